@@ -4,6 +4,7 @@
 // DeepSpeed Team
 
 #include "cpu_adagrad.h"
+#include "cpu_numa.h"
 #include <torch/extension.h>
 #include <iostream>
 #include <memory>
@@ -29,10 +30,8 @@ void Adagrad_Optimizer::Step_1(float* _params,
                                bool half_precision)
 {
     size_t rounded_size = 0;
-#if defined(__AVX512__) or defined(__AVX256__)
-    Step_AVX<1>(
+    Step_SIMD<1>(
         &rounded_size, _params, grads, _exp_avg_sq, _param_size, dev_params, half_precision);
-#endif
     if (_param_size > rounded_size) {
         float step_size = -1 * _alpha;
         ds_half_precision_t* grads_cast_h;
@@ -48,7 +47,7 @@ void Adagrad_Optimizer::Step_1(float* _params,
 #if defined(__ENABLE_CUDA__)
             if ((t / TILE) >= 2) { cudaStreamSynchronize(_streams[_buf_index]); }
 #endif
-#pragma omp parallel for
+#pragma omp parallel for schedule(static)
             for (size_t k = t; k < offset; k++) {
                 float grad = half_precision ? (float)grads_cast_h[k] : grads[k];
                 float param = half_precision ? (float)params_cast_h[k] : _params[k];
@@ -92,10 +91,8 @@ void Adagrad_Optimizer::Step_4(float* _params,
                                bool half_precision)
 {
     size_t rounded_size = 0;
-#if defined(__AVX512__) or defined(__AVX256__)
-    Step_AVX<4>(
+    Step_SIMD<4>(
         &rounded_size, _params, grads, _exp_avg_sq, _param_size, dev_params, half_precision);
-#endif
     if (_param_size > rounded_size)
         Step_1((_params + rounded_size),
                (grads + rounded_size),
@@ -116,16 +113,7 @@ int create_adagrad_optimizer(int optimizer_id,
     s_optimizers[optimizer_id] = opt;
 
     if (should_log) {
-        std::string avx_type = "";
-#if defined(__AVX512__)
-        avx_type = "AVX512";
-#else
-#if defined(__AVX256__)
-        avx_type = "AVX2";
-#else
-        avx_type = "scalar";
-#endif
-#endif
+        std::string avx_type = ds_simd_isa_name(ds_simd_active_isa());
 
         printf("Adagrad Optimizer #%d is created with %s arithmetic capability.\n",
                optimizer_id,
@@ -144,10 +132,8 @@ void Adagrad_Optimizer::Step_8(float* _params,
                                bool half_precision)
 {
     size_t rounded_size = 0;
-#if defined(__AVX512__) or defined(__AVX256__)
-    Step_AVX<8>(
+    Step_SIMD<8>(
         &rounded_size, _params, grads, _exp_avg_sq, _param_size, dev_params, half_precision);
-#endif
     if (_param_size > rounded_size)
         Step_4((_params + rounded_size),
                (grads + rounded_size),
@@ -166,6 +152,8 @@ int ds_adagrad_step(int optimizer_id,
                     torch::Tensor& grads,
                     torch::Tensor& exp_avg_sq)
 {
+    // Thread 0 of the team runs on the caller, keep its chunk on the node of its state.
+    Numa_Master_Guard numa_guard;
     auto params_c = params.contiguous();
     auto grads_c = grads.contiguous();
     auto exp_avg_sq_c = exp_avg_sq.contiguous();
@@ -196,6 +184,7 @@ int ds_adagrad_step_plus_copy(int optimizer_id,
                               torch::Tensor& exp_avg_sq,
                               torch::Tensor& gpu_params)
 {
+    Numa_Master_Guard numa_guard;
 #if defined(__ENABLE_CUDA__)
     auto params_c = params.contiguous();
     auto gpu_params_c = gpu_params.contiguous();
@@ -232,6 +221,14 @@ int destroy_adagrad_optimizer(int optimizer_id)
     return 0;
 }
 
+int numa_init() { return ds_numa_pin_threads(); }
+
+// First touches `state` with the tiles and vectors the bulk Step_8 updates it with.
+void numa_zero(torch::Tensor& state)
+{
+    ds_numa_zero_tensor(state, TILE, ds_simd_step_vector(ds_simd_active_isa(), 8));
+}
+
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
     m.def("adagrad_update", &ds_adagrad_step, "DeepSpeed CPU Adagrad update (C++)");
@@ -240,4 +237,6 @@ PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
           "DeepSpeed CPU Adagrad update and param copy (C++)");
     m.def("create_adagrad", &create_adagrad_optimizer, "DeepSpeed CPU Adagrad (C++)");
     m.def("destroy_adagrad", &destroy_adagrad_optimizer, "DeepSpeed CPU Adagrad destroy (C++)");
+    m.def("numa_init", &numa_init, "Pin the CPU Adagrad threads to NUMA nodes (C++)");
+    m.def("numa_zero", &numa_zero, "Zero optimizer state with NUMA local first touch (C++)");
 }
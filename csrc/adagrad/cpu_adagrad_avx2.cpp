@@ -0,0 +1,44 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+AVX2 kernels of the CPU Adagrad optimizer for builds with runtime SIMD dispatch.
+*/
+
+#if defined(__DS_SIMD_DISPATCH__)
+
+// Headers are pulled in before the target switch, so only the kernels below carry AVX2 code.
+#include <stdio.h>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <x86intrin.h>
+#if defined(__ENABLE_CUDA__)
+#include <cuda_fp16.h>
+#include <cuda_runtime_api.h>
+#include "cuda.h"
+#include "custom_cuda_layers.h"
+#endif
+
+#pragma GCC target("avx2,fma,f16c")
+#define __AVX256__
+
+#include "cpu_adagrad.h"
+
+#define INSTANTIATE_STEP_AVX(SPAN)                                                     \
+    template void Adagrad_Optimizer::Step_AVX<SPAN, DS_SIMD_ISA>(size_t*,              \
+                                                                 float*,               \
+                                                                 float*,               \
+                                                                 float*,               \
+                                                                 size_t,               \
+                                                                 ds_half_precision_t*, \
+                                                                 bool);
+
+INSTANTIATE_STEP_AVX(1)
+INSTANTIATE_STEP_AVX(4)
+INSTANTIATE_STEP_AVX(8)
+
+#endif
@@ -4,12 +4,16 @@
 // DeepSpeed Team
 
 #include "cpu_adam.h"
+#include "cpu_numa.h"
 #include <torch/extension.h>
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <memory>
+#include <tuple>
 #include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 #if defined(__ENABLE_CUDA__)
 #include <cuda_runtime_api.h>
@@ -21,6 +25,14 @@
 
 static std::unordered_map<int, std::shared_ptr<void>> s_optimizers;
 
+static ds_dtype_t get_ds_dtype(const torch::Tensor& tensor)
+{
+    if (tensor.options().dtype() == at::kHalf) return DS_DTYPE_FP16;
+    if (tensor.options().dtype() == at::kBFloat16) return DS_DTYPE_BF16;
+    assert(tensor.options().dtype() == at::kFloat);
+    return DS_DTYPE_FP32;
+}
+
 // C++ interface
 
 void Adam_Optimizer::Step_1(float* _params,
@@ -29,43 +41,60 @@ void Adam_Optimizer::Step_1(float* _params,
                             float* _exp_avg_sq,
                             size_t _param_size,
                             ds_half_precision_t* dev_params,
-                            bool half_precision)
+                            ds_dtype_t param_dtype,
+                            ds_dtype_t grad_dtype,
+                            ds_dtype_t dev_param_dtype)
 {
     size_t rounded_size = 0;
-#if defined(__AVX512__) or defined(__AVX256__)
-    Step_AVX<1>(&rounded_size,
-                _params,
-                grads,
-                _exp_avg,
-                _exp_avg_sq,
-                _param_size,
-                dev_params,
-                half_precision);
-#endif
+    Step_SIMD<1>(&rounded_size,
+                 _params,
+                 grads,
+                 _exp_avg,
+                 _exp_avg_sq,
+                 _param_size,
+                 dev_params,
+                 param_dtype,
+                 grad_dtype,
+                 dev_param_dtype);
     if (_param_size > rounded_size) {
         float betta1_minus1 = 1 - _betta1;
         float betta2_minus1 = 1 - _betta2;
 
         float step_size = -1 * _alpha / _bias_correction1;
         float w_decay = -1 * _alpha * _weight_decay;
-        ds_half_precision_t* grads_cast_h;
-        ds_half_precision_t* params_cast_h;
-        if (half_precision) {
-            grads_cast_h = reinterpret_cast<ds_half_precision_t*>(grads);
-            params_cast_h = reinterpret_cast<ds_half_precision_t*>(_params);
-        }
+        ds_half_precision_t* grads_cast_h = reinterpret_cast<ds_half_precision_t*>(grads);
+        ds_half_precision_t* params_cast_h = reinterpret_cast<ds_half_precision_t*>(_params);
+        uint16_t* grads_cast_bf16 = reinterpret_cast<uint16_t*>(grads);
+        uint16_t* params_cast_bf16 = reinterpret_cast<uint16_t*>(_params);
+#if defined(__ENABLE_CUDA__)
+        const bool bf16_copy = (dev_param_dtype == DS_DTYPE_BF16);
+#endif
+        const size_t tile = step_tile(dev_params != nullptr, 1);
+#if defined(__ENABLE_CUDA__)
+        std::shared_ptr<Pinned_Staging_Ring> staging;
+        if (dev_params) { staging = Pinned_Staging_Ring::Get(_copy_depth, tile); }
+#endif
 
-        for (size_t t = rounded_size; t < _param_size; t += TILE) {
-            size_t copy_size = TILE;
-            if ((t + TILE) > _param_size) copy_size = _param_size - t;
+        for (size_t t = rounded_size; t < _param_size; t += tile) {
+            size_t copy_size = tile;
+            if ((t + tile) > _param_size) copy_size = _param_size - t;
             size_t offset = copy_size + t;
 #if defined(__ENABLE_CUDA__)
-            if ((t / TILE) >= 2) { cudaStreamSynchronize(_streams[_buf_index]); }
+            const int slot = dev_params ? staging->acquire() : -1;
+            float* staging_buffer = dev_params ? staging->buffer(slot) : nullptr;
 #endif
-#pragma omp parallel for
+#pragma omp parallel for schedule(static)
             for (size_t k = t; k < offset; k++) {
-                float grad = half_precision ? (float)grads_cast_h[k] : grads[k];
-                float param = half_precision ? (float)params_cast_h[k] : _params[k];
+                float grad = (grad_dtype == DS_DTYPE_FP16)
+                                 ? (float)grads_cast_h[k]
+                                 : (grad_dtype == DS_DTYPE_BF16
+                                        ? ds_bf16_to_float(grads_cast_bf16[k])
+                                        : grads[k]);
+                float param = (param_dtype == DS_DTYPE_FP16)
+                                  ? (float)params_cast_h[k]
+                                  : (param_dtype == DS_DTYPE_BF16
+                                         ? ds_bf16_to_float(params_cast_bf16[k])
+                                         : _params[k]);
                 float momentum = _exp_avg[k];
                 float variance = _exp_avg_sq[k];
                 if (_weight_decay > 0 && !_adamw_mode) { grad = param * _weight_decay + grad; }
@@ -82,10 +111,18 @@ void Adam_Optimizer::Step_1(float* _params,
                 if (_weight_decay > 0 && _adamw_mode) { param += w_decay * param; }
                 param = grad * step_size + param;
 #if defined(__ENABLE_CUDA__)
-                if (dev_params) _doubled_buffer[_buf_index][k - t] = param;
+                if (dev_params) {
+                    if (bf16_copy)
+                        reinterpret_cast<uint16_t*>(staging_buffer)[k - t] =
+                            ds_float_to_bf16(param);
+                    else
+                        staging_buffer[k - t] = param;
+                }
 #endif
-                if (half_precision)
+                if (param_dtype == DS_DTYPE_FP16)
                     params_cast_h[k] = (ds_half_precision_t)param;
+                else if (param_dtype == DS_DTYPE_BF16)
+                    params_cast_bf16[k] = ds_float_to_bf16(param);
                 else
                     _params[k] = param;
                 _exp_avg[k] = momentum;
@@ -93,10 +130,17 @@ void Adam_Optimizer::Step_1(float* _params,
             }
 #if defined(__ENABLE_CUDA__)
             if (dev_params) {
-                launch_param_update(
-                    _doubled_buffer[_buf_index], dev_params + t, (copy_size), _streams[_buf_index]);
+                if (bf16_copy)
+                    cudaMemcpyAsync(dev_params + t,
+                                    staging_buffer,
+                                    copy_size * sizeof(ds_half_precision_t),
+                                    cudaMemcpyHostToDevice,
+                                    staging->stream(slot));
+                else
+                    launch_param_update(
+                        staging_buffer, dev_params + t, (copy_size), staging->stream(slot));
 
-                _buf_index = !_buf_index;
+                staging->release(slot);
             }
 #endif
         }
@@ -109,27 +153,31 @@ void Adam_Optimizer::Step_4(float* _params,
                             float* _exp_avg_sq,
                             size_t _param_size,
                             ds_half_precision_t* dev_params,
-                            bool half_precision)
+                            ds_dtype_t param_dtype,
+                            ds_dtype_t grad_dtype,
+                            ds_dtype_t dev_param_dtype)
 {
     size_t rounded_size = 0;
-#if defined(__AVX512__) or defined(__AVX256__)
-    Step_AVX<4>(&rounded_size,
-                _params,
-                grads,
-                _exp_avg,
-                _exp_avg_sq,
-                _param_size,
-                dev_params,
-                half_precision);
-#endif
+    Step_SIMD<4>(&rounded_size,
+                 _params,
+                 grads,
+                 _exp_avg,
+                 _exp_avg_sq,
+                 _param_size,
+                 dev_params,
+                 param_dtype,
+                 grad_dtype,
+                 dev_param_dtype);
     if (_param_size > rounded_size)
-        Step_1((_params + rounded_size),
-               (grads + rounded_size),
+        Step_1(ds_dtype_offset(_params, rounded_size, param_dtype),
+               ds_dtype_offset(grads, rounded_size, grad_dtype),
                (_exp_avg + rounded_size),
                (_exp_avg_sq + rounded_size),
                (_param_size - rounded_size),
                (dev_params != nullptr ? (dev_params + rounded_size) : dev_params),
-               half_precision);
+               param_dtype,
+               grad_dtype,
+               dev_param_dtype);
 }
 
 int create_adam_optimizer(int optimizer_id,
@@ -139,24 +187,17 @@ int create_adam_optimizer(int optimizer_id,
                           float eps = 1e-8,
                           float weight_decay = 0,
                           bool adamw_mode = true,
-                          bool should_log = false)
+                          bool should_log = false,
+                          int copy_depth = DEFAULT_COPY_DEPTH,
+                          size_t copy_tile = TILE)
 {
-    auto opt =
-        std::make_shared<Adam_Optimizer>(alpha, betta1, betta2, eps, weight_decay, adamw_mode);
+    auto opt = std::make_shared<Adam_Optimizer>(
+        alpha, betta1, betta2, eps, weight_decay, adamw_mode, copy_depth, copy_tile);
 
     s_optimizers[optimizer_id] = opt;
 
     if (should_log) {
-        std::string avx_type = "";
-#if defined(__AVX512__)
-        avx_type = "AVX512";
-#else
-#if defined(__AVX256__)
-        avx_type = "AVX2";
-#else
-        avx_type = "scalar";
-#endif
-#endif
+        std::string avx_type = ds_simd_isa_name(ds_simd_active_isa());
 
         printf("Adam Optimizer #%d is created with %s arithmetic capability.\n",
                optimizer_id,
@@ -178,27 +219,95 @@ void Adam_Optimizer::Step_8(float* _params,
                             float* _exp_avg_sq,
                             size_t _param_size,
                             ds_half_precision_t* dev_params,
-                            bool half_precision)
+                            ds_dtype_t param_dtype,
+                            ds_dtype_t grad_dtype,
+                            ds_dtype_t dev_param_dtype)
 {
     size_t rounded_size = 0;
-#if defined(__AVX512__) or defined(__AVX256__)
-    Step_AVX<8>(&rounded_size,
-                _params,
-                grads,
-                _exp_avg,
-                _exp_avg_sq,
-                _param_size,
-                dev_params,
-                half_precision);
-#endif
+    Step_SIMD<8>(&rounded_size,
+                 _params,
+                 grads,
+                 _exp_avg,
+                 _exp_avg_sq,
+                 _param_size,
+                 dev_params,
+                 param_dtype,
+                 grad_dtype,
+                 dev_param_dtype);
     if (_param_size > rounded_size)
-        Step_4((_params + rounded_size),
-               (grads + rounded_size),
+        Step_4(ds_dtype_offset(_params, rounded_size, param_dtype),
+               ds_dtype_offset(grads, rounded_size, grad_dtype),
                (_exp_avg + rounded_size),
                (_exp_avg_sq + rounded_size),
                (_param_size - rounded_size),
                (dev_params != nullptr ? (dev_params + rounded_size) : dev_params),
-               half_precision);
+               param_dtype,
+               grad_dtype,
+               dev_param_dtype);
+}
+
+void Adam_Optimizer::Step_Quantized(float* _params,
+                                    float* grads,
+                                    uint8_t* _exp_avg,
+                                    uint8_t* _exp_avg_sq,
+                                    float* _absmax,
+                                    size_t _param_size,
+                                    ds_dtype_t param_dtype,
+                                    ds_dtype_t grad_dtype,
+                                    uint32_t seed)
+{
+    constexpr size_t block = state_quant::block_size;
+    const size_t num_blocks = (_param_size + block - 1) / block;
+
+    // Fresh rounding noise every step, reproducible for a given seed.
+    const uint32_t step_seed = state_quant::hash(seed, static_cast<uint32_t>(_step));
+    const uint32_t m_seed = state_quant::hash(step_seed, 0);
+    const uint32_t v_seed = state_quant::hash(step_seed, 1);
+
+    // Every block is dequantized, updated by the regular kernels and requantized by one thread,
+    // the parallel loops inside Step_8 are nested and run serially.
+#pragma omp parallel for schedule(static)
+    for (size_t b = 0; b < num_blocks; ++b) {
+        const size_t start = b * block;
+        const size_t count = std::min(block, _param_size - start);
+
+        float momentum[block];
+        float variance[block];
+        const float m_absmax = _absmax[2 * b];
+        const float v_absmax = _absmax[2 * b + 1];
+        for (size_t k = 0; k < count; ++k) {
+            momentum[k] = state_quant::decode_exp_avg(_exp_avg[start + k], m_absmax);
+            variance[k] = state_quant::decode_exp_avg_sq(_exp_avg_sq[start + k], v_absmax);
+        }
+
+        Step_8(ds_dtype_offset(_params, start, param_dtype),
+               ds_dtype_offset(grads, start, grad_dtype),
+               momentum,
+               variance,
+               count,
+               nullptr,
+               param_dtype,
+               grad_dtype);
+
+        float m_max = 0;
+        float v_max = 0;
+        for (size_t k = 0; k < count; ++k) {
+            m_max = std::max(m_max, std::fabs(momentum[k]));
+            v_max = std::max(v_max, variance[k]);
+        }
+        _absmax[2 * b] = m_max;
+        _absmax[2 * b + 1] = v_max;
+
+        const float inv_m_max = state_quant::inverse_absmax(m_max);
+        const float inv_v_max = state_quant::inverse_absmax(v_max);
+        for (size_t k = 0; k < count; ++k) {
+            const uint32_t index = static_cast<uint32_t>(start + k);
+            _exp_avg[start + k] = state_quant::encode_exp_avg(
+                momentum[k], inv_m_max, state_quant::hash(m_seed, index));
+            _exp_avg_sq[start + k] = state_quant::encode_exp_avg_sq(
+                variance[k], inv_v_max, state_quant::hash(v_seed, index));
+        }
+    }
 }
 
 int ds_adam_step(int optimizer_id,
@@ -214,13 +323,13 @@ int ds_adam_step(int optimizer_id,
                  torch::Tensor& exp_avg,
                  torch::Tensor& exp_avg_sq)
 {
+    // Thread 0 of the team runs on the caller, keep its chunk on the node of its state.
+    Numa_Master_Guard numa_guard;
     auto params_c = params.contiguous();
     auto grads_c = grads.contiguous();
     auto exp_avg_c = exp_avg.contiguous();
     auto exp_avg_sq_c = exp_avg_sq.contiguous();
 
-    // assert(params.options().dtype() == grads.options().dtype());
-
     float* params_ptr = (float*)params_c.data_ptr();
     float* grads_ptr = (float*)grads_c.data_ptr();
     float* exp_avg_ptr = (float*)exp_avg_c.data_ptr();
@@ -237,7 +346,8 @@ int ds_adam_step(int optimizer_id,
                 exp_avg_sq_ptr,
                 params_c.numel(),
                 nullptr,
-                (params.options().dtype() == at::kHalf));
+                get_ds_dtype(params_c),
+                get_ds_dtype(grads_c));
 
 #if defined(__ENABLE_CUDA__)
     opt->SynchronizeStreams();
@@ -245,6 +355,114 @@ int ds_adam_step(int optimizer_id,
     return 0;
 }
 
+int ds_adam_step_quantized(int optimizer_id,
+                           size_t step,
+                           float lr,
+                           float beta1,
+                           float beta2,
+                           float epsilon,
+                           float weight_decay,
+                           bool bias_correction,
+                           torch::Tensor& params,
+                           torch::Tensor& grads,
+                           torch::Tensor& exp_avg,
+                           torch::Tensor& exp_avg_sq,
+                           torch::Tensor& absmax,
+                           int64_t seed)
+{
+    Numa_Master_Guard numa_guard;
+    // The 8-bit state is updated in place, so it must not be a temporary contiguous copy.
+    assert(exp_avg.is_contiguous() && exp_avg.scalar_type() == at::kByte);
+    assert(exp_avg_sq.is_contiguous() && exp_avg_sq.scalar_type() == at::kByte);
+    assert(absmax.is_contiguous() && absmax.scalar_type() == at::kFloat);
+    assert(absmax.numel() ==
+           2 * ((params.numel() + state_quant::block_size - 1) / state_quant::block_size));
+
+    auto params_c = params.contiguous();
+    auto grads_c = grads.contiguous();
+
+    std::shared_ptr<Adam_Optimizer> opt =
+        std::static_pointer_cast<Adam_Optimizer>(s_optimizers[optimizer_id]);
+    opt->IncrementStep(step, beta1, beta2);
+    opt->update_state(lr, epsilon, weight_decay, bias_correction);
+
+    opt->Step_Quantized((float*)params_c.data_ptr(),
+                        (float*)grads_c.data_ptr(),
+                        exp_avg.data_ptr<uint8_t>(),
+                        exp_avg_sq.data_ptr<uint8_t>(),
+                        absmax.data_ptr<float>(),
+                        params_c.numel(),
+                        get_ds_dtype(params_c),
+                        get_ds_dtype(grads_c),
+                        static_cast<uint32_t>(seed));
+
+    return 0;
+}
+
+// Elements per work item of the multi tensor step, a multiple of SIMD_WIDTH * 8 on every ISA.
+#define MULTI_TENSOR_CHUNK (64 * 1024)
+
+int ds_adam_step_multi(int optimizer_id,
+                       size_t step,
+                       float lr,
+                       float beta1,
+                       float beta2,
+                       float epsilon,
+                       float weight_decay,
+                       bool bias_correction,
+                       std::vector<torch::Tensor>& params,
+                       std::vector<torch::Tensor>& grads,
+                       std::vector<torch::Tensor>& exp_avg,
+                       std::vector<torch::Tensor>& exp_avg_sq)
+{
+    Numa_Master_Guard numa_guard;
+    const auto num_tensors = params.size();
+    assert(grads.size() == num_tensors);
+    assert(exp_avg.size() == num_tensors);
+    assert(exp_avg_sq.size() == num_tensors);
+
+    std::vector<torch::Tensor> params_c, grads_c, exp_avg_c, exp_avg_sq_c;
+    std::vector<ds_dtype_t> param_dtypes, grad_dtypes;
+    // (tensor index, first element, number of elements) of every work item.
+    std::vector<std::tuple<size_t, size_t, size_t>> chunks;
+    for (size_t i = 0; i < num_tensors; ++i) {
+        params_c.push_back(params[i].contiguous());
+        grads_c.push_back(grads[i].contiguous());
+        exp_avg_c.push_back(exp_avg[i].contiguous());
+        exp_avg_sq_c.push_back(exp_avg_sq[i].contiguous());
+        param_dtypes.push_back(get_ds_dtype(params_c[i]));
+        grad_dtypes.push_back(get_ds_dtype(grads_c[i]));
+
+        const size_t numel = params_c[i].numel();
+        for (size_t start = 0; start < numel; start += MULTI_TENSOR_CHUNK) {
+            chunks.emplace_back(i, start, std::min<size_t>(MULTI_TENSOR_CHUNK, numel - start));
+        }
+    }
+
+    std::shared_ptr<Adam_Optimizer> opt =
+        std::static_pointer_cast<Adam_Optimizer>(s_optimizers[optimizer_id]);
+    opt->IncrementStep(step, beta1, beta2);
+    opt->update_state(lr, epsilon, weight_decay, bias_correction);
+
+    // One parallel region over the equally sized chunks of all tensors, the parallel loops inside
+    // Step_8 are nested and run serially on the calling thread.
+#pragma omp parallel for schedule(static)
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        const auto i = std::get<0>(chunks[c]);
+        const auto start = std::get<1>(chunks[c]);
+        opt->Step_8(ds_dtype_offset((float*)params_c[i].data_ptr(), start, param_dtypes[i]),
+                    ds_dtype_offset((float*)grads_c[i].data_ptr(), start, grad_dtypes[i]),
+                    (float*)exp_avg_c[i].data_ptr() + start,
+                    (float*)exp_avg_sq_c[i].data_ptr() + start,
+                    std::get<2>(chunks[c]),
+                    nullptr,
+                    param_dtypes[i],
+                    grad_dtypes[i]);
+    }
+
+    return 0;
+}
+
 int ds_adam_step_plus_copy(int optimizer_id,
                            size_t step,
                            float lr,
@@ -259,6 +477,7 @@ int ds_adam_step_plus_copy(int optimizer_id,
                            torch::Tensor& exp_avg_sq,
                            torch::Tensor& gpu_params)
 {
+    Numa_Master_Guard numa_guard;
 #if defined(__ENABLE_CUDA__)
     auto params_c = params.contiguous();
     auto gpu_params_c = gpu_params.contiguous();
@@ -282,7 +501,9 @@ int ds_adam_step_plus_copy(int optimizer_id,
                 exp_avg_sq_ptr,
                 params_c.numel(),
                 gpu_params_ptr,
-                (params.options().dtype() == at::kHalf));
+                get_ds_dtype(params_c),
+                get_ds_dtype(grads_c),
+                get_ds_dtype(gpu_params_c));
 
     opt->SynchronizeStreams();
 #else
@@ -294,16 +515,39 @@ int ds_adam_step_plus_copy(int optimizer_id,
 int destroy_adam_optimizer(int optimizer_id)
 {
     s_optimizers.erase(optimizer_id);
+#if defined(__ENABLE_CUDA__)
+    if (s_optimizers.empty()) { Pinned_Staging_Ring::Release(); }
+#endif
 
     return 0;
 }
 
+int numa_init() { return ds_numa_pin_threads(); }
+
+// First touches `state` with the tiles and vectors the bulk Step_8 of optimizer_id updates it with,
+// with or without the param copy to the device.
+void numa_zero(int optimizer_id, torch::Tensor& state, bool copy)
+{
+    std::shared_ptr<Adam_Optimizer> opt =
+        std::static_pointer_cast<Adam_Optimizer>(s_optimizers[optimizer_id]);
+    const size_t vector = ds_simd_step_vector(ds_simd_active_isa(), 8);
+    ds_numa_zero_tensor(state, opt->step_tile(copy, vector), vector);
+}
+
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
     m.def("adam_update", &ds_adam_step, "DeepSpeed CPU Adam update (C++)");
+    m.def("adam_update_multi",
+          &ds_adam_step_multi,
+          "DeepSpeed CPU Adam update over lists of tensors (C++)");
+    m.def("adam_update_quantized",
+          &ds_adam_step_quantized,
+          "DeepSpeed CPU Adam update with blockwise 8-bit moments (C++)");
     m.def("adam_update_copy",
           &ds_adam_step_plus_copy,
           "DeepSpeed CPU Adam update and param copy (C++)");
     m.def("create_adam", &create_adam_optimizer, "DeepSpeed CPU Adam (C++)");
     m.def("destroy_adam", &destroy_adam_optimizer, "DeepSpeed CPU Adam destroy (C++)");
+    m.def("numa_init", &numa_init, "Pin the CPU Adam threads to NUMA nodes (C++)");
+    m.def("numa_zero", &numa_zero, "Zero optimizer state with NUMA local first touch (C++)");
 }
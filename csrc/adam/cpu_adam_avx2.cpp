@@ -0,0 +1,55 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+AVX2 kernels of the CPU Adam optimizer for builds with runtime SIMD dispatch.
+*/
+
+#if defined(__DS_SIMD_DISPATCH__)
+
+// Headers are pulled in before the target switch, so only the kernels below carry AVX2 code.
+// Their inline functions would otherwise be emitted as weak AVX2 copies the linker may pick
+// for the generic unit. The optimizer header follows it for the ISA macros, its kernels only
+// call the per-ISA helpers of simd.h and the functions declared above.
+#include <stdio.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <x86intrin.h>
+#if defined(__ENABLE_CUDA__)
+#include <cuda_fp16.h>
+#include <cuda_runtime_api.h>
+#include "cuda.h"
+#include "custom_cuda_layers.h"
+#endif
+#include "blockwise_state_quant.h"
+#include "cpu_staging_ring.h"
+
+#pragma GCC target("avx2,fma,f16c")
+#define __AVX256__
+
+#include "cpu_adam.h"
+
+#define INSTANTIATE_STEP_AVX(SPAN)                                                  \
+    template void Adam_Optimizer::Step_AVX<SPAN, DS_SIMD_ISA>(size_t*,              \
+                                                              float*,               \
+                                                              float*,               \
+                                                              float*,               \
+                                                              float*,               \
+                                                              size_t,               \
+                                                              ds_half_precision_t*, \
+                                                              ds_dtype_t,           \
+                                                              ds_dtype_t,           \
+                                                              ds_dtype_t);
+
+INSTANTIATE_STEP_AVX(1)
+INSTANTIATE_STEP_AVX(4)
+INSTANTIATE_STEP_AVX(8)
+
+#endif
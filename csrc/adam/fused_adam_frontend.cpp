@@ -15,11 +15,94 @@ void multi_tensor_adam_cuda(int chunk_size,
                             const int step,
                             const int mode,
                             const int bias_correction,
-                            const float weight_decay);
+                            const float weight_decay,
+                            const float inv_scale,
+                            at::Tensor found_inf,
+                            at::Tensor clip_coef,
+                            at::Tensor step_tensor);
+
+void multi_tensor_adam_8bit_cuda(int chunk_size,
+                                 at::Tensor noop_flag,
+                                 std::vector<std::vector<at::Tensor>> tensor_lists,
+                                 const float lr,
+                                 const float beta1,
+                                 const float beta2,
+                                 const float epsilon,
+                                 const int step,
+                                 const int mode,
+                                 const int bias_correction,
+                                 const float weight_decay,
+                                 const float inv_scale,
+                                 at::Tensor found_inf,
+                                 at::Tensor clip_coef,
+                                 const int64_t seed,
+                                 at::Tensor step_tensor);
+
+std::vector<at::Tensor> onebit_worker_compress_cuda(at::Tensor buffer,
+                                                    at::Tensor worker_error,
+                                                    int num_chunks);
+
+std::vector<at::Tensor> onebit_server_compress_cuda(at::Tensor signs,
+                                                    at::Tensor scales,
+                                                    at::Tensor server_error);
+
+void onebit_decompress_cuda(at::Tensor output, at::Tensor signs, at::Tensor scales);
 
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
     m.def("multi_tensor_adam",
           &multi_tensor_adam_cuda,
-          "Compute and apply gradient update to parameters for Adam optimizer");
+          "Compute and apply gradient update to parameters for Adam optimizer",
+          py::arg("chunk_size"),
+          py::arg("noop_flag"),
+          py::arg("tensor_lists"),
+          py::arg("lr"),
+          py::arg("beta1"),
+          py::arg("beta2"),
+          py::arg("epsilon"),
+          py::arg("step"),
+          py::arg("mode"),
+          py::arg("bias_correction"),
+          py::arg("weight_decay"),
+          py::arg("inv_scale") = 1.0f,
+          py::arg("found_inf") = at::Tensor(),
+          py::arg("clip_coef") = at::Tensor(),
+          py::arg("step_tensor") = at::Tensor());
+    m.def("multi_tensor_adam_8bit",
+          &multi_tensor_adam_8bit_cuda,
+          "Adam update with the moments stored as blockwise 8-bit codes",
+          py::arg("chunk_size"),
+          py::arg("noop_flag"),
+          py::arg("tensor_lists"),
+          py::arg("lr"),
+          py::arg("beta1"),
+          py::arg("beta2"),
+          py::arg("epsilon"),
+          py::arg("step"),
+          py::arg("mode"),
+          py::arg("bias_correction"),
+          py::arg("weight_decay"),
+          py::arg("inv_scale") = 1.0f,
+          py::arg("found_inf") = at::Tensor(),
+          py::arg("clip_coef") = at::Tensor(),
+          py::arg("seed") = 0,
+          py::arg("step_tensor") = at::Tensor());
+    m.def("onebit_worker_compress",
+          &onebit_worker_compress_cuda,
+          "1-bit compression of buffer + worker_error in one chunk per rank, updating worker_error",
+          py::arg("buffer"),
+          py::arg("worker_error"),
+          py::arg("num_chunks"));
+    m.def("onebit_server_compress",
+          &onebit_server_compress_cuda,
+          "1-bit compression of the average of the received signs, updating server_error",
+          py::arg("signs"),
+          py::arg("scales"),
+          py::arg("server_error"));
+    m.def("onebit_decompress",
+          &onebit_decompress_cuda,
+          "Expand the packed signs of every rank, scaled by their scale, into output",
+          py::arg("output"),
+          py::arg("signs"),
+          py::arg("scales"));
 }
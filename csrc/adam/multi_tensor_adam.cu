@@ -17,7 +17,9 @@ This file is adapted from fused adam in NVIDIA/apex, commit a109f85
 
 #include <assert.h>
 
+#include "blockwise_state_quant.h"
 #include "multi_tensor_apply.cuh"
+#include "reduction_utils.h"
 #include "type_shim.h"
 
 #define BLOCK_SIZE 512
@@ -42,12 +44,31 @@ struct AdamFunctor {
                                                const float epsilon,
                                                const float lr,
                                                adamMode_t mode,
-                                               const float decay)
+                                               const float decay,
+                                               const float inv_scale,
+                                               const float* found_inf,
+                                               const float* clip_coef,
+                                               const float* step,
+                                               const int bias_correction)
     {
         // I'd like this kernel to propagate infs/nans.
         // if(*noop_gmem == 1)
         //   return;
 
+        // An overflow flagged on the device skips the whole step, without a sync on the host.
+        if (found_inf != nullptr && *found_inf != 0) return;
+
+        // A step count kept on the device replaces the one the host corrections are computed from.
+        MATH_T bias_correction1 = beta1_correction, bias_correction2 = beta2_correction;
+        if (step != nullptr && bias_correction == 1) {
+            bias_correction1 = 1 - powf(beta1, *step);
+            bias_correction2 = 1 - powf(beta2, *step);
+        }
+
+        // Loss scale and clipping are folded into the gradient as it is read.
+        MATH_T grad_scale = inv_scale;
+        if (clip_coef != nullptr) grad_scale *= *clip_coef;
+
         int tensor_loc = tl.block_to_tensor[blockIdx.x];
 
         // potentially use to pass in list of scalar
@@ -80,7 +101,7 @@ struct AdamFunctor {
             for (int ii = 0; ii < ILP; ii++) {
                 int i = i_start + threadIdx.x + ii * blockDim.x;
                 if (i < n && i < chunk_size) {
-                    r_g[ii] = g[i];
+                    r_g[ii] = static_cast<MATH_T>(g[i]) * grad_scale;
                     r_p[ii] = p[i];
                     r_m[ii] = m[i];
                     r_v[ii] = v[i];
@@ -97,16 +118,16 @@ struct AdamFunctor {
                     r_g[ii] = r_g[ii] + (decay * r_p[ii]);
                     r_m[ii] = beta1 * r_m[ii] + (1 - beta1) * r_g[ii];
                     r_v[ii] = beta2 * r_v[ii] + (1 - beta2) * r_g[ii] * r_g[ii];
-                    MATH_T next_m_unbiased = r_m[ii] / beta1_correction;
-                    MATH_T next_v_unbiased = r_v[ii] / beta2_correction;
+                    MATH_T next_m_unbiased = r_m[ii] / bias_correction1;
+                    MATH_T next_v_unbiased = r_v[ii] / bias_correction2;
                     MATH_T denom = sqrtf(next_v_unbiased) + epsilon;
                     MATH_T update = next_m_unbiased / denom;
                     r_p[ii] = r_p[ii] - (lr * update);
                 } else {  // weight decay
                     r_m[ii] = beta1 * r_m[ii] + (1 - beta1) * r_g[ii];
                     r_v[ii] = beta2 * r_v[ii] + (1 - beta2) * r_g[ii] * r_g[ii];
-                    MATH_T next_m_unbiased = r_m[ii] / beta1_correction;
-                    MATH_T next_v_unbiased = r_v[ii] / beta2_correction;
+                    MATH_T next_m_unbiased = r_m[ii] / bias_correction1;
+                    MATH_T next_v_unbiased = r_v[ii] / bias_correction2;
                     MATH_T denom = sqrtf(next_v_unbiased) + epsilon;
                     MATH_T update = (next_m_unbiased / denom) + (decay * r_p[ii]);
                     r_p[ii] = r_p[ii] - (lr * update);
@@ -125,6 +146,166 @@ struct AdamFunctor {
     }
 };
 
+// Adam with exp_avg and exp_avg_sq kept as blockwise 8-bit codes (see blockwise_state_quant.h).
+// Each pass of the i_start loop covers exactly one quantization block, so a block is dequantized,
+// updated, reduced to its new absmax and requantized by the same thread block.
+template <typename T>
+struct Adam8bitFunctor {
+    static_assert(BLOCK_SIZE * ILP == state_quant::block_size,
+                  "one i_start pass must cover one quantization block");
+
+    __device__ __forceinline__ void operator()(int chunk_size,
+                                               volatile int* noop_gmem,
+                                               TensorListMetadata<5>& tl,
+                                               const float beta1,
+                                               const float beta2,
+                                               const float beta1_correction,
+                                               const float beta2_correction,
+                                               const float epsilon,
+                                               const float lr,
+                                               adamMode_t mode,
+                                               const float decay,
+                                               const float inv_scale,
+                                               const float* found_inf,
+                                               const float* clip_coef,
+                                               const float* step,
+                                               const int bias_correction,
+                                               const int host_step,
+                                               const uint32_t seed)
+    {
+        if (found_inf != nullptr && *found_inf != 0) return;
+
+        MATH_T bias_correction1 = beta1_correction, bias_correction2 = beta2_correction;
+        if (step != nullptr && bias_correction == 1) {
+            bias_correction1 = 1 - powf(beta1, *step);
+            bias_correction2 = 1 - powf(beta2, *step);
+        }
+        // Fresh rounding noise every step, reproducible for a given seed.
+        const uint32_t step_seed = state_quant::hash(
+            seed, static_cast<uint32_t>(step != nullptr ? static_cast<int>(*step) : host_step));
+
+        MATH_T grad_scale = inv_scale;
+        if (clip_coef != nullptr) grad_scale *= *clip_coef;
+
+        cg::thread_block tb = cg::this_thread_block();
+        cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+
+        int tensor_loc = tl.block_to_tensor[blockIdx.x];
+        int tensor_num = tl.start_tensor_this_launch + tensor_loc;
+
+        int chunk_idx = tl.block_to_chunk[blockIdx.x];
+        int n = tl.sizes[tensor_loc];
+
+        T* g = (T*)tl.addresses[0][tensor_loc];
+        g += chunk_idx * chunk_size;
+
+        T* p = (T*)tl.addresses[1][tensor_loc];
+        p += chunk_idx * chunk_size;
+
+        uint8_t* m = (uint8_t*)tl.addresses[2][tensor_loc];
+        m += chunk_idx * chunk_size;
+
+        uint8_t* v = (uint8_t*)tl.addresses[3][tensor_loc];
+        v += chunk_idx * chunk_size;
+
+        // Interleaved exp_avg and exp_avg_sq absmax of every block of the tensor.
+        float* absmax = (float*)tl.addresses[4][tensor_loc];
+        absmax += 2 * (chunk_idx * chunk_size / state_quant::block_size);
+
+        n -= chunk_idx * chunk_size;
+
+        const uint32_t m_seed = state_quant::hash(step_seed, 2 * tensor_num);
+        const uint32_t v_seed = state_quant::hash(step_seed, 2 * tensor_num + 1);
+
+        for (int i_start = 0, q = 0; i_start < n && i_start < chunk_size;
+             i_start += blockDim.x * ILP, q++) {
+            const float m_absmax = absmax[2 * q];
+            const float v_absmax = absmax[2 * q + 1];
+
+            MATH_T r_g[ILP];
+            MATH_T r_p[ILP];
+            MATH_T r_m[ILP];
+            MATH_T r_v[ILP];
+#pragma unroll
+            for (int ii = 0; ii < ILP; ii++) {
+                int i = i_start + threadIdx.x + ii * blockDim.x;
+                if (i < n && i < chunk_size) {
+                    r_g[ii] = static_cast<MATH_T>(g[i]) * grad_scale;
+                    r_p[ii] = p[i];
+                    r_m[ii] = state_quant::decode_exp_avg(m[i], m_absmax);
+                    r_v[ii] = state_quant::decode_exp_avg_sq(v[i], v_absmax);
+                } else {
+                    r_g[ii] = MATH_T(0);
+                    r_p[ii] = MATH_T(0);
+                    r_m[ii] = MATH_T(0);
+                    r_v[ii] = MATH_T(0);
+                }
+            }
+            MATH_T m_max = 0;
+            MATH_T v_max = 0;
+#pragma unroll
+            for (int ii = 0; ii < ILP; ii++) {
+                if (mode == ADAM_MODE_0) {  // L2
+                    r_g[ii] = r_g[ii] + (decay * r_p[ii]);
+                    r_m[ii] = beta1 * r_m[ii] + (1 - beta1) * r_g[ii];
+                    r_v[ii] = beta2 * r_v[ii] + (1 - beta2) * r_g[ii] * r_g[ii];
+                    MATH_T next_m_unbiased = r_m[ii] / bias_correction1;
+                    MATH_T next_v_unbiased = r_v[ii] / bias_correction2;
+                    MATH_T denom = sqrtf(next_v_unbiased) + epsilon;
+                    MATH_T update = next_m_unbiased / denom;
+                    r_p[ii] = r_p[ii] - (lr * update);
+                } else {  // weight decay
+                    r_m[ii] = beta1 * r_m[ii] + (1 - beta1) * r_g[ii];
+                    r_v[ii] = beta2 * r_v[ii] + (1 - beta2) * r_g[ii] * r_g[ii];
+                    MATH_T next_m_unbiased = r_m[ii] / bias_correction1;
+                    MATH_T next_v_unbiased = r_v[ii] / bias_correction2;
+                    MATH_T denom = sqrtf(next_v_unbiased) + epsilon;
+                    MATH_T update = (next_m_unbiased / denom) + (decay * r_p[ii]);
+                    r_p[ii] = r_p[ii] - (lr * update);
+                }
+                // Padding lanes hold zero moments, so they never raise the absmax.
+                m_max = fmaxf(m_max, fabsf(r_m[ii]));
+                v_max = fmaxf(v_max, r_v[ii]);
+            }
+
+            reduce::block<reduce::ROpType::Max, reduce::ROpType::Max>(tb, warp, m_max, v_max);
+            // Every thread has read the old absmax before the reduction returns.
+            if (threadIdx.x == 0) {
+                absmax[2 * q] = m_max;
+                absmax[2 * q + 1] = v_max;
+            }
+            const float inv_m_max = state_quant::inverse_absmax(m_max);
+            const float inv_v_max = state_quant::inverse_absmax(v_max);
+
+#pragma unroll
+            for (int ii = 0; ii < ILP; ii++) {
+                int i = i_start + threadIdx.x + ii * blockDim.x;
+                if (i < n && i < chunk_size) {
+                    const uint32_t index = chunk_idx * chunk_size + i;
+                    p[i] = r_p[ii];
+                    m[i] = state_quant::encode_exp_avg(
+                        r_m[ii], inv_m_max, state_quant::hash(m_seed, index));
+                    v[i] = state_quant::encode_exp_avg_sq(
+                        r_v[ii], inv_v_max, state_quant::hash(v_seed, index));
+                }
+            }
+            // The reduction scratch in shared memory is reused by the next block.
+            tb.sync();
+        }
+    }
+};
+
+// Device pointer of an optional one element scalar, nullptr for an undefined or empty tensor.
+static const float* optional_device_scalar(const at::Tensor& scalar, const at::Tensor& ref)
+{
+    if (!scalar.defined() || scalar.numel() == 0) return nullptr;
+    TORCH_CHECK(scalar.numel() == 1 && scalar.scalar_type() == at::ScalarType::Float &&
+                    scalar.device() == ref.device(),
+                "found_inf, clip_coef and step_tensor must be empty or one element float tensors "
+                "on the device of the params");
+    return scalar.data_ptr<float>();
+}
+
 void multi_tensor_adam_cuda(int chunk_size,
                             at::Tensor noop_flag,
                             std::vector<std::vector<at::Tensor>> tensor_lists,
@@ -135,10 +316,18 @@ void multi_tensor_adam_cuda(int chunk_size,
                             const int step,
                             const int mode,
                             const int bias_correction,
-                            const float weight_decay)
+                            const float weight_decay,
+                            const float inv_scale,
+                            at::Tensor found_inf,
+                            at::Tensor clip_coef,
+                            at::Tensor step_tensor)
 {
     using namespace at;
 
+    const float* found_inf_ptr = optional_device_scalar(found_inf, tensor_lists[0][0]);
+    const float* clip_coef_ptr = optional_device_scalar(clip_coef, tensor_lists[0][0]);
+    const float* step_ptr = optional_device_scalar(step_tensor, tensor_lists[0][0]);
+
     // Handle bias correction mode
     float bias_correction1 = 1.0f, bias_correction2 = 1.0f;
     if (bias_correction == 1) {
@@ -162,7 +351,83 @@ void multi_tensor_adam_cuda(int chunk_size,
                                                          epsilon,
                                                          lr,
                                                          (adamMode_t)mode,
-                                                         weight_decay);)
+                                                         weight_decay,
+                                                         inv_scale,
+                                                         found_inf_ptr,
+                                                         clip_coef_ptr,
+                                                         step_ptr,
+                                                         bias_correction);)
+
+    AT_CUDA_CHECK(cudaGetLastError());
+}
+
+void multi_tensor_adam_8bit_cuda(int chunk_size,
+                                 at::Tensor noop_flag,
+                                 std::vector<std::vector<at::Tensor>> tensor_lists,
+                                 const float lr,
+                                 const float beta1,
+                                 const float beta2,
+                                 const float epsilon,
+                                 const int step,
+                                 const int mode,
+                                 const int bias_correction,
+                                 const float weight_decay,
+                                 const float inv_scale,
+                                 at::Tensor found_inf,
+                                 at::Tensor clip_coef,
+                                 const int64_t seed,
+                                 at::Tensor step_tensor)
+{
+    using namespace at;
+
+    // Lists are g, p, exp_avg codes, exp_avg_sq codes and the per block absmax.
+    TORCH_CHECK(tensor_lists.size() == 5, "expected g, p, exp_avg, exp_avg_sq and absmax lists");
+    TORCH_CHECK(chunk_size % state_quant::block_size == 0,
+                "chunk_size must be a multiple of the quantization block size");
+    for (size_t t = 0; t < tensor_lists[0].size(); t++) {
+        const int64_t blocks =
+            (tensor_lists[0][t].numel() + state_quant::block_size - 1) / state_quant::block_size;
+        TORCH_CHECK(tensor_lists[2][t].scalar_type() == at::ScalarType::Byte &&
+                        tensor_lists[3][t].scalar_type() == at::ScalarType::Byte,
+                    "quantized exp_avg and exp_avg_sq must be uint8");
+        TORCH_CHECK(tensor_lists[4][t].scalar_type() == at::ScalarType::Float &&
+                        tensor_lists[4][t].numel() == 2 * blocks,
+                    "absmax must hold two floats per quantization block");
+    }
+
+    const float* found_inf_ptr = optional_device_scalar(found_inf, tensor_lists[0][0]);
+    const float* clip_coef_ptr = optional_device_scalar(clip_coef, tensor_lists[0][0]);
+    const float* step_ptr = optional_device_scalar(step_tensor, tensor_lists[0][0]);
+
+    float bias_correction1 = 1.0f, bias_correction2 = 1.0f;
+    if (bias_correction == 1) {
+        bias_correction1 = 1 - std::pow(beta1, step);
+        bias_correction2 = 1 - std::pow(beta2, step);
+    }
+
+    DISPATCH_FLOAT_AND_HALF(tensor_lists[0][0].scalar_type(),
+                            0,
+                            "adam_8bit",
+                            multi_tensor_apply<5, 2>(BLOCK_SIZE,
+                                                     chunk_size,
+                                                     noop_flag,
+                                                     tensor_lists,
+                                                     Adam8bitFunctor<scalar_t_0>(),
+                                                     beta1,
+                                                     beta2,
+                                                     bias_correction1,
+                                                     bias_correction2,
+                                                     epsilon,
+                                                     lr,
+                                                     (adamMode_t)mode,
+                                                     weight_decay,
+                                                     inv_scale,
+                                                     found_inf_ptr,
+                                                     clip_coef_ptr,
+                                                     step_ptr,
+                                                     bias_correction,
+                                                     step,
+                                                     static_cast<uint32_t>(seed));)
 
     AT_CUDA_CHECK(cudaGetLastError());
 }
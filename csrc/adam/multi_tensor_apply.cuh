@@ -45,7 +45,9 @@ __global__ void multi_tensor_apply_kernel(int chunk_size,
     callable(chunk_size, noop_flag, tl, args...);
 }
 
-template <int depth, typename T, typename... ArgTypes>
+// Only the first sized_depth lists must match the element counts of the first list, later ones
+// may hold per tensor side data such as quantization scales.
+template <int depth, int sized_depth = depth, typename T, typename... ArgTypes>
 void multi_tensor_apply(int block_size,
                         int chunk_size,
                         const at::Tensor& noop_flag,
@@ -71,7 +73,9 @@ void multi_tensor_apply(int block_size,
             TORCH_CHECK(contiguous_memory, "A tensor was not contiguous.");
             TORCH_CHECK(tensor_lists[l][t].device() == ref_device,
                         "A tensor was not on the same device as the first tensor");
-            TORCH_CHECK(tensor_lists[l][t].numel() == tensor_lists[0][t].numel(), "Size mismatch");
+            TORCH_CHECK(
+                l >= sized_depth || tensor_lists[l][t].numel() == tensor_lists[0][t].numel(),
+                "Size mismatch");
         }
     }
 
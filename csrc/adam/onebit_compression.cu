@@ -0,0 +1,291 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Fused compression kernels of the 1-bit optimizers (1-bit Adam/LAMB, 0/1 Adam).
+
+Compressing a buffer x with error feedback sends sign(x) with one scale, ||x|| / sqrt(n), and
+keeps x - scale * sign(x) as the error added to the next buffer. The scale needs the whole
+buffer, so every compression is two kernels: a deterministic partial sum of squares, then a pass
+that finishes the scale, writes the new error and packs the signs, each block reducing the
+partials itself. Signs are packed into 32-bit words, bit j of word w holding element 32 * w + j
+of its chunk (1 for x >= 0), and every chunk starts on a new word so it can be sent on its own.
+
+On the workers x is the momentum plus the worker error and the packed signs are split in one
+chunk per rank. On the servers x is the average of the signs received from every rank, times
+their scales, plus the server error; the signs are read again in the second pass rather than
+storing the average. A last kernel expands the signs gathered from the servers.
+*/
+
+#include <ATen/ATen.h>
+#include <ATen/cuda/CUDAContext.h>
+#include <ATen/cuda/Exceptions.h>
+#include <torch/extension.h>
+
+#include "reduction_utils.h"
+
+namespace onebit {
+constexpr int threads = 256;
+constexpr int bits_per_word = 32;
+// Elements whose signs one block packs at a time, one word per thread
+constexpr int tile = threads * bits_per_word;
+// Upper bound on the blocks of the sum of squares, read back by every packing block
+constexpr int max_partials = 1024;
+}  // namespace onebit
+
+// Worker input: momentum plus the error left by the previous compression
+struct worker_input_t {
+    const float* buffer;
+    const float* error;
+
+    __device__ __forceinline__ float operator()(int64_t i) const { return buffer[i] + error[i]; }
+};
+
+// Server input: average of the signs received from every rank, plus the server error
+struct server_input_t {
+    const int32_t* signs;
+    const float* scales;
+    const float* error;
+    int ranks;
+    int words_per_chunk;
+    float inv_ranks;
+
+    __device__ __forceinline__ float operator()(int64_t i) const
+    {
+        const int64_t word = i / onebit::bits_per_word;
+        const int bit = i % onebit::bits_per_word;
+        float sum = 0.f;
+        for (int r = 0; r < ranks; r++) {
+            const int32_t packed = signs[r * words_per_chunk + word];
+            sum += ((packed >> bit) & 1) ? scales[r] : -scales[r];
+        }
+        return sum * inv_ranks + error[i];
+    }
+};
+
+template <typename Input>
+__global__ void onebit_sum_squares(float* partials, Input input, int64_t numel)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+
+    float sum = 0.f;
+    for (int64_t i = blockIdx.x * onebit::threads + threadIdx.x; i < numel;
+         i += (int64_t)gridDim.x * onebit::threads) {
+        const float x = input(i);
+        sum += x * x;
+    }
+
+    reduce::block<reduce::ROpType::Add>(tb, warp, sum);
+    if (threadIdx.x == 0) { partials[blockIdx.x] = sum; }
+}
+
+template <typename Input>
+__global__ void onebit_sign_pack(int32_t* packed,
+                                 float* error,
+                                 float* scale_out,
+                                 const float* partials,
+                                 int num_partials,
+                                 Input input,
+                                 int64_t chunk_elems,
+                                 int num_chunks,
+                                 int words_per_chunk)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+
+    __shared__ uint8_t positive[onebit::tile];
+
+    // Same summation order in every block, so they all agree on the scale
+    float sum = 0.f;
+    for (int i = threadIdx.x; i < num_partials; i += onebit::threads) { sum += partials[i]; }
+    reduce::block<reduce::ROpType::Add>(tb, warp, sum);
+    const float scale = sqrtf(sum / (float)(chunk_elems * num_chunks));
+    if (blockIdx.x == 0 && threadIdx.x == 0) { *scale_out = scale; }
+
+    const int64_t tiles_per_chunk = (chunk_elems + onebit::tile - 1) / onebit::tile;
+    for (int64_t t = blockIdx.x; t < tiles_per_chunk * num_chunks; t += gridDim.x) {
+        const int64_t chunk = t / tiles_per_chunk;
+        const int64_t tile_start = (t % tiles_per_chunk) * onebit::tile;
+
+        // Coalesced pass over the elements, signs staged in shared memory
+        for (int j = threadIdx.x; j < onebit::tile; j += onebit::threads) {
+            const int64_t offset = tile_start + j;
+            bool is_positive = false;
+            if (offset < chunk_elems) {
+                const int64_t i = chunk * chunk_elems + offset;
+                const float x = input(i);
+                is_positive = x >= 0.f;
+                error[i] = x - (is_positive ? scale : -scale);
+            }
+            positive[j] = is_positive;
+        }
+        tb.sync();
+
+        const int64_t word = tile_start / onebit::bits_per_word + threadIdx.x;
+        if (word < words_per_chunk) {
+            uint32_t bits = 0;
+#pragma unroll
+            for (int b = 0; b < onebit::bits_per_word; b++) {
+                bits |= (uint32_t)positive[threadIdx.x * onebit::bits_per_word + b] << b;
+            }
+            packed[chunk * words_per_chunk + word] = (int32_t)bits;
+        }
+        // The next tile overwrites the staged signs
+        tb.sync();
+    }
+}
+
+// output[r * chunk_elems + i] = +/- scales[r] for the sign of element i of chunk r
+__global__ void onebit_sign_unpack(float* output,
+                                   const int32_t* signs,
+                                   const float* scales,
+                                   int64_t chunk_elems,
+                                   int words_per_chunk,
+                                   int64_t numel)
+{
+    for (int64_t i = blockIdx.x * onebit::threads + threadIdx.x; i < numel;
+         i += (int64_t)gridDim.x * onebit::threads) {
+        const int64_t chunk = i / chunk_elems;
+        const int64_t offset = i % chunk_elems;
+        const int32_t packed =
+            signs[chunk * words_per_chunk + offset / onebit::bits_per_word];
+        const float scale = scales[chunk];
+        output[i] = ((packed >> (offset % onebit::bits_per_word)) & 1) ? scale : -scale;
+    }
+}
+
+static int words_per_chunk(int64_t chunk_elems)
+{
+    return (chunk_elems + onebit::bits_per_word - 1) / onebit::bits_per_word;
+}
+
+static int grid_size(int64_t numel, int64_t elems_per_block, int max_blocks)
+{
+    return std::max<int64_t>(std::min<int64_t>((numel + elems_per_block - 1) / elems_per_block,
+                                               max_blocks),
+                             1);
+}
+
+template <typename Input>
+static void onebit_compress(at::Tensor& packed,
+                            at::Tensor& error,
+                            at::Tensor& scale,
+                            Input input,
+                            int64_t chunk_elems,
+                            int num_chunks)
+{
+    cudaStream_t stream = at::cuda::getCurrentCUDAStream();
+    const int64_t numel = chunk_elems * num_chunks;
+
+    // A few elements per thread before the partials are reduced
+    const int num_partials = grid_size(numel, 4 * onebit::threads, onebit::max_partials);
+    auto partials = at::empty({num_partials}, error.options());
+    onebit_sum_squares<<<num_partials, onebit::threads, 0, stream>>>(
+        partials.data_ptr<float>(), input, numel);
+
+    const int sm_count = at::cuda::getCurrentDeviceProperties()->multiProcessorCount;
+    const int pack_blocks = grid_size(numel, onebit::tile, 4 * sm_count);
+    onebit_sign_pack<<<pack_blocks, onebit::threads, 0, stream>>>(packed.data_ptr<int32_t>(),
+                                                                  error.data_ptr<float>(),
+                                                                  scale.data_ptr<float>(),
+                                                                  partials.data_ptr<float>(),
+                                                                  num_partials,
+                                                                  input,
+                                                                  chunk_elems,
+                                                                  num_chunks,
+                                                                  words_per_chunk(chunk_elems));
+    AT_CUDA_CHECK(cudaGetLastError());
+}
+
+/*
+Worker side: compresses buffer + worker_error into one chunk of signs per rank and updates
+worker_error in place. Returns {signs [num_chunks, words], scale [1]}.
+*/
+std::vector<at::Tensor> onebit_worker_compress_cuda(at::Tensor buffer,
+                                                    at::Tensor worker_error,
+                                                    int num_chunks)
+{
+    TORCH_CHECK(buffer.is_cuda() && buffer.scalar_type() == at::kFloat && buffer.is_contiguous(),
+                "buffer must be a contiguous fp32 CUDA tensor");
+    TORCH_CHECK(worker_error.scalar_type() == at::kFloat && worker_error.is_contiguous() &&
+                    worker_error.numel() == buffer.numel(),
+                "worker_error must be a contiguous fp32 tensor of the size of the buffer");
+    TORCH_CHECK(num_chunks > 0 && buffer.numel() % num_chunks == 0,
+                "the buffer must split evenly in num_chunks");
+
+    const int64_t chunk_elems = buffer.numel() / num_chunks;
+    auto signs = at::empty({num_chunks, words_per_chunk(chunk_elems)},
+                           buffer.options().dtype(at::kInt));
+    auto scale = at::empty({1}, buffer.options());
+
+    worker_input_t input{buffer.data_ptr<float>(), worker_error.data_ptr<float>()};
+    onebit_compress(signs, worker_error, scale, input, chunk_elems, num_chunks);
+    return {signs, scale};
+}
+
+/*
+Server side: averages the signs of its chunk received from every rank ([ranks, words]) with
+their scales ([ranks]), adds server_error and compresses the result, updating server_error in
+place. Returns {signs [1, words], scale [1]}.
+*/
+std::vector<at::Tensor> onebit_server_compress_cuda(at::Tensor signs,
+                                                    at::Tensor scales,
+                                                    at::Tensor server_error)
+{
+    TORCH_CHECK(signs.scalar_type() == at::kInt && signs.dim() == 2 && signs.is_contiguous(),
+                "signs must be a contiguous int32 [ranks, words] tensor");
+    TORCH_CHECK(scales.scalar_type() == at::kFloat && scales.numel() == signs.size(0),
+                "scales must hold one fp32 scale per rank");
+    TORCH_CHECK(server_error.scalar_type() == at::kFloat && server_error.is_contiguous() &&
+                    words_per_chunk(server_error.numel()) == signs.size(1),
+                "server_error must be a contiguous fp32 tensor of the size of one chunk");
+
+    const int ranks = signs.size(0);
+    const int64_t chunk_elems = server_error.numel();
+    auto scales_c = scales.contiguous();
+    auto server_signs = at::empty({1, signs.size(1)}, signs.options());
+    auto server_scale = at::empty({1}, server_error.options());
+
+    server_input_t input{signs.data_ptr<int32_t>(),
+                         scales_c.data_ptr<float>(),
+                         server_error.data_ptr<float>(),
+                         ranks,
+                         (int)signs.size(1),
+                         1.f / ranks};
+    onebit_compress(server_signs, server_error, server_scale, input, chunk_elems, 1);
+    return {server_signs, server_scale};
+}
+
+/*
+Expands the signs gathered from every server ([ranks, words]) with their scales ([ranks]) into
+output, chunk r of output coming from rank r.
+*/
+void onebit_decompress_cuda(at::Tensor output, at::Tensor signs, at::Tensor scales)
+{
+    TORCH_CHECK(output.scalar_type() == at::kFloat && output.is_contiguous(),
+                "output must be a contiguous fp32 tensor");
+    TORCH_CHECK(signs.scalar_type() == at::kInt && signs.dim() == 2 && signs.is_contiguous(),
+                "signs must be a contiguous int32 [ranks, words] tensor");
+    TORCH_CHECK(scales.scalar_type() == at::kFloat && scales.numel() == signs.size(0),
+                "scales must hold one fp32 scale per rank");
+    TORCH_CHECK(output.numel() % signs.size(0) == 0 &&
+                    words_per_chunk(output.numel() / signs.size(0)) == signs.size(1),
+                "output must hold one chunk per rank of signs");
+
+    cudaStream_t stream = at::cuda::getCurrentCUDAStream();
+    auto scales_c = scales.contiguous();
+    const int64_t numel = output.numel();
+    const int sm_count = at::cuda::getCurrentDeviceProperties()->multiProcessorCount;
+    const int blocks = grid_size(numel, 4 * onebit::threads, 4 * sm_count);
+
+    onebit_sign_unpack<<<blocks, onebit::threads, 0, stream>>>(output.data_ptr<float>(),
+                                                               signs.data_ptr<int32_t>(),
+                                                               scales_c.data_ptr<float>(),
+                                                               numel / signs.size(0),
+                                                               signs.size(1),
+                                                               numel);
+    AT_CUDA_CHECK(cudaGetLastError());
+}
@@ -57,9 +57,11 @@ static void _report_aio_statistics(const char* tag,
               << " min/max/avg = " << min_lat << " " << max_lat << " " << avg_lat << std::endl;
 }
 
-static void _get_aio_latencies(std::vector<std::chrono::duration<double>>& raw_latencies,
-                               struct deepspeed_aio_latency_t& summary_latencies)
+void _get_aio_latencies(std::vector<std::chrono::duration<double>>& raw_latencies,
+                        struct deepspeed_aio_latency_t& summary_latencies)
 {
+    if (raw_latencies.empty()) { return; }
+
     std::vector<double> lat_usec;
     for (auto& lat : raw_latencies) { lat_usec.push_back(lat.count() * 1e6); }
     summary_latencies._min_usec = *(std::min_element(lat_usec.begin(), lat_usec.end()));
@@ -127,7 +129,8 @@ void do_aio_operation_sequential(const bool read_op,
                                  std::unique_ptr<aio_context>& aio_ctxt,
                                  std::unique_ptr<io_xfer_ctxt>& xfer_ctxt,
                                  deepspeed_aio_config_t* config,
-                                 deepspeed_aio_perf_t* perf)
+                                 deepspeed_aio_perf_t* perf,
+                                 deepspeed_aio_stats_t* stats)
 {
     struct io_prep_context prep_ctxt(read_op, xfer_ctxt, aio_ctxt->_block_size, &aio_ctxt->_iocbs);
 
@@ -160,10 +163,13 @@ void do_aio_operation_sequential(const bool read_op,
             _do_io_submit_block(n_iocbs, iocb_index, aio_ctxt, submit_times);
         }
 
+        if (stats) { stats->record_queue_depth(n_iocbs); }
         _do_io_complete(n_iocbs, n_iocbs, aio_ctxt, reap_times);
     }
     const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
 
+    if (stats) { stats->record_latencies(submit_times, reap_times); }
+
     if (perf) {
         _get_aio_latencies(submit_times, perf->_submit);
         _get_aio_latencies(reap_times, perf->_complete);
@@ -191,7 +197,8 @@ void do_aio_operation_overlap(const bool read_op,
                               std::unique_ptr<aio_context>& aio_ctxt,
                               std::unique_ptr<io_xfer_ctxt>& xfer_ctxt,
                               deepspeed_aio_config_t* config,
-                              deepspeed_aio_perf_t* perf)
+                              deepspeed_aio_perf_t* perf,
+                              deepspeed_aio_stats_t* stats)
 {
     struct io_prep_generator io_gen(read_op, xfer_ctxt, aio_ctxt->_block_size);
 
@@ -225,6 +232,7 @@ void do_aio_operation_overlap(const bool read_op,
 
         if (n_pending_iocbs == 0) { break; }
 
+        if (stats) { stats->record_queue_depth(n_pending_iocbs); }
         const auto n_complete =
             _do_io_complete(min_completes, n_pending_iocbs, aio_ctxt, reap_times);
         n_pending_iocbs -= n_complete;
@@ -232,6 +240,8 @@ void do_aio_operation_overlap(const bool read_op,
 
     const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
 
+    if (stats) { stats->record_latencies(submit_times, reap_times); }
+
     if (perf) {
         _get_aio_latencies(submit_times, perf->_submit);
         _get_aio_latencies(reap_times, perf->_complete);
@@ -255,6 +265,82 @@ void do_aio_operation_overlap(const bool read_op,
 #endif
 }
 
+void do_aio_operation_batch(const bool read_op,
+                            std::unique_ptr<aio_context>& aio_ctxt,
+                            std::vector<std::unique_ptr<io_xfer_ctxt>>& xfer_ctxts,
+                            deepspeed_aio_config_t* config,
+                            deepspeed_aio_perf_t* perf,
+                            deepspeed_aio_stats_t* stats)
+{
+    std::vector<std::unique_ptr<io_prep_generator>> io_gens;
+    long long int total_bytes = 0;
+    for (auto& xfer_ctxt : xfer_ctxts) {
+        io_gens.emplace_back(new io_prep_generator(read_op, xfer_ctxt, aio_ctxt->_block_size));
+        total_bytes += xfer_ctxt->_num_bytes;
+    }
+
+#if DEBUG_DS_AIO_PERF
+    const auto io_op_name = std::string(read_op ? "read" : "write");
+    std::cout << c_library_name << ": start batch " << io_op_name << " " << total_bytes
+              << " bytes in " << xfer_ctxts.size() << " transfers" << std::endl;
+#endif
+
+    std::vector<std::chrono::duration<double>> submit_times;
+    std::vector<std::chrono::duration<double>> reap_times;
+
+    // Keep the queue full across transfer boundaries, so small tensors do not drain it.
+    size_t gen_index = 0;
+    auto n_pending_iocbs = 0;
+    const auto min_completes = 1;
+    auto start = std::chrono::high_resolution_clock::now();
+    while (true) {
+        while (gen_index < io_gens.size() && n_pending_iocbs < aio_ctxt->_queue_depth) {
+            auto& io_gen = io_gens[gen_index];
+            const auto n_iocbs =
+                io_gen->prep_iocbs(aio_ctxt->_queue_depth - n_pending_iocbs, &aio_ctxt->_iocbs);
+            if (n_iocbs == 0) {
+                ++gen_index;
+                continue;
+            }
+
+            if (config->_single_submit) {
+                _do_io_submit_singles(
+                    n_iocbs, (io_gen->_next_iocb_index - n_iocbs), aio_ctxt, submit_times);
+            } else {
+                _do_io_submit_block(
+                    n_iocbs, (io_gen->_next_iocb_index - n_iocbs), aio_ctxt, submit_times);
+            }
+            n_pending_iocbs += n_iocbs;
+        }
+        assert(n_pending_iocbs <= aio_ctxt->_queue_depth);
+
+        if (n_pending_iocbs == 0) { break; }
+
+        if (stats) { stats->record_queue_depth(n_pending_iocbs); }
+        const auto n_complete =
+            _do_io_complete(min_completes, n_pending_iocbs, aio_ctxt, reap_times);
+        n_pending_iocbs -= n_complete;
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    if (stats) { stats->record_latencies(submit_times, reap_times); }
+
+    if (perf) {
+        _get_aio_latencies(submit_times, perf->_submit);
+        _get_aio_latencies(reap_times, perf->_complete);
+        perf->_e2e_usec = elapsed.count() * 1e6;
+        perf->_e2e_rate_GB = (total_bytes / elapsed.count() / 1e9);
+    }
+
+#if DEBUG_DS_AIO_PERF
+    _report_aio_statistics("submit", submit_times);
+    _report_aio_statistics("complete", reap_times);
+    std::cout << c_library_name << ": finish batch " << io_op_name << " " << total_bytes
+              << " bytes " << std::endl;
+#endif
+}
+
 void report_file_error(const char* filename, const std::string file_op, const int error_code)
 {
     std::string err_msg = file_op + std::string(" failed on ") + std::string(filename) +
@@ -7,8 +7,11 @@
 Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
 */
 
+#pragma once
+
 #include <deepspeed_aio_utils.h>
 #include <stdlib.h>
+#include <chrono>
 #include <memory>
 #include <string>
 
@@ -18,13 +21,26 @@ void do_aio_operation_sequential(const bool read_op,
                                  std::unique_ptr<aio_context>& aio_ctxt,
                                  std::unique_ptr<io_xfer_ctxt>& xfer_ctxt,
                                  deepspeed_aio_config_t* config,
-                                 deepspeed_aio_perf_t* perf);
+                                 deepspeed_aio_perf_t* perf,
+                                 deepspeed_aio_stats_t* stats = nullptr);
 
 void do_aio_operation_overlap(const bool read_op,
                               std::unique_ptr<aio_context>& aio_ctxt,
                               std::unique_ptr<io_xfer_ctxt>& xfer_ctxt,
                               deepspeed_aio_config_t* config,
-                              deepspeed_aio_perf_t* perf);
+                              deepspeed_aio_perf_t* perf,
+                              deepspeed_aio_stats_t* stats = nullptr);
+
+// Overlapped submission over several transfers sharing one queue.
+void do_aio_operation_batch(const bool read_op,
+                            std::unique_ptr<aio_context>& aio_ctxt,
+                            std::vector<std::unique_ptr<io_xfer_ctxt>>& xfer_ctxts,
+                            deepspeed_aio_config_t* config,
+                            deepspeed_aio_perf_t* perf,
+                            deepspeed_aio_stats_t* stats = nullptr);
+
+void _get_aio_latencies(std::vector<std::chrono::duration<double>>& raw_latencies,
+                        struct deepspeed_aio_latency_t& summary_latencies);
 
 int open_file(const char* filename, const bool read_op);
 
@@ -0,0 +1,147 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Functionality for swapping tensors to/from (NVMe) storage devices.
+GPUDirect Storage (cuFile) engine.
+*/
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <mutex>
+
+#if defined(DS_AIO_GDS)
+#include <cuda_runtime.h>
+#include <cufile.h>
+#endif
+
+#include "deepspeed_aio_gds.h"
+
+using namespace std;
+
+static const std::string c_library_name = "deepspeed_aio";
+
+bool gds_engine_available()
+{
+#if defined(DS_AIO_GDS)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool gds_driver_open()
+{
+#if defined(DS_AIO_GDS)
+    static std::once_flag driver_once;
+    static bool driver_open = false;
+    std::call_once(driver_once, [] {
+        const auto status = cuFileDriverOpen();
+        driver_open = (status.err == CU_FILE_SUCCESS);
+        if (!driver_open) {
+            std::cerr << c_library_name << ": cuFileDriverOpen failed with error " << status.err
+                      << std::endl;
+        }
+    });
+    return driver_open;
+#else
+    return false;
+#endif
+}
+
+gds_file_t::gds_file_t(const int fd, const bool owns_fd)
+    : _fd(fd), _owns_fd(owns_fd), _handle(nullptr)
+{
+#if defined(DS_AIO_GDS)
+    CUfileDescr_t descr;
+    memset(&descr, 0, sizeof(descr));
+    descr.handle.fd = fd;
+    descr.type = CU_FILE_HANDLE_TYPE_OPAQUE_FD;
+
+    CUfileHandle_t handle;
+    const auto status = cuFileHandleRegister(&handle, &descr);
+    if (status.err == CU_FILE_SUCCESS) {
+        _handle = handle;
+    } else {
+        std::cerr << c_library_name << ": cuFileHandleRegister failed with error " << status.err
+                  << std::endl;
+    }
+#endif
+}
+
+gds_file_t::~gds_file_t()
+{
+#if defined(DS_AIO_GDS)
+    if (_handle) { cuFileHandleDeregister(static_cast<CUfileHandle_t>(_handle)); }
+#endif
+    if (_owns_fd) { close(_fd); }
+}
+
+bool gds_file_t::is_valid() const { return _handle != nullptr; }
+
+std::shared_ptr<gds_file_t> gds_file_cache_t::get(const std::string& filename, const int fd)
+{
+    struct stat fd_stat;
+    if (fstat(fd, &fd_stat) != 0) { return nullptr; }
+
+    auto iter = _files.find(filename);
+    if (iter != _files.end()) {
+        if (iter->second._dev == fd_stat.st_dev && iter->second._ino == fd_stat.st_ino) {
+            return iter->second._file;
+        }
+        // Replaced file, ops still in flight keep the old registration alive until they retire.
+        _files.erase(iter);
+    }
+
+    // Opened for both directions, later ops on the path may read or write.
+    const auto cached_fd = open(filename.c_str(), O_RDWR | O_DIRECT);
+    if (cached_fd == -1) {
+        // Not writable by us: register the op's own fd for this op only, as before caching.
+        auto file = std::make_shared<gds_file_t>(fd);
+        return file->is_valid() ? file : nullptr;
+    }
+
+    auto file = std::make_shared<gds_file_t>(cached_fd, true);
+    if (!file->is_valid()) { return nullptr; }
+    _files[filename] = {fd_stat.st_dev, fd_stat.st_ino, file};
+    return file;
+}
+
+int do_gds_operation(const bool read_op,
+                     const int device,
+                     const std::shared_ptr<gds_file_t>& gds_file,
+                     std::unique_ptr<io_xfer_ctxt>& xfer_ctxt)
+{
+#if defined(DS_AIO_GDS)
+    // aio worker threads have no current device, cuFile needs the context of the buffer.
+    cudaSetDevice(device);
+
+    auto handle = static_cast<CUfileHandle_t>(gds_file->_handle);
+    const auto device_ptr = const_cast<void*>(xfer_ctxt->_mem_buffer);
+
+    // cuFile may transfer fewer bytes than requested, continue from where it stopped.
+    long long int done_bytes = 0;
+    while (done_bytes < xfer_ctxt->_num_bytes) {
+        const auto num_bytes = static_cast<size_t>(xfer_ctxt->_num_bytes - done_bytes);
+        const auto file_offset = static_cast<off_t>(xfer_ctxt->_base_offset + done_bytes);
+        const auto ret =
+            read_op ? cuFileRead(handle, device_ptr, num_bytes, file_offset, done_bytes)
+                    : cuFileWrite(handle, device_ptr, num_bytes, file_offset, done_bytes);
+        if (ret <= 0) {
+            std::cerr << c_library_name << ": cuFile " << (read_op ? "read" : "write")
+                      << " failed with error " << ret << std::endl;
+            return -1;
+        }
+        done_bytes += ret;
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,56 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Functionality for swapping tensors to/from (NVMe) storage devices.
+GPUDirect Storage (cuFile) engine, DMA's directly between files and device memory when the
+op is built against libcufile.
+*/
+
+#pragma once
+
+#include <deepspeed_aio_utils.h>
+#include <sys/types.h>
+#include <map>
+#include <memory>
+#include <string>
+
+bool gds_engine_available();
+
+// Opens the cuFile driver once per process, returns false if GDS is unusable.
+bool gds_driver_open();
+
+struct gds_file_t {
+    const int _fd;
+    const bool _owns_fd;
+    void* _handle;
+
+    gds_file_t(const int fd, const bool owns_fd = false);
+    ~gds_file_t();
+
+    bool is_valid() const;
+};
+
+// cuFile handles registered by an aio handle, kept for its lifetime so that each file pays for
+// cuFileHandleRegister once instead of on every op. Entries are keyed by path, on an fd of their
+// own, and registered again when the path names another file. Only used from the thread that
+// schedules the ops.
+struct gds_file_cache_t {
+    struct entry_t {
+        dev_t _dev;
+        ino_t _ino;
+        std::shared_ptr<gds_file_t> _file;
+    };
+    std::map<std::string, entry_t> _files;
+
+    // Registered handle of filename, given open as fd. Returns nullptr if it cannot be registered.
+    std::shared_ptr<gds_file_t> get(const std::string& filename, const int fd);
+};
+
+// Transfers xfer_ctxt->_num_bytes between the device buffer and the file, returns 0 on success.
+int do_gds_operation(const bool read_op,
+                     const int device,
+                     const std::shared_ptr<gds_file_t>& gds_file,
+                     std::unique_ptr<io_xfer_ctxt>& xfer_ctxt);
@@ -21,7 +21,9 @@ deepspeed_aio_config_t::deepspeed_aio_config_t()
       _queue_depth(c_io_queue_depth),
       _single_submit(false),
       _overlap_events(false),
-      _lock_memory(false)
+      _lock_memory(false),
+      _use_io_uring(false),
+      _sq_poll(false)
 {
 }
 
@@ -29,12 +31,16 @@ deepspeed_aio_config_t::deepspeed_aio_config_t(const int block_size,
                                                const int queue_depth,
                                                const bool single_submit,
                                                const bool overlap_events,
-                                               const bool lock_memory)
+                                               const bool lock_memory,
+                                               const bool use_io_uring,
+                                               const bool sq_poll)
     : _block_size(block_size),
       _queue_depth(queue_depth),
       _single_submit(single_submit),
       _overlap_events(overlap_events),
-      _lock_memory(lock_memory)
+      _lock_memory(lock_memory),
+      _use_io_uring(use_io_uring),
+      _sq_poll(sq_poll)
 {
 }
 
@@ -74,3 +80,91 @@ aio_context::~aio_context()
     _io_events.resize(0);
     io_queue_release(_io_ctxt);
 }
+
+static void _atomic_max(std::atomic<long long int>& target, const long long int value)
+{
+    auto current = target.load(std::memory_order_relaxed);
+    while (value > current &&
+           !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+}
+
+deepspeed_aio_histogram_t::deepspeed_aio_histogram_t() { reset(); }
+
+void deepspeed_aio_histogram_t::record(const std::chrono::duration<double>& latency)
+{
+    const auto nsec = static_cast<long long int>(latency.count() * 1e9);
+    const auto usec = static_cast<unsigned long long>(nsec / 1000);
+    auto bucket = 0;
+    while (bucket < (c_num_buckets - 1) && (usec >> bucket) > 0) { ++bucket; }
+
+    _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _total_nsec.fetch_add(nsec, std::memory_order_relaxed);
+    _atomic_max(_max_nsec, nsec);
+}
+
+void deepspeed_aio_histogram_t::reset()
+{
+    for (auto& bucket : _buckets) { bucket.store(0, std::memory_order_relaxed); }
+    _count.store(0, std::memory_order_relaxed);
+    _total_nsec.store(0, std::memory_order_relaxed);
+    _max_nsec.store(0, std::memory_order_relaxed);
+}
+
+std::vector<long long int> deepspeed_aio_histogram_t::get_buckets() const
+{
+    std::vector<long long int> buckets;
+    for (auto& bucket : _buckets) { buckets.push_back(bucket.load(std::memory_order_relaxed)); }
+    return buckets;
+}
+
+deepspeed_aio_stats_t::deepspeed_aio_stats_t() { reset(); }
+
+void deepspeed_aio_stats_t::record_latencies(
+    const std::vector<std::chrono::duration<double>>& submit_times,
+    const std::vector<std::chrono::duration<double>>& reap_times)
+{
+    for (auto& latency : submit_times) { _submit.record(latency); }
+    for (auto& latency : reap_times) { _complete.record(latency); }
+}
+
+void deepspeed_aio_stats_t::record_queue_depth(const long long int n_pending)
+{
+    _queue_depth_sum.fetch_add(n_pending, std::memory_order_relaxed);
+    _queue_depth_samples.fetch_add(1, std::memory_order_relaxed);
+    _atomic_max(_queue_depth_max, n_pending);
+}
+
+void deepspeed_aio_stats_t::record_bytes(const bool read_op, const long long int num_bytes)
+{
+    auto& counter = read_op ? _read_bytes : _write_bytes;
+    counter.fetch_add(num_bytes, std::memory_order_relaxed);
+}
+
+void deepspeed_aio_stats_t::record_op(const bool read_op)
+{
+    auto& counter = read_op ? _read_ops : _write_ops;
+    counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+void deepspeed_aio_stats_t::record_busy(const std::chrono::duration<double>& elapsed)
+{
+    _busy_nsec.fetch_add(static_cast<long long int>(elapsed.count() * 1e9),
+                         std::memory_order_relaxed);
+}
+
+void deepspeed_aio_stats_t::reset()
+{
+    _submit.reset();
+    _complete.reset();
+    for (auto counter : {&_read_bytes,
+                         &_write_bytes,
+                         &_read_ops,
+                         &_write_ops,
+                         &_busy_nsec,
+                         &_queue_depth_sum,
+                         &_queue_depth_samples,
+                         &_queue_depth_max}) {
+        counter->store(0, std::memory_order_relaxed);
+    }
+}
@@ -10,6 +10,8 @@ Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
 #include <libaio.h>
 #include <stdlib.h>
 
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -32,19 +34,66 @@ struct deepspeed_aio_perf_t {
     double _e2e_rate_GB;
 };
 
+// Log2 latency histogram: bucket i counts latencies in [2^(i-1), 2^i) usec, bucket 0 is < 1 usec.
+// Updated by one aio thread and read by the handle, hence relaxed atomics.
+struct deepspeed_aio_histogram_t {
+    static const int c_num_buckets = 32;
+
+    std::atomic<long long int> _buckets[c_num_buckets];
+    std::atomic<long long int> _count;
+    std::atomic<long long int> _total_nsec;
+    std::atomic<long long int> _max_nsec;
+
+    deepspeed_aio_histogram_t();
+
+    void record(const std::chrono::duration<double>& latency);
+    void reset();
+    std::vector<long long int> get_buckets() const;
+};
+
+// Always-on counters for the I/O issued by one aio thread.
+struct deepspeed_aio_stats_t {
+    deepspeed_aio_histogram_t _submit;
+    deepspeed_aio_histogram_t _complete;
+    std::atomic<long long int> _read_bytes;
+    std::atomic<long long int> _write_bytes;
+    std::atomic<long long int> _read_ops;
+    std::atomic<long long int> _write_ops;
+    std::atomic<long long int> _busy_nsec;
+    // In-flight requests sampled at every completion poll.
+    std::atomic<long long int> _queue_depth_sum;
+    std::atomic<long long int> _queue_depth_samples;
+    std::atomic<long long int> _queue_depth_max;
+
+    deepspeed_aio_stats_t();
+
+    void record_latencies(const std::vector<std::chrono::duration<double>>& submit_times,
+                          const std::vector<std::chrono::duration<double>>& reap_times);
+    void record_queue_depth(const long long int n_pending);
+    void record_bytes(const bool read_op, const long long int num_bytes);
+    // Counted by the thread that retires the op, so ops are not double counted across threads.
+    void record_op(const bool read_op);
+    void record_busy(const std::chrono::duration<double>& elapsed);
+    void reset();
+};
+
 struct deepspeed_aio_config_t {
     const int _block_size;
     const int _queue_depth;
     const bool _single_submit;
     const bool _overlap_events;
     const bool _lock_memory;
+    const bool _use_io_uring;
+    const bool _sq_poll;
 
     deepspeed_aio_config_t();
     deepspeed_aio_config_t(const int block_size,
                            const int queue_depth,
                            const bool single_submit,
                            const bool overlap_events,
-                           const bool lock_memory);
+                           const bool lock_memory,
+                           const bool use_io_uring = false,
+                           const bool sq_poll = false);
 };
 
 struct aio_context {
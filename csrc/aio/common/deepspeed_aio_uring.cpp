@@ -0,0 +1,298 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
+io_uring engine, used in place of libaio when the op is built against liburing.
+*/
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined(DS_AIO_IO_URING)
+#include <liburing.h>
+#endif
+
+#include "deepspeed_aio_common.h"
+#include "deepspeed_aio_uring.h"
+
+using namespace std;
+
+static const std::string c_library_name = "deepspeed_aio";
+
+// Idle time before the kernel SQ polling thread goes to sleep.
+static const unsigned c_sq_thread_idle_msec = 2000;
+
+// Slots of the registered file table. A slot keeps its file open in the kernel until another op
+// takes it over, so the table stays small.
+static const int c_num_fixed_files = 16;
+
+bool uring_engine_available()
+{
+#if defined(DS_AIO_IO_URING)
+    return true;
+#else
+    return false;
+#endif
+}
+
+uring_context::uring_context(const int block_size, const int queue_depth, const bool sq_poll)
+    : _ring(nullptr),
+      _block_size(block_size),
+      _queue_depth(queue_depth),
+      _sq_poll(sq_poll),
+      _next_fixed_file(0)
+{
+#if defined(DS_AIO_IO_URING)
+    _ring = new struct io_uring;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if (_sq_poll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = c_sq_thread_idle_msec;
+    }
+
+    auto ret = io_uring_queue_init_params(queue_depth, _ring, &params);
+    if (ret < 0 && _sq_poll) {
+        // SQPOLL requires elevated privileges on older kernels, retry with regular submission.
+        std::cerr << c_library_name << ": io_uring SQPOLL setup failed with error " << -ret
+                  << ", falling back to regular submission" << std::endl;
+        _sq_poll = false;
+        memset(&params, 0, sizeof(params));
+        ret = io_uring_queue_init_params(queue_depth, _ring, &params);
+    }
+
+    if (ret < 0) {
+        std::cerr << c_library_name << ": io_uring setup failed with error " << -ret << std::endl;
+        delete _ring;
+        _ring = nullptr;
+        return;
+    }
+
+    // Registered once, slots are swapped with io_uring_register_files_update, so a transfer does
+    // not pay a register/unregister pair (and the quiesce of the ring that comes with it).
+    std::vector<int> sparse_fds(c_num_fixed_files, -1);
+    if (0 == io_uring_register_files(_ring, sparse_fds.data(), sparse_fds.size())) {
+        _fixed_files.resize(c_num_fixed_files, {-1, std::weak_ptr<void>()});
+    }
+#endif
+}
+
+uring_context::~uring_context()
+{
+#if defined(DS_AIO_IO_URING)
+    if (_ring) {
+        io_uring_queue_exit(_ring);
+        delete _ring;
+    }
+#endif
+}
+
+bool uring_context::is_valid() const { return _ring != nullptr; }
+
+int uring_context::register_buffers(const std::vector<struct iovec>& buffers)
+{
+#if defined(DS_AIO_IO_URING)
+    if (!_ring) { return -1; }
+
+    if (!_fixed_buffers.empty()) {
+        io_uring_unregister_buffers(_ring);
+        _fixed_buffers.clear();
+    }
+
+    if (buffers.empty()) { return 0; }
+
+    const auto ret = io_uring_register_buffers(_ring, buffers.data(), buffers.size());
+    if (ret < 0) {
+        // Not fatal, I/O on unregistered buffers is still correct, just slower.
+        std::cerr << c_library_name << ": io_uring buffer registration of " << buffers.size()
+                  << " buffers failed with error " << -ret << std::endl;
+        return ret;
+    }
+
+    _fixed_buffers = buffers;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int uring_context::find_fixed_buffer(const void* addr, const long long int num_bytes) const
+{
+    const auto start = static_cast<const char*>(addr);
+    for (size_t i = 0; i < _fixed_buffers.size(); ++i) {
+        const auto base = static_cast<const char*>(_fixed_buffers[i].iov_base);
+        if (start >= base && (start + num_bytes) <= (base + _fixed_buffers[i].iov_len)) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+int uring_context::find_fixed_file(const int fd, const std::shared_ptr<void>& owner)
+{
+#if defined(DS_AIO_IO_URING)
+    if (_fixed_files.empty() || !owner) { return -1; }
+
+    auto slot = -1;
+    for (size_t i = 0; i < _fixed_files.size(); ++i) {
+        const auto& file = _fixed_files[i];
+        // Same control block, an expired owner can never match a later op.
+        const auto same_owner =
+            !file._owner.owner_before(owner) && !owner.owner_before(file._owner);
+        if (file._fd == fd && same_owner && !file._owner.expired()) { return static_cast<int>(i); }
+        if (slot < 0 && file._owner.expired()) { slot = i; }
+    }
+    if (slot < 0) {
+        slot = static_cast<int>(_next_fixed_file);
+        _next_fixed_file = (_next_fixed_file + 1) % _fixed_files.size();
+    }
+
+    int update_fd = fd;
+    if (io_uring_register_files_update(_ring, slot, &update_fd, 1) != 1) { return -1; }
+    _fixed_files[slot] = {fd, owner};
+    return slot;
+#else
+    return -1;
+#endif
+}
+
+int do_uring_operation(const bool read_op,
+                       std::unique_ptr<uring_context>& uring_ctxt,
+                       std::unique_ptr<io_xfer_ctxt>& xfer_ctxt,
+                       deepspeed_aio_config_t* config,
+                       deepspeed_aio_perf_t* perf,
+                       deepspeed_aio_stats_t* stats,
+                       const std::shared_ptr<void>& file_owner)
+{
+#if defined(DS_AIO_IO_URING)
+    assert(uring_ctxt->is_valid());
+    auto ring = uring_ctxt->_ring;
+
+    const long long int block_size = uring_ctxt->_block_size;
+    const auto num_io_blocks = static_cast<long long int>(
+        ceil(static_cast<double>(xfer_ctxt->_num_bytes) / block_size));
+
+    // A fixed file skips the fd lookup on every request, SQPOLL also requires it on kernels
+    // older than 5.11.
+    int fd = xfer_ctxt->_fd;
+    unsigned sqe_flags = 0;
+    const auto file_slot = uring_ctxt->find_fixed_file(fd, file_owner);
+    if (file_slot >= 0) {
+        fd = file_slot;
+        sqe_flags = IOSQE_FIXED_FILE;
+    }
+    auto error = 0;
+
+    const auto base_buffer = (char*)xfer_ctxt->_mem_buffer;
+    const auto buf_index = uring_ctxt->find_fixed_buffer(base_buffer, xfer_ctxt->_num_bytes);
+
+    std::vector<std::chrono::duration<double>> submit_times;
+    std::vector<std::chrono::duration<double>> reap_times;
+
+    long long int next_block = 0;
+    auto n_pending = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    while (true) {
+        auto n_prepped = 0;
+        while ((n_pending + n_prepped) < uring_ctxt->_queue_depth && next_block < num_io_blocks) {
+            auto sqe = io_uring_get_sqe(ring);
+            if (!sqe) { break; }
+
+            const auto block_offset = next_block * block_size;
+            const auto xfer_offset = xfer_ctxt->_base_offset + block_offset;
+            const auto xfer_buffer = base_buffer + block_offset;
+            const auto num_bytes =
+                static_cast<unsigned>(min(block_size, xfer_ctxt->_num_bytes - block_offset));
+
+            if (buf_index >= 0) {
+                if (read_op) {
+                    io_uring_prep_read_fixed(
+                        sqe, fd, xfer_buffer, num_bytes, xfer_offset, buf_index);
+                } else {
+                    io_uring_prep_write_fixed(
+                        sqe, fd, xfer_buffer, num_bytes, xfer_offset, buf_index);
+                }
+            } else {
+                if (read_op) {
+                    io_uring_prep_read(sqe, fd, xfer_buffer, num_bytes, xfer_offset);
+                } else {
+                    io_uring_prep_write(sqe, fd, xfer_buffer, num_bytes, xfer_offset);
+                }
+            }
+            io_uring_sqe_set_flags(sqe, sqe_flags);
+
+            ++next_block;
+            ++n_prepped;
+        }
+
+        if (n_prepped > 0) {
+            const auto st = std::chrono::high_resolution_clock::now();
+            auto submit_ret = io_uring_submit(ring);
+            while (submit_ret == -EINTR) { submit_ret = io_uring_submit(ring); }
+            submit_times.push_back(std::chrono::high_resolution_clock::now() - st);
+            if (submit_ret < 0) {
+                std::cerr << c_library_name << ": io_uring submit failed with error "
+                          << -submit_ret << std::endl;
+                return submit_ret;
+            }
+        }
+
+        n_pending += n_prepped;
+        if (n_pending == 0) { break; }
+
+        if (stats) { stats->record_queue_depth(n_pending); }
+        const auto st = std::chrono::high_resolution_clock::now();
+        struct io_uring_cqe* cqe = nullptr;
+        auto wait_ret = io_uring_wait_cqe(ring, &cqe);
+        while (wait_ret == -EINTR) { wait_ret = io_uring_wait_cqe(ring, &cqe); }
+        if (wait_ret < 0) {
+            std::cerr << c_library_name << ": io_uring wait failed with error " << -wait_ret
+                      << std::endl;
+            return wait_ret;
+        }
+
+        unsigned head;
+        auto n_complete = 0;
+        io_uring_for_each_cqe(ring, head, cqe)
+        {
+            // Keep reaping after a failure, the buffer must not be released while I/O is in
+            // flight.
+            if (cqe->res < 0 && error == 0) {
+                std::cerr << c_library_name << ": io_uring " << (read_op ? "read" : "write")
+                          << " failed with error " << -cqe->res << std::endl;
+                error = cqe->res;
+            }
+            ++n_complete;
+        }
+        io_uring_cq_advance(ring, n_complete);
+        reap_times.push_back(std::chrono::high_resolution_clock::now() - st);
+
+        n_pending -= n_complete;
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    if (stats) { stats->record_latencies(submit_times, reap_times); }
+
+    if (perf) {
+        _get_aio_latencies(submit_times, perf->_submit);
+        _get_aio_latencies(reap_times, perf->_complete);
+        perf->_e2e_usec = elapsed.count() * 1e6;
+        perf->_e2e_rate_GB = (xfer_ctxt->_num_bytes / elapsed.count() / 1e9);
+    }
+    return error;
+#else
+    assert(false && "deepspeed_aio was built without io_uring support");
+    return -ENOSYS;
+#endif
+}
@@ -0,0 +1,63 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
+io_uring engine, used in place of libaio when the op is built against liburing.
+*/
+
+#pragma once
+
+#include <sys/uio.h>
+
+#include <deepspeed_aio_utils.h>
+#include <memory>
+#include <vector>
+
+struct io_uring;
+
+bool uring_engine_available();
+
+struct uring_context {
+    // A slot of the registered file table, held by one op until another op needs the slot.
+    struct fixed_file_t {
+        int _fd;
+        std::weak_ptr<void> _owner;
+    };
+
+    struct io_uring* _ring;
+    int _block_size;
+    int _queue_depth;
+    bool _sq_poll;
+    std::vector<struct iovec> _fixed_buffers;
+    // Sparse file table registered once at setup, empty if the kernel refused it.
+    std::vector<fixed_file_t> _fixed_files;
+    size_t _next_fixed_file;
+
+    uring_context(const int block_size, const int queue_depth, const bool sq_poll);
+    ~uring_context();
+
+    bool is_valid() const;
+
+    // Replaces the set of registered (fixed) buffers. Must not be called while I/O is in flight.
+    int register_buffers(const std::vector<struct iovec>& buffers);
+
+    // Returns the index of the registered buffer containing [addr, addr + num_bytes), or -1.
+    int find_fixed_buffer(const void* addr, const long long int num_bytes) const;
+
+    // Returns the file table slot holding fd for owner, installing it in a free or the oldest
+    // slot first, or -1 if there is no table. Owner identifies the opened file, fd numbers are
+    // reused once closed.
+    int find_fixed_file(const int fd, const std::shared_ptr<void>& owner);
+};
+
+// Returns 0, or the negative errno of the first failed request of the transfer.
+int do_uring_operation(const bool read_op,
+                       std::unique_ptr<uring_context>& uring_ctxt,
+                       std::unique_ptr<io_xfer_ctxt>& xfer_ctxt,
+                       deepspeed_aio_config_t* config,
+                       deepspeed_aio_perf_t* perf,
+                       deepspeed_aio_stats_t* stats = nullptr,
+                       const std::shared_ptr<void>& file_owner = nullptr);
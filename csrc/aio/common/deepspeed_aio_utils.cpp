@@ -41,7 +41,7 @@ void io_prep_context::prep_iocbs(const int n_iocbs,
     assert(static_cast<size_t>(n_iocbs) <= _iocbs->size());
     for (auto i = 0; i < n_iocbs; ++i) {
         const auto shift = i * _block_size;
-        const auto xfer_buffer = (char*)start_buffer + _xfer_ctxt->_base_offset + shift;
+        const auto xfer_buffer = (char*)start_buffer + shift;
         const auto xfer_offset = _xfer_ctxt->_base_offset + start_offset + shift;
         auto byte_count = _block_size;
         if ((shift + _block_size) > num_bytes) { byte_count = num_bytes - shift; }
@@ -79,8 +79,9 @@ int io_prep_generator::prep_iocbs(const int n_iocbs, std::vector<struct iocb*>*
 
     auto actual_n_iocbs = min(static_cast<long long int>(n_iocbs), _remaining_io_blocks);
     for (auto i = 0; i < actual_n_iocbs; ++i, ++_next_iocb_index) {
-        const auto xfer_offset = _xfer_ctxt->_base_offset + (_next_iocb_index * _block_size);
-        const auto xfer_buffer = (char*)_xfer_ctxt->_mem_buffer + xfer_offset;
+        const auto buffer_offset = _next_iocb_index * _block_size;
+        const auto xfer_offset = _xfer_ctxt->_base_offset + buffer_offset;
+        const auto xfer_buffer = (char*)_xfer_ctxt->_mem_buffer + buffer_offset;
         const auto num_bytes = min(static_cast<long long int>(_block_size), _remaining_bytes);
 
         if (_read_op) {
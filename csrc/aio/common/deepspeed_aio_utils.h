@@ -28,6 +28,7 @@ Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
 #include <string>
 #include <vector>
 
+// Transfer of _num_bytes between _mem_buffer and the file range starting at _base_offset.
 struct io_xfer_ctxt {
     const int _fd;
     const long long int _base_offset;
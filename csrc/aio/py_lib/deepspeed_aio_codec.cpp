@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
+*/
+
+// The op builds at -O0 since it is I/O bound, but the codec loops sit on the swap path.
+#pragma GCC optimize("O3")
+
+#include <assert.h>
+#include <string.h>
+
+#include <torch/extension.h>
+
+#include "deepspeed_aio_codec.h"
+
+bool parse_swap_codec(const std::string& name, swap_codec_t& codec)
+{
+    if (name == "none") {
+        codec = swap_codec_t::none;
+    } else if (name == "bf16") {
+        codec = swap_codec_t::bf16;
+    } else if (name == "fp16") {
+        codec = swap_codec_t::fp16;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+int swap_codec_elem_size(const swap_codec_t codec)
+{
+    return (codec == swap_codec_t::none) ? sizeof(float) : sizeof(c10::Half);
+}
+
+// Both 16-bit types convert with round-to-nearest-even, and fp16 saturates to inf like a cast.
+template <typename T>
+static void _encode(const float* src, T* dst, const long long int num_elems)
+{
+#pragma omp simd
+    for (long long int i = 0; i < num_elems; ++i) { dst[i] = static_cast<T>(src[i]); }
+}
+
+template <typename T>
+static void _decode(const T* src, float* dst, const long long int num_elems)
+{
+#pragma omp simd
+    for (long long int i = 0; i < num_elems; ++i) { dst[i] = static_cast<float>(src[i]); }
+}
+
+void swap_encode(const swap_codec_t codec,
+                 const float* src,
+                 char* dst,
+                 const long long int num_elems)
+{
+    switch (codec) {
+        case swap_codec_t::bf16: _encode(src, (c10::BFloat16*)dst, num_elems); break;
+        case swap_codec_t::fp16: _encode(src, (c10::Half*)dst, num_elems); break;
+        default: memcpy(dst, src, num_elems * sizeof(float)); break;
+    }
+}
+
+void swap_decode(const swap_codec_t codec,
+                 const char* src,
+                 float* dst,
+                 const long long int num_elems)
+{
+    switch (codec) {
+        case swap_codec_t::bf16: _decode((const c10::BFloat16*)src, dst, num_elems); break;
+        case swap_codec_t::fp16: _decode((const c10::Half*)src, dst, num_elems); break;
+        default: memcpy(dst, src, num_elems * sizeof(float)); break;
+    }
+}
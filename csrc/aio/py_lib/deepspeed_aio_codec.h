@@ -0,0 +1,35 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
+On-disk encodings that shrink fp32 swap traffic, applied by the aio threads.
+*/
+
+#pragma once
+
+#include <string>
+
+enum class swap_codec_t {
+    none,
+    bf16,
+    fp16,
+};
+
+// Accepts "none", "bf16" and "fp16", returns false for anything else.
+bool parse_swap_codec(const std::string& name, swap_codec_t& codec);
+
+// Bytes per encoded fp32 element.
+int swap_codec_elem_size(const swap_codec_t codec);
+
+void swap_encode(const swap_codec_t codec,
+                 const float* src,
+                 char* dst,
+                 const long long int num_elems);
+
+void swap_decode(const swap_codec_t codec,
+                 const char* src,
+                 float* dst,
+                 const long long int num_elems);
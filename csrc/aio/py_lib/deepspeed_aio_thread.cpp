@@ -7,40 +7,210 @@
 Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
 */
 
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 #include "deepspeed_aio_thread.h"
 
 using namespace std;
 
+// Upper bound on how finely each thread's share of an op is split for stealing.
+static const int c_max_chunks_per_thread = 4;
+
 io_op_desc_t::io_op_desc_t(const bool read_op,
                            const torch::Tensor& buffer,
                            const int fd,
                            const char* filename,
                            const long long int num_bytes,
-                           const bool validate)
+                           const bool validate,
+                           const long long int file_offset,
+                           const bool owns_fd,
+                           struct gds_file_cache_t* gds_files)
     : _read_op(read_op),
       _buffer(buffer),
       _fd(fd),
       _filename(filename),
       _num_bytes(num_bytes),
-      _validate(validate)
+      _validate(validate),
+      _file_offset(file_offset),
+      _owns_fd(owns_fd),
+      _use_gds(gds_files != nullptr && _buffer.is_cuda()),
+      _num_chunks(1),
+      _chunk_bytes(num_bytes),
+      _next_chunk(0),
+      _pending_chunks(1),
+      _request_id(-1),
+      _codec(swap_codec_t::none),
+      _error(0)
 {
-    _cpu_buffer = _buffer.is_cuda() ? _buffer.to(torch::kCPU).pin_memory() : _buffer;
+    if (_use_gds) {
+        _gds_file = gds_files->get(_filename, fd);
+        if (!_gds_file) { _use_gds = false; }
+    }
+
+    // GDS transfers straight into device memory, everything else is staged through host memory.
+    if (_use_gds) {
+        _cpu_buffer = _buffer;
+    } else {
+        _cpu_buffer = _buffer.is_cuda() ? _buffer.to(torch::kCPU).pin_memory() : _buffer;
+    }
     _contiguous_buffer = _cpu_buffer.contiguous();
 }
 
-char* io_op_desc_t::data_ptr() const { return (char*)_contiguous_buffer.data_ptr(); }
+char* io_op_desc_t::data_ptr() const
+{
+    const auto& io_buffer = (_codec == swap_codec_t::none) ? _contiguous_buffer : _encoded_buffer;
+    return (char*)io_buffer.data_ptr();
+}
 
 void io_op_desc_t::fini()
 {
+    if (_use_gds) {
+        if (_read_op && !_buffer.is_contiguous()) { _buffer.copy_(_contiguous_buffer); }
+        _gds_file.reset();
+        return;
+    }
     if (_read_op && _buffer.is_cuda()) { _buffer.copy_(_cpu_buffer.to(torch::kCUDA)); }
 }
 
-deepspeed_aio_thread_t::deepspeed_aio_thread_t(const int tid, deepspeed_aio_config_t& aio_config)
+void io_op_desc_t::set_chunks(const int num_threads, const int block_size)
+{
+    // Split each thread's share only while the chunks stay whole blocks, so chunk offsets keep
+    // at least the alignment the per-thread slices had.
+    auto chunks_per_thread = 1;
+    auto chunk_bytes = _num_bytes;
+    while (chunks_per_thread < c_max_chunks_per_thread && (chunk_bytes % 2) == 0 &&
+           ((chunk_bytes / 2) % block_size) == 0) {
+        chunk_bytes /= 2;
+        chunks_per_thread *= 2;
+    }
+
+    _num_chunks = num_threads * chunks_per_thread;
+    _chunk_bytes = chunk_bytes;
+    _next_chunk.store(0);
+    _pending_chunks.store(_num_chunks);
+}
+
+void io_op_desc_t::set_codec(const swap_codec_t codec)
+{
+    _codec = codec;
+    if (_codec == swap_codec_t::none) { return; }
+
+    // Encoding runs on host memory, so codec ops are never GDS ops.
+    assert(!_use_gds);
+
+    // O_DIRECT needs page aligned staging.
+    auto encoded_bytes = static_cast<int64_t>(_contiguous_buffer.numel()) *
+                         swap_codec_elem_size(_codec);
+    auto encoded_ptr = ds_page_aligned_alloc(encoded_bytes);
+    assert(nullptr != encoded_ptr);
+    auto options = torch::TensorOptions().dtype(torch::kByte).device(torch::kCPU);
+    _encoded_buffer =
+        torch::from_blob(encoded_ptr, {encoded_bytes}, [](void* ptr) { free(ptr); }, options);
+}
+
+void io_op_desc_t::encode_chunk(const int chunk)
+{
+    const auto elem_size = swap_codec_elem_size(_codec);
+    const auto first_elem = (_chunk_bytes / elem_size) * chunk;
+    swap_encode(_codec,
+                (const float*)_contiguous_buffer.data_ptr() + first_elem,
+                data_ptr() + _chunk_bytes * chunk,
+                _chunk_bytes / elem_size);
+}
+
+void io_op_desc_t::decode_chunk(const int chunk)
+{
+    const auto elem_size = swap_codec_elem_size(_codec);
+    const auto first_elem = (_chunk_bytes / elem_size) * chunk;
+    swap_decode(_codec,
+                data_ptr() + _chunk_bytes * chunk,
+                (float*)_contiguous_buffer.data_ptr() + first_elem,
+                _chunk_bytes / elem_size);
+}
+
+int io_op_desc_t::claim_chunk()
+{
+    // Cheap check first so threads reaching a fully claimed op do not keep bumping the counter.
+    if (_next_chunk.load(std::memory_order_relaxed) >= _num_chunks) { return -1; }
+    const auto chunk = _next_chunk.fetch_add(1, std::memory_order_relaxed);
+    return (chunk < _num_chunks) ? chunk : -1;
+}
+
+bool io_op_desc_t::retire_chunk()
+{
+    // acq_rel so the retiring thread observes every other thread's transfer into the buffer.
+    return 1 == _pending_chunks.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void io_op_desc_t::record_error(const int error)
+{
+    if (error == 0) { return; }
+    auto expected = 0;
+    _error.compare_exchange_strong(expected, error, std::memory_order_relaxed);
+}
+
+io_completion_t::io_completion_t() : _event_fd(eventfd(0, EFD_CLOEXEC))
+{
+    if (_event_fd == -1) {
+        std::cerr << "deepspeed_aio: eventfd creation failed with error = " << errno << std::endl;
+    }
+    assert(_event_fd != -1);
+}
+
+io_completion_t::~io_completion_t()
+{
+    if (_event_fd != -1) { close(_event_fd); }
+}
+
+void io_completion_t::push(std::shared_ptr<struct io_op_desc_t> completed_op)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _completed_ops.push(completed_op);
+    }
+    const uint64_t one = 1;
+    const auto ret = write(_event_fd, &one, sizeof(one));
+    assert(ret == sizeof(one));
+}
+
+std::shared_ptr<struct io_op_desc_t> io_completion_t::try_pop()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_completed_ops.empty()) { return nullptr; }
+    auto completed_op = _completed_ops.front();
+    _completed_ops.pop();
+    return completed_op;
+}
+
+std::shared_ptr<struct io_op_desc_t> io_completion_t::pop()
+{
+    while (true) {
+        auto completed_op = try_pop();
+        if (completed_op) { return completed_op; }
+        // A push racing with the check above leaves the counter non-zero, so this returns
+        // immediately rather than missing the wakeup.
+        uint64_t count = 0;
+        const auto ret = read(_event_fd, &count, sizeof(count));
+        assert(ret == sizeof(count) || errno == EINTR);
+    }
+}
+
+deepspeed_aio_thread_t::deepspeed_aio_thread_t(const int tid,
+                                               deepspeed_aio_config_t& aio_config,
+                                               io_completion_t& completion)
     : _tid(tid),
       _aio_config(aio_config),
+      _completion(completion),
       _aio_ctxt(new aio_context(aio_config._block_size, aio_config._queue_depth)),
       _time_to_exit(false)
 {
+    if (aio_config._use_io_uring && uring_engine_available()) {
+        _uring_ctxt.reset(new uring_context(
+            aio_config._block_size, aio_config._queue_depth, aio_config._sq_poll));
+        if (!_uring_ctxt->is_valid()) { _uring_ctxt.reset(); }
+    }
 }
 
 deepspeed_aio_thread_t::~deepspeed_aio_thread_t() {}
@@ -48,39 +218,121 @@ deepspeed_aio_thread_t::~deepspeed_aio_thread_t() {}
 void deepspeed_aio_thread_t::run()
 {
     while (true) {
-        std::shared_ptr<struct io_op_desc_t> next_io_op = nullptr;
+        std::vector<std::shared_ptr<struct io_op_desc_t>> next_io_ops;
 
         {
             std::unique_lock<std::mutex> lock(_work_sync._mutex);
             _work_sync._cond_var.wait(lock,
                                       [this] { return (!_work_queue.empty() || _time_to_exit); });
-            if (!_work_queue.empty()) {
-                next_io_op = _work_queue.front();
+            // Drain everything queued so far, batched submissions run as one iocb stream.
+            while (!_work_queue.empty()) {
+                next_io_ops.push_back(_work_queue.front());
                 _work_queue.pop();
             }
         }
 
-        if (next_io_op) {
-            const auto base_offset = next_io_op->_num_bytes * _tid;
+        if (!next_io_ops.empty()) {
+            const auto start_time = std::chrono::high_resolution_clock::now();
+            _run_io_ops(next_io_ops);
+            _stats.record_busy(std::chrono::high_resolution_clock::now() - start_time);
+        }
 
-            std::unique_ptr<io_xfer_ctxt> xfer_ctxt(new io_xfer_ctxt(
-                next_io_op->_fd, base_offset, next_io_op->_num_bytes, next_io_op->data_ptr()));
+        if (_time_to_exit) { break; }
+    }
+}
 
-            if (_aio_config._overlap_events) {
-                do_aio_operation_overlap(
-                    next_io_op->_read_op, _aio_ctxt, xfer_ctxt, &_aio_config, nullptr);
-            } else {
-                do_aio_operation_sequential(
-                    next_io_op->_read_op, _aio_ctxt, xfer_ctxt, &_aio_config, nullptr);
+void deepspeed_aio_thread_t::_run_io_ops(std::vector<std::shared_ptr<struct io_op_desc_t>>& io_ops)
+{
+    // Every thread sees every op. Each round claims at most one chunk per op, which keeps ops
+    // batched together while letting a thread that finishes early move on to chunks the slower
+    // threads have not reached yet.
+    while (true) {
+        std::vector<std::shared_ptr<struct io_op_desc_t>> claimed_ops;
+        std::vector<int> claimed_chunks;
+        std::vector<std::unique_ptr<io_xfer_ctxt>> xfer_ctxts;
+        for (auto& io_op : io_ops) {
+            const auto chunk = io_op->claim_chunk();
+            if (chunk < 0) { continue; }
+            if (io_op->_codec != swap_codec_t::none && !io_op->_read_op) {
+                io_op->encode_chunk(chunk);
             }
+            const auto base_offset = io_op->_chunk_bytes * chunk;
+            claimed_ops.push_back(io_op);
+            claimed_chunks.push_back(chunk);
+            xfer_ctxts.emplace_back(new io_xfer_ctxt(io_op->_fd,
+                                                     io_op->_file_offset + base_offset,
+                                                     io_op->_chunk_bytes,
+                                                     io_op->data_ptr() + base_offset));
+        }
+        if (claimed_ops.empty()) { break; }
+
+        _run_xfers(claimed_ops, xfer_ctxts);
 
-            {
-                std::lock_guard<std::mutex> lock(_complete_sync._mutex);
-                _complete_queue.push(next_io_op);
+        for (size_t i = 0; i < claimed_ops.size(); ++i) {
+            auto& io_op = claimed_ops[i];
+            if (io_op->_codec != swap_codec_t::none && io_op->_read_op) {
+                io_op->decode_chunk(claimed_chunks[i]);
+            }
+            _stats.record_bytes(io_op->_read_op, io_op->_chunk_bytes);
+            if (io_op->retire_chunk()) {
+                _stats.record_op(io_op->_read_op);
+                _completion.push(io_op);
             }
-            _complete_sync._cond_var.notify_one();
         }
+    }
+}
 
-        if (_time_to_exit) { break; }
+void deepspeed_aio_thread_t::_run_xfers(std::vector<std::shared_ptr<struct io_op_desc_t>>& io_ops,
+                                        std::vector<std::unique_ptr<io_xfer_ctxt>>& xfer_ctxts)
+{
+    // GDS ops bypass the host queues entirely.
+    for (size_t i = 0; i < io_ops.size(); ++i) {
+        auto& io_op = io_ops[i];
+        if (!io_op->_use_gds) { continue; }
+        const auto ret = do_gds_operation(
+            io_op->_read_op, io_op->_buffer.get_device(), io_op->_gds_file, xfer_ctxts[i]);
+        io_op->record_error(ret);
+    }
+
+    // Reads and writes cannot share a batch, split the ops into runs of the same direction.
+    size_t run_start = 0;
+    while (run_start < io_ops.size()) {
+        if (io_ops[run_start]->_use_gds) {
+            ++run_start;
+            continue;
+        }
+        const auto read_op = io_ops[run_start]->_read_op;
+        auto run_end = run_start + 1;
+        while (run_end < io_ops.size() && !io_ops[run_end]->_use_gds &&
+               io_ops[run_end]->_read_op == read_op) {
+            ++run_end;
+        }
+
+        if (_aio_config._overlap_events && !_uring_ctxt && (run_end - run_start) > 1) {
+            std::vector<std::unique_ptr<io_xfer_ctxt>> batch_ctxts;
+            for (auto i = run_start; i < run_end; ++i) {
+                batch_ctxts.push_back(std::move(xfer_ctxts[i]));
+            }
+            do_aio_operation_batch(read_op, _aio_ctxt, batch_ctxts, &_aio_config, nullptr, &_stats);
+        } else {
+            for (auto i = run_start; i < run_end; ++i) {
+                if (_uring_ctxt) {
+                    io_ops[i]->record_error(do_uring_operation(read_op,
+                                                               _uring_ctxt,
+                                                               xfer_ctxts[i],
+                                                               &_aio_config,
+                                                               nullptr,
+                                                               &_stats,
+                                                               io_ops[i]));
+                } else if (_aio_config._overlap_events) {
+                    do_aio_operation_overlap(
+                        read_op, _aio_ctxt, xfer_ctxts[i], &_aio_config, nullptr, &_stats);
+                } else {
+                    do_aio_operation_sequential(
+                        read_op, _aio_ctxt, xfer_ctxts[i], &_aio_config, nullptr, &_stats);
+                }
+            }
+        }
+        run_start = run_end;
     }
 }
@@ -7,9 +7,13 @@
 Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
 */
 
+#include <atomic>
 #include <condition_variable>
 #include <memory>
 #include <queue>
+#include "deepspeed_aio_codec.h"
+#include "deepspeed_aio_gds.h"
+#include "deepspeed_aio_uring.h"
 #include "deepspeed_py_aio.h"
 
 struct io_op_desc_t {
@@ -21,16 +25,48 @@ struct io_op_desc_t {
     torch::Tensor _cpu_buffer;
     torch::Tensor _contiguous_buffer;
     const bool _validate;
+    const long long int _file_offset;
+    const bool _owns_fd;
+    bool _use_gds;
+    std::shared_ptr<struct gds_file_t> _gds_file;
+    // The op is split into equal chunks that idle aio threads claim in order, so a slow
+    // device or file only delays the chunks it is already serving.
+    int _num_chunks;
+    long long int _chunk_bytes;
+    std::atomic<int> _next_chunk;
+    std::atomic<int> _pending_chunks;
+    // Id of the async call that scheduled the op, shared by all ops of a batch.
+    long long int _request_id;
+    // With a codec the file holds the encoded bytes, staged in _encoded_buffer. The aio
+    // threads encode each chunk before writing it and decode it after reading it.
+    swap_codec_t _codec;
+    torch::Tensor _encoded_buffer;
+    // Negative errno of the first failed chunk, 0 while every chunk succeeded.
+    std::atomic<int> _error;
 
     io_op_desc_t(const bool read_op,
                  const torch::Tensor& buffer,
                  const int fd,
                  const char* filename,
                  const long long int num_bytes,
-                 const bool validate);
+                 const bool validate,
+                 const long long int file_offset = 0,
+                 const bool owns_fd = true,
+                 struct gds_file_cache_t* gds_files = nullptr);
 
     char* data_ptr() const;
     void fini();
+
+    void set_chunks(const int num_threads, const int block_size);
+    void set_codec(const swap_codec_t codec);
+    void encode_chunk(const int chunk);
+    void decode_chunk(const int chunk);
+    // Returns the index of the next unclaimed chunk, or -1 when all chunks are taken.
+    int claim_chunk();
+    // Returns true for the caller that completed the last chunk of the op.
+    bool retire_chunk();
+    // Keeps the first error reported by any chunk.
+    void record_error(const int error);
 };
 
 struct thread_sync_t {
@@ -38,22 +74,51 @@ struct thread_sync_t {
     std::condition_variable _cond_var;
 };
 
+// Completed ops shared by all aio threads. An eventfd counts the completions, so the waiter
+// sleeps in the kernel instead of handing a condition variable between every worker and itself.
+struct io_completion_t {
+    int _event_fd;
+    std::mutex _mutex;
+    std::queue<std::shared_ptr<struct io_op_desc_t>> _completed_ops;
+
+    io_completion_t();
+
+    ~io_completion_t();
+
+    void push(std::shared_ptr<struct io_op_desc_t> completed_op);
+
+    // Blocks until an op is available.
+    std::shared_ptr<struct io_op_desc_t> pop();
+
+    // Returns nullptr when no op has completed yet.
+    std::shared_ptr<struct io_op_desc_t> try_pop();
+};
+
 struct deepspeed_aio_thread_t {
     const int _tid;
     deepspeed_aio_config_t& _aio_config;
+    io_completion_t& _completion;
 
     std::unique_ptr<struct aio_context> _aio_ctxt;
+    std::unique_ptr<struct uring_context> _uring_ctxt;
     std::queue<std::shared_ptr<struct io_op_desc_t>> _work_queue;
-    std::queue<std::shared_ptr<struct io_op_desc_t>> _complete_queue;
 
     bool _time_to_exit;
 
     struct thread_sync_t _work_sync;
-    struct thread_sync_t _complete_sync;
 
-    deepspeed_aio_thread_t(const int tid, deepspeed_aio_config_t& aio_config);
+    struct deepspeed_aio_stats_t _stats;
+
+    deepspeed_aio_thread_t(const int tid,
+                           deepspeed_aio_config_t& aio_config,
+                           io_completion_t& completion);
 
     ~deepspeed_aio_thread_t();
 
     void run();
+
+    void _run_io_ops(std::vector<std::shared_ptr<struct io_op_desc_t>>& io_ops);
+
+    void _run_xfers(std::vector<std::shared_ptr<struct io_op_desc_t>>& io_ops,
+                    std::vector<std::unique_ptr<io_xfer_ctxt>>& xfer_ctxts);
 };
@@ -8,38 +8,245 @@ Functionality for managing CPU tensors occupying page-locked memory.
 */
 
 #include "deepspeed_pin_tensor.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#if defined(DS_AIO_CUDART)
+#include <cuda_runtime.h>
+#endif
 
 using namespace std;
 
+static size_t _page_size() { return static_cast<size_t>(sysconf(_SC_PAGESIZE)); }
+
+static size_t _hugepage_size()
+{
+    static size_t hugepage_size = 0;
+    if (hugepage_size == 0) {
+        hugepage_size = 2 * 1024 * 1024;
+        ifstream meminfo("/proc/meminfo");
+        string key;
+        while (meminfo >> key) {
+            if (key == "Hugepagesize:") {
+                size_t size_kb;
+                if (meminfo >> size_kb) { hugepage_size = size_kb * 1024; }
+                break;
+            }
+            meminfo.ignore(numeric_limits<streamsize>::max(), '\n');
+        }
+    }
+    return hugepage_size;
+}
+
+static size_t _round_up(const size_t value, const size_t multiple)
+{
+    return ((value + multiple - 1) / multiple) * multiple;
+}
+
+bool cuda_host_register_available()
+{
+#if defined(DS_AIO_CUDART)
+    return true;
+#else
+    return false;
+#endif
+}
+
 deepspeed_pin_tensor_t::~deepspeed_pin_tensor_t()
 {
-    for (auto iter = _locked_tensors.begin(); iter != _locked_tensors.end(); ++iter) {
-        munlock(iter->first, iter->second);
+    while (!_blocks.empty()) { _release_block(_blocks.begin()->first); }
+    _in_use.clear();
+    _cached.clear();
+}
+
+void deepspeed_pin_tensor_t::configure(const deepspeed_pin_pool_config_t& config)
+{
+    _config = config;
+    if (_config._cuda_host_register && !cuda_host_register_available()) {
+        std::cerr << "deepspeed_aio: built without the CUDA runtime, pinned buffers will not be "
+                     "registered with cudaHostRegister"
+                  << std::endl;
+        _config._cuda_host_register = false;
+    }
+    // Blocks cached with a different class rounding would never be reused
+    release_cached();
+}
+
+size_t deepspeed_pin_tensor_t::_size_class(const size_t num_bytes) const
+{
+    const auto granularity = (_config._use_hugepages && num_bytes >= _hugepage_size())
+                                 ? _hugepage_size()
+                                 : _page_size();
+    if (_config._exact_size_classes ||
+        (_config._geometric_max_bytes > 0 && num_bytes > _config._geometric_max_bytes)) {
+        return _round_up(std::max<size_t>(num_bytes, 1), granularity);
+    }
+
+    size_t size_class = _page_size();
+    while (size_class < num_bytes) { size_class <<= 1; }
+    return std::max(size_class, granularity);
+}
+
+void* deepspeed_pin_tensor_t::_alloc_block(const size_t block_bytes)
+{
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    void* addr = nullptr;
+    auto backing = backing_t::aligned_alloc;
+
+    if (_config._use_hugepages && block_bytes >= _hugepage_size()) {
+        // hugetlbfs only succeeds when pages were reserved (vm.nr_hugepages), otherwise ask for
+        // transparent huge pages on a regular mapping.
+        addr = mmap(nullptr,
+                    block_bytes,
+                    PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                    -1,
+                    0);
+        backing = backing_t::hugetlb;
+        if (addr == MAP_FAILED) {
+            addr = mmap(
+                nullptr, block_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            backing = backing_t::thp;
+            if (addr != MAP_FAILED) { madvise(addr, block_bytes, MADV_HUGEPAGE); }
+        }
+        if (addr == MAP_FAILED) { return nullptr; }
+
+        if (mlock(addr, block_bytes) != 0) {
+            auto mlock_error = errno;
+            std::cerr << "mlock failed to allocate " << block_bytes << " bytes with error no "
+                      << mlock_error << " msg " << strerror(mlock_error) << std::endl;
+            munmap(addr, block_bytes);
+            return nullptr;
+        }
+    } else {
+        addr = ds_page_aligned_alloc(block_bytes, true);
+        if (nullptr == addr) { return nullptr; }
+    }
+
+    bool registered = false;
+#if defined(DS_AIO_CUDART)
+    if (_config._cuda_host_register) {
+        registered = (cudaHostRegister(addr, block_bytes, cudaHostRegisterDefault) == cudaSuccess);
+        if (!registered) {
+            // Clear the sticky error so later runtime calls are not affected
+            cudaGetLastError();
+            std::cerr << "deepspeed_aio: cudaHostRegister failed for " << block_bytes << " bytes"
+                      << std::endl;
+        }
+    }
+#endif
+
+    _blocks[addr] = {block_bytes, backing, registered};
+    _locked_tensors[addr] = block_bytes;
+    _locked_tensors_version++;
+
+    if (backing == backing_t::hugetlb) { _stats._hugetlb_bytes += block_bytes; }
+    if (backing == backing_t::thp) { _stats._thp_bytes += block_bytes; }
+    if (registered) { _stats._cuda_registered_bytes += block_bytes; }
+
+    size_t locked_bytes = 0;
+    for (auto& block : _locked_tensors) { locked_bytes += block.second; }
+    _stats._peak_locked_bytes = std::max(_stats._peak_locked_bytes, locked_bytes);
+
+    const std::chrono::duration<double> elapsed =
+        std::chrono::high_resolution_clock::now() - start_time;
+    _stats._block_alloc_usec += elapsed.count() * 1e6;
+
+    return addr;
+}
+
+void deepspeed_pin_tensor_t::_release_block(void* addr)
+{
+    const auto block = _blocks.at(addr);
+
+#if defined(DS_AIO_CUDART)
+    if (block._cuda_registered) { cudaHostUnregister(addr); }
+#endif
+
+    munlock(addr, block._num_bytes);
+    if (block._backing == backing_t::aligned_alloc) {
+        ::free(addr);
+    } else {
+        munmap(addr, block._num_bytes);
     }
-    _locked_tensors.clear();
+
+    if (block._backing == backing_t::hugetlb) { _stats._hugetlb_bytes -= block._num_bytes; }
+    if (block._backing == backing_t::thp) { _stats._thp_bytes -= block._num_bytes; }
+    if (block._cuda_registered) { _stats._cuda_registered_bytes -= block._num_bytes; }
+
+    _blocks.erase(addr);
+    _locked_tensors.erase(addr);
+    _locked_tensors_version++;
 }
 
 torch::Tensor deepspeed_pin_tensor_t::alloc(const size_t num_elem, const at::ScalarType& elem_type)
 {
     const auto num_bytes = num_elem * elementSize(elem_type);
-    auto pinned_buffer = ds_page_aligned_alloc(num_bytes, true);
-    assert(nullptr != pinned_buffer);
+    const auto block_bytes = _size_class(num_bytes);
 
-    _locked_tensors[pinned_buffer] = num_bytes;
+    void* pinned_buffer = nullptr;
+    auto cached = _cached.find(block_bytes);
+    if (cached != _cached.end()) {
+        pinned_buffer = cached->second;
+        _cached.erase(cached);
+        _stats._cached_bytes -= block_bytes;
+        _stats._cache_hits++;
+    } else {
+        pinned_buffer = _alloc_block(block_bytes);
+        // Idle blocks of other classes may be holding the mlock budget
+        if (nullptr == pinned_buffer && release_cached() > 0) {
+            pinned_buffer = _alloc_block(block_bytes);
+        }
+        _stats._cache_misses++;
+    }
+    TORCH_CHECK(nullptr != pinned_buffer,
+                "deepspeed_aio: failed to allocate ",
+                block_bytes,
+                " bytes of page-locked memory");
+
+    _in_use[pinned_buffer] = num_bytes;
+    _stats._allocs++;
+    _stats._requested_bytes += num_bytes;
+    _stats._in_use_bytes += block_bytes;
 
     auto options = torch::TensorOptions().dtype(elem_type).device(torch::kCPU);
 
-    return at::from_blob(pinned_buffer, static_cast<long int>(num_bytes), options);
+    return at::from_blob(pinned_buffer, static_cast<long int>(num_elem), options);
 }
 
 bool deepspeed_pin_tensor_t::free(torch::Tensor& locked_tensor)
 {
     auto addr = locked_tensor.data_ptr();
-    if (_locked_tensors.find(addr) != _locked_tensors.end()) {
-        munlock(addr, _locked_tensors[addr]);
-        _locked_tensors.erase(addr);
-        return true;
+    auto in_use = _in_use.find(addr);
+    if (in_use == _in_use.end()) { return false; }
+
+    const auto block_bytes = _blocks.at(addr)._num_bytes;
+    _stats._frees++;
+    _stats._requested_bytes -= in_use->second;
+    _stats._in_use_bytes -= block_bytes;
+    _in_use.erase(in_use);
+
+    if (_config._max_cached_bytes > 0 &&
+        _stats._cached_bytes + block_bytes > _config._max_cached_bytes) {
+        _release_block(addr);
+    } else {
+        _cached.insert({block_bytes, addr});
+        _stats._cached_bytes += block_bytes;
     }
 
-    return false;
+    return true;
+}
+
+size_t deepspeed_pin_tensor_t::release_cached()
+{
+    size_t released = 0;
+    for (auto& cached : _cached) {
+        released += cached.first;
+        _release_block(cached.second);
+    }
+    _cached.clear();
+    _stats._cached_bytes = 0;
+    return released;
 }
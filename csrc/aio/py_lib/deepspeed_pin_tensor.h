@@ -5,17 +5,67 @@
 
 /*
 Functionality for managing CPU tensors occupying page-locked memory.
-TODO: Implement a full-featured manager that
-1. Avoid page-locked memory leaks
-2. Minimize page-locked memory usage by reducing internal fragmentation
-Functionality for managing CPU tensors occupying page-locked memory.
+
+Freed tensors are returned to a cache keyed by size class rather than unlocked, so swap
+buffers that are requested over and over are served without another posix_memalign/mlock.
+Small requests are rounded to the next power of two so that nearby sizes share blocks, large
+ones only to the page (or huge page) size, a power of two class could lock almost twice the
+bytes of a multi-GB buffer.
+Large blocks can be backed by huge pages (hugetlbfs when pages are reserved, transparent huge
+pages otherwise) to cut TLB misses on multi-GB buffers, and can be registered with the CUDA
+driver so device copies do not stage through a bounce buffer.
 */
 
 #include <map>
 #include "deepspeed_py_aio.h"
 
+struct deepspeed_pin_pool_config_t {
+    // Round every request to the page (or huge page) size instead of the next power of two.
+    // Exact classes waste less of the mlock budget but only reuse blocks of identical size.
+    bool _exact_size_classes = false;
+    // Largest request rounded to a power of two, larger ones get exact classes. 0 rounds every
+    // request to a power of two.
+    size_t _geometric_max_bytes = 64 * 1024 * 1024;
+    bool _use_hugepages = true;
+    bool _cuda_host_register = false;
+    // Upper bound on idle cached bytes, 0 means unbounded.
+    size_t _max_cached_bytes = 0;
+};
+
+struct deepspeed_pin_pool_stats_t {
+    long long int _allocs = 0;
+    long long int _frees = 0;
+    long long int _cache_hits = 0;
+    long long int _cache_misses = 0;
+    size_t _requested_bytes = 0;
+    size_t _in_use_bytes = 0;
+    size_t _cached_bytes = 0;
+    size_t _peak_locked_bytes = 0;
+    size_t _hugetlb_bytes = 0;
+    size_t _thp_bytes = 0;
+    size_t _cuda_registered_bytes = 0;
+    double _block_alloc_usec = 0;
+};
+
 struct deepspeed_pin_tensor_t {
+    enum class backing_t { aligned_alloc, hugetlb, thp };
+
+    struct pinned_block_t {
+        size_t _num_bytes;
+        backing_t _backing;
+        bool _cuda_registered;
+    };
+
+    // Every block currently locked by the pool (in use or cached), mapped to its size.
     std::map<void*, size_t> _locked_tensors;
+    // Bumped whenever _locked_tensors changes, so callers know to re-register buffers.
+    long long int _locked_tensors_version = 0;
+    std::map<void*, pinned_block_t> _blocks;
+    // Blocks handed out, mapped to the number of bytes that were requested.
+    std::map<void*, size_t> _in_use;
+    std::multimap<size_t, void*> _cached;
+    deepspeed_pin_pool_config_t _config;
+    deepspeed_pin_pool_stats_t _stats;
 
     deepspeed_pin_tensor_t() = default;
 
@@ -24,4 +74,17 @@ struct deepspeed_pin_tensor_t {
     torch::Tensor alloc(const size_t num_elem, const at::ScalarType& elem_type);
 
     bool free(torch::Tensor& locked_tensor);
+
+    void configure(const deepspeed_pin_pool_config_t& config);
+
+    // Unlocks and releases every cached block, returns the number of bytes released.
+    size_t release_cached();
+
+    size_t _size_class(const size_t num_bytes) const;
+
+    void* _alloc_block(const size_t block_bytes);
+
+    void _release_block(void* addr);
 };
+
+bool cuda_host_register_available();
@@ -14,23 +14,52 @@ Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
 
 using namespace std;
 
+// Smallest unit O_DIRECT transfers can be aligned to, the logical sector of the device.
+static const long long int c_direct_io_alignment = 512;
+
 static void _start_aio_thread(std::shared_ptr<struct deepspeed_aio_thread_t> ctxt) { ctxt->run(); }
 
 deepspeed_aio_handle_t::deepspeed_aio_handle_t(const int block_size,
                                                const int queue_depth,
                                                const bool single_submit,
                                                const bool overlap_events,
-                                               const int num_threads)
+                                               const int num_threads,
+                                               const bool use_io_uring,
+                                               const bool sq_poll,
+                                               const bool use_gds)
     : _aio_ctxt(new aio_context(block_size, queue_depth)),
       _single_submit(single_submit),
       _overlap_events(overlap_events),
       _num_threads(num_threads),
-      _aio_config(block_size, queue_depth, single_submit, overlap_events, false),
+      _aio_config(block_size,
+                  queue_depth,
+                  single_submit,
+                  overlap_events,
+                  false,
+                  use_io_uring,
+                  sq_poll),
       _num_pending_ops(0),
-      _pinned_tensor_mgr(new deepspeed_pin_tensor_t())
+      _num_failed_ops(0),
+      _pinned_tensor_mgr(new deepspeed_pin_tensor_t()),
+      _pinned_buffers_dirty(false),
+      _next_request_id(0),
+      _use_gds(use_gds && gds_driver_open()),
+      _wait_usec(0),
+      _wait_calls(0)
 {
+    if (_use_gds) { _gds_files.reset(new gds_file_cache_t()); }
+    if (use_gds && !_use_gds) {
+        std::cerr << "deepspeed_aio: GPUDirect Storage unavailable, staging device tensors "
+                     "through host memory"
+                  << std::endl;
+    }
+    if (use_io_uring && !uring_engine_available()) {
+        std::cerr << "deepspeed_aio: built without io_uring support, using libaio" << std::endl;
+    }
+
     for (auto i = 0; i < num_threads; ++i) {
-        _thread_contexts.push_back(std::make_shared<deepspeed_aio_thread_t>(i, _aio_config));
+        _thread_contexts.push_back(
+            std::make_shared<deepspeed_aio_thread_t>(i, _aio_config, _completion));
     }
 
     for (auto& ctxt : _thread_contexts) {
@@ -60,6 +89,16 @@ const bool deepspeed_aio_handle_t::get_overlap_events() const { return _overlap_
 
 const int deepspeed_aio_handle_t::get_thread_count() const { return _num_threads; }
 
+const bool deepspeed_aio_handle_t::get_use_gds() const { return _use_gds; }
+
+const bool deepspeed_aio_handle_t::get_use_io_uring() const
+{
+    for (auto& ctxt : _thread_contexts) {
+        if (!ctxt->_uring_ctxt) { return false; }
+    }
+    return !_thread_contexts.empty();
+}
+
 int deepspeed_aio_handle_t::read(torch::Tensor& buffer, const char* filename, const bool validate)
 {
     const auto start_time = std::chrono::high_resolution_clock::now();
@@ -134,29 +173,42 @@ int deepspeed_aio_handle_t::write(const torch::Tensor& buffer,
     return 0;
 }
 
-void deepspeed_aio_handle_t::_schedule_aio_work(std::shared_ptr<struct io_op_desc_t> scheduled_op)
+long long int deepspeed_aio_handle_t::_schedule_aio_work(
+    std::shared_ptr<struct io_op_desc_t> scheduled_op)
+{
+    return _schedule_aio_work(std::vector<std::shared_ptr<struct io_op_desc_t>>{scheduled_op});
+}
+
+long long int deepspeed_aio_handle_t::_schedule_aio_work(
+    const std::vector<std::shared_ptr<struct io_op_desc_t>>& scheduled_ops)
 {
+    // Empty requests get an id too, they simply have nothing to wait for.
+    const auto request_id = _next_request_id++;
+    if (scheduled_ops.empty()) { return request_id; }
+
+    auto& request = _requests[request_id];
+    request._num_ops = static_cast<int>(scheduled_ops.size());
+    request._num_pending_ops = request._num_ops;
+
+    for (auto& op : scheduled_ops) {
+        op->_request_id = request_id;
+        op->set_chunks(_num_threads, _aio_config._block_size);
+    }
+
     for (auto& ctxt : _thread_contexts) {
         {
             std::lock_guard<std::mutex> lock(ctxt->_work_sync._mutex);
-            ctxt->_work_queue.push(scheduled_op);
+            for (auto& op : scheduled_ops) { ctxt->_work_queue.push(op); }
         }
         ctxt->_work_sync._cond_var.notify_one();
     }
-    _num_pending_ops++;
+    _num_pending_ops += scheduled_ops.size();
+    return request_id;
 }
 
 std::shared_ptr<struct io_op_desc_t> deepspeed_aio_handle_t::_wait_for_aio_work()
 {
-    std::shared_ptr<struct io_op_desc_t> completed_op = nullptr;
-    for (auto& ctxt : _thread_contexts) {
-        std::unique_lock<std::mutex> lock(ctxt->_complete_sync._mutex);
-        ctxt->_complete_sync._cond_var.wait(lock,
-                                            [ctxt] { return !ctxt->_complete_queue.empty(); });
-        completed_op = ctxt->_complete_queue.front();
-        ctxt->_complete_queue.pop();
-    }
-    return completed_op;
+    return _completion.pop();
 }
 
 void deepspeed_aio_handle_t::_stop_threads()
@@ -175,25 +227,132 @@ int deepspeed_aio_handle_t::wait()
 {
     assert(_num_pending_ops > 0);
     auto num_completed_ops = 0;
+    const auto start_time = std::chrono::high_resolution_clock::now();
 
     while (_num_pending_ops > 0) {
-        auto completed_op = _wait_for_aio_work();
+        _retire_op(_wait_for_aio_work());
+        ++num_completed_ops;
+    }
 
-        completed_op->fini();
+    _record_wait(start_time);
+    return _report_failed_ops(num_completed_ops);
+}
 
-        close(completed_op->_fd);
+long long int deepspeed_aio_handle_t::get_last_request() const { return _next_request_id - 1; }
 
-        if (completed_op->_validate) {
-            validate_aio_operation(completed_op->_read_op,
-                                   completed_op->_filename.c_str(),
-                                   completed_op->data_ptr(),
-                                   _num_threads * completed_op->_num_bytes);
-        }
-        --_num_pending_ops;
-        ++num_completed_ops;
+int deepspeed_aio_handle_t::wait_request(const long long int request_id)
+{
+    auto request_iter = _requests.find(request_id);
+    if (request_iter == _requests.end()) { return 0; }
+
+    const auto num_ops = request_iter->second._num_ops;
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    // Completions arrive in any order, ops of other requests popped on the way are retired too.
+    while (_requests.count(request_id)) { _retire_op(_wait_for_aio_work()); }
+
+    _record_wait(start_time);
+    return _report_failed_ops(num_ops);
+}
+
+bool deepspeed_aio_handle_t::test_request(const long long int request_id)
+{
+    while (auto completed_op = _completion.try_pop()) { _retire_op(completed_op); }
+    if (_pinned_buffers_dirty) { _register_pinned_buffers(); }
+    return _requests.count(request_id) == 0;
+}
+
+void deepspeed_aio_handle_t::_retire_op(std::shared_ptr<struct io_op_desc_t> completed_op)
+{
+    completed_op->fini();
+
+    if (completed_op->_owns_fd) { close(completed_op->_fd); }
+
+    if (completed_op->_error != 0) {
+        std::cerr << "deepspeed_aio: " << (completed_op->_read_op ? "read of " : "write of ")
+                  << completed_op->_filename << " failed with error " << -completed_op->_error
+                  << std::endl;
+        ++_num_failed_ops;
+    }
+
+    if (completed_op->_validate) {
+        validate_aio_operation(completed_op->_read_op,
+                               completed_op->_filename.c_str(),
+                               completed_op->data_ptr(),
+                               _num_threads * completed_op->_num_bytes);
     }
+    --_num_pending_ops;
 
-    return num_completed_ops;
+    auto request_iter = _requests.find(completed_op->_request_id);
+    assert(request_iter != _requests.end());
+    if (--request_iter->second._num_pending_ops == 0) {
+        for (auto fd : request_iter->second._fds) { close(fd); }
+        _requests.erase(request_iter);
+    }
+}
+
+int deepspeed_aio_handle_t::_report_failed_ops(const int num_ops)
+{
+    if (_num_failed_ops == 0) { return num_ops; }
+    _num_failed_ops = 0;
+    return -1;
+}
+
+void deepspeed_aio_handle_t::_record_wait(
+    const std::chrono::high_resolution_clock::time_point& start_time)
+{
+    const std::chrono::duration<double> elapsed =
+        std::chrono::high_resolution_clock::now() - start_time;
+    _wait_usec += elapsed.count() * 1e6;
+    ++_wait_calls;
+
+    if (_pinned_buffers_dirty) { _register_pinned_buffers(); }
+}
+
+static py::dict _histogram_to_dict(const deepspeed_aio_histogram_t& histogram)
+{
+    py::dict result;
+    result["count"] = histogram._count.load();
+    result["total_usec"] = histogram._total_nsec.load() / 1e3;
+    result["max_usec"] = histogram._max_nsec.load() / 1e3;
+    // buckets[i] counts latencies in [2^(i-1), 2^i) usec, bucket 0 is everything below 1 usec.
+    result["buckets"] = histogram.get_buckets();
+    return result;
+}
+
+py::dict deepspeed_aio_handle_t::get_stats() const
+{
+    py::list threads;
+    for (auto& ctxt : _thread_contexts) {
+        const auto& stats = ctxt->_stats;
+        const auto samples = stats._queue_depth_samples.load();
+
+        py::dict thread_stats;
+        thread_stats["read_bytes"] = stats._read_bytes.load();
+        thread_stats["write_bytes"] = stats._write_bytes.load();
+        thread_stats["read_ops"] = stats._read_ops.load();
+        thread_stats["write_ops"] = stats._write_ops.load();
+        thread_stats["busy_usec"] = stats._busy_nsec.load() / 1e3;
+        thread_stats["queue_depth_avg"] =
+            samples ? static_cast<double>(stats._queue_depth_sum.load()) / samples : 0.0;
+        thread_stats["queue_depth_max"] = stats._queue_depth_max.load();
+        thread_stats["submit"] = _histogram_to_dict(stats._submit);
+        thread_stats["complete"] = _histogram_to_dict(stats._complete);
+        threads.append(thread_stats);
+    }
+
+    py::dict result;
+    result["wait_usec"] = _wait_usec;
+    result["wait_calls"] = _wait_calls;
+    result["threads"] = threads;
+    return result;
+}
+
+void deepspeed_aio_handle_t::reset_stats()
+{
+    for (auto& ctxt : _thread_contexts) { ctxt->_stats.reset(); }
+    _wait_usec = 0;
+    _wait_calls = 0;
 }
 
 bool deepspeed_aio_handle_t::_is_valid_parallel_aio_op(const bool read_op,
@@ -233,8 +392,15 @@ int deepspeed_aio_handle_t::pread(const torch::Tensor& buffer,
     const auto fd = open_file(filename, true);
     if (fd == -1) { return -1; }
 
-    auto scheduled_op = std::make_shared<io_op_desc_t>(
-        true, buffer, fd, filename, (num_file_bytes / _num_threads), validate);
+    auto scheduled_op = std::make_shared<io_op_desc_t>(true,
+                                                       buffer,
+                                                       fd,
+                                                       filename,
+                                                       (num_file_bytes / _num_threads),
+                                                       validate,
+                                                       0,
+                                                       true,
+                                                       _gds_files.get());
 
     _schedule_aio_work(scheduled_op);
 
@@ -256,8 +422,15 @@ int deepspeed_aio_handle_t::pwrite(const torch::Tensor& buffer,
     const auto fd = open_file(filename, false);
     if (fd == -1) { return -1; }
 
-    auto scheduled_op = std::make_shared<io_op_desc_t>(
-        false, buffer, fd, filename, (num_write_bytes / _num_threads), validate);
+    auto scheduled_op = std::make_shared<io_op_desc_t>(false,
+                                                       buffer,
+                                                       fd,
+                                                       filename,
+                                                       (num_write_bytes / _num_threads),
+                                                       validate,
+                                                       0,
+                                                       true,
+                                                       _gds_files.get());
 
     _schedule_aio_work(scheduled_op);
 
@@ -286,13 +459,394 @@ int deepspeed_aio_handle_t::async_pwrite(const torch::Tensor& buffer, const char
     return pwrite(buffer, filename, false, true);
 }
 
+int deepspeed_aio_handle_t::async_pread_batch(const std::vector<torch::Tensor>& buffers,
+                                              const std::vector<std::string>& filenames,
+                                              const std::vector<long long int>& offsets)
+{
+    return _batch_io(true, buffers, filenames, offsets);
+}
+
+int deepspeed_aio_handle_t::async_pwrite_batch(const std::vector<torch::Tensor>& buffers,
+                                               const std::vector<std::string>& filenames,
+                                               const std::vector<long long int>& offsets)
+{
+    return _batch_io(false, buffers, filenames, offsets);
+}
+
+int deepspeed_aio_handle_t::_batch_io(const bool read_op,
+                                      const std::vector<torch::Tensor>& buffers,
+                                      const std::vector<std::string>& filenames,
+                                      const std::vector<long long int>& offsets)
+{
+    if (buffers.size() != filenames.size() || buffers.size() != offsets.size()) {
+        std::cout << "deepspeed_aio failure: batch of " << buffers.size() << " buffers, "
+                  << filenames.size() << " files and " << offsets.size() << " offsets"
+                  << std::endl;
+        return -1;
+    }
+
+    std::map<std::string, int> batch_fds;
+    const auto fail = [&batch_fds]() {
+        for (auto& file_fd : batch_fds) { close(file_fd.second); }
+        return -1;
+    };
+
+    std::vector<std::shared_ptr<struct io_op_desc_t>> scheduled_ops;
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        const auto filename = filenames[i].c_str();
+        const auto num_bytes = static_cast<long long int>(buffers[i].nbytes());
+        if (!_is_valid_parallel_aio_op(read_op, num_bytes)) { return fail(); }
+
+        if (read_op) {
+            long long num_file_bytes;
+            if (-1 == get_file_size(filename, num_file_bytes)) {
+                const auto error_code = errno;
+                report_file_error(filename, " fstat for read", error_code);
+                return fail();
+            }
+            if ((offsets[i] + num_bytes) > num_file_bytes) {
+                std::cout << filename << ": read of " << num_bytes << " bytes at offset "
+                          << offsets[i] << " exceeds file bytes " << num_file_bytes << std::endl;
+                return fail();
+            }
+        }
+
+        auto fd_iter = batch_fds.find(filenames[i]);
+        if (fd_iter == batch_fds.end()) {
+            const auto fd = open_file(filename, read_op);
+            if (fd == -1) { return fail(); }
+            fd_iter = batch_fds.emplace(filenames[i], fd).first;
+        }
+
+        scheduled_ops.push_back(std::make_shared<io_op_desc_t>(read_op,
+                                                               buffers[i],
+                                                               fd_iter->second,
+                                                               filename,
+                                                               (num_bytes / _num_threads),
+                                                               false,
+                                                               offsets[i],
+                                                               false,
+                                                               _gds_files.get()));
+    }
+
+    const auto request_id = _schedule_aio_work(scheduled_ops);
+    if (!scheduled_ops.empty()) {
+        for (auto& file_fd : batch_fds) { _requests[request_id]._fds.push_back(file_fd.second); }
+    }
+    return 0;
+}
+
+int deepspeed_aio_handle_t::async_pread_striped(torch::Tensor& buffer,
+                                                const std::vector<std::string>& filenames,
+                                                const long long int stripe_size)
+{
+    return _striped_io(true, buffer, filenames, stripe_size);
+}
+
+int deepspeed_aio_handle_t::async_pwrite_striped(const torch::Tensor& buffer,
+                                                 const std::vector<std::string>& filenames,
+                                                 const long long int stripe_size)
+{
+    return _striped_io(false, buffer, filenames, stripe_size);
+}
+
+int deepspeed_aio_handle_t::_striped_io(const bool read_op,
+                                        const torch::Tensor& buffer,
+                                        const std::vector<std::string>& filenames,
+                                        const long long int stripe_size)
+{
+    const auto elem_size = static_cast<long long int>(buffer.element_size());
+    if (filenames.empty() || stripe_size <= 0 || (stripe_size % elem_size) ||
+        !buffer.is_contiguous()) {
+        std::cout << "deepspeed_aio failure: invalid stripe of " << stripe_size << " bytes over "
+                  << filenames.size() << " files for a "
+                  << (buffer.is_contiguous() ? "contiguous" : "non-contiguous") << " buffer"
+                  << std::endl;
+        return -1;
+    }
+
+    // Every thread's slice of a stripe, in the file and in memory, must stay O_DIRECT aligned, the
+    // tail stripe included, or the kernel fails the transfer with EINVAL.
+    const auto alignment = c_direct_io_alignment * _num_threads;
+    const auto num_bytes = static_cast<long long int>(buffer.nbytes());
+    if ((stripe_size % alignment) || (num_bytes % alignment)) {
+        std::cout << "deepspeed_aio failure: unaligned stripe of " << stripe_size
+                  << " bytes over a buffer of " << num_bytes
+                  << " bytes, both must be multiples of " << alignment << " bytes" << std::endl;
+        return -1;
+    }
+
+    // Stripes are views into the buffer, so reads land in place and the batch path handles
+    // opening each device file once.
+    const auto flat_buffer = buffer.reshape({-1});
+    const auto stripe_elems = stripe_size / elem_size;
+    const auto num_elems = flat_buffer.numel();
+    const auto num_files = static_cast<long long int>(filenames.size());
+
+    std::vector<torch::Tensor> stripe_buffers;
+    std::vector<std::string> stripe_files;
+    std::vector<long long int> stripe_offsets;
+    for (long long int k = 0; (k * stripe_elems) < num_elems; ++k) {
+        const auto start = k * stripe_elems;
+        const auto length = min(stripe_elems, num_elems - start);
+        stripe_buffers.push_back(flat_buffer.narrow(0, start, length));
+        stripe_files.push_back(filenames[k % num_files]);
+        stripe_offsets.push_back((k / num_files) * stripe_size);
+    }
+
+    return _batch_io(read_op, stripe_buffers, stripe_files, stripe_offsets);
+}
+
+int deepspeed_aio_handle_t::async_pread_compressed(torch::Tensor& buffer,
+                                                   const char* filename,
+                                                   const char* codec)
+{
+    return _compressed_io(true, buffer, filename, codec);
+}
+
+int deepspeed_aio_handle_t::async_pwrite_compressed(const torch::Tensor& buffer,
+                                                    const char* filename,
+                                                    const char* codec)
+{
+    return _compressed_io(false, buffer, filename, codec);
+}
+
+int deepspeed_aio_handle_t::_compressed_io(const bool read_op,
+                                           const torch::Tensor& buffer,
+                                           const char* filename,
+                                           const char* codec)
+{
+    swap_codec_t swap_codec;
+    if (!parse_swap_codec(codec, swap_codec)) {
+        std::cout << "deepspeed_aio failure: unknown swap codec " << codec << std::endl;
+        return -1;
+    }
+    if (buffer.scalar_type() != torch::kFloat32 || !buffer.is_contiguous()) {
+        std::cout << "deepspeed_aio failure: compressed swap needs a contiguous fp32 buffer"
+                  << std::endl;
+        return -1;
+    }
+
+    const auto elem_size = swap_codec_elem_size(swap_codec);
+    const auto num_bytes = static_cast<long long int>(buffer.numel()) * elem_size;
+    if (!_is_valid_parallel_aio_op(read_op, num_bytes)) { return -1; }
+    if ((num_bytes / _num_threads) % elem_size) {
+        std::cout << "deepspeed_aio failure: " << buffer.numel()
+                  << " elements do not split into whole encoded elements over "
+                  << _num_threads << " threads" << std::endl;
+        return -1;
+    }
+
+    if (read_op) {
+        long long num_file_bytes;
+        if (-1 == get_file_size(filename, num_file_bytes)) {
+            const auto error_code = errno;
+            report_file_error(filename, " fstat for read", error_code);
+            return -1;
+        }
+        if (num_bytes > num_file_bytes) {
+            std::cout << filename << ": encoded read of " << num_bytes
+                      << " bytes exceeds file bytes " << num_file_bytes << std::endl;
+            return -1;
+        }
+    }
+
+    const auto fd = open_file(filename, read_op);
+    if (fd == -1) { return -1; }
+
+    auto scheduled_op = std::make_shared<io_op_desc_t>(
+        read_op, buffer, fd, filename, (num_bytes / _num_threads), false, 0, true, nullptr);
+    scheduled_op->set_codec(swap_codec);
+
+    _schedule_aio_work(scheduled_op);
+    return 0;
+}
+
+int deepspeed_aio_handle_t::new_swap_arena(const char* filename, const long long int num_bytes)
+{
+    // Extents are aligned so that every thread's slice of a transfer stays O_DIRECT aligned.
+    const auto alignment = static_cast<long long int>(sysconf(_SC_PAGESIZE)) * _num_threads;
+    std::unique_ptr<struct deepspeed_swap_arena_t> arena(
+        new deepspeed_swap_arena_t(filename, num_bytes, alignment));
+    if (!arena->is_valid()) { return -1; }
+
+    _swap_arenas.push_back(std::move(arena));
+    return static_cast<int>(_swap_arenas.size() - 1);
+}
+
+bool deepspeed_aio_handle_t::_is_valid_swap_arena(const int arena_id) const
+{
+    if (arena_id < 0 || arena_id >= static_cast<int>(_swap_arenas.size())) {
+        std::cout << "deepspeed_aio failure: invalid swap arena id " << arena_id << std::endl;
+        return false;
+    }
+    return true;
+}
+
+long long int deepspeed_aio_handle_t::swap_arena_alloc(const int arena_id,
+                                                       const long long int num_bytes)
+{
+    if (!_is_valid_swap_arena(arena_id)) { return -1; }
+    return _swap_arenas[arena_id]->alloc(num_bytes);
+}
+
+bool deepspeed_aio_handle_t::swap_arena_free(const int arena_id, const long long int offset)
+{
+    if (!_is_valid_swap_arena(arena_id)) { return false; }
+    return _swap_arenas[arena_id]->free(offset);
+}
+
+long long int deepspeed_aio_handle_t::get_swap_arena_free_bytes(const int arena_id) const
+{
+    if (!_is_valid_swap_arena(arena_id)) { return -1; }
+    return _swap_arenas[arena_id]->get_free_bytes();
+}
+
+int deepspeed_aio_handle_t::async_pread_arena(const std::vector<torch::Tensor>& buffers,
+                                              const int arena_id,
+                                              const std::vector<long long int>& offsets)
+{
+    return _arena_io(true, buffers, arena_id, offsets);
+}
+
+int deepspeed_aio_handle_t::async_pwrite_arena(const std::vector<torch::Tensor>& buffers,
+                                               const int arena_id,
+                                               const std::vector<long long int>& offsets)
+{
+    return _arena_io(false, buffers, arena_id, offsets);
+}
+
+int deepspeed_aio_handle_t::_arena_io(const bool read_op,
+                                      const std::vector<torch::Tensor>& buffers,
+                                      const int arena_id,
+                                      const std::vector<long long int>& offsets)
+{
+    if (!_is_valid_swap_arena(arena_id)) { return -1; }
+    if (buffers.size() != offsets.size()) {
+        std::cout << "deepspeed_aio failure: arena batch of " << buffers.size() << " buffers and "
+                  << offsets.size() << " offsets" << std::endl;
+        return -1;
+    }
+
+    auto& arena = _swap_arenas[arena_id];
+    std::vector<std::shared_ptr<struct io_op_desc_t>> scheduled_ops;
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        const auto num_bytes = static_cast<long long int>(buffers[i].nbytes());
+        if (!_is_valid_parallel_aio_op(read_op, num_bytes)) { return -1; }
+        if (!arena->contains(offsets[i], num_bytes)) {
+            std::cout << arena->_filename << ": " << num_bytes << " bytes at offset " << offsets[i]
+                      << " are not inside an allocated extent" << std::endl;
+            return -1;
+        }
+
+        scheduled_ops.push_back(std::make_shared<io_op_desc_t>(read_op,
+                                                               buffers[i],
+                                                               arena->_fd,
+                                                               arena->_filename.c_str(),
+                                                               (num_bytes / _num_threads),
+                                                               false,
+                                                               offsets[i],
+                                                               false,
+                                                               _gds_files.get()));
+    }
+
+    _schedule_aio_work(scheduled_ops);
+    return 0;
+}
+
 at::Tensor deepspeed_aio_handle_t::new_cpu_locked_tensor(const size_t num_elem,
                                                          const torch::Tensor& example_tensor)
 {
-    return _pinned_tensor_mgr->alloc(num_elem, example_tensor.scalar_type());
+    const auto version = _pinned_tensor_mgr->_locked_tensors_version;
+    auto locked_tensor = _pinned_tensor_mgr->alloc(num_elem, example_tensor.scalar_type());
+    // Buffers served from the pool cache are already registered
+    if (version != _pinned_tensor_mgr->_locked_tensors_version) {
+        _pinned_buffers_dirty = true;
+        _register_pinned_buffers();
+    }
+    return locked_tensor;
 }
 
 bool deepspeed_aio_handle_t::free_cpu_locked_tensor(torch::Tensor& locked_tensor)
 {
-    return _pinned_tensor_mgr->free(locked_tensor);
+    const auto version = _pinned_tensor_mgr->_locked_tensors_version;
+    const auto freed = _pinned_tensor_mgr->free(locked_tensor);
+    if (version != _pinned_tensor_mgr->_locked_tensors_version) {
+        _pinned_buffers_dirty = true;
+        _register_pinned_buffers();
+    }
+    return freed;
+}
+
+void deepspeed_aio_handle_t::configure_pinned_pool(const bool exact_size_classes,
+                                                   const bool use_hugepages,
+                                                   const bool cuda_host_register,
+                                                   const long long int max_cached_bytes,
+                                                   const long long int geometric_max_bytes)
+{
+    deepspeed_pin_pool_config_t config;
+    config._exact_size_classes = exact_size_classes;
+    config._use_hugepages = use_hugepages;
+    config._cuda_host_register = cuda_host_register;
+    config._max_cached_bytes = static_cast<size_t>(std::max(max_cached_bytes, 0LL));
+    config._geometric_max_bytes = static_cast<size_t>(std::max(geometric_max_bytes, 0LL));
+
+    const auto version = _pinned_tensor_mgr->_locked_tensors_version;
+    _pinned_tensor_mgr->configure(config);
+    if (version != _pinned_tensor_mgr->_locked_tensors_version) {
+        _pinned_buffers_dirty = true;
+        _register_pinned_buffers();
+    }
+}
+
+long long int deepspeed_aio_handle_t::release_cached_cpu_locked_tensors()
+{
+    const auto released = _pinned_tensor_mgr->release_cached();
+    if (released > 0) {
+        _pinned_buffers_dirty = true;
+        _register_pinned_buffers();
+    }
+    return static_cast<long long int>(released);
+}
+
+py::dict deepspeed_aio_handle_t::get_pinned_pool_stats() const
+{
+    const auto& stats = _pinned_tensor_mgr->_stats;
+    const auto lookups = stats._cache_hits + stats._cache_misses;
+
+    py::dict result;
+    result["allocs"] = stats._allocs;
+    result["frees"] = stats._frees;
+    result["cache_hits"] = stats._cache_hits;
+    result["cache_misses"] = stats._cache_misses;
+    result["hit_rate"] = lookups ? static_cast<double>(stats._cache_hits) / lookups : 0.0;
+    result["requested_bytes"] = stats._requested_bytes;
+    result["in_use_bytes"] = stats._in_use_bytes;
+    result["cached_bytes"] = stats._cached_bytes;
+    result["locked_bytes"] = stats._in_use_bytes + stats._cached_bytes;
+    result["peak_locked_bytes"] = stats._peak_locked_bytes;
+    result["hugetlb_bytes"] = stats._hugetlb_bytes;
+    result["thp_bytes"] = stats._thp_bytes;
+    result["cuda_registered_bytes"] = stats._cuda_registered_bytes;
+    result["block_alloc_usec"] = stats._block_alloc_usec;
+    return result;
+}
+
+void deepspeed_aio_handle_t::_register_pinned_buffers()
+{
+    if (!get_use_io_uring()) {
+        _pinned_buffers_dirty = false;
+        return;
+    }
+
+    // Registration quiesces the rings, so defer it until the in-flight ops are complete.
+    if (_num_pending_ops > 0) { return; }
+
+    std::vector<struct iovec> buffers;
+    for (auto& locked : _pinned_tensor_mgr->_locked_tensors) {
+        buffers.push_back({locked.first, locked.second});
+    }
+
+    for (auto& ctxt : _thread_contexts) { ctxt->_uring_ctxt->register_buffers(buffers); }
+    _pinned_buffers_dirty = false;
 }
@@ -8,9 +8,19 @@ Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
 */
 
 #include <condition_variable>
+#include <map>
 #include <memory>
 #include "deepspeed_aio_thread.h"
 #include "deepspeed_pin_tensor.h"
+#include "deepspeed_swap_arena.h"
+
+// Ops of one async call that have not been retired by wait() or wait_request() yet.
+struct io_request_t {
+    int _num_ops;
+    int _num_pending_ops;
+    // Files opened on behalf of the request, closed once all its ops are retired.
+    std::vector<int> _fds;
+};
 
 struct deepspeed_aio_handle_t {
     std::unique_ptr<struct aio_context> _aio_ctxt;
@@ -18,17 +28,33 @@ struct deepspeed_aio_handle_t {
     const bool _overlap_events;
     const int _num_threads;
     deepspeed_aio_config_t _aio_config;
+    io_completion_t _completion;
 
     std::vector<std::shared_ptr<struct deepspeed_aio_thread_t>> _thread_contexts;
     std::vector<std::thread> _threads;
     int _num_pending_ops;
+    // Ops retired with an I/O error since the last wait() or wait_request() reported them.
+    int _num_failed_ops;
     std::unique_ptr<struct deepspeed_pin_tensor_t> _pinned_tensor_mgr;
+    bool _pinned_buffers_dirty;
+    std::map<long long int, struct io_request_t> _requests;
+    long long int _next_request_id;
+    std::vector<std::unique_ptr<struct deepspeed_swap_arena_t>> _swap_arenas;
+    const bool _use_gds;
+    // Registered cuFile handles, only created when GDS is in use.
+    std::unique_ptr<struct gds_file_cache_t> _gds_files;
+    // Time the caller spent blocked in wait(), only touched from the Python thread.
+    double _wait_usec;
+    long long int _wait_calls;
 
     deepspeed_aio_handle_t(const int block_size,
                            const int queue_depth,
                            const bool single_submit,
                            const bool overlap_events,
-                           const int num_threads);
+                           const int num_threads,
+                           const bool use_io_uring = false,
+                           const bool sq_poll = false,
+                           const bool use_gds = false);
 
     ~deepspeed_aio_handle_t();
 
@@ -37,6 +63,8 @@ struct deepspeed_aio_handle_t {
     const bool get_single_submit() const;
     const bool get_overlap_events() const;
     const int get_thread_count() const;
+    const bool get_use_io_uring() const;
+    const bool get_use_gds() const;
 
     int read(torch::Tensor& buffer, const char* filename, const bool validate);
 
@@ -60,18 +88,132 @@ struct deepspeed_aio_handle_t {
 
     int async_pwrite(const torch::Tensor& buffer, const char* filename);
 
+    // Batched variants: buffers[i] is transferred at offsets[i] of filenames[i]. Each distinct
+    // file is opened once per batch and all ops are queued to the aio threads together.
+    int async_pread_batch(const std::vector<torch::Tensor>& buffers,
+                          const std::vector<std::string>& filenames,
+                          const std::vector<long long int>& offsets);
+
+    int async_pwrite_batch(const std::vector<torch::Tensor>& buffers,
+                           const std::vector<std::string>& filenames,
+                           const std::vector<long long int>& offsets);
+
+    // Striped variants: the buffer is split into stripe_size pieces distributed round-robin
+    // (RAID-0) over filenames, typically one file per NVMe device. Stripe k is stored in
+    // filenames[k % n] at offset (k / n) * stripe_size. For O_DIRECT the stripe and the buffer
+    // sizes must be multiples of 512 bytes per thread.
+    int async_pread_striped(torch::Tensor& buffer,
+                            const std::vector<std::string>& filenames,
+                            const long long int stripe_size);
+
+    int async_pwrite_striped(const torch::Tensor& buffer,
+                             const std::vector<std::string>& filenames,
+                             const long long int stripe_size);
+
+    // Compressed variants for fp32 buffers: the file holds the buffer encoded with codec
+    // ("bf16" or "fp16"), halving the bytes moved. Encoding and decoding run on the aio threads.
+    int async_pread_compressed(torch::Tensor& buffer, const char* filename, const char* codec);
+
+    int async_pwrite_compressed(const torch::Tensor& buffer,
+                                const char* filename,
+                                const char* codec);
+
+    // Swap arenas: preallocated files that stay open for the lifetime of the handle.
+    // Returns the arena id, or -1 on failure.
+    int new_swap_arena(const char* filename, const long long int num_bytes);
+
+    long long int swap_arena_alloc(const int arena_id, const long long int num_bytes);
+
+    bool swap_arena_free(const int arena_id, const long long int offset);
+
+    long long int get_swap_arena_free_bytes(const int arena_id) const;
+
+    int async_pread_arena(const std::vector<torch::Tensor>& buffers,
+                          const int arena_id,
+                          const std::vector<long long int>& offsets);
+
+    int async_pwrite_arena(const std::vector<torch::Tensor>& buffers,
+                           const int arena_id,
+                           const std::vector<long long int>& offsets);
+
     // TODO: Make API's args to be shape and dtype.
     torch::Tensor new_cpu_locked_tensor(const size_t num_elem, const torch::Tensor& example_tensor);
 
+    // Returns the tensor's block to the pinned pool cache, it stays locked for reuse.
     bool free_cpu_locked_tensor(torch::Tensor&);
 
+    // Applies to blocks allocated afterwards, idle cached blocks are released.
+    void configure_pinned_pool(const bool exact_size_classes,
+                               const bool use_hugepages,
+                               const bool cuda_host_register,
+                               const long long int max_cached_bytes,
+                               const long long int geometric_max_bytes);
+
+    // Unlocks the idle cached blocks, returns the number of bytes released.
+    long long int release_cached_cpu_locked_tensors();
+
+    py::dict get_pinned_pool_stats() const;
+
+    // Blocks until all pending ops are retired, returns their number, or -1 if any op retired
+    // since the last wait failed.
     int wait();
 
+    // Per-request completion: every async call is a request, identified by
+    // get_last_request() right after the call.
+    long long int get_last_request() const;
+
+    // Blocks until all ops of the request are retired, returns the number of ops in the
+    // request, 0 if it already completed, or -1 if any op retired since the last wait failed.
+    int wait_request(const long long int request_id);
+
+    // Retires whatever has completed so far without blocking, returns true if the request
+    // has completed.
+    bool test_request(const long long int request_id);
+
+    // Snapshot of the always-on counters: wait() totals plus one dict per aio thread.
+    py::dict get_stats() const;
+
+    void reset_stats();
+
     void _stop_threads();
 
-    void _schedule_aio_work(std::shared_ptr<struct io_op_desc_t> scheduled_op);
+    long long int _schedule_aio_work(std::shared_ptr<struct io_op_desc_t> scheduled_op);
+
+    long long int _schedule_aio_work(
+        const std::vector<std::shared_ptr<struct io_op_desc_t>>& scheduled_ops);
+
+    void _retire_op(std::shared_ptr<struct io_op_desc_t> completed_op);
+
+    void _record_wait(const std::chrono::high_resolution_clock::time_point& start_time);
+
+    // Returns num_ops, or -1 (clearing the count) if ops failed since the last report.
+    int _report_failed_ops(const int num_ops);
+
+    int _batch_io(const bool read_op,
+                  const std::vector<torch::Tensor>& buffers,
+                  const std::vector<std::string>& filenames,
+                  const std::vector<long long int>& offsets);
+
+    int _striped_io(const bool read_op,
+                    const torch::Tensor& buffer,
+                    const std::vector<std::string>& filenames,
+                    const long long int stripe_size);
+
+    int _compressed_io(const bool read_op,
+                       const torch::Tensor& buffer,
+                       const char* filename,
+                       const char* codec);
 
     std::shared_ptr<struct io_op_desc_t> _wait_for_aio_work();
 
     bool _is_valid_parallel_aio_op(const bool read_op, const long long int num_bytes);
+
+    void _register_pinned_buffers();
+
+    bool _is_valid_swap_arena(const int arena_id) const;
+
+    int _arena_io(const bool read_op,
+                  const std::vector<torch::Tensor>& buffers,
+                  const int arena_id,
+                  const std::vector<long long int>& offsets);
 };
@@ -5,131 +5,245 @@
 
 /*
 Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
+
+Copies are split into fixed size chunks of the destination. On multi-socket hosts every chunk is
+bucketed by the NUMA node its destination pages live on, and each OpenMP thread drains the
+bucket of the node it runs on before helping with the others, so most writes stay node local.
+Copies larger than the last level cache use non-temporal stores, which skip the read for
+ownership and keep the streamed buffer from evicting the working set.
 */
 
 #include "deepspeed_py_copy.h"
 #include <omp.h>
+#include <sys/syscall.h>
+#include <atomic>
+#include <memory>
 
-#define ROUND_DOWN(size, step) ((size) & ~((step)-1))
+// Destination bytes handed to a thread at a time
+static const size_t COPY_CHUNK_BYTES = 4 * 1024 * 1024;
 
+// Bytes written by one SIMD store of fp32 lanes
 #if defined(__AVX512__) or defined(__AVX256__)
-union AVX_Data {
-#if defined(__AVX512__)
-    __m512 data;
-#else
-    __m256 data;
-#endif
-};
+static const size_t SIMD_STORE_BYTES = SIMD_WIDTH * sizeof(float);
 #endif
 
-static void helper_memcpy_1(float* dest, float* src, size_t param_size)
+static size_t _llc_bytes()
 {
-    size_t rounded_size = 0;
-
-#if defined(__AVX512__) or defined(__AVX256__)
-
-    rounded_size = ROUND_DOWN(param_size, SIMD_WIDTH);
-
-    for (size_t t = 0; t < rounded_size; t += TILE) {
-        size_t copy_size = TILE;
-        if ((t + TILE) > rounded_size) copy_size = rounded_size - t;
-        size_t offset = copy_size + t;
-#pragma omp parallel for
-        for (size_t i = t; i < offset; i += SIMD_WIDTH) {
-            AVX_Data src_4;
-            src_4.data = SIMD_LOAD(src + i);
+    static const size_t llc_bytes = [] {
+        const auto bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        return bytes > 0 ? static_cast<size_t>(bytes) : static_cast<size_t>(32 * 1024 * 1024);
+    }();
+    return llc_bytes;
+}
 
-            SIMD_STORE(dest + i, src_4.data);
+// Kernel NUMA node id of each CPU, empty on single node hosts.
+static const std::vector<int>& _cpu_nodes()
+{
+    static const std::vector<int> cpu_nodes = [] {
+        std::vector<int> result;
+        int num_nodes = 0;
+        for (int node = 0; node < 1024; ++node) {
+            std::ifstream cpulist_file("/sys/devices/system/node/node" + std::to_string(node) +
+                                       "/cpulist");
+            if (!cpulist_file) { continue; }
+            std::string cpulist;
+            std::getline(cpulist_file, cpulist);
+            const auto cpus = ds_numa_parse_cpulist(cpulist);
+            if (!cpus.empty()) { num_nodes++; }
+            for (const auto cpu : cpus) {
+                if (static_cast<size_t>(cpu) >= result.size()) { result.resize(cpu + 1, 0); }
+                result[cpu] = node;
+            }
         }
-    }
+        if (num_nodes < 2) { result.clear(); }
+        return result;
+    }();
+    return cpu_nodes;
+}
 
+// Kernel NUMA node id of the page at addr, -1 if unknown.
+static int _page_node(const void* addr)
+{
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+    // MPOL_F_NODE | MPOL_F_ADDR, without depending on libnuma headers
+    const unsigned long flags = 3;
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, nullptr, 0, addr, flags) != 0) { return -1; }
+    return node;
+#else
+    return -1;
 #endif
+}
 
-    if (param_size > rounded_size) {
-#pragma omp parallel for
-        for (size_t k = rounded_size; k < param_size; k++) { dest[k] = src[k]; }
+static bool _ds_dtype(const at::ScalarType type, ds_dtype_t* dtype)
+{
+    if (type == at::kFloat) {
+        *dtype = DS_DTYPE_FP32;
+    } else if (type == at::kHalf) {
+        *dtype = DS_DTYPE_FP16;
+    } else if (type == at::kBFloat16) {
+        *dtype = DS_DTYPE_BF16;
+    } else {
+        return false;
     }
+    return true;
 }
 
-static void helper_memcpy_4(float* dest, float* src, size_t param_size)
+static void _copy_bytes(char* dest, const char* src, const size_t num_bytes, const bool streaming)
 {
-    size_t rounded_size = 0;
-
 #if defined(__AVX512__) or defined(__AVX256__)
+    if (streaming) {
+        const auto misalign = reinterpret_cast<uintptr_t>(dest) % SIMD_STORE_BYTES;
+        const auto head = std::min(num_bytes, misalign ? SIMD_STORE_BYTES - misalign : 0);
+        memcpy(dest, src, head);
 
-    rounded_size = ROUND_DOWN(param_size, (SIMD_WIDTH << 2));
-
-    for (size_t t = 0; t < rounded_size; t += TILE) {
-        size_t copy_size = TILE;
-        if ((t + TILE) > rounded_size) copy_size = rounded_size - t;
-        size_t offset = copy_size + t;
-#pragma omp parallel for
-        for (size_t i = t; i < offset; i += (SIMD_WIDTH << 2)) {
-            AVX_Data src_4[4];
-            src_4[0].data = SIMD_LOAD(src + i);
-            src_4[1].data = SIMD_LOAD(src + i + SIMD_WIDTH);
-            src_4[2].data = SIMD_LOAD(src + i + (SIMD_WIDTH << 1));
-            src_4[3].data = SIMD_LOAD(src + i + SIMD_WIDTH * 3);
-
-            SIMD_STORE(dest + i, src_4[0].data);
-            SIMD_STORE(dest + i + SIMD_WIDTH, src_4[1].data);
-            SIMD_STORE(dest + i + (SIMD_WIDTH << 1), src_4[2].data);
-            SIMD_STORE(dest + i + SIMD_WIDTH * 3, src_4[3].data);
+        size_t i = head;
+        for (; i + SIMD_STORE_BYTES <= num_bytes; i += SIMD_STORE_BYTES) {
+#if defined(__AVX512__)
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + i),
+                                _mm512_loadu_si512(reinterpret_cast<const void*>(src + i)));
+#else
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + i),
+                                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+#endif
         }
+        memcpy(dest + i, src + i, num_bytes - i);
+        _mm_sfence();
+        return;
     }
 #endif
-    if (param_size > rounded_size)
-        helper_memcpy_1((dest + rounded_size), (src + rounded_size), (param_size - rounded_size));
+    memcpy(dest, src, num_bytes);
 }
 
-static void helper_mempcy_8(float* dest, float* src, size_t param_size)
+static void _convert(float* dest,
+                     const ds_dtype_t dest_dtype,
+                     float* src,
+                     const ds_dtype_t src_dtype,
+                     const size_t num_elems,
+                     const bool streaming)
 {
+    size_t head = 0;
     size_t rounded_size = 0;
 
 #if defined(__AVX512__) or defined(__AVX256__)
-
-    rounded_size = ROUND_DOWN(param_size, (SIMD_WIDTH << 2));
-
-    for (size_t t = 0; t < rounded_size; t += TILE) {
-        size_t copy_size = TILE;
-        if ((t + TILE) > rounded_size) copy_size = rounded_size - t;
-        size_t offset = copy_size + t;
-#pragma omp parallel for
-        for (size_t i = t; i < offset; i += (SIMD_WIDTH << 3)) {
-            AVX_Data src_4[8];
-            src_4[0].data = SIMD_LOAD(src + i);
-            src_4[1].data = SIMD_LOAD(src + i + SIMD_WIDTH);
-            src_4[2].data = SIMD_LOAD(src + i + (SIMD_WIDTH << 1));
-            src_4[3].data = SIMD_LOAD(src + i + SIMD_WIDTH * 3);
-            src_4[4].data = SIMD_LOAD(src + i + (SIMD_WIDTH << 2));
-            src_4[5].data = SIMD_LOAD(src + i + SIMD_WIDTH * 5);
-            src_4[6].data = SIMD_LOAD(src + i + SIMD_WIDTH * 6);
-            src_4[7].data = SIMD_LOAD(src + i + SIMD_WIDTH * 7);
-
-            SIMD_STORE(dest + i, src_4[0].data);
-            SIMD_STORE(dest + i + SIMD_WIDTH, src_4[1].data);
-            SIMD_STORE(dest + i + (SIMD_WIDTH << 1), src_4[2].data);
-            SIMD_STORE(dest + i + SIMD_WIDTH * 3, src_4[3].data);
-            SIMD_STORE(dest + i + (SIMD_WIDTH << 2), src_4[4].data);
-            SIMD_STORE(dest + i + SIMD_WIDTH * 5, src_4[5].data);
-            SIMD_STORE(dest + i + SIMD_WIDTH * 6, src_4[6].data);
-            SIMD_STORE(dest + i + SIMD_WIDTH * 7, src_4[7].data);
+    // Peel up to the store alignment: the 16-bit SIMD stores and the streaming stores need it.
+    // Odd 16-bit destinations can never be aligned and are converted elementwise.
+    const auto dest_elem = ds_dtype_is_16bit(dest_dtype) ? sizeof(uint16_t) : sizeof(float);
+    const auto store_bytes = ds_dtype_is_16bit(dest_dtype) ? SIMD_STORE_BYTES / 2
+                                                           : SIMD_STORE_BYTES;
+    const auto misalign = reinterpret_cast<uintptr_t>(dest) % store_bytes;
+    const bool vectorize = (misalign % dest_elem == 0);
+    head = misalign ? std::min(num_elems, (store_bytes - misalign) / dest_elem) : 0;
+    const bool stream_fp32 = streaming && dest_dtype == DS_DTYPE_FP32;
+
+    if (vectorize) {
+        rounded_size = head + ROUND_DOWN(num_elems - head, SIMD_WIDTH);
+        for (size_t i = head; i < rounded_size; i += SIMD_WIDTH) {
+            AVX_Data data;
+            simd_load<1>(&data, ds_dtype_offset(src, i, src_dtype), src_dtype);
+            if (stream_fp32) {
+                SIMD_STREAM(dest + i, data.data);
+            } else {
+                simd_store<1>(ds_dtype_offset(dest, i, dest_dtype), &data, dest_dtype);
+            }
         }
+        if (stream_fp32) { _mm_sfence(); }
+    } else {
+        head = num_elems;
     }
 #endif
-    if (param_size > rounded_size)
-        helper_memcpy_4((dest + rounded_size), (src + rounded_size), (param_size - rounded_size));
+
+    for (size_t k = 0; k < head; k++) {
+        ds_store_elem<c10::Half>(dest, k, ds_load_elem<c10::Half>(src, k, src_dtype), dest_dtype);
+    }
+    for (size_t k = std::max(head, rounded_size); k < num_elems; k++) {
+        ds_store_elem<c10::Half>(dest, k, ds_load_elem<c10::Half>(src, k, src_dtype), dest_dtype);
+    }
+}
+
+// Runs chunk_fn(begin, end) over [0, num_elems) in chunks of COPY_CHUNK_BYTES of destination.
+template <typename ChunkFn>
+static void _parallel_chunks(const char* dest,
+                             const size_t num_elems,
+                             const size_t dest_elem_bytes,
+                             ChunkFn chunk_fn)
+{
+    const auto chunk_elems = std::max<size_t>(COPY_CHUNK_BYTES / dest_elem_bytes, 1);
+    const auto num_chunks = (num_elems + chunk_elems - 1) / chunk_elems;
+    if (num_chunks <= 1 || omp_get_max_threads() == 1) {
+        chunk_fn(0, num_elems);
+        return;
+    }
+
+    const auto& cpu_nodes = _cpu_nodes();
+    const int num_nodes =
+        cpu_nodes.empty() ? 1 : (*std::max_element(cpu_nodes.begin(), cpu_nodes.end()) + 1);
+
+    std::vector<std::vector<size_t>> node_chunks(num_nodes);
+    for (size_t c = 0; c < num_chunks; ++c) {
+        auto node = (num_nodes > 1) ? _page_node(dest + c * chunk_elems * dest_elem_bytes) : 0;
+        if (node < 0 || node >= num_nodes) { node = static_cast<int>(c % num_nodes); }
+        node_chunks[node].push_back(c);
+    }
+
+    std::unique_ptr<std::atomic<size_t>[]> cursors(new std::atomic<size_t>[num_nodes]);
+    for (int node = 0; node < num_nodes; ++node) { cursors[node] = 0; }
+
+#pragma omp parallel
+    {
+        const auto cpu = sched_getcpu();
+        const int home = (cpu >= 0 && static_cast<size_t>(cpu) < cpu_nodes.size())
+                             ? cpu_nodes[cpu]
+                             : 0;
+        for (int n = 0; n < num_nodes; ++n) {
+            const int node = (home + n) % num_nodes;
+            for (auto idx = cursors[node]++; idx < node_chunks[node].size();
+                 idx = cursors[node]++) {
+                const auto begin = node_chunks[node][idx] * chunk_elems;
+                chunk_fn(begin, std::min(begin + chunk_elems, num_elems));
+            }
+        }
+    }
 }
 
 int deepspeed_py_memcpy(torch::Tensor& dest, const torch::Tensor& src)
 {
-    auto dest_c = dest.contiguous();
-    auto src_c = src.contiguous();
+    if (dest.numel() != src.numel() || !dest.is_contiguous() || dest.is_cuda() || src.is_cuda()) {
+        std::cout << "deepspeed_memcpy: dest and src must be CPU tensors with the same number of"
+                  << " elements, and dest must be contiguous" << std::endl;
+        return -1;
+    }
 
-    float* dest_ptr = (float*)dest_c.data_ptr();
-    float* src_ptr = (float*)src_c.data_ptr();
+    auto src_c = src.contiguous();
+    char* dest_ptr = static_cast<char*>(dest.data_ptr());
+    char* src_ptr = static_cast<char*>(src_c.data_ptr());
+    const bool streaming = static_cast<size_t>(dest.nbytes()) > _llc_bytes();
+
+    if (dest.scalar_type() == src_c.scalar_type()) {
+        _parallel_chunks(dest_ptr, dest.nbytes(), 1, [&](const size_t begin, const size_t end) {
+            _copy_bytes(dest_ptr + begin, src_ptr + begin, end - begin, streaming);
+        });
+        return 0;
+    }
 
-    helper_mempcy_8(dest_ptr, src_ptr, dest_c.size(0));
+    ds_dtype_t dest_dtype, src_dtype;
+    if (!_ds_dtype(dest.scalar_type(), &dest_dtype) ||
+        !_ds_dtype(src_c.scalar_type(), &src_dtype)) {
+        std::cout << "deepspeed_memcpy: dtype conversion is only supported between float, half "
+                  << "and bfloat16" << std::endl;
+        return -1;
+    }
 
+    float* dest_f = reinterpret_cast<float*>(dest_ptr);
+    float* src_f = reinterpret_cast<float*>(src_ptr);
+    _parallel_chunks(
+        dest_ptr, dest.numel(), dest.element_size(), [&](const size_t begin, const size_t end) {
+            _convert(ds_dtype_offset(dest_f, begin, dest_dtype),
+                     dest_dtype,
+                     ds_dtype_offset(src_f, begin, src_dtype),
+                     src_dtype,
+                     end - begin,
+                     streaming);
+        });
     return 0;
 }
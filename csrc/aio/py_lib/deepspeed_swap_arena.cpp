@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Functionality for swapping tensors into preallocated (NVMe) swap files.
+*/
+
+#include <errno.h>
+#include <algorithm>
+#include <iterator>
+
+#include "deepspeed_swap_arena.h"
+
+using namespace std;
+
+static long long int _round_up(const long long int value, const long long int alignment)
+{
+    return ((value + alignment - 1) / alignment) * alignment;
+}
+
+deepspeed_swap_arena_t::deepspeed_swap_arena_t(const char* filename,
+                                               const long long int capacity,
+                                               const long long int alignment)
+    : _filename(filename),
+      _capacity(_round_up(capacity, alignment)),
+      _alignment(alignment),
+      _fd(-1),
+      _used_bytes(0)
+{
+    _fd = open(filename, O_RDWR | O_CREAT | O_DIRECT, 0600);
+    if (_fd == -1) {
+        report_file_error(filename, " open for swap arena ", errno);
+        return;
+    }
+
+    // Reserve the blocks up front so later writes neither allocate nor fragment.
+    if (fallocate(_fd, 0, 0, _capacity) != 0) {
+        const auto error_code = errno;
+        if (error_code != EOPNOTSUPP || ftruncate(_fd, _capacity) != 0) {
+            report_file_error(filename, " fallocate for swap arena ", error_code);
+            close(_fd);
+            _fd = -1;
+            return;
+        }
+    }
+
+    _free_extents[0] = _capacity;
+}
+
+deepspeed_swap_arena_t::~deepspeed_swap_arena_t()
+{
+    if (_fd != -1) { close(_fd); }
+}
+
+bool deepspeed_swap_arena_t::is_valid() const { return _fd != -1; }
+
+long long int deepspeed_swap_arena_t::alloc(const long long int num_bytes)
+{
+    const auto extent_bytes = _round_up(std::max(num_bytes, 1LL), _alignment);
+
+    // First fit, so that extents handed out together stay sequential on the device.
+    for (auto iter = _free_extents.begin(); iter != _free_extents.end(); ++iter) {
+        if (iter->second < extent_bytes) { continue; }
+
+        const auto offset = iter->first;
+        const auto remaining_bytes = iter->second - extent_bytes;
+        _free_extents.erase(iter);
+        if (remaining_bytes > 0) { _free_extents[offset + extent_bytes] = remaining_bytes; }
+
+        _used_extents[offset] = extent_bytes;
+        _used_bytes += extent_bytes;
+        return offset;
+    }
+
+    return -1;
+}
+
+bool deepspeed_swap_arena_t::free(const long long int offset)
+{
+    auto used_iter = _used_extents.find(offset);
+    if (used_iter == _used_extents.end()) { return false; }
+
+    auto extent_offset = offset;
+    auto extent_bytes = used_iter->second;
+    _used_extents.erase(used_iter);
+    _used_bytes -= extent_bytes;
+
+    // Coalesce with the free neighbours on both sides.
+    auto next_iter = _free_extents.lower_bound(extent_offset);
+    if (next_iter != _free_extents.end() && next_iter->first == extent_offset + extent_bytes) {
+        extent_bytes += next_iter->second;
+        next_iter = _free_extents.erase(next_iter);
+    }
+    if (next_iter != _free_extents.begin()) {
+        auto prev_iter = std::prev(next_iter);
+        if (prev_iter->first + prev_iter->second == extent_offset) {
+            extent_offset = prev_iter->first;
+            extent_bytes += prev_iter->second;
+            _free_extents.erase(prev_iter);
+        }
+    }
+    _free_extents[extent_offset] = extent_bytes;
+
+    return true;
+}
+
+bool deepspeed_swap_arena_t::contains(const long long int offset,
+                                      const long long int num_bytes) const
+{
+    auto iter = _used_extents.upper_bound(offset);
+    if (iter == _used_extents.begin()) { return false; }
+    --iter;
+    return (offset + num_bytes) <= (iter->first + iter->second);
+}
+
+long long int deepspeed_swap_arena_t::get_free_bytes() const { return _capacity - _used_bytes; }
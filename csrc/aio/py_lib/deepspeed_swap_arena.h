@@ -0,0 +1,44 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Functionality for swapping tensors into preallocated (NVMe) swap files.
+A swap arena is one large file that stays open for the lifetime of the aio handle, with an
+offset allocator handing out aligned extents to tensors. This removes open/create/close from
+the swap path and keeps the tensors of a swap group adjacent on the device.
+*/
+
+#include <map>
+#include "deepspeed_py_aio.h"
+
+struct deepspeed_swap_arena_t {
+    const std::string _filename;
+    const long long int _capacity;
+    const long long int _alignment;
+    int _fd;
+
+    // Extents keyed by file offset, values are extent sizes.
+    std::map<long long int, long long int> _free_extents;
+    std::map<long long int, long long int> _used_extents;
+    long long int _used_bytes;
+
+    deepspeed_swap_arena_t(const char* filename,
+                           const long long int capacity,
+                           const long long int alignment);
+
+    ~deepspeed_swap_arena_t();
+
+    bool is_valid() const;
+
+    // Returns the file offset of an extent holding num_bytes, or -1 when the arena is full.
+    long long int alloc(const long long int num_bytes);
+
+    bool free(const long long int offset);
+
+    // True if [offset, offset + num_bytes) lies inside one allocated extent.
+    bool contains(const long long int offset, const long long int num_bytes) const;
+
+    long long int get_free_bytes() const;
+};
@@ -11,22 +11,44 @@ Functionality for swapping optimizer tensors to/from (NVMe) storage devices.
 #include "deepspeed_py_aio_handle.h"
 #include "deepspeed_py_copy.h"
 
+using namespace pybind11::literals;
+
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
     m.def("aio_read", &deepspeed_py_aio_read, "DeepSpeed Asynchronous I/O Read");
 
     m.def("aio_write", &deepspeed_py_aio_write, "DeepSpeed Asynchronous I/O Write");
 
-    m.def("deepspeed_memcpy", &deepspeed_py_memcpy, "DeepSpeed Memory Copy");
+    m.def("deepspeed_memcpy",
+          &deepspeed_py_memcpy,
+          "DeepSpeed Memory Copy, converting between float, half and bfloat16");
 
     py::class_<deepspeed_aio_handle_t>(m, "aio_handle")
-        .def(py::init<const int, const int, const bool, const bool, const int>())
+        .def(py::init<const int,
+                      const int,
+                      const bool,
+                      const bool,
+                      const int,
+                      const bool,
+                      const bool,
+                      const bool>(),
+             "AIO handle constructor",
+             "block_size"_a,
+             "queue_depth"_a,
+             "single_submit"_a,
+             "overlap_events"_a,
+             "num_threads"_a,
+             "use_io_uring"_a = false,
+             "sq_poll"_a = false,
+             "use_gds"_a = false)
 
         .def("get_block_size", &deepspeed_aio_handle_t::get_block_size)
         .def("get_queue_depth", &deepspeed_aio_handle_t::get_queue_depth)
         .def("get_single_submit", &deepspeed_aio_handle_t::get_single_submit)
         .def("get_overlap_events", &deepspeed_aio_handle_t::get_overlap_events)
         .def("get_thread_count", &deepspeed_aio_handle_t::get_thread_count)
+        .def("get_use_io_uring", &deepspeed_aio_handle_t::get_use_io_uring)
+        .def("get_use_gds", &deepspeed_aio_handle_t::get_use_gds)
 
         .def("read", &deepspeed_aio_handle_t::read)
         .def("write", &deepspeed_aio_handle_t::write)
@@ -38,9 +60,39 @@ PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
         .def("sync_pwrite", &deepspeed_aio_handle_t::sync_pwrite)
         .def("async_pread", &deepspeed_aio_handle_t::async_pread)
         .def("async_pwrite", &deepspeed_aio_handle_t::async_pwrite)
+        .def("async_pread_batch", &deepspeed_aio_handle_t::async_pread_batch)
+        .def("async_pwrite_batch", &deepspeed_aio_handle_t::async_pwrite_batch)
+        .def("async_pread_striped", &deepspeed_aio_handle_t::async_pread_striped)
+        .def("async_pwrite_striped", &deepspeed_aio_handle_t::async_pwrite_striped)
+        .def("async_pread_compressed", &deepspeed_aio_handle_t::async_pread_compressed)
+        .def("async_pwrite_compressed", &deepspeed_aio_handle_t::async_pwrite_compressed)
+
+        .def("new_swap_arena", &deepspeed_aio_handle_t::new_swap_arena)
+        .def("swap_arena_alloc", &deepspeed_aio_handle_t::swap_arena_alloc)
+        .def("swap_arena_free", &deepspeed_aio_handle_t::swap_arena_free)
+        .def("get_swap_arena_free_bytes", &deepspeed_aio_handle_t::get_swap_arena_free_bytes)
+        .def("async_pread_arena", &deepspeed_aio_handle_t::async_pread_arena)
+        .def("async_pwrite_arena", &deepspeed_aio_handle_t::async_pwrite_arena)
 
         .def("new_cpu_locked_tensor", &deepspeed_aio_handle_t::new_cpu_locked_tensor)
         .def("free_cpu_locked_tensor", &deepspeed_aio_handle_t::free_cpu_locked_tensor)
+        .def("configure_pinned_pool",
+             &deepspeed_aio_handle_t::configure_pinned_pool,
+             "Configure size classes and backing of the pinned tensor pool",
+             "exact_size_classes"_a = false,
+             "use_hugepages"_a = true,
+             "cuda_host_register"_a = false,
+             "max_cached_bytes"_a = 0,
+             "geometric_max_bytes"_a = 64 * 1024 * 1024)
+        .def("release_cached_cpu_locked_tensors",
+             &deepspeed_aio_handle_t::release_cached_cpu_locked_tensors)
+        .def("get_pinned_pool_stats", &deepspeed_aio_handle_t::get_pinned_pool_stats)
+
+        .def("wait", &deepspeed_aio_handle_t::wait)
+        .def("get_last_request", &deepspeed_aio_handle_t::get_last_request)
+        .def("wait_request", &deepspeed_aio_handle_t::wait_request)
+        .def("test_request", &deepspeed_aio_handle_t::test_request)
 
-        .def("wait", &deepspeed_aio_handle_t::wait);
+        .def("get_stats", &deepspeed_aio_handle_t::get_stats)
+        .def("reset_stats", &deepspeed_aio_handle_t::reset_stats);
 }
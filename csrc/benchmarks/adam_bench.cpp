@@ -0,0 +1,122 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Adam steps on the device (multi_tensor_adam) and on the host (Step_AVX of the CPU optimizer used
+by ZeRO-Offload). Both read the param, grad and both moments and write back all but the grad.
+*/
+
+#include <torch/extension.h>
+#include "cpu_adam.h"
+#include "kernel_bench.h"
+
+using kernel_bench::bench_case_t;
+using kernel_bench::case_name;
+
+void multi_tensor_adam_cuda(int chunk_size,
+                            at::Tensor noop_flag,
+                            std::vector<std::vector<at::Tensor>> tensor_lists,
+                            const float lr,
+                            const float beta1,
+                            const float beta2,
+                            const float epsilon,
+                            const int step,
+                            const int mode,
+                            const int bias_correction,
+                            const float weight_decay,
+                            const float inv_scale,
+                            at::Tensor found_inf,
+                            at::Tensor clip_coef,
+                            at::Tensor step_tensor);
+
+static const double adam_bytes_per_elem = 7 * sizeof(float);
+// Moment updates, bias correction, rsqrt and the weight decayed update
+static const double adam_flops_per_elem = 16;
+
+DS_KERNEL_BENCHMARK(multi_tensor_adam)
+{
+    struct shape_t {
+        int tensors;
+        int64_t elems_per_tensor;
+    };
+    // A few large matrices, and the long tail of small tensors of a transformer layer
+    const std::vector<shape_t> shapes = {{4, 16 * 1024 * 1024}, {512, 64 * 1024}, {4096, 4096}};
+
+    std::vector<bench_case_t> cases;
+    for (auto s : shapes) {
+        const double elems = (double)s.tensors * s.elems_per_tensor;
+        cases.push_back(
+            {case_name(
+                 "multi_tensor_adam/fp32/t%d_n%lld", s.tensors, (long long)s.elems_per_tensor),
+             elems * adam_bytes_per_elem,
+             elems * adam_flops_per_elem,
+             true,
+             [s]() -> std::function<void()> {
+                 auto options = at::TensorOptions().dtype(at::kFloat).device(at::kCUDA);
+                 std::vector<std::vector<at::Tensor>> tensor_lists(4);
+                 for (int t = 0; t < s.tensors; t++) {
+                     tensor_lists[0].push_back(torch::randn({s.elems_per_tensor}, options));
+                     tensor_lists[1].push_back(torch::randn({s.elems_per_tensor}, options));
+                     tensor_lists[2].push_back(torch::zeros({s.elems_per_tensor}, options));
+                     tensor_lists[3].push_back(torch::zeros({s.elems_per_tensor}, options));
+                 }
+                 auto noop_flag = torch::zeros({1}, options.dtype(at::kInt));
+                 return [tensor_lists, noop_flag]() {
+                     // Chunk size of FusedAdam
+                     multi_tensor_adam_cuda(2048 * 32,
+                                            noop_flag,
+                                            tensor_lists,
+                                            1e-3f,
+                                            0.9f,
+                                            0.999f,
+                                            1e-8f,
+                                            1,
+                                            1,
+                                            1,
+                                            0.01f,
+                                            1.f,
+                                            at::Tensor(),
+                                            at::Tensor(),
+                                            at::Tensor());
+                 };
+             }});
+    }
+    return cases;
+}
+
+#if defined(__AVX512__) or defined(__AVX256__)
+DS_KERNEL_BENCHMARK(cpu_adam_step_avx)
+{
+    const std::vector<int64_t> sizes = {1024 * 1024, 16 * 1024 * 1024, 128 * 1024 * 1024};
+
+    std::vector<bench_case_t> cases;
+    for (auto elems : sizes) {
+        cases.push_back(
+            {case_name("cpu_adam_step_avx/fp32/simd%d_n%lld", DS_SIMD_ISA, (long long)elems),
+             elems * adam_bytes_per_elem,
+             elems * adam_flops_per_elem,
+             false,
+             [elems]() -> std::function<void()> {
+                 auto params = torch::randn({elems});
+                 auto grads = torch::randn({elems});
+                 auto exp_avg = torch::zeros({elems});
+                 auto exp_avg_sq = torch::zeros({elems});
+                 auto optimizer = std::make_shared<Adam_Optimizer>(1e-3, 0.9, 0.999, 1e-8, 0.01);
+                 optimizer->IncrementStep(1, 0.9, 0.999);
+                 optimizer->update_state(1e-3, 1e-8, 0.01, true);
+                 return [elems, params, grads, exp_avg, exp_avg_sq, optimizer]() {
+                     size_t rounded_size = 0;
+                     optimizer->Step_AVX<8, DS_SIMD_ISA>(&rounded_size,
+                                                         (float*)params.data_ptr(),
+                                                         (float*)grads.data_ptr(),
+                                                         (float*)exp_avg.data_ptr(),
+                                                         (float*)exp_avg_sq.data_ptr(),
+                                                         elems);
+                 };
+             }});
+    }
+    return cases;
+}
+#endif
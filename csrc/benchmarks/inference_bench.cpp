@@ -0,0 +1,155 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Inference kernels at the shapes of a 7B-13B decoder: prompts of a few thousand tokens and
+batched single token decode steps.
+*/
+
+#include <ATen/cuda/CUDAContext.h>
+#include <torch/extension.h>
+#include "inference_cuda_layers.h"
+#include "kernel_bench.h"
+
+using kernel_bench::bench_case_t;
+using kernel_bench::case_name;
+
+static at::Tensor randn_half(std::vector<int64_t> sizes)
+{
+    return torch::randn(sizes, at::TensorOptions().dtype(at::kHalf).device(at::kCUDA));
+}
+
+// Softmax over the attention scores in place: read and write every score, with a max, an
+// exp, a sum and a scale per element.
+DS_KERNEL_BENCHMARK(attn_softmax_v2)
+{
+    struct shape_t {
+        int batch, heads, q_len, kv_len;
+    };
+    const std::vector<shape_t> shapes = {
+        {1, 32, 2048, 2048}, {8, 32, 512, 512}, {64, 32, 1, 2048}, {1, 40, 4096, 4096}};
+
+    std::vector<bench_case_t> cases;
+    for (auto s : shapes) {
+        const double elems = (double)s.batch * s.heads * s.q_len * s.kv_len;
+        cases.push_back(
+            {case_name("attn_softmax_v2/fp16/b%d_h%d_q%d_k%d", s.batch, s.heads, s.q_len, s.kv_len),
+             2 * elems * sizeof(__half),
+             5 * elems,
+             true,
+             [s]() -> std::function<void()> {
+                 auto scores = randn_half({s.batch, s.heads, s.q_len, s.kv_len});
+                 // Causal for prompts, every cached token is visible while decoding
+                 const bool triangular = s.q_len > 1;
+                 return [s, scores, triangular]() {
+                     launch_attn_softmax_v2((__half*)scores.data_ptr(),
+                                            (__half*)nullptr,
+                                            (__half*)nullptr,
+                                            1.f,
+                                            triangular,
+                                            false,
+                                            false,
+                                            1,
+                                            s.batch,
+                                            s.heads,
+                                            s.q_len,
+                                            s.kv_len,
+                                            0,
+                                            0,
+                                            1,
+                                            at::cuda::getCurrentCUDAStream());
+                 };
+             }});
+    }
+    return cases;
+}
+
+// LayerNorm of every token: read the activations once, write the output once.
+DS_KERNEL_BENCHMARK(fused_ln)
+{
+    struct shape_t {
+        int rows, hidden;
+    };
+    const std::vector<shape_t> shapes = {{64, 4096}, {2048, 4096}, {8192, 5120}, {4096, 8192}};
+
+    std::vector<bench_case_t> cases;
+    for (auto s : shapes) {
+        const double elems = (double)s.rows * s.hidden;
+        cases.push_back({case_name("fused_ln/fp16/r%d_h%d", s.rows, s.hidden),
+                         (2 * elems + 2 * s.hidden) * sizeof(__half),
+                         8 * elems,
+                         true,
+                         [s]() -> std::function<void()> {
+                             auto input = randn_half({s.rows, s.hidden});
+                             auto gamma = randn_half({s.hidden});
+                             auto beta = randn_half({s.hidden});
+                             auto output = at::empty_like(input);
+                             return [s, input, gamma, beta, output]() {
+                                 launch_fused_ln((__half*)output.data_ptr(),
+                                                 (const __half*)input.data_ptr(),
+                                                 (const __half*)gamma.data_ptr(),
+                                                 (const __half*)beta.data_ptr(),
+                                                 1e-5f,
+                                                 s.rows,
+                                                 s.hidden,
+                                                 at::cuda::getCurrentCUDAStream());
+                             };
+                         }});
+    }
+    return cases;
+}
+
+// Split of the fused QKV projection into heads with the rotary embedding applied to q and k,
+// writing k and v into the KV cache: every element is read and written once.
+DS_KERNEL_BENCHMARK(bias_add_transform_0213)
+{
+    struct shape_t {
+        int batch, seq_len, hidden, heads;
+    };
+    const std::vector<shape_t> shapes = {
+        {1, 2048, 4096, 32}, {8, 512, 4096, 32}, {64, 1, 4096, 32}, {1, 4096, 5120, 40}};
+
+    std::vector<bench_case_t> cases;
+    for (auto s : shapes) {
+        const double elems = 3.0 * s.batch * s.seq_len * s.hidden;
+        const int head_size = s.hidden / s.heads;
+        cases.push_back(
+            {case_name("bias_add_transform_0213/fp16/b%d_s%d_h%d_n%d",
+                       s.batch,
+                       s.seq_len,
+                       s.hidden,
+                       s.heads),
+             2 * elems * sizeof(__half),
+             // Rotation of the q and k thirds
+             2 * elems,
+             true,
+             [s, head_size]() -> std::function<void()> {
+                 auto qkv = randn_half({s.batch, s.seq_len, 3 * s.hidden});
+                 auto query = randn_half({s.batch, s.heads, s.seq_len, head_size});
+                 auto k_cache = randn_half({s.batch, s.heads, s.seq_len, head_size});
+                 auto v_cache = randn_half({s.batch, s.heads, s.seq_len, head_size});
+                 return [s, head_size, qkv, query, k_cache, v_cache]() {
+                     launch_bias_add_transform_0213<__half>((__half*)query.data_ptr(),
+                                                            (__half*)k_cache.data_ptr(),
+                                                            (__half*)v_cache.data_ptr(),
+                                                            (const __half*)qkv.data_ptr(),
+                                                            nullptr,
+                                                            s.batch,
+                                                            s.seq_len,
+                                                            0,
+                                                            s.seq_len,
+                                                            s.hidden,
+                                                            s.heads,
+                                                            head_size,
+                                                            true,
+                                                            false,
+                                                            at::cuda::getCurrentCUDAStream(),
+                                                            3,
+                                                            s.seq_len);
+                 };
+             }});
+    }
+    return cases;
+}
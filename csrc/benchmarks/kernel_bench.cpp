@@ -0,0 +1,161 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "kernel_bench.h"
+#include <ATen/cuda/CUDAContext.h>
+#include <c10/cuda/CUDACachingAllocator.h>
+#include <torch/extension.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <regex>
+
+// Upper bound on the calls of one repetition, which otherwise lasts about min_time_ms
+static const int64_t max_iterations = 1000000;
+
+// Elapsed milliseconds of `iterations` back to back calls
+static double time_calls(const kernel_bench::bench_case_t& bench,
+                         const std::function<void()>& call,
+                         int64_t iterations)
+{
+    if (bench.on_device) {
+        cudaStream_t stream = at::cuda::getCurrentCUDAStream();
+        cudaEvent_t start, end;
+        cudaEventCreate(&start);
+        cudaEventCreate(&end);
+        cudaEventRecord(start, stream);
+        for (int64_t i = 0; i < iterations; i++) { call(); }
+        cudaEventRecord(end, stream);
+        cudaEventSynchronize(end);
+        float elapsed_ms = 0;
+        cudaEventElapsedTime(&elapsed_ms, start, end);
+        cudaEventDestroy(start);
+        cudaEventDestroy(end);
+        return elapsed_ms;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < iterations; i++) { call(); }
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() -
+                                                              start;
+    return elapsed.count();
+}
+
+static pybind11::dict run_case(const std::string& family,
+                               const kernel_bench::bench_case_t& bench,
+                               double min_time_ms,
+                               int repetitions,
+                               int warmup)
+{
+    auto call = bench.setup();
+    for (int i = 0; i < warmup; i++) { call(); }
+
+    const double single_ms = std::max(time_calls(bench, call, 1), 1e-4);
+    const auto iterations =
+        std::min<int64_t>(std::max<int64_t>(std::ceil(min_time_ms / single_ms), 1), max_iterations);
+
+    std::vector<double> times;
+    for (int r = 0; r < repetitions; r++) {
+        times.push_back(time_calls(bench, call, iterations) / iterations);
+    }
+    std::sort(times.begin(), times.end());
+    const double median_ms = times[times.size() / 2];
+
+    pybind11::dict result;
+    result["name"] = bench.name;
+    result["family"] = family;
+    result["device"] = bench.on_device ? "cuda" : "cpu";
+    result["iterations"] = iterations;
+    result["repetitions"] = repetitions;
+    result["time_ms"] = median_ms;
+    result["min_ms"] = times.front();
+    result["max_ms"] = times.back();
+    result["bytes"] = bench.bytes;
+    result["flops"] = bench.flops;
+    result["gbps"] = bench.bytes / (median_ms * 1e6);
+    result["tflops"] = bench.flops / (median_ms * 1e9);
+    return result;
+}
+
+// Names of the registered cases matching `filter` (ECMAScript regex, searched in the name)
+std::vector<std::string> list_benchmarks(const std::string& filter)
+{
+    const std::regex pattern(filter);
+    std::vector<std::string> names;
+    for (auto& family : kernel_bench::registry()) {
+        for (auto& bench : family.second()) {
+            if (std::regex_search(bench.name, pattern)) { names.push_back(bench.name); }
+        }
+    }
+    return names;
+}
+
+pybind11::list run_benchmarks(const std::string& filter,
+                              double min_time_ms,
+                              int repetitions,
+                              int warmup)
+{
+    TORCH_CHECK(repetitions > 0, "repetitions must be positive");
+
+    const std::regex pattern(filter);
+    pybind11::list results;
+    for (auto& family : kernel_bench::registry()) {
+        for (auto& bench : family.second()) {
+            if (!std::regex_search(bench.name, pattern)) { continue; }
+            results.append(run_case(family.first, bench, min_time_ms, repetitions, warmup));
+            // Release the cached inputs of this case before allocating the next ones
+            c10::cuda::CUDACachingAllocator::emptyCache();
+        }
+    }
+    return results;
+}
+
+// FP32 lanes per SM, for the vector peak of the non tensor core kernels
+static int fp32_lanes_per_sm(int major, int minor)
+{
+    if (major == 6) { return minor == 0 ? 64 : 128; }
+    if (major == 7) { return 64; }
+    if (major == 8) { return minor == 0 ? 64 : 128; }
+    if (major >= 9) { return 128; }
+    return 0;
+}
+
+pybind11::dict device_info()
+{
+    int device, sm_count, clock_khz, mem_clock_khz, bus_width;
+    cudaGetDevice(&device);
+    cudaDeviceProp props;
+    cudaGetDeviceProperties(&props, device);
+    cudaDeviceGetAttribute(&sm_count, cudaDevAttrMultiProcessorCount, device);
+    cudaDeviceGetAttribute(&clock_khz, cudaDevAttrClockRate, device);
+    cudaDeviceGetAttribute(&mem_clock_khz, cudaDevAttrMemoryClockRate, device);
+    cudaDeviceGetAttribute(&bus_width, cudaDevAttrGlobalMemoryBusWidth, device);
+
+    pybind11::dict info;
+    info["name"] = std::string(props.name);
+    info["compute_capability"] = std::to_string(props.major) + "." + std::to_string(props.minor);
+    info["sm_count"] = sm_count;
+    // Double data rate
+    info["peak_gbps"] = 2.0 * mem_clock_khz * 1e3 * (bus_width / 8) / 1e9;
+    info["peak_fp32_tflops"] =
+        2.0 * sm_count * fp32_lanes_per_sm(props.major, props.minor) * clock_khz * 1e3 / 1e12;
+    return info;
+}
+
+PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
+{
+    m.def("list_benchmarks",
+          &list_benchmarks,
+          "Names of the registered kernel benchmarks matching a regex",
+          pybind11::arg("filter") = ".*");
+    m.def("run_benchmarks",
+          &run_benchmarks,
+          "Time the kernel benchmarks matching a regex, one dict per case",
+          pybind11::arg("filter") = ".*",
+          pybind11::arg("min_time_ms") = 100.0,
+          pybind11::arg("repetitions") = 5,
+          pybind11::arg("warmup") = 3);
+    m.def("device_info", &device_info, "Name and peak bandwidth/throughput of the current device");
+}
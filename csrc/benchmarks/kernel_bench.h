@@ -0,0 +1,63 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Microbenchmark harness for the csrc kernels. A benchmark family registers the shapes it sweeps
+with DS_KERNEL_BENCHMARK; each case reports the bytes it moves and the flops it performs per
+call, so the runner can turn the measured time into GB/s and TFLOP/s. Inputs are only
+allocated while their case runs.
+*/
+
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace kernel_bench {
+
+struct bench_case_t {
+    std::string name;
+    // Per call, used to derive the achieved bandwidth and throughput.
+    double bytes;
+    double flops;
+    // Device cases are timed with CUDA events on the current stream, host cases with a clock.
+    bool on_device;
+    // Allocates the inputs and returns the timed call, which owns them.
+    std::function<std::function<void()>()> setup;
+};
+
+typedef std::vector<bench_case_t> (*bench_family_t)();
+
+inline std::vector<std::pair<std::string, bench_family_t>>& registry()
+{
+    static std::vector<std::pair<std::string, bench_family_t>> families;
+    return families;
+}
+
+struct registrar_t {
+    registrar_t(const char* family, bench_family_t cases) { registry().push_back({family, cases}); }
+};
+
+// printf style case names, e.g. case_name("%s/b%d_s%d", family, batch, seq).
+inline std::string case_name(const char* format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return buffer;
+}
+
+}  // namespace kernel_bench
+
+#define DS_KERNEL_BENCHMARK(family)                                                \
+    static std::vector<kernel_bench::bench_case_t> family##_cases();               \
+    static kernel_bench::registrar_t family##_registrar(#family, &family##_cases); \
+    static std::vector<kernel_bench::bench_case_t> family##_cases()
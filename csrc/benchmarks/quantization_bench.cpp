@@ -0,0 +1,69 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include <ATen/cuda/CUDAContext.h>
+#include <torch/extension.h>
+#include "kernel_bench.h"
+#include "quantization.h"
+
+using kernel_bench::bench_case_t;
+using kernel_bench::case_name;
+
+// Group-wise quantization of fp16 weights or gradients (cached_quantization): read every
+// value once, write the packed values and the per group scale (and offset).
+DS_KERNEL_BENCHMARK(cached_quantization)
+{
+    struct shape_t {
+        int64_t elems;
+        int elems_per_group, bits;
+        quantize::Type type;
+    };
+    const int64_t weight_elems = 4096 * 4096;
+    const int64_t shard_elems = 64 * 1024 * 1024;
+    const std::vector<shape_t> shapes = {
+        {weight_elems, 128, 8, quantize::Type::Symmetric},
+        {weight_elems, 2048, 8, quantize::Type::Symmetric},
+        {shard_elems, 2048, 8, quantize::Type::Symmetric},
+        {shard_elems, 2048, 4, quantize::Type::Symmetric},
+        {shard_elems, 2048, 8, quantize::Type::Asymmetric},
+        {shard_elems, 4096, 4, quantize::Type::Asymmetric},
+    };
+
+    std::vector<bench_case_t> cases;
+    for (auto s : shapes) {
+        const int groups = s.elems / s.elems_per_group;
+        const int params_per_group = quantize::requires_offset(s.type) ? 2 : 1;
+        const double bytes = s.elems * sizeof(__half) + s.elems * s.bits / 8.0 +
+                             (double)groups * params_per_group * sizeof(float);
+        cases.push_back({case_name("cached_quantization/%s%d/n%lld_g%d",
+                                   quantize::requires_offset(s.type) ? "asym" : "sym",
+                                   s.bits,
+                                   (long long)s.elems,
+                                   s.elems_per_group),
+                         bytes,
+                         // Max reduction, scale and round of every value
+                         3.0 * s.elems,
+                         true,
+                         [s, groups, params_per_group]() -> std::function<void()> {
+                             auto options = at::TensorOptions().device(at::kCUDA);
+                             auto input = torch::randn({s.elems}, options.dtype(at::kHalf));
+                             auto output =
+                                 torch::empty({s.elems * s.bits / 8}, options.dtype(at::kChar));
+                             auto params = torch::empty({groups, params_per_group},
+                                                        options.dtype(at::kFloat));
+                             return [s, groups, input, output, params]() {
+                                 launch_quant((int8_t*)output.data_ptr(),
+                                              (float*)params.data_ptr(),
+                                              (const __half*)input.data_ptr(),
+                                              groups,
+                                              s.elems_per_group,
+                                              s.bits,
+                                              s.type,
+                                              at::cuda::getCurrentCUDAStream());
+                             };
+                         }});
+    }
+    return cases;
+}
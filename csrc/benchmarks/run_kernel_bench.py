@@ -0,0 +1,153 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+"""
+Microbenchmarks of the csrc kernels.
+
+Runs the benchmarks registered in csrc/benchmarks (KernelBenchBuilder), prints the achieved
+bandwidth and throughput of every case against the device peak, and optionally writes the
+results as JSON. Comparing against the JSON of a previous release reports every case that got
+slower than the threshold, and exits with an error if any did.
+
+    python run_kernel_bench.py --filter 'softmax|fused_ln' --output new.json
+    python run_kernel_bench.py --output new.json --baseline old.json --threshold 0.05
+"""
+import sys
+import json
+import argparse
+import datetime
+
+import deepspeed
+from deepspeed.ops.op_builder import KernelBenchBuilder
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser()
+
+    parser.add_argument('--filter', type=str, default='.*', help='Regex of the benchmark names to run.')
+
+    parser.add_argument('--list', action='store_true', help='List the benchmarks and exit.')
+
+    parser.add_argument('--min_time_ms', type=float, default=100.0, help='Minimum duration of one repetition.')
+
+    parser.add_argument('--repetitions',
+                        type=int,
+                        default=5,
+                        help='Repetitions of every case, the median is reported.')
+
+    parser.add_argument('--warmup', type=int, default=3, help='Untimed calls before the repetitions.')
+
+    parser.add_argument('--peak_gbps',
+                        type=float,
+                        default=None,
+                        help='Device bandwidth peak, instead of the queried one.')
+
+    parser.add_argument('--peak_tflops',
+                        type=float,
+                        default=None,
+                        help='Device throughput peak, instead of the fp32 vector peak.')
+
+    parser.add_argument('--cpu_peak_gbps', type=float, default=None, help='Host memory bandwidth peak.')
+
+    parser.add_argument('--output', type=str, default=None, help='JSON file to write the results to.')
+
+    parser.add_argument('--baseline', type=str, default=None, help='JSON results to compare against.')
+
+    parser.add_argument('--threshold',
+                        type=float,
+                        default=0.05,
+                        help='Relative slowdown over the baseline reported as a regression.')
+
+    return parser.parse_args()
+
+
+def add_peak_fractions(results, device, args):
+    peak_gbps = args.peak_gbps or device['peak_gbps']
+    peak_tflops = args.peak_tflops or device['peak_fp32_tflops']
+    for result in results:
+        if result['device'] == 'cuda':
+            result['peak_bandwidth'] = result['gbps'] / peak_gbps if peak_gbps else None
+            result['peak_throughput'] = result['tflops'] / peak_tflops if peak_tflops else None
+        else:
+            result['peak_bandwidth'] = result['gbps'] / args.cpu_peak_gbps if args.cpu_peak_gbps else None
+            result['peak_throughput'] = None
+
+
+def percent(fraction):
+    return '-' if fraction is None else f'{fraction * 100:.1f}%'
+
+
+def print_results(results):
+    width = max(len(result['name']) for result in results)
+    print(f'{"benchmark":<{width}} {"time(ms)":>10} {"GB/s":>9} {"TFLOP/s":>9} {"%BW":>7} {"%FLOP":>7}')
+    for result in results:
+        print(f'{result["name"]:<{width}} {result["time_ms"]:>10.4f} {result["gbps"]:>9.1f} '
+              f'{result["tflops"]:>9.3f} {percent(result["peak_bandwidth"]):>7} '
+              f'{percent(result["peak_throughput"]):>7}')
+
+
+def compare(results, baseline_path, threshold):
+    with open(baseline_path) as baseline_file:
+        baseline = {result['name']: result for result in json.load(baseline_file)['benchmarks']}
+
+    regressions = []
+    for result in results:
+        if result['name'] not in baseline:
+            continue
+        ratio = result['time_ms'] / baseline[result['name']]['time_ms']
+        change = f'{(ratio - 1) * 100:+.1f}%'
+        if ratio > 1 + threshold:
+            regressions.append(result['name'])
+            print(f'REGRESSION {result["name"]}: {change}')
+        elif ratio < 1 - threshold:
+            print(f'improved   {result["name"]}: {change}')
+
+    missing = set(baseline.keys()) - set(result['name'] for result in results)
+    for name in sorted(missing):
+        print(f'not run    {name}')
+
+    return regressions
+
+
+def main():
+    args = parse_arguments()
+    kernel_bench = KernelBenchBuilder().load()
+
+    if args.list:
+        print('\n'.join(kernel_bench.list_benchmarks(args.filter)))
+        return 0
+
+    device = kernel_bench.device_info()
+    results = kernel_bench.run_benchmarks(args.filter, args.min_time_ms, args.repetitions, args.warmup)
+    if not results:
+        print(f'No benchmark matches {args.filter}')
+        return 1
+
+    add_peak_fractions(results, device, args)
+    print(f'{device["name"]} (sm_{device["compute_capability"]}): {device["peak_gbps"]:.0f} GB/s, '
+          f'{device["peak_fp32_tflops"]:.1f} fp32 TFLOP/s')
+    print_results(results)
+
+    if args.output:
+        context = {
+            'date': datetime.datetime.now().isoformat(),
+            'deepspeed_version': deepspeed.__version__,
+            'git_hash': deepspeed.__git_hash__,
+            'device': device
+        }
+        with open(args.output, 'w') as output_file:
+            json.dump({'context': context, 'benchmarks': results}, output_file, indent=2)
+
+    if args.baseline:
+        regressions = compare(results, args.baseline, args.threshold)
+        if regressions:
+            print(f'{len(regressions)} of {len(results)} benchmarks regressed by more than '
+                  f'{args.threshold * 100:.0f}%')
+            return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
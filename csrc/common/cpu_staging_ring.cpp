@@ -0,0 +1,95 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Pinned staging ring for the host to device param copy of the CPU optimizers.
+Compiled into every CPU optimizer op, the ring below is local to the extension module.
+*/
+
+#include "cpu_staging_ring.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#if defined(__ENABLE_CUDA__)
+static std::shared_ptr<Pinned_Staging_Ring> s_staging_ring;
+
+Pinned_Staging_Ring::Pinned_Staging_Ring(int depth, size_t tile) : _tile(tile), _next_slot(0)
+{
+    for (int i = 0; i < depth; ++i) {
+        float* buffer = nullptr;
+        if (cudaMallocHost((void**)&buffer, tile * sizeof(float)) != cudaSuccess) {
+            // Clear the sticky error and give back the slots pinned so far, the destructor of a
+            // throwing constructor does not run.
+            cudaGetLastError();
+            _destroy();
+            throw std::runtime_error("CPU optimizer: cudaMallocHost of a " +
+                                     std::to_string(tile * sizeof(float)) +
+                                     " byte staging tile failed, lower copy_tile_numel");
+        }
+        cudaStream_t stream;
+        cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking);
+        cudaEvent_t event;
+        cudaEventCreateWithFlags(&event, cudaEventDisableTiming);
+        _buffers.push_back(buffer);
+        _streams.push_back(stream);
+        _events.push_back(event);
+    }
+}
+
+Pinned_Staging_Ring::~Pinned_Staging_Ring() { _destroy(); }
+
+void Pinned_Staging_Ring::_destroy()
+{
+    synchronize();
+    for (size_t i = 0; i < _buffers.size(); ++i) {
+        cudaEventDestroy(_events[i]);
+        cudaStreamDestroy(_streams[i]);
+        cudaFreeHost(_buffers[i]);
+    }
+    _buffers.clear();
+    _streams.clear();
+    _events.clear();
+}
+
+std::shared_ptr<Pinned_Staging_Ring> Pinned_Staging_Ring::Get(int depth, size_t tile)
+{
+    depth = std::max(depth, 1);
+    if (!s_staging_ring || s_staging_ring->depth() < depth || s_staging_ring->tile() < tile) {
+        if (s_staging_ring) {
+            depth = std::max(depth, s_staging_ring->depth());
+            tile = std::max(tile, s_staging_ring->tile());
+        }
+        // Free the old ring before pinning the new one.
+        s_staging_ring.reset();
+        s_staging_ring = std::make_shared<Pinned_Staging_Ring>(depth, tile);
+    }
+    return s_staging_ring;
+}
+
+void Pinned_Staging_Ring::Synchronize()
+{
+    if (s_staging_ring) { s_staging_ring->synchronize(); }
+}
+
+void Pinned_Staging_Ring::Release() { s_staging_ring.reset(); }
+
+int Pinned_Staging_Ring::acquire()
+{
+    const auto slot = _next_slot;
+    _next_slot = (_next_slot + 1) % depth();
+    // A never recorded event counts as complete, so the first pass through the ring is free.
+    cudaEventSynchronize(_events[slot]);
+    return slot;
+}
+
+void Pinned_Staging_Ring::release(int slot) { cudaEventRecord(_events[slot], _streams[slot]); }
+
+void Pinned_Staging_Ring::synchronize()
+{
+    for (auto& event : _events) { cudaEventSynchronize(event); }
+}
+#endif
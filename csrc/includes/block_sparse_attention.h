@@ -0,0 +1,129 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#pragma once
+
+#include <cuda.h>
+#include <cuda_bf16.h>
+#include <cuda_fp16.h>
+#include <cuda_runtime.h>
+#include <stdint.h>
+
+/*
+Block-sparse tensors are stored as [Z, nnz, block, block], with the nnz blocks in the
+(head, row, column) order of layout.nonzero(). Dense operands are [Z, H, rows, cols] views
+described by their strides; a transposed operand swaps the row and column strides, so no copy
+is made for trans_a / trans_b.
+*/
+struct DenseStrides {
+    int64_t batch;
+    int64_t head;
+    int64_t row;
+    int64_t col;
+};
+
+/*
+Additive terms of the block-sparse softmax, mirroring the Triton kernel it replaces. Any pointer
+may be null. With the `mul` modes a mask value of 0 removes the element and any other value
+keeps it, otherwise the mask is added to the logit.
+*/
+template <typename T>
+struct SoftmaxInputs {
+    const T* rpe;
+    const T* kp_mask;
+    const T* attn_mask;
+    int64_t rpe_batch_stride;
+    int64_t rpe_head_stride;
+    int64_t rpe_row_stride;
+    int64_t kp_batch_stride;
+    int64_t attn_row_stride;
+    float scale;
+    bool kp_mask_mul;
+    bool attn_mask_mul;
+};
+
+// Supported block sizes are 16, 32, 64 and 128.
+bool block_sparse_supported_block(int block);
+
+/*
+C[z, idx] = op(A)[z, h, m block] @ op(B)[z, h, n block] for every (h, m, n, idx) row of the
+segmented look-up table produced by `sdd_segment`.
+*/
+template <typename T>
+void launch_sdd_matmul(T* c,
+                       const T* a,
+                       const T* b,
+                       const int* lut,
+                       DenseStrides a_strides,
+                       DenseStrides b_strides,
+                       int entries,
+                       int batch,
+                       int nnz,
+                       int inner_dim,
+                       int block,
+                       cudaStream_t stream);
+
+/*
+Dense = op(sparse A) @ op(B). The look-up table holds a (size, offset) header for each
+(head, block row) of op(A) followed by (block column, block index) pairs.
+*/
+template <typename T>
+void launch_dsd_matmul(T* c,
+                       const T* a,
+                       const T* b,
+                       const int* lut,
+                       DenseStrides b_strides,
+                       DenseStrides c_strides,
+                       int heads,
+                       int block_rows,
+                       int batch,
+                       int nnz,
+                       int cols,
+                       bool trans_a,
+                       int block,
+                       cudaStream_t stream);
+
+/*
+Dense = op(A) @ op(sparse B). The look-up table holds a (size, offset) header for each
+(head, block column) of op(B) followed by (block row, block index) pairs.
+*/
+template <typename T>
+void launch_dds_matmul(T* c,
+                       const T* a,
+                       const T* b,
+                       const int* lut,
+                       DenseStrides a_strides,
+                       DenseStrides c_strides,
+                       int heads,
+                       int block_cols,
+                       int batch,
+                       int nnz,
+                       int rows,
+                       bool trans_b,
+                       int block,
+                       cudaStream_t stream);
+
+// In-place softmax over the rows of a block-sparse tensor, using the `Softmax` look-up table.
+template <typename T>
+void launch_block_sparse_softmax(T* x,
+                                 const int* lut,
+                                 SoftmaxInputs<T> inputs,
+                                 int block_rows,
+                                 int batch,
+                                 int nnz,
+                                 int block,
+                                 cudaStream_t stream);
+
+// dx = y * (dx - sum(y * dx)) * scale, written in place into dx.
+template <typename T>
+void launch_block_sparse_softmax_bwd(T* dx,
+                                     const T* y,
+                                     const int* lut,
+                                     float scale,
+                                     int block_rows,
+                                     int batch,
+                                     int nnz,
+                                     int block,
+                                     cudaStream_t stream);
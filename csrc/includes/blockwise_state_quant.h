@@ -0,0 +1,127 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Blockwise 8-bit storage of the Adam moments, shared by the CPU and the CUDA optimizers so the
+state layout is the same on both.
+
+Every block of block_size moments keeps one fp32 absmax, exp_avg and exp_avg_sq blocks
+interleaved in a single float tensor, and one byte per element. A byte is a small float relative
+to the absmax of its block, so codes spread over octaves instead of the 256 even steps of
+linear int8:
+    exp_avg     sign + 4 exponent + 3 mantissa bits, down to 2^-14 of the absmax
+    exp_avg_sq         5 exponent + 3 mantissa bits, down to 2^-30 of the absmax
+Rounding is stochastic, so the running averages stay unbiased, and smaller values flush to zero.
+*/
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__CUDACC__) || defined(__HIPCC__)
+#define DS_STATE_QUANT_INLINE __host__ __device__ __forceinline__
+#else
+#define DS_STATE_QUANT_INLINE inline
+#endif
+
+namespace state_quant {
+
+constexpr int block_size = 2048;
+
+constexpr int exp_avg_exp_bits = 4;
+constexpr int exp_avg_mant_bits = 3;
+constexpr int exp_avg_sq_exp_bits = 5;
+constexpr int exp_avg_sq_mant_bits = 3;
+
+DS_STATE_QUANT_INLINE uint32_t float_bits(float x)
+{
+#if defined(__CUDA_ARCH__) || defined(__HIP_DEVICE_COMPILE__)
+    return __float_as_uint(x);
+#else
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+#endif
+}
+
+DS_STATE_QUANT_INLINE float bits_float(uint32_t bits)
+{
+#if defined(__CUDA_ARCH__) || defined(__HIP_DEVICE_COMPILE__)
+    return __uint_as_float(bits);
+#else
+    float x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+#endif
+}
+
+// Counter based noise for the stochastic rounding (murmur3 finalizer).
+DS_STATE_QUANT_INLINE uint32_t hash(uint32_t seed, uint32_t index)
+{
+    uint32_t h = seed ^ (index * 0x9e3779b9u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Code of rel = |x| / absmax in [0, 1]. The noise is added to the mantissa bits that get
+// dropped, a carry moves the value to the next code up.
+template <int exp_bits, int mant_bits>
+DS_STATE_QUANT_INLINE uint32_t encode_magnitude(float rel, uint32_t noise)
+{
+    constexpr int bias = (1 << exp_bits) - 1;
+    constexpr int dropped_bits = 23 - mant_bits;
+    constexpr uint32_t max_code = static_cast<uint32_t>(bias) << mant_bits;
+
+    const uint32_t bits = float_bits(rel) + (noise & ((1u << dropped_bits) - 1));
+    const int exponent = static_cast<int>(bits >> 23) - 127 + bias;
+    if (exponent <= 0) return 0;
+    const uint32_t code = (static_cast<uint32_t>(exponent) << mant_bits) |
+                          ((bits >> dropped_bits) & ((1u << mant_bits) - 1));
+    return code < max_code ? code : max_code;
+}
+
+template <int exp_bits, int mant_bits>
+DS_STATE_QUANT_INLINE float decode_magnitude(uint32_t code)
+{
+    constexpr int bias = (1 << exp_bits) - 1;
+    const uint32_t exponent = code >> mant_bits;
+    if (exponent == 0) return 0.0f;
+    return bits_float(((exponent + 127 - bias) << 23) |
+                      ((code & ((1u << mant_bits) - 1)) << (23 - mant_bits)));
+}
+
+DS_STATE_QUANT_INLINE uint8_t encode_exp_avg(float x, float inv_absmax, uint32_t noise)
+{
+    const uint32_t code =
+        encode_magnitude<exp_avg_exp_bits, exp_avg_mant_bits>(fabsf(x) * inv_absmax, noise);
+    return static_cast<uint8_t>((x < 0 ? 0x80 : 0) | code);
+}
+
+DS_STATE_QUANT_INLINE float decode_exp_avg(uint8_t q, float absmax)
+{
+    const float x = decode_magnitude<exp_avg_exp_bits, exp_avg_mant_bits>(q & 0x7f) * absmax;
+    return (q & 0x80) ? -x : x;
+}
+
+DS_STATE_QUANT_INLINE uint8_t encode_exp_avg_sq(float x, float inv_absmax, uint32_t noise)
+{
+    return static_cast<uint8_t>(
+        encode_magnitude<exp_avg_sq_exp_bits, exp_avg_sq_mant_bits>(x * inv_absmax, noise));
+}
+
+DS_STATE_QUANT_INLINE float decode_exp_avg_sq(uint8_t q, float absmax)
+{
+    return decode_magnitude<exp_avg_sq_exp_bits, exp_avg_sq_mant_bits>(q) * absmax;
+}
+
+DS_STATE_QUANT_INLINE float inverse_absmax(float absmax) { return absmax > 0 ? 1 / absmax : 0; }
+
+}  // namespace state_quant
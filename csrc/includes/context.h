@@ -60,7 +60,12 @@ public:
     virtual ~TrainingContext()
     {
         cublasDestroy(_cublasHandle);
+#ifdef CUBLASLT_EPILOGUE_AVAILABLE
+        if (_cublasLtHandle) cublasLtDestroy(_cublasLtHandle);
+        cudaFree(_cublasLtWorkspace);
+#endif
         cudaFree(_workspace);
+        cudaFree(_reduce_workspace);
     }
 
     static TrainingContext& Instance()
@@ -77,6 +82,29 @@ public:
 
     void* GetWorkSpace() { return _workspace; }
 
+    // Scratch of the partial results of cross-block reductions, grown on demand (cudaFree
+    // synchronizes the device, so a kernel still reading the old buffer is not cut short).
+    void* GetReduceWorkSpace(size_t bytes)
+    {
+        if (bytes > _reduce_workspace_size) {
+            cudaFree(_reduce_workspace);
+            CUDA_CHECK(cudaMalloc(&_reduce_workspace, bytes));
+            _reduce_workspace_size = bytes;
+        }
+        return _reduce_workspace;
+    }
+
+    int GetMultiProcessorCount()
+    {
+        if (!_sm_count) {
+            int device;
+            CUDA_CHECK(cudaGetDevice(&device));
+            CUDA_CHECK(
+                cudaDeviceGetAttribute(&_sm_count, cudaDevAttrMultiProcessorCount, device));
+        }
+        return _sm_count;
+    }
+
     curandGenerator_t& GetRandGenerator() { return _gen; }
 
     cudaStream_t GetCurrentStream()
@@ -90,6 +118,27 @@ public:
 
     cublasHandle_t GetCublasHandle() { return _cublasHandle; }
 
+#ifdef CUBLASLT_EPILOGUE_AVAILABLE
+    // Only the epilogue-fused GEMMs go through cublasLt, so its handle and workspace are created
+    // on first use.
+    cublasLtHandle_t GetCublasLtHandle()
+    {
+        if (!_cublasLtHandle) {
+            if (cublasLtCreate(&_cublasLtHandle) != CUBLAS_STATUS_SUCCESS) {
+                auto message = std::string("Fail to create cublasLt handle.");
+                std::cerr << message << std::endl;
+                throw std::runtime_error(message);
+            }
+            CUDA_CHECK(cudaMalloc(&_cublasLtWorkspace, kCublasLtWorkspaceSize));
+        }
+        return _cublasLtHandle;
+    }
+
+    void* GetCublasLtWorkSpace() { return _cublasLtWorkspace; }
+
+    static constexpr size_t kCublasLtWorkspaceSize = 4 * 1024 * 1024;
+#endif
+
     std::pair<uint64_t, uint64_t> IncrementOffset(uint64_t offset_inc)
     {
         uint64_t offset = _curr_offset;
@@ -169,7 +218,14 @@ public:
 private:
     curandGenerator_t _gen;
     cublasHandle_t _cublasHandle;
+#ifdef CUBLASLT_EPILOGUE_AVAILABLE
+    cublasLtHandle_t _cublasLtHandle = nullptr;
+    void* _cublasLtWorkspace = nullptr;
+#endif
     void* _workspace;
+    void* _reduce_workspace = nullptr;
+    size_t _reduce_workspace_size = 0;
+    int _sm_count = 0;
     uint64_t _seed;
     uint64_t _curr_offset;
     std::vector<std::array<int, 3>> _gemm_algos;
@@ -14,6 +14,10 @@
 #include <cuda_bf16.h>
 #endif
 
+#ifdef FP8_AVAILABLE
+#include <cuda_fp8.h>
+#endif
+
 namespace conversion {
 
 // Basic primitive for constructing conversions
@@ -623,4 +627,39 @@ DS_D_INLINE uint8_t to(__nv_bfloat16 val)
 }
 #endif
 
+/*********************  FP8 Conversions *********************/
+// Narrowing to fp8 saturates to the largest finite value of the format.
+#ifdef FP8_AVAILABLE
+template <>
+DS_D_INLINE float to(__nv_fp8_e4m3 val)
+{
+    return (float)val;
+}
+template <>
+DS_D_INLINE float to(__nv_fp8_e5m2 val)
+{
+    return (float)val;
+}
+template <>
+DS_D_INLINE __nv_fp8_e4m3 to(float val)
+{
+    return __nv_fp8_e4m3(val);
+}
+template <>
+DS_D_INLINE __nv_fp8_e5m2 to(float val)
+{
+    return __nv_fp8_e5m2(val);
+}
+template <>
+DS_D_INLINE __nv_fp8_e4m3 to(__half val)
+{
+    return __nv_fp8_e4m3(val);
+}
+template <>
+DS_D_INLINE __nv_fp8_e5m2 to(__half val)
+{
+    return __nv_fp8_e5m2(val);
+}
+#endif
+
 }  // namespace conversion
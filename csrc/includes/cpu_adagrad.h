@@ -51,8 +51,8 @@ public:
         cudaFreeHost(_doubled_buffer[1]);
 #endif
     }
-#if defined(__AVX512__) or defined(__AVX256__)
-    template <int span>
+#if defined(__AVX512__) or defined(__AVX256__) or defined(__DS_SIMD_DISPATCH__)
+    template <int span, int isa>
     void Step_AVX(size_t* rounded_size,
                   float* _params,
                   float* grads,
@@ -61,6 +61,49 @@ public:
                   ds_half_precision_t* dev_param = nullptr,
                   bool half_precision = false);
 #endif
+    // Runs the vectorized kernel for the active ISA and reports how much of the buffer it
+    // covered in rounded_size, the scalar Step_1 loop handles the rest.
+    template <int span>
+    void Step_SIMD(size_t* rounded_size,
+                   float* _params,
+                   float* grads,
+                   float* _exp_avg_sq,
+                   size_t param_size,
+                   ds_half_precision_t* dev_param,
+                   bool half_precision)
+    {
+#if defined(__DS_SIMD_DISPATCH__)
+        switch (ds_simd_runtime_isa()) {
+            case DS_SIMD_ISA_AVX512:
+                Step_AVX<span, DS_SIMD_ISA_AVX512>(rounded_size,
+                                                   _params,
+                                                   grads,
+                                                   _exp_avg_sq,
+                                                   param_size,
+                                                   dev_param,
+                                                   half_precision);
+                break;
+            case DS_SIMD_ISA_AVX256:
+                Step_AVX<span, DS_SIMD_ISA_AVX256>(rounded_size,
+                                                   _params,
+                                                   grads,
+                                                   _exp_avg_sq,
+                                                   param_size,
+                                                   dev_param,
+                                                   half_precision);
+                break;
+            default: break;
+        }
+#elif defined(__AVX512__) or defined(__AVX256__)
+        Step_AVX<span, DS_SIMD_ISA>(rounded_size,
+                                    _params,
+                                    grads,
+                                    _exp_avg_sq,
+                                    param_size,
+                                    dev_param,
+                                    half_precision);
+#endif
+    }
     STEP(1)
     STEP(4)
     STEP(8)
@@ -99,7 +142,7 @@ private:
 };
 
 #if defined(__AVX512__) or defined(__AVX256__)
-template <int span>
+template <int span, int isa>
 void Adagrad_Optimizer::Step_AVX(size_t* rounded_size,
                                  float* _params,
                                  float* grads,
@@ -126,7 +169,7 @@ void Adagrad_Optimizer::Step_AVX(size_t* rounded_size,
 #if defined(__ENABLE_CUDA__)
         if ((t / TILE) >= 2) { cudaStreamSynchronize(_streams[_buf_index]); }
 #endif
-#pragma omp parallel for
+#pragma omp parallel for schedule(static)
         for (size_t i = t; i < offset; i += SIMD_WIDTH * span) {
             AVX_Data grad_4[span];
             simd_load<span>(grad_4, grads + i, half_precision);
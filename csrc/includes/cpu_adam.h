@@ -9,7 +9,11 @@
                   // https://stackoverflow.com/questions/4913922/possible-problems-with-nominmax-on-visual-c
 
 #include <stdio.h>
+#include <algorithm>
 #include <cassert>
+#include <memory>
+#include <vector>
+#include "blockwise_state_quant.h"
 #include "simd.h"
 
 #if defined(__ENABLE_CUDA__)
@@ -23,14 +27,18 @@ typedef __half ds_half_precision_t;
 typedef unsigned short ds_half_precision_t;
 #endif
 
-#define STEP(SPAN)                                             \
-    void Step_##SPAN(float* _params,                           \
-                     float* grads,                             \
-                     float* _exp_avg,                          \
-                     float* _exp_avg_sq,                       \
-                     size_t _param_size,                       \
-                     ds_half_precision_t* dev_param = nullptr, \
-                     bool half_precision = false);
+#include "cpu_staging_ring.h"
+
+#define STEP(SPAN)                                                 \
+    void Step_##SPAN(float* _params,                               \
+                     float* grads,                                 \
+                     float* _exp_avg,                              \
+                     float* _exp_avg_sq,                           \
+                     size_t _param_size,                           \
+                     ds_half_precision_t* dev_param = nullptr,     \
+                     ds_dtype_t param_dtype = DS_DTYPE_FP32,       \
+                     ds_dtype_t grad_dtype = DS_DTYPE_FP32,        \
+                     ds_dtype_t dev_param_dtype = DS_DTYPE_FP16);
 
 class Adam_Optimizer {
 public:
@@ -39,7 +47,9 @@ public:
                    float betta2 = 0.999,
                    float eps = 1e-8,
                    float weight_decay = 0,
-                   bool adamw_mode = true)
+                   bool adamw_mode = true,
+                   int copy_depth = DEFAULT_COPY_DEPTH,
+                   size_t copy_tile = TILE)
         : _alpha(alpha),
           _betta1(betta1),
           _betta2(betta2),
@@ -48,27 +58,15 @@ public:
           _betta1_t(1.0),
           _betta2_t(1.0),
           _step(0),
-          _adamw_mode(adamw_mode)
+          _adamw_mode(adamw_mode),
+          _copy_depth(copy_depth),
+          _copy_tile(copy_tile)
     {
-#if defined(__ENABLE_CUDA__)
-        cudaMallocHost((void**)_doubled_buffer, TILE * sizeof(float));
-        cudaMallocHost((void**)(_doubled_buffer + 1), TILE * sizeof(float));
-
-        _streams[0] = TrainingContext::Instance().GetCurrentStream();
-        _streams[1] = TrainingContext::Instance().GetNewStream();
-        _buf_index = false;
-#endif
-    }
-    ~Adam_Optimizer()
-    {
-#if defined(__ENABLE_CUDA__)
-        cudaFreeHost(_doubled_buffer[0]);
-        cudaFreeHost(_doubled_buffer[1]);
-#endif
     }
+    ~Adam_Optimizer() {}
 
-#if defined(__AVX512__) or defined(__AVX256__)
-    template <int span>
+#if defined(__AVX512__) or defined(__AVX256__) or defined(__DS_SIMD_DISPATCH__)
+    template <int span, int isa>
     void Step_AVX(size_t* rounded_size,
                   float* _params,
                   float* grads,
@@ -76,16 +74,81 @@ public:
                   float* _exp_avg_sq,
                   size_t param_size,
                   ds_half_precision_t* dev_param = nullptr,
-                  bool half_precision = false);
+                  ds_dtype_t param_dtype = DS_DTYPE_FP32,
+                  ds_dtype_t grad_dtype = DS_DTYPE_FP32,
+                  ds_dtype_t dev_param_dtype = DS_DTYPE_FP16);
 #endif
+    // Runs the vectorized kernel for the active ISA and reports how much of the buffer it
+    // covered in rounded_size, the scalar Step_1 loop handles the rest.
+    template <int span>
+    void Step_SIMD(size_t* rounded_size,
+                   float* _params,
+                   float* grads,
+                   float* _exp_avg,
+                   float* _exp_avg_sq,
+                   size_t param_size,
+                   ds_half_precision_t* dev_param,
+                   ds_dtype_t param_dtype,
+                   ds_dtype_t grad_dtype,
+                   ds_dtype_t dev_param_dtype)
+    {
+#if defined(__DS_SIMD_DISPATCH__)
+        switch (ds_simd_runtime_isa()) {
+            case DS_SIMD_ISA_AVX512:
+                Step_AVX<span, DS_SIMD_ISA_AVX512>(rounded_size,
+                                                   _params,
+                                                   grads,
+                                                   _exp_avg,
+                                                   _exp_avg_sq,
+                                                   param_size,
+                                                   dev_param,
+                                                   param_dtype,
+                                                   grad_dtype,
+                                                   dev_param_dtype);
+                break;
+            case DS_SIMD_ISA_AVX256:
+                Step_AVX<span, DS_SIMD_ISA_AVX256>(rounded_size,
+                                                   _params,
+                                                   grads,
+                                                   _exp_avg,
+                                                   _exp_avg_sq,
+                                                   param_size,
+                                                   dev_param,
+                                                   param_dtype,
+                                                   grad_dtype,
+                                                   dev_param_dtype);
+                break;
+            default: break;
+        }
+#elif defined(__AVX512__) or defined(__AVX256__)
+        Step_AVX<span, DS_SIMD_ISA>(rounded_size,
+                                    _params,
+                                    grads,
+                                    _exp_avg,
+                                    _exp_avg_sq,
+                                    param_size,
+                                    dev_param,
+                                    param_dtype,
+                                    grad_dtype,
+                                    dev_param_dtype);
+#endif
+    }
     STEP(1)
     STEP(4)
     STEP(8)
+    // Step with exp_avg and exp_avg_sq stored as blockwise 8-bit codes, absmax holding the
+    // interleaved scales of every state_quant::block_size block (see blockwise_state_quant.h).
+    void Step_Quantized(float* _params,
+                        float* grads,
+                        uint8_t* _exp_avg,
+                        uint8_t* _exp_avg_sq,
+                        float* _absmax,
+                        size_t _param_size,
+                        ds_dtype_t param_dtype,
+                        ds_dtype_t grad_dtype,
+                        uint32_t seed);
 #if defined(__ENABLE_CUDA__)
-    inline void SynchronizeStreams()
-    {
-        for (int i = 0; i < 2; i++) cudaStreamSynchronize(_streams[i]);
-    }
+    inline void SynchronizeStreams() { Pinned_Staging_Ring::Synchronize(); }
 #endif
     inline void IncrementStep(size_t step, float beta1, float beta2)
     {
@@ -121,6 +184,12 @@ public:
         }
     }
 
+    // Elements per tile of a step over `vector` wide iterations, with or without the param copy.
+    size_t step_tile(bool copy, size_t vector) const
+    {
+        return ds_step_tile(copy, _copy_tile, vector);
+    }
+
 private:
     float _alpha;
     float _betta1;
@@ -137,15 +206,13 @@ private:
 
     bool _adamw_mode;
 
-#if defined(__ENABLE_CUDA__)
-    float* _doubled_buffer[2];
-    cudaStream_t _streams[2];
-    bool _buf_index;
-#endif
+    // Staging slots and elements per tile of the param copy to the device.
+    int _copy_depth;
+    size_t _copy_tile;
 };
 
 #if defined(__AVX512__) or defined(__AVX256__)
-template <int span>
+template <int span, int isa>
 void Adam_Optimizer::Step_AVX(size_t* rounded_size,
                               float* _params,
                               float* grads,
@@ -153,10 +220,20 @@ void Adam_Optimizer::Step_AVX(size_t* rounded_size,
                               float* _exp_avg_sq,
                               size_t _param_size,
                               ds_half_precision_t* dev_params,
-                              bool half_precision)
+                              ds_dtype_t param_dtype,
+                              ds_dtype_t grad_dtype,
+                              ds_dtype_t dev_param_dtype)
 {
     size_t new_rounded_size = 0;
-    int rshft = half_precision ? 1 : 0;
+    int param_rshft = ds_dtype_is_16bit(param_dtype) ? 1 : 0;
+    int grad_rshft = ds_dtype_is_16bit(grad_dtype) ? 1 : 0;
+
+    // The pinned copy buffer carries bf16 straight to the device, fp16 device copies are staged
+    // as fp16 or fp32 like the host params and converted by the param update kernels.
+    const ds_dtype_t copy_dtype =
+        (dev_param_dtype == DS_DTYPE_BF16)
+            ? DS_DTYPE_BF16
+            : (param_dtype == DS_DTYPE_FP16 ? DS_DTYPE_FP16 : DS_DTYPE_FP32);
 
     AVX_Data betta1_4;
     betta1_4.data = SIMD_SET(_betta1);
@@ -184,18 +261,25 @@ void Adam_Optimizer::Step_AVX(size_t* rounded_size,
     AVX_Data weight_decay4;
     if (_weight_decay > 0)
         weight_decay4.data = (_adamw_mode ? SIMD_SET(w_decay) : SIMD_SET(_weight_decay));
+    // Not step_tile(): an inline member called here would get a weak AVX copy in the per-ISA units.
+    const size_t tile = ds_step_tile(dev_params != nullptr, _copy_tile, SIMD_WIDTH * span);
+#if defined(__ENABLE_CUDA__)
+    std::shared_ptr<Pinned_Staging_Ring> staging;
+    if (dev_params) { staging = Pinned_Staging_Ring::Get(_copy_depth, tile); }
+#endif
     new_rounded_size = ROUND_DOWN(_param_size, SIMD_WIDTH * span);
-    for (size_t t = 0; t < new_rounded_size; t += TILE) {
-        size_t copy_size = TILE;
-        if ((t + TILE) > new_rounded_size) copy_size = new_rounded_size - t;
+    for (size_t t = 0; t < new_rounded_size; t += tile) {
+        size_t copy_size = tile;
+        if ((t + tile) > new_rounded_size) copy_size = new_rounded_size - t;
         size_t offset = copy_size + t;
 #if defined(__ENABLE_CUDA__)
-        if ((t / TILE) >= 2) { cudaStreamSynchronize(_streams[_buf_index]); }
+        const int slot = dev_params ? staging->acquire() : -1;
+        float* staging_buffer = dev_params ? staging->buffer(slot) : nullptr;
 #endif
-#pragma omp parallel for
+#pragma omp parallel for schedule(static)
         for (size_t i = t; i < offset; i += SIMD_WIDTH * span) {
             AVX_Data grad_4[span];
-            simd_load<span>(grad_4, grads + (i >> rshft), half_precision);
+            simd_load<span>(grad_4, grads + (i >> grad_rshft), grad_dtype);
 
             AVX_Data momentum_4[span];
             simd_load<span>(momentum_4, _exp_avg + i, false);
@@ -204,7 +288,7 @@ void Adam_Optimizer::Step_AVX(size_t* rounded_size,
             simd_load<span>(variance_4, _exp_avg_sq + i, false);
 
             AVX_Data param_4[span];
-            simd_load<span>(param_4, _params + (i >> rshft), half_precision);
+            simd_load<span>(param_4, _params + (i >> param_rshft), param_dtype);
 
             if (_weight_decay > 0 && !_adamw_mode) {
                 simd_fma<span>(grad_4, param_4, weight_decay4, grad_4);
@@ -225,10 +309,11 @@ void Adam_Optimizer::Step_AVX(size_t* rounded_size,
 
             simd_fma<span>(param_4, grad_4, step_size_4, param_4);
 
-            simd_store<span>(_params + (i >> rshft), param_4, half_precision);
+            simd_store<span>(_params + (i >> param_rshft), param_4, param_dtype);
 #if defined(__ENABLE_CUDA__)
             if (dev_params) {
-                simd_store<span>(_doubled_buffer[_buf_index] + (i - t), param_4, half_precision);
+                simd_store<span>(
+                    ds_dtype_offset(staging_buffer, i - t, copy_dtype), param_4, copy_dtype);
             }
 #endif
             simd_store<span>(_exp_avg + i, momentum_4, false);
@@ -236,14 +321,20 @@ void Adam_Optimizer::Step_AVX(size_t* rounded_size,
         }
 #if defined(__ENABLE_CUDA__)
         if (dev_params) {
-            if (half_precision)
+            if (copy_dtype == DS_DTYPE_BF16)
+                cudaMemcpyAsync(dev_params + t,
+                                staging_buffer,
+                                copy_size * sizeof(ds_half_precision_t),
+                                cudaMemcpyHostToDevice,
+                                staging->stream(slot));
+            else if (copy_dtype == DS_DTYPE_FP16)
                 launch_param_update_half(
-                    _doubled_buffer[_buf_index], dev_params + t, copy_size, _streams[_buf_index]);
+                    staging_buffer, dev_params + t, copy_size, staging->stream(slot));
             else
                 launch_param_update(
-                    _doubled_buffer[_buf_index], dev_params + t, copy_size, _streams[_buf_index]);
+                    staging_buffer, dev_params + t, copy_size, staging->stream(slot));
 
-            _buf_index = !_buf_index;
+            staging->release(slot);
         }
 #endif
     }
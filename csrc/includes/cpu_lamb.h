@@ -0,0 +1,448 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#pragma once
+
+#define NOMINMAX  // Windows idiosyncrasy
+                  // https://stackoverflow.com/questions/4913922/possible-problems-with-nominmax-on-visual-c
+
+#include <stdio.h>
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include "simd.h"
+
+#if defined(__ENABLE_CUDA__)
+#include <cuda_fp16.h>
+#include <cuda_runtime_api.h>
+#include "cuda.h"
+#include "custom_cuda_layers.h"
+typedef __half ds_half_precision_t;
+#else
+#include <cmath>
+typedef unsigned short ds_half_precision_t;
+#endif
+
+#include "cpu_staging_ring.h"
+
+// LAMB, "Large Batch Optimization for Deep Learning" (https://arxiv.org/abs/1904.00962), with the
+// update of FusedLamb, where g is the gradient divided by grad_scale:
+//   m = b1 * m + (1 - b1) * g
+//   v = b2 * v + (1 - b2) * g * g
+//   u = m / (sqrt(v) + eps) + wd * p
+//   p = p - step_size * clamp(|p| / |u|, min_coeff, max_coeff) * u
+// The per tensor norms need the whole tensor, so a step makes two passes over it. The first
+// updates the moments and reduces |p|^2 and |u|^2, the second recomputes u from the stored
+// moments and applies it.
+class Lamb_Optimizer {
+public:
+    Lamb_Optimizer(float alpha = 1e-3,
+                   float betta1 = 0.9,
+                   float betta2 = 0.999,
+                   float eps = 1e-8,
+                   float weight_decay = 0,
+                   float max_coeff = 10.0,
+                   float min_coeff = 0.01,
+                   bool eps_inside_sqrt = false,
+                   int copy_depth = DEFAULT_COPY_DEPTH,
+                   size_t copy_tile = TILE)
+        : _alpha(alpha),
+          _betta1(betta1),
+          _betta2(betta2),
+          _eps(eps),
+          _weight_decay(weight_decay),
+          _max_coeff(max_coeff),
+          _min_coeff(min_coeff),
+          _eps_inside_sqrt(eps_inside_sqrt),
+          _step_size(alpha),
+          _inv_grad_scale(1.0),
+          _step(0),
+          _copy_depth(copy_depth),
+          _copy_tile(copy_tile)
+    {
+    }
+    ~Lamb_Optimizer() {}
+
+#if defined(__AVX512__) or defined(__AVX256__) or defined(__DS_SIMD_DISPATCH__)
+    template <int span, int isa>
+    void Reduce_AVX(size_t* rounded_size,
+                    float* _params,
+                    float* grads,
+                    float* _exp_avg,
+                    float* _exp_avg_sq,
+                    size_t param_size,
+                    ds_dtype_t param_dtype,
+                    ds_dtype_t grad_dtype,
+                    double* w_norm_sq,
+                    double* u_norm_sq);
+    template <int span, int isa>
+    void Update_AVX(size_t* rounded_size,
+                    float* _params,
+                    float* _exp_avg,
+                    float* _exp_avg_sq,
+                    size_t param_size,
+                    float lamb_coeff,
+                    ds_half_precision_t* dev_param,
+                    ds_dtype_t param_dtype,
+                    ds_dtype_t dev_param_dtype);
+#endif
+    // First pass for the active ISA, rounded_size reports how much of the buffer it covered.
+    template <int span>
+    void Reduce_SIMD(size_t* rounded_size,
+                     float* _params,
+                     float* grads,
+                     float* _exp_avg,
+                     float* _exp_avg_sq,
+                     size_t param_size,
+                     ds_dtype_t param_dtype,
+                     ds_dtype_t grad_dtype,
+                     double* w_norm_sq,
+                     double* u_norm_sq)
+    {
+#if defined(__DS_SIMD_DISPATCH__)
+        switch (ds_simd_runtime_isa()) {
+            case DS_SIMD_ISA_AVX512:
+                Reduce_AVX<span, DS_SIMD_ISA_AVX512>(rounded_size,
+                                                     _params,
+                                                     grads,
+                                                     _exp_avg,
+                                                     _exp_avg_sq,
+                                                     param_size,
+                                                     param_dtype,
+                                                     grad_dtype,
+                                                     w_norm_sq,
+                                                     u_norm_sq);
+                break;
+            case DS_SIMD_ISA_AVX256:
+                Reduce_AVX<span, DS_SIMD_ISA_AVX256>(rounded_size,
+                                                     _params,
+                                                     grads,
+                                                     _exp_avg,
+                                                     _exp_avg_sq,
+                                                     param_size,
+                                                     param_dtype,
+                                                     grad_dtype,
+                                                     w_norm_sq,
+                                                     u_norm_sq);
+                break;
+            default: break;
+        }
+#elif defined(__AVX512__) or defined(__AVX256__)
+        Reduce_AVX<span, DS_SIMD_ISA>(rounded_size,
+                                      _params,
+                                      grads,
+                                      _exp_avg,
+                                      _exp_avg_sq,
+                                      param_size,
+                                      param_dtype,
+                                      grad_dtype,
+                                      w_norm_sq,
+                                      u_norm_sq);
+#endif
+    }
+    // Second pass for the active ISA, rounded_size reports how much of the buffer it covered.
+    template <int span>
+    void Update_SIMD(size_t* rounded_size,
+                     float* _params,
+                     float* _exp_avg,
+                     float* _exp_avg_sq,
+                     size_t param_size,
+                     float lamb_coeff,
+                     ds_half_precision_t* dev_param,
+                     ds_dtype_t param_dtype,
+                     ds_dtype_t dev_param_dtype)
+    {
+#if defined(__DS_SIMD_DISPATCH__)
+        switch (ds_simd_runtime_isa()) {
+            case DS_SIMD_ISA_AVX512:
+                Update_AVX<span, DS_SIMD_ISA_AVX512>(rounded_size,
+                                                     _params,
+                                                     _exp_avg,
+                                                     _exp_avg_sq,
+                                                     param_size,
+                                                     lamb_coeff,
+                                                     dev_param,
+                                                     param_dtype,
+                                                     dev_param_dtype);
+                break;
+            case DS_SIMD_ISA_AVX256:
+                Update_AVX<span, DS_SIMD_ISA_AVX256>(rounded_size,
+                                                     _params,
+                                                     _exp_avg,
+                                                     _exp_avg_sq,
+                                                     param_size,
+                                                     lamb_coeff,
+                                                     dev_param,
+                                                     param_dtype,
+                                                     dev_param_dtype);
+                break;
+            default: break;
+        }
+#elif defined(__AVX512__) or defined(__AVX256__)
+        Update_AVX<span, DS_SIMD_ISA>(rounded_size,
+                                      _params,
+                                      _exp_avg,
+                                      _exp_avg_sq,
+                                      param_size,
+                                      lamb_coeff,
+                                      dev_param,
+                                      param_dtype,
+                                      dev_param_dtype);
+#endif
+    }
+    // Runs both passes over one tensor and returns its lamb coefficient.
+    float Step(float* _params,
+               float* grads,
+               float* _exp_avg,
+               float* _exp_avg_sq,
+               size_t _param_size,
+               ds_half_precision_t* dev_param = nullptr,
+               ds_dtype_t param_dtype = DS_DTYPE_FP32,
+               ds_dtype_t grad_dtype = DS_DTYPE_FP32,
+               ds_dtype_t dev_param_dtype = DS_DTYPE_FP16);
+#if defined(__ENABLE_CUDA__)
+    inline void SynchronizeStreams() { Pinned_Staging_Ring::Synchronize(); }
+#endif
+    inline void IncrementStep(size_t step, float beta1, float beta2)
+    {
+        _step = step;
+        _betta1 = beta1;
+        _betta2 = beta2;
+    }
+    inline void update_state(float lr,
+                             float epsilon,
+                             float weight_decay,
+                             bool bias_correction,
+                             float max_coeff,
+                             float min_coeff,
+                             float grad_scale = 1.0)
+    {
+        _alpha = lr;
+        _eps = epsilon;
+        _weight_decay = weight_decay;
+        _max_coeff = max_coeff;
+        _min_coeff = min_coeff;
+        _inv_grad_scale = 1 / grad_scale;
+
+        // Like FusedLamb, the bias corrections are folded into the step size.
+        _step_size = _alpha;
+        if (bias_correction == 1) {
+            const float bias_correction1 = 1 - std::pow(_betta1, _step);
+            const float bias_correction2 = 1 - std::pow(_betta2, _step);
+            _step_size = _alpha * std::sqrt(bias_correction2) / bias_correction1;
+        }
+    }
+
+private:
+    float _alpha;
+    float _betta1;
+    float _betta2;
+    float _eps;
+    float _weight_decay;
+    float _max_coeff;
+    float _min_coeff;
+    bool _eps_inside_sqrt;
+
+    float _step_size;
+    float _inv_grad_scale;
+    size_t _step;
+
+    // Staging slots and elements per tile of the param copy to the device.
+    int _copy_depth;
+    size_t _copy_tile;
+};
+
+#if defined(__AVX512__) or defined(__AVX256__)
+template <int span, int isa>
+void Lamb_Optimizer::Reduce_AVX(size_t* rounded_size,
+                                float* _params,
+                                float* grads,
+                                float* _exp_avg,
+                                float* _exp_avg_sq,
+                                size_t _param_size,
+                                ds_dtype_t param_dtype,
+                                ds_dtype_t grad_dtype,
+                                double* w_norm_sq,
+                                double* u_norm_sq)
+{
+    int param_rshft = ds_dtype_is_16bit(param_dtype) ? 1 : 0;
+    int grad_rshft = ds_dtype_is_16bit(grad_dtype) ? 1 : 0;
+
+    AVX_Data betta1_4;
+    betta1_4.data = SIMD_SET(_betta1);
+    AVX_Data betta2_4;
+    betta2_4.data = SIMD_SET(_betta2);
+
+    AVX_Data betta1_minus1_4;
+    betta1_minus1_4.data = SIMD_SET(1 - _betta1);
+    AVX_Data betta2_minus1_4;
+    betta2_minus1_4.data = SIMD_SET(1 - _betta2);
+
+    AVX_Data eps_4;
+    eps_4.data = SIMD_SET(_eps);
+
+    AVX_Data weight_decay4;
+    weight_decay4.data = SIMD_SET(_weight_decay);
+
+    AVX_Data inv_grad_scale_4;
+    inv_grad_scale_4.data = SIMD_SET(_inv_grad_scale);
+
+    const size_t new_rounded_size = ROUND_DOWN(_param_size, SIMD_WIDTH * span);
+    double w_sum = 0;
+    double u_sum = 0;
+#pragma omp parallel reduction(+ : w_sum, u_sum)
+    {
+        AVX_Data w_acc;
+        w_acc.data = SIMD_SET(0);
+        AVX_Data u_acc;
+        u_acc.data = SIMD_SET(0);
+
+#pragma omp for schedule(static)
+        for (size_t i = 0; i < new_rounded_size; i += SIMD_WIDTH * span) {
+            AVX_Data grad_4[span];
+            simd_load<span>(grad_4, grads + (i >> grad_rshft), grad_dtype);
+            if (_inv_grad_scale != 1) { simd_mul<span>(grad_4, grad_4, inv_grad_scale_4); }
+
+            AVX_Data momentum_4[span];
+            simd_load<span>(momentum_4, _exp_avg + i, false);
+
+            AVX_Data variance_4[span];
+            simd_load<span>(variance_4, _exp_avg_sq + i, false);
+
+            AVX_Data param_4[span];
+            simd_load<span>(param_4, _params + (i >> param_rshft), param_dtype);
+
+            simd_mul<span>(momentum_4, momentum_4, betta1_4);
+            simd_fma<span>(momentum_4, grad_4, betta1_minus1_4, momentum_4);
+            simd_mul<span>(variance_4, variance_4, betta2_4);
+            simd_mul<span>(grad_4, grad_4, grad_4);
+            simd_fma<span>(variance_4, grad_4, betta2_minus1_4, variance_4);
+
+            AVX_Data update_4[span];
+            if (_eps_inside_sqrt) {
+                simd_add<span>(update_4, variance_4, eps_4);
+                simd_sqrt<span>(update_4, update_4);
+            } else {
+                simd_sqrt<span>(update_4, variance_4);
+                simd_add<span>(update_4, update_4, eps_4);
+            }
+            simd_div<span>(update_4, momentum_4, update_4);
+            if (_weight_decay > 0) { simd_fma<span>(update_4, param_4, weight_decay4, update_4); }
+
+#pragma unroll
+            for (size_t j = 0; j < span; ++j) {
+                w_acc.data = SIMD_FMA(param_4[j].data, param_4[j].data, w_acc.data);
+                u_acc.data = SIMD_FMA(update_4[j].data, update_4[j].data, u_acc.data);
+            }
+
+            simd_store<span>(_exp_avg + i, momentum_4, false);
+            simd_store<span>(_exp_avg_sq + i, variance_4, false);
+        }
+
+        w_sum += simd_reduce_add(w_acc);
+        u_sum += simd_reduce_add(u_acc);
+    }
+    *w_norm_sq += w_sum;
+    *u_norm_sq += u_sum;
+    *rounded_size = new_rounded_size;
+}
+
+template <int span, int isa>
+void Lamb_Optimizer::Update_AVX(size_t* rounded_size,
+                                float* _params,
+                                float* _exp_avg,
+                                float* _exp_avg_sq,
+                                size_t _param_size,
+                                float lamb_coeff,
+                                ds_half_precision_t* dev_params,
+                                ds_dtype_t param_dtype,
+                                ds_dtype_t dev_param_dtype)
+{
+    size_t new_rounded_size = 0;
+    int param_rshft = ds_dtype_is_16bit(param_dtype) ? 1 : 0;
+
+    // Same staging rules as Adam_Optimizer::Step_AVX.
+    const ds_dtype_t copy_dtype =
+        (dev_param_dtype == DS_DTYPE_BF16)
+            ? DS_DTYPE_BF16
+            : (param_dtype == DS_DTYPE_FP16 ? DS_DTYPE_FP16 : DS_DTYPE_FP32);
+
+    AVX_Data eps_4;
+    eps_4.data = SIMD_SET(_eps);
+
+    AVX_Data weight_decay4;
+    weight_decay4.data = SIMD_SET(_weight_decay);
+
+    AVX_Data step_size_4;
+    step_size_4.data = SIMD_SET(-1 * _step_size * lamb_coeff);
+
+    const size_t tile = ds_step_tile(dev_params != nullptr, _copy_tile, SIMD_WIDTH * span);
+#if defined(__ENABLE_CUDA__)
+    std::shared_ptr<Pinned_Staging_Ring> staging;
+    if (dev_params) { staging = Pinned_Staging_Ring::Get(_copy_depth, tile); }
+#endif
+    new_rounded_size = ROUND_DOWN(_param_size, SIMD_WIDTH * span);
+    for (size_t t = 0; t < new_rounded_size; t += tile) {
+        size_t copy_size = tile;
+        if ((t + tile) > new_rounded_size) copy_size = new_rounded_size - t;
+        size_t offset = copy_size + t;
+#if defined(__ENABLE_CUDA__)
+        const int slot = dev_params ? staging->acquire() : -1;
+        float* staging_buffer = dev_params ? staging->buffer(slot) : nullptr;
+#endif
+#pragma omp parallel for schedule(static)
+        for (size_t i = t; i < offset; i += SIMD_WIDTH * span) {
+            AVX_Data momentum_4[span];
+            simd_load<span>(momentum_4, _exp_avg + i, false);
+
+            AVX_Data variance_4[span];
+            simd_load<span>(variance_4, _exp_avg_sq + i, false);
+
+            AVX_Data param_4[span];
+            simd_load<span>(param_4, _params + (i >> param_rshft), param_dtype);
+
+            AVX_Data update_4[span];
+            if (_eps_inside_sqrt) {
+                simd_add<span>(update_4, variance_4, eps_4);
+                simd_sqrt<span>(update_4, update_4);
+            } else {
+                simd_sqrt<span>(update_4, variance_4);
+                simd_add<span>(update_4, update_4, eps_4);
+            }
+            simd_div<span>(update_4, momentum_4, update_4);
+            if (_weight_decay > 0) { simd_fma<span>(update_4, param_4, weight_decay4, update_4); }
+
+            simd_fma<span>(param_4, update_4, step_size_4, param_4);
+
+            simd_store<span>(_params + (i >> param_rshft), param_4, param_dtype);
+#if defined(__ENABLE_CUDA__)
+            if (dev_params) {
+                simd_store<span>(
+                    ds_dtype_offset(staging_buffer, i - t, copy_dtype), param_4, copy_dtype);
+            }
+#endif
+        }
+#if defined(__ENABLE_CUDA__)
+        if (dev_params) {
+            if (copy_dtype == DS_DTYPE_BF16)
+                cudaMemcpyAsync(dev_params + t,
+                                staging_buffer,
+                                copy_size * sizeof(ds_half_precision_t),
+                                cudaMemcpyHostToDevice,
+                                staging->stream(slot));
+            else if (copy_dtype == DS_DTYPE_FP16)
+                launch_param_update_half(
+                    staging_buffer, dev_params + t, copy_size, staging->stream(slot));
+            else
+                launch_param_update(
+                    staging_buffer, dev_params + t, copy_size, staging->stream(slot));
+
+            staging->release(slot);
+        }
+#endif
+    }
+    *rounded_size = new_rounded_size;
+}
+#endif
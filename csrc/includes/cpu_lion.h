@@ -0,0 +1,259 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#pragma once
+
+#define NOMINMAX  // Windows idiosyncrasy
+                  // https://stackoverflow.com/questions/4913922/possible-problems-with-nominmax-on-visual-c
+
+#include <stdio.h>
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include "simd.h"
+
+#if defined(__ENABLE_CUDA__)
+#include <cuda_fp16.h>
+#include <cuda_runtime_api.h>
+#include "cuda.h"
+#include "custom_cuda_layers.h"
+typedef __half ds_half_precision_t;
+#else
+#include <cmath>
+typedef unsigned short ds_half_precision_t;
+#endif
+
+#include "cpu_staging_ring.h"
+
+#define STEP(SPAN)                                                 \
+    void Step_##SPAN(float* _params,                               \
+                     float* grads,                                 \
+                     float* _exp_avg,                              \
+                     size_t _param_size,                           \
+                     ds_half_precision_t* dev_param = nullptr,     \
+                     ds_dtype_t param_dtype = DS_DTYPE_FP32,       \
+                     ds_dtype_t grad_dtype = DS_DTYPE_FP32,        \
+                     ds_dtype_t dev_param_dtype = DS_DTYPE_FP16);
+
+// Lion, "Symbolic Discovery of Optimization Algorithms" (https://arxiv.org/abs/2302.06675):
+//   p = p * (1 - lr * wd) - lr * sign(b1 * m + (1 - b1) * g)
+//   m = b2 * m + (1 - b2) * g
+class Lion_Optimizer {
+public:
+    Lion_Optimizer(float alpha = 1e-4,
+                   float betta1 = 0.9,
+                   float betta2 = 0.99,
+                   float weight_decay = 0,
+                   int copy_depth = DEFAULT_COPY_DEPTH,
+                   size_t copy_tile = TILE)
+        : _alpha(alpha),
+          _betta1(betta1),
+          _betta2(betta2),
+          _weight_decay(weight_decay),
+          _step(0),
+          _copy_depth(copy_depth),
+          _copy_tile(copy_tile)
+    {
+    }
+    ~Lion_Optimizer() {}
+
+#if defined(__AVX512__) or defined(__AVX256__) or defined(__DS_SIMD_DISPATCH__)
+    template <int span, int isa>
+    void Step_AVX(size_t* rounded_size,
+                  float* _params,
+                  float* grads,
+                  float* _exp_avg,
+                  size_t param_size,
+                  ds_half_precision_t* dev_param = nullptr,
+                  ds_dtype_t param_dtype = DS_DTYPE_FP32,
+                  ds_dtype_t grad_dtype = DS_DTYPE_FP32,
+                  ds_dtype_t dev_param_dtype = DS_DTYPE_FP16);
+#endif
+    // Runs the vectorized kernel for the active ISA and reports how much of the buffer it
+    // covered in rounded_size, the scalar Step_1 loop handles the rest.
+    template <int span>
+    void Step_SIMD(size_t* rounded_size,
+                   float* _params,
+                   float* grads,
+                   float* _exp_avg,
+                   size_t param_size,
+                   ds_half_precision_t* dev_param,
+                   ds_dtype_t param_dtype,
+                   ds_dtype_t grad_dtype,
+                   ds_dtype_t dev_param_dtype)
+    {
+#if defined(__DS_SIMD_DISPATCH__)
+        switch (ds_simd_runtime_isa()) {
+            case DS_SIMD_ISA_AVX512:
+                Step_AVX<span, DS_SIMD_ISA_AVX512>(rounded_size,
+                                                   _params,
+                                                   grads,
+                                                   _exp_avg,
+                                                   param_size,
+                                                   dev_param,
+                                                   param_dtype,
+                                                   grad_dtype,
+                                                   dev_param_dtype);
+                break;
+            case DS_SIMD_ISA_AVX256:
+                Step_AVX<span, DS_SIMD_ISA_AVX256>(rounded_size,
+                                                   _params,
+                                                   grads,
+                                                   _exp_avg,
+                                                   param_size,
+                                                   dev_param,
+                                                   param_dtype,
+                                                   grad_dtype,
+                                                   dev_param_dtype);
+                break;
+            default: break;
+        }
+#elif defined(__AVX512__) or defined(__AVX256__)
+        Step_AVX<span, DS_SIMD_ISA>(rounded_size,
+                                    _params,
+                                    grads,
+                                    _exp_avg,
+                                    param_size,
+                                    dev_param,
+                                    param_dtype,
+                                    grad_dtype,
+                                    dev_param_dtype);
+#endif
+    }
+    STEP(1)
+    STEP(4)
+    STEP(8)
+#if defined(__ENABLE_CUDA__)
+    inline void SynchronizeStreams() { Pinned_Staging_Ring::Synchronize(); }
+#endif
+    inline void IncrementStep(size_t step, float beta1, float beta2)
+    {
+        _step = step;
+        _betta1 = beta1;
+        _betta2 = beta2;
+    }
+    inline void update_state(float lr, float weight_decay)
+    {
+        _alpha = lr;
+        _weight_decay = weight_decay;
+    }
+
+private:
+    float _alpha;
+    float _betta1;
+    float _betta2;
+    float _weight_decay;
+    size_t _step;
+
+    // Staging slots and elements per tile of the param copy to the device.
+    int _copy_depth;
+    size_t _copy_tile;
+};
+
+#if defined(__AVX512__) or defined(__AVX256__)
+template <int span, int isa>
+void Lion_Optimizer::Step_AVX(size_t* rounded_size,
+                              float* _params,
+                              float* grads,
+                              float* _exp_avg,
+                              size_t _param_size,
+                              ds_half_precision_t* dev_params,
+                              ds_dtype_t param_dtype,
+                              ds_dtype_t grad_dtype,
+                              ds_dtype_t dev_param_dtype)
+{
+    size_t new_rounded_size = 0;
+    int param_rshft = ds_dtype_is_16bit(param_dtype) ? 1 : 0;
+    int grad_rshft = ds_dtype_is_16bit(grad_dtype) ? 1 : 0;
+
+    // Same staging rules as Adam_Optimizer::Step_AVX.
+    const ds_dtype_t copy_dtype =
+        (dev_param_dtype == DS_DTYPE_BF16)
+            ? DS_DTYPE_BF16
+            : (param_dtype == DS_DTYPE_FP16 ? DS_DTYPE_FP16 : DS_DTYPE_FP32);
+
+    AVX_Data betta1_4;
+    betta1_4.data = SIMD_SET(_betta1);
+    AVX_Data betta2_4;
+    betta2_4.data = SIMD_SET(_betta2);
+
+    AVX_Data betta1_minus1_4;
+    betta1_minus1_4.data = SIMD_SET(1 - _betta1);
+    AVX_Data betta2_minus1_4;
+    betta2_minus1_4.data = SIMD_SET(1 - _betta2);
+
+    AVX_Data step_size_4;
+    step_size_4.data = SIMD_SET(-1 * _alpha);
+
+    AVX_Data decay_4;
+    decay_4.data = SIMD_SET(1 - _alpha * _weight_decay);
+
+    const size_t tile = ds_step_tile(dev_params != nullptr, _copy_tile, SIMD_WIDTH * span);
+#if defined(__ENABLE_CUDA__)
+    std::shared_ptr<Pinned_Staging_Ring> staging;
+    if (dev_params) { staging = Pinned_Staging_Ring::Get(_copy_depth, tile); }
+#endif
+    new_rounded_size = ROUND_DOWN(_param_size, SIMD_WIDTH * span);
+    for (size_t t = 0; t < new_rounded_size; t += tile) {
+        size_t copy_size = tile;
+        if ((t + tile) > new_rounded_size) copy_size = new_rounded_size - t;
+        size_t offset = copy_size + t;
+#if defined(__ENABLE_CUDA__)
+        const int slot = dev_params ? staging->acquire() : -1;
+        float* staging_buffer = dev_params ? staging->buffer(slot) : nullptr;
+#endif
+#pragma omp parallel for schedule(static)
+        for (size_t i = t; i < offset; i += SIMD_WIDTH * span) {
+            AVX_Data grad_4[span];
+            simd_load<span>(grad_4, grads + (i >> grad_rshft), grad_dtype);
+
+            AVX_Data momentum_4[span];
+            simd_load<span>(momentum_4, _exp_avg + i, false);
+
+            AVX_Data param_4[span];
+            simd_load<span>(param_4, _params + (i >> param_rshft), param_dtype);
+
+            AVX_Data update_4[span];
+            simd_mul<span>(update_4, momentum_4, betta1_4);
+            simd_fma<span>(update_4, grad_4, betta1_minus1_4, update_4);
+            simd_sign<span>(update_4, update_4);
+
+            if (_weight_decay > 0) { simd_mul<span>(param_4, param_4, decay_4); }
+            simd_fma<span>(param_4, update_4, step_size_4, param_4);
+
+            simd_mul<span>(momentum_4, momentum_4, betta2_4);
+            simd_fma<span>(momentum_4, grad_4, betta2_minus1_4, momentum_4);
+
+            simd_store<span>(_params + (i >> param_rshft), param_4, param_dtype);
+#if defined(__ENABLE_CUDA__)
+            if (dev_params) {
+                simd_store<span>(
+                    ds_dtype_offset(staging_buffer, i - t, copy_dtype), param_4, copy_dtype);
+            }
+#endif
+            simd_store<span>(_exp_avg + i, momentum_4, false);
+        }
+#if defined(__ENABLE_CUDA__)
+        if (dev_params) {
+            if (copy_dtype == DS_DTYPE_BF16)
+                cudaMemcpyAsync(dev_params + t,
+                                staging_buffer,
+                                copy_size * sizeof(ds_half_precision_t),
+                                cudaMemcpyHostToDevice,
+                                staging->stream(slot));
+            else if (copy_dtype == DS_DTYPE_FP16)
+                launch_param_update_half(
+                    staging_buffer, dev_params + t, copy_size, staging->stream(slot));
+            else
+                launch_param_update(
+                    staging_buffer, dev_params + t, copy_size, staging->stream(slot));
+
+            staging->release(slot);
+        }
+#endif
+    }
+    *rounded_size = new_rounded_size;
+}
+#endif
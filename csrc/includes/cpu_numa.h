@@ -0,0 +1,202 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+NUMA placement for the CPU optimizers.
+
+The optimizer steps split every tile into contiguous static chunks, one per OpenMP thread. Once
+the threads are pinned node by node, in node order, the chunk of thread k always lands on the
+same node. Optimizer state zeroed through ds_numa_zero is first touched with the same split, so
+its pages are allocated on the node that later updates them and a step never streams state
+across sockets. The master thread is the caller's Python thread, so it is only pinned for the
+duration of a step (see Numa_Master_Guard) and otherwise keeps its own affinity.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <sched.h>
+#endif
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#include <torch/extension.h>
+#include "simd.h"
+
+// Parses a sysfs cpu list such as "0-3,8,10-11".
+static std::vector<int> ds_numa_parse_cpulist(const std::string& cpulist)
+{
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < cpulist.size()) {
+        auto end = cpulist.find(',', pos);
+        if (end == std::string::npos) { end = cpulist.size(); }
+        const auto range = cpulist.substr(pos, end - pos);
+        const auto dash = range.find('-');
+        if (!range.empty() && range[0] >= '0' && range[0] <= '9') {
+            const auto first = std::stoi(range.substr(0, dash));
+            const auto last =
+                (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+            for (auto cpu = first; cpu <= last; ++cpu) { cpus.push_back(cpu); }
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+// CPUs of each NUMA node that this process may run on, nodes without such CPUs are left out.
+static std::vector<std::vector<int>> ds_numa_node_cpus()
+{
+    std::vector<std::vector<int>> nodes;
+#if defined(__linux__)
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) { return nodes; }
+
+    const std::string node_root = "/sys/devices/system/node/";
+    std::vector<int> node_ids;
+    auto dir = opendir(node_root.c_str());
+    if (!dir) { return nodes; }
+    while (auto entry = readdir(dir)) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' &&
+            entry->d_name[4] <= '9') {
+            node_ids.push_back(std::stoi(entry->d_name + 4));
+        }
+    }
+    closedir(dir);
+    std::sort(node_ids.begin(), node_ids.end());
+
+    for (const auto node : node_ids) {
+        std::ifstream cpulist_file(node_root + "node" + std::to_string(node) + "/cpulist");
+        std::string cpulist;
+        std::getline(cpulist_file, cpulist);
+
+        std::vector<int> cpus;
+        for (const auto cpu : ds_numa_parse_cpulist(cpulist)) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) { cpus.push_back(cpu); }
+        }
+        if (!cpus.empty()) { nodes.push_back(cpus); }
+    }
+#endif
+    return nodes;
+}
+
+// CPUs of the node of OpenMP thread 0, empty until ds_numa_pin_threads() ran.
+inline std::vector<int>& ds_numa_master_cpus()
+{
+    static std::vector<int> master_cpus;
+    return master_cpus;
+}
+
+// Sizes the OpenMP team to one thread per allowed CPU and pins thread k to the node whose CPUs
+// come k-th in node order. The master thread is left alone, Numa_Master_Guard moves it to its node
+// while a step runs. Returns the number of nodes in use, 0 if the topology is unavailable. Later
+// parallel regions must keep the team size, the runtime then reuses the same pinned threads.
+static int ds_numa_pin_threads()
+{
+    const auto nodes = ds_numa_node_cpus();
+#if defined(__linux__) && defined(_OPENMP)
+    if (nodes.empty()) { return 0; }
+
+    std::vector<int> thread_nodes;
+    for (size_t node = 0; node < nodes.size(); ++node) {
+        thread_nodes.insert(thread_nodes.end(), nodes[node].size(), static_cast<int>(node));
+    }
+    const auto num_threads = static_cast<int>(thread_nodes.size());
+    omp_set_num_threads(num_threads);
+    ds_numa_master_cpus() = nodes[thread_nodes[0]];
+
+#pragma omp parallel num_threads(num_threads)
+    {
+        const auto thread = omp_get_thread_num();
+        if (thread > 0) {
+            const auto& cpus = nodes[thread_nodes[thread]];
+            cpu_set_t node_set;
+            CPU_ZERO(&node_set);
+            for (const auto cpu : cpus) { CPU_SET(cpu, &node_set); }
+            sched_setaffinity(0, sizeof(node_set), &node_set);
+        }
+    }
+#endif
+    return static_cast<int>(nodes.size());
+}
+
+// Pins the calling thread to the node of OpenMP thread 0 for the lifetime of the guard and then
+// restores its previous mask. A no-op until ds_numa_pin_threads() ran.
+class Numa_Master_Guard {
+public:
+    Numa_Master_Guard()
+    {
+#if defined(__linux__)
+        const auto& cpus = ds_numa_master_cpus();
+        if (cpus.empty()) { return; }
+        CPU_ZERO(&_saved);
+        if (sched_getaffinity(0, sizeof(_saved), &_saved) != 0) { return; }
+        cpu_set_t node_set;
+        CPU_ZERO(&node_set);
+        for (const auto cpu : cpus) { CPU_SET(cpu, &node_set); }
+        _pinned = (sched_setaffinity(0, sizeof(node_set), &node_set) == 0);
+#endif
+    }
+
+    ~Numa_Master_Guard()
+    {
+#if defined(__linux__)
+        if (_pinned) { sched_setaffinity(0, sizeof(_saved), &_saved); }
+#endif
+    }
+
+    Numa_Master_Guard(const Numa_Master_Guard&) = delete;
+    Numa_Master_Guard& operator=(const Numa_Master_Guard&) = delete;
+
+private:
+    bool _pinned = false;
+#if defined(__linux__)
+    cpu_set_t _saved;
+#endif
+};
+
+// Zeroes a freshly allocated buffer with the static split of an optimizer step over `tile` element
+// tiles of `vector` element iterations, so each page is first touched, and therefore allocated, by
+// the thread that will update it.
+template <typename T>
+static void ds_numa_zero(T* buffer, const size_t num_elems, const size_t tile, const size_t vector)
+{
+    Numa_Master_Guard numa_guard;
+    for (size_t t = 0; t < num_elems; t += tile) {
+        size_t copy_size = tile;
+        if ((t + tile) > num_elems) copy_size = num_elems - t;
+        size_t offset = copy_size + t;
+#pragma omp parallel for schedule(static)
+        for (size_t i = t; i < offset; i += vector) {
+            std::fill(buffer + i, buffer + std::min(i + vector, offset), T(0));
+        }
+    }
+}
+
+// ds_numa_zero on the storage of a contiguous state tensor, other element sizes are zeroed by
+// torch without any placement.
+static void ds_numa_zero_tensor(torch::Tensor& tensor, const size_t tile, const size_t vector)
+{
+    assert(tensor.is_contiguous());
+    if (tensor.element_size() == sizeof(float))
+        ds_numa_zero((float*)tensor.data_ptr(), tensor.numel(), tile, vector);
+    else if (tensor.element_size() == sizeof(uint16_t))
+        ds_numa_zero((uint16_t*)tensor.data_ptr(), tensor.numel(), tile, vector);
+    else
+        tensor.zero_();
+}
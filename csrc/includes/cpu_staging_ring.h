@@ -0,0 +1,56 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#if defined(__ENABLE_CUDA__)
+#include <cuda_runtime_api.h>
+#endif
+
+#define DEFAULT_COPY_DEPTH 2
+
+#if defined(__ENABLE_CUDA__)
+// Ring of pinned tiles that stage the updated params for the host to device copy of the CPU
+// optimizers. A single ring is shared by every optimizer of the op, steps run one at a time and
+// drain it before they return, so it only has to be as deep and as wide as the largest request.
+// Acquiring a slot waits on the event of the copy that last used it, the CPU only stalls when all
+// slots are busy. Defined in cpu_staging_ring.cpp so the per-ISA kernel units of a dispatch build
+// share one instance. Each op (cpu_adam, cpu_lamb, cpu_lion) compiles its own copy of that
+// unit, so every extension module pins a ring of its own.
+class Pinned_Staging_Ring {
+public:
+    // Throws std::runtime_error if a tile cannot be pinned.
+    Pinned_Staging_Ring(int depth, size_t tile);
+    ~Pinned_Staging_Ring();
+
+    // Returns the shared ring, replaced by a larger one first if it is too small.
+    static std::shared_ptr<Pinned_Staging_Ring> Get(int depth, size_t tile);
+    // Waits for the copies in flight on the shared ring, if there is one.
+    static void Synchronize();
+    // Drops the shared ring once no optimizer is left.
+    static void Release();
+
+    int acquire();
+    void release(int slot);
+    void synchronize();
+
+    float* buffer(int slot) const { return _buffers[slot]; }
+    cudaStream_t stream(int slot) const { return _streams[slot]; }
+    int depth() const { return static_cast<int>(_buffers.size()); }
+    size_t tile() const { return _tile; }
+
+private:
+    void _destroy();
+
+    size_t _tile;
+    int _next_slot;
+    std::vector<float*> _buffers;
+    std::vector<cudaStream_t> _streams;
+    std::vector<cudaEvent_t> _events;
+};
+#endif
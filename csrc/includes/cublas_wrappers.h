@@ -15,6 +15,12 @@
 #endif
 #include <stdio.h>
 
+// The bias, GELU and bias-gradient epilogues of cublasLt need CUDA 11.4.
+#if !defined(__HIP_PLATFORM_HCC__) && defined(CUDART_VERSION) && CUDART_VERSION >= 11040
+#define CUBLASLT_EPILOGUE_AVAILABLE
+#include <cublasLt.h>
+#endif
+
 int cublas_gemm_ex(cublasHandle_t handle,
                    cublasOperation_t transa,
                    cublasOperation_t transb,
@@ -90,3 +96,26 @@ int cublas_strided_batched_gemm(cublasHandle_t handle,
 #else
                                 cublasGemmAlgo_t algo = CUBLAS_GEMM_DEFAULT_TENSOR_OP);
 #endif
+
+#ifdef CUBLASLT_EPILOGUE_AVAILABLE
+// Column major C[m, n] = op(A) x op(B) with a cublasLt epilogue, bias is the bias vector of
+// the BIAS variants or the gradient written by the BGRAD ones, aux holds the GELU input (ld m).
+template <typename T>
+int cublas_lt_gemm(cublasLtHandle_t handle,
+                   cublasOperation_t transa,
+                   cublasOperation_t transb,
+                   int m,
+                   int n,
+                   int k,
+                   const float* alpha,
+                   const float* beta,
+                   const T* A,
+                   const T* B,
+                   T* C,
+                   cublasLtEpilogue_t epilogue,
+                   T* bias,
+                   T* aux,
+                   void* workspace,
+                   size_t workspace_size,
+                   cudaStream_t stream);
+#endif
@@ -42,6 +42,12 @@
 
 #define WARP_SIZE_BITS 5
 
+// Largest head the fused attention of the training layer (flash_attention_kernels.cu) supports.
+#define ATTN_FLASH_MAX_HEAD_SIZE 128
+
+// Widest row the single-pass normalization kernels keep in registers (1024 threads x 16).
+#define NORM_FUSED_MAX_WIDTH 16384
+
 // Fused bias add with gelu activation
 template <typename T>
 void launch_bias_gelu(const T* input,
@@ -66,6 +72,24 @@ void launch_d_gelu(T* d_output,
                    int batch_size,
                    cudaStream_t stream);
 
+// Fused bias add with SwiGLU, input and bias are 2 * intermediate_size wide (gate second)
+template <typename T>
+void launch_bias_swiglu(const T* input,
+                        const T* bias,
+                        T* output,
+                        int intermediate_size,
+                        int batch_size,
+                        cudaStream_t stream);
+
+template <typename T>
+void launch_d_swiglu(T* d_input,
+                     const T* d_output,
+                     const T* input,
+                     const T* bias,
+                     int intermediate_size,
+                     int batch_size,
+                     cudaStream_t stream);
+
 // Custom fused bias add with layer normalization
 template <typename T>
 void launch_bias_residual_layer_norm(T* vals,
@@ -164,6 +188,40 @@ void launch_layerNorm_backward_nreversible(const T* out_grad,
                                            int hidden_dim,
                                            cudaStream_t stream[2]);
 
+// RMSNorm: vals = residual / sqrt(mean(residual^2) + epsilon) * gamma, vars keeps the
+// mean(residual^2) + epsilon of each row for the backward.
+template <typename T>
+void launch_rms_norm(T* vals,
+                     const T* residual,
+                     const T* gamma,
+                     float epsilon,
+                     int batch_size,
+                     int hidden_dim,
+                     cudaStream_t stream,
+                     bool training,
+                     T* vars);
+
+// Single-pass LayerNorm (or RMSNorm with rms) backward: inp_grad and per-block partial gamma
+// and betta gradients in one kernel, then a column reduction of the partials. vals is the
+// normalize input with its means (nullptr for RMSNorm), or its output when invertible.
+// residual_grad, if given, is added to inp_grad. betta_grad is zeroed for RMSNorm.
+template <typename T>
+void launch_norm_backward_fused(const T* out_grad,
+                                const T* residual_grad,
+                                const T* vals,
+                                const T* vars,
+                                const T* means,
+                                const T* gamma,
+                                const T* betta,
+                                T* gamma_grad,
+                                T* betta_grad,
+                                T* inp_grad,
+                                int batch_size,
+                                int hidden_dim,
+                                bool invertible,
+                                bool rms,
+                                cudaStream_t stream);
+
 template <typename T>
 void Transpose(const T* inp_mat, T* out_mat, int rows, int cols, cudaStream_t stream);
 
@@ -183,6 +241,50 @@ void launch_attn_softmax_backward_v2(T* out_grad,
                                      int seq_length,
                                      cudaStream_t stream);
 
+/*
+Fused attention of the training layer: q, k, v and out are [batch, heads, seq, head_size], mask
+the additive [batch, seq] mask of the keys, lse the [batch, heads, seq] fp32 log-sum-exp of the
+score rows kept for the backward. The attention dropout is drawn in the kernels from seed, the
+backward regenerates it from the same pair. d_out and out of the backward are
+[batch, seq, heads * head_size], delta is [batch, heads, seq] fp32 scratch.
+*/
+template <typename T>
+void launch_attn_flash_forward(T* out,
+                               float* lse,
+                               const T* q,
+                               const T* k,
+                               const T* v,
+                               const T* mask,
+                               int batch_size,
+                               int heads,
+                               int seq_length,
+                               int head_size,
+                               float scale,
+                               float dropout_ratio,
+                               std::pair<uint64_t, uint64_t> seed,
+                               cudaStream_t stream);
+
+template <typename T>
+void launch_attn_flash_backward(T* d_q,
+                                T* d_k,
+                                T* d_v,
+                                float* delta,
+                                const T* d_out,
+                                const T* out,
+                                const float* lse,
+                                const T* q,
+                                const T* k,
+                                const T* v,
+                                const T* mask,
+                                int batch_size,
+                                int heads,
+                                int seq_length,
+                                int head_size,
+                                float scale,
+                                float dropout_ratio,
+                                std::pair<uint64_t, uint64_t> seed,
+                                cudaStream_t stream);
+
 // Custom softmax with scaling and attention mask addition
 template <typename T>
 void launch_attn_softmax(T* vals,
@@ -265,6 +367,27 @@ void launch_dropout_grad(T* vals_out,
                          float ratio,
                          cudaStream_t stream);
 
+// Dropout without a mask: the keep flags are derived from (seed, offset) and the element index, the
+// backward passes the same pair to regenerate them. residual and bias may be null.
+template <typename T>
+void launch_dropout_stateless(T* out,
+                              const T* vals,
+                              const T* residual,
+                              const T* bias,
+                              int total_count,
+                              int dim,
+                              float ratio,
+                              std::pair<uint64_t, uint64_t> seed,
+                              cudaStream_t stream);
+
+template <typename T>
+void launch_dropout_stateless_grad(T* vals_out,
+                                   const T* vals,
+                                   int total_count,
+                                   float ratio,
+                                   std::pair<uint64_t, uint64_t> seed,
+                                   cudaStream_t stream);
+
 template <typename T>
 void launch_fuse_transpose_bias_kernel(const T* inp,
                                        T* out,
@@ -275,7 +398,12 @@ void launch_fuse_transpose_bias_kernel(const T* inp,
 void launch_param_update(const float* input, __half* output, int size, cudaStream_t stream);
 void launch_param_update_half(const float* input, __half* output, int size, cudaStream_t stream);
 
+// Rows with more original tokens are sorted through a [layers * batch_size, original_tokens] int32
+// workspace in global memory instead of shared memory.
+constexpr int token_sort_max_shared_tokens = 2048;
+
 void launch_token_sort(int32_t* indices,
+                       int32_t* workspace,
                        int layers,
                        int batch_size,
                        int reserved_size,
@@ -8,6 +8,7 @@
 #include <cuda.h>
 #include <cuda_fp16.h>
 #include <stdio.h>
+#include "custom_cuda_layers.h"
 
 template <typename T>
 class Dropout {
@@ -16,8 +17,13 @@ public:
         float ratio;
         uint32_t dim;
         bool training;
+        // Keep (seed, offset) instead of a mask and regenerate the mask in the backward.
+        bool stateless;
 
-        Config(float r, uint32_t d) : ratio(r), dim(d), training(true) {}
+        Config(float r, uint32_t d, bool stateless = false)
+            : ratio(r), dim(d), training(true), stateless(stateless)
+        {
+        }
 
         float RATIO() const { return training ? ratio : 0.0; }
         inline void SetDim(uint32_t d) { dim = d; }
@@ -29,12 +35,37 @@ public:
 
     void Forward(int bsz, T* out, const T* vals, cudaStream_t stream, bool bwd = false)
     {
+        if (_config.stateless) {
+            // bwd recomputes the output of the forward, with its seed.
+            launch_dropout_stateless<T>(out,
+                                        vals,
+                                        nullptr,
+                                        nullptr,
+                                        bsz * _config.dim,
+                                        _config.dim,
+                                        _config.RATIO(),
+                                        bwd ? GetSeed() : NextSeed(),
+                                        stream);
+            return;
+        }
         launch_dropout<T>(
             out, vals, _mask, bsz * _config.dim, _config.dim, _config.RATIO(), stream, bwd);
     }
 
     void ForwardWithBias(int bsz, T* vals, const T* bias, cudaStream_t stream)
     {
+        if (_config.stateless) {
+            launch_dropout_stateless<T>(vals,
+                                        vals,
+                                        nullptr,
+                                        bias,
+                                        bsz * _config.dim,
+                                        _config.dim,
+                                        _config.RATIO(),
+                                        NextSeed(),
+                                        stream);
+            return;
+        }
         launch_dropout<T>(vals, bias, _mask, bsz, _config.dim, _config.RATIO(), stream);
     }
 
@@ -45,17 +76,39 @@ public:
                          const T* bias,
                          cudaStream_t stream)
     {
+        if (_config.stateless) {
+            launch_dropout_stateless<T>(out,
+                                        vals,
+                                        residual,
+                                        bias,
+                                        bsz * _config.dim,
+                                        _config.dim,
+                                        _config.RATIO(),
+                                        NextSeed(),
+                                        stream);
+            return;
+        }
         launch_dropout<T>(
             out, vals, residual, bias, _mask, bsz, _config.dim, _config.RATIO(), stream);
     }
 
     void Backward(int bsz, T* d_vals, cudaStream_t stream)
     {
+        if (_config.stateless) {
+            launch_dropout_stateless_grad<T>(
+                d_vals, d_vals, bsz * _config.dim, _config.RATIO(), GetSeed(), stream);
+            return;
+        }
         launch_dropout_grad<T>(d_vals, _mask, bsz * _config.dim, _config.RATIO(), stream);
     }
 
     void Backward(int bsz, T* d_vals_out, const T* d_vals, cudaStream_t stream)
     {
+        if (_config.stateless) {
+            launch_dropout_stateless_grad<T>(
+                d_vals_out, d_vals, bsz * _config.dim, _config.RATIO(), GetSeed(), stream);
+            return;
+        }
         launch_dropout_grad<T>(
             d_vals_out, d_vals, _mask, bsz * _config.dim, _config.RATIO(), stream);
     }
@@ -64,6 +117,7 @@ public:
 
     void SetTrainingMode(bool training) { _config.training = training; }
 
+    // In stateless mode the mask is the host memory of the (seed, offset) pair of the forward.
     void SetMask(uint8_t* mask)
     {
         if (!mask) { throw std::runtime_error("Dropout mask is null."); }
@@ -75,7 +129,25 @@ public:
 
     inline void SetDimension(uint32_t dim) { _config.SetDim(dim); }
 
+    inline bool IsStateless() const { return _config.stateless; }
+
 private:
+    std::pair<uint64_t, uint64_t> NextSeed()
+    {
+        // 4 values per subsequence, one subsequence per 4 elements.
+        auto seed = TrainingContext::Instance().IncrementOffset(4);
+        uint64_t* pair = reinterpret_cast<uint64_t*>(_mask);
+        pair[0] = seed.first;
+        pair[1] = seed.second;
+        return seed;
+    }
+
+    std::pair<uint64_t, uint64_t> GetSeed() const
+    {
+        const uint64_t* pair = reinterpret_cast<const uint64_t*>(_mask);
+        return std::pair<uint64_t, uint64_t>(pair[0], pair[1]);
+    }
+
     uint8_t* _mask;
     Config _config;
 };
@@ -0,0 +1,261 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Opt-in instrumentation of the extension entry points. Every op registered through
+`ds_instrument::def` is wrapped so that, when enabled at runtime, the call is enclosed in an
+NVTX range named after the op and/or bracketed by CUDA events on the current stream. Events
+are never synchronized on the call path: finished pairs are resolved when the timings are
+queried (or opportunistically once many are pending) and aggregated per op name and shape of
+the first tensor argument. When both are disabled the wrapper costs one relaxed atomic load.
+
+Each extension module keeps its own state and exposes it with `ds_instrument::def_queries`:
+    set_instrumentation(nvtx, timing), get_op_timings(), reset_op_timings()
+*/
+
+#pragma once
+
+#include <ATen/cuda/CUDAContext.h>
+#include <cuda_runtime.h>
+#include <torch/extension.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__has_include)
+#if __has_include(<nvtx3/nvToolsExt.h>)
+#include <nvtx3/nvToolsExt.h>
+#define DS_INSTRUMENT_NVTX
+#endif
+#endif
+
+namespace ds_instrument {
+
+constexpr int nvtx_flag = 1;
+constexpr int timing_flag = 2;
+
+// Pending event pairs past which completed ones are resolved from the call path
+constexpr size_t max_pending = 4096;
+
+struct op_stats_t {
+    int64_t count = 0;
+    double total_ms = 0;
+    double min_ms = 0;
+    double max_ms = 0;
+};
+
+struct pending_t {
+    const char* name;
+    std::vector<int64_t> shape;
+    cudaEvent_t start;
+    cudaEvent_t end;
+};
+
+class InstrumentState {
+public:
+    static InstrumentState& instance()
+    {
+        static InstrumentState state;
+        return state;
+    }
+
+    std::atomic<int> flags{0};
+
+    cudaEvent_t acquire_event()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_free_events.empty()) {
+            auto event = _free_events.back();
+            _free_events.pop_back();
+            return event;
+        }
+        cudaEvent_t event;
+        cudaEventCreate(&event);
+        return event;
+    }
+
+    void push(pending_t&& record)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending.push_back(std::move(record));
+        if (_pending.size() > max_pending) { _resolve(false); }
+    }
+
+    std::map<std::pair<std::string, std::vector<int64_t>>, op_stats_t> timings()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _resolve(true);
+        return _timings;
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _resolve(true);
+        _timings.clear();
+    }
+
+private:
+    // Folds finished event pairs into the timings, oldest first. Only waits when `wait` is set.
+    void _resolve(bool wait)
+    {
+        while (!_pending.empty()) {
+            auto& record = _pending.front();
+            if (wait) {
+                cudaEventSynchronize(record.end);
+            } else if (cudaEventQuery(record.end) != cudaSuccess) {
+                break;
+            }
+
+            float elapsed_ms = 0;
+            if (cudaEventElapsedTime(&elapsed_ms, record.start, record.end) == cudaSuccess) {
+                auto& stats = _timings[{record.name, record.shape}];
+                stats.min_ms = stats.count ? std::min<double>(stats.min_ms, elapsed_ms)
+                                           : elapsed_ms;
+                stats.max_ms = std::max<double>(stats.max_ms, elapsed_ms);
+                stats.total_ms += elapsed_ms;
+                stats.count++;
+            }
+            // Clear a sticky error left by an event that was never recorded
+            cudaGetLastError();
+
+            _free_events.push_back(record.start);
+            _free_events.push_back(record.end);
+            _pending.pop_front();
+        }
+    }
+
+    std::mutex _mutex;
+    std::deque<pending_t> _pending;
+    std::vector<cudaEvent_t> _free_events;
+    std::map<std::pair<std::string, std::vector<int64_t>>, op_stats_t> _timings;
+};
+
+inline std::vector<int64_t> first_shape() { return {}; }
+
+template <typename... Rest>
+inline std::vector<int64_t> first_shape(const at::Tensor& tensor, const Rest&...)
+{
+    return tensor.defined() ? tensor.sizes().vec() : std::vector<int64_t>();
+}
+
+template <typename T, typename... Rest>
+inline std::vector<int64_t> first_shape(const T&, const Rest&... rest)
+{
+    return first_shape(rest...);
+}
+
+// Instruments the lifetime of one op call.
+class OpRange {
+public:
+    template <typename... Args>
+    OpRange(const char* name, const Args&... args) : _flags(0)
+    {
+        const int flags = InstrumentState::instance().flags.load(std::memory_order_relaxed);
+        if (flags == 0) { return; }
+        _start(flags, name, first_shape(args...));
+    }
+
+    ~OpRange()
+    {
+        if (_flags == 0) { return; }
+        _stop();
+    }
+
+    OpRange(const OpRange&) = delete;
+    OpRange& operator=(const OpRange&) = delete;
+
+private:
+    void _start(int flags, const char* name, std::vector<int64_t>&& shape)
+    {
+        _flags = flags;
+        if (_flags & timing_flag) {
+            // Events recorded during graph capture become graph nodes and have no elapsed time
+            cudaStreamCaptureStatus status;
+            cudaStreamIsCapturing(at::cuda::getCurrentCUDAStream(), &status);
+            if (status != cudaStreamCaptureStatusNone) { _flags &= ~timing_flag; }
+        }
+#if defined(DS_INSTRUMENT_NVTX)
+        if (_flags & nvtx_flag) { nvtxRangePushA(name); }
+#endif
+        if (_flags & timing_flag) {
+            auto& state = InstrumentState::instance();
+            _record = {name, std::move(shape), state.acquire_event(), state.acquire_event()};
+            cudaEventRecord(_record.start, at::cuda::getCurrentCUDAStream());
+        }
+    }
+
+    void _stop()
+    {
+        if (_flags & timing_flag) {
+            cudaEventRecord(_record.end, at::cuda::getCurrentCUDAStream());
+            InstrumentState::instance().push(std::move(_record));
+        }
+#if defined(DS_INSTRUMENT_NVTX)
+        if (_flags & nvtx_flag) { nvtxRangePop(); }
+#endif
+    }
+
+    int _flags;
+    pending_t _record;
+};
+
+template <typename R, typename... Args>
+inline auto wrap(const char* name, R (*fn)(Args...))
+{
+    return [name, fn](Args... args) -> R {
+        OpRange range(name, args...);
+        return fn(std::forward<Args>(args)...);
+    };
+}
+
+// Drop-in for `m.def(name, fn, extra...)` on a free function.
+template <typename R, typename... Args, typename... Extra>
+inline void def(pybind11::module& m, const char* name, R (*fn)(Args...), const Extra&... extra)
+{
+    m.def(name, wrap(name, fn), extra...);
+}
+
+inline void set_instrumentation(bool nvtx, bool timing)
+{
+    InstrumentState::instance().flags.store((nvtx ? nvtx_flag : 0) | (timing ? timing_flag : 0));
+}
+
+inline pybind11::list get_op_timings()
+{
+    pybind11::list result;
+    for (auto& entry : InstrumentState::instance().timings()) {
+        pybind11::dict op;
+        op["name"] = entry.first.first;
+        op["shape"] = entry.first.second;
+        op["count"] = entry.second.count;
+        op["total_ms"] = entry.second.total_ms;
+        op["min_ms"] = entry.second.min_ms;
+        op["max_ms"] = entry.second.max_ms;
+        result.append(op);
+    }
+    return result;
+}
+
+inline void reset_op_timings() { InstrumentState::instance().reset(); }
+
+inline void def_queries(pybind11::module& m)
+{
+    m.def("set_instrumentation",
+          &set_instrumentation,
+          "Enable NVTX ranges and/or CUDA event timing of the ops of this extension",
+          pybind11::arg("nvtx") = false,
+          pybind11::arg("timing") = false);
+    m.def("get_op_timings",
+          &get_op_timings,
+          "Per op name and input shape timings recorded since the last reset");
+    m.def("reset_op_timings", &reset_op_timings, "Clear the recorded op timings");
+}
+
+}  // namespace ds_instrument
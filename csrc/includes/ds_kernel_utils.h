@@ -39,6 +39,12 @@ constexpr int hw_warp_size = 32;
 
 #include <cooperative_groups.h>
 
+// fp8 types and the cublasLt fp8 GEMM, host and device side. The GEMM itself needs sm_89 or newer
+// at run time.
+#if CUDA_VERSION >= 11080
+#define FP8_AVAILABLE
+#endif  // CUDA_VERSION >= 11080
+
 #endif  //__HIP_PLATFORM_HCC__
 
 inline int next_pow2(const int val)
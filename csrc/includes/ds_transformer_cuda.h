@@ -13,6 +13,7 @@
 #include "cuda.h"
 #include "dropout.h"
 #include "feed_forward.h"
+#include "flash_attention.h"
 #include "gelu.h"
 #include "general_kernels.h"
 #include "normalize_layer.h"
@@ -53,7 +54,15 @@ public:
                          bool attn_dropout_checkpoint,
                          bool normalize_invertible,
                          bool gelu_checkpoint,
-                         bool stochastic_mode);
+                         bool stochastic_mode,
+                         bool flash_attention = false,
+                         bool stateless_dropout = false,
+                         bool gemm_epilogues = false,
+                         bool recompute_qkv = false,
+                         bool recompute_softmax = false,
+                         bool recompute_ff1 = false,
+                         bool rms_norm = false,
+                         bool swiglu = false);
 
     virtual ~BertTransformerLayer();
 
@@ -125,6 +134,21 @@ public:
                   T* grad_norm_w_ptr,
                   T* grad_norm_b_ptr);
 
+    // Rebuilds the activations the forward did not keep, before Backward: Q, K and V from the
+    // QKV GEMM of qkv_input_ptr, the attention probabilities from Q.K^T, and the intermediate
+    // GEMM output, each only when its recompute flag is set.
+    void Recompute(unsigned bsz,
+                   const T* qkv_input_ptr,
+                   const T* input_mask_ptr,
+                   const T* attn_qkvw_ptr,
+                   const T* attn_qkvb_ptr,
+                   const T* ff1_inp_ptr,
+                   const T* inter_w_ptr,
+                   const T* inter_b_ptr,
+                   T* q_tf_ptr,
+                   T* softmax_output_ptr,
+                   T* ff1_out_ptr);
+
     void SetIntermediateBuffers(uint8_t* attn_prob_dropout_mask_ptr,
                                 uint8_t* attn_output_dropout_mask_ptr,
                                 uint8_t* layer_output_dropout_mask_ptr,
@@ -133,19 +157,46 @@ public:
                                 T* attn_layer_norm_var,
                                 T* attn_layer_norm_mean);
 
+    // Packed sequences: the token-wise layers run on total_tokens rows, token_index maps them to
+    // their [batch, seq] position for the attention and padded_index back (-1 for padding).
+    // packed_buf holds 3 * batch * seq * hidden elements. total_tokens 0 is the padded batch.
+    void SetPackedTokens(int total_tokens,
+                         const int* token_index,
+                         const int* padded_index,
+                         T* packed_buf);
+
     inline unsigned GetBatchSize() const { return _batch_size; }
     inline unsigned GetNumHeads() const { return _heads; }
     inline unsigned GetSeqLength() const { return _seq_length; }
     inline unsigned GetIntermediateSize() const { return _intermediate_size; }
+    // Width of the intermediate GEMM output, the SwiGLU gate doubles it.
+    inline unsigned GetFF1Size() const { return (_swiglu ? 2 : 1) * _intermediate_size; }
 
     void SetSeqLength(unsigned seq_len);
     inline unsigned GetHiddenSize() const { return _hidden_size; }
     void SetTrainingMode(bool training);
     inline bool IsTrainingMode() const { return _training; }
     inline bool GeluCheckpoint() const { return _gelu_checkpoint; }
+    inline bool IsPreLayerNorm() const { return _pre_or_postLayerNorm; }
+    inline bool UseFlashAttention() const { return _flash_attention; }
+    inline bool StatelessDropout() const { return _stateless_dropout; }
+    inline bool GemmEpilogues() const { return _gemm_epilogues; }
+    inline bool RecomputeQkv() const { return _recompute_qkv; }
+    inline bool RecomputeSoftmax() const { return _recompute_softmax; }
+    inline bool RecomputeFF1() const { return _recompute_ff1; }
+    inline bool UseSwiglu() const { return _swiglu; }
+
+    // Seed and offset of the attention dropout of the last Forward, for the Backward to replay.
+    inline std::pair<uint64_t, uint64_t> GetFlashSeed() const { return _flash_seed; }
+    inline void SetFlashSeed(std::pair<uint64_t, uint64_t> seed) { _flash_seed = seed; }
 
 private:
     void Initialize();
+    void QkvForward(unsigned bsz,
+                    const T* qkv_input_ptr,
+                    const T* attn_qkvw_ptr,
+                    const T* attn_qkvb_ptr,
+                    T* q_tf_ptr);
     size_t getWorkspaceSize(int maxBatchSize) const;
 
     // Params
@@ -171,11 +222,13 @@ private:
     FeedForward<T> _ff1, _ff2;
     Softmax<T> _softmax;
     Gelu<T> _gelu;
+    Swiglu<T> _swiglu_act;
     Dropout<T> _attn_prob_dropout;
     Dropout<T> _attn_output_dropout;
     Dropout<T> _layer_output_dropout;
     StridedBatchGemm<T> _attn_scores;
     StridedBatchGemm<T> _attn_context;
+    FlashAttention<T> _flash_attn;
 
     bool _training;
 
@@ -183,7 +236,21 @@ private:
     bool _attn_dropout_checkpoint;
     bool _normalize_invertible;
     bool _gelu_checkpoint;
+    bool _recompute_qkv;
+    bool _recompute_softmax;
+    bool _recompute_ff1;
 
     // High Performance flags
     bool _stochastic_mode;
+    bool _flash_attention;
+    bool _stateless_dropout;
+    bool _gemm_epilogues;
+    bool _swiglu;
+
+    std::pair<uint64_t, uint64_t> _flash_seed;
+
+    int _total_tokens;
+    const int* _token_index;
+    const int* _padded_index;
+    T* _packed_buf;
 };
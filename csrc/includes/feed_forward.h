@@ -100,9 +100,126 @@ public:
                        cublasGemmAlgo_t(config_.gemm_algos[2]));
 #endif
 
-        launch_fuse_transpose_bias_kernel<T>(out_grad, bias_grad, bsz, config_.outputSize, stream);
+        if (bias_grad)
+            launch_fuse_transpose_bias_kernel<T>(
+                out_grad, bias_grad, bsz, config_.outputSize, stream);
     }
 
+#ifdef CUBLASLT_EPILOGUE_AVAILABLE
+    // out = input x weights^T + bias in a single cublasLt GEMM.
+    void ForwardBias(int bsz,
+                     const T* input_ptr,
+                     const T* weights,
+                     const T* bias,
+                     T* out,
+                     cudaStream_t stream)
+    {
+        float alpha = 1.f, beta = 0.f;
+        TrainingContext& ctx = TrainingContext::Instance();
+        cublas_lt_gemm<T>(ctx.GetCublasLtHandle(),
+                          CUBLAS_OP_T,
+                          CUBLAS_OP_N,
+                          config_.outputSize,
+                          bsz,
+                          config_.inputSize,
+                          &alpha,
+                          &beta,
+                          weights,
+                          input_ptr,
+                          out,
+                          CUBLASLT_EPILOGUE_BIAS,
+                          const_cast<T*>(bias),
+                          nullptr,
+                          ctx.GetCublasLtWorkSpace(),
+                          TrainingContext::kCublasLtWorkspaceSize,
+                          stream);
+    }
+
+    // out = gelu(input x weights^T + bias) in a single cublasLt GEMM, gelu_inp keeps the
+    // pre-activation (bias included) that BackwardDGelu of the next layer reads.
+    void ForwardBiasGelu(int bsz,
+                         const T* input_ptr,
+                         const T* weights,
+                         const T* bias,
+                         T* out,
+                         T* gelu_inp,
+                         cudaStream_t stream)
+    {
+        float alpha = 1.f, beta = 0.f;
+        TrainingContext& ctx = TrainingContext::Instance();
+        cublas_lt_gemm<T>(ctx.GetCublasLtHandle(),
+                          CUBLAS_OP_T,
+                          CUBLAS_OP_N,
+                          config_.outputSize,
+                          bsz,
+                          config_.inputSize,
+                          &alpha,
+                          &beta,
+                          weights,
+                          input_ptr,
+                          out,
+                          CUBLASLT_EPILOGUE_GELU_AUX_BIAS,
+                          const_cast<T*>(bias),
+                          gelu_inp,
+                          ctx.GetCublasLtWorkSpace(),
+                          TrainingContext::kCublasLtWorkspaceSize,
+                          stream);
+    }
+
+    // Backward of a layer fed by ForwardBiasGelu: the bias gradient is reduced in the epilogue
+    // of the weight gradient GEMM, and the input gradient GEMM applies gelu'(gelu_inp) and
+    // reduces the result into gelu_bias_grad, the bias gradient of the producing layer.
+    void BackwardDGelu(int bsz,
+                       const T* out_grad,
+                       const T* input_ptr,
+                       const T* weights,
+                       T* weights_grad,
+                       T* bias_grad,
+                       const T* gelu_inp,
+                       T* gelu_bias_grad,
+                       cudaStream_t stream,
+                       T* inp_grad_out)
+    {
+        float alpha = 1.f, beta = 0.f;
+        TrainingContext& ctx = TrainingContext::Instance();
+        cublas_lt_gemm<T>(ctx.GetCublasLtHandle(),
+                          CUBLAS_OP_N,
+                          CUBLAS_OP_T,
+                          config_.inputSize,
+                          config_.outputSize,
+                          bsz,
+                          &alpha,
+                          &beta,
+                          input_ptr,
+                          out_grad,
+                          weights_grad,
+                          CUBLASLT_EPILOGUE_BGRADB,
+                          bias_grad,
+                          nullptr,
+                          ctx.GetCublasLtWorkSpace(),
+                          TrainingContext::kCublasLtWorkspaceSize,
+                          stream);
+
+        cublas_lt_gemm<T>(ctx.GetCublasLtHandle(),
+                          CUBLAS_OP_N,
+                          CUBLAS_OP_N,
+                          config_.inputSize,
+                          bsz,
+                          config_.outputSize,
+                          &alpha,
+                          &beta,
+                          weights,
+                          out_grad,
+                          inp_grad_out,
+                          CUBLASLT_EPILOGUE_DGELU_BGRAD,
+                          gelu_bias_grad,
+                          const_cast<T*>(gelu_inp),
+                          ctx.GetCublasLtWorkSpace(),
+                          TrainingContext::kCublasLtWorkspaceSize,
+                          stream);
+    }
+#endif
+
 private:
     Config config_;
 };
@@ -0,0 +1,101 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#pragma once
+
+#include <cuda.h>
+#include <cuda_fp16.h>
+#include <stdio.h>
+#include "custom_cuda_layers.h"
+
+template <typename T>
+class FlashAttention {
+public:
+    struct Config {
+        size_t heads;
+        size_t seq_length;
+        size_t head_size;
+        float scale;
+        Config(size_t h, size_t seq, size_t head_size)
+            : heads(h), seq_length(seq), head_size(head_size), scale(1.0 / sqrt(head_size))
+        {
+        }
+    };
+
+    FlashAttention(Config config) : config_(config) {}
+
+    ~FlashAttention() {}
+
+    void Forward(int bsz,
+                 T* out,
+                 float* lse,
+                 const T* q,
+                 const T* k,
+                 const T* v,
+                 const T* attn_mask,
+                 float dropout_ratio,
+                 std::pair<uint64_t, uint64_t> seed,
+                 cudaStream_t stream)
+    {
+        launch_attn_flash_forward<T>(out,
+                                     lse,
+                                     q,
+                                     k,
+                                     v,
+                                     attn_mask,
+                                     bsz,
+                                     config_.heads,
+                                     config_.seq_length,
+                                     config_.head_size,
+                                     config_.scale,
+                                     dropout_ratio,
+                                     seed,
+                                     stream);
+    }
+
+    void Backward(int bsz,
+                  T* d_q,
+                  T* d_k,
+                  T* d_v,
+                  float* delta,
+                  const T* d_out,
+                  const T* out,
+                  const float* lse,
+                  const T* q,
+                  const T* k,
+                  const T* v,
+                  const T* attn_mask,
+                  float dropout_ratio,
+                  std::pair<uint64_t, uint64_t> seed,
+                  cudaStream_t stream)
+    {
+        launch_attn_flash_backward<T>(d_q,
+                                      d_k,
+                                      d_v,
+                                      delta,
+                                      d_out,
+                                      out,
+                                      lse,
+                                      q,
+                                      k,
+                                      v,
+                                      attn_mask,
+                                      bsz,
+                                      config_.heads,
+                                      config_.seq_length,
+                                      config_.head_size,
+                                      config_.scale,
+                                      dropout_ratio,
+                                      seed,
+                                      stream);
+    }
+
+    inline size_t GetSeqLength() const { return config_.seq_length; }
+
+    inline void SetSeqLength(size_t seq_len) { config_.seq_length = seq_len; }
+
+private:
+    Config config_;
+};
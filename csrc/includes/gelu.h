@@ -31,6 +31,11 @@ public:
         launch_bias_gelu<T>(input_buf, bias, output, _config.intermediate_size, bsz, stream);
     }
 
+    void Forward(int bsz, const T* input_buf, T* output, cudaStream_t stream)
+    {
+        launch_gelu<T>(input_buf, output, _config.intermediate_size, bsz, stream);
+    }
+
     void Backward(int bsz, T* d_output, const T* input_buf, const T* bias, cudaStream_t stream)
     {
         launch_d_gelu<T>(d_output, input_buf, bias, _config.intermediate_size, bsz, stream);
@@ -39,3 +44,41 @@ public:
 private:
     Config _config;
 };
+
+// SwiGLU counterpart of Gelu for gated MLPs: the intermediate GEMM produces
+// 2 * intermediate_size channels, the second half gating the first one.
+template <typename T>
+class Swiglu {
+public:
+    struct Config {
+        uint32_t intermediate_size;
+        Config(uint32_t inter_size) : intermediate_size(inter_size) {}
+    };
+
+    Swiglu(const Config& config) : _config(config) {}
+
+    virtual ~Swiglu() {}
+
+    void ForwardWithBiasAdd(int bsz,
+                            const T* input_buf,
+                            const T* bias,
+                            T* output,
+                            cudaStream_t stream)
+    {
+        launch_bias_swiglu<T>(input_buf, bias, output, _config.intermediate_size, bsz, stream);
+    }
+
+    void Backward(int bsz,
+                  T* d_input,
+                  const T* d_output,
+                  const T* input_buf,
+                  const T* bias,
+                  cudaStream_t stream)
+    {
+        launch_d_swiglu<T>(
+            d_input, d_output, input_buf, bias, _config.intermediate_size, bsz, stream);
+    }
+
+private:
+    Config _config;
+};
@@ -0,0 +1,187 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#pragma once
+
+#include <cuda_runtime_api.h>
+#include <sys/stat.h>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+/*
+Winners of the GEMM algorithm searches, kept on disk so a shape is only timed once per GPU model.
+The cache is a text file of "<key> <algo>" lines, one file per device name and compute capability,
+in $DS_GEMM_ALGO_CACHE_DIR or else ~/.cache/deepspeed/gemm_algos. Lines are appended as shapes are
+tuned, a later line for the same key wins.
+
+The training kernels search through GemmTest when gemm_algos tuning is requested, the inference
+GEMMs time the candidates on their first call for a shape once SetTuning(true) was called, both
+look the shape up here first.
+*/
+class GemmAlgoCache {
+public:
+    static GemmAlgoCache& Instance()
+    {
+        static GemmAlgoCache _ctx;
+        return _ctx;
+    }
+
+    static std::string Key(const char* kind,
+                           int batch,
+                           int m,
+                           int n,
+                           int k,
+                           int transa,
+                           int transb,
+                           int elem_size)
+    {
+        std::ostringstream key;
+        key << kind << "_b" << batch << "_m" << m << "_n" << n << "_k" << k << "_t" << transa
+            << transb << "_e" << elem_size;
+        return key.str();
+    }
+
+    bool Lookup(const std::string& key, int* algo)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Load();
+        auto it = _algos.find(key);
+        if (it == _algos.end()) return false;
+        *algo = it->second;
+        return true;
+    }
+
+    void Store(const std::string& key, int algo)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Load();
+        _algos[key] = algo;
+        if (_path.empty()) return;
+        // A single short append, so processes tuning at the same time do not mix their lines.
+        std::ofstream file(_path, std::ios::app);
+        if (file) file << key << " " << algo << "\n";
+    }
+
+    void SetTuning(bool tuning) { _tuning = tuning; }
+    bool Tuning() const { return _tuning; }
+
+    /*
+    Fastest of the algorithms [first_algo, last_algo] for key, timed with gemm(algo) on stream
+    unless cached. Returns default_algo when tuning is off and the key is missing, or while the
+    stream is captured into a CUDA graph, where nothing can be timed.
+    */
+    template <typename Func>
+    int Select(const std::string& key,
+               int default_algo,
+               int first_algo,
+               int last_algo,
+               cudaStream_t stream,
+               Func gemm)
+    {
+        int algo;
+        if (Lookup(key, &algo)) return algo;
+        if (!_tuning) return default_algo;
+        cudaStreamCaptureStatus capture;
+        if (cudaStreamIsCapturing(stream, &capture) != cudaSuccess ||
+            capture != cudaStreamCaptureStatusNone)
+            return default_algo;
+
+        constexpr int warm_up = 3;
+        constexpr int loops = 10;
+        cudaEvent_t start, stop;
+        cudaEventCreate(&start);
+        cudaEventCreate(&stop);
+        float fast_latency = (std::numeric_limits<float>::max)();
+        int fast_algo = default_algo;
+        for (algo = first_algo; algo <= last_algo; algo++) {
+            // Algorithms that do not support the shape fail, skip them.
+            if (!gemm(algo)) continue;
+            for (int i = 1; i < warm_up; i++) gemm(algo);
+            cudaEventRecord(start, stream);
+            for (int i = 0; i < loops; i++) gemm(algo);
+            cudaEventRecord(stop, stream);
+            cudaEventSynchronize(stop);
+            float latency;
+            cudaEventElapsedTime(&latency, start, stop);
+            if (latency < fast_latency) {
+                fast_latency = latency;
+                fast_algo = algo;
+            }
+        }
+        cudaEventDestroy(start);
+        cudaEventDestroy(stop);
+        Store(key, fast_algo);
+        return fast_algo;
+    }
+
+private:
+    GemmAlgoCache() : _loaded(false), _tuning(false) {}
+
+    void Load()
+    {
+        if (_loaded) return;
+        _loaded = true;
+        _path = CachePath();
+        if (_path.empty()) return;
+        std::ifstream file(_path);
+        std::string key;
+        int algo;
+        while (file >> key >> algo) _algos[key] = algo;
+    }
+
+    static void MakeDir(const std::string& dir)
+    {
+#ifdef _WIN32
+        _mkdir(dir.c_str());
+#else
+        mkdir(dir.c_str(), 0755);
+#endif
+    }
+
+    static std::string CachePath()
+    {
+        std::string dir;
+        if (const char* env = std::getenv("DS_GEMM_ALGO_CACHE_DIR")) {
+            dir = env;
+        } else {
+            const char* home = std::getenv("HOME");
+            if (!home) home = std::getenv("USERPROFILE");
+            if (!home) return "";
+            dir = std::string(home) + "/.cache";
+            MakeDir(dir);
+            dir += "/deepspeed";
+            MakeDir(dir);
+            dir += "/gemm_algos";
+        }
+        MakeDir(dir);
+
+        int device;
+        cudaDeviceProp prop;
+        if (cudaGetDevice(&device) != cudaSuccess ||
+            cudaGetDeviceProperties(&prop, device) != cudaSuccess)
+            return "";
+        std::string name(prop.name);
+        for (char& c : name)
+            if (!isalnum((unsigned char)c)) c = '_';
+        return dir + "/" + name + "_sm" + std::to_string(prop.major) + std::to_string(prop.minor) +
+               ".txt";
+    }
+
+    std::mutex _mutex;
+    std::unordered_map<std::string, int> _algos;
+    std::string _path;
+    bool _loaded;
+    bool _tuning;
+};
@@ -17,6 +17,7 @@
 #include <memory>
 #include "StopWatch.h"
 #include "cublas_wrappers.h"
+#include "gemm_algo_cache.h"
 
 template <typename T>
 void check(T result, char const* const func, const char* const file, int const line)
@@ -52,7 +53,7 @@ public:
         float alpha = (T)1.0f;
         float beta = (T)0.0f;
 
-        int algo_fw = Run(loops, [=](int algo) {
+        int algo_fw = Run(Key("gemm_fw"), loops, [=](int algo) {
             cublas_gemm_ex(handle,
                            CUBLAS_OP_T,
                            CUBLAS_OP_N,
@@ -71,7 +72,7 @@ public:
 #endif
         });
 
-        int algo_bw1 = Run(loops, [=](int algo) {
+        int algo_bw1 = Run(Key("gemm_bw1"), loops, [=](int algo) {
             cublas_gemm_ex(handle,
                            CUBLAS_OP_N,
                            CUBLAS_OP_T,
@@ -90,7 +91,7 @@ public:
 #endif
         });
 
-        int algo_bw2 = Run(loops, [=](int algo) {
+        int algo_bw2 = Run(Key("gemm_bw2"), loops, [=](int algo) {
             cublas_gemm_ex(handle,
                            CUBLAS_OP_N,
                            CUBLAS_OP_N,
@@ -113,10 +114,12 @@ public:
     }
 
     template <typename Func>
-    int Run(int loops, Func f)
+    int Run(const std::string& key, int loops, Func f)
     {
-        float fast_latency = (std::numeric_limits<float>::max)();
         int fast_algo = 0;
+        // Shapes searched by an earlier run are not timed again.
+        if (GemmAlgoCache::Instance().Lookup(key, &fast_algo)) return fast_algo;
+        float fast_latency = (std::numeric_limits<float>::max)();
 
 #ifdef __HIP_PLATFORM_HCC__
         for (int algo = (int)rocblas_gemm_algo_standard; algo <= (int)rocblas_gemm_algo_standard;
@@ -149,10 +152,16 @@ public:
 
         printf("fast_algo %d: %.3f ms\n", fast_algo, fast_latency);
 
+        GemmAlgoCache::Instance().Store(key, fast_algo);
         return fast_algo;
     }
 
 private:
+    std::string Key(const char* kind) const
+    {
+        return GemmAlgoCache::Key(kind, 1, M, N, K, transa, transb, sizeof(T));
+    }
+
     int M, N, K;
     cublasHandle_t handle;
     cublasOperation_t transa, transb;
@@ -188,7 +197,7 @@ public:
         float alpha = (T)1.0f;
         float beta = (T)0.0f;
 
-        int algo_fw = Run(loops, [=](int algo) {
+        int algo_fw = Run(Key("strided_fw"), loops, [=](int algo) {
             int stride_a = M * K;
             int stride_b = N * K;
             int stride_c = M * N;
@@ -215,7 +224,7 @@ public:
 #endif
         });
 
-        int algo_bw1 = Run(loops, [=](int algo) {
+        int algo_bw1 = Run(Key("strided_bw1"), loops, [=](int algo) {
             int mb = (transa == CUBLAS_OP_T ? K : M);
             int kb = (transa == CUBLAS_OP_T ? M : K);
 
@@ -249,7 +258,7 @@ public:
 #endif
         });
 
-        int algo_bw2 = Run(loops, [=](int algo) {
+        int algo_bw2 = Run(Key("strided_bw2"), loops, [=](int algo) {
             // A need to transpose.
             cublasOperation_t op_a = (transa == CUBLAS_OP_T ? CUBLAS_OP_N : CUBLAS_OP_T);
 
@@ -284,10 +293,12 @@ public:
     }
 
     template <typename Func>
-    int Run(int loops, Func f)
+    int Run(const std::string& key, int loops, Func f)
     {
-        float fast_latency = (std::numeric_limits<float>::max)();
         int fast_algo = 0;
+        // Shapes searched by an earlier run are not timed again.
+        if (GemmAlgoCache::Instance().Lookup(key, &fast_algo)) return fast_algo;
+        float fast_latency = (std::numeric_limits<float>::max)();
 
 #ifdef __HIP_PLATFORM_HCC__
         for (int algo = (int)rocblas_gemm_algo_standard; algo <= (int)rocblas_gemm_algo_standard;
@@ -320,10 +331,16 @@ public:
 
         printf("fast_algo %d: %.3f ms\n", fast_algo, fast_latency);
 
+        GemmAlgoCache::Instance().Store(key, fast_algo);
         return fast_algo;
     }
 
 private:
+    std::string Key(const char* kind) const
+    {
+        return GemmAlgoCache::Key(kind, bsz, M, N, K, transa, transb, sizeof(T));
+    }
+
     int bsz, M, N, K;
     cublasHandle_t handle;
     cublasOperation_t transa, transb;
@@ -54,3 +54,13 @@ void launch_fused_add3(T* out,
                        int seq_length,
                        int hidden_size,
                        cudaStream_t& stream);
+
+// out[r] = in[index[r]] for rows of width elements, a row with a negative index is zeroed. Moves
+// tokens between the packed layout of unpadded sequences and the padded [batch, seq] one.
+template <typename T>
+void launch_gather_tokens(T* out,
+                          const T* in,
+                          const int* index,
+                          int rows,
+                          int width,
+                          cudaStream_t stream);
@@ -23,18 +23,21 @@ public:
         float epsilon;
         bool training;
         bool useMean;
+        bool rms;
         Config(uint32_t batch,
                uint32_t seq,
                uint32_t h,
                float epsilon = 1e-12,
                bool training = true,
-               bool useMean = true)
+               bool useMean = true,
+               bool rms = false)
             : batchSize(batch),
               seqLength(seq),
               hiddenDim(h),
               epsilon(epsilon),
               training(training),
-              useMean(useMean)
+              useMean(useMean),
+              rms(rms)
         {
         }
     };
@@ -54,18 +57,29 @@ public:
                            cudaStream_t& stream,
                            bool preLayerNorm = false)
     {
-        launch_bias_residual_layer_norm(vals,
-                                        residual,
-                                        gamma,
-                                        betta,
-                                        config_.epsilon,
-                                        bsz,
-                                        config_.hiddenDim,
-                                        stream,
-                                        preLayerNorm,
-                                        config_.training,
-                                        vars,
-                                        means);
+        if (config_.rms)
+            launch_rms_norm(vals,
+                            residual,
+                            gamma,
+                            config_.epsilon,
+                            bsz,
+                            config_.hiddenDim,
+                            stream,
+                            config_.training,
+                            vars);
+        else
+            launch_bias_residual_layer_norm(vals,
+                                            residual,
+                                            gamma,
+                                            betta,
+                                            config_.epsilon,
+                                            bsz,
+                                            config_.hiddenDim,
+                                            stream,
+                                            preLayerNorm,
+                                            config_.training,
+                                            vars,
+                                            means);
     }
 
     void Forward(int bsz,
@@ -76,17 +90,28 @@ public:
                  cudaStream_t& stream,
                  bool preLayerNorm = false)
     {
-        launch_bias_residual_layer_norm(vals,
-                                        residual,
-                                        gamma,
-                                        betta,
-                                        config_.epsilon,
-                                        bsz,
-                                        config_.hiddenDim,
-                                        stream,
-                                        preLayerNorm,
-                                        config_.training,
-                                        vars);
+        if (config_.rms)
+            launch_rms_norm(vals,
+                            residual,
+                            gamma,
+                            config_.epsilon,
+                            bsz,
+                            config_.hiddenDim,
+                            stream,
+                            config_.training,
+                            vars);
+        else
+            launch_bias_residual_layer_norm(vals,
+                                            residual,
+                                            gamma,
+                                            betta,
+                                            config_.epsilon,
+                                            bsz,
+                                            config_.hiddenDim,
+                                            stream,
+                                            preLayerNorm,
+                                            config_.training,
+                                            vars);
     }
 
     void Backward(int bsz,
@@ -98,6 +123,24 @@ public:
                   T* inp_grad_out,
                   const T* norm_in = nullptr)
     {
+        if (UseFused()) {
+            launch_norm_backward_fused(out_grad,
+                                       (const T*)nullptr,
+                                       norm_in,
+                                       vars,
+                                       means,
+                                       gamma,
+                                       (const T*)nullptr,
+                                       gamma_grad,
+                                       betta_grad,
+                                       inp_grad_out,
+                                       bsz,
+                                       config_.hiddenDim,
+                                       false,
+                                       config_.rms,
+                                       stream[0]);
+            return;
+        }
         launch_layerNorm_backward(out_grad,
                                   norm_in,
                                   vars,
@@ -121,6 +164,24 @@ public:
                   T* inp_grad_out,
                   const T* norm_out)
     {
+        if (UseFused()) {
+            launch_norm_backward_fused(out_grad,
+                                       (const T*)nullptr,
+                                       norm_out,
+                                       vars,
+                                       (const T*)nullptr,
+                                       gamma,
+                                       betta,
+                                       gamma_grad,
+                                       betta_grad,
+                                       inp_grad_out,
+                                       bsz,
+                                       config_.hiddenDim,
+                                       !config_.useMean,
+                                       config_.rms,
+                                       stream[0]);
+            return;
+        }
         launch_layerNorm_backward(out_grad,
                                   norm_out,
                                   vars,
@@ -145,6 +206,24 @@ public:
                           T* inp_grad_out,
                           const T* norm_in = nullptr)
     {
+        if (UseFused()) {
+            launch_norm_backward_fused(out_grad1,
+                                       out_grad2,
+                                       norm_in,
+                                       vars,
+                                       means,
+                                       gamma,
+                                       (const T*)nullptr,
+                                       gamma_grad,
+                                       betta_grad,
+                                       inp_grad_out,
+                                       bsz,
+                                       config_.hiddenDim,
+                                       false,
+                                       config_.rms,
+                                       stream[0]);
+            return;
+        }
         launch_layerNorm_backward_fused_add(out_grad1,
                                             out_grad2,
                                             norm_in,
@@ -170,6 +249,24 @@ public:
                           T* inp_grad_out,
                           const T* norm_out)
     {
+        if (UseFused()) {
+            launch_norm_backward_fused(out_grad1,
+                                       out_grad2,
+                                       norm_out,
+                                       vars,
+                                       (const T*)nullptr,
+                                       gamma,
+                                       betta,
+                                       gamma_grad,
+                                       betta_grad,
+                                       inp_grad_out,
+                                       bsz,
+                                       config_.hiddenDim,
+                                       !config_.useMean,
+                                       config_.rms,
+                                       stream[0]);
+            return;
+        }
         launch_layerNorm_backward_fused_add(out_grad1,
                                             out_grad2,
                                             norm_out,
@@ -187,6 +284,13 @@ public:
 
     inline bool UseMean() const { return config_.useMean; }
 
+    // The single-pass backward covers rows of up to NORM_FUSED_MAX_WIDTH elements and is the
+    // only one RMSNorm has.
+    inline bool UseFused() const
+    {
+        return config_.rms || config_.hiddenDim <= NORM_FUSED_MAX_WIDTH;
+    }
+
     inline void SetVar(T* variance)
     {
         if (!variance) { throw std::runtime_error("Normalize variance is null."); }
@@ -10,7 +10,12 @@
 
 namespace quantize {
 
-enum class Type { Symmetric, Asymmetric };
+/*
+Symmetric and Asymmetric are integer formats of 4 or 8 bits. FP8_E4M3 and FP8_E5M2 store each
+element as an fp8 value (and need FP8_AVAILABLE), NF4 as the 4 bit index of the nearest
+normal-float code. All three scale each group by its absolute maximum.
+*/
+enum class Type { Symmetric, Asymmetric, FP8_E4M3, FP8_E5M2, NF4 };
 
 struct PackedInt4 {
     int8_t high : 4;
@@ -19,6 +24,14 @@ struct PackedInt4 {
 
 DS_HD_INLINE bool requires_offset(Type qType) { return qType == Type::Asymmetric; }
 
+// The fp8 and NF4 formats have a fixed width, the integer formats use the requested one.
+DS_HD_INLINE int bits_per_element(Type qType, int num_bits)
+{
+    if (qType == Type::FP8_E4M3 || qType == Type::FP8_E5M2) return 8;
+    if (qType == Type::NF4) return 4;
+    return num_bits;
+}
+
 }  // namespace quantize
 
 void launch_quant(int8_t* output_data,
@@ -64,3 +77,38 @@ void launch_sr_fake_quantize_kernel_asym(T* vals,
                                          int group_num,
                                          int num_bits,
                                          cudaStream_t stream);
+
+void launch_swizzled_quant(int8_t* q_data,
+                           float* q_params,
+                           const __half* input_data,
+                           int num_bits,
+                           quantize::Type q_type,
+                           int groups,
+                           int elems_per_group,
+                           int pipelining,
+                           int nodes,
+                           int devices_per_node,
+                           cudaStream_t stream);
+
+void launch_dequant_reduce(int8_t* reduced_data,
+                           float* reduced_params,
+                           const int8_t* input_data,
+                           const float* input_params,
+                           int num_bits,
+                           quantize::Type q_type,
+                           int out_groups,
+                           int elems_per_group,
+                           int num_tensors,
+                           cudaStream_t stream);
+
+void launch_swizzled_dequant(__half* dequant_data,
+                             const int8_t* q_data,
+                             const float* q_params,
+                             int num_bits,
+                             quantize::Type q_type,
+                             int groups,
+                             int elems_per_group,
+                             int pipelining,
+                             int nodes,
+                             int devices_per_node,
+                             cudaStream_t stream);
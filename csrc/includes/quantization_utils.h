@@ -141,6 +141,128 @@ public:
     }
 };
 
+#ifdef FP8_AVAILABLE
+/*
+fp8 quantization scales the group so its absolute maximum maps to the largest finite value of the
+format and stores the fp8 bits as int8. FP8 is __nv_fp8_e4m3 or __nv_fp8_e5m2.
+*/
+template <typename FP8>
+class FP8Params {
+public:
+    float scale;
+
+    DS_D_INLINE FP8Params(float max)
+    {
+        constexpr float fp8_max = std::is_same<FP8, __nv_fp8_e4m3>::value ? 448.f : 57344.f;
+        if (max == 0) {
+            scale = 1.0;
+        } else {
+            scale = fp8_max / max;
+        }
+    }
+
+    DS_D_INLINE int8_t quantize(__half val)
+    {
+        const FP8 data_fp8 = conversion::to<FP8>(conversion::to<float>(val) * scale);
+        return *reinterpret_cast<const int8_t*>(&data_fp8);
+    }
+
+    template <typename T>
+    DS_D_INLINE T dequantize(int8_t val)
+    {
+        const float val_deq_f = conversion::to<float>(*reinterpret_cast<const FP8*>(&val)) * scale;
+        return conversion::to<T>(val_deq_f);
+    }
+
+    DS_D_INLINE void store(float* params, int group_index)
+    {
+        const float store_scale = 1 / scale;
+        mem_access::store_global<sizeof(float)>(params + group_index, &store_scale);
+    }
+
+    DS_D_INLINE FP8Params(const float* params, int group_index)
+    {
+        mem_access::load_global<sizeof(float)>(&scale, params + group_index);
+    }
+};
+
+template <int numBits>
+class Params<Type::FP8_E4M3, numBits> : public FP8Params<__nv_fp8_e4m3> {
+public:
+    using FP8Params<__nv_fp8_e4m3>::FP8Params;
+};
+
+template <int numBits>
+class Params<Type::FP8_E5M2, numBits> : public FP8Params<__nv_fp8_e5m2> {
+public:
+    using FP8Params<__nv_fp8_e5m2>::FP8Params;
+};
+#endif
+
+// The 16 NF4 values, quantiles of N(0, 1) normalized to [-1, 1] with an exact zero (QLoRA).
+static __constant__ float nf4_code[16] = {-1.0f,
+                                          -0.6961928009986877f,
+                                          -0.5250730514526367f,
+                                          -0.39491748809814453f,
+                                          -0.28444138169288635f,
+                                          -0.18477343022823334f,
+                                          -0.09105003625154495f,
+                                          0.0f,
+                                          0.07958029955625534f,
+                                          0.16093020141124725f,
+                                          0.24611230194568634f,
+                                          0.33791524171829224f,
+                                          0.44070982933044434f,
+                                          0.5626170039176941f,
+                                          0.7229568362236023f,
+                                          1.0f};
+
+/*
+NF4 quantization normalizes the group by its absolute maximum and keeps the index of the nearest
+code. The index is stored offset by -8 so it packs into the signed PackedInt4 fields.
+*/
+template <int numBits>
+class Params<Type::NF4, numBits> {
+public:
+    float scale;
+
+    DS_D_INLINE Params(float max)
+    {
+        if (max == 0) {
+            scale = 1.0;
+        } else {
+            scale = 1 / max;
+        }
+    }
+
+    DS_D_INLINE int8_t quantize(__half val)
+    {
+        const float val_f = conversion::to<float>(val) * scale;
+        int32_t index = 0;
+#pragma unroll
+        for (int i = 0; i < 15; i++) index += val_f > 0.5f * (nf4_code[i] + nf4_code[i + 1]);
+        return (int8_t)(index - 8);
+    }
+
+    template <typename T>
+    DS_D_INLINE T dequantize(int8_t val)
+    {
+        const float val_deq_f = nf4_code[val + 8] * scale;
+        return conversion::to<T>(val_deq_f);
+    }
+
+    DS_D_INLINE void store(float* params, int group_index)
+    {
+        const float store_scale = 1 / scale;
+        mem_access::store_global<sizeof(float)>(params + group_index, &store_scale);
+    }
+
+    DS_D_INLINE Params(const float* params, int group_index)
+    {
+        mem_access::load_global<sizeof(float)>(&scale, params + group_index);
+    }
+};
+
 /*
 Group stats tracks the necessary statistics about the quantized group
 to abstract the particulars for the main loop.
@@ -255,6 +377,46 @@ public:
     }
 };
 
+/*
+The fp8 and NF4 formats only need the absolute maximum of the group, like Symmetric.
+*/
+template <Type qType>
+class AbsMaxGroupStats {
+public:
+    __half2 cur_max;
+
+    DS_D_INLINE AbsMaxGroupStats() { cur_max = reduce::init<rop::Max, __half2>(); }
+
+    DS_D_INLINE void update(__half2 val)
+    {
+        cur_max = reduce::element<rop::Max>(cur_max, __habs2(val));
+    }
+
+    template <int numBits, int threads_per_group>
+    DS_D_INLINE Params<qType, numBits> get_params(cg::thread_block& tb,
+                                                  cg::thread_block_tile<hw_warp_size>& warp)
+    {
+        const float2 partial_max = conversion::to<float2>(cur_max);
+        float max = reduce::element<rop::Max>(partial_max.x, partial_max.y);
+
+        reduce::partitioned_block<rop::Max, threads_per_group>(tb, warp, max);
+        Params<qType, numBits> params(max);
+
+        return params;
+    }
+};
+
+#ifdef FP8_AVAILABLE
+template <>
+class GroupStats<Type::FP8_E4M3> : public AbsMaxGroupStats<Type::FP8_E4M3> {};
+
+template <>
+class GroupStats<Type::FP8_E5M2> : public AbsMaxGroupStats<Type::FP8_E5M2> {};
+#endif
+
+template <>
+class GroupStats<Type::NF4> : public AbsMaxGroupStats<Type::NF4> {};
+
 /*
 Device function that quantizes 16 bytes of __half type input data.
 Template Arguments :
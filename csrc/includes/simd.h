@@ -10,13 +10,142 @@
 #include <x86intrin.h>
 #endif
 
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
 #define TILE (128 * 1024 * 1024)
+
+// Storage type of a param, gradient or param copy buffer handed to the kernels. The kernels
+// always compute in fp32, 16-bit operands are converted on the fly in the same pass.
+// The ISA independent helpers below are static, so the copies compiled into the per-ISA kernel
+// translation units of a dispatch build are never merged with the baseline ones at link time.
+enum ds_dtype_t { DS_DTYPE_FP32 = 0, DS_DTYPE_FP16, DS_DTYPE_BF16 };
+
+static inline bool ds_dtype_is_16bit(const ds_dtype_t dtype) { return dtype != DS_DTYPE_FP32; }
+
+// Offsets a buffer passed around as float* by num_elems elements of its storage type.
+static inline float* ds_dtype_offset(float* ptr, const size_t num_elems, const ds_dtype_t dtype)
+{
+    return ds_dtype_is_16bit(dtype) ? reinterpret_cast<float*>(
+                                          reinterpret_cast<uint16_t*>(ptr) + num_elems)
+                                    : ptr + num_elems;
+}
+
+static inline float ds_bf16_to_float(const uint16_t value)
+{
+    const uint32_t bits = static_cast<uint32_t>(value) << 16;
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+// Round to nearest even, NaNs stay (quiet) NaNs.
+static inline uint16_t ds_float_to_bf16(const float value)
+{
+    if (std::isnan(value)) { return 0x7fc0; }
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return static_cast<uint16_t>(bits >> 16);
+}
+
+// Scalar access to element k of a buffer of any ds_dtype_t, half_t is the op's fp16 type.
+template <typename half_t>
+static inline float ds_load_elem(const float* buffer, const size_t k, const ds_dtype_t dtype)
+{
+    if (dtype == DS_DTYPE_FP16) return (float)reinterpret_cast<const half_t*>(buffer)[k];
+    if (dtype == DS_DTYPE_BF16) {
+        return ds_bf16_to_float(reinterpret_cast<const uint16_t*>(buffer)[k]);
+    }
+    return buffer[k];
+}
+
+template <typename half_t>
+static inline void ds_store_elem(float* buffer,
+                                 const size_t k,
+                                 const float value,
+                                 const ds_dtype_t dtype)
+{
+    if (dtype == DS_DTYPE_FP16)
+        reinterpret_cast<half_t*>(buffer)[k] = (half_t)value;
+    else if (dtype == DS_DTYPE_BF16)
+        reinterpret_cast<uint16_t*>(buffer)[k] = ds_float_to_bf16(value);
+    else
+        buffer[k] = value;
+}
+
+#define DS_SIMD_ISA_SCALAR 0
+#define DS_SIMD_ISA_AVX256 256
+#define DS_SIMD_ISA_AVX512 512
+
+// ISA of the kernels compiled in this translation unit.
+#if defined(__AVX512__)
+#define DS_SIMD_ISA DS_SIMD_ISA_AVX512
+#define DS_SIMD_NAMESPACE ds_simd_avx512
+#elif defined(__AVX256__)
+#define DS_SIMD_ISA DS_SIMD_ISA_AVX256
+#define DS_SIMD_NAMESPACE ds_simd_avx256
+#else
+#define DS_SIMD_ISA DS_SIMD_ISA_SCALAR
+#endif
+
+// With __DS_SIMD_DISPATCH__ the op is built for the baseline ISA, the kernels are compiled once per
+// ISA in their own translation units, and the best one for the host is picked at runtime. This
+// keeps a prebuilt op (or a shared JIT cache) valid on every x86 host it is loaded on.
+#if defined(__DS_SIMD_DISPATCH__)
+static inline int ds_simd_runtime_isa()
+{
+    static const int isa = __builtin_cpu_supports("avx512f")
+                               ? DS_SIMD_ISA_AVX512
+                               : ((__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+                                      ? DS_SIMD_ISA_AVX256
+                                      : DS_SIMD_ISA_SCALAR);
+    return isa;
+}
+#endif
+
+static inline int ds_simd_active_isa()
+{
+#if defined(__DS_SIMD_DISPATCH__)
+    return ds_simd_runtime_isa();
+#else
+    return DS_SIMD_ISA;
+#endif
+}
+
+static inline const char* ds_simd_isa_name(const int isa)
+{
+    if (isa == DS_SIMD_ISA_AVX512) return "AVX512";
+    if (isa == DS_SIMD_ISA_AVX256) return "AVX2";
+    return "scalar";
+}
+
+// Elements per iteration of a `span` register loop of an ISA, the scalar loops update one.
+static inline size_t ds_simd_step_vector(const int isa, const int span)
+{
+    if (isa == DS_SIMD_ISA_AVX512) return 16 * span;
+    if (isa == DS_SIMD_ISA_AVX256) return 8 * span;
+    return 1;
+}
+
+// Elements per tile of an optimizer step over `vector` wide iterations. A step that also copies
+// the params to the device paces the copy with whole vector tiles of `copy_tile`, any other step
+// uses TILE. The first touch of the optimizer state splits it with the same tiles.
+static inline size_t ds_step_tile(const bool copy, const size_t copy_tile, const size_t vector)
+{
+    if (!copy) return TILE;
+    return copy_tile >= vector ? copy_tile / vector * vector : vector;
+}
+
 #if defined(__AVX512__) or defined(__AVX256__)
 
 #define ROUND_DOWN(size, step) ((size) & ~((step)-1))
 
 #if defined(__AVX512__)
 #define SIMD_STORE(a, d) _mm512_storeu_ps(a, d)
+// Non-temporal, `a` must be aligned to the vector width
+#define SIMD_STREAM(a, d) _mm512_stream_ps(a, d)
 #define SIMD_LOAD(x) _mm512_loadu_ps(x)
 #define SIMD_SET(x) _mm512_set1_ps(x)
 #define SIMD_ADD(x, y) _mm512_add_ps(x, y)
@@ -32,9 +161,14 @@
     ((h) ? _mm256_store_ps(x, _mm256_castsi256_ps(_mm512_cvtps_ph(d, _MM_FROUND_TO_NEAREST_INT))) \
          : _mm512_storeu_ps(x, d))
 
+#define SIMD_LOAD_BF16(x) \
+    _mm512_castsi512_ps(  \
+        _mm512_slli_epi32(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(x))), 16))
+
 #define INTV __m256i
 #elif defined(__AVX256__)
 #define SIMD_STORE(a, d) _mm256_storeu_ps(a, d)
+#define SIMD_STREAM(a, d) _mm256_stream_ps(a, d)
 #define SIMD_LOAD(x) _mm256_loadu_ps(x)
 #define SIMD_SET(x) _mm256_set1_ps(x)
 #define SIMD_ADD(x, y) _mm256_add_ps(x, y)
@@ -50,9 +184,17 @@
     ((h) ? _mm_store_ps(x, _mm_castsi128_ps(_mm256_cvtps_ph(d, _MM_FROUND_TO_NEAREST_INT))) \
          : _mm256_storeu_ps(x, d))
 
+#define SIMD_LOAD_BF16(x) \
+    _mm256_castsi256_ps(  \
+        _mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(x))), 16))
+
 #define INTV __m128i
 #endif
 
+// The SIMD types and helpers differ per ISA, a separate namespace keeps the per-ISA kernel
+// translation units of a dispatch build from colliding at link time.
+inline namespace DS_SIMD_NAMESPACE {
+
 union AVX_Data {
 #if defined(__AVX512__)
     __m512 data;
@@ -62,19 +204,67 @@ union AVX_Data {
     // float data_f[16];
 };
 
+// Rounds to nearest even like ds_float_to_bf16. With AVX512-BF16 this is a single vcvtneps2bf16,
+// which also flushes fp32 denormals to zero.
+inline void simd_store_bf16(float* dst, const AVX_Data& src)
+{
+#if defined(__AVX512__) && defined(__AVX512BF16__)
+    _mm256_storeu_si256((__m256i*)dst, (__m256i)_mm512_cvtneps_pbh(src.data));
+#elif defined(__AVX512__)
+    const __m512i bits = _mm512_castps_si512(src.data);
+    const __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(1));
+    __m512i rounded = _mm512_srli_epi32(
+        _mm512_add_epi32(bits, _mm512_add_epi32(lsb, _mm512_set1_epi32(0x7fff))), 16);
+    const __mmask16 nan_mask = _mm512_cmp_ps_mask(src.data, src.data, _CMP_UNORD_Q);
+    rounded = _mm512_mask_blend_epi32(nan_mask, rounded, _mm512_set1_epi32(0x7fc0));
+    _mm256_storeu_si256((__m256i*)dst, _mm512_cvtepi32_epi16(rounded));
+#elif defined(__AVX256__)
+    const __m256i bits = _mm256_castps_si256(src.data);
+    const __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1));
+    __m256i rounded = _mm256_srli_epi32(
+        _mm256_add_epi32(bits, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7fff))), 16);
+    const __m256i nan_mask = _mm256_castps_si256(_mm256_cmp_ps(src.data, src.data, _CMP_UNORD_Q));
+    rounded = _mm256_blendv_epi8(rounded, _mm256_set1_epi32(0x7fc0), nan_mask);
+    // packus interleaves the two 128-bit lanes, gather both halves into the low lane.
+    const __m256i packed =
+        _mm256_permute4x64_epi64(_mm256_packus_epi32(rounded, rounded), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(packed));
+#endif
+}
+
+template <int span>
+inline void simd_store(float* dst, AVX_Data* src, ds_dtype_t dtype)
+{
+    size_t width = (ds_dtype_is_16bit(dtype) ? SIMD_WIDTH / 2 : SIMD_WIDTH);
+#pragma unroll
+    for (size_t i = 0; i < span; ++i) {
+        if (dtype == DS_DTYPE_BF16) {
+            simd_store_bf16(dst + width * i, src[i]);
+        } else {
+            SIMD_STORE2(dst + width * i, src[i].data, dtype == DS_DTYPE_FP16);
+        }
+    }
+}
 template <int span>
 inline void simd_store(float* dst, AVX_Data* src, bool half_precision)
 {
-    size_t width = (half_precision ? SIMD_WIDTH / 2 : SIMD_WIDTH);
+    simd_store<span>(dst, src, half_precision ? DS_DTYPE_FP16 : DS_DTYPE_FP32);
+}
+template <int span>
+inline void simd_load(AVX_Data* dst, float* src, ds_dtype_t dtype)
+{
+    size_t width = (ds_dtype_is_16bit(dtype) ? SIMD_WIDTH / 2 : SIMD_WIDTH);
 #pragma unroll
-    for (size_t i = 0; i < span; ++i) { SIMD_STORE2(dst + width * i, src[i].data, half_precision); }
+    for (size_t i = 0; i < span; ++i) {
+        dst[i].data = (dtype == DS_DTYPE_BF16)
+                          ? SIMD_LOAD_BF16(src + width * i)
+                          : SIMD_LOAD2(src + width * i, dtype == DS_DTYPE_FP16);
+    }
 }
 template <int span>
 inline void simd_load(AVX_Data* dst, float* src, bool half_precision)
 {
-    size_t width = (half_precision ? 1 : SIMD_WIDTH);
-#pragma unroll
-    for (size_t i = 0; i < span; ++i) { dst[i].data = SIMD_LOAD2(src + width * i, half_precision); }
+    simd_load<span>(dst, src, half_precision ? DS_DTYPE_FP16 : DS_DTYPE_FP32);
 }
 template <int span>
 inline void simd_fma(AVX_Data* dst, AVX_Data* src_m_l, AVX_Data src_m_r, AVX_Data* src_a)
@@ -137,4 +327,44 @@ inline void simd_div(AVX_Data* dst, AVX_Data* src_a_l, AVX_Data* src_a_r)
     for (size_t i = 0; i < span; ++i) { dst[i].data = SIMD_DIV(src_a_l[i].data, src_a_r[i].data); }
 }
 
+template <int span>
+inline void simd_sign(AVX_Data* dst, AVX_Data* src)
+{
+    // -1, 0 or 1 like torch.sign.
+#if defined(__AVX512__)
+    const __m512 zero = _mm512_setzero_ps();
+#pragma unroll
+    for (size_t i = 0; i < span; ++i) {
+        const __mmask16 pos = _mm512_cmp_ps_mask(src[i].data, zero, _CMP_GT_OQ);
+        const __mmask16 neg = _mm512_cmp_ps_mask(src[i].data, zero, _CMP_LT_OQ);
+        dst[i].data = _mm512_mask_blend_ps(
+            neg, _mm512_maskz_mov_ps(pos, _mm512_set1_ps(1.0f)), _mm512_set1_ps(-1.0f));
+    }
+#elif defined(__AVX256__)
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+#pragma unroll
+    for (size_t i = 0; i < span; ++i) {
+        const __m256 pos = _mm256_and_ps(_mm256_cmp_ps(src[i].data, zero, _CMP_GT_OQ), one);
+        const __m256 neg = _mm256_and_ps(_mm256_cmp_ps(src[i].data, zero, _CMP_LT_OQ), one);
+        dst[i].data = _mm256_sub_ps(pos, neg);
+    }
+#endif
+}
+
+// Horizontal sum of the lanes of a register.
+inline float simd_reduce_add(const AVX_Data& src)
+{
+#if defined(__AVX512__)
+    return _mm512_reduce_add_ps(src.data);
+#elif defined(__AVX256__)
+    const __m128 sum4 =
+        _mm_add_ps(_mm256_castps256_ps128(src.data), _mm256_extractf128_ps(src.data, 1));
+    const __m128 sum2 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    return _mm_cvtss_f32(_mm_add_ss(sum2, _mm_shuffle_ps(sum2, sum2, 0x1)));
+#endif
+}
+
+}  // namespace DS_SIMD_NAMESPACE
+
 #endif
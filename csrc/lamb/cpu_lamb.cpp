@@ -0,0 +1,325 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "cpu_lamb.h"
+#include <torch/extension.h>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+
+#if defined(__ENABLE_CUDA__)
+#include <cuda_runtime_api.h>
+#include "cublas_v2.h"
+#include "cuda.h"
+#include "curand.h"
+#include "custom_cuda_layers.h"
+#endif
+
+static std::unordered_map<int, std::shared_ptr<void>> s_optimizers;
+
+static ds_dtype_t get_ds_dtype(const torch::Tensor& tensor)
+{
+    if (tensor.options().dtype() == at::kHalf) return DS_DTYPE_FP16;
+    if (tensor.options().dtype() == at::kBFloat16) return DS_DTYPE_BF16;
+    assert(tensor.options().dtype() == at::kFloat);
+    return DS_DTYPE_FP32;
+}
+
+// C++ interface
+
+float Lamb_Optimizer::Step(float* _params,
+                           float* grads,
+                           float* _exp_avg,
+                           float* _exp_avg_sq,
+                           size_t _param_size,
+                           ds_half_precision_t* dev_params,
+                           ds_dtype_t param_dtype,
+                           ds_dtype_t grad_dtype,
+                           ds_dtype_t dev_param_dtype)
+{
+    float betta1_minus1 = 1 - _betta1;
+    float betta2_minus1 = 1 - _betta2;
+
+    // Pass 1: moments and the squared norms of the params and of the update.
+    size_t rounded_size = 0;
+    double w_norm_sq = 0;
+    double u_norm_sq = 0;
+    Reduce_SIMD<8>(&rounded_size,
+                   _params,
+                   grads,
+                   _exp_avg,
+                   _exp_avg_sq,
+                   _param_size,
+                   param_dtype,
+                   grad_dtype,
+                   &w_norm_sq,
+                   &u_norm_sq);
+    if (_param_size > rounded_size) {
+        double w_sum = 0;
+        double u_sum = 0;
+#pragma omp parallel for schedule(static) reduction(+ : w_sum, u_sum)
+        for (size_t k = rounded_size; k < _param_size; k++) {
+            float grad = ds_load_elem<ds_half_precision_t>(grads, k, grad_dtype) * _inv_grad_scale;
+            float param = ds_load_elem<ds_half_precision_t>(_params, k, param_dtype);
+            float momentum = _exp_avg[k];
+            float variance = _exp_avg_sq[k];
+
+            momentum = momentum * _betta1 + grad * betta1_minus1;
+            variance = variance * _betta2 + grad * grad * betta2_minus1;
+
+            float denom = _eps_inside_sqrt ? sqrt(variance + _eps) : sqrt(variance) + _eps;
+            float update = momentum / denom + _weight_decay * param;
+
+            w_sum += param * param;
+            u_sum += update * update;
+
+            _exp_avg[k] = momentum;
+            _exp_avg_sq[k] = variance;
+        }
+        w_norm_sq += w_sum;
+        u_norm_sq += u_sum;
+    }
+
+    float lamb_coeff = 1.0;
+    const float w_norm = std::sqrt(w_norm_sq);
+    const float u_norm = std::sqrt(u_norm_sq);
+    if (w_norm != 0 && u_norm != 0) {
+        lamb_coeff = w_norm / u_norm;
+        if (lamb_coeff > _max_coeff) { lamb_coeff = _max_coeff; }
+        if (lamb_coeff < _min_coeff) { lamb_coeff = _min_coeff; }
+    }
+
+    // Pass 2: the trust ratio scaled update, streamed to the device copy when there is one.
+    rounded_size = 0;
+    Update_SIMD<8>(&rounded_size,
+                   _params,
+                   _exp_avg,
+                   _exp_avg_sq,
+                   _param_size,
+                   lamb_coeff,
+                   dev_params,
+                   param_dtype,
+                   dev_param_dtype);
+    if (_param_size > rounded_size) {
+        const float step_size = _step_size * lamb_coeff;
+#if defined(__ENABLE_CUDA__)
+        const bool bf16_copy = (dev_param_dtype == DS_DTYPE_BF16);
+#endif
+        const size_t tile = dev_params ? std::max<size_t>(_copy_tile, 1) : TILE;
+#if defined(__ENABLE_CUDA__)
+        std::shared_ptr<Pinned_Staging_Ring> staging;
+        if (dev_params) { staging = Pinned_Staging_Ring::Get(_copy_depth, tile); }
+#endif
+
+        for (size_t t = rounded_size; t < _param_size; t += tile) {
+            size_t copy_size = tile;
+            if ((t + tile) > _param_size) copy_size = _param_size - t;
+            size_t offset = copy_size + t;
+#if defined(__ENABLE_CUDA__)
+            const int slot = dev_params ? staging->acquire() : -1;
+            float* staging_buffer = dev_params ? staging->buffer(slot) : nullptr;
+#endif
+#pragma omp parallel for schedule(static)
+            for (size_t k = t; k < offset; k++) {
+                float param = ds_load_elem<ds_half_precision_t>(_params, k, param_dtype);
+                float variance = _exp_avg_sq[k];
+
+                float denom = _eps_inside_sqrt ? sqrt(variance + _eps) : sqrt(variance) + _eps;
+                float update = _exp_avg[k] / denom + _weight_decay * param;
+                param -= step_size * update;
+#if defined(__ENABLE_CUDA__)
+                if (dev_params) {
+                    if (bf16_copy)
+                        reinterpret_cast<uint16_t*>(staging_buffer)[k - t] =
+                            ds_float_to_bf16(param);
+                    else
+                        staging_buffer[k - t] = param;
+                }
+#endif
+                ds_store_elem<ds_half_precision_t>(_params, k, param, param_dtype);
+            }
+#if defined(__ENABLE_CUDA__)
+            if (dev_params) {
+                if (bf16_copy)
+                    cudaMemcpyAsync(dev_params + t,
+                                    staging_buffer,
+                                    copy_size * sizeof(ds_half_precision_t),
+                                    cudaMemcpyHostToDevice,
+                                    staging->stream(slot));
+                else
+                    launch_param_update(
+                        staging_buffer, dev_params + t, (copy_size), staging->stream(slot));
+
+                staging->release(slot);
+            }
+#endif
+        }
+    }
+    return lamb_coeff;
+}
+
+int create_lamb_optimizer(int optimizer_id,
+                          float alpha = 1e-3,
+                          float betta1 = 0.9,
+                          float betta2 = 0.999,
+                          float eps = 1e-8,
+                          float weight_decay = 0,
+                          float max_coeff = 10.0,
+                          float min_coeff = 0.01,
+                          bool eps_inside_sqrt = false,
+                          bool should_log = false,
+                          int copy_depth = DEFAULT_COPY_DEPTH,
+                          size_t copy_tile = TILE)
+{
+    auto opt = std::make_shared<Lamb_Optimizer>(alpha,
+                                                betta1,
+                                                betta2,
+                                                eps,
+                                                weight_decay,
+                                                max_coeff,
+                                                min_coeff,
+                                                eps_inside_sqrt,
+                                                copy_depth,
+                                                copy_tile);
+
+    s_optimizers[optimizer_id] = opt;
+
+    if (should_log) {
+        std::string avx_type = ds_simd_isa_name(ds_simd_active_isa());
+
+        printf("Lamb Optimizer #%d is created with %s arithmetic capability.\n",
+               optimizer_id,
+               avx_type.c_str());
+        printf("Config: alpha=%f, betas=(%f, %f), weight_decay=%f, coeff=[%f, %f]\n",
+               alpha,
+               betta1,
+               betta2,
+               weight_decay,
+               min_coeff,
+               max_coeff);
+    }
+
+    return 0;
+}
+
+float ds_lamb_step(int optimizer_id,
+                   size_t step,
+                   float lr,
+                   float beta1,
+                   float beta2,
+                   float epsilon,
+                   float weight_decay,
+                   bool bias_correction,
+                   float max_coeff,
+                   float min_coeff,
+                   float grad_scale,
+                   torch::Tensor& params,
+                   torch::Tensor& grads,
+                   torch::Tensor& exp_avg,
+                   torch::Tensor& exp_avg_sq)
+{
+    auto params_c = params.contiguous();
+    auto grads_c = grads.contiguous();
+    auto exp_avg_c = exp_avg.contiguous();
+    auto exp_avg_sq_c = exp_avg_sq.contiguous();
+
+    float* params_ptr = (float*)params_c.data_ptr();
+    float* grads_ptr = (float*)grads_c.data_ptr();
+    float* exp_avg_ptr = (float*)exp_avg_c.data_ptr();
+    float* exp_avg_sq_ptr = (float*)exp_avg_sq_c.data_ptr();
+
+    std::shared_ptr<Lamb_Optimizer> opt =
+        std::static_pointer_cast<Lamb_Optimizer>(s_optimizers[optimizer_id]);
+    opt->IncrementStep(step, beta1, beta2);
+    opt->update_state(lr, epsilon, weight_decay, bias_correction, max_coeff, min_coeff, grad_scale);
+
+    float lamb_coeff = opt->Step(params_ptr,
+                                 grads_ptr,
+                                 exp_avg_ptr,
+                                 exp_avg_sq_ptr,
+                                 params_c.numel(),
+                                 nullptr,
+                                 get_ds_dtype(params_c),
+                                 get_ds_dtype(grads_c));
+
+#if defined(__ENABLE_CUDA__)
+    opt->SynchronizeStreams();
+#endif
+    return lamb_coeff;
+}
+
+float ds_lamb_step_plus_copy(int optimizer_id,
+                             size_t step,
+                             float lr,
+                             float beta1,
+                             float beta2,
+                             float epsilon,
+                             float weight_decay,
+                             bool bias_correction,
+                             float max_coeff,
+                             float min_coeff,
+                             float grad_scale,
+                             torch::Tensor& params,
+                             torch::Tensor& grads,
+                             torch::Tensor& exp_avg,
+                             torch::Tensor& exp_avg_sq,
+                             torch::Tensor& gpu_params)
+{
+    float lamb_coeff = 1.0;
+#if defined(__ENABLE_CUDA__)
+    auto params_c = params.contiguous();
+    auto gpu_params_c = gpu_params.contiguous();
+    auto exp_avg_c = exp_avg.contiguous();
+    auto exp_avg_sq_c = exp_avg_sq.contiguous();
+    auto grads_c = grads.contiguous();
+
+    float* params_ptr = (float*)params_c.data_ptr();
+    float* grads_ptr = (float*)grads_c.data_ptr();
+    ds_half_precision_t* gpu_params_ptr = (ds_half_precision_t*)gpu_params_c.data_ptr();
+    float* exp_avg_ptr = (float*)exp_avg_c.data_ptr();
+    float* exp_avg_sq_ptr = (float*)exp_avg_sq_c.data_ptr();
+
+    std::shared_ptr<Lamb_Optimizer> opt =
+        std::static_pointer_cast<Lamb_Optimizer>(s_optimizers[optimizer_id]);
+    opt->IncrementStep(step, beta1, beta2);
+    opt->update_state(lr, epsilon, weight_decay, bias_correction, max_coeff, min_coeff, grad_scale);
+    lamb_coeff = opt->Step(params_ptr,
+                           grads_ptr,
+                           exp_avg_ptr,
+                           exp_avg_sq_ptr,
+                           params_c.numel(),
+                           gpu_params_ptr,
+                           get_ds_dtype(params_c),
+                           get_ds_dtype(grads_c),
+                           get_ds_dtype(gpu_params_c));
+
+    opt->SynchronizeStreams();
+#else
+    assert(false);
+#endif
+    return lamb_coeff;
+}
+
+int destroy_lamb_optimizer(int optimizer_id)
+{
+    s_optimizers.erase(optimizer_id);
+#if defined(__ENABLE_CUDA__)
+    if (s_optimizers.empty()) { Pinned_Staging_Ring::Release(); }
+#endif
+
+    return 0;
+}
+
+PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
+{
+    m.def("lamb_update", &ds_lamb_step, "DeepSpeed CPU Lamb update (C++)");
+    m.def("lamb_update_copy",
+          &ds_lamb_step_plus_copy,
+          "DeepSpeed CPU Lamb update and param copy (C++)");
+    m.def("create_lamb", &create_lamb_optimizer, "DeepSpeed CPU Lamb (C++)");
+    m.def("destroy_lamb", &destroy_lamb_optimizer, "DeepSpeed CPU Lamb destroy (C++)");
+}
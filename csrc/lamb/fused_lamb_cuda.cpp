@@ -26,6 +26,22 @@ void fused_lamb_cuda(at::Tensor& p,
                      at::Tensor& u_l2_i,
                      at::Tensor& lamb_coeff_val);
 
+void multi_tensor_lamb_cuda(int chunk_size,
+                            at::Tensor noop_flag,
+                            std::vector<std::vector<at::Tensor>> tensor_lists,
+                            const float lr,
+                            const float beta1,
+                            const float beta2,
+                            const float epsilon,
+                            const int step,
+                            const int mode,
+                            const int bias_correction,
+                            const float weight_decay,
+                            const float max_coeff,
+                            const float min_coeff,
+                            const float grad_scale,
+                            at::Tensor lamb_coeffs);
+
 #define CHECK_CUDA(x) AT_ASSERTM(x.type().is_cuda(), #x " must be a CUDA tensor")
 #define CHECK_CONTIGUOUS(x) AT_ASSERTM(x.is_contiguous(), #x " must be contiguous")
 #define CHECK_INPUT(x) \
@@ -110,4 +126,7 @@ at::Tensor lamb(at::Tensor& p,
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
     m.def("lamb", &lamb, "Adam optimized CUDA implementation with LAMB.");
+    m.def("multi_tensor_lamb",
+          &multi_tensor_lamb_cuda,
+          "Compute and apply the LAMB update to a list of parameters in chunked launches");
 }
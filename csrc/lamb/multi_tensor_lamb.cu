@@ -0,0 +1,330 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+/*
+Multi tensor LAMB, built on the multi tensor apply of fused adam.
+
+Stage 1 updates the moments of every chunk, writes the raw update u = m / denom + decay * p in
+fp32 and folds the chunk's |p|^2 and |u|^2 into per tensor sums. Stage 2 turns the sums into the
+trust ratio of each tensor and applies it, reading only the params and the stored update. A step
+therefore reads the moments once and takes two chunked launches for all tensors. fp32 grads are
+overwritten with the update, reduced precision grads would round it before the trust ratio is
+applied and get an fp32 scratch copy instead.
+*/
+
+#include <ATen/ATen.h>
+#include <ATen/AccumulateType.h>
+#include <ATen/cuda/CUDAContext.h>
+#include <ATen/cuda/Exceptions.h>
+
+#include <assert.h>
+
+#include "multi_tensor_apply.cuh"
+#include "type_shim.h"
+
+#define BLOCK_SIZE 512
+#define ILP 4
+
+typedef enum {
+    ADAM_MODE_0 = 0,  // eps under square root
+    ADAM_MODE_1 = 1   // eps outside square root
+} adamMode_t;
+
+using MATH_T = float;
+
+// Sums a and b over the block, the totals end up in thread 0. blockDim.x must be a power of two.
+__device__ __forceinline__ void reduce_two_in_block(MATH_T& a, MATH_T& b)
+{
+    __shared__ MATH_T s_a[BLOCK_SIZE];
+    __shared__ MATH_T s_b[BLOCK_SIZE];
+
+    s_a[threadIdx.x] = a;
+    s_b[threadIdx.x] = b;
+    __syncthreads();
+
+    for (int offset = blockDim.x / 2; offset > 0; offset >>= 1) {
+        if (threadIdx.x < offset) {
+            s_a[threadIdx.x] += s_a[threadIdx.x + offset];
+            s_b[threadIdx.x] += s_b[threadIdx.x + offset];
+        }
+        __syncthreads();
+    }
+
+    a = s_a[0];
+    b = s_b[0];
+}
+
+template <typename GRAD_T, typename T>
+struct LAMBStage1Functor {
+    __device__ __forceinline__ void operator()(int chunk_size,
+                                               volatile int* noop_gmem,
+                                               TensorListMetadata<5>& tl,
+                                               const float beta1,
+                                               const float beta2,
+                                               const float epsilon,
+                                               const float inv_grad_scale,
+                                               adamMode_t mode,
+                                               const float decay,
+                                               float* w_norm_sq,
+                                               float* u_norm_sq)
+    {
+        int tensor_loc = tl.block_to_tensor[blockIdx.x];
+        int tensor_num = tl.start_tensor_this_launch + tensor_loc;
+
+        int chunk_idx = tl.block_to_chunk[blockIdx.x];
+        int n = tl.sizes[tensor_loc];
+
+        GRAD_T* g = (GRAD_T*)tl.addresses[0][tensor_loc];
+        g += chunk_idx * chunk_size;
+
+        T* p = (T*)tl.addresses[1][tensor_loc];
+        p += chunk_idx * chunk_size;
+
+        T* m = (T*)tl.addresses[2][tensor_loc];
+        m += chunk_idx * chunk_size;
+
+        T* v = (T*)tl.addresses[3][tensor_loc];
+        v += chunk_idx * chunk_size;
+
+        float* u = (float*)tl.addresses[4][tensor_loc];
+        u += chunk_idx * chunk_size;
+
+        n -= chunk_idx * chunk_size;
+
+        MATH_T w_sum = MATH_T(0);
+        MATH_T u_sum = MATH_T(0);
+        for (int i_start = 0; i_start < n && i_start < chunk_size; i_start += blockDim.x * ILP) {
+            MATH_T r_g[ILP];
+            MATH_T r_p[ILP];
+            MATH_T r_m[ILP];
+            MATH_T r_v[ILP];
+#pragma unroll
+            for (int ii = 0; ii < ILP; ii++) {
+                int i = i_start + threadIdx.x + ii * blockDim.x;
+                if (i < n && i < chunk_size) {
+                    r_g[ii] = static_cast<MATH_T>(g[i]) * inv_grad_scale;
+                    r_p[ii] = p[i];
+                    r_m[ii] = m[i];
+                    r_v[ii] = v[i];
+                } else {
+                    r_g[ii] = MATH_T(0);
+                    r_p[ii] = MATH_T(0);
+                    r_m[ii] = MATH_T(0);
+                    r_v[ii] = MATH_T(0);
+                }
+            }
+#pragma unroll
+            for (int ii = 0; ii < ILP; ii++) {
+                r_m[ii] = beta1 * r_m[ii] + (1 - beta1) * r_g[ii];
+                r_v[ii] = beta2 * r_v[ii] + (1 - beta2) * r_g[ii] * r_g[ii];
+                MATH_T denom;
+                if (mode == ADAM_MODE_0)
+                    denom = sqrtf(r_v[ii] + epsilon);
+                else  // Mode 1
+                    denom = sqrtf(r_v[ii]) + epsilon;
+                // Padding lanes are all zero and add nothing to the sums.
+                r_g[ii] = (r_m[ii] / denom) + (decay * r_p[ii]);
+                w_sum += r_p[ii] * r_p[ii];
+                u_sum += r_g[ii] * r_g[ii];
+            }
+#pragma unroll
+            for (int ii = 0; ii < ILP; ii++) {
+                int i = i_start + threadIdx.x + ii * blockDim.x;
+                if (i < n && i < chunk_size) {
+                    u[i] = r_g[ii];
+                    m[i] = r_m[ii];
+                    v[i] = r_v[ii];
+                }
+            }
+        }
+
+        reduce_two_in_block(w_sum, u_sum);
+        if (threadIdx.x == 0) {
+            atomicAdd(w_norm_sq + tensor_num, w_sum);
+            atomicAdd(u_norm_sq + tensor_num, u_sum);
+        }
+    }
+};
+
+// DEPTH is 3 when a reduced precision copy of the params is written as well.
+template <typename GRAD_T, typename T, int DEPTH>
+struct LAMBStage2Functor {
+    __device__ __forceinline__ void operator()(int chunk_size,
+                                               volatile int* noop_gmem,
+                                               TensorListMetadata<DEPTH>& tl,
+                                               const float step_size,
+                                               const float max_coeff,
+                                               const float min_coeff,
+                                               const float* w_norm_sq,
+                                               const float* u_norm_sq,
+                                               float* lamb_coeffs)
+    {
+        int tensor_loc = tl.block_to_tensor[blockIdx.x];
+        int tensor_num = tl.start_tensor_this_launch + tensor_loc;
+
+        int chunk_idx = tl.block_to_chunk[blockIdx.x];
+        int n = tl.sizes[tensor_loc];
+
+        const MATH_T w_norm = sqrtf(w_norm_sq[tensor_num]);
+        const MATH_T u_norm = sqrtf(u_norm_sq[tensor_num]);
+        MATH_T lamb_coeff = 1.0;
+        if (w_norm != 0 && u_norm != 0) {
+            lamb_coeff = w_norm / u_norm;
+            if (lamb_coeff > max_coeff) { lamb_coeff = max_coeff; }
+            if (lamb_coeff < min_coeff) { lamb_coeff = min_coeff; }
+        }
+        if (chunk_idx == 0 && threadIdx.x == 0) { lamb_coeffs[tensor_num] = lamb_coeff; }
+        const MATH_T scaled_step = step_size * lamb_coeff;
+
+        const float* u = (const float*)tl.addresses[0][tensor_loc];
+        u += chunk_idx * chunk_size;
+
+        T* p = (T*)tl.addresses[1][tensor_loc];
+        p += chunk_idx * chunk_size;
+
+        GRAD_T* p_copy = nullptr;
+        if (DEPTH == 3) {
+            p_copy = (GRAD_T*)tl.addresses[DEPTH - 1][tensor_loc];
+            p_copy += chunk_idx * chunk_size;
+        }
+
+        n -= chunk_idx * chunk_size;
+
+        for (int i_start = 0; i_start < n && i_start < chunk_size; i_start += blockDim.x * ILP) {
+            MATH_T r_u[ILP];
+            MATH_T r_p[ILP];
+#pragma unroll
+            for (int ii = 0; ii < ILP; ii++) {
+                int i = i_start + threadIdx.x + ii * blockDim.x;
+                if (i < n && i < chunk_size) {
+                    r_u[ii] = u[i];
+                    r_p[ii] = p[i];
+                } else {
+                    r_u[ii] = MATH_T(0);
+                    r_p[ii] = MATH_T(0);
+                }
+            }
+#pragma unroll
+            for (int ii = 0; ii < ILP; ii++) { r_p[ii] = r_p[ii] - (scaled_step * r_u[ii]); }
+#pragma unroll
+            for (int ii = 0; ii < ILP; ii++) {
+                int i = i_start + threadIdx.x + ii * blockDim.x;
+                if (i < n && i < chunk_size) {
+                    p[i] = r_p[ii];
+                    if (DEPTH == 3) { p_copy[i] = r_p[ii]; }
+                }
+            }
+        }
+    }
+};
+
+// tensor_lists holds grads, params, exp_avg and exp_avg_sq, optionally followed by reduced
+// precision param copies of the grad dtype. fp32 grads are overwritten with the raw update. The
+// lamb coefficient of each tensor is written to lamb_coeffs, a float tensor with one element per
+// tensor.
+void multi_tensor_lamb_cuda(int chunk_size,
+                            at::Tensor noop_flag,
+                            std::vector<std::vector<at::Tensor>> tensor_lists,
+                            const float lr,
+                            const float beta1,
+                            const float beta2,
+                            const float epsilon,
+                            const int step,
+                            const int mode,
+                            const int bias_correction,
+                            const float weight_decay,
+                            const float max_coeff,
+                            const float min_coeff,
+                            const float grad_scale,
+                            at::Tensor lamb_coeffs)
+{
+    using namespace at;
+
+    TORCH_CHECK(tensor_lists.size() == 4 || tensor_lists.size() == 5,
+                "expected grads, params, exp_avg, exp_avg_sq and optional param copies");
+    const auto num_tensors = tensor_lists[0].size();
+    TORCH_CHECK(lamb_coeffs.scalar_type() == at::ScalarType::Float &&
+                    lamb_coeffs.numel() == static_cast<int64_t>(num_tensors) &&
+                    lamb_coeffs.is_contiguous(),
+                "lamb_coeffs must be a contiguous float tensor with one element per tensor");
+
+    // Like FusedLamb, the bias corrections are folded into the step size.
+    float step_size = lr;
+    if (bias_correction == 1) {
+        const float bias_correction1 = 1 - std::pow(beta1, step);
+        const float bias_correction2 = 1 - std::pow(beta2, step);
+        step_size = lr * std::sqrt(bias_correction2) / bias_correction1;
+    }
+
+    auto norms = at::zeros({2, static_cast<int64_t>(num_tensors)}, lamb_coeffs.options());
+    float* w_norm_sq = norms.data_ptr<float>();
+    float* u_norm_sq = w_norm_sq + num_tensors;
+
+    // The update stays fp32 until the trust ratio is applied, in place of fp32 grads
+    std::vector<at::Tensor> updates;
+    if (tensor_lists[0][0].scalar_type() == at::ScalarType::Float) {
+        updates = tensor_lists[0];
+    } else {
+        for (const auto& g : tensor_lists[0]) {
+            updates.push_back(at::empty_like(g, g.options().dtype(at::ScalarType::Float)));
+        }
+    }
+
+    std::vector<std::vector<at::Tensor>> stage1_lists(tensor_lists.begin(),
+                                                      tensor_lists.begin() + 4);
+    stage1_lists.push_back(updates);
+    std::vector<std::vector<at::Tensor>> stage2_lists = {updates, tensor_lists[1]};
+    if (tensor_lists.size() == 5) stage2_lists.push_back(tensor_lists[4]);
+
+    // Grads may be reduced precision while params and moments share one dtype.
+    DISPATCH_FLOAT_AND_HALF(
+        tensor_lists[0][0].scalar_type(),
+        0,
+        "lamb",
+        DISPATCH_FLOAT_AND_HALF(
+            tensor_lists[1][0].scalar_type(),
+            1,
+            "lamb",
+            multi_tensor_apply<5>(BLOCK_SIZE,
+                                  chunk_size,
+                                  noop_flag,
+                                  stage1_lists,
+                                  LAMBStage1Functor<scalar_t_0, scalar_t_1>(),
+                                  beta1,
+                                  beta2,
+                                  epsilon,
+                                  1 / grad_scale,
+                                  (adamMode_t)mode,
+                                  weight_decay,
+                                  w_norm_sq,
+                                  u_norm_sq);
+            if (stage2_lists.size() == 3) {
+                multi_tensor_apply<3>(BLOCK_SIZE,
+                                      chunk_size,
+                                      noop_flag,
+                                      stage2_lists,
+                                      LAMBStage2Functor<scalar_t_0, scalar_t_1, 3>(),
+                                      step_size,
+                                      max_coeff,
+                                      min_coeff,
+                                      w_norm_sq,
+                                      u_norm_sq,
+                                      lamb_coeffs.data_ptr<float>());
+            } else {
+                multi_tensor_apply<2>(BLOCK_SIZE,
+                                      chunk_size,
+                                      noop_flag,
+                                      stage2_lists,
+                                      LAMBStage2Functor<scalar_t_0, scalar_t_1, 2>(),
+                                      step_size,
+                                      max_coeff,
+                                      min_coeff,
+                                      w_norm_sq,
+                                      u_norm_sq,
+                                      lamb_coeffs.data_ptr<float>());
+            }))
+
+    AT_CUDA_CHECK(cudaGetLastError());
+}
@@ -0,0 +1,303 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "cpu_lion.h"
+#include <torch/extension.h>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+
+#if defined(__ENABLE_CUDA__)
+#include <cuda_runtime_api.h>
+#include "cublas_v2.h"
+#include "cuda.h"
+#include "curand.h"
+#include "custom_cuda_layers.h"
+#endif
+
+static std::unordered_map<int, std::shared_ptr<void>> s_optimizers;
+
+static ds_dtype_t get_ds_dtype(const torch::Tensor& tensor)
+{
+    if (tensor.options().dtype() == at::kHalf) return DS_DTYPE_FP16;
+    if (tensor.options().dtype() == at::kBFloat16) return DS_DTYPE_BF16;
+    assert(tensor.options().dtype() == at::kFloat);
+    return DS_DTYPE_FP32;
+}
+
+// C++ interface
+
+void Lion_Optimizer::Step_1(float* _params,
+                            float* grads,
+                            float* _exp_avg,
+                            size_t _param_size,
+                            ds_half_precision_t* dev_params,
+                            ds_dtype_t param_dtype,
+                            ds_dtype_t grad_dtype,
+                            ds_dtype_t dev_param_dtype)
+{
+    size_t rounded_size = 0;
+    Step_SIMD<1>(&rounded_size,
+                 _params,
+                 grads,
+                 _exp_avg,
+                 _param_size,
+                 dev_params,
+                 param_dtype,
+                 grad_dtype,
+                 dev_param_dtype);
+    if (_param_size > rounded_size) {
+        float betta1_minus1 = 1 - _betta1;
+        float betta2_minus1 = 1 - _betta2;
+        float decay = 1 - _alpha * _weight_decay;
+#if defined(__ENABLE_CUDA__)
+        const bool bf16_copy = (dev_param_dtype == DS_DTYPE_BF16);
+#endif
+        const size_t tile = dev_params ? std::max<size_t>(_copy_tile, 1) : TILE;
+#if defined(__ENABLE_CUDA__)
+        std::shared_ptr<Pinned_Staging_Ring> staging;
+        if (dev_params) { staging = Pinned_Staging_Ring::Get(_copy_depth, tile); }
+#endif
+
+        for (size_t t = rounded_size; t < _param_size; t += tile) {
+            size_t copy_size = tile;
+            if ((t + tile) > _param_size) copy_size = _param_size - t;
+            size_t offset = copy_size + t;
+#if defined(__ENABLE_CUDA__)
+            const int slot = dev_params ? staging->acquire() : -1;
+            float* staging_buffer = dev_params ? staging->buffer(slot) : nullptr;
+#endif
+#pragma omp parallel for schedule(static)
+            for (size_t k = t; k < offset; k++) {
+                float grad = ds_load_elem<ds_half_precision_t>(grads, k, grad_dtype);
+                float param = ds_load_elem<ds_half_precision_t>(_params, k, param_dtype);
+                float momentum = _exp_avg[k];
+
+                float update = momentum * _betta1 + grad * betta1_minus1;
+                update = (update > 0) ? 1.0f : ((update < 0) ? -1.0f : 0.0f);
+                if (_weight_decay > 0) { param *= decay; }
+                param -= _alpha * update;
+                momentum = momentum * _betta2 + grad * betta2_minus1;
+#if defined(__ENABLE_CUDA__)
+                if (dev_params) {
+                    if (bf16_copy)
+                        reinterpret_cast<uint16_t*>(staging_buffer)[k - t] =
+                            ds_float_to_bf16(param);
+                    else
+                        staging_buffer[k - t] = param;
+                }
+#endif
+                ds_store_elem<ds_half_precision_t>(_params, k, param, param_dtype);
+                _exp_avg[k] = momentum;
+            }
+#if defined(__ENABLE_CUDA__)
+            if (dev_params) {
+                if (bf16_copy)
+                    cudaMemcpyAsync(dev_params + t,
+                                    staging_buffer,
+                                    copy_size * sizeof(ds_half_precision_t),
+                                    cudaMemcpyHostToDevice,
+                                    staging->stream(slot));
+                else
+                    launch_param_update(
+                        staging_buffer, dev_params + t, (copy_size), staging->stream(slot));
+
+                staging->release(slot);
+            }
+#endif
+        }
+    }
+}
+
+void Lion_Optimizer::Step_4(float* _params,
+                            float* grads,
+                            float* _exp_avg,
+                            size_t _param_size,
+                            ds_half_precision_t* dev_params,
+                            ds_dtype_t param_dtype,
+                            ds_dtype_t grad_dtype,
+                            ds_dtype_t dev_param_dtype)
+{
+    size_t rounded_size = 0;
+    Step_SIMD<4>(&rounded_size,
+                 _params,
+                 grads,
+                 _exp_avg,
+                 _param_size,
+                 dev_params,
+                 param_dtype,
+                 grad_dtype,
+                 dev_param_dtype);
+    if (_param_size > rounded_size)
+        Step_1(ds_dtype_offset(_params, rounded_size, param_dtype),
+               ds_dtype_offset(grads, rounded_size, grad_dtype),
+               (_exp_avg + rounded_size),
+               (_param_size - rounded_size),
+               (dev_params != nullptr ? (dev_params + rounded_size) : dev_params),
+               param_dtype,
+               grad_dtype,
+               dev_param_dtype);
+}
+
+int create_lion_optimizer(int optimizer_id,
+                          float alpha = 1e-4,
+                          float betta1 = 0.9,
+                          float betta2 = 0.99,
+                          float weight_decay = 0,
+                          bool should_log = false,
+                          int copy_depth = DEFAULT_COPY_DEPTH,
+                          size_t copy_tile = TILE)
+{
+    auto opt = std::make_shared<Lion_Optimizer>(
+        alpha, betta1, betta2, weight_decay, copy_depth, copy_tile);
+
+    s_optimizers[optimizer_id] = opt;
+
+    if (should_log) {
+        std::string avx_type = ds_simd_isa_name(ds_simd_active_isa());
+
+        printf("Lion Optimizer #%d is created with %s arithmetic capability.\n",
+               optimizer_id,
+               avx_type.c_str());
+        printf("Config: alpha=%f, betas=(%f, %f), weight_decay=%f\n",
+               alpha,
+               betta1,
+               betta2,
+               weight_decay);
+    }
+
+    return 0;
+}
+
+void Lion_Optimizer::Step_8(float* _params,
+                            float* grads,
+                            float* _exp_avg,
+                            size_t _param_size,
+                            ds_half_precision_t* dev_params,
+                            ds_dtype_t param_dtype,
+                            ds_dtype_t grad_dtype,
+                            ds_dtype_t dev_param_dtype)
+{
+    size_t rounded_size = 0;
+    Step_SIMD<8>(&rounded_size,
+                 _params,
+                 grads,
+                 _exp_avg,
+                 _param_size,
+                 dev_params,
+                 param_dtype,
+                 grad_dtype,
+                 dev_param_dtype);
+    if (_param_size > rounded_size)
+        Step_4(ds_dtype_offset(_params, rounded_size, param_dtype),
+               ds_dtype_offset(grads, rounded_size, grad_dtype),
+               (_exp_avg + rounded_size),
+               (_param_size - rounded_size),
+               (dev_params != nullptr ? (dev_params + rounded_size) : dev_params),
+               param_dtype,
+               grad_dtype,
+               dev_param_dtype);
+}
+
+int ds_lion_step(int optimizer_id,
+                 size_t step,
+                 float lr,
+                 float beta1,
+                 float beta2,
+                 float weight_decay,
+                 torch::Tensor& params,
+                 torch::Tensor& grads,
+                 torch::Tensor& exp_avg)
+{
+    auto params_c = params.contiguous();
+    auto grads_c = grads.contiguous();
+    auto exp_avg_c = exp_avg.contiguous();
+
+    float* params_ptr = (float*)params_c.data_ptr();
+    float* grads_ptr = (float*)grads_c.data_ptr();
+    float* exp_avg_ptr = (float*)exp_avg_c.data_ptr();
+
+    std::shared_ptr<Lion_Optimizer> opt =
+        std::static_pointer_cast<Lion_Optimizer>(s_optimizers[optimizer_id]);
+    opt->IncrementStep(step, beta1, beta2);
+    opt->update_state(lr, weight_decay);
+
+    opt->Step_8(params_ptr,
+                grads_ptr,
+                exp_avg_ptr,
+                params_c.numel(),
+                nullptr,
+                get_ds_dtype(params_c),
+                get_ds_dtype(grads_c));
+
+#if defined(__ENABLE_CUDA__)
+    opt->SynchronizeStreams();
+#endif
+    return 0;
+}
+
+int ds_lion_step_plus_copy(int optimizer_id,
+                           size_t step,
+                           float lr,
+                           float beta1,
+                           float beta2,
+                           float weight_decay,
+                           torch::Tensor& params,
+                           torch::Tensor& grads,
+                           torch::Tensor& exp_avg,
+                           torch::Tensor& gpu_params)
+{
+#if defined(__ENABLE_CUDA__)
+    auto params_c = params.contiguous();
+    auto gpu_params_c = gpu_params.contiguous();
+    auto exp_avg_c = exp_avg.contiguous();
+    auto grads_c = grads.contiguous();
+
+    float* params_ptr = (float*)params_c.data_ptr();
+    float* grads_ptr = (float*)grads_c.data_ptr();
+    ds_half_precision_t* gpu_params_ptr = (ds_half_precision_t*)gpu_params_c.data_ptr();
+    float* exp_avg_ptr = (float*)exp_avg_c.data_ptr();
+
+    std::shared_ptr<Lion_Optimizer> opt =
+        std::static_pointer_cast<Lion_Optimizer>(s_optimizers[optimizer_id]);
+    opt->IncrementStep(step, beta1, beta2);
+    opt->update_state(lr, weight_decay);
+    opt->Step_8(params_ptr,
+                grads_ptr,
+                exp_avg_ptr,
+                params_c.numel(),
+                gpu_params_ptr,
+                get_ds_dtype(params_c),
+                get_ds_dtype(grads_c),
+                get_ds_dtype(gpu_params_c));
+
+    opt->SynchronizeStreams();
+#else
+    assert(false);
+#endif
+    return 0;
+}
+
+int destroy_lion_optimizer(int optimizer_id)
+{
+    s_optimizers.erase(optimizer_id);
+#if defined(__ENABLE_CUDA__)
+    if (s_optimizers.empty()) { Pinned_Staging_Ring::Release(); }
+#endif
+
+    return 0;
+}
+
+PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
+{
+    m.def("lion_update", &ds_lion_step, "DeepSpeed CPU Lion update (C++)");
+    m.def("lion_update_copy",
+          &ds_lion_step_plus_copy,
+          "DeepSpeed CPU Lion update and param copy (C++)");
+    m.def("create_lion", &create_lion_optimizer, "DeepSpeed CPU Lion (C++)");
+    m.def("destroy_lion", &destroy_lion_optimizer, "DeepSpeed CPU Lion destroy (C++)");
+}
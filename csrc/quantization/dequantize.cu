@@ -50,6 +50,14 @@ void launch_dequantize_kernel(T* dequant_data,
         LAUNCH_DEQUANT_KERNEL(4, quantize::Type::Symmetric);
     } else if (num_bits == 4 && q_type == quantize::Type::Asymmetric) {
         LAUNCH_DEQUANT_KERNEL(4, quantize::Type::Asymmetric);
+    } else if (q_type == quantize::Type::NF4) {
+        LAUNCH_DEQUANT_KERNEL(4, quantize::Type::NF4);
+#ifdef FP8_AVAILABLE
+    } else if (q_type == quantize::Type::FP8_E4M3) {
+        LAUNCH_DEQUANT_KERNEL(8, quantize::Type::FP8_E4M3);
+    } else if (q_type == quantize::Type::FP8_E5M2) {
+        LAUNCH_DEQUANT_KERNEL(8, quantize::Type::FP8_E5M2);
+#endif
     }
 }
 
@@ -70,3 +78,82 @@ template void launch_dequantize_kernel(float* dequant_data,
                                        int elems_per_group,
                                        int total_elems,
                                        cudaStream_t stream);
+
+/*
+Inverse of the swizzled quantization layout, for the receiving end of a hierarchical all-gather.
+After an inter-node all-gather followed by an intra-node one, the groups of partition
+(node, device) sit in the [pipeline, device, node] slot. Each block dequantizes one group and
+writes it to its [pipeline, node, device] position, so no permutation pass is needed.
+*/
+template <int numBits, quantize::Type qType, int threads>
+__global__ void swizzled_dequant_kernel(__half* __restrict__ dequant_data,
+                                        const int8_t* __restrict__ q_data,
+                                        const float* __restrict__ q_params,
+                                        int elems_per_group,
+                                        int nodes,
+                                        int devices_per_node)
+{
+    cg::thread_block tb = cg::this_thread_block();
+
+    constexpr int num_ele_int8 = 8 / numBits;
+    constexpr int num_int8_in = dequantize::h_per_chunk / num_ele_int8;
+    constexpr int stride = threads * dequantize::h_per_chunk;
+
+    const int groups_per_partition = gridDim.x;
+    const int node_id = blockIdx.y / devices_per_node;
+    const int device_id = blockIdx.y % devices_per_node;
+    const int pipe_id = blockIdx.z;
+
+    const int output_group =
+        (pipe_id * gridDim.y + blockIdx.y) * groups_per_partition + blockIdx.x;
+    const int input_group =
+        ((pipe_id * devices_per_node + device_id) * nodes + node_id) * groups_per_partition +
+        blockIdx.x;
+
+    dequantize::Params<qType, numBits> params(q_params, input_group);
+
+    const int8_t* input_base = q_data + (size_t)input_group * elems_per_group / num_ele_int8;
+    __half* output_base = dequant_data + (size_t)output_group * elems_per_group;
+
+    for (int elem = tb.thread_index().x * dequantize::h_per_chunk; elem < elems_per_group;
+         elem += stride) {
+        int8_t local_input[num_int8_in];
+        __half local_output[dequantize::h_per_chunk];
+        mem_access::load_global<num_int8_in>(local_input, input_base + elem / num_ele_int8);
+        dequantize::chunk<__half, numBits, qType>(local_output, local_input, params);
+        mem_access::store_global<dequantize::granularity>(output_base + elem, local_output);
+    }
+}
+
+#define LAUNCH_SWIZZLED_DEQUANT_KERNEL(num_bits, q_type)                            \
+    swizzled_dequant_kernel<num_bits, q_type, threads><<<grid, block, 0, stream>>>( \
+        dequant_data, q_data, q_params, elems_per_group, nodes, devices_per_node);
+
+void launch_swizzled_dequant(__half* dequant_data,
+                             const int8_t* q_data,
+                             const float* q_params,
+                             int num_bits,
+                             quantize::Type q_type,
+                             int groups,
+                             int elems_per_group,
+                             int pipelining,
+                             int nodes,
+                             int devices_per_node,
+                             cudaStream_t stream)
+{
+    constexpr int threads = 256;
+
+    const int partitions = nodes * devices_per_node;
+    const dim3 block(threads);
+    const dim3 grid(groups / (partitions * pipelining), partitions, pipelining);
+
+    if (num_bits == 8 && q_type == quantize::Type::Symmetric) {
+        LAUNCH_SWIZZLED_DEQUANT_KERNEL(8, quantize::Type::Symmetric);
+    } else if (num_bits == 8 && q_type == quantize::Type::Asymmetric) {
+        LAUNCH_SWIZZLED_DEQUANT_KERNEL(8, quantize::Type::Asymmetric);
+    } else if (num_bits == 4 && q_type == quantize::Type::Symmetric) {
+        LAUNCH_SWIZZLED_DEQUANT_KERNEL(4, quantize::Type::Symmetric);
+    } else if (num_bits == 4 && q_type == quantize::Type::Asymmetric) {
+        LAUNCH_SWIZZLED_DEQUANT_KERNEL(4, quantize::Type::Asymmetric);
+    }
+}
@@ -7,6 +7,7 @@
 #include <torch/extension.h>
 #include <cassert>
 #include <vector>
+#include "ds_instrument.h"
 #include "quantization.h"
 
 template <typename T>
@@ -78,6 +79,7 @@ std::vector<at::Tensor> quantize_kernel(at::Tensor& input_vals,
                               .requires_grad(false);
     const int param_elems = (quantize::requires_offset(quantType)) ? 2 : 1;
     auto params = torch::empty({groups, param_elems}, params_options);
+    numBits = quantize::bits_per_element(quantType, numBits);
 
     auto output_options = at::TensorOptions()
                               .dtype(at::kChar)
@@ -117,6 +119,7 @@ at::Tensor dequantize(at::Tensor& quantized_data,
                               .device(at::kCUDA)
                               .requires_grad(false);
 
+    num_bits = quantize::bits_per_element(quant_type, num_bits);
     auto output_sizes = quantized_data.sizes().vec();
     output_sizes[output_sizes.size() - 1] *= num_bits == 8 ? 1 : 2;
     auto output = torch::empty(output_sizes, output_options);
@@ -136,26 +139,204 @@ at::Tensor dequantize(at::Tensor& quantized_data,
     return output;
 }
 
+/*
+NF4 with double-quantized scales, as in QLoRA: the fp32 absmax of each group is itself quantized
+to 8 bit symmetric in blocks of scale_block_size groups, each block keeping one fp32 scale. This
+takes the scale overhead from 32 to about 8 bits per group. Returns {data, scales, scale_params}.
+*/
+std::vector<at::Tensor> quantize_nf4(at::Tensor& input_vals, int groups, int scale_block_size)
+{
+    TORCH_CHECK(groups % scale_block_size == 0, "groups must be a multiple of scale_block_size");
+
+    auto quantized = quantize_kernel(input_vals, groups, 4, quantize::Type::NF4);
+    auto absmax = quantized[1].to(at::kHalf);
+    auto quantized_scales =
+        quantize_kernel(absmax, groups / scale_block_size, 8, quantize::Type::Symmetric);
+
+    return {quantized[0], quantized_scales[0], quantized_scales[1]};
+}
+
+at::Tensor dequantize_nf4(at::Tensor& quantized_data,
+                          at::Tensor& quantized_scales,
+                          at::Tensor& scale_params,
+                          int groups)
+{
+    auto absmax = dequantize<__half>(
+        quantized_scales, scale_params, scale_params.size(0), 8, quantize::Type::Symmetric);
+    auto params = absmax.to(at::kFloat);
+
+    return dequantize<__half>(quantized_data, params, groups, 4, quantize::Type::NF4);
+}
+
+std::vector<at::Tensor> ds_swizzle_quant(at::Tensor& input_vals,
+                                         int groups,
+                                         int num_bits,
+                                         quantize::Type quant_type,
+                                         int pipeline_size,
+                                         int nodes,
+                                         int devices_per_node)
+{
+    TORCH_CHECK(quant_type == quantize::Type::Symmetric || quant_type == quantize::Type::Asymmetric,
+                "only the integer formats are supported");
+
+    auto scales_options = at::TensorOptions()
+                              .dtype(at::kFloat)
+                              .layout(at::kStrided)
+                              .device(at::kCUDA)
+                              .requires_grad(false);
+    const int scales_elems = (quantize::requires_offset(quant_type)) ? 2 : 1;
+    auto scales = torch::empty({groups, scales_elems}, scales_options);
+
+    auto output_options = at::TensorOptions()
+                              .dtype(at::kChar)
+                              .layout(at::kStrided)
+                              .device(at::kCUDA)
+                              .requires_grad(false);
+
+    const int quantization_scalar = 8 / num_bits;
+    const int compressed_vals = at::numel(input_vals) / quantization_scalar;
+
+    auto output = torch::empty({compressed_vals}, output_options);
+    const int elems_per_group = at::numel(input_vals) / groups;
+
+    launch_swizzled_quant((int8_t*)output.data_ptr(),
+                          (float*)scales.data_ptr(),
+                          (__half*)input_vals.data_ptr(),
+                          num_bits,
+                          quant_type,
+                          groups,
+                          elems_per_group,
+                          pipeline_size,
+                          nodes,
+                          devices_per_node,
+                          at::cuda::getCurrentCUDAStream());
+
+    return {output, scales};
+}
+
+at::Tensor ds_swizzled_dequantize(at::Tensor& quantized_data,
+                                  at::Tensor& params,
+                                  int groups,
+                                  int num_bits,
+                                  quantize::Type quant_type,
+                                  int pipeline_size,
+                                  int nodes,
+                                  int devices_per_node)
+{
+    TORCH_CHECK(quant_type == quantize::Type::Symmetric || quant_type == quantize::Type::Asymmetric,
+                "only the integer formats are supported");
+
+    auto output_options = at::TensorOptions()
+                              .dtype(torch::kFloat16)
+                              .layout(at::kStrided)
+                              .device(at::kCUDA)
+                              .requires_grad(false);
+
+    const int quantization_scalar = 8 / num_bits;
+    auto output = torch::empty({at::numel(quantized_data) * quantization_scalar}, output_options);
+
+    const int elems_per_group = at::numel(output) / groups;
+
+    launch_swizzled_dequant((__half*)output.data_ptr(),
+                            (const int8_t*)quantized_data.data_ptr(),
+                            (const float*)params.data_ptr(),
+                            num_bits,
+                            quant_type,
+                            groups,
+                            elems_per_group,
+                            pipeline_size,
+                            nodes,
+                            devices_per_node,
+                            at::cuda::getCurrentCUDAStream());
+
+    return output;
+}
+
+std::vector<at::Tensor> quantized_reduction(at::Tensor& input_vals,
+                                            at::Tensor& input_scales,
+                                            int out_groups,
+                                            int num_bits,
+                                            quantize::Type quant_type,
+                                            int num_tensors)
+{
+    TORCH_CHECK(quant_type == quantize::Type::Symmetric || quant_type == quantize::Type::Asymmetric,
+                "only the integer formats are supported");
+
+    auto scales_options = at::TensorOptions()
+                              .dtype(at::kFloat)
+                              .layout(at::kStrided)
+                              .device(at::kCUDA)
+                              .requires_grad(false);
+    const int scales_elems = (quantize::requires_offset(quant_type)) ? 2 : 1;
+    auto scales = torch::empty({out_groups, scales_elems}, scales_options);
+
+    auto output_options = at::TensorOptions()
+                              .dtype(at::kChar)
+                              .layout(at::kStrided)
+                              .device(at::kCUDA)
+                              .requires_grad(false);
+
+    auto output = torch::empty({at::numel(input_vals) / num_tensors}, output_options);
+
+    const int quantization_scalar = 8 / num_bits;
+    const int elems_per_group = at::numel(output) * quantization_scalar / out_groups;
+
+    launch_dequant_reduce((int8_t*)output.data_ptr(),
+                          (float*)scales.data_ptr(),
+                          (const int8_t*)input_vals.data_ptr(),
+                          (const float*)input_scales.data_ptr(),
+                          num_bits,
+                          quant_type,
+                          out_groups,
+                          elems_per_group,
+                          num_tensors,
+                          at::cuda::getCurrentCUDAStream());
+
+    return {output, scales};
+}
+
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
-    m.def("ds_quantize_fp32", &ds_quantize<float>, "DeepSpeed Quantize with fp32 (CUDA)");
-    m.def("ds_quantize_fp16", &ds_quantize<__half>, "DeepSpeed Quantize with fp16 (CUDA)");
-    m.def("ds_sr_quantize_fp32", &ds_sr_quantize<float>, "DeepSpeed Quantize with fp32 (CUDA)");
-    m.def("ds_sr_quantize_fp16", &ds_sr_quantize<__half>, "DeepSpeed Quantize with fp16 (CUDA)");
-    m.def("ds_quantize_asym_fp32", &ds_quantize_asym<float>, "DeepSpeed Quantize with fp32 (CUDA)");
-    m.def(
-        "ds_quantize_asym_fp16", &ds_quantize_asym<__half>, "DeepSpeed Quantize with fp16 (CUDA)");
-    m.def("ds_sr_quantize_asym_fp32",
-          &ds_sr_quantize_asym<float>,
-          "DeepSpeed Quantize with fp32 (CUDA)");
-    m.def("ds_sr_quantize_asym_fp16",
-          &ds_sr_quantize_asym<__half>,
-          "DeepSpeed Quantize with fp16 (CUDA)");
-    pybind11::enum_<quantize::Type>(m, "QuantizationType")
-        .value("Symmetric", quantize::Type::Symmetric)
-        .value("Asymmetric", quantize::Type::Asymmetric)
-        .export_values();
-    m.def("quantize", &quantize_kernel);
-    m.def("dequantize", &dequantize<__half>);
-    m.def("dequantize_fp32", &dequantize<float>);
+    ds_instrument::def(
+        m, "ds_quantize_fp32", &ds_quantize<float>, "DeepSpeed Quantize with fp32 (CUDA)");
+    ds_instrument::def(
+        m, "ds_quantize_fp16", &ds_quantize<__half>, "DeepSpeed Quantize with fp16 (CUDA)");
+    ds_instrument::def(
+        m, "ds_sr_quantize_fp32", &ds_sr_quantize<float>, "DeepSpeed Quantize with fp32 (CUDA)");
+    ds_instrument::def(
+        m, "ds_sr_quantize_fp16", &ds_sr_quantize<__half>, "DeepSpeed Quantize with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "ds_quantize_asym_fp32",
+                       &ds_quantize_asym<float>,
+                       "DeepSpeed Quantize with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "ds_quantize_asym_fp16",
+                       &ds_quantize_asym<__half>,
+                       "DeepSpeed Quantize with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "ds_sr_quantize_asym_fp32",
+                       &ds_sr_quantize_asym<float>,
+                       "DeepSpeed Quantize with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "ds_sr_quantize_asym_fp16",
+                       &ds_sr_quantize_asym<__half>,
+                       "DeepSpeed Quantize with fp16 (CUDA)");
+    auto quantization_type = pybind11::enum_<quantize::Type>(m, "QuantizationType")
+                                 .value("Symmetric", quantize::Type::Symmetric)
+                                 .value("Asymmetric", quantize::Type::Asymmetric)
+                                 .value("NF4", quantize::Type::NF4);
+#ifdef FP8_AVAILABLE
+    quantization_type.value("FP8_E4M3", quantize::Type::FP8_E4M3)
+        .value("FP8_E5M2", quantize::Type::FP8_E5M2);
+#endif
+    quantization_type.export_values();
+    ds_instrument::def(m, "quantize", &quantize_kernel);
+    ds_instrument::def(m, "dequantize", &dequantize<__half>);
+    ds_instrument::def(m, "dequantize_fp32", &dequantize<float>);
+    ds_instrument::def(m, "quantize_nf4", &quantize_nf4);
+    ds_instrument::def(m, "dequantize_nf4", &dequantize_nf4);
+    ds_instrument::def(m, "swizzle_quant", &ds_swizzle_quant);
+    ds_instrument::def(m, "swizzled_dequantize", &ds_swizzled_dequantize);
+    ds_instrument::def(m, "quantized_reduction", &quantized_reduction);
+    ds_instrument::def_queries(m);
 }
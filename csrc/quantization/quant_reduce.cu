@@ -0,0 +1,214 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "dequantization_utils.h"
+#include "ds_kernel_utils.h"
+#include "memory_access_utils.h"
+#include "quantization.h"
+#include "quantization_utils.h"
+#include "reduction_utils.h"
+
+namespace cg = cooperative_groups;
+
+namespace quant_reduce {
+constexpr int max_threads = 512;
+constexpr int min_threads = 32;
+
+constexpr int step_granularity = 2;
+constexpr int h_per_step = step_granularity * quantize::h_per_load;
+}  // namespace quant_reduce
+
+/*
+Reduction step of a hierarchical quantized reduce-scatter. The input holds num_tensors quantized
+copies of the same elements, one per peer of the previous all-to-all, each quantized with
+out_groups groups of elems_per_group elements. Each block dequantizes group g of every copy,
+sums them in fp32 and requantizes the sum as group g of the output, so a hop only moves the
+quantized data and scales. The output of the last hop is dequantized with the `dequantize` op.
+*/
+template <int numBits, int totalChunks, int threads, quantize::Type quantType>
+__global__ void dequant_reduce(int8_t* __restrict__ reduced_data,
+                               float* __restrict__ reduced_params,
+                               const int8_t* __restrict__ input_data,
+                               const float* __restrict__ input_params,
+                               int elems_per_group,
+                               int out_groups,
+                               int num_tensors)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+
+    constexpr int num_ele_int8 = 8 / numBits;
+    constexpr int num_int8_out = quantize::h_per_load / num_ele_int8;
+
+    const int group_id = blockIdx.x;
+    const int elem_offset = tb.thread_index().x * quantize::h_per_load;
+    const int stride = threads * quantize::h_per_load;
+    const size_t elems_per_tensor = (size_t)out_groups * elems_per_group;
+
+    float accumulator[totalChunks * quantize::h_per_load];
+#pragma unroll
+    for (int i = 0; i < totalChunks * quantize::h_per_load; i++) accumulator[i] = 0.f;
+
+    for (int t = 0; t < num_tensors; t++) {
+        quantize::Params<quantType, numBits> in_params(input_params, t * out_groups + group_id);
+        const int8_t* input_base =
+            input_data +
+            (t * elems_per_tensor + (size_t)group_id * elems_per_group + elem_offset) /
+                num_ele_int8;
+
+#pragma unroll
+        for (int i = 0; i < totalChunks; i++) {
+            if (elem_offset + i * stride < elems_per_group) {
+                int8_t local_input[num_int8_out];
+                __half dequantized[quantize::h_per_load];
+                mem_access::load_global<num_int8_out>(local_input,
+                                                      input_base + i * stride / num_ele_int8);
+                dequantize::chunk<__half, numBits, quantType>(dequantized, local_input, in_params);
+#pragma unroll
+                for (int j = 0; j < quantize::h_per_load; j++)
+                    accumulator[i * quantize::h_per_load + j] +=
+                        conversion::to<float>(dequantized[j]);
+            }
+        }
+    }
+
+    __half2 local_buffer[totalChunks * quantize::h2_per_load];
+    quantize::GroupStats<quantType> stats;
+#pragma unroll
+    for (int i = 0; i < totalChunks; i++) {
+        __half2* iteration_buffer = local_buffer + i * quantize::h2_per_load;
+#pragma unroll
+        for (int j = 0; j < quantize::h2_per_load; j++) {
+            const float* sums = accumulator + i * quantize::h_per_load + 2 * j;
+            iteration_buffer[j] = __floats2half2_rn(sums[0], sums[1]);
+        }
+        // Only the elements of the group take part in an asymmetric range.
+        if (elem_offset + i * stride < elems_per_group) {
+#pragma unroll
+            for (int j = 0; j < quantize::h2_per_load; j++) stats.update(iteration_buffer[j]);
+        }
+    }
+
+    auto params = stats.template get_params<numBits, threads>(tb, warp);
+
+    if (tb.thread_index().x == 0) params.store(reduced_params, group_id);
+
+    int8_t* output_base =
+        reduced_data + ((size_t)group_id * elems_per_group + elem_offset) / num_ele_int8;
+
+#pragma unroll
+    for (int i = 0; i < totalChunks; i++) {
+        if (elem_offset + i * stride < elems_per_group) {
+            int8_t local_output[num_int8_out];
+            quantize::_chunk<numBits, quantType>(
+                local_output, local_buffer + i * quantize::h2_per_load, params);
+            mem_access::store_global<num_int8_out>(output_base + i * stride / num_ele_int8,
+                                                   local_output);
+        }
+    }
+}
+
+#define LAUNCH_DEQUANT_REDUCE(total_chunks, threads)                                         \
+    dequant_reduce<numBits, total_chunks, threads, qType><<<grid, block, 0, stream>>>(       \
+        reduced_data, reduced_params, input_data, input_params, elems_per_group, out_groups, \
+        num_tensors);
+
+template <int numBits, quantize::Type qType>
+void launch_dequant_reduce_impl(int8_t* reduced_data,
+                                float* reduced_params,
+                                const int8_t* input_data,
+                                const float* input_params,
+                                int out_groups,
+                                int elems_per_group,
+                                int num_tensors,
+                                cudaStream_t stream)
+{
+    const int one_step_threads =
+        next_pow2((elems_per_group + quant_reduce::h_per_step - 1) / quant_reduce::h_per_step);
+    const int max_threads = (one_step_threads < quant_reduce::max_threads)
+                                ? one_step_threads
+                                : quant_reduce::max_threads;
+    const int threads = (max_threads < quant_reduce::min_threads) ? quant_reduce::min_threads
+                                                                  : max_threads;
+
+    dim3 block(threads);
+    dim3 grid(out_groups);
+
+    const int elems_per_step = threads * quantize::h_per_load;
+    const int total_chunks = (elems_per_group + elems_per_step - 1) / elems_per_step;
+
+    if (threads == 32) {
+        LAUNCH_DEQUANT_REDUCE(quant_reduce::step_granularity, 32);
+    } else if (threads == 64) {
+        LAUNCH_DEQUANT_REDUCE(quant_reduce::step_granularity, 64);
+    } else if (threads == 128) {
+        LAUNCH_DEQUANT_REDUCE(quant_reduce::step_granularity, 128);
+    } else if (threads == 256) {
+        LAUNCH_DEQUANT_REDUCE(quant_reduce::step_granularity, 256);
+    } else if (total_chunks <= 2) {
+        // <= 8192 elems
+        LAUNCH_DEQUANT_REDUCE(2, 512);
+    } else if (total_chunks <= 4) {
+        // <= 16384 elems
+        LAUNCH_DEQUANT_REDUCE(4, 512);
+    } else if (total_chunks <= 8) {
+        // <= 32768 elems
+        LAUNCH_DEQUANT_REDUCE(8, 512);
+    }
+}
+
+void launch_dequant_reduce(int8_t* reduced_data,
+                           float* reduced_params,
+                           const int8_t* input_data,
+                           const float* input_params,
+                           int num_bits,
+                           quantize::Type q_type,
+                           int out_groups,
+                           int elems_per_group,
+                           int num_tensors,
+                           cudaStream_t stream)
+{
+    if (num_bits == 4) {
+        if (q_type == quantize::Type::Asymmetric) {
+            launch_dequant_reduce_impl<4, quantize::Type::Asymmetric>(reduced_data,
+                                                                      reduced_params,
+                                                                      input_data,
+                                                                      input_params,
+                                                                      out_groups,
+                                                                      elems_per_group,
+                                                                      num_tensors,
+                                                                      stream);
+        } else {
+            launch_dequant_reduce_impl<4, quantize::Type::Symmetric>(reduced_data,
+                                                                     reduced_params,
+                                                                     input_data,
+                                                                     input_params,
+                                                                     out_groups,
+                                                                     elems_per_group,
+                                                                     num_tensors,
+                                                                     stream);
+        }
+    } else {
+        if (q_type == quantize::Type::Asymmetric) {
+            launch_dequant_reduce_impl<8, quantize::Type::Asymmetric>(reduced_data,
+                                                                      reduced_params,
+                                                                      input_data,
+                                                                      input_params,
+                                                                      out_groups,
+                                                                      elems_per_group,
+                                                                      num_tensors,
+                                                                      stream);
+        } else {
+            launch_dequant_reduce_impl<8, quantize::Type::Symmetric>(reduced_data,
+                                                                     reduced_params,
+                                                                     input_data,
+                                                                     input_params,
+                                                                     out_groups,
+                                                                     elems_per_group,
+                                                                     num_tensors,
+                                                                     stream);
+        }
+    }
+}
@@ -70,12 +70,24 @@ __global__ void cached_quantization(int8_t* __restrict__ output_data,
                         max_threads>                 \
         <<<grid, block, 0, stream>>>(output_data, params, input_data, groups, elems_per_group);
 
+#ifdef FP8_AVAILABLE
+#define LAUNCH_CACHED_QUANT_FP8_CALL(quant_type) LAUNCH_CACHED_QUANT_CALL(8, quant_type)
+#else
+#define LAUNCH_CACHED_QUANT_FP8_CALL(quant_type)
+#endif
+
 #define LAUNCH_CACHED_QUANT(                                                        \
     q_bits, quant_type, unroll_factor_in, internal_unroll_in, threads_per_group_in) \
     const int unroll_factor = unroll_factor_in;                                     \
     const int internal_unroll_l = internal_unroll_in;                               \
     const int threads_per_group = threads_per_group_in;                             \
-    if (q_bits == 4) {                                                              \
+    if (quant_type == quantize::Type::NF4) {                                        \
+        LAUNCH_CACHED_QUANT_CALL(4, quantize::Type::NF4)                            \
+    } else if (quant_type == quantize::Type::FP8_E4M3) {                            \
+        LAUNCH_CACHED_QUANT_FP8_CALL(quantize::Type::FP8_E4M3)                      \
+    } else if (quant_type == quantize::Type::FP8_E5M2) {                            \
+        LAUNCH_CACHED_QUANT_FP8_CALL(quantize::Type::FP8_E5M2)                      \
+    } else if (q_bits == 4) {                                                       \
         if (quant_type == quantize::Type::Asymmetric) {                             \
             LAUNCH_CACHED_QUANT_CALL(4, quantize::Type::Asymmetric)                 \
         } else {                                                                    \
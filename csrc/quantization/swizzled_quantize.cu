@@ -0,0 +1,204 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "ds_kernel_utils.h"
+#include "memory_access_utils.h"
+#include "quantization.h"
+#include "quantization_utils.h"
+#include "reduction_utils.h"
+
+namespace cg = cooperative_groups;
+
+namespace swiz_quant {
+constexpr int max_threads = 512;
+constexpr int min_threads = 32;
+
+constexpr int step_granularity = 2;
+constexpr int h_per_step = step_granularity * quantize::h_per_load;
+}  // namespace swiz_quant
+
+/*
+Quantization for the first hop of a hierarchical reduce-scatter. The input is the flat buffer of
+a reduce-scatter over nodes * devices_per_node ranks, optionally split in pipeline_size stages,
+so partition (node, device) of a stage is destined to rank node * devices_per_node + device.
+
+Each quantization group is written to the transposed [pipeline, device, node] slot instead, so
+the partitions going to the same device of every node are contiguous and one intra-node
+all-to-all moves them. Scales follow the same layout. Each block quantizes one group.
+*/
+template <int numBits, int totalChunks, int threads, quantize::Type quantType>
+__global__ void swizzled_quant_kernel(int8_t* __restrict__ quantized_data,
+                                      float* __restrict__ quantized_params,
+                                      const __half* __restrict__ uncompressed_data,
+                                      int elems_per_group,
+                                      int nodes,
+                                      int devices_per_node)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+
+    const int groups_per_partition = gridDim.x;
+    const int node_id = blockIdx.y / devices_per_node;
+    const int device_id = blockIdx.y % devices_per_node;
+    const int partition_id = blockIdx.y;
+    const int pipe_id = blockIdx.z;
+
+    const int input_group =
+        (pipe_id * gridDim.y + partition_id) * groups_per_partition + blockIdx.x;
+    const int output_group =
+        ((pipe_id * devices_per_node + device_id) * nodes + node_id) * groups_per_partition +
+        blockIdx.x;
+
+    const int elem_offset = tb.thread_index().x * quantize::h_per_load;
+    const int stride = threads * quantize::h_per_load;
+    const __half* input_base = uncompressed_data + (size_t)input_group * elems_per_group;
+
+    __half2 local_buffer[totalChunks * quantize::h2_per_load];
+
+    quantize::GroupStats<quantType> stats;
+#pragma unroll
+    for (int i = 0; i < totalChunks; i++) {
+        __half2* iteration_buffer = local_buffer + i * quantize::h2_per_load;
+        const int iter_offset = elem_offset + i * stride;
+        const bool do_loads = iter_offset < elems_per_group;
+
+        mem_access::load_global<quantize::granularity>(
+            iteration_buffer, input_base + iter_offset, do_loads);
+
+        // Zero-filled elements must not take part in an asymmetric range.
+        if (do_loads) {
+#pragma unroll
+            for (int j = 0; j < quantize::h2_per_load; j++) stats.update(iteration_buffer[j]);
+        }
+    }
+
+    auto params = stats.template get_params<numBits, threads>(tb, warp);
+
+    if (tb.thread_index().x == 0) params.store(quantized_params, output_group);
+
+    constexpr int num_ele_int8 = 8 / numBits;
+    constexpr int num_int8_out = quantize::h_per_load / num_ele_int8;
+    int8_t* output_base =
+        quantized_data + ((size_t)output_group * elems_per_group + elem_offset) / num_ele_int8;
+
+#pragma unroll
+    for (int i = 0; i < totalChunks; i++) {
+        if (elem_offset + i * stride < elems_per_group) {
+            int8_t local_output[num_int8_out];
+            quantize::_chunk<numBits, quantType>(
+                local_output, local_buffer + i * quantize::h2_per_load, params);
+            mem_access::store_global<num_int8_out>(output_base + i * stride / num_ele_int8,
+                                                   local_output);
+        }
+    }
+}
+
+#define LAUNCH_SWIZZLE_QUANT(total_chunks, threads)                                           \
+    swizzled_quant_kernel<numBits, total_chunks, threads, qType><<<grid, block, 0, stream>>>( \
+        q_data, q_params, input_data, elems_per_group, nodes, devices_per_node);
+
+template <int numBits, quantize::Type qType>
+void launch_swizzled_quant_impl(int8_t* q_data,
+                                float* q_params,
+                                const __half* input_data,
+                                int groups,
+                                int elems_per_group,
+                                int pipelining,
+                                int nodes,
+                                int devices_per_node,
+                                cudaStream_t stream)
+{
+    const int one_step_threads =
+        next_pow2((elems_per_group + swiz_quant::h_per_step - 1) / swiz_quant::h_per_step);
+    const int max_threads = (one_step_threads < swiz_quant::max_threads) ? one_step_threads
+                                                                         : swiz_quant::max_threads;
+    const int threads = (max_threads < swiz_quant::min_threads) ? swiz_quant::min_threads
+                                                                : max_threads;
+
+    const int partitions = nodes * devices_per_node;
+    dim3 block(threads);
+    dim3 grid(groups / (partitions * pipelining), partitions, pipelining);
+
+    const int elems_per_step = threads * quantize::h_per_load;
+    const int total_chunks = (elems_per_group + elems_per_step - 1) / elems_per_step;
+
+    if (threads == 32) {
+        LAUNCH_SWIZZLE_QUANT(swiz_quant::step_granularity, 32);
+    } else if (threads == 64) {
+        LAUNCH_SWIZZLE_QUANT(swiz_quant::step_granularity, 64);
+    } else if (threads == 128) {
+        LAUNCH_SWIZZLE_QUANT(swiz_quant::step_granularity, 128);
+    } else if (threads == 256) {
+        LAUNCH_SWIZZLE_QUANT(swiz_quant::step_granularity, 256);
+    } else if (total_chunks <= 2) {
+        // <= 8192 elems
+        LAUNCH_SWIZZLE_QUANT(2, 512);
+    } else if (total_chunks <= 4) {
+        // <= 16384 elems
+        LAUNCH_SWIZZLE_QUANT(4, 512);
+    } else if (total_chunks <= 8) {
+        // <= 32768 elems
+        LAUNCH_SWIZZLE_QUANT(8, 512);
+    }
+}
+
+void launch_swizzled_quant(int8_t* q_data,
+                           float* q_params,
+                           const __half* input_data,
+                           int num_bits,
+                           quantize::Type q_type,
+                           int groups,
+                           int elems_per_group,
+                           int pipelining,
+                           int nodes,
+                           int devices_per_node,
+                           cudaStream_t stream)
+{
+    if (num_bits == 4) {
+        if (q_type == quantize::Type::Asymmetric) {
+            launch_swizzled_quant_impl<4, quantize::Type::Asymmetric>(q_data,
+                                                                      q_params,
+                                                                      input_data,
+                                                                      groups,
+                                                                      elems_per_group,
+                                                                      pipelining,
+                                                                      nodes,
+                                                                      devices_per_node,
+                                                                      stream);
+        } else {
+            launch_swizzled_quant_impl<4, quantize::Type::Symmetric>(q_data,
+                                                                     q_params,
+                                                                     input_data,
+                                                                     groups,
+                                                                     elems_per_group,
+                                                                     pipelining,
+                                                                     nodes,
+                                                                     devices_per_node,
+                                                                     stream);
+        }
+    } else {
+        if (q_type == quantize::Type::Asymmetric) {
+            launch_swizzled_quant_impl<8, quantize::Type::Asymmetric>(q_data,
+                                                                      q_params,
+                                                                      input_data,
+                                                                      groups,
+                                                                      elems_per_group,
+                                                                      pipelining,
+                                                                      nodes,
+                                                                      devices_per_node,
+                                                                      stream);
+        } else {
+            launch_swizzled_quant_impl<8, quantize::Type::Symmetric>(q_data,
+                                                                     q_params,
+                                                                     input_data,
+                                                                     groups,
+                                                                     elems_per_group,
+                                                                     pipelining,
+                                                                     nodes,
+                                                                     devices_per_node,
+                                                                     stream);
+        }
+    }
+}
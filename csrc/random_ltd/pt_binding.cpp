@@ -6,6 +6,7 @@
 #include <torch/extension.h>
 #include <vector>
 #include "custom_cuda_layers.h"
+#include "ds_instrument.h"
 
 torch::Tensor token_sort_(torch::Tensor& unsorted_token_ids, int64_t original_tokens)
 {
@@ -13,7 +14,15 @@ torch::Tensor token_sort_(torch::Tensor& unsorted_token_ids, int64_t original_to
     const int batch_size = unsorted_token_ids.size(1);
     const int reserved_tokens = unsorted_token_ids.size(2);
 
+    // Long sequences sort through global memory
+    torch::Tensor workspace;
+    if (original_tokens > token_sort_max_shared_tokens) {
+        workspace =
+            torch::empty({layers * batch_size, original_tokens}, unsorted_token_ids.options());
+    }
+
     launch_token_sort(unsorted_token_ids.data_ptr<int32_t>(),
+                      workspace.defined() ? workspace.data_ptr<int32_t>() : nullptr,
                       layers,
                       batch_size,
                       reserved_tokens,
@@ -208,9 +217,14 @@ torch::Tensor mask_gather_gpt(torch::Tensor dense_mask, int truncated_seq_len)
 
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
-    m.def("token_sort_", &token_sort_, "Comparison free sorting algorithm (CUDA)");
-    m.def("token_gather", &token_gather, "Parallel gather of tokens (CUDA)");
-    m.def("token_scatter_", &token_scatter_, "Parallel scatter of tokens (CUDA)");
-    m.def("mask_gather_bert", &mask_gather_bert, "Token-based mask gather for BERT masking (CUDA)");
-    m.def("mask_gather_gpt", &mask_gather_gpt, "Token-based mask gather for GPT masking (CUDA)");
+    ds_instrument::def(m, "token_sort_", &token_sort_, "Comparison free sorting algorithm (CUDA)");
+    ds_instrument::def(m, "token_gather", &token_gather, "Parallel gather of tokens (CUDA)");
+    ds_instrument::def(m, "token_scatter_", &token_scatter_, "Parallel scatter of tokens (CUDA)");
+    ds_instrument::def(m,
+                       "mask_gather_bert",
+                       &mask_gather_bert,
+                       "Token-based mask gather for BERT masking (CUDA)");
+    ds_instrument::def(
+        m, "mask_gather_gpt", &mask_gather_gpt, "Token-based mask gather for GPT masking (CUDA)");
+    ds_instrument::def_queries(m);
 }
@@ -68,14 +68,17 @@ __global__ void slice_bert_mask_impl(T* output_mask,
     const int in_batch_offset = tb.group_index().y * in_batch_stride;
     const int out_batch_offset = tb.group_index().y * out_batch_stride;
 
-    const int32_t gather_row =
-        retained_indices[tb.group_index().y * truncated_seq_len + tb.group_index().z];
+    // Each layer samples its own tokens, indices are [layers, batch_size, truncated_seq_len]
+    const int32_t* gather_data =
+        retained_indices +
+        (tb.group_index().x * gridDim.y + tb.group_index().y) * truncated_seq_len;
+
+    const int32_t gather_row = gather_data[tb.group_index().z];
     const int in_seq_offset = gather_row * orig_seq_len;
     const int out_seq_offset = tb.group_index().z * truncated_seq_len;
 
     const T* in_sequence = input_mask + in_batch_offset + in_seq_offset;
     T* out_sequence = output_mask + out_layer_offset + out_batch_offset + out_seq_offset;
-    const int32_t* gather_data = retained_indices + tb.group_index().y * truncated_seq_len;
 
     for (int i = tb.thread_index().x; i < truncated_seq_len; i += blockDim.x) {
         out_sequence[i] = in_sequence[gather_data[i]];
@@ -87,9 +90,11 @@ Since the Bert mask is not causal like GPT, we can't just generate a set of
 masks for the entire model based off a single layer sample.
 
 We map the kernel as follows:
-z-dimension: layer
+x-dimension: layer
 y-dimension: batch
-x-dimension: sequence_offset
+z-dimension: sequence_offset
+
+so the rows and columns of every layer's mask are gathered in a single launch.
 */
 template <typename T>
 void launch_slice_bert_mask(T* output_mask,
@@ -22,6 +22,9 @@ constexpr int warp_size = 32;
 #endif
 
 constexpr int max_warps = threads / warp_size;
+
+static_assert(token_sort_max_shared_tokens == threads * mem_vals,
+              "The shared memory sort scans threads * mem_vals tokens");
 }  // namespace td_sort
 
 template <int VALS_PER_THREAD>
@@ -167,7 +170,101 @@ __global__ void scan_sort(int32_t* data, int reserved_tokens, int original_token
     }
 }
 
+/*
+Variant of scan_sort for rows that don't fit in shared memory. The occupancy flags of the original
+tokens live in a [rows, original_tokens] global workspace and are compacted one block-wide chunk
+at a time, carrying the running count between chunks. The indices of a row are unique, so the
+position of each set flag in the compacted output is its sorted position.
+*/
+__global__ void scan_sort_global(int32_t* data,
+                                 int32_t* flags,
+                                 int reserved_tokens,
+                                 int original_tokens)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<td_sort::warp_size> warp = cg::tiled_partition<td_sort::warp_size>(tb);
+
+    __shared__ int32_t intermediate_buffer[td_sort::max_warps];
+
+    int32_t* data_block = data + tb.group_index().x * reserved_tokens;
+    int32_t* flags_block = flags + (size_t)tb.group_index().x * original_tokens;
+
+    for (int i = tb.thread_index().x; i < original_tokens; i += td_sort::threads) {
+        flags_block[i] = 0;
+    }
+
+    tb.sync();
+
+    for (int i = tb.thread_index().x; i < reserved_tokens; i += td_sort::threads) {
+        flags_block[data_block[i]] = 1;
+    }
+
+    // Also orders the reads of data_block above before the writes below
+    tb.sync();
+
+    constexpr int chunk_size = td_sort::threads * td_sort::mem_vals;
+    int32_t running_offset = 0;
+
+    for (int chunk = 0; chunk < original_tokens; chunk += chunk_size) {
+        const int thread_base = chunk + tb.thread_index().x * td_sort::mem_vals;
+
+        int32_t local_flags[td_sort::mem_vals];
+        int32_t thread_count = 0;
+#pragma unroll
+        for (int i = 0; i < td_sort::mem_vals; i++) {
+            local_flags[i] = (thread_base + i < original_tokens) ? flags_block[thread_base + i] : 0;
+            thread_count += local_flags[i];
+        }
+
+        int32_t warp_scan = thread_count;
+#pragma unroll
+        for (int i = 1; i < td_sort::warp_size; i *= 2) {
+            int32_t step_val = warp.shfl_up(warp_scan, i);
+            warp_scan = (warp.thread_rank() < i) ? warp_scan : warp_scan + step_val;
+        }
+
+        if (warp.thread_rank() == td_sort::warp_size - 1) {
+            intermediate_buffer[warp.meta_group_rank()] = warp_scan;
+        }
+
+        tb.sync();
+
+        if (warp.meta_group_rank() == 0) {
+            int32_t warp_total =
+                (warp.thread_rank() < td_sort::max_warps) ? intermediate_buffer[warp.thread_rank()]
+                                                          : 0;
+#pragma unroll
+            for (int i = 1; i < td_sort::warp_size; i *= 2) {
+                int32_t step_val = warp.shfl_up(warp_total, i);
+                warp_total = (warp.thread_rank() < i) ? warp_total : warp_total + step_val;
+            }
+
+            if (warp.thread_rank() < td_sort::max_warps) {
+                intermediate_buffer[warp.thread_rank()] = warp_total;
+            }
+        }
+
+        tb.sync();
+
+        int32_t write_offset = running_offset + warp_scan - thread_count;
+        if (warp.meta_group_rank() > 0) {
+            write_offset += intermediate_buffer[warp.meta_group_rank() - 1];
+        }
+
+#pragma unroll
+        for (int i = 0; i < td_sort::mem_vals; i++) {
+            if (local_flags[i]) { data_block[write_offset++] = thread_base + i; }
+        }
+
+        running_offset += intermediate_buffer[td_sort::max_warps - 1];
+
+        // intermediate_buffer is rewritten by the next chunk
+        tb.sync();
+    }
+}
+
 void launch_token_sort(int32_t* indices,
+                       int32_t* workspace,
                        int layers,
                        int batch_size,
                        int reserved_size,
@@ -178,6 +275,13 @@ void launch_token_sort(int32_t* indices,
     dim3 grid(layers * batch_size);
     dim3 block(td_sort::threads);
 
+    if (original_tokens > token_sort_max_shared_tokens) {
+        assert(workspace != nullptr);
+        scan_sort_global<<<grid, block, 0, stream>>>(
+            indices, workspace, reserved_size, original_tokens);
+        return;
+    }
+
     const int vals_per_thread = (reserved_size + td_sort::threads - 1) / td_sort::threads;
 
     if (vals_per_thread == 1) {
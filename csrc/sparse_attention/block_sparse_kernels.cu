@@ -0,0 +1,623 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include <math.h>
+#include "block_sparse_attention.h"
+#include "ds_kernel_utils.h"
+#include "reduction_utils.h"
+
+namespace cg = cooperative_groups;
+
+namespace block_sparse {
+
+// Each thread block computes one block x block output tile with a 16 x 16 thread grid; a thread
+// owns a (block / 16) x (block / 16) sub-tile strided by 16 so shared memory reads broadcast.
+constexpr int threads = 256;
+constexpr int tile_threads = 16;
+constexpr int k_tile = 16;
+
+constexpr int softmax_threads = 256;
+
+// bf16 conversions are emulated before sm_80, so these are safe for every architecture.
+DS_D_INLINE float to_float(float val) { return val; }
+DS_D_INLINE float to_float(__half val) { return __half2float(val); }
+DS_D_INLINE float to_float(__nv_bfloat16 val) { return __bfloat162float(val); }
+
+template <typename T>
+DS_D_INLINE T from_float(float val);
+
+template <>
+DS_D_INLINE float from_float(float val)
+{
+    return val;
+}
+template <>
+DS_D_INLINE __half from_float(float val)
+{
+    return __float2half_rn(val);
+}
+template <>
+DS_D_INLINE __nv_bfloat16 from_float(float val)
+{
+    return __float2bfloat16_rn(val);
+}
+
+/*
+Stage a block x k_tile slice of an operand in shared memory as tile[k][i] = src(i, k), where
+src(i, k) = src[i * outer_stride + k * k_stride]. Elements past `outer_valid` or `k_valid` are
+zero filled. Consecutive threads walk whichever dimension is contiguous in memory.
+*/
+template <typename T, int BLOCK>
+DS_D_INLINE void load_tile(float (*tile)[BLOCK + 1],
+                           const T* src,
+                           int64_t outer_stride,
+                           int64_t k_stride,
+                           int outer_valid,
+                           int k_valid)
+{
+    constexpr int elems = BLOCK * k_tile;
+    const bool k_contiguous = (k_stride == 1);
+
+#pragma unroll
+    for (int e = threadIdx.x; e < elems; e += threads) {
+        const int i = k_contiguous ? e / k_tile : e % BLOCK;
+        const int k = k_contiguous ? e % k_tile : e / BLOCK;
+        tile[k][i] = (i < outer_valid && k < k_valid)
+                         ? to_float(src[i * outer_stride + k * k_stride])
+                         : 0.f;
+    }
+}
+
+/*
+acc += op(A) @ op(B) over an inner dimension of `inner` elements, with op(A)(i, k) at
+a[i * a_row + k * a_k] and op(B)(k, j) at b[j * b_col + k * b_k]. Accumulation is in fp32.
+*/
+template <typename T, int BLOCK>
+DS_D_INLINE void accumulate(float (&acc)[BLOCK / tile_threads][BLOCK / tile_threads],
+                            float (*a_tile)[BLOCK + 1],
+                            float (*b_tile)[BLOCK + 1],
+                            const T* a,
+                            int64_t a_row,
+                            int64_t a_k,
+                            int a_rows,
+                            const T* b,
+                            int64_t b_col,
+                            int64_t b_k,
+                            int b_cols,
+                            int inner)
+{
+    constexpr int micro = BLOCK / tile_threads;
+    const int tx = threadIdx.x % tile_threads;
+    const int ty = threadIdx.x / tile_threads;
+
+    for (int k0 = 0; k0 < inner; k0 += k_tile) {
+        load_tile<T, BLOCK>(a_tile, a + k0 * a_k, a_row, a_k, a_rows, inner - k0);
+        load_tile<T, BLOCK>(b_tile, b + k0 * b_k, b_col, b_k, b_cols, inner - k0);
+        __syncthreads();
+
+#pragma unroll
+        for (int k = 0; k < k_tile; k++) {
+            float a_frag[micro];
+            float b_frag[micro];
+#pragma unroll
+            for (int m = 0; m < micro; m++) a_frag[m] = a_tile[k][ty + m * tile_threads];
+#pragma unroll
+            for (int n = 0; n < micro; n++) b_frag[n] = b_tile[k][tx + n * tile_threads];
+#pragma unroll
+            for (int m = 0; m < micro; m++) {
+#pragma unroll
+                for (int n = 0; n < micro; n++) acc[m][n] += a_frag[m] * b_frag[n];
+            }
+        }
+        __syncthreads();
+    }
+}
+
+template <typename T, int BLOCK>
+DS_D_INLINE void store_tile(T* dst,
+                            int64_t row_stride,
+                            int64_t col_stride,
+                            int rows,
+                            int cols,
+                            const float (&acc)[BLOCK / tile_threads][BLOCK / tile_threads])
+{
+    constexpr int micro = BLOCK / tile_threads;
+    const int tx = threadIdx.x % tile_threads;
+    const int ty = threadIdx.x / tile_threads;
+
+#pragma unroll
+    for (int m = 0; m < micro; m++) {
+        const int row = ty + m * tile_threads;
+#pragma unroll
+        for (int n = 0; n < micro; n++) {
+            const int col = tx + n * tile_threads;
+            if (row < rows && col < cols)
+                dst[row * row_stride + col * col_stride] = from_float<T>(acc[m][n]);
+        }
+    }
+}
+
+template <int BLOCK>
+DS_D_INLINE void zero_acc(float (&acc)[BLOCK / tile_threads][BLOCK / tile_threads])
+{
+#pragma unroll
+    for (int m = 0; m < BLOCK / tile_threads; m++) {
+#pragma unroll
+        for (int n = 0; n < BLOCK / tile_threads; n++) acc[m][n] = 0.f;
+    }
+}
+
+}  // namespace block_sparse
+
+/*
+Sparse = dense x dense. One thread block per (look-up table entry, batch) computes a single
+block of the output over the full inner dimension.
+*/
+template <typename T, int BLOCK>
+__global__ void sdd_matmul_kernel(T* __restrict__ c,
+                                  const T* __restrict__ a,
+                                  const T* __restrict__ b,
+                                  const int* __restrict__ lut,
+                                  DenseStrides a_strides,
+                                  DenseStrides b_strides,
+                                  int nnz,
+                                  int inner_dim)
+{
+    __shared__ float a_tile[block_sparse::k_tile][BLOCK + 1];
+    __shared__ float b_tile[block_sparse::k_tile][BLOCK + 1];
+
+    const int* entry = lut + blockIdx.x * 4;
+    const int head = entry[0];
+    const int row = entry[1];
+    const int col = entry[2];
+    const int idx = entry[3];
+    const int64_t z = blockIdx.y;
+
+    const T* a_base = a + z * a_strides.batch + head * a_strides.head +
+                      (int64_t)row * BLOCK * a_strides.row;
+    const T* b_base = b + z * b_strides.batch + head * b_strides.head +
+                      (int64_t)col * BLOCK * b_strides.col;
+
+    float acc[BLOCK / block_sparse::tile_threads][BLOCK / block_sparse::tile_threads];
+    block_sparse::zero_acc<BLOCK>(acc);
+    block_sparse::accumulate<T, BLOCK>(acc,
+                                       a_tile,
+                                       b_tile,
+                                       a_base,
+                                       a_strides.row,
+                                       a_strides.col,
+                                       BLOCK,
+                                       b_base,
+                                       b_strides.col,
+                                       b_strides.row,
+                                       BLOCK,
+                                       inner_dim);
+
+    T* c_base = c + (z * nnz + idx) * BLOCK * BLOCK;
+    block_sparse::store_tile<T, BLOCK>(c_base, BLOCK, 1, BLOCK, BLOCK, acc);
+}
+
+/*
+Dense = sparse x dense. One thread block per (head and block row of op(A), block wide column
+tile of the output, batch) accumulates over the non-zero blocks of that row.
+*/
+template <typename T, int BLOCK>
+__global__ void dsd_matmul_kernel(T* __restrict__ c,
+                                  const T* __restrict__ a,
+                                  const T* __restrict__ b,
+                                  const int* __restrict__ lut,
+                                  DenseStrides b_strides,
+                                  DenseStrides c_strides,
+                                  int block_rows,
+                                  int nnz,
+                                  int cols,
+                                  bool trans_a)
+{
+    __shared__ float a_tile[block_sparse::k_tile][BLOCK + 1];
+    __shared__ float b_tile[block_sparse::k_tile][BLOCK + 1];
+
+    const int head = blockIdx.x / block_rows;
+    const int row = blockIdx.x % block_rows;
+    const int col_offset = blockIdx.y * BLOCK;
+    const int64_t z = blockIdx.z;
+
+    const int size = lut[2 * blockIdx.x];
+    const int* entries = lut + lut[2 * blockIdx.x + 1];
+
+    // A stored block is op(A)'s block when trans_a is false and its transpose otherwise
+    const int64_t a_row = trans_a ? 1 : BLOCK;
+    const int64_t a_k = trans_a ? BLOCK : 1;
+
+    const T* b_base = b + z * b_strides.batch + head * b_strides.head + col_offset * b_strides.col;
+
+    float acc[BLOCK / block_sparse::tile_threads][BLOCK / block_sparse::tile_threads];
+    block_sparse::zero_acc<BLOCK>(acc);
+    for (int e = 0; e < size; e++) {
+        const int k_block = entries[2 * e];
+        const int idx = entries[2 * e + 1];
+        block_sparse::accumulate<T, BLOCK>(acc,
+                                           a_tile,
+                                           b_tile,
+                                           a + (z * nnz + idx) * BLOCK * BLOCK,
+                                           a_row,
+                                           a_k,
+                                           BLOCK,
+                                           b_base + (int64_t)k_block * BLOCK * b_strides.row,
+                                           b_strides.col,
+                                           b_strides.row,
+                                           cols - col_offset,
+                                           BLOCK);
+    }
+
+    T* c_base = c + z * c_strides.batch + head * c_strides.head +
+                (int64_t)row * BLOCK * c_strides.row + col_offset * c_strides.col;
+    block_sparse::store_tile<T, BLOCK>(
+        c_base, c_strides.row, c_strides.col, BLOCK, cols - col_offset, acc);
+}
+
+/*
+Dense = dense x sparse. One thread block per (head and block column of op(B), block tall row
+tile of the output, batch) accumulates over the non-zero blocks of that column.
+*/
+template <typename T, int BLOCK>
+__global__ void dds_matmul_kernel(T* __restrict__ c,
+                                  const T* __restrict__ a,
+                                  const T* __restrict__ b,
+                                  const int* __restrict__ lut,
+                                  DenseStrides a_strides,
+                                  DenseStrides c_strides,
+                                  int block_cols,
+                                  int nnz,
+                                  int rows,
+                                  bool trans_b)
+{
+    __shared__ float a_tile[block_sparse::k_tile][BLOCK + 1];
+    __shared__ float b_tile[block_sparse::k_tile][BLOCK + 1];
+
+    const int head = blockIdx.x / block_cols;
+    const int col = blockIdx.x % block_cols;
+    const int row_offset = blockIdx.y * BLOCK;
+    const int64_t z = blockIdx.z;
+
+    const int size = lut[2 * blockIdx.x];
+    const int* entries = lut + lut[2 * blockIdx.x + 1];
+
+    const int64_t b_col = trans_b ? BLOCK : 1;
+    const int64_t b_k = trans_b ? 1 : BLOCK;
+
+    const T* a_base = a + z * a_strides.batch + head * a_strides.head + row_offset * a_strides.row;
+
+    float acc[BLOCK / block_sparse::tile_threads][BLOCK / block_sparse::tile_threads];
+    block_sparse::zero_acc<BLOCK>(acc);
+    for (int e = 0; e < size; e++) {
+        const int k_block = entries[2 * e];
+        const int idx = entries[2 * e + 1];
+        block_sparse::accumulate<T, BLOCK>(acc,
+                                           a_tile,
+                                           b_tile,
+                                           a_base + (int64_t)k_block * BLOCK * a_strides.col,
+                                           a_strides.row,
+                                           a_strides.col,
+                                           rows - row_offset,
+                                           b + (z * nnz + idx) * BLOCK * BLOCK,
+                                           b_col,
+                                           b_k,
+                                           BLOCK,
+                                           BLOCK);
+    }
+
+    T* c_base = c + z * c_strides.batch + head * c_strides.head + row_offset * c_strides.row +
+                (int64_t)col * BLOCK * c_strides.col;
+    block_sparse::store_tile<T, BLOCK>(
+        c_base, c_strides.row, c_strides.col, rows - row_offset, BLOCK, acc);
+}
+
+bool block_sparse_supported_block(int block)
+{
+    return block == 16 || block == 32 || block == 64 || block == 128;
+}
+
+#define DISPATCH_SPARSE_BLOCK(LAUNCH) \
+    if (block == 16) {                \
+        LAUNCH(16);                   \
+    } else if (block == 32) {         \
+        LAUNCH(32);                   \
+    } else if (block == 64) {         \
+        LAUNCH(64);                   \
+    } else if (block == 128) {        \
+        LAUNCH(128);                  \
+    }
+
+#define LAUNCH_SDD_MATMUL(BLOCK)                                             \
+    sdd_matmul_kernel<T, BLOCK><<<grid, block_sparse::threads, 0, stream>>>( \
+        c, a, b, lut, a_strides, b_strides, nnz, inner_dim)
+
+template <typename T>
+void launch_sdd_matmul(T* c,
+                       const T* a,
+                       const T* b,
+                       const int* lut,
+                       DenseStrides a_strides,
+                       DenseStrides b_strides,
+                       int entries,
+                       int batch,
+                       int nnz,
+                       int inner_dim,
+                       int block,
+                       cudaStream_t stream)
+{
+    if (entries == 0) return;
+    const dim3 grid(entries, batch);
+    DISPATCH_SPARSE_BLOCK(LAUNCH_SDD_MATMUL);
+}
+
+#define LAUNCH_DSD_MATMUL(BLOCK)                                             \
+    dsd_matmul_kernel<T, BLOCK><<<grid, block_sparse::threads, 0, stream>>>( \
+        c, a, b, lut, b_strides, c_strides, block_rows, nnz, cols, trans_a)
+
+template <typename T>
+void launch_dsd_matmul(T* c,
+                       const T* a,
+                       const T* b,
+                       const int* lut,
+                       DenseStrides b_strides,
+                       DenseStrides c_strides,
+                       int heads,
+                       int block_rows,
+                       int batch,
+                       int nnz,
+                       int cols,
+                       bool trans_a,
+                       int block,
+                       cudaStream_t stream)
+{
+    const dim3 grid(heads * block_rows, (cols + block - 1) / block, batch);
+    DISPATCH_SPARSE_BLOCK(LAUNCH_DSD_MATMUL);
+}
+
+#define LAUNCH_DDS_MATMUL(BLOCK)                                             \
+    dds_matmul_kernel<T, BLOCK><<<grid, block_sparse::threads, 0, stream>>>( \
+        c, a, b, lut, a_strides, c_strides, block_cols, nnz, rows, trans_b)
+
+template <typename T>
+void launch_dds_matmul(T* c,
+                       const T* a,
+                       const T* b,
+                       const int* lut,
+                       DenseStrides a_strides,
+                       DenseStrides c_strides,
+                       int heads,
+                       int block_cols,
+                       int batch,
+                       int nnz,
+                       int rows,
+                       bool trans_b,
+                       int block,
+                       cudaStream_t stream)
+{
+    const dim3 grid(heads * block_cols, (rows + block - 1) / block, batch);
+    DISPATCH_SPARSE_BLOCK(LAUNCH_DDS_MATMUL);
+}
+
+/*
+Softmax look-up table: a (size, offset) header per (head, block row), then for each non-zero
+block of the row its (block index, block column, block row, head).
+*/
+template <typename T>
+DS_D_INLINE float masked_logit(const T* x_row,
+                               const int* entry,
+                               int col_in_block,
+                               int row_in_block,
+                               int64_t z,
+                               const SoftmaxInputs<T>& inputs,
+                               int block)
+{
+    const int64_t block_id = entry[0];
+    const int64_t query = (int64_t)entry[2] * block + row_in_block;
+    const int64_t key = (int64_t)entry[1] * block + col_in_block;
+    const int head = entry[3];
+
+    float logit = block_sparse::to_float(x_row[block_id * block * block + col_in_block]);
+    logit *= inputs.scale;
+    if (inputs.rpe) {
+        logit += block_sparse::to_float(
+            inputs.rpe[z * inputs.rpe_batch_stride + head * inputs.rpe_head_stride +
+                       query * inputs.rpe_row_stride + key]);
+    }
+    if (inputs.kp_mask) {
+        const float mask =
+            block_sparse::to_float(inputs.kp_mask[z * inputs.kp_batch_stride + key]);
+        logit += inputs.kp_mask_mul ? (mask == 0.f ? -INFINITY : 0.f) : mask;
+    }
+    if (inputs.attn_mask) {
+        const float mask =
+            block_sparse::to_float(inputs.attn_mask[query * inputs.attn_row_stride + key]);
+        logit += inputs.attn_mask_mul ? (mask == 0.f ? -INFINITY : 0.f) : mask;
+    }
+    return logit;
+}
+
+/*
+One thread block per (row of a block row, batch). Each thread keeps an online max and sum over
+its strided elements, so the row is read once for the statistics and once for the output.
+Fully masked rows produce zeros.
+*/
+template <typename T>
+__global__ void block_sparse_softmax_kernel(T* x,
+                                            const int* __restrict__ lut,
+                                            SoftmaxInputs<T> inputs,
+                                            int nnz,
+                                            int block)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+
+    const int row_in_block = blockIdx.x % block;
+    const int block_row = blockIdx.x / block;
+    const int64_t z = blockIdx.y;
+
+    const int size = lut[2 * block_row];
+    const int* entries = lut + lut[2 * block_row + 1];
+    const int row_elems = size * block;
+
+    T* x_row = x + z * nnz * block * block + row_in_block * block;
+
+    float thread_max = -INFINITY;
+    float thread_sum = 0.f;
+    for (int e = tb.thread_index().x; e < row_elems; e += block_sparse::softmax_threads) {
+        const int* entry = entries + (e / block) * 4;
+        const float logit = masked_logit(x_row, entry, e % block, row_in_block, z, inputs, block);
+        if (logit == -INFINITY) continue;
+        if (logit > thread_max) {
+            thread_sum *= __expf(thread_max - logit);
+            thread_max = logit;
+        }
+        thread_sum += __expf(logit - thread_max);
+    }
+
+    float row_max = thread_max;
+    reduce::block<reduce::ROpType::Max>(tb, warp, row_max);
+    float row_sum = (thread_max == -INFINITY) ? 0.f : thread_sum * __expf(thread_max - row_max);
+    reduce::block<reduce::ROpType::Add>(tb, warp, row_sum);
+    const float inv_sum = (row_sum > 0.f) ? 1.f / row_sum : 0.f;
+
+    for (int e = tb.thread_index().x; e < row_elems; e += block_sparse::softmax_threads) {
+        const int* entry = entries + (e / block) * 4;
+        const float logit = masked_logit(x_row, entry, e % block, row_in_block, z, inputs, block);
+        const float prob = (logit == -INFINITY) ? 0.f : __expf(logit - row_max) * inv_sum;
+        x_row[(int64_t)entry[0] * block * block + e % block] =
+            block_sparse::from_float<T>(prob);
+    }
+}
+
+template <typename T>
+__global__ void block_sparse_softmax_bwd_kernel(T* dx,
+                                                const T* __restrict__ y,
+                                                const int* __restrict__ lut,
+                                                float scale,
+                                                int nnz,
+                                                int block)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+
+    const int row_in_block = blockIdx.x % block;
+    const int block_row = blockIdx.x / block;
+    const int64_t row_offset = (int64_t)blockIdx.y * nnz * block * block + row_in_block * block;
+
+    const int size = lut[2 * block_row];
+    const int* entries = lut + lut[2 * block_row + 1];
+    const int row_elems = size * block;
+
+    float dot = 0.f;
+    for (int e = tb.thread_index().x; e < row_elems; e += block_sparse::softmax_threads) {
+        const int64_t offset = row_offset + (int64_t)entries[(e / block) * 4] * block * block +
+                               e % block;
+        dot += block_sparse::to_float(y[offset]) * block_sparse::to_float(dx[offset]);
+    }
+    reduce::block<reduce::ROpType::Add>(tb, warp, dot);
+
+    for (int e = tb.thread_index().x; e < row_elems; e += block_sparse::softmax_threads) {
+        const int64_t offset = row_offset + (int64_t)entries[(e / block) * 4] * block * block +
+                               e % block;
+        const float grad = block_sparse::to_float(y[offset]) *
+                           (block_sparse::to_float(dx[offset]) - dot) * scale;
+        dx[offset] = block_sparse::from_float<T>(grad);
+    }
+}
+
+template <typename T>
+void launch_block_sparse_softmax(T* x,
+                                 const int* lut,
+                                 SoftmaxInputs<T> inputs,
+                                 int block_rows,
+                                 int batch,
+                                 int nnz,
+                                 int block,
+                                 cudaStream_t stream)
+{
+    const dim3 grid(block_rows * block, batch);
+    block_sparse_softmax_kernel<T>
+        <<<grid, block_sparse::softmax_threads, 0, stream>>>(x, lut, inputs, nnz, block);
+}
+
+template <typename T>
+void launch_block_sparse_softmax_bwd(T* dx,
+                                     const T* y,
+                                     const int* lut,
+                                     float scale,
+                                     int block_rows,
+                                     int batch,
+                                     int nnz,
+                                     int block,
+                                     cudaStream_t stream)
+{
+    const dim3 grid(block_rows * block, batch);
+    block_sparse_softmax_bwd_kernel<T>
+        <<<grid, block_sparse::softmax_threads, 0, stream>>>(dx, y, lut, scale, nnz, block);
+}
+
+#define INSTANTIATE_BLOCK_SPARSE(T)                                \
+    template void launch_sdd_matmul<T>(T*,                         \
+                                       const T*,                   \
+                                       const T*,                   \
+                                       const int*,                 \
+                                       DenseStrides,               \
+                                       DenseStrides,               \
+                                       int,                        \
+                                       int,                        \
+                                       int,                        \
+                                       int,                        \
+                                       int,                        \
+                                       cudaStream_t);              \
+    template void launch_dsd_matmul<T>(T*,                         \
+                                       const T*,                   \
+                                       const T*,                   \
+                                       const int*,                 \
+                                       DenseStrides,               \
+                                       DenseStrides,               \
+                                       int,                        \
+                                       int,                        \
+                                       int,                        \
+                                       int,                        \
+                                       int,                        \
+                                       bool,                       \
+                                       int,                        \
+                                       cudaStream_t);              \
+    template void launch_dds_matmul<T>(T*,                         \
+                                       const T*,                   \
+                                       const T*,                   \
+                                       const int*,                 \
+                                       DenseStrides,               \
+                                       DenseStrides,               \
+                                       int,                        \
+                                       int,                        \
+                                       int,                        \
+                                       int,                        \
+                                       int,                        \
+                                       bool,                       \
+                                       int,                        \
+                                       cudaStream_t);              \
+    template void launch_block_sparse_softmax<T>(T*,               \
+                                                 const int*,       \
+                                                 SoftmaxInputs<T>, \
+                                                 int,              \
+                                                 int,              \
+                                                 int,              \
+                                                 int,              \
+                                                 cudaStream_t);    \
+    template void launch_block_sparse_softmax_bwd<T>(T*,           \
+                                                     const T*,     \
+                                                     const int*,   \
+                                                     float,        \
+                                                     int,          \
+                                                     int,          \
+                                                     int,          \
+                                                     int,          \
+                                                     cudaStream_t);
+
+INSTANTIATE_BLOCK_SPARSE(float)
+INSTANTIATE_BLOCK_SPARSE(__half)
+INSTANTIATE_BLOCK_SPARSE(__nv_bfloat16)
@@ -0,0 +1,318 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include <c10/cuda/CUDAStream.h>
+#include <torch/extension.h>
+#include <algorithm>
+#include "block_sparse_attention.h"
+
+namespace {
+
+// Strides of op(t) for a [Z, H, rows, cols] tensor. Singleton batch or head dimensions
+// broadcast against the layout.
+DenseStrides dense_strides(const torch::Tensor& t, bool transposed)
+{
+    DenseStrides strides;
+    strides.batch = (t.size(0) == 1) ? 0 : t.stride(0);
+    strides.head = (t.size(1) == 1) ? 0 : t.stride(1);
+    strides.row = transposed ? t.stride(3) : t.stride(2);
+    strides.col = transposed ? t.stride(2) : t.stride(3);
+    return strides;
+}
+
+void check_inputs(const torch::Tensor& lut, int64_t block)
+{
+    TORCH_CHECK(block_sparse_supported_block(block), "block size must be 16, 32, 64 or 128");
+    TORCH_CHECK(lut.scalar_type() == torch::kInt32 && lut.is_contiguous(),
+                "look-up tables must be contiguous int32 tensors");
+}
+
+template <typename T>
+T* ptr(torch::Tensor& t)
+{
+    return reinterpret_cast<T*>(t.data_ptr());
+}
+
+template <typename T>
+const T* const_ptr(const torch::Tensor& t)
+{
+    return reinterpret_cast<const T*>(t.data_ptr());
+}
+
+template <typename T>
+void sdd_matmul_impl(torch::Tensor& c,
+                     const torch::Tensor& a,
+                     const torch::Tensor& b,
+                     const torch::Tensor& lut,
+                     bool trans_a,
+                     bool trans_b,
+                     int inner_dim,
+                     int block)
+{
+    launch_sdd_matmul(ptr<T>(c),
+                      const_ptr<T>(a),
+                      const_ptr<T>(b),
+                      lut.data_ptr<int>(),
+                      dense_strides(a, trans_a),
+                      dense_strides(b, trans_b),
+                      lut.numel() / 4,
+                      c.size(0),
+                      c.size(1),
+                      inner_dim,
+                      block,
+                      at::cuda::getCurrentCUDAStream());
+}
+
+template <typename T>
+void dsd_matmul_impl(torch::Tensor& c,
+                     const torch::Tensor& a,
+                     const torch::Tensor& b,
+                     const torch::Tensor& lut,
+                     bool trans_a,
+                     bool trans_b,
+                     int block_rows,
+                     int block)
+{
+    launch_dsd_matmul(ptr<T>(c),
+                      const_ptr<T>(a),
+                      const_ptr<T>(b),
+                      lut.data_ptr<int>(),
+                      dense_strides(b, trans_b),
+                      dense_strides(c, false),
+                      c.size(1),
+                      block_rows,
+                      c.size(0),
+                      a.size(1),
+                      c.size(3),
+                      trans_a,
+                      block,
+                      at::cuda::getCurrentCUDAStream());
+}
+
+template <typename T>
+void dds_matmul_impl(torch::Tensor& c,
+                     const torch::Tensor& a,
+                     const torch::Tensor& b,
+                     const torch::Tensor& lut,
+                     bool trans_a,
+                     bool trans_b,
+                     int block_cols,
+                     int block)
+{
+    launch_dds_matmul(ptr<T>(c),
+                      const_ptr<T>(a),
+                      const_ptr<T>(b),
+                      lut.data_ptr<int>(),
+                      dense_strides(a, trans_a),
+                      dense_strides(c, false),
+                      c.size(1),
+                      block_cols,
+                      c.size(0),
+                      b.size(1),
+                      c.size(2),
+                      trans_b,
+                      block,
+                      at::cuda::getCurrentCUDAStream());
+}
+
+template <typename T>
+void softmax_impl(torch::Tensor& x,
+                  const torch::Tensor& lut,
+                  const torch::Tensor& rpe,
+                  const torch::Tensor& kp_mask,
+                  const torch::Tensor& attn_mask,
+                  float scale,
+                  bool kp_mask_mul,
+                  bool attn_mask_mul,
+                  int block_rows,
+                  int block)
+{
+    SoftmaxInputs<T> inputs;
+    inputs.rpe = rpe.numel() ? const_ptr<T>(rpe) : nullptr;
+    inputs.kp_mask = kp_mask.numel() ? const_ptr<T>(kp_mask) : nullptr;
+    inputs.attn_mask = attn_mask.numel() ? const_ptr<T>(attn_mask) : nullptr;
+    inputs.rpe_batch_stride = rpe.numel() ? rpe.stride(0) : 0;
+    inputs.rpe_head_stride = rpe.numel() ? rpe.stride(1) : 0;
+    inputs.rpe_row_stride = rpe.numel() ? rpe.stride(2) : 0;
+    inputs.kp_batch_stride = kp_mask.numel() ? kp_mask.stride(0) : 0;
+    inputs.attn_row_stride = attn_mask.numel() ? attn_mask.stride(0) : 0;
+    inputs.scale = scale;
+    inputs.kp_mask_mul = kp_mask_mul;
+    inputs.attn_mask_mul = attn_mask_mul;
+
+    launch_block_sparse_softmax(ptr<T>(x),
+                                lut.data_ptr<int>(),
+                                inputs,
+                                block_rows,
+                                x.size(0),
+                                x.size(1),
+                                block,
+                                at::cuda::getCurrentCUDAStream());
+}
+
+template <typename T>
+void softmax_bwd_impl(torch::Tensor& dx,
+                      const torch::Tensor& y,
+                      const torch::Tensor& lut,
+                      float scale,
+                      int block_rows,
+                      int block)
+{
+    launch_block_sparse_softmax_bwd(ptr<T>(dx),
+                                    const_ptr<T>(y),
+                                    lut.data_ptr<int>(),
+                                    scale,
+                                    block_rows,
+                                    dx.size(0),
+                                    dx.size(1),
+                                    block,
+                                    at::cuda::getCurrentCUDAStream());
+}
+
+}  // namespace
+
+#define DISPATCH_SPARSE_TYPE(TYPE, NAME, ...)                                  \
+    if (TYPE == at::kHalf) {                                                   \
+        NAME<__half>(__VA_ARGS__);                                             \
+    } else if (TYPE == at::kBFloat16) {                                        \
+        NAME<__nv_bfloat16>(__VA_ARGS__);                                      \
+    } else if (TYPE == at::kFloat) {                                           \
+        NAME<float>(__VA_ARGS__);                                              \
+    } else {                                                                   \
+        TORCH_CHECK(false, #NAME " supports float, half and bfloat16 inputs"); \
+    }
+
+/*
+Sparse = op(a) @ op(b) for [Z, H, rows, cols] dense inputs, over the blocks listed by the
+`sdd_segment` look-up table. Returns [Z, nnz, block, block].
+*/
+torch::Tensor sdd_matmul(torch::Tensor& a,
+                         torch::Tensor& b,
+                         torch::Tensor& lut,
+                         bool trans_a,
+                         bool trans_b,
+                         int64_t block,
+                         int64_t nnz)
+{
+    check_inputs(lut, block);
+    TORCH_CHECK(a.dim() == 4 && b.dim() == 4, "dense inputs must be [Z, H, rows, cols]");
+    const int64_t inner_dim = trans_a ? a.size(2) : a.size(3);
+    TORCH_CHECK(inner_dim == (trans_b ? b.size(3) : b.size(2)), "inner dimensions do not match");
+
+    auto c = torch::empty({std::max(a.size(0), b.size(0)), nnz, block, block}, a.options());
+    DISPATCH_SPARSE_TYPE(a.scalar_type(),
+                         sdd_matmul_impl,
+                         c,
+                         a,
+                         b,
+                         lut,
+                         trans_a,
+                         trans_b,
+                         inner_dim,
+                         block);
+    return c;
+}
+
+/*
+Dense = op(a) @ op(b) for a [Z, nnz, block, block] sparse `a` whose op(a) layout has
+`block_rows` rows per head. Returns [Z, H, block_rows * block, cols of op(b)].
+*/
+torch::Tensor dsd_matmul(torch::Tensor& a,
+                         torch::Tensor& b,
+                         torch::Tensor& lut,
+                         bool trans_a,
+                         bool trans_b,
+                         int64_t block,
+                         int64_t heads,
+                         int64_t block_rows)
+{
+    check_inputs(lut, block);
+    TORCH_CHECK(a.is_contiguous(), "block-sparse tensors must be contiguous");
+    TORCH_CHECK(b.dim() == 4, "dense inputs must be [Z, H, rows, cols]");
+    TORCH_CHECK(b.size(0) == a.size(0), "sparse and dense inputs must have the same batch size");
+    const int64_t cols = trans_b ? b.size(2) : b.size(3);
+
+    auto c = torch::empty({a.size(0), heads, block_rows * block, cols}, b.options());
+    DISPATCH_SPARSE_TYPE(
+        a.scalar_type(), dsd_matmul_impl, c, a, b, lut, trans_a, trans_b, block_rows, block);
+    return c;
+}
+
+/*
+Dense = op(a) @ op(b) for a [Z, nnz, block, block] sparse `b` whose op(b) layout has
+`block_cols` columns per head. Returns [Z, H, rows of op(a), block_cols * block].
+*/
+torch::Tensor dds_matmul(torch::Tensor& a,
+                         torch::Tensor& b,
+                         torch::Tensor& lut,
+                         bool trans_a,
+                         bool trans_b,
+                         int64_t block,
+                         int64_t heads,
+                         int64_t block_cols)
+{
+    check_inputs(lut, block);
+    TORCH_CHECK(b.is_contiguous(), "block-sparse tensors must be contiguous");
+    TORCH_CHECK(a.dim() == 4, "dense inputs must be [Z, H, rows, cols]");
+    TORCH_CHECK(a.size(0) == b.size(0), "sparse and dense inputs must have the same batch size");
+    const int64_t rows = trans_a ? a.size(3) : a.size(2);
+
+    auto c = torch::empty({b.size(0), heads, rows, block_cols * block}, a.options());
+    DISPATCH_SPARSE_TYPE(
+        a.scalar_type(), dds_matmul_impl, c, a, b, lut, trans_a, trans_b, block_cols, block);
+    return c;
+}
+
+// Empty rpe / kp_mask / attn_mask tensors disable the corresponding term. Runs in place.
+torch::Tensor softmax_fwd(torch::Tensor& x,
+                          torch::Tensor& lut,
+                          torch::Tensor& rpe,
+                          torch::Tensor& kp_mask,
+                          torch::Tensor& attn_mask,
+                          float scale,
+                          bool kp_mask_mul,
+                          bool attn_mask_mul,
+                          int64_t block,
+                          int64_t block_rows)
+{
+    check_inputs(lut, block);
+    TORCH_CHECK(x.is_contiguous(), "block-sparse tensors must be contiguous");
+    DISPATCH_SPARSE_TYPE(x.scalar_type(),
+                         softmax_impl,
+                         x,
+                         lut,
+                         rpe,
+                         kp_mask,
+                         attn_mask,
+                         scale,
+                         kp_mask_mul,
+                         attn_mask_mul,
+                         block_rows,
+                         block);
+    return x;
+}
+
+// Gradient of softmax_fwd given its output `y`, written in place into `dx`.
+torch::Tensor softmax_bwd(torch::Tensor& dx,
+                          torch::Tensor& y,
+                          torch::Tensor& lut,
+                          float scale,
+                          int64_t block,
+                          int64_t block_rows)
+{
+    check_inputs(lut, block);
+    TORCH_CHECK(dx.is_contiguous() && y.is_contiguous(), "block-sparse tensors must be contiguous");
+    DISPATCH_SPARSE_TYPE(dx.scalar_type(), softmax_bwd_impl, dx, y, lut, scale, block_rows, block);
+    return dx;
+}
+
+PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
+{
+    m.def("sdd_matmul", &sdd_matmul, "Block-sparse = dense x dense (CUDA)");
+    m.def("dsd_matmul", &dsd_matmul, "Dense = block-sparse x dense (CUDA)");
+    m.def("dds_matmul", &dds_matmul, "Dense = dense x block-sparse (CUDA)");
+    m.def("softmax_fwd", &softmax_fwd, "Block-sparse softmax forward (CUDA)");
+    m.def("softmax_bwd", &softmax_bwd, "Block-sparse softmax backward (CUDA)");
+}
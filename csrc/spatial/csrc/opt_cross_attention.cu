@@ -0,0 +1,197 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include <cassert>
+#include <cmath>
+#include "spatial_cuda_layers.h"
+
+namespace cg = cooperative_groups;
+
+/*
+Fused cross-attention for the UNet transformer blocks. Queries come from the image
+([batch, q_len, heads * head_size]) while keys and values come from a short text context
+([batch, kv_len, heads * head_size]), so the whole softmax(q k^T * scale) v product is
+computed per head in one pass with an online softmax over 32-key tiles. Inputs are read and
+the output is written in the un-transposed token-major layout, so no head transposes or
+score buffers are needed around the kernel.
+*/
+
+namespace xattn_opt {
+constexpr int warp_size = 32;
+constexpr int threads = 128;
+constexpr int warps = threads / warp_size;
+constexpr int rows_per_warp = 2;
+constexpr int rows_per_block = warps * rows_per_warp;
+// One key per lane while computing scores
+constexpr int keys_per_tile = warp_size;
+constexpr int max_head_size = 256;
+}  // namespace xattn_opt
+
+// Padding by one __half2 keeps the per-lane key rows on distinct banks for head sizes that
+// are multiples of 4.
+__host__ __device__ __forceinline__ int kv_tile_pitch(int head_size) { return head_size + 2; }
+
+template <int VALS_PER_LANE>
+__global__ void opt_cross_attention(__half* output,
+                                    const __half* query,
+                                    const __half* key,
+                                    const __half* value,
+                                    int q_len,
+                                    int kv_len,
+                                    int heads,
+                                    int head_size,
+                                    float scale)
+{
+    extern __shared__ float shmem[];
+
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<xattn_opt::warp_size> warp =
+        cg::tiled_partition<xattn_opt::warp_size>(tb);
+
+    const int lane = warp.thread_rank();
+    const int warp_id = threadIdx.x / xattn_opt::warp_size;
+    const int head = blockIdx.y;
+    const int batch = blockIdx.z;
+    const int hidden = heads * head_size;
+    const int pitch = kv_tile_pitch(head_size);
+    const int first_row = blockIdx.x * xattn_opt::rows_per_block;
+
+    float* q_tile = shmem;
+    __half* k_tile = reinterpret_cast<__half*>(q_tile + xattn_opt::rows_per_block * head_size);
+    __half* v_tile = k_tile + xattn_opt::keys_per_tile * pitch;
+
+    const __half* q_base = query + (batch * q_len) * hidden + head * head_size;
+    const __half* k_base = key + (batch * kv_len) * hidden + head * head_size;
+    const __half* v_base = value + (batch * kv_len) * hidden + head * head_size;
+
+    // Stage the pre-scaled queries of this block once
+    for (int i = threadIdx.x; i < xattn_opt::rows_per_block * head_size; i += xattn_opt::threads) {
+        const int row = first_row + i / head_size;
+        q_tile[i] = (row < q_len) ? __half2float(q_base[row * hidden + i % head_size]) * scale
+                                  : 0.f;
+    }
+
+    float row_max[xattn_opt::rows_per_warp];
+    float row_sum[xattn_opt::rows_per_warp];
+    float acc[xattn_opt::rows_per_warp][VALS_PER_LANE];
+
+#pragma unroll
+    for (int r = 0; r < xattn_opt::rows_per_warp; r++) {
+        row_max[r] = -INFINITY;
+        row_sum[r] = 0.f;
+#pragma unroll
+        for (int v = 0; v < VALS_PER_LANE; v++) { acc[r][v] = 0.f; }
+    }
+
+    for (int tile = 0; tile < kv_len; tile += xattn_opt::keys_per_tile) {
+        // Previous tile is fully consumed (and the queries are staged on the first pass)
+        tb.sync();
+        for (int i = threadIdx.x; i < xattn_opt::keys_per_tile * head_size;
+             i += xattn_opt::threads) {
+            const int k = i / head_size;
+            const int d = i % head_size;
+            const bool in_range = tile + k < kv_len;
+            const __half zero = __float2half(0.f);
+            k_tile[k * pitch + d] = in_range ? k_base[(tile + k) * hidden + d] : zero;
+            v_tile[k * pitch + d] = in_range ? v_base[(tile + k) * hidden + d] : zero;
+        }
+        tb.sync();
+
+        const int tile_keys = min(xattn_opt::keys_per_tile, kv_len - tile);
+        const bool valid_key = lane < tile_keys;
+        const __half* k_row = k_tile + lane * pitch;
+
+#pragma unroll
+        for (int r = 0; r < xattn_opt::rows_per_warp; r++) {
+            const float* q_row = q_tile + (warp_id * xattn_opt::rows_per_warp + r) * head_size;
+
+            float score = 0.f;
+            for (int d = 0; d < head_size; d++) { score += q_row[d] * __half2float(k_row[d]); }
+            score = valid_key ? score : -INFINITY;
+
+            float tile_max = score;
+#pragma unroll
+            for (int i = 1; i < xattn_opt::warp_size; i *= 2) {
+                tile_max = fmaxf(tile_max, warp.shfl_xor(tile_max, i));
+            }
+
+            const float new_max = fmaxf(row_max[r], tile_max);
+            const float correction = __expf(row_max[r] - new_max);
+            const float prob = valid_key ? __expf(score - new_max) : 0.f;
+
+            float prob_sum = prob;
+#pragma unroll
+            for (int i = 1; i < xattn_opt::warp_size; i *= 2) {
+                prob_sum += warp.shfl_xor(prob_sum, i);
+            }
+
+            row_max[r] = new_max;
+            row_sum[r] = row_sum[r] * correction + prob_sum;
+
+#pragma unroll
+            for (int v = 0; v < VALS_PER_LANE; v++) { acc[r][v] *= correction; }
+
+            for (int k = 0; k < tile_keys; k++) {
+                const float key_prob = warp.shfl(prob, k);
+                const __half* v_row = v_tile + k * pitch;
+#pragma unroll
+                for (int v = 0; v < VALS_PER_LANE; v++) {
+                    const int d = lane + v * xattn_opt::warp_size;
+                    if (d < head_size) { acc[r][v] += key_prob * __half2float(v_row[d]); }
+                }
+            }
+        }
+    }
+
+#pragma unroll
+    for (int r = 0; r < xattn_opt::rows_per_warp; r++) {
+        const int row = first_row + warp_id * xattn_opt::rows_per_warp + r;
+        if (row < q_len) {
+            const float inv_sum = 1.f / row_sum[r];
+            __half* out_row = output + (batch * q_len + row) * hidden + head * head_size;
+#pragma unroll
+            for (int v = 0; v < VALS_PER_LANE; v++) {
+                const int d = lane + v * xattn_opt::warp_size;
+                if (d < head_size) { out_row[d] = __float2half(acc[r][v] * inv_sum); }
+            }
+        }
+    }
+}
+
+#define LAUNCH_CROSS_ATTENTION(VALS_PER_LANE)                                \
+    opt_cross_attention<VALS_PER_LANE><<<grid, block, shmem_size, stream>>>( \
+        output, query, key, value, q_len, kv_len, heads, head_size, scale)
+
+void launch_opt_cross_attention(__half* output,
+                                const __half* query,
+                                const __half* key,
+                                const __half* value,
+                                int batch_size,
+                                int q_len,
+                                int kv_len,
+                                int heads,
+                                int head_size,
+                                float scale,
+                                cudaStream_t stream)
+{
+    assert(head_size <= xattn_opt::max_head_size);
+    assert(kv_len > 0);
+
+    dim3 block(xattn_opt::threads);
+    dim3 grid((q_len + xattn_opt::rows_per_block - 1) / xattn_opt::rows_per_block,
+              heads,
+              batch_size);
+    const size_t shmem_size = xattn_opt::rows_per_block * head_size * sizeof(float) +
+                              2 * xattn_opt::keys_per_tile * kv_tile_pitch(head_size) *
+                                  sizeof(__half);
+
+    if (head_size <= 64) {
+        LAUNCH_CROSS_ATTENTION(2);
+    } else if (head_size <= 128) {
+        LAUNCH_CROSS_ATTENTION(4);
+    } else {
+        LAUNCH_CROSS_ATTENTION(8);
+    }
+}
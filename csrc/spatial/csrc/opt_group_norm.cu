@@ -0,0 +1,264 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include <cassert>
+#include "memory_access_utils.h"
+#include "spatial_cuda_layers.h"
+
+/*
+Fused channels-last group norm. The normalized value is `activation (+ bias) (+ residual)`,
+where `bias` broadcasts over the spatial dimension (e.g. a projected time embedding) and
+`residual` is a full activation. Statistics for each (image, group) are gathered by a
+partial reduction over spatial tiles so that small batches still fill the device, then a
+second elementwise pass normalizes, applies the affine transform and, optionally, SiLU.
+*/
+
+namespace gn_opt {
+constexpr int threads = 256;
+constexpr int steps = 4;
+constexpr int granularity = 16;
+constexpr int vals_per_h = granularity / sizeof(__half);
+constexpr int vals_per_h2 = granularity / sizeof(__half2);
+constexpr int stride = vals_per_h * threads;
+constexpr int vals_per_block = stride * steps;
+}  // namespace gn_opt
+
+__device__ __forceinline__ void load_group_norm_input(float* vals,
+                                                      const __half* activation,
+                                                      const __half* bias,
+                                                      const __half* residual,
+                                                      int offset,
+                                                      int bias_offset)
+{
+    __half2 act_buffer[gn_opt::vals_per_h2];
+    mem_access::load_global<gn_opt::granularity>(act_buffer, activation + offset);
+
+#pragma unroll
+    for (int j = 0; j < gn_opt::vals_per_h2; j++) {
+        const float2 act = __half22float2(act_buffer[j]);
+        vals[2 * j] = act.x;
+        vals[2 * j + 1] = act.y;
+    }
+
+    if (bias) {
+        __half2 bias_buffer[gn_opt::vals_per_h2];
+        mem_access::load_global<gn_opt::granularity>(bias_buffer, bias + bias_offset);
+#pragma unroll
+        for (int j = 0; j < gn_opt::vals_per_h2; j++) {
+            const float2 b = __half22float2(bias_buffer[j]);
+            vals[2 * j] += b.x;
+            vals[2 * j + 1] += b.y;
+        }
+    }
+
+    if (residual) {
+        __half2 res_buffer[gn_opt::vals_per_h2];
+        mem_access::load_global<gn_opt::granularity>(res_buffer, residual + offset);
+#pragma unroll
+        for (int j = 0; j < gn_opt::vals_per_h2; j++) {
+            const float2 res = __half22float2(res_buffer[j]);
+            vals[2 * j] += res.x;
+            vals[2 * j + 1] += res.y;
+        }
+    }
+}
+
+/*
+Accumulates sum and sum of squares for every group of one spatial tile of image
+`blockIdx.y` into `stats` ([batch, groups, 2], zero-initialized). A 16B vector may straddle
+two groups when the channels per group is not a multiple of 8, so partial sums are flushed
+through shared memory whenever the group changes.
+*/
+__global__ void opt_group_norm_stats(float* stats,
+                                     const __half* activation,
+                                     const __half* bias,
+                                     const __half* residual,
+                                     int bias_batch_stride,
+                                     int seq_len,
+                                     int channels,
+                                     int groups)
+{
+    extern __shared__ float group_sums[];
+
+    const int batch = blockIdx.y;
+    const int image_vals = seq_len * channels;
+    const int channels_per_group = channels / groups;
+
+    for (int i = threadIdx.x; i < 2 * groups; i += gn_opt::threads) { group_sums[i] = 0.f; }
+    __syncthreads();
+
+    const int id = blockIdx.x * gn_opt::vals_per_block + threadIdx.x * gn_opt::vals_per_h;
+
+    for (int i = 0; i < gn_opt::steps; i++) {
+        if (id + i * gn_opt::stride < image_vals) {
+            const int channel = (id + i * gn_opt::stride) % channels;
+            float vals[gn_opt::vals_per_h];
+            load_group_norm_input(vals,
+                                  activation,
+                                  bias,
+                                  residual,
+                                  batch * image_vals + id + i * gn_opt::stride,
+                                  batch * bias_batch_stride + channel);
+
+            int group = channel / channels_per_group;
+            int group_end = (group + 1) * channels_per_group;
+            float sum = 0.f;
+            float sum_sq = 0.f;
+
+#pragma unroll
+            for (int j = 0; j < gn_opt::vals_per_h; j++) {
+                if (channel + j == group_end) {
+                    atomicAdd(group_sums + 2 * group, sum);
+                    atomicAdd(group_sums + 2 * group + 1, sum_sq);
+                    sum = 0.f;
+                    sum_sq = 0.f;
+                    group++;
+                    group_end += channels_per_group;
+                }
+                sum += vals[j];
+                sum_sq += vals[j] * vals[j];
+            }
+            atomicAdd(group_sums + 2 * group, sum);
+            atomicAdd(group_sums + 2 * group + 1, sum_sq);
+        }
+    }
+    __syncthreads();
+
+    for (int i = threadIdx.x; i < 2 * groups; i += gn_opt::threads) {
+        atomicAdd(stats + 2 * batch * groups + i, group_sums[i]);
+    }
+}
+
+template <bool DoSilu>
+__global__ void opt_group_norm_apply(__half* output,
+                                     const float* stats,
+                                     const __half* activation,
+                                     const __half* bias,
+                                     const __half* residual,
+                                     const __half* gamma,
+                                     const __half* beta,
+                                     int bias_batch_stride,
+                                     int total_vals,
+                                     int seq_len,
+                                     int channels,
+                                     int groups,
+                                     float eps)
+{
+    const int image_vals = seq_len * channels;
+    const int channels_per_group = channels / groups;
+    const float inv_count = 1.f / (float)(seq_len * channels_per_group);
+
+    const int id = blockIdx.x * gn_opt::vals_per_block + threadIdx.x * gn_opt::vals_per_h;
+
+    for (int i = 0; i < gn_opt::steps; i++) {
+        if (id + i * gn_opt::stride < total_vals) {
+            const int offset = id + i * gn_opt::stride;
+            const int batch = offset / image_vals;
+            const int channel = offset % channels;
+
+            float vals[gn_opt::vals_per_h];
+            load_group_norm_input(
+                vals, activation, bias, residual, offset, batch * bias_batch_stride + channel);
+
+            __half2 gamma_buffer[gn_opt::vals_per_h2];
+            __half2 beta_buffer[gn_opt::vals_per_h2];
+            mem_access::load_global<gn_opt::granularity>(gamma_buffer, gamma + channel);
+            mem_access::load_global<gn_opt::granularity>(beta_buffer, beta + channel);
+            const __half* gamma_vals = reinterpret_cast<const __half*>(gamma_buffer);
+            const __half* beta_vals = reinterpret_cast<const __half*>(beta_buffer);
+
+            int cached_group = -1;
+            float mean = 0.f;
+            float rstd = 0.f;
+            __half2 out_buffer[gn_opt::vals_per_h2];
+            __half* out_vals = reinterpret_cast<__half*>(out_buffer);
+
+#pragma unroll
+            for (int j = 0; j < gn_opt::vals_per_h; j++) {
+                const int group = (channel + j) / channels_per_group;
+                if (group != cached_group) {
+                    const float* group_stats = stats + 2 * (batch * groups + group);
+                    mean = group_stats[0] * inv_count;
+                    const float var = fmaxf(group_stats[1] * inv_count - mean * mean, 0.f);
+                    rstd = rsqrtf(var + eps);
+                    cached_group = group;
+                }
+
+                float val = (vals[j] - mean) * rstd * __half2float(gamma_vals[j]) +
+                            __half2float(beta_vals[j]);
+                if (DoSilu) { val = val / (1.f + __expf(-val)); }
+                out_vals[j] = __float2half(val);
+            }
+
+            mem_access::store_global<gn_opt::granularity>(output + offset, out_buffer);
+        }
+    }
+}
+
+void launch_opt_group_norm(__half* output,
+                           float* stats,
+                           const __half* activation,
+                           const __half* bias,
+                           const __half* residual,
+                           const __half* gamma,
+                           const __half* beta,
+                           int bias_batch_stride,
+                           int batch_size,
+                           int seq_len,
+                           int channels,
+                           int groups,
+                           float eps,
+                           bool silu,
+                           cudaStream_t stream)
+{
+    // Should evaluate `true` for reasonable hidden sizes
+    assert(channels % gn_opt::vals_per_h == 0);
+    assert(channels % groups == 0);
+
+    const int image_vals = seq_len * channels;
+    const int total_vals = batch_size * image_vals;
+
+    cudaMemsetAsync(stats, 0, 2 * batch_size * groups * sizeof(float), stream);
+
+    dim3 block(gn_opt::threads);
+    dim3 stats_grid((image_vals + gn_opt::vals_per_block - 1) / gn_opt::vals_per_block,
+                    batch_size);
+    const size_t shmem = 2 * groups * sizeof(float);
+
+    opt_group_norm_stats<<<stats_grid, block, shmem, stream>>>(
+        stats, activation, bias, residual, bias_batch_stride, seq_len, channels, groups);
+
+    dim3 grid((total_vals + gn_opt::vals_per_block - 1) / gn_opt::vals_per_block);
+
+    if (silu) {
+        opt_group_norm_apply<true><<<grid, block, 0, stream>>>(output,
+                                                                stats,
+                                                                activation,
+                                                                bias,
+                                                                residual,
+                                                                gamma,
+                                                                beta,
+                                                                bias_batch_stride,
+                                                                total_vals,
+                                                                seq_len,
+                                                                channels,
+                                                                groups,
+                                                                eps);
+    } else {
+        opt_group_norm_apply<false><<<grid, block, 0, stream>>>(output,
+                                                                 stats,
+                                                                 activation,
+                                                                 bias,
+                                                                 residual,
+                                                                 gamma,
+                                                                 beta,
+                                                                 bias_batch_stride,
+                                                                 total_vals,
+                                                                 seq_len,
+                                                                 channels,
+                                                                 groups,
+                                                                 eps);
+    }
+}
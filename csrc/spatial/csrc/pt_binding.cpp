@@ -104,9 +104,160 @@ at::Tensor seq_bias_add_bias_add(at::Tensor& input,
     return output;
 }
 
+at::Tensor group_norm_impl(at::Tensor& input,
+                           const __half* bias,
+                           int bias_batch_stride,
+                           const __half* residual,
+                           at::Tensor& gamma,
+                           at::Tensor& beta,
+                           int64_t groups,
+                           float eps,
+                           bool silu)
+{
+    assert(input.dtype() == at::kHalf);
+    assert(gamma.dtype() == at::kHalf && beta.dtype() == at::kHalf);
+
+    ChannelsLastProblem problem = dimension_problem(input);
+
+    auto output = at::empty_like(input);
+    auto stats = at::empty({problem.batch_size, groups, 2}, input.options().dtype(at::kFloat));
+
+    launch_opt_group_norm((__half*)output.data_ptr(),
+                          (float*)stats.data_ptr(),
+                          (const __half*)input.data_ptr(),
+                          bias,
+                          residual,
+                          (const __half*)gamma.data_ptr(),
+                          (const __half*)beta.data_ptr(),
+                          bias_batch_stride,
+                          problem.batch_size,
+                          problem.seq_len,
+                          problem.channels,
+                          groups,
+                          eps,
+                          silu,
+                          at::cuda::getCurrentCUDAStream());
+
+    return output;
+}
+
+// Bias is either per-channel ([C]) or per-image ([B, C]), e.g. a projected time embedding.
+int group_norm_bias_stride(at::Tensor& bias)
+{
+    assert(bias.dtype() == at::kHalf && bias.is_contiguous());
+    return (bias.dim() == 2 && bias.size(0) > 1) ? bias.size(-1) : 0;
+}
+
+at::Tensor nhwc_group_norm(at::Tensor& input,
+                           at::Tensor& gamma,
+                           at::Tensor& beta,
+                           int64_t groups,
+                           float eps,
+                           bool silu)
+{
+    return group_norm_impl(input, nullptr, 0, nullptr, gamma, beta, groups, eps, silu);
+}
+
+at::Tensor nhwc_bias_group_norm(at::Tensor& input,
+                                at::Tensor& bias,
+                                at::Tensor& gamma,
+                                at::Tensor& beta,
+                                int64_t groups,
+                                float eps,
+                                bool silu)
+{
+    return group_norm_impl(input,
+                           (const __half*)bias.data_ptr(),
+                           group_norm_bias_stride(bias),
+                           nullptr,
+                           gamma,
+                           beta,
+                           groups,
+                           eps,
+                           silu);
+}
+
+at::Tensor nhwc_add_group_norm(at::Tensor& input,
+                               at::Tensor& residual,
+                               at::Tensor& gamma,
+                               at::Tensor& beta,
+                               int64_t groups,
+                               float eps,
+                               bool silu)
+{
+    assert(residual.sizes() == input.sizes() && residual.strides() == input.strides());
+    return group_norm_impl(input,
+                           nullptr,
+                           0,
+                           (const __half*)residual.data_ptr(),
+                           gamma,
+                           beta,
+                           groups,
+                           eps,
+                           silu);
+}
+
+at::Tensor nhwc_bias_add_group_norm(at::Tensor& input,
+                                    at::Tensor& bias,
+                                    at::Tensor& residual,
+                                    at::Tensor& gamma,
+                                    at::Tensor& beta,
+                                    int64_t groups,
+                                    float eps,
+                                    bool silu)
+{
+    assert(residual.sizes() == input.sizes() && residual.strides() == input.strides());
+    return group_norm_impl(input,
+                           (const __half*)bias.data_ptr(),
+                           group_norm_bias_stride(bias),
+                           (const __half*)residual.data_ptr(),
+                           gamma,
+                           beta,
+                           groups,
+                           eps,
+                           silu);
+}
+
+/*
+softmax(query @ key^T * scale) @ value per head, with query [B, S_q, H * D] and key/value
+[B, S_kv, H * D]. Returns [B, S_q, H * D], ready for the output projection.
+*/
+at::Tensor cross_attention(at::Tensor& query,
+                           at::Tensor& key,
+                           at::Tensor& value,
+                           int64_t heads,
+                           float scale)
+{
+    assert(query.dtype() == at::kHalf);
+    assert(query.is_contiguous() && key.is_contiguous() && value.is_contiguous());
+    assert(key.sizes() == value.sizes() && key.size(2) == query.size(2));
+    assert(query.size(2) % heads == 0);
+
+    auto output = at::empty_like(query);
+
+    launch_opt_cross_attention((__half*)output.data_ptr(),
+                               (const __half*)query.data_ptr(),
+                               (const __half*)key.data_ptr(),
+                               (const __half*)value.data_ptr(),
+                               query.size(0),
+                               query.size(1),
+                               key.size(1),
+                               heads,
+                               query.size(2) / heads,
+                               scale,
+                               at::cuda::getCurrentCUDAStream());
+
+    return output;
+}
+
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
     m.def("nhwc_bias_add", &seq_unroll_bias_add);
     m.def("nhwc_bias_add_add", &seq_bias_add_add);
     m.def("nhwc_bias_add_bias_add", &seq_bias_add_bias_add);
+    m.def("nhwc_group_norm", &nhwc_group_norm);
+    m.def("nhwc_bias_group_norm", &nhwc_bias_group_norm);
+    m.def("nhwc_add_group_norm", &nhwc_add_group_norm);
+    m.def("nhwc_bias_add_group_norm", &nhwc_bias_add_group_norm);
+    m.def("cross_attention", &cross_attention);
 }
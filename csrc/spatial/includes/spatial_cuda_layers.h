@@ -30,3 +30,33 @@ void launch_opt_bias_add(__half* result,
                          int seq_len,
                          int channels,
                          cudaStream_t stream);
+
+void launch_opt_group_norm(__half* output,
+                           float* stats,
+                           const __half* activation,
+                           const __half* bias,
+                           const __half* residual,
+                           const __half* gamma,
+                           const __half* beta,
+                           int bias_batch_stride,
+                           int batch_size,
+                           int seq_len,
+                           int channels,
+                           int groups,
+                           float eps,
+                           bool silu,
+                           cudaStream_t stream);
+
+/*********** Cross Attention Kernels ************/
+
+void launch_opt_cross_attention(__half* output,
+                                const __half* query,
+                                const __half* key,
+                                const __half* value,
+                                int batch_size,
+                                int q_len,
+                                int kv_len,
+                                int heads,
+                                int head_size,
+                                float scale,
+                                cudaStream_t stream);
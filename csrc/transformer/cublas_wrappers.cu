@@ -3,6 +3,7 @@
 
 // DeepSpeed Team
 
+#include <type_traits>
 #include "cublas_wrappers.h"
 
 #ifdef __HIP_PLATFORM_HCC__
@@ -406,3 +407,117 @@ int cublas_strided_batched_gemm(cublasHandle_t handle,
 
     return 0;
 }
+
+#ifdef CUBLASLT_EPILOGUE_AVAILABLE
+template <typename T>
+int cublas_lt_gemm(cublasLtHandle_t handle,
+                   cublasOperation_t transa,
+                   cublasOperation_t transb,
+                   int m,
+                   int n,
+                   int k,
+                   const float* alpha,
+                   const float* beta,
+                   const T* A,
+                   const T* B,
+                   T* C,
+                   cublasLtEpilogue_t epilogue,
+                   T* bias,
+                   T* aux,
+                   void* workspace,
+                   size_t workspace_size,
+                   cudaStream_t stream)
+{
+    const cudaDataType_t data_type = std::is_same<T, __half>::value ? CUDA_R_16F : CUDA_R_32F;
+    const int64_t aux_ld = m;
+    cublasLtMatmulDesc_t op_desc = nullptr;
+    cublasLtMatrixLayout_t a_desc = nullptr, b_desc = nullptr, c_desc = nullptr;
+
+    cublasStatus_t status = cublasLtMatmulDescCreate(&op_desc, CUBLAS_COMPUTE_32F, CUDA_R_32F);
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatmulDescSetAttribute(
+            op_desc, CUBLASLT_MATMUL_DESC_TRANSA, &transa, sizeof(transa));
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatmulDescSetAttribute(
+            op_desc, CUBLASLT_MATMUL_DESC_TRANSB, &transb, sizeof(transb));
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatmulDescSetAttribute(
+            op_desc, CUBLASLT_MATMUL_DESC_EPILOGUE, &epilogue, sizeof(epilogue));
+    if (status == CUBLAS_STATUS_SUCCESS && bias)
+        status = cublasLtMatmulDescSetAttribute(
+            op_desc, CUBLASLT_MATMUL_DESC_BIAS_POINTER, &bias, sizeof(bias));
+    if (status == CUBLAS_STATUS_SUCCESS && aux) {
+        status = cublasLtMatmulDescSetAttribute(
+            op_desc, CUBLASLT_MATMUL_DESC_EPILOGUE_AUX_POINTER, &aux, sizeof(aux));
+        if (status == CUBLAS_STATUS_SUCCESS)
+            status = cublasLtMatmulDescSetAttribute(
+                op_desc, CUBLASLT_MATMUL_DESC_EPILOGUE_AUX_LD, &aux_ld, sizeof(aux_ld));
+    }
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = (transa == CUBLAS_OP_N)
+                     ? cublasLtMatrixLayoutCreate(&a_desc, data_type, m, k, m)
+                     : cublasLtMatrixLayoutCreate(&a_desc, data_type, k, m, k);
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = (transb == CUBLAS_OP_N)
+                     ? cublasLtMatrixLayoutCreate(&b_desc, data_type, k, n, k)
+                     : cublasLtMatrixLayoutCreate(&b_desc, data_type, n, k, n);
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatrixLayoutCreate(&c_desc, data_type, m, n, m);
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatmul(handle,
+                                op_desc,
+                                alpha,
+                                A,
+                                a_desc,
+                                B,
+                                b_desc,
+                                beta,
+                                C,
+                                c_desc,
+                                C,
+                                c_desc,
+                                nullptr,
+                                workspace,
+                                workspace_size,
+                                stream);
+
+    if (c_desc) cublasLtMatrixLayoutDestroy(c_desc);
+    if (b_desc) cublasLtMatrixLayoutDestroy(b_desc);
+    if (a_desc) cublasLtMatrixLayoutDestroy(a_desc);
+    if (op_desc) cublasLtMatmulDescDestroy(op_desc);
+
+    if (status != CUBLAS_STATUS_SUCCESS) {
+        fprintf(stderr,
+                "!!!! kernel execution error. (m: %d, n: %d, k: %d, error: %d) \n",
+                m,
+                n,
+                k,
+                (int)status);
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
+
+#define INSTANTIATE_CUBLAS_LT_GEMM(T)                  \
+    template int cublas_lt_gemm<T>(cublasLtHandle_t,   \
+                                   cublasOperation_t,  \
+                                   cublasOperation_t,  \
+                                   int,                \
+                                   int,                \
+                                   int,                \
+                                   const float*,       \
+                                   const float*,       \
+                                   const T*,           \
+                                   const T*,           \
+                                   T*,                 \
+                                   cublasLtEpilogue_t, \
+                                   T*,                 \
+                                   T*,                 \
+                                   void*,              \
+                                   size_t,             \
+                                   cudaStream_t);
+
+INSTANTIATE_CUBLAS_LT_GEMM(float)
+INSTANTIATE_CUBLAS_LT_GEMM(__half)
+#endif
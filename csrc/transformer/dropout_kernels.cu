@@ -871,3 +871,135 @@ template void launch_dropout(__half*,
                              int dim,
                              float ratio,
                              cudaStream_t stream);
+
+/*
+Stateless dropout: the keep flags of elements [4 j, 4 j + 4) are the Philox draw of subsequence j
+at the offset of the call, so they only depend on the element index and (seed, offset). The
+backward regenerates them instead of reading a mask, whichever launch shape it uses.
+*/
+namespace stateless_dropout {
+
+__device__ __forceinline__ float4 draw(uint64_t group, std::pair<uint64_t, uint64_t> seed)
+{
+    curandStatePhilox4_32_10_t state;
+    curand_init(seed.first, group, seed.second, &state);
+    return curand_uniform4(&state);
+}
+
+}  // namespace stateless_dropout
+
+// out = (vals + bias) * mask * scale + residual, bias and residual optional.
+template <typename T>
+__global__ void dropout_stateless_kernel(const int N,
+                                         const int dim,
+                                         const float ratio,
+                                         T* out,
+                                         const T* vals,
+                                         const T* residual,
+                                         const T* bias,
+                                         std::pair<uint64_t, uint64_t> seed)
+{
+    const float scale = 1. / (1. - ratio);
+
+    CUDA_1D_KERNEL_LOOP(j, (N + unroll_factor - 1) / unroll_factor)
+    {
+        float4 rand = stateless_dropout::draw(j, seed);
+        const float* rand_data = &(rand.x);
+#pragma unroll
+        for (int k = 0; k < unroll_factor; k++) {
+            const int i = j * unroll_factor + k;
+            if (i >= N) break;
+            float x_data = (float)vals[i];
+            if (bias) x_data += (float)bias[i % dim];
+            x_data = rand_data[k] > ratio ? x_data * scale : 0.f;
+            if (residual) x_data += (float)residual[i];
+            out[i] = (T)x_data;
+        }
+    }
+}
+
+template <typename T>
+__global__ void dropout_stateless_grad_kernel(const int N,
+                                              const float ratio,
+                                              T* out,
+                                              const T* vals,
+                                              std::pair<uint64_t, uint64_t> seed)
+{
+    const float scale = 1. / (1. - ratio);
+
+    CUDA_1D_KERNEL_LOOP(j, (N + unroll_factor - 1) / unroll_factor)
+    {
+        float4 rand = stateless_dropout::draw(j, seed);
+        const float* rand_data = &(rand.x);
+#pragma unroll
+        for (int k = 0; k < unroll_factor; k++) {
+            const int i = j * unroll_factor + k;
+            if (i >= N) break;
+            out[i] = (T)(rand_data[k] > ratio ? (float)vals[i] * scale : 0.f);
+        }
+    }
+}
+
+template <typename T>
+void launch_dropout_stateless(T* out,
+                              const T* vals,
+                              const T* residual,
+                              const T* bias,
+                              int total_count,
+                              int dim,
+                              float ratio,
+                              std::pair<uint64_t, uint64_t> seed,
+                              cudaStream_t stream)
+{
+    dropout_stateless_kernel<<<DS_GET_BLOCKS((total_count + unroll_factor - 1) / unroll_factor),
+                               DS_CUDA_NUM_THREADS,
+                               0,
+                               stream>>>(total_count, dim, ratio, out, vals, residual, bias, seed);
+}
+
+template void launch_dropout_stateless(float*,
+                                       const float*,
+                                       const float*,
+                                       const float*,
+                                       int,
+                                       int,
+                                       float,
+                                       std::pair<uint64_t, uint64_t>,
+                                       cudaStream_t);
+template void launch_dropout_stateless(__half*,
+                                       const __half*,
+                                       const __half*,
+                                       const __half*,
+                                       int,
+                                       int,
+                                       float,
+                                       std::pair<uint64_t, uint64_t>,
+                                       cudaStream_t);
+
+template <typename T>
+void launch_dropout_stateless_grad(T* vals_out,
+                                   const T* vals,
+                                   int total_count,
+                                   float ratio,
+                                   std::pair<uint64_t, uint64_t> seed,
+                                   cudaStream_t stream)
+{
+    dropout_stateless_grad_kernel<<<DS_GET_BLOCKS((total_count + unroll_factor - 1) /
+                                                  unroll_factor),
+                                    DS_CUDA_NUM_THREADS,
+                                    0,
+                                    stream>>>(total_count, ratio, vals_out, vals, seed);
+}
+
+template void launch_dropout_stateless_grad(float*,
+                                            const float*,
+                                            int,
+                                            float,
+                                            std::pair<uint64_t, uint64_t>,
+                                            cudaStream_t);
+template void launch_dropout_stateless_grad(__half*,
+                                            const __half*,
+                                            int,
+                                            float,
+                                            std::pair<uint64_t, uint64_t>,
+                                            cudaStream_t);
@@ -15,6 +15,7 @@
 #include "context.h"
 #include "cublas_wrappers.h"
 #include "custom_cuda_layers.h"
+#include "ds_instrument.h"
 #include "ds_transformer_cuda.h"
 
 static std::unordered_map<int, std::shared_ptr<void>> s_transformer_layers;
@@ -30,13 +31,20 @@ unsigned get_workspace_size(unsigned maxBatchSize,
                             unsigned intermediate_size,
                             unsigned heads,
                             bool training,
-                            bool gelu_checkpoint)
+                            bool gelu_checkpoint,
+                            bool flash_attention,
+                            bool swiglu)
 {
     unsigned workSpacesize = 4 * (size_t(maxBatchSize) * seq_len * hidden_size);
     if (training) {
         workSpacesize += 2 * (size_t(maxBatchSize) * seq_len * hidden_size);
-        workSpacesize += ((std::max)((size_t(maxBatchSize) * seq_len * intermediate_size),
-                                     2 * (size_t(maxBatchSize) * heads * seq_len * seq_len)));
+        // The fused attention needs no scores, only its output gradient, delta and the 3 gradients.
+        // SwiGLU keeps the gradient of its 2x wider input next to the one of its output.
+        workSpacesize +=
+            ((std::max)((size_t(maxBatchSize) * seq_len * intermediate_size * (swiglu ? 3 : 1)),
+                        flash_attention
+                            ? 4 * (size_t(maxBatchSize) * seq_len * hidden_size)
+                            : 2 * (size_t(maxBatchSize) * heads * seq_len * seq_len)));
         if (gelu_checkpoint)
             workSpacesize += 2 * (size_t(maxBatchSize) * seq_len * intermediate_size);
     }
@@ -65,7 +73,15 @@ BertTransformerLayer<T>::BertTransformerLayer(unsigned layer_id,
                                               bool attn_dropout_checkpoint,
                                               bool normalize_invertible,
                                               bool gelu_checkpoint,
-                                              bool stochastic_mode)
+                                              bool stochastic_mode,
+                                              bool flash_attention,
+                                              bool stateless_dropout,
+                                              bool gemm_epilogues,
+                                              bool recompute_qkv,
+                                              bool recompute_softmax,
+                                              bool recompute_ff1,
+                                              bool rms_norm,
+                                              bool swiglu)
     : _layer_id(layer_id),
       _batch_size(batch_size),
       _hidden_size(hidden_size),
@@ -77,7 +93,19 @@ BertTransformerLayer<T>::BertTransformerLayer(unsigned layer_id,
       _attn_dropout_checkpoint(attn_dropout_checkpoint),
       _normalize_invertible(normalize_invertible),
       _gelu_checkpoint(gelu_checkpoint),
+      _recompute_qkv(recompute_qkv),
+      _recompute_softmax(recompute_softmax),
+      _recompute_ff1(recompute_ff1),
       _stochastic_mode(stochastic_mode),
+      _flash_attention(flash_attention),
+      _stateless_dropout(stateless_dropout),
+      _gemm_epilogues(gemm_epilogues),
+      _swiglu(swiglu),
+      _flash_seed(0, 0),
+      _total_tokens(0),
+      _token_index(nullptr),
+      _padded_index(nullptr),
+      _packed_buf(nullptr),
       _stream(TrainingContext::Instance().GetCurrentStream()),
       _cublasHandle(TrainingContext::Instance().GetCublasHandle()),
       _qkv_linear(typename FeedForward<T>::Config(batch_size * seq_length,
@@ -93,15 +121,17 @@ BertTransformerLayer<T>::BertTransformerLayer(unsigned layer_id,
                                                            hidden_size,
                                                            layer_norm_eps,
                                                            true,
-                                                           !normalize_invertible)),
+                                                           !normalize_invertible,
+                                                           rms_norm)),
       _layer_norm(typename Normalize_Layer<T>::Config(batch_size,
                                                       seq_length,
                                                       hidden_size,
                                                       layer_norm_eps,
                                                       true,
-                                                      !normalize_invertible)),
+                                                      !normalize_invertible,
+                                                      rms_norm)),
       _ff1(typename FeedForward<T>::Config(batch_size * seq_length,
-                                           _intermediate_size,
+                                           (swiglu ? 2 : 1) * _intermediate_size,
                                            hidden_size,
                                            gemm_algos[1])),
       _ff2(typename FeedForward<T>::Config(batch_size * seq_length,
@@ -110,9 +140,15 @@ BertTransformerLayer<T>::BertTransformerLayer(unsigned layer_id,
                                            gemm_algos[2])),
       _softmax(typename Softmax<T>::Config(batch_size, num_heads, seq_length)),
       _gelu(typename Gelu<T>::Config(_intermediate_size)),
-      _attn_prob_dropout(typename Dropout<T>::Config(attn_prob_dropout_ratio, _seq_length)),
-      _attn_output_dropout(typename Dropout<T>::Config(hidden_output_dropout_ratio, _hidden_size)),
-      _layer_output_dropout(typename Dropout<T>::Config(hidden_output_dropout_ratio, _hidden_size)),
+      _swiglu_act(typename Swiglu<T>::Config(_intermediate_size)),
+      _attn_prob_dropout(
+          typename Dropout<T>::Config(attn_prob_dropout_ratio, _seq_length, stateless_dropout)),
+      _attn_output_dropout(typename Dropout<T>::Config(hidden_output_dropout_ratio,
+                                                       _hidden_size,
+                                                       stateless_dropout)),
+      _layer_output_dropout(typename Dropout<T>::Config(hidden_output_dropout_ratio,
+                                                        _hidden_size,
+                                                        stateless_dropout)),
       _attn_scores(typename StridedBatchGemm<T>::Config(_batch_size * _heads,
                                                         _seq_length,
                                                         _seq_length,
@@ -130,9 +166,27 @@ BertTransformerLayer<T>::BertTransformerLayer(unsigned layer_id,
                                                          T(0.0),
                                                          CUBLAS_OP_N,
                                                          CUBLAS_OP_N,
-                                                         gemm_algos[4]))
+                                                         gemm_algos[4])),
+      _flash_attn(typename FlashAttention<T>::Config(_heads, _seq_length, _hidden_size / _heads))
 {
     assert(_hidden_size % _heads == 0);
+    if (_flash_attention && _hidden_size / _heads > ATTN_FLASH_MAX_HEAD_SIZE)
+        throw std::runtime_error("Fused attention supports heads of up to " +
+                                 std::to_string(ATTN_FLASH_MAX_HEAD_SIZE) + " elements.");
+#ifndef CUBLASLT_EPILOGUE_AVAILABLE
+    if (_gemm_epilogues)
+        throw std::runtime_error("GEMM epilogue fusion needs cublasLt from CUDA 11.4 or newer.");
+#endif
+    if (_flash_attention && _recompute_softmax)
+        throw std::runtime_error("The fused attention keeps no softmax output to recompute.");
+    // cublasLt wants the leading dimension of the GELU input kept by the epilogue aligned.
+    if (_gemm_epilogues && _intermediate_size % 8 != 0)
+        throw std::runtime_error("GEMM epilogue fusion needs an intermediate size multiple of 8.");
+    // The epilogues and the GELU recompute of gelu_checkpoint only know the GELU.
+    if (_swiglu && (_gemm_epilogues || _gelu_checkpoint))
+        throw std::runtime_error("SwiGLU supports neither gemm_epilogues nor gelu_checkpoint.");
+    if (_swiglu && _intermediate_size % 8 != 0)
+        throw std::runtime_error("SwiGLU needs an intermediate size multiple of 8.");
 
     Initialize();
 }
@@ -199,7 +253,9 @@ void BertTransformerLayer<T>::Forward(unsigned bsz,
             (_gelu_checkpoint ? (buf_2 + (_intermediate_size / _hidden_size) * small_buf_size)
                               : (buf_1 + 4 * small_buf_size));
 
-    int bsz_seq = bsz * _seq_length;
+    // Only the attention sees the padded batch when the sequences are packed.
+    int bsz_seq = _total_tokens ? _total_tokens : bsz * _seq_length;
+    T* attn_o_padded = _total_tokens ? _packed_buf : attn_o_inp_ptr;
 
     if (_pre_or_postLayerNorm) {
         if (_layer_norm.UseMean())
@@ -211,30 +267,48 @@ void BertTransformerLayer<T>::Forward(unsigned bsz,
                 bsz_seq, inp_norm_ptr, input_ptr, norm_w_ptr, norm_b_ptr, _stream, true);
     }
 
-    if (_pre_or_postLayerNorm)
-        _qkv_linear.Forward(bsz_seq, inp_norm_ptr, attn_qkvw_ptr, buf_0, _cublasHandle);
-    else
-        _qkv_linear.Forward(bsz_seq, input_ptr, attn_qkvw_ptr, buf_0, _cublasHandle);
-
-    launch_bias_add_transform_0213<T>(
-        q_tf_ptr, buf_0, attn_qkvb_ptr, bsz, _seq_length, _hidden_size, _heads, _stream, 3);
+    QkvForward(bsz,
+               (_pre_or_postLayerNorm ? inp_norm_ptr : input_ptr),
+               attn_qkvw_ptr,
+               attn_qkvb_ptr,
+               q_tf_ptr);
 
     int bsz_heads = bsz * _heads;
 
-    // attention scores
-    _attn_scores.Forward(bsz_heads, soft_out_ptr, k_tf_ptr, q_tf_ptr, _cublasHandle);
+    if (_flash_attention) {
+        // Scores, softmax, dropout and context in one pass, soft_out keeps the row log-sum-exp.
+        const float ratio = _attn_prob_dropout.GetConfig().RATIO();
+        if (ratio > 0) _flash_seed = TrainingContext::Instance().IncrementOffset(1);
+        _flash_attn.Forward(bsz,
+                            buf_1,
+                            reinterpret_cast<float*>(soft_out_ptr),
+                            q_tf_ptr,
+                            k_tf_ptr,
+                            v_tf_ptr,
+                            input_mask_ptr,
+                            ratio,
+                            _flash_seed,
+                            _stream);
+    } else {
+        // attention scores
+        _attn_scores.Forward(bsz_heads, soft_out_ptr, k_tf_ptr, q_tf_ptr, _cublasHandle);
 
-    // Softmax + Mask
-    _softmax.Forward(bsz, soft_out_ptr, input_mask_ptr, _stream);
+        // Softmax + Mask
+        _softmax.Forward(bsz, soft_out_ptr, input_mask_ptr, _stream);
 
-    // attn prob dropout.
-    _attn_prob_dropout.Forward(bsz_heads * _seq_length, ctx_bufB_ptr, soft_out_ptr, _stream);
+        // attn prob dropout.
+        _attn_prob_dropout.Forward(bsz_heads * _seq_length, ctx_bufB_ptr, soft_out_ptr, _stream);
 
-    // attention context
-    _attn_context.Forward(bsz_heads, buf_1, v_tf_ptr, ctx_bufB_ptr, _cublasHandle);
+        // attention context
+        _attn_context.Forward(bsz_heads, buf_1, v_tf_ptr, ctx_bufB_ptr, _cublasHandle);
+    }
 
     launch_transform4d_0213<T>(
-        attn_o_inp_ptr, buf_1, bsz, _heads, _seq_length, _hidden_size, _stream, 1);
+        attn_o_padded, buf_1, bsz, _heads, _seq_length, _hidden_size, _stream, 1);
+
+    if (_total_tokens)
+        launch_gather_tokens<T>(
+            attn_o_inp_ptr, attn_o_padded, _token_index, _total_tokens, _hidden_size, _stream);
 
     if (_pre_or_postLayerNorm)
         _attn_out_linear.Forward(bsz_seq, attn_o_inp_ptr, attn_ow_ptr, buf_1, _cublasHandle);
@@ -265,17 +339,35 @@ void BertTransformerLayer<T>::Forward(unsigned bsz,
                 bsz_seq, ff1_inp_ptr, add_res_ptr, attn_nw_ptr, attn_nb_ptr, _stream, true);
     }
 
-    _ff1.Forward(bsz_seq,
-                 ff1_inp_ptr,
-                 inter_w_ptr,
-                 (_gelu_checkpoint ? ff2_inp_ptr : gelu_inp_ptr),
-                 _cublasHandle);
-
-    _gelu.ForwardWithBiasAdd(bsz_seq,
-                             (_gelu_checkpoint ? ff2_inp_ptr : gelu_inp_ptr),
+#ifdef CUBLASLT_EPILOGUE_AVAILABLE
+    // The GELU input kept for the backward has the bias added, unlike the unfused path.
+    if (_gemm_epilogues)
+        _ff1.ForwardBiasGelu(bsz_seq,
+                             ff1_inp_ptr,
+                             inter_w_ptr,
                              inter_b_ptr,
                              (_gelu_checkpoint ? buf_2 : ff2_inp_ptr),
+                             (_gelu_checkpoint ? ff2_inp_ptr : gelu_inp_ptr),
                              _stream);
+    else
+#endif
+    {
+        _ff1.Forward(bsz_seq,
+                     ff1_inp_ptr,
+                     inter_w_ptr,
+                     (_gelu_checkpoint ? ff2_inp_ptr : gelu_inp_ptr),
+                     _cublasHandle);
+
+        if (_swiglu)
+            _swiglu_act.ForwardWithBiasAdd(
+                bsz_seq, gelu_inp_ptr, inter_b_ptr, ff2_inp_ptr, _stream);
+        else
+            _gelu.ForwardWithBiasAdd(bsz_seq,
+                                     (_gelu_checkpoint ? ff2_inp_ptr : gelu_inp_ptr),
+                                     inter_b_ptr,
+                                     (_gelu_checkpoint ? buf_2 : ff2_inp_ptr),
+                                     _stream);
+    }
 
     _ff2.Forward(
         bsz_seq, (_gelu_checkpoint ? buf_2 : ff2_inp_ptr), output_w_ptr, out_ptr, _cublasHandle);
@@ -353,10 +445,12 @@ void BertTransformerLayer<T>::Backward(unsigned bsz,
     T* ff2_buf = (_gelu_checkpoint ? buf_3 + (bsz * _seq_length * _intermediate_size)
                                    : buf_3 + small_buf_size);
     T* ctx_bufB_ptr_recomp = ff2_buf + (_seq_length * _seq_length * bsz * _heads);
+    // Gradient of the intermediate GEMM output, wider than ff2_buf under SwiGLU.
+    T* ff1_buf = (_swiglu ? ff2_buf + (bsz * _seq_length * _intermediate_size) : ff2_buf);
 
     cudaStream_t streams[2] = {_stream, _stream};
 
-    int bsz_seq = bsz * _seq_length;
+    int bsz_seq = _total_tokens ? _total_tokens : bsz * _seq_length;
     int bsz_heads = bsz * _heads;
 
     if (!_pre_or_postLayerNorm) {
@@ -391,33 +485,57 @@ void BertTransformerLayer<T>::Backward(unsigned bsz,
                                      ? buf_0
                                      : (_pre_or_postLayerNorm ? grad_output_ptr : buf_1);
 
-    if (_gelu_checkpoint)
-        _gelu.ForwardWithBiasAdd(bsz_seq, ff2_inp_ptr, inter_b_ptr, buf_2, _stream);
-    _ff2.Backward(bsz_seq,
-                  layer_dropout_buf,
-                  (_gelu_checkpoint ? buf_2 : ff2_inp_ptr),
-                  output_w_ptr,
-                  grad_output_w_ptr,
-                  grad_output_b_ptr,
-                  _cublasHandle,
-                  _stream,
-                  ff2_buf);
-
-    _gelu.Backward(
-        bsz_seq, ff2_buf, (_gelu_checkpoint ? ff2_inp_ptr : gelu_inp_ptr), inter_b_ptr, _stream);
+#ifdef CUBLASLT_EPILOGUE_AVAILABLE
+    // Both bias gradients and the GELU derivative are reduced and applied in the GEMM epilogues.
+    if (_gemm_epilogues) {
+        if (_gelu_checkpoint) _gelu.Forward(bsz_seq, ff2_inp_ptr, buf_2, _stream);
+        _ff2.BackwardDGelu(bsz_seq,
+                           layer_dropout_buf,
+                           (_gelu_checkpoint ? buf_2 : ff2_inp_ptr),
+                           output_w_ptr,
+                           grad_output_w_ptr,
+                           grad_output_b_ptr,
+                           (_gelu_checkpoint ? ff2_inp_ptr : gelu_inp_ptr),
+                           grad_inter_b_ptr,
+                           _stream,
+                           ff2_buf);
+    } else
+#endif
+    {
+        if (_gelu_checkpoint)
+            _gelu.ForwardWithBiasAdd(bsz_seq, ff2_inp_ptr, inter_b_ptr, buf_2, _stream);
+        _ff2.Backward(bsz_seq,
+                      layer_dropout_buf,
+                      (_gelu_checkpoint ? buf_2 : ff2_inp_ptr),
+                      output_w_ptr,
+                      grad_output_w_ptr,
+                      grad_output_b_ptr,
+                      _cublasHandle,
+                      _stream,
+                      ff2_buf);
+
+        if (_swiglu)
+            _swiglu_act.Backward(bsz_seq, ff1_buf, ff2_buf, gelu_inp_ptr, inter_b_ptr, _stream);
+        else
+            _gelu.Backward(bsz_seq,
+                           ff2_buf,
+                           (_gelu_checkpoint ? ff2_inp_ptr : gelu_inp_ptr),
+                           inter_b_ptr,
+                           _stream);
+    }
 
     _ff1.Backward(bsz_seq,
-                  ff2_buf,
+                  ff1_buf,
                   ff1_inp_ptr,
                   inter_w_ptr,
                   grad_inter_w_ptr,
-                  grad_inter_b_ptr,
+                  (_gemm_epilogues ? nullptr : grad_inter_b_ptr),
                   _cublasHandle,
                   _stream,
                   buf_3);
 
     if (!_pre_or_postLayerNorm)
-        launch_fused_add2<T>(buf_2, buf_3, buf_1, bsz, _seq_length, _hidden_size, _stream);
+        launch_fused_add2<T>(buf_2, buf_3, buf_1, bsz_seq, 1, _hidden_size, _stream);
 
     if (_pre_or_postLayerNorm) {
         if (_attn_layer_norm.UseMean())
@@ -479,35 +597,84 @@ void BertTransformerLayer<T>::Backward(unsigned bsz,
                               _stream,
                               buf_1);
 
-    launch_transform_0213<T>(buf_2, buf_1, bsz, _seq_length, _hidden_size, _heads, _stream);
-
-    if (_attn_prob_dropout.HasDropout()) {
-        if (_attn_dropout_checkpoint)
-            _attn_prob_dropout.Forward(
-                bsz_heads * _seq_length, ctx_bufB_ptr_recomp, soft_out_ptr, _stream, true);
-
-        _attn_context.Backward(bsz_heads,
-                               buf_2,
-                               v_tf_ptr,
-                               (_attn_dropout_checkpoint ? ctx_bufB_ptr_recomp : ctx_bufB_ptr),
-                               _cublasHandle,
-                               buf_3,
-                               ff2_buf);
-    } else
-        _attn_context.Backward(
-            bsz_heads, buf_2, v_tf_ptr, soft_out_ptr, _cublasHandle, buf_3, ff2_buf);
-
-    _attn_prob_dropout.Backward(bsz_heads * _seq_length, ff2_buf, _stream);
-
-    _softmax.Backward(bsz, ff2_buf, soft_out_ptr, _stream);
-
-    _attn_scores.Backward(bsz_heads, ff2_buf, k_tf_ptr, q_tf_ptr, _cublasHandle, buf_2, buf_1);
+    if (_flash_attention) {
+        // The gradients of q, k and v go to buf_1..3, so the output gradient moves out of buf_1.
+        T* d_out = ff2_buf;
+        float* delta = reinterpret_cast<float*>(ff2_buf + small_buf_size);
+        const T* attn_o_padded = attn_o_inp_ptr;
+        if (_total_tokens) {
+            launch_gather_tokens<T>(
+                d_out, buf_1, _padded_index, bsz * _seq_length, _hidden_size, _stream);
+            launch_gather_tokens<T>(_packed_buf,
+                                    attn_o_inp_ptr,
+                                    _padded_index,
+                                    bsz * _seq_length,
+                                    _hidden_size,
+                                    _stream);
+            attn_o_padded = _packed_buf;
+        } else
+            cudaMemcpyAsync(
+                d_out, buf_1, small_buf_size * sizeof(T), cudaMemcpyDeviceToDevice, _stream);
+        _flash_attn.Backward(bsz,
+                             buf_1,
+                             buf_2,
+                             buf_3,
+                             delta,
+                             d_out,
+                             attn_o_padded,
+                             reinterpret_cast<const float*>(soft_out_ptr),
+                             q_tf_ptr,
+                             k_tf_ptr,
+                             v_tf_ptr,
+                             input_mask_ptr,
+                             _attn_prob_dropout.GetConfig().RATIO(),
+                             _flash_seed,
+                             _stream);
+    } else {
+        const T* attn_o_grad = buf_1;
+        if (_total_tokens) {
+            launch_gather_tokens<T>(
+                _packed_buf, buf_1, _padded_index, bsz * _seq_length, _hidden_size, _stream);
+            attn_o_grad = _packed_buf;
+        }
+        launch_transform_0213<T>(
+            buf_2, attn_o_grad, bsz, _seq_length, _hidden_size, _heads, _stream);
+
+        if (_attn_prob_dropout.HasDropout()) {
+            if (_attn_dropout_checkpoint)
+                _attn_prob_dropout.Forward(
+                    bsz_heads * _seq_length, ctx_bufB_ptr_recomp, soft_out_ptr, _stream, true);
+
+            _attn_context.Backward(bsz_heads,
+                                   buf_2,
+                                   v_tf_ptr,
+                                   (_attn_dropout_checkpoint ? ctx_bufB_ptr_recomp : ctx_bufB_ptr),
+                                   _cublasHandle,
+                                   buf_3,
+                                   ff2_buf);
+        } else
+            _attn_context.Backward(
+                bsz_heads, buf_2, v_tf_ptr, soft_out_ptr, _cublasHandle, buf_3, ff2_buf);
+
+        _attn_prob_dropout.Backward(bsz_heads * _seq_length, ff2_buf, _stream);
+
+        _softmax.Backward(bsz, ff2_buf, soft_out_ptr, _stream);
+
+        _attn_scores.Backward(bsz_heads, ff2_buf, k_tf_ptr, q_tf_ptr, _cublasHandle, buf_2, buf_1);
+    }
 
     launch_transform4d_0213(ff2_buf, buf_1, bsz, _heads, _seq_length, _hidden_size, _stream, 3);
 
+    T* qkv_grad = ff2_buf;
+    if (_total_tokens) {
+        launch_gather_tokens<T>(
+            _packed_buf, ff2_buf, _token_index, _total_tokens, 3 * _hidden_size, _stream);
+        qkv_grad = _packed_buf;
+    }
+
     if (_pre_or_postLayerNorm)
         _qkv_linear.Backward(bsz_seq,
-                             ff2_buf,
+                             qkv_grad,
                              inp_norm_ptr,
                              attn_qkvw_ptr,
                              grad_attn_qkvw_ptr,
@@ -517,7 +684,7 @@ void BertTransformerLayer<T>::Backward(unsigned bsz,
                              buf_2);
     else
         _qkv_linear.Backward(bsz_seq,
-                             ff2_buf,
+                             qkv_grad,
                              input_ptr,
                              attn_qkvw_ptr,
                              grad_attn_qkvw_ptr,
@@ -550,7 +717,66 @@ void BertTransformerLayer<T>::Backward(unsigned bsz,
                                          grad_input_ptr,
                                          inp_norm_ptr);
     } else
-        launch_fused_add2<T>(grad_input_ptr, buf_2, buf_0, bsz, _seq_length, _hidden_size, _stream);
+        launch_fused_add2<T>(grad_input_ptr, buf_2, buf_0, bsz_seq, 1, _hidden_size, _stream);
+}
+
+template <typename T>
+void BertTransformerLayer<T>::QkvForward(unsigned bsz,
+                                         const T* qkv_input_ptr,
+                                         const T* attn_qkvw_ptr,
+                                         const T* attn_qkvb_ptr,
+                                         T* q_tf_ptr)
+{
+    // The GEMM output takes the first 3 buffers of the workspace.
+    T* buf_0 = static_cast<T*>(TrainingContext::Instance().GetWorkSpace());
+    int bsz_seq = _total_tokens ? _total_tokens : bsz * _seq_length;
+    T* qkv_out = _total_tokens ? _packed_buf : buf_0;
+
+    _qkv_linear.Forward(bsz_seq, qkv_input_ptr, attn_qkvw_ptr, qkv_out, _cublasHandle);
+
+    if (_total_tokens)
+        launch_gather_tokens<T>(
+            buf_0, qkv_out, _padded_index, bsz * _seq_length, 3 * _hidden_size, _stream);
+
+    launch_bias_add_transform_0213<T>(
+        q_tf_ptr, buf_0, attn_qkvb_ptr, bsz, _seq_length, _hidden_size, _heads, _stream, 3);
+}
+
+template <typename T>
+void BertTransformerLayer<T>::Recompute(unsigned bsz,
+                                        const T* qkv_input_ptr,
+                                        const T* input_mask_ptr,
+                                        const T* attn_qkvw_ptr,
+                                        const T* attn_qkvb_ptr,
+                                        const T* ff1_inp_ptr,
+                                        const T* inter_w_ptr,
+                                        const T* inter_b_ptr,
+                                        T* q_tf_ptr,
+                                        T* softmax_output_ptr,
+                                        T* ff1_out_ptr)
+{
+    cublasSetStream(_cublasHandle, _stream);
+
+    int bsz_seq = _total_tokens ? _total_tokens : bsz * _seq_length;
+    size_t qkv_size = bsz * _seq_length * _hidden_size;
+
+    if (_recompute_qkv) QkvForward(bsz, qkv_input_ptr, attn_qkvw_ptr, attn_qkvb_ptr, q_tf_ptr);
+
+    if (_recompute_softmax) {
+        const T* k_tf_ptr = q_tf_ptr + qkv_size;
+        _attn_scores.Forward(bsz * _heads, softmax_output_ptr, k_tf_ptr, q_tf_ptr, _cublasHandle);
+        _softmax.Forward(bsz, softmax_output_ptr, input_mask_ptr, _stream);
+    }
+
+    if (_recompute_ff1) {
+        // The same pre-activation as the forward: with the bias under gemm_epilogues only.
+#ifdef CUBLASLT_EPILOGUE_AVAILABLE
+        if (_gemm_epilogues)
+            _ff1.ForwardBias(bsz_seq, ff1_inp_ptr, inter_w_ptr, inter_b_ptr, ff1_out_ptr, _stream);
+        else
+#endif
+            _ff1.Forward(bsz_seq, ff1_inp_ptr, inter_w_ptr, ff1_out_ptr, _cublasHandle);
+    }
 }
 
 template <typename T>
@@ -581,12 +807,25 @@ void BertTransformerLayer<T>::SetIntermediateBuffers(uint8_t* attn_prob_dropout_
     _layer_norm.SetMean(layer_norm_mean);
 }
 
+template <typename T>
+void BertTransformerLayer<T>::SetPackedTokens(int total_tokens,
+                                              const int* token_index,
+                                              const int* padded_index,
+                                              T* packed_buf)
+{
+    _total_tokens = total_tokens;
+    _token_index = token_index;
+    _padded_index = padded_index;
+    _packed_buf = packed_buf;
+}
+
 template <typename T>
 void BertTransformerLayer<T>::SetSeqLength(unsigned seq_len)
 {
     _seq_length = seq_len;
 
     _softmax.SetSeqLength(_seq_length);
+    _flash_attn.SetSeqLength(_seq_length);
     _attn_prob_dropout.SetDimension(_seq_length);
     _attn_scores.SetConfig(_seq_length, _seq_length, _hidden_size / _heads);
     _attn_context.SetConfig(_hidden_size / _heads, _seq_length, _seq_length);
@@ -607,7 +846,15 @@ int create_transformer_layer(unsigned layer_id,
                              bool attn_dropout_checkpoint,
                              bool normalize_invertible,
                              bool gelu_checkpoint,
-                             bool stochastic_mode)
+                             bool stochastic_mode,
+                             bool flash_attention,
+                             bool stateless_dropout,
+                             bool gemm_epilogues,
+                             bool recompute_qkv,
+                             bool recompute_softmax,
+                             bool recompute_ff1,
+                             bool rms_norm,
+                             bool swiglu)
 {
     TrainingContext::Instance().SetSeed(seed);
     TrainingContext::Instance().TestGemmFP16(
@@ -628,7 +875,15 @@ int create_transformer_layer(unsigned layer_id,
                                                   attn_dropout_checkpoint,
                                                   normalize_invertible,
                                                   gelu_checkpoint,
-                                                  stochastic_mode);
+                                                  stochastic_mode,
+                                                  flash_attention,
+                                                  stateless_dropout,
+                                                  gemm_epilogues,
+                                                  recompute_qkv,
+                                                  recompute_softmax,
+                                                  recompute_ff1,
+                                                  rms_norm,
+                                                  swiglu);
 
     s_transformer_layers[layer_id] = layer;
 
@@ -660,7 +915,9 @@ std::vector<torch::Tensor> ds_transformer_forward(unsigned layer_id,
                                                   bool prelayernorm,
                                                   bool attn_dropout_checkpoint,
                                                   bool normalize_invertible,
-                                                  bool gelu_checkpoint)
+                                                  bool gelu_checkpoint,
+                                                  const torch::Tensor& token_index,
+                                                  const torch::Tensor& padded_index)
 {
     CHECK_INPUT(input);
     CHECK_INPUT(input_mask);
@@ -677,7 +934,14 @@ std::vector<torch::Tensor> ds_transformer_forward(unsigned layer_id,
     CHECK_INPUT(norm_w);
     CHECK_INPUT(norm_b);
 
-    unsigned bsz = input.size(0);
+    // Packed sequences are [tokens, hidden], with the [batch, 1, 1, seq] mask of the padded batch.
+    const bool packed = token_index.numel() > 0;
+    if (packed) {
+        CHECK_INPUT(token_index);
+        CHECK_INPUT(padded_index);
+    }
+    unsigned bsz = packed ? input_mask.size(0) : input.size(0);
+    unsigned input_seq = packed ? input_mask.size(3) : input.size(1);
 
     const T* input_ptr = (const T*)input.data_ptr();
     const T* input_mask_ptr = (const T*)input_mask.data_ptr();
@@ -713,10 +977,11 @@ std::vector<torch::Tensor> ds_transformer_forward(unsigned layer_id,
         std::static_pointer_cast<BertTransformerLayer<T>>(s_transformer_layers[layer_id]);
 
     unsigned seq_len = layer->GetSeqLength();
-    if (input.size(1) != seq_len) {
-        seq_len = input.size(1);
+    if (input_seq != seq_len) {
+        seq_len = input_seq;
         layer->SetSeqLength(seq_len);
     }
+    unsigned tokens = packed ? input.size(0) : bsz * seq_len;
 
     auto workspace = torch::empty({get_workspace_size<T>(bsz,
                                                          seq_len,
@@ -724,7 +989,9 @@ std::vector<torch::Tensor> ds_transformer_forward(unsigned layer_id,
                                                          layer->GetIntermediateSize(),
                                                          layer->GetNumHeads(),
                                                          layer->IsTrainingMode(),
-                                                         layer->GeluCheckpoint())},
+                                                         layer->GeluCheckpoint(),
+                                                         layer->UseFlashAttention(),
+                                                         layer->UseSwiglu())},
                                   options);
     TrainingContext::Instance().SetWorkSpace((T*)workspace.data_ptr());
 
@@ -733,17 +1000,27 @@ std::vector<torch::Tensor> ds_transformer_forward(unsigned layer_id,
     auto attn_o_inp = torch::empty_like(input);
     auto qkv_tf = torch::empty({(bsz * seq_len), output_w.size(0) * 3}, options);
 
+    // Stateless dropout keeps the (seed, offset) of each dropout on the host instead of its mask,
+    // the fused attention draws its dropout in the kernels and only needs a placeholder.
+    auto seed_options = torch::TensorOptions().dtype(torch::kInt64);
     auto attn_prob_dropout_mask =
-        torch::empty({(bsz * layer->GetNumHeads() * seq_len), seq_len}, uint8_options);
+        (layer->StatelessDropout()
+             ? torch::empty({2}, seed_options)
+             : (layer->UseFlashAttention()
+                    ? torch::empty({1}, uint8_options)
+                    : torch::empty({(bsz * layer->GetNumHeads() * seq_len), seq_len},
+                                   uint8_options)));
     auto attn_output_dropout_mask =
-        torch::empty({(bsz * seq_len), layer->GetHiddenSize()}, uint8_options);
+        (layer->StatelessDropout() ? torch::empty({2}, seed_options)
+                                   : torch::empty({tokens, layer->GetHiddenSize()}, uint8_options));
     auto layer_output_dropout_mask =
-        torch::empty({(bsz * seq_len), layer->GetHiddenSize()}, uint8_options);
+        (layer->StatelessDropout() ? torch::empty({2}, seed_options)
+                                   : torch::empty({tokens, layer->GetHiddenSize()}, uint8_options));
 
-    auto attn_layer_norm_var = torch::empty({(bsz * seq_len)}, options);
-    auto attn_layer_norm_mean = torch::empty({(bsz * seq_len)}, options);
-    auto layer_norm_var = torch::empty({(bsz * seq_len)}, options);
-    auto layer_norm_mean = torch::empty({(bsz * seq_len)}, options);
+    auto attn_layer_norm_var = torch::empty({tokens}, options);
+    auto attn_layer_norm_mean = torch::empty({tokens}, options);
+    auto layer_norm_var = torch::empty({tokens}, options);
+    auto layer_norm_mean = torch::empty({tokens}, options);
 
     T* inp_norm_ptr = (T*)inp_norm.data_ptr();
     T* add_res_ptr = (T*)add_res.data_ptr();
@@ -752,23 +1029,37 @@ std::vector<torch::Tensor> ds_transformer_forward(unsigned layer_id,
     T* v_tf_ptr = k_tf_ptr + (bsz * seq_len * output_w.size(0));  //(T*)v_tf.data_ptr();
     T* attn_o_inp_ptr = (T*)attn_o_inp.data_ptr();
 
-    torch::Tensor ff2_inp = torch::empty({(bsz * seq_len), output_w.size(1)}, options);
+    torch::Tensor ff2_inp = torch::empty({tokens, output_w.size(1)}, options);
     torch::Tensor gelu_inp =
-        (gelu_checkpoint ? ff2_inp : torch::empty({(bsz * seq_len), output_w.size(1)}, options));
+        (gelu_checkpoint ? ff2_inp : torch::empty({tokens, layer->GetFF1Size()}, options));
     auto ff1_inp = torch::empty_like(input);
     T* ff2_inp_ptr = (T*)ff2_inp.data_ptr();
     T* gelu_inp_ptr = (T*)gelu_inp.data_ptr();
     T* ff1_inp_ptr = (T*)ff1_inp.data_ptr();
 
+    // With the fused attention, soft_out keeps the fp32 log-sum-exp of the score rows and ctx_bufB
+    // the seed and offset of the attention dropout, on the host.
     torch::Tensor soft_out =
-        torch::empty({(bsz * layer->GetNumHeads() * seq_len), seq_len}, options);
-    torch::Tensor ctx_bufB =
-        (attn_dropout_checkpoint
-             ? soft_out
+        (layer->UseFlashAttention()
+             ? torch::empty({(bsz * layer->GetNumHeads() * seq_len)},
+                            options.dtype(torch::kFloat32).requires_grad(false))
              : torch::empty({(bsz * layer->GetNumHeads() * seq_len), seq_len}, options));
+    torch::Tensor ctx_bufB =
+        (layer->UseFlashAttention()
+             ? torch::empty({2}, torch::TensorOptions().dtype(torch::kInt64))
+             : (attn_dropout_checkpoint
+                    ? soft_out
+                    : torch::empty({(bsz * layer->GetNumHeads() * seq_len), seq_len}, options)));
     T* soft_out_ptr = (T*)soft_out.data_ptr();
     T* ctx_bufB_ptr = (T*)ctx_bufB.data_ptr();
 
+    auto packed_buf = (packed ? torch::empty({3 * bsz * seq_len, layer->GetHiddenSize()}, options)
+                              : torch::Tensor());
+    layer->SetPackedTokens(packed ? tokens : 0,
+                           packed ? (const int*)token_index.data_ptr() : nullptr,
+                           packed ? (const int*)padded_index.data_ptr() : nullptr,
+                           packed ? (T*)packed_buf.data_ptr() : nullptr);
+
     layer->SetTrainingMode(training_mode);
     layer->SetIntermediateBuffers((uint8_t*)attn_prob_dropout_mask.data_ptr(),
                                   (uint8_t*)attn_output_dropout_mask.data_ptr(),
@@ -806,6 +1097,12 @@ std::vector<torch::Tensor> ds_transformer_forward(unsigned layer_id,
                    gelu_inp_ptr,
                    ff2_inp_ptr);
 
+    if (layer->UseFlashAttention()) {
+        auto flash_seed = layer->GetFlashSeed();
+        ctx_bufB[0] = (int64_t)flash_seed.first;
+        ctx_bufB[1] = (int64_t)flash_seed.second;
+    }
+
     return {output,
             inp_norm,
             qkv_tf,
@@ -858,7 +1155,9 @@ std::vector<torch::Tensor> ds_transformer_backward(unsigned layer_id,
                                                    const torch::Tensor& output_w,
                                                    const torch::Tensor& output_b,
                                                    const torch::Tensor& norm_w,
-                                                   const torch::Tensor& norm_b)
+                                                   const torch::Tensor& norm_b,
+                                                   const torch::Tensor& token_index,
+                                                   const torch::Tensor& padded_index)
 {
     auto g_output = grad_output.contiguous();
     CHECK_INPUT(g_output);
@@ -866,8 +1165,6 @@ std::vector<torch::Tensor> ds_transformer_backward(unsigned layer_id,
     CHECK_INPUT(inp_norm);
     CHECK_INPUT(qkv_tf);
     CHECK_INPUT(add_res);
-    CHECK_INPUT(soft_out);
-    CHECK_INPUT(ctx_bufB);
     CHECK_INPUT(attn_o_inp);
     CHECK_INPUT(ff1_inp);
     CHECK_INPUT(gelu_inp);
@@ -887,14 +1184,29 @@ std::vector<torch::Tensor> ds_transformer_backward(unsigned layer_id,
     CHECK_INPUT(norm_w);
     CHECK_INPUT(norm_b);
 
-    unsigned bsz = g_output.size(0);
+    const bool packed = token_index.numel() > 0;
+    if (packed) {
+        CHECK_INPUT(token_index);
+        CHECK_INPUT(padded_index);
+    }
+    unsigned bsz = packed ? input_mask.size(0) : g_output.size(0);
+    unsigned input_seq = packed ? input_mask.size(3) : g_output.size(1);
 
     std::shared_ptr<BertTransformerLayer<T>> layer =
         std::static_pointer_cast<BertTransformerLayer<T>>(s_transformer_layers[layer_id]);
 
+    CHECK_INPUT(soft_out);
+    if (layer->UseFlashAttention()) {
+        auto seed = ctx_bufB.cpu();
+        layer->SetFlashSeed(std::make_pair((uint64_t)seed[0].item<int64_t>(),
+                                           (uint64_t)seed[1].item<int64_t>()));
+    } else {
+        CHECK_INPUT(ctx_bufB);
+    }
+
     unsigned seq_len = layer->GetSeqLength();
-    if (g_output.size(1) != seq_len) {
-        seq_len = g_output.size(1);
+    if (input_seq != seq_len) {
+        seq_len = input_seq;
         layer->SetSeqLength(seq_len);
     }
     auto options = torch::TensorOptions()
@@ -908,10 +1220,27 @@ std::vector<torch::Tensor> ds_transformer_backward(unsigned layer_id,
                                                          layer->GetIntermediateSize(),
                                                          layer->GetNumHeads(),
                                                          layer->IsTrainingMode(),
-                                                         layer->GeluCheckpoint())},
+                                                         layer->GeluCheckpoint(),
+                                                         layer->UseFlashAttention(),
+                                                         layer->UseSwiglu())},
                                   options);
     TrainingContext::Instance().SetWorkSpace((T*)workspace.data_ptr());
 
+    // The activations the forward did not keep are rebuilt into new tensors by Recompute, under
+    // gelu_checkpoint ff2_inp is the intermediate GEMM output as well.
+    unsigned tokens = packed ? g_output.size(0) : bsz * seq_len;
+    auto qkv_buf =
+        (layer->RecomputeQkv()
+             ? torch::empty({(bsz * seq_len), 3 * layer->GetHiddenSize()}, options)
+             : qkv_tf);
+    auto soft_out_buf =
+        (layer->RecomputeSoftmax()
+             ? torch::empty({(bsz * layer->GetNumHeads() * seq_len), seq_len}, options)
+             : soft_out);
+    auto gelu_inp_buf =
+        (layer->RecomputeFF1() ? torch::empty({tokens, layer->GetFF1Size()}, options) : gelu_inp);
+    auto ff2_inp_buf = (layer->GeluCheckpoint() ? gelu_inp_buf : ff2_inp);
+
     auto grad_input = torch::empty_like(input);
     auto grad_attn_qkvw = torch::empty_like(attn_qkvw);
     auto grad_attn_qkvb = torch::empty_like(attn_qkvb);
@@ -931,20 +1260,21 @@ std::vector<torch::Tensor> ds_transformer_backward(unsigned layer_id,
     const T* input_ptr = (const T*)input.data_ptr();
     const T* output_ptr = (const T*)output.data_ptr();
     const T* inp_norm_ptr = (const T*)inp_norm.data_ptr();
-    const T* q_tf_ptr = (const T*)qkv_tf.data_ptr();
+    const T* q_tf_ptr = (const T*)qkv_buf.data_ptr();
     const T* add_res_ptr = (const T*)add_res.data_ptr();
     const T* k_tf_ptr =
         q_tf_ptr + (bsz * layer->GetSeqLength() * output_w.size(0));  //(const T*)k_tf.data_ptr();
     const T* v_tf_ptr =
         k_tf_ptr + (bsz * layer->GetSeqLength() * output_w.size(0));  //(const T*)v_tf.data_ptr();
     const T* ff1_inp_ptr = (const T*)ff1_inp.data_ptr();
-    const T* gelu_inp_ptr = (const T*)gelu_inp.data_ptr();
-    const T* ff2_inp_ptr = (const T*)ff2_inp.data_ptr();
+    const T* gelu_inp_ptr = (const T*)gelu_inp_buf.data_ptr();
+    const T* ff2_inp_ptr = (const T*)ff2_inp_buf.data_ptr();
     const T* ctx_bufB_ptr = (const T*)ctx_bufB.data_ptr();
-    const T* soft_out_ptr = (const T*)soft_out.data_ptr();
+    const T* soft_out_ptr = (const T*)soft_out_buf.data_ptr();
     const T* attn_o_inp_ptr = (const T*)attn_o_inp.data_ptr();
     const T* input_mask_ptr = (const T*)input_mask.data_ptr();
     const T* attn_qkvw_ptr = (const T*)attn_qkvw.data_ptr();
+    const T* attn_qkvb_ptr = (const T*)attn_qkvb.data_ptr();
     const T* attn_ow_ptr = (const T*)attn_ow.data_ptr();
     const T* attn_nw_ptr = (const T*)attn_nw.data_ptr();
     const T* attn_nb_ptr = (const T*)attn_nb.data_ptr();
@@ -969,6 +1299,13 @@ std::vector<torch::Tensor> ds_transformer_backward(unsigned layer_id,
     T* grad_norm_w_ptr = (T*)grad_norm_w.data_ptr();
     T* grad_norm_b_ptr = (T*)grad_norm_b.data_ptr();
 
+    auto packed_buf = (packed ? torch::empty({3 * bsz * seq_len, layer->GetHiddenSize()}, options)
+                              : torch::Tensor());
+    layer->SetPackedTokens(packed ? g_output.size(0) : 0,
+                           packed ? (const int*)token_index.data_ptr() : nullptr,
+                           packed ? (const int*)padded_index.data_ptr() : nullptr,
+                           packed ? (T*)packed_buf.data_ptr() : nullptr);
+
     layer->SetIntermediateBuffers((uint8_t*)attn_prob_dropout_mask.data_ptr(),
                                   (uint8_t*)attn_output_dropout_mask.data_ptr(),
                                   (uint8_t*)layer_output_dropout_mask.data_ptr(),
@@ -977,6 +1314,19 @@ std::vector<torch::Tensor> ds_transformer_backward(unsigned layer_id,
                                   (T*)layer_norm_var.data_ptr(),
                                   (T*)layer_norm_mean.data_ptr());
 
+    if (layer->RecomputeQkv() || layer->RecomputeSoftmax() || layer->RecomputeFF1())
+        layer->Recompute(bsz,
+                         (layer->IsPreLayerNorm() ? inp_norm_ptr : input_ptr),
+                         input_mask_ptr,
+                         attn_qkvw_ptr,
+                         attn_qkvb_ptr,
+                         ff1_inp_ptr,
+                         inter_w_ptr,
+                         inter_b_ptr,
+                         (T*)qkv_buf.data_ptr(),
+                         (T*)soft_out_buf.data_ptr(),
+                         (T*)gelu_inp_buf.data_ptr());
+
     layer->Backward(bsz,
                     grad_output_ptr,
                     input_ptr,
@@ -1034,22 +1384,29 @@ std::vector<torch::Tensor> ds_transformer_backward(unsigned layer_id,
 
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
-    m.def("forward_fp32",
-          &ds_transformer_forward<float>,
-          "DeepSpeed Transformer forward with fp32 (CUDA)");
-    m.def("forward_fp16",
-          &ds_transformer_forward<__half>,
-          "DeepSpeed Transformer forward with fp16 (CUDA)");
-    m.def("backward_fp32",
-          &ds_transformer_backward<float>,
-          "DeepSpeed Transformer backward with fp32 (CUDA)");
-    m.def("backward_fp16",
-          &ds_transformer_backward<__half>,
-          "DeepSpeed Transformer backward with fp16 (CUDA)");
-    m.def("create_transformer_layer_fp32",
-          &create_transformer_layer<float>,
-          "Create DeepSpeed Transformer Transformer Layer with fp32 (CUDA)");
-    m.def("create_transformer_layer_fp16",
-          &create_transformer_layer<__half>,
-          "Create DeepSpeed Transformer Transformer Layer with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "forward_fp32",
+                       &ds_transformer_forward<float>,
+                       "DeepSpeed Transformer forward with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "forward_fp16",
+                       &ds_transformer_forward<__half>,
+                       "DeepSpeed Transformer forward with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "backward_fp32",
+                       &ds_transformer_backward<float>,
+                       "DeepSpeed Transformer backward with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "backward_fp16",
+                       &ds_transformer_backward<__half>,
+                       "DeepSpeed Transformer backward with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "create_transformer_layer_fp32",
+                       &create_transformer_layer<float>,
+                       "Create DeepSpeed Transformer Transformer Layer with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "create_transformer_layer_fp16",
+                       &create_transformer_layer<__half>,
+                       "Create DeepSpeed Transformer Transformer Layer with fp16 (CUDA)");
+    ds_instrument::def_queries(m);
 }
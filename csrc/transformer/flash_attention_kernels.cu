@@ -0,0 +1,656 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "conversion_utils.h"
+#include "custom_cuda_layers.h"
+
+namespace cg = cooperative_groups;
+
+/*
+Tiled attention of BertTransformerLayer: softmax(q . k^T * scale + mask) with dropout, times v,
+without the [batch, heads, seq, seq] scores and dropout mask in memory.
+
+The forward streams the keys and values of one (batch, head) through shared memory for a tile of
+query rows, each warp keeping a running max, sum and output for its rows (online softmax), and
+stores the log-sum-exp of every row. The backward recomputes the probabilities from it: one
+kernel owns a tile of keys and accumulates their dK and dV over all the queries, another owns a
+tile of queries and accumulates their dQ over all the keys, so none of them needs atomics and the
+gradients are deterministic.
+
+Dropout draws one Philox value per (query, key) of a (batch, head) from the seed and offset of
+the forward, so the backward finds the same mask without storing it.
+*/
+namespace attn_flash {
+
+constexpr int warps = 4;
+constexpr int threads = warps * WARP_SIZE;
+// Forward and dQ: rows_per_warp query rows per warp, one key per lane.
+constexpr int rows_per_warp = 4;
+constexpr int q_tile = warps * rows_per_warp;
+constexpr int kv_tile = WARP_SIZE;
+// dK/dV: one query per lane, keys_per_warp keys per warp.
+constexpr int bwd_q_tile = WARP_SIZE;
+constexpr int keys_per_warp = 8;
+constexpr int bwd_kv_tile = warps * keys_per_warp;
+constexpr int max_lane_dims = ATTN_FLASH_MAX_HEAD_SIZE / WARP_SIZE;
+
+// Philox4x32-10, first word of the block of counter ctr.
+DS_D_INLINE uint32_t philox(uint4 ctr, uint2 key)
+{
+    constexpr uint32_t m0 = 0xD2511F53;
+    constexpr uint32_t m1 = 0xCD9E8D57;
+#pragma unroll
+    for (int i = 0; i < 10; i++) {
+        const uint32_t hi0 = __umulhi(m0, ctr.x);
+        const uint32_t hi1 = __umulhi(m1, ctr.z);
+        ctr = make_uint4(hi1 ^ ctr.y ^ key.x, m1 * ctr.z, hi0 ^ ctr.w ^ key.y, m0 * ctr.x);
+        key.x += 0x9E3779B9;
+        key.y += 0xBB67AE85;
+    }
+    return ctr.x;
+}
+
+// Dropout factor of probability (query, key) of score row `row`: 0 or 1 / (1 - ratio).
+DS_D_INLINE float dropout(int row,
+                          int query,
+                          int key,
+                          float ratio,
+                          float keep_scale,
+                          uint64_t seed,
+                          uint64_t offset)
+{
+    if (ratio <= 0.f) return 1.f;
+    const uint32_t bits = philox(make_uint4(key, query, row, (uint32_t)offset),
+                                 make_uint2((uint32_t)seed, (uint32_t)(seed >> 32)));
+    return (float)bits * 2.3283064365386963e-10f >= ratio ? keep_scale : 0.f;
+}
+
+}  // namespace attn_flash
+
+template <typename T>
+__global__ void attn_flash_forward(T* output,
+                                   float* lse,
+                                   const T* query,
+                                   const T* key,
+                                   const T* value,
+                                   const T* mask,
+                                   int heads,
+                                   int seq_len,
+                                   int head_size,
+                                   float scale,
+                                   float ratio,
+                                   uint64_t seed,
+                                   uint64_t offset)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<WARP_SIZE> warp = cg::tiled_partition<WARP_SIZE>(tb);
+
+    const int q_start = blockIdx.x * attn_flash::q_tile;
+    const int row = blockIdx.y;
+    const int batch = row / heads;
+    const int warp_id = threadIdx.x / WARP_SIZE;
+    const int lane = threadIdx.x % WARP_SIZE;
+    const float keep_scale = 1.f / (1.f - ratio);
+
+    // The key rows are padded by one so the lanes, each on its own key, hit different banks.
+    __shared__ float q_s[attn_flash::q_tile][ATTN_FLASH_MAX_HEAD_SIZE];
+    __shared__ float k_s[attn_flash::kv_tile][ATTN_FLASH_MAX_HEAD_SIZE + 1];
+    __shared__ float v_s[attn_flash::kv_tile][ATTN_FLASH_MAX_HEAD_SIZE];
+
+    const size_t row_offset = (size_t)row * seq_len * head_size;
+    query += row_offset;
+    key += row_offset;
+    value += row_offset;
+    output += row_offset;
+    lse += (size_t)row * seq_len;
+    if (mask) mask += (size_t)batch * seq_len;
+
+    for (int idx = threadIdx.x; idx < attn_flash::q_tile * head_size; idx += attn_flash::threads) {
+        const int r = idx / head_size;
+        const int d = idx % head_size;
+        q_s[r][d] = (q_start + r < seq_len)
+                        ? conversion::to<float>(query[(size_t)(q_start + r) * head_size + d])
+                        : 0.f;
+    }
+
+    float max_val[attn_flash::rows_per_warp];
+    float sum[attn_flash::rows_per_warp];
+    float acc[attn_flash::rows_per_warp][attn_flash::max_lane_dims];
+#pragma unroll
+    for (int r = 0; r < attn_flash::rows_per_warp; r++) {
+        max_val[r] = -INFINITY;
+        sum[r] = 0.f;
+#pragma unroll
+        for (int i = 0; i < attn_flash::max_lane_dims; i++) acc[r][i] = 0.f;
+    }
+
+    for (int kv_start = 0; kv_start < seq_len; kv_start += attn_flash::kv_tile) {
+        tb.sync();
+        for (int idx = threadIdx.x; idx < attn_flash::kv_tile * head_size;
+             idx += attn_flash::threads) {
+            const int j = idx / head_size;
+            const int d = idx % head_size;
+            const bool in_range = kv_start + j < seq_len;
+            const size_t offset_kv = (size_t)(kv_start + j) * head_size + d;
+            k_s[j][d] = in_range ? conversion::to<float>(key[offset_kv]) : 0.f;
+            v_s[j][d] = in_range ? conversion::to<float>(value[offset_kv]) : 0.f;
+        }
+        tb.sync();
+
+        const int pos = kv_start + lane;
+        const bool valid = pos < seq_len;
+        const float mask_val = (valid && mask) ? conversion::to<float>(mask[pos]) : 0.f;
+#pragma unroll
+        for (int r = 0; r < attn_flash::rows_per_warp; r++) {
+            const int q_row = warp_id * attn_flash::rows_per_warp + r;
+            const int seq_id = q_start + q_row;
+            if (seq_id >= seq_len) continue;
+
+            float score = -INFINITY;
+            if (valid) {
+                float dot = 0.f;
+                for (int d = 0; d < head_size; d++) dot += q_s[q_row][d] * k_s[lane][d];
+                score = dot * scale + mask_val;
+            }
+
+            float tile_max = score;
+#pragma unroll
+            for (int j = WARP_SIZE / 2; j > 0; j >>= 1)
+                tile_max = fmaxf(tile_max, warp.shfl_xor(tile_max, j));
+
+            const float new_max = fmaxf(max_val[r], tile_max);
+            const float correction = __expf(max_val[r] - new_max);
+            const float p = valid ? __expf(score - new_max) : 0.f;
+            float p_sum = p;
+#pragma unroll
+            for (int j = WARP_SIZE / 2; j > 0; j >>= 1) p_sum += warp.shfl_xor(p_sum, j);
+            sum[r] = sum[r] * correction + p_sum;
+            max_val[r] = new_max;
+
+            // The sum takes every probability, the output only the ones dropout keeps.
+            const float p_drop =
+                valid ? p * attn_flash::dropout(row, seq_id, pos, ratio, keep_scale, seed, offset)
+                      : 0.f;
+#pragma unroll
+            for (int i = 0; i < attn_flash::max_lane_dims; i++) acc[r][i] *= correction;
+            for (int j = 0; j < attn_flash::kv_tile; j++) {
+                const float p_j = warp.shfl(p_drop, j);
+#pragma unroll
+                for (int i = 0; i < attn_flash::max_lane_dims; i++) {
+                    const int d = lane + i * WARP_SIZE;
+                    if (d < head_size) acc[r][i] += p_j * v_s[j][d];
+                }
+            }
+        }
+    }
+
+#pragma unroll
+    for (int r = 0; r < attn_flash::rows_per_warp; r++) {
+        const int seq_id = q_start + warp_id * attn_flash::rows_per_warp + r;
+        if (seq_id >= seq_len) continue;
+        const float inv_sum = 1.f / sum[r];
+#pragma unroll
+        for (int i = 0; i < attn_flash::max_lane_dims; i++) {
+            const int d = lane + i * WARP_SIZE;
+            if (d < head_size)
+                output[(size_t)seq_id * head_size + d] = conversion::to<T>(acc[r][i] * inv_sum);
+        }
+        if (lane == 0) lse[seq_id] = max_val[r] + __logf(sum[r]);
+    }
+}
+
+// delta of row (batch, head, query) = d_out . out of that row, one warp per row.
+template <typename T>
+__global__ void attn_flash_delta(float* delta,
+                                 const T* d_out,
+                                 const T* out,
+                                 int heads,
+                                 int seq_len,
+                                 int head_size,
+                                 int rows)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<WARP_SIZE> warp = cg::tiled_partition<WARP_SIZE>(tb);
+
+    const int id = blockIdx.x * attn_flash::warps + threadIdx.x / WARP_SIZE;
+    if (id >= rows) return;
+    // id enumerates (batch, head, query), the inputs are [batch, seq, heads, head_size].
+    const int query = id % seq_len;
+    const int head = (id / seq_len) % heads;
+    const int batch = id / (seq_len * heads);
+    const size_t offset = (((size_t)batch * seq_len + query) * heads + head) * head_size;
+
+    float sum = 0.f;
+    for (int d = warp.thread_rank(); d < head_size; d += WARP_SIZE)
+        sum += conversion::to<float>(d_out[offset + d]) * conversion::to<float>(out[offset + d]);
+#pragma unroll
+    for (int j = WARP_SIZE / 2; j > 0; j >>= 1) sum += warp.shfl_xor(sum, j);
+    if (warp.thread_rank() == 0) delta[id] = sum;
+}
+
+/*
+dK and dV of a tile of keys: lane i takes query i of every query tile, the warps keys_per_warp
+keys each. The per (query, key) terms are broadcast over the lanes, which own the head dims of
+the accumulators.
+*/
+template <typename T>
+__global__ void attn_flash_backward_kv(T* d_key,
+                                       T* d_value,
+                                       const T* d_out,
+                                       const float* delta,
+                                       const float* lse,
+                                       const T* query,
+                                       const T* key,
+                                       const T* value,
+                                       const T* mask,
+                                       int heads,
+                                       int seq_len,
+                                       int head_size,
+                                       float scale,
+                                       float ratio,
+                                       uint64_t seed,
+                                       uint64_t offset)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<WARP_SIZE> warp = cg::tiled_partition<WARP_SIZE>(tb);
+
+    const int kv_start = blockIdx.x * attn_flash::bwd_kv_tile;
+    const int row = blockIdx.y;
+    const int batch = row / heads;
+    const int head = row % heads;
+    const int warp_id = threadIdx.x / WARP_SIZE;
+    const int lane = threadIdx.x % WARP_SIZE;
+    const float keep_scale = 1.f / (1.f - ratio);
+    const int stride = head_size + 1;
+    const int hidden = heads * head_size;
+
+    // All rows padded by one, every lane reads its own query row.
+    extern __shared__ float smem[];
+    float* k_s = smem;
+    float* v_s = k_s + attn_flash::bwd_kv_tile * stride;
+    float* q_s = v_s + attn_flash::bwd_kv_tile * stride;
+    float* do_s = q_s + attn_flash::bwd_q_tile * stride;
+
+    const size_t row_offset = (size_t)row * seq_len * head_size;
+    query += row_offset;
+    key += row_offset;
+    value += row_offset;
+    d_key += row_offset;
+    d_value += row_offset;
+    lse += (size_t)row * seq_len;
+    delta += (size_t)row * seq_len;
+    d_out += (size_t)batch * seq_len * hidden + head * head_size;
+
+    for (int idx = threadIdx.x; idx < attn_flash::bwd_kv_tile * head_size;
+         idx += attn_flash::threads) {
+        const int j = idx / head_size;
+        const int d = idx % head_size;
+        const bool in_range = kv_start + j < seq_len;
+        const size_t offset_kv = (size_t)(kv_start + j) * head_size + d;
+        k_s[j * stride + d] = in_range ? conversion::to<float>(key[offset_kv]) : 0.f;
+        v_s[j * stride + d] = in_range ? conversion::to<float>(value[offset_kv]) : 0.f;
+    }
+
+    float mask_val[attn_flash::keys_per_warp];
+    float d_k[attn_flash::keys_per_warp][attn_flash::max_lane_dims];
+    float d_v[attn_flash::keys_per_warp][attn_flash::max_lane_dims];
+#pragma unroll
+    for (int jj = 0; jj < attn_flash::keys_per_warp; jj++) {
+        const int pos = kv_start + warp_id * attn_flash::keys_per_warp + jj;
+        mask_val[jj] = (pos < seq_len && mask)
+                           ? conversion::to<float>(mask[(size_t)batch * seq_len + pos])
+                           : 0.f;
+#pragma unroll
+        for (int i = 0; i < attn_flash::max_lane_dims; i++) {
+            d_k[jj][i] = 0.f;
+            d_v[jj][i] = 0.f;
+        }
+    }
+
+    for (int q_start = 0; q_start < seq_len; q_start += attn_flash::bwd_q_tile) {
+        tb.sync();
+        for (int idx = threadIdx.x; idx < attn_flash::bwd_q_tile * head_size;
+             idx += attn_flash::threads) {
+            const int i = idx / head_size;
+            const int d = idx % head_size;
+            const bool in_range = q_start + i < seq_len;
+            q_s[i * stride + d] =
+                in_range ? conversion::to<float>(query[(size_t)(q_start + i) * head_size + d])
+                         : 0.f;
+            do_s[i * stride + d] =
+                in_range ? conversion::to<float>(d_out[(size_t)(q_start + i) * hidden + d]) : 0.f;
+        }
+        tb.sync();
+
+        const int q_pos = q_start + lane;
+        const bool q_valid = q_pos < seq_len;
+        const float row_lse = q_valid ? lse[q_pos] : 0.f;
+        const float row_delta = q_valid ? delta[q_pos] : 0.f;
+
+        float p_drop[attn_flash::keys_per_warp];
+        float d_s[attn_flash::keys_per_warp];
+#pragma unroll
+        for (int jj = 0; jj < attn_flash::keys_per_warp; jj++) {
+            const int j = warp_id * attn_flash::keys_per_warp + jj;
+            const int pos = kv_start + j;
+            p_drop[jj] = 0.f;
+            d_s[jj] = 0.f;
+            if (!q_valid || pos >= seq_len) continue;
+            float dot = 0.f;
+            float d_p = 0.f;
+            for (int d = 0; d < head_size; d++) {
+                dot += q_s[lane * stride + d] * k_s[j * stride + d];
+                d_p += do_s[lane * stride + d] * v_s[j * stride + d];
+            }
+            const float p = __expf(dot * scale + mask_val[jj] - row_lse);
+            const float drop =
+                attn_flash::dropout(row, q_pos, pos, ratio, keep_scale, seed, offset);
+            p_drop[jj] = p * drop;
+            d_s[jj] = p * (d_p * drop - row_delta);
+        }
+
+        for (int i = 0; i < attn_flash::bwd_q_tile; i++) {
+#pragma unroll
+            for (int jj = 0; jj < attn_flash::keys_per_warp; jj++) {
+                const float p_i = warp.shfl(p_drop[jj], i);
+                const float ds_i = warp.shfl(d_s[jj], i);
+#pragma unroll
+                for (int t = 0; t < attn_flash::max_lane_dims; t++) {
+                    const int d = lane + t * WARP_SIZE;
+                    if (d < head_size) {
+                        d_v[jj][t] += p_i * do_s[i * stride + d];
+                        d_k[jj][t] += ds_i * q_s[i * stride + d];
+                    }
+                }
+            }
+        }
+    }
+
+#pragma unroll
+    for (int jj = 0; jj < attn_flash::keys_per_warp; jj++) {
+        const int pos = kv_start + warp_id * attn_flash::keys_per_warp + jj;
+        if (pos >= seq_len) continue;
+#pragma unroll
+        for (int t = 0; t < attn_flash::max_lane_dims; t++) {
+            const int d = lane + t * WARP_SIZE;
+            if (d < head_size) {
+                d_key[(size_t)pos * head_size + d] = conversion::to<T>(d_k[jj][t] * scale);
+                d_value[(size_t)pos * head_size + d] = conversion::to<T>(d_v[jj][t]);
+            }
+        }
+    }
+}
+
+// dQ of a tile of queries, laid out like the forward: one key per lane, 4 rows per warp.
+template <typename T>
+__global__ void attn_flash_backward_q(T* d_query,
+                                      const T* d_out,
+                                      const float* delta,
+                                      const float* lse,
+                                      const T* query,
+                                      const T* key,
+                                      const T* value,
+                                      const T* mask,
+                                      int heads,
+                                      int seq_len,
+                                      int head_size,
+                                      float scale,
+                                      float ratio,
+                                      uint64_t seed,
+                                      uint64_t offset)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<WARP_SIZE> warp = cg::tiled_partition<WARP_SIZE>(tb);
+
+    const int q_start = blockIdx.x * attn_flash::q_tile;
+    const int row = blockIdx.y;
+    const int batch = row / heads;
+    const int head = row % heads;
+    const int warp_id = threadIdx.x / WARP_SIZE;
+    const int lane = threadIdx.x % WARP_SIZE;
+    const float keep_scale = 1.f / (1.f - ratio);
+    const int stride = head_size + 1;
+    const int hidden = heads * head_size;
+
+    extern __shared__ float smem[];
+    float* q_s = smem;
+    float* do_s = q_s + attn_flash::q_tile * head_size;
+    float* k_s = do_s + attn_flash::q_tile * head_size;
+    float* v_s = k_s + attn_flash::kv_tile * stride;
+
+    const size_t row_offset = (size_t)row * seq_len * head_size;
+    query += row_offset;
+    key += row_offset;
+    value += row_offset;
+    d_query += row_offset;
+    lse += (size_t)row * seq_len;
+    delta += (size_t)row * seq_len;
+    d_out += (size_t)batch * seq_len * hidden + head * head_size;
+    if (mask) mask += (size_t)batch * seq_len;
+
+    for (int idx = threadIdx.x; idx < attn_flash::q_tile * head_size; idx += attn_flash::threads) {
+        const int r = idx / head_size;
+        const int d = idx % head_size;
+        const bool in_range = q_start + r < seq_len;
+        q_s[idx] = in_range ? conversion::to<float>(query[(size_t)(q_start + r) * head_size + d])
+                            : 0.f;
+        do_s[idx] =
+            in_range ? conversion::to<float>(d_out[(size_t)(q_start + r) * hidden + d]) : 0.f;
+    }
+
+    float row_lse[attn_flash::rows_per_warp];
+    float row_delta[attn_flash::rows_per_warp];
+    float acc[attn_flash::rows_per_warp][attn_flash::max_lane_dims];
+#pragma unroll
+    for (int r = 0; r < attn_flash::rows_per_warp; r++) {
+        const int seq_id = q_start + warp_id * attn_flash::rows_per_warp + r;
+        row_lse[r] = seq_id < seq_len ? lse[seq_id] : 0.f;
+        row_delta[r] = seq_id < seq_len ? delta[seq_id] : 0.f;
+#pragma unroll
+        for (int i = 0; i < attn_flash::max_lane_dims; i++) acc[r][i] = 0.f;
+    }
+
+    for (int kv_start = 0; kv_start < seq_len; kv_start += attn_flash::kv_tile) {
+        tb.sync();
+        for (int idx = threadIdx.x; idx < attn_flash::kv_tile * head_size;
+             idx += attn_flash::threads) {
+            const int j = idx / head_size;
+            const int d = idx % head_size;
+            const bool in_range = kv_start + j < seq_len;
+            const size_t offset_kv = (size_t)(kv_start + j) * head_size + d;
+            k_s[j * stride + d] = in_range ? conversion::to<float>(key[offset_kv]) : 0.f;
+            v_s[j * stride + d] = in_range ? conversion::to<float>(value[offset_kv]) : 0.f;
+        }
+        tb.sync();
+
+        const int pos = kv_start + lane;
+        const bool valid = pos < seq_len;
+        const float mask_val = (valid && mask) ? conversion::to<float>(mask[pos]) : 0.f;
+#pragma unroll
+        for (int r = 0; r < attn_flash::rows_per_warp; r++) {
+            const int q_row = warp_id * attn_flash::rows_per_warp + r;
+            const int seq_id = q_start + q_row;
+            if (seq_id >= seq_len) continue;
+
+            float d_s = 0.f;
+            if (valid) {
+                float dot = 0.f;
+                float d_p = 0.f;
+                for (int d = 0; d < head_size; d++) {
+                    dot += q_s[q_row * head_size + d] * k_s[lane * stride + d];
+                    d_p += do_s[q_row * head_size + d] * v_s[lane * stride + d];
+                }
+                const float p = __expf(dot * scale + mask_val - row_lse[r]);
+                const float drop =
+                    attn_flash::dropout(row, seq_id, pos, ratio, keep_scale, seed, offset);
+                d_s = p * (d_p * drop - row_delta[r]);
+            }
+            for (int j = 0; j < attn_flash::kv_tile; j++) {
+                const float ds_j = warp.shfl(d_s, j);
+#pragma unroll
+                for (int i = 0; i < attn_flash::max_lane_dims; i++) {
+                    const int d = lane + i * WARP_SIZE;
+                    if (d < head_size) acc[r][i] += ds_j * k_s[j * stride + d];
+                }
+            }
+        }
+    }
+
+#pragma unroll
+    for (int r = 0; r < attn_flash::rows_per_warp; r++) {
+        const int seq_id = q_start + warp_id * attn_flash::rows_per_warp + r;
+        if (seq_id >= seq_len) continue;
+#pragma unroll
+        for (int i = 0; i < attn_flash::max_lane_dims; i++) {
+            const int d = lane + i * WARP_SIZE;
+            if (d < head_size)
+                d_query[(size_t)seq_id * head_size + d] = conversion::to<T>(acc[r][i] * scale);
+        }
+    }
+}
+
+template <typename T>
+void launch_attn_flash_forward(T* out,
+                               float* lse,
+                               const T* q,
+                               const T* k,
+                               const T* v,
+                               const T* mask,
+                               int batch_size,
+                               int heads,
+                               int seq_length,
+                               int head_size,
+                               float scale,
+                               float dropout_ratio,
+                               std::pair<uint64_t, uint64_t> seed,
+                               cudaStream_t stream)
+{
+    dim3 grid_dim((seq_length + attn_flash::q_tile - 1) / attn_flash::q_tile, batch_size * heads);
+    attn_flash_forward<<<grid_dim, attn_flash::threads, 0, stream>>>(out,
+                                                                     lse,
+                                                                     q,
+                                                                     k,
+                                                                     v,
+                                                                     mask,
+                                                                     heads,
+                                                                     seq_length,
+                                                                     head_size,
+                                                                     scale,
+                                                                     dropout_ratio,
+                                                                     seed.first,
+                                                                     seed.second);
+}
+
+template <typename T>
+void launch_attn_flash_backward(T* d_q,
+                                T* d_k,
+                                T* d_v,
+                                float* delta,
+                                const T* d_out,
+                                const T* out,
+                                const float* lse,
+                                const T* q,
+                                const T* k,
+                                const T* v,
+                                const T* mask,
+                                int batch_size,
+                                int heads,
+                                int seq_length,
+                                int head_size,
+                                float scale,
+                                float dropout_ratio,
+                                std::pair<uint64_t, uint64_t> seed,
+                                cudaStream_t stream)
+{
+    const int rows = batch_size * heads * seq_length;
+    attn_flash_delta<<<(rows + attn_flash::warps - 1) / attn_flash::warps,
+                       attn_flash::threads,
+                       0,
+                       stream>>>(delta, d_out, out, heads, seq_length, head_size, rows);
+
+    // Past 48KB for the largest heads, which needs the opt-in.
+    const int stride = head_size + 1;
+    const size_t kv_smem = (2 * attn_flash::bwd_kv_tile + 2 * attn_flash::bwd_q_tile) * stride *
+                           sizeof(float);
+    cudaFuncSetAttribute(
+        attn_flash_backward_kv<T>, cudaFuncAttributeMaxDynamicSharedMemorySize, kv_smem);
+    dim3 kv_grid((seq_length + attn_flash::bwd_kv_tile - 1) / attn_flash::bwd_kv_tile,
+                 batch_size * heads);
+    attn_flash_backward_kv<<<kv_grid, attn_flash::threads, kv_smem, stream>>>(d_k,
+                                                                              d_v,
+                                                                              d_out,
+                                                                              delta,
+                                                                              lse,
+                                                                              q,
+                                                                              k,
+                                                                              v,
+                                                                              mask,
+                                                                              heads,
+                                                                              seq_length,
+                                                                              head_size,
+                                                                              scale,
+                                                                              dropout_ratio,
+                                                                              seed.first,
+                                                                              seed.second);
+
+    const size_t q_smem =
+        (2 * attn_flash::q_tile * head_size + 2 * attn_flash::kv_tile * stride) * sizeof(float);
+    cudaFuncSetAttribute(
+        attn_flash_backward_q<T>, cudaFuncAttributeMaxDynamicSharedMemorySize, q_smem);
+    dim3 q_grid((seq_length + attn_flash::q_tile - 1) / attn_flash::q_tile, batch_size * heads);
+    attn_flash_backward_q<<<q_grid, attn_flash::threads, q_smem, stream>>>(d_q,
+                                                                           d_out,
+                                                                           delta,
+                                                                           lse,
+                                                                           q,
+                                                                           k,
+                                                                           v,
+                                                                           mask,
+                                                                           heads,
+                                                                           seq_length,
+                                                                           head_size,
+                                                                           scale,
+                                                                           dropout_ratio,
+                                                                           seed.first,
+                                                                           seed.second);
+}
+
+#define INSTANTIATE_ATTN_FLASH(T)                                              \
+    template void launch_attn_flash_forward<T>(T*,                             \
+                                               float*,                         \
+                                               const T*,                       \
+                                               const T*,                       \
+                                               const T*,                       \
+                                               const T*,                       \
+                                               int,                            \
+                                               int,                            \
+                                               int,                            \
+                                               int,                            \
+                                               float,                          \
+                                               float,                          \
+                                               std::pair<uint64_t, uint64_t>,  \
+                                               cudaStream_t);                  \
+    template void launch_attn_flash_backward<T>(T*,                            \
+                                                T*,                            \
+                                                T*,                            \
+                                                float*,                        \
+                                                const T*,                      \
+                                                const T*,                      \
+                                                const float*,                  \
+                                                const T*,                      \
+                                                const T*,                      \
+                                                const T*,                      \
+                                                const T*,                      \
+                                                int,                           \
+                                                int,                           \
+                                                int,                           \
+                                                int,                           \
+                                                float,                         \
+                                                float,                         \
+                                                std::pair<uint64_t, uint64_t>, \
+                                                cudaStream_t);
+
+INSTANTIATE_ATTN_FLASH(float)
+INSTANTIATE_ATTN_FLASH(__half)
@@ -3,7 +3,9 @@
 
 // DeepSpeed Team
 
+#include "conversion_utils.h"
 #include "custom_cuda_layers.h"
+#include "memory_access_utils.h"
 
 inline __device__ float gelu(const float x)
 {
@@ -333,3 +335,141 @@ void launch_d_gelu(T* d_output,
 
 template void launch_d_gelu<float>(float*, const float*, const float*, int, int, cudaStream_t);
 template void launch_d_gelu<__half>(__half*, const __half*, const __half*, int, int, cudaStream_t);
+
+inline __device__ float sigmoid(const float x) { return 1.0f / (1.0f + __expf(-x)); }
+
+/*
+Fused bias add with SwiGLU
+
+The input is the [batch_size, 2 * intermediate_size] output of the intermediate GEMM, whose
+second half of the channels gates the first half through a SiLU:
+    output = (x1 + b1) * silu(x2 + b2)
+Each thread handles 16 bytes of output per step, so intermediate_size % 8 has to be 0 for
+__half (4 for float). Like the GELU above the arithmetic is done in fp32.
+*/
+namespace swiglu {
+constexpr int threads = 256;
+constexpr int granularity = 16;
+}  // namespace swiglu
+
+template <typename T>
+__global__ void fused_bias_swiglu(T* output,
+                                  const T* input,
+                                  const T* bias,
+                                  int intermediate_size,
+                                  int total_elems)
+{
+    constexpr int T_per_access = swiglu::granularity / sizeof(T);
+
+    for (int id = (blockIdx.x * blockDim.x + threadIdx.x) * T_per_access; id < total_elems;
+         id += gridDim.x * blockDim.x * T_per_access) {
+        const int channel = id % intermediate_size;
+        const T* row_input = input + (id / intermediate_size) * 2 * intermediate_size;
+
+        T hidden[T_per_access], gate[T_per_access];
+        T hidden_bias[T_per_access], gate_bias[T_per_access];
+        mem_access::load_global<swiglu::granularity>(hidden, row_input + channel);
+        mem_access::load_global<swiglu::granularity>(gate,
+                                                     row_input + channel + intermediate_size);
+        mem_access::load_global<swiglu::granularity>(hidden_bias, bias + channel);
+        mem_access::load_global<swiglu::granularity>(gate_bias,
+                                                     bias + channel + intermediate_size);
+
+#pragma unroll
+        for (int j = 0; j < T_per_access; j++) {
+            float h = conversion::to<float>(hidden[j]) + conversion::to<float>(hidden_bias[j]);
+            float g = conversion::to<float>(gate[j]) + conversion::to<float>(gate_bias[j]);
+            hidden[j] = conversion::to<T>(h * g * sigmoid(g));
+        }
+
+        mem_access::store_global<swiglu::granularity>(output + id, hidden);
+    }
+}
+
+/*
+Backward of the above: with s = sigmoid(g), d silu(g) / dg = s * (1 + g * (1 - s)), so
+    d_input1 = d_output * silu(g)
+    d_input2 = d_output * h * s * (1 + g * (1 - s))
+The pre-activation is recomputed from the un-biased input and the bias, the same way d_gelu does,
+so the forward doesn't need to store it. The bias gradient is the column sum of d_input.
+*/
+template <typename T>
+__global__ void d_swiglu_func(T* d_input,
+                              const T* d_output,
+                              const T* input,
+                              const T* bias,
+                              int intermediate_size,
+                              int total_elems)
+{
+    constexpr int T_per_access = swiglu::granularity / sizeof(T);
+
+    for (int id = (blockIdx.x * blockDim.x + threadIdx.x) * T_per_access; id < total_elems;
+         id += gridDim.x * blockDim.x * T_per_access) {
+        const int channel = id % intermediate_size;
+        const int row_offset = (id / intermediate_size) * 2 * intermediate_size;
+
+        T grad[T_per_access], hidden[T_per_access], gate[T_per_access];
+        T hidden_bias[T_per_access], gate_bias[T_per_access];
+        mem_access::load_global<swiglu::granularity>(grad, d_output + id);
+        mem_access::load_global<swiglu::granularity>(hidden, input + row_offset + channel);
+        mem_access::load_global<swiglu::granularity>(
+            gate, input + row_offset + channel + intermediate_size);
+        mem_access::load_global<swiglu::granularity>(hidden_bias, bias + channel);
+        mem_access::load_global<swiglu::granularity>(gate_bias,
+                                                     bias + channel + intermediate_size);
+
+#pragma unroll
+        for (int j = 0; j < T_per_access; j++) {
+            float dy = conversion::to<float>(grad[j]);
+            float h = conversion::to<float>(hidden[j]) + conversion::to<float>(hidden_bias[j]);
+            float g = conversion::to<float>(gate[j]) + conversion::to<float>(gate_bias[j]);
+            float s = sigmoid(g);
+            hidden[j] = conversion::to<T>(dy * g * s);
+            gate[j] = conversion::to<T>(dy * h * s * (1.0f + g * (1.0f - s)));
+        }
+
+        mem_access::store_global<swiglu::granularity>(d_input + row_offset + channel, hidden);
+        mem_access::store_global<swiglu::granularity>(
+            d_input + row_offset + channel + intermediate_size, gate);
+    }
+}
+
+template <typename T>
+void launch_bias_swiglu(const T* input,
+                        const T* bias,
+                        T* output,
+                        int intermediate_size,
+                        int batch_size,
+                        cudaStream_t stream)
+{
+    constexpr int T_per_access = swiglu::granularity / sizeof(T);
+    const int total_elems = intermediate_size * batch_size;
+    const int blocks = (total_elems / T_per_access + swiglu::threads - 1) / swiglu::threads;
+
+    fused_bias_swiglu<<<blocks, swiglu::threads, 0, stream>>>(
+        output, input, bias, intermediate_size, total_elems);
+}
+
+template <typename T>
+void launch_d_swiglu(T* d_input,
+                     const T* d_output,
+                     const T* input,
+                     const T* bias,
+                     int intermediate_size,
+                     int batch_size,
+                     cudaStream_t stream)
+{
+    constexpr int T_per_access = swiglu::granularity / sizeof(T);
+    const int total_elems = intermediate_size * batch_size;
+    const int blocks = (total_elems / T_per_access + swiglu::threads - 1) / swiglu::threads;
+
+    d_swiglu_func<<<blocks, swiglu::threads, 0, stream>>>(
+        d_input, d_output, input, bias, intermediate_size, total_elems);
+}
+
+#define INSTANTIATE_SWIGLU(T)                                                            \
+    template void launch_bias_swiglu<T>(const T*, const T*, T*, int, int, cudaStream_t); \
+    template void launch_d_swiglu<T>(T*, const T*, const T*, const T*, int, int, cudaStream_t);
+
+INSTANTIATE_SWIGLU(float)
+INSTANTIATE_SWIGLU(__half)
@@ -414,3 +414,36 @@ void launch_fused_add4<__half>(__half* out,
     fused_add4_kernel<<<grid_dim, block_dim, 0, stream>>>(
         out, inp1, inp2, inp3, inp4, (batch_size * seq_length * hidden_size), hidden_size / 4);
 }
+
+template <typename T>
+__global__ void gather_tokens_kernel(T* out, const T* in, const int* index, int width)
+{
+    // Rows are copied in 16 byte chunks, the widths of the layer are multiples of 8 elements.
+    const int vec_width = width * sizeof(T) / sizeof(float4);
+    const int row = index[blockIdx.x];
+
+    float4* out_4 = reinterpret_cast<float4*>(out) + (size_t)blockIdx.x * vec_width;
+    const float4* in_4 = reinterpret_cast<const float4*>(in) + (size_t)row * vec_width;
+
+    for (int i = threadIdx.x; i < vec_width; i += blockDim.x)
+        out_4[i] = row < 0 ? make_float4(0.f, 0.f, 0.f, 0.f) : in_4[i];
+}
+
+template <typename T>
+void launch_gather_tokens(T* out,
+                          const T* in,
+                          const int* index,
+                          int rows,
+                          int width,
+                          cudaStream_t stream)
+{
+    gather_tokens_kernel<<<rows, THREADS, 0, stream>>>(out, in, index, width);
+}
+
+template void launch_gather_tokens<float>(float*, const float*, const int*, int, int, cudaStream_t);
+template void launch_gather_tokens<__half>(__half*,
+                                           const __half*,
+                                           const int*,
+                                           int,
+                                           int,
+                                           cudaStream_t);
@@ -20,7 +20,10 @@ __global__ void apply_rotary_pos_emb(float* mixed_query,
                                      unsigned num_heads,
                                      unsigned head_size,
                                      unsigned total_count,
-                                     int max_out_tokens)
+                                     int max_out_tokens,
+                                     const int* seq_offsets,
+                                     unsigned num_kv_heads,
+                                     const int* cache_offsets)
 {
     cg::thread_block b = cg::this_thread_block();
     cg::thread_block_tile<WARP_SIZE> g = cg::tiled_partition<WARP_SIZE>(b);
@@ -32,16 +35,23 @@ __global__ void apply_rotary_pos_emb(float* mixed_query,
     unsigned head_id = blockIdx.x * MAX_WARP_NUM + gid;
     unsigned offset = head_id * head_size;
 
-    unsigned seq_id = (head_id / num_heads) % seq_len + seq_offset;
     unsigned seq_index = head_id % seq_len;
-    unsigned k_offset = (seq_index + (head_id / seq_len) * max_out_tokens) * head_size;
+    // A ragged batch gives every sequence its own start position.
+    unsigned seq_id = seq_offsets ? seq_index + seq_offsets[head_id / (seq_len * num_heads)]
+                                  : (head_id / num_heads) % seq_len + seq_offset;
+    // With grouped KV heads only the first num_kv_heads query heads have a key to rotate.
+    unsigned row = head_id / seq_len;
+    bool has_key = row % num_heads < num_kv_heads;
+    unsigned k_row = (row / num_heads) * num_kv_heads + row % num_heads;
+    unsigned k_offset = (seq_index + k_row * max_out_tokens) * head_size;
+    if (cache_offsets) k_offset += cache_offsets[row / num_heads] * head_size;
 
     if (head_id < total_count) {
         while (lane < rotary_dim) {
             float inv_freq = (float)((lane / 2) * 2) / (float)rotary_dim;
             inv_freq = 1.0 / powf(10000.0, inv_freq) * (float)seq_id;
             float q = mixed_query[offset + lane];
-            float k = key_layer[k_offset + lane];
+            float k = has_key ? key_layer[k_offset + lane] : 0.f;
             float rotary_sign = (lane % 2 == 1 ? -1.0 : 1.0);
             float q_rot = (q * rotary_sign);
             float k_rot = (k * rotary_sign);
@@ -51,7 +61,7 @@ __global__ void apply_rotary_pos_emb(float* mixed_query,
             k = k * cosf(inv_freq) + k_rot * sinf(inv_freq);
 
             mixed_query[offset + lane] = q;
-            key_layer[k_offset + lane] = k;
+            if (has_key) key_layer[k_offset + lane] = k;
 
             lane += WARP_SIZE;
         }
@@ -66,7 +76,10 @@ __global__ void apply_rotary_pos_emb(__half* mixed_query,
                                      unsigned num_heads,
                                      unsigned head_size,
                                      unsigned total_count,
-                                     int max_out_tokens)
+                                     int max_out_tokens,
+                                     const int* seq_offsets,
+                                     unsigned num_kv_heads,
+                                     const int* cache_offsets)
 {
     cg::thread_block b = cg::this_thread_block();
     cg::thread_block_tile<WARP_SIZE> g = cg::tiled_partition<WARP_SIZE>(b);
@@ -78,16 +91,23 @@ __global__ void apply_rotary_pos_emb(__half* mixed_query,
     unsigned head_id = blockIdx.x * MAX_WARP_NUM + gid;
     unsigned offset = head_id * head_size;
 
-    unsigned seq_id = (head_id / num_heads) % seq_len + seq_offset;
     unsigned seq_index = head_id % seq_len;
-    unsigned k_offset = (seq_index + (head_id / seq_len) * max_out_tokens) * head_size;
+    // A ragged batch gives every sequence its own start position.
+    unsigned seq_id = seq_offsets ? seq_index + seq_offsets[head_id / (seq_len * num_heads)]
+                                  : (head_id / num_heads) % seq_len + seq_offset;
+    // With grouped KV heads only the first num_kv_heads query heads have a key to rotate.
+    unsigned row = head_id / seq_len;
+    bool has_key = row % num_heads < num_kv_heads;
+    unsigned k_row = (row / num_heads) * num_kv_heads + row % num_heads;
+    unsigned k_offset = (seq_index + k_row * max_out_tokens) * head_size;
+    if (cache_offsets) k_offset += cache_offsets[row / num_heads] * head_size;
 
     if (head_id < total_count) {
         while (lane < rotary_dim) {
             float inv_freq = (float)((lane / 2) * 2) / (float)rotary_dim;
             inv_freq = 1.0 / powf(10000.0, inv_freq) * (float)seq_id;
             float q = (float)mixed_query[offset + lane];
-            float k = (float)key_layer[k_offset + lane];
+            float k = has_key ? (float)key_layer[k_offset + lane] : 0.f;
             float rotary_sign = (lane % 2 == 1 ? -1.0 : 1.0);
             float q_rot = (q * rotary_sign);
             float k_rot = (k * rotary_sign);
@@ -97,7 +117,7 @@ __global__ void apply_rotary_pos_emb(__half* mixed_query,
             k = k * cosf(inv_freq) + k_rot * sinf(inv_freq);
 
             mixed_query[offset + lane] = (__half)q;
-            key_layer[k_offset + lane] = (__half)k;
+            if (has_key) key_layer[k_offset + lane] = (__half)k;
 
             lane += WARP_SIZE;
         }
@@ -111,7 +131,10 @@ __global__ void apply_rotary_pos_emb1(float* mixed_query,
                                       unsigned num_heads,
                                       unsigned head_size,
                                       unsigned total_count,
-                                      int max_out_tokens)
+                                      int max_out_tokens,
+                                      const int* seq_offsets,
+                                      unsigned num_kv_heads,
+                                      const int* cache_offsets)
 {
     cg::thread_block b = cg::this_thread_block();
     cg::thread_block_tile<WARP_SIZE> g = cg::tiled_partition<WARP_SIZE>(b);
@@ -123,16 +146,23 @@ __global__ void apply_rotary_pos_emb1(float* mixed_query,
     unsigned head_id = blockIdx.x * MAX_WARP_NUM + gid;
     unsigned offset = head_id * head_size;
 
-    unsigned seq_id = (head_id / num_heads) % seq_len + seq_offset;
     unsigned seq_index = head_id % seq_len;
-    unsigned k_offset = (seq_index + (head_id / seq_len) * max_out_tokens) * head_size;
+    // A ragged batch gives every sequence its own start position.
+    unsigned seq_id = seq_offsets ? seq_index + seq_offsets[head_id / (seq_len * num_heads)]
+                                  : (head_id / num_heads) % seq_len + seq_offset;
+    // With grouped KV heads only the first num_kv_heads query heads have a key to rotate.
+    unsigned row = head_id / seq_len;
+    bool has_key = row % num_heads < num_kv_heads;
+    unsigned k_row = (row / num_heads) * num_kv_heads + row % num_heads;
+    unsigned k_offset = (seq_index + k_row * max_out_tokens) * head_size;
+    if (cache_offsets) k_offset += cache_offsets[row / num_heads] * head_size;
 
     if (head_id < total_count) {
         while (lane < rotary_dim) {
             float inv_freq = (float)((lane / 2) * 2) / (float)rotary_dim;
             inv_freq = 1.0 / powf(10000.0, inv_freq) * (float)seq_id;
             float q = mixed_query[offset + lane];
-            float k = key_layer[k_offset + lane];
+            float k = has_key ? key_layer[k_offset + lane] : 0.f;
             float rotary_sign = (lane % 2 == 1 ? -1.0 : 1.0);
             float q_rot = (q * rotary_sign);
             float k_rot = (k * rotary_sign);
@@ -142,7 +172,7 @@ __global__ void apply_rotary_pos_emb1(float* mixed_query,
             k = k * cosf(inv_freq) + k_rot * sinf(inv_freq);
 
             mixed_query[offset + lane] = q;
-            key_layer[k_offset + lane] = k;
+            if (has_key) key_layer[k_offset + lane] = k;
 
             lane += WARP_SIZE;
         }
@@ -156,7 +186,10 @@ __global__ void apply_rotary_pos_emb1(__half* mixed_query,
                                       unsigned num_heads,
                                       unsigned head_size,
                                       unsigned total_count,
-                                      int max_out_tokens)
+                                      int max_out_tokens,
+                                      const int* seq_offsets,
+                                      unsigned num_kv_heads,
+                                      const int* cache_offsets)
 {
     cg::thread_block b = cg::this_thread_block();
     cg::thread_block_tile<WARP_SIZE> g = cg::tiled_partition<WARP_SIZE>(b);
@@ -168,7 +201,12 @@ __global__ void apply_rotary_pos_emb1(__half* mixed_query,
     unsigned head_id = blockIdx.x * MAX_WARP_NUM + gid;
     unsigned seq_index = head_id % seq_len;
     unsigned offset = head_id * head_size;
-    unsigned k_offset = (seq_index + (head_id / seq_len) * max_out_tokens) * head_size;
+    // With grouped KV heads only the first num_kv_heads query heads have a key to rotate.
+    unsigned row = head_id / seq_len;
+    bool has_key = row % num_heads < num_kv_heads;
+    unsigned k_row = (row / num_heads) * num_kv_heads + row % num_heads;
+    unsigned k_offset = (seq_index + k_row * max_out_tokens) * head_size;
+    if (cache_offsets) k_offset += cache_offsets[row / num_heads] * head_size;
 
     constexpr unsigned mask[32] = {
         0x1 | 0x1000,     0x2 | 0x2000,     0x4 | 0x4000,     0x8 | 0x8000,     0x10 | 0x10000,
@@ -179,14 +217,15 @@ __global__ void apply_rotary_pos_emb1(__half* mixed_query,
         0x2000000,        0x4000000,        0x8000000,        0x10000000,       0x20000000,
         0x40000000,       0x80000000};
 
-    unsigned seq_id = (head_id % seq_len) + seq_offset;
+    unsigned seq_id = (head_id % seq_len) +
+                      (seq_offsets ? seq_offsets[head_id / (seq_len * num_heads)] : seq_offset);
     unsigned half_dim = rotary_dim >> 1;
     if (head_id < total_count) {
         while (lane < rotary_dim) {
             float inv_freq = (float)((lane % half_dim) * 2) / (float)rotary_dim;
             inv_freq = 1.0 / powf(10000.0, inv_freq) * (float)seq_id;
             float q = (float)mixed_query[offset + lane];
-            float k = (float)key_layer[k_offset + lane];
+            float k = has_key ? (float)key_layer[k_offset + lane] : 0.f;
             float rotary_sign = (lane > (half_dim - 1) ? -1.0 : 1.0);
             float q_rot = (q * rotary_sign);
             float k_rot = (k * rotary_sign);
@@ -198,7 +237,7 @@ __global__ void apply_rotary_pos_emb1(__half* mixed_query,
             k = k * cosf(inv_freq) + k_rot_tmp * sinf(inv_freq);
 
             mixed_query[offset + lane] = (__half)q;
-            key_layer[k_offset + lane] = (__half)k;
+            if (has_key) key_layer[k_offset + lane] = (__half)k;
 
             lane += WARP_SIZE;
         }
@@ -217,8 +256,12 @@ void launch_apply_rotary_pos_emb(T* mixed_query,
                                  bool rotate_half,
                                  bool rotate_every_two,
                                  cudaStream_t stream,
-                                 int max_out_tokens)
+                                 int max_out_tokens,
+                                 const int* seq_offsets,
+                                 int num_kv_heads,
+                                 const int* cache_offsets)
 {
+    if (!num_kv_heads) num_kv_heads = num_heads;
     int total_count = batch * num_heads * seq_len;
     dim3 block_dims(1024);
     dim3 grid_dims((total_count - 1) / MAX_WARP_NUM + 1);  // (batch_size);
@@ -231,7 +274,10 @@ void launch_apply_rotary_pos_emb(T* mixed_query,
                                                                    num_heads,
                                                                    head_size,
                                                                    total_count,
-                                                                   max_out_tokens);
+                                                                   max_out_tokens,
+                                                                   seq_offsets,
+                                                                   num_kv_heads,
+                                                                   cache_offsets);
     else if (rotate_half)
         apply_rotary_pos_emb1<<<grid_dims, block_dims, 0, stream>>>(mixed_query,
                                                                     key_layer,
@@ -241,7 +287,10 @@ void launch_apply_rotary_pos_emb(T* mixed_query,
                                                                     num_heads,
                                                                     head_size,
                                                                     total_count,
-                                                                    max_out_tokens);
+                                                                    max_out_tokens,
+                                                                    seq_offsets,
+                                                                    num_kv_heads,
+                                                                    cache_offsets);
 }
 
 template void launch_apply_rotary_pos_emb<float>(float*,
@@ -255,7 +304,10 @@ template void launch_apply_rotary_pos_emb<float>(float*,
                                                  bool,
                                                  bool,
                                                  cudaStream_t,
-                                                 int);
+                                                 int,
+                                                 const int*,
+                                                 int,
+                                                 const int*);
 template void launch_apply_rotary_pos_emb<__half>(__half*,
                                                   __half*,
                                                   unsigned,
@@ -267,7 +319,10 @@ template void launch_apply_rotary_pos_emb<__half>(__half*,
                                                   bool,
                                                   bool,
                                                   cudaStream_t,
-                                                  int);
+                                                  int,
+                                                  const int*,
+                                                  int,
+                                                  const int*);
 
 /*
 __global__ void apply_rotary_pos_emb(float* mixed_query,
@@ -0,0 +1,504 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "conversion_utils.h"
+#include "inference_cuda_layers.h"
+#include "kv_cache_layout.h"
+
+#include <algorithm>
+
+namespace cg = cooperative_groups;
+
+namespace decode {
+
+constexpr int warps = 4;
+constexpr int threads = warps * WARP_SIZE;
+// Every lane keeps its share of the dims of the query and of the output in registers.
+constexpr int max_lane_dims = DECODE_ATTN_MAX_HEAD_SIZE / WARP_SIZE;
+// Fewest positions worth a split of their own, below that the merge costs more than it saves.
+constexpr int min_split_tokens = 128;
+
+int multiprocessor_count()
+{
+    static int count = 0;
+    if (!count) {
+        int device;
+        cudaGetDevice(&device);
+        cudaDeviceGetAttribute(&count, cudaDevAttrMultiProcessorCount, device);
+    }
+    return count;
+}
+
+// Splits the positions in enough pieces to give every SM a couple of blocks, as long as the
+// pieces stay long and the partial results fit in their workspace.
+int num_splits(int blocks, int seq_len, int max_visible, bool has_partials)
+{
+    if (!has_partials) return 1;
+    int splits = (2 * multiprocessor_count() + blocks - 1) / blocks;
+    splits = std::min(splits, (max_visible + min_split_tokens - 1) / min_split_tokens);
+    splits = std::min(splits, DECODE_ATTN_MAX_SPLITS / seq_len);
+    return std::max(splits, 1);
+}
+
+}  // namespace decode
+
+/*
+Attention of the new tokens over the KV cache, split over the cached positions (flash-decoding).
+Block (head, sequence, token * num_splits + split) takes a contiguous share of the positions the
+query token sees, its warps walk them keeping a running max, sum and output (online softmax) and
+merge into one partial result. With a single split that result is the output, otherwise the
+partials go to the workspace and decode_attention_merge rescales and adds them up.
+
+Query token t of sequence b sits at position start + t and attends causally to the positions up
+to it, the padding tokens past the sequence count get a zero output. The scores follow
+attn_softmax_v2: the scaled dot product times layer_scale, plus the alibi and the mask, positions
+out of the local window dropped. Mask and alibi rows are score_stride long.
+KV is one of the views of kv_cache_layout.h, the int8 cache is dequantized as it is read. Groups of
+kv_group query heads share one head of the cache.
+*/
+template <typename T, typename KV>
+__global__ void decode_attention(T* output,
+                                 const T* query,
+                                 KV cache,
+                                 kv_layout::Positions positions,
+                                 const T* mask,
+                                 int mask_stride,
+                                 const T* alibi,
+                                 int score_stride,
+                                 float layer_scale,
+                                 float alpha,
+                                 bool local_attention,
+                                 int window_size,
+                                 int head_size,
+                                 int kv_group,
+                                 int num_splits,
+                                 float* partials)
+{
+    cg::thread_block tb = cg::this_thread_block();
+
+    const int head = blockIdx.x;
+    const int seq = blockIdx.y;
+    const int token = blockIdx.z / num_splits;
+    const int split = blockIdx.z % num_splits;
+    const int heads = gridDim.x;
+    const int seq_len = gridDim.z / num_splits;
+    const int warp_id = threadIdx.x / WARP_SIZE;
+    const int lane = threadIdx.x % WARP_SIZE;
+    const int row = seq * heads + head;
+    const int kv_head = head / kv_group;
+    const int q_row = row * seq_len + token;
+
+    if (token >= positions.count_of(seq)) {
+        // With several splits the merge writes the zeros.
+        if (num_splits == 1)
+            for (int dim = threadIdx.x; dim < head_size; dim += decode::threads)
+                output[q_row * head_size + dim] = conversion::to<T>(0.f);
+        return;
+    }
+
+    __shared__ float warp_max[decode::warps];
+    __shared__ float warp_sum[decode::warps];
+    __shared__ float warp_out[decode::warps][DECODE_ATTN_MAX_HEAD_SIZE];
+
+    float q[decode::max_lane_dims];
+    float acc[decode::max_lane_dims];
+#pragma unroll
+    for (int i = 0; i < decode::max_lane_dims; i++) {
+        const int dim = lane + i * WARP_SIZE;
+        q[i] = dim < head_size ? conversion::to<float>(query[q_row * head_size + dim]) : 0.f;
+        acc[i] = 0.f;
+    }
+
+    const int visible = positions.start_of(seq) + token + 1;
+    const int window_start =
+        (local_attention && visible >= window_size) ? visible - window_size : -1;
+    const int split_len = (visible + num_splits - 1) / num_splits;
+    const int begin = max(split * split_len, window_start + 1);
+    const int end = min(visible, (split + 1) * split_len);
+
+    const int mask_offset = (seq * mask_stride + (q_row % mask_stride)) * score_stride;
+    const int alibi_offset = row * score_stride;
+
+    float max_val = -INFINITY;
+    float sum = 0.f;
+    for (int pos = begin + warp_id; pos < end; pos += decode::warps) {
+        const auto key = cache.key(seq, kv_head, pos);
+        float dot = 0.f;
+#pragma unroll
+        for (int i = 0; i < decode::max_lane_dims; i++) {
+            const int dim = lane + i * WARP_SIZE;
+            if (dim < head_size) dot += q[i] * conversion::to<float>(key[dim]);
+        }
+#pragma unroll
+        for (int j = WARP_SIZE / 2; j > 0; j >>= 1) dot += __shfl_xor_sync(0xffffffff, dot, j);
+
+        float score = dot * alpha * layer_scale;
+        if (alibi) score += conversion::to<float>(alibi[alibi_offset + pos]);
+        if (mask) score += conversion::to<float>(mask[mask_offset + pos]);
+
+        const float new_max = fmaxf(max_val, score);
+        const float correction = __expf(max_val - new_max);
+        const float p = __expf(score - new_max);
+        sum = sum * correction + p;
+        const auto value = cache.value(seq, kv_head, pos);
+#pragma unroll
+        for (int i = 0; i < decode::max_lane_dims; i++) {
+            const int dim = lane + i * WARP_SIZE;
+            const float v = dim < head_size ? conversion::to<float>(value[dim]) : 0.f;
+            acc[i] = acc[i] * correction + p * v;
+        }
+        max_val = new_max;
+    }
+
+    if (lane == 0) {
+        warp_max[warp_id] = max_val;
+        warp_sum[warp_id] = sum;
+    }
+#pragma unroll
+    for (int i = 0; i < decode::max_lane_dims; i++) {
+        const int dim = lane + i * WARP_SIZE;
+        if (dim < head_size) warp_out[warp_id][dim] = acc[i];
+    }
+    tb.sync();
+
+    float block_max = -INFINITY;
+#pragma unroll
+    for (int w = 0; w < decode::warps; w++) block_max = fmaxf(block_max, warp_max[w]);
+    float scale[decode::warps];
+    float block_sum = 0.f;
+#pragma unroll
+    for (int w = 0; w < decode::warps; w++) {
+        scale[w] = warp_sum[w] > 0.f ? __expf(warp_max[w] - block_max) : 0.f;
+        block_sum += warp_sum[w] * scale[w];
+    }
+
+    if (num_splits == 1) {
+        const float inv_sum = block_sum > 0.f ? 1.f / block_sum : 0.f;
+        for (int dim = threadIdx.x; dim < head_size; dim += decode::threads) {
+            float out = 0.f;
+#pragma unroll
+            for (int w = 0; w < decode::warps; w++) out += warp_out[w][dim] * scale[w];
+            output[q_row * head_size + dim] = conversion::to<T>(out * inv_sum);
+        }
+        return;
+    }
+
+    // Partial outputs first, then a (max, sum) pair per partial.
+    const int partial = q_row * num_splits + split;
+    const size_t total_partials = (size_t)gridDim.x * gridDim.y * gridDim.z;
+    for (int dim = threadIdx.x; dim < head_size; dim += decode::threads) {
+        float out = 0.f;
+#pragma unroll
+        for (int w = 0; w < decode::warps; w++) out += warp_out[w][dim] * scale[w];
+        partials[(size_t)partial * head_size + dim] = out;
+    }
+    if (threadIdx.x == 0) {
+        partials[total_partials * head_size + 2 * partial] = block_max;
+        partials[total_partials * head_size + 2 * partial + 1] = block_sum;
+    }
+}
+
+template <typename T>
+__global__ void decode_attention_merge(T* output,
+                                       const float* partials,
+                                       kv_layout::Positions positions,
+                                       int head_size,
+                                       int num_splits)
+{
+    const int head = blockIdx.x;
+    const int seq = blockIdx.y;
+    const int token = blockIdx.z;
+    const int q_row = (seq * gridDim.x + head) * gridDim.z + token;
+
+    if (token >= positions.count_of(seq)) {
+        for (int dim = threadIdx.x; dim < head_size; dim += decode::threads)
+            output[q_row * head_size + dim] = conversion::to<T>(0.f);
+        return;
+    }
+
+    const size_t total_partials = (size_t)gridDim.x * gridDim.y * gridDim.z * num_splits;
+    const float* stats = partials + total_partials * head_size + 2 * q_row * num_splits;
+    const float* outs = partials + (size_t)q_row * num_splits * head_size;
+
+    float max_val = -INFINITY;
+    for (int s = 0; s < num_splits; s++)
+        if (stats[2 * s + 1] > 0.f) max_val = fmaxf(max_val, stats[2 * s]);
+    float sum = 0.f;
+    for (int s = 0; s < num_splits; s++)
+        if (stats[2 * s + 1] > 0.f) sum += stats[2 * s + 1] * __expf(stats[2 * s] - max_val);
+    const float inv_sum = sum > 0.f ? 1.f / sum : 0.f;
+
+    for (int dim = threadIdx.x; dim < head_size; dim += decode::threads) {
+        float out = 0.f;
+        for (int s = 0; s < num_splits; s++)
+            if (stats[2 * s + 1] > 0.f)
+                out += outs[s * head_size + dim] * __expf(stats[2 * s] - max_val);
+        output[q_row * head_size + dim] = conversion::to<T>(out * inv_sum);
+    }
+}
+
+template <typename T, typename KV>
+void launch_split_attention(T* output,
+                            const T* query,
+                            KV cache,
+                            kv_layout::Positions positions,
+                            const T* mask,
+                            int mask_stride,
+                            const T* alibi,
+                            int score_stride,
+                            float layer_scale,
+                            float alpha,
+                            bool local_attention,
+                            int window_size,
+                            int batch_size,
+                            int heads,
+                            int kv_heads,
+                            int seq_len,
+                            int max_visible,
+                            int head_size,
+                            float* partials,
+                            cudaStream_t stream)
+{
+    assert(head_size <= DECODE_ATTN_MAX_HEAD_SIZE);
+    const int splits =
+        decode::num_splits(batch_size * heads * seq_len, seq_len, max_visible, partials);
+    dim3 block_dim(decode::threads);
+    dim3 grid_dim(heads, batch_size, seq_len * splits);
+    decode_attention<<<grid_dim, block_dim, 0, stream>>>(output,
+                                                         query,
+                                                         cache,
+                                                         positions,
+                                                         mask,
+                                                         mask_stride,
+                                                         alibi,
+                                                         score_stride,
+                                                         layer_scale,
+                                                         alpha,
+                                                         local_attention,
+                                                         window_size,
+                                                         head_size,
+                                                         heads / kv_heads,
+                                                         splits,
+                                                         partials);
+    if (splits > 1) {
+        dim3 merge_grid_dim(heads, batch_size, seq_len);
+        decode_attention_merge<<<merge_grid_dim, block_dim, 0, stream>>>(
+            output, partials, positions, head_size, splits);
+    }
+}
+
+// One new token per sequence, at position positions[b] when given (see
+// InferenceContext::SetDevicePositions), at soft_len - 1 otherwise. soft_len bounds the visible
+// positions either way.
+template <typename T>
+void launch_decode_attention(T* output,
+                             const T* query,
+                             const T* key,
+                             const T* value,
+                             int kv_stride,
+                             const T* mask,
+                             int mask_stride,
+                             const T* alibi,
+                             int score_stride,
+                             float layer_scale,
+                             float alpha,
+                             bool local_attention,
+                             int window_size,
+                             int batch_size,
+                             int heads,
+                             int kv_heads,
+                             const int* positions,
+                             int soft_len,
+                             int head_size,
+                             float* partials,
+                             cudaStream_t stream)
+{
+    const kv_layout::Contiguous<const T> cache{key, value, kv_stride, kv_heads, head_size};
+    const kv_layout::Positions token_positions{positions, nullptr, soft_len - 1, 1};
+    launch_split_attention(output,
+                           query,
+                           cache,
+                           token_positions,
+                           mask,
+                           mask_stride,
+                           alibi,
+                           score_stride,
+                           layer_scale,
+                           alpha,
+                           local_attention,
+                           window_size,
+                           batch_size,
+                           heads,
+                           kv_heads,
+                           1,
+                           soft_len,
+                           head_size,
+                           partials,
+                           stream);
+}
+
+template <typename T>
+void launch_paged_attention(T* output,
+                            const T* query,
+                            const void* pool,
+                            const float* kv_scales,
+                            const int* block_table,
+                            int table_width,
+                            const int* start_positions,
+                            const int* new_tokens,
+                            const T* mask,
+                            int mask_stride,
+                            const T* alibi,
+                            int score_stride,
+                            float layer_scale,
+                            float alpha,
+                            bool local_attention,
+                            int window_size,
+                            int layer,
+                            int num_layers,
+                            int heads,
+                            int kv_heads,
+                            int head_size,
+                            int block_tokens,
+                            int batch_size,
+                            int seq_len,
+                            int max_visible,
+                            float* partials,
+                            cudaStream_t stream)
+{
+    const kv_layout::Positions positions{start_positions, new_tokens, 0, 0};
+    if (kv_scales) {
+        const kv_layout::QuantizedPaged<const int8_t> cache{{(const int8_t*)pool,
+                                                             block_table,
+                                                             table_width,
+                                                             layer,
+                                                             num_layers,
+                                                             kv_heads,
+                                                             head_size,
+                                                             block_tokens},
+                                                            kv_scales};
+        launch_split_attention(output,
+                               query,
+                               cache,
+                               positions,
+                               mask,
+                               mask_stride,
+                               alibi,
+                               score_stride,
+                               layer_scale,
+                               alpha,
+                               local_attention,
+                               window_size,
+                               batch_size,
+                               heads,
+                               kv_heads,
+                               seq_len,
+                               max_visible,
+                               head_size,
+                               partials,
+                               stream);
+    } else {
+        const kv_layout::Paged<const T> cache{(const T*)pool,
+                                              block_table,
+                                              table_width,
+                                              layer,
+                                              num_layers,
+                                              kv_heads,
+                                              head_size,
+                                              block_tokens};
+        launch_split_attention(output,
+                               query,
+                               cache,
+                               positions,
+                               mask,
+                               mask_stride,
+                               alibi,
+                               score_stride,
+                               layer_scale,
+                               alpha,
+                               local_attention,
+                               window_size,
+                               batch_size,
+                               heads,
+                               kv_heads,
+                               seq_len,
+                               max_visible,
+                               head_size,
+                               partials,
+                               stream);
+    }
+}
+
+#define INSTANTIATE_DECODE_ATTENTION(T)                             \
+    template void launch_decode_attention<T>(T*,                    \
+                                             const T*,              \
+                                             const T*,              \
+                                             const T*,              \
+                                             int,                   \
+                                             const T*,              \
+                                             int,                   \
+                                             const T*,              \
+                                             int,                   \
+                                             float,                 \
+                                             float,                 \
+                                             bool,                  \
+                                             int,                   \
+                                             int,                   \
+                                             int,                   \
+                                             int,                   \
+                                             const int*,            \
+                                             int,                   \
+                                             int,                   \
+                                             float*,                \
+                                             cudaStream_t);         \
+    template void launch_paged_attention<T>(T*,                     \
+                                            const T*,               \
+                                            const void*,            \
+                                            const float*,           \
+                                            const int*,             \
+                                            int,                    \
+                                            const int*,             \
+                                            const int*,             \
+                                            const T*,               \
+                                            int,                    \
+                                            const T*,               \
+                                            int,                    \
+                                            float,                  \
+                                            float,                  \
+                                            bool,                   \
+                                            int,                    \
+                                            int,                    \
+                                            int,                    \
+                                            int,                    \
+                                            int,                    \
+                                            int,                    \
+                                            int,                    \
+                                            int,                    \
+                                            int,                    \
+                                            int,                    \
+                                            float*,                 \
+                                            cudaStream_t);
+
+INSTANTIATE_DECODE_ATTENTION(float)
+INSTANTIATE_DECODE_ATTENTION(__half)
+
+__global__ void update_positions(int* positions, int value, bool relative, int batch_size)
+{
+    const int idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx < batch_size) positions[idx] = relative ? positions[idx] + value : value;
+}
+
+// Moves the device side positions on without a host write, so a captured graph can replay it.
+void launch_update_positions(int* positions,
+                             int value,
+                             bool relative,
+                             int batch_size,
+                             cudaStream_t stream)
+{
+    const int threads = 256;
+    dim3 block_dim(threads);
+    dim3 grid_dim((batch_size + threads - 1) / threads);
+    update_positions<<<grid_dim, block_dim, 0, stream>>>(positions, value, relative, batch_size);
+}
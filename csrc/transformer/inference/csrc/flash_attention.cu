@@ -0,0 +1,250 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "conversion_utils.h"
+#include "inference_cuda_layers.h"
+
+namespace cg = cooperative_groups;
+
+namespace flash {
+
+constexpr int warps = 4;
+constexpr int threads = warps * WARP_SIZE;
+constexpr int rows_per_warp = 4;
+constexpr int q_tile = warps * rows_per_warp;
+// One key per lane.
+constexpr int kv_tile = WARP_SIZE;
+constexpr int max_lane_dims = FLASH_ATTN_MAX_HEAD_SIZE / WARP_SIZE;
+
+}  // namespace flash
+
+/*
+Fused attention of the prompt tokens: the scores never leave the SM. A block takes q_tile query
+rows of one (batch, head) and streams the keys and values through shared memory kv_tile tokens at
+a time, every warp keeping a running max, sum and output for its rows (online softmax).
+
+The scores follow attn_softmax_v2 in its prompt configuration: the scaled dot product times
+layer_scale, plus the alibi and the mask, query s seeing the keys up to s + (soft_len - seq_len)
+when triangular, and only the last window_size of them with local attention. K and V have
+kv_heads heads, shared by groups of query heads.
+*/
+template <typename T>
+__global__ void flash_attention(T* output,
+                                const T* query,
+                                const T* key,
+                                const T* value,
+                                int kv_stride,
+                                const T* mask,
+                                int mask_stride,
+                                const T* alibi,
+                                float layer_scale,
+                                float alpha,
+                                bool triangular,
+                                bool local_attention,
+                                int window_size,
+                                int heads,
+                                int kv_heads,
+                                int seq_len,
+                                int soft_len,
+                                int head_size)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<WARP_SIZE> warp = cg::tiled_partition<WARP_SIZE>(tb);
+
+    const int q_start = blockIdx.x * flash::q_tile;
+    const int head = blockIdx.y;
+    const int batch = blockIdx.z;
+    const int row = batch * heads + head;
+    // Every group of heads / kv_heads query heads shares one K/V head.
+    const int kv_row = batch * kv_heads + head / (heads / kv_heads);
+    const int warp_id = threadIdx.x / WARP_SIZE;
+    const int lane = threadIdx.x % WARP_SIZE;
+    const int q_offset = soft_len - seq_len;
+
+    // The key rows are padded by one so the lanes, each on its own key, hit different banks.
+    __shared__ float q_s[flash::q_tile][FLASH_ATTN_MAX_HEAD_SIZE];
+    __shared__ float k_s[flash::kv_tile][FLASH_ATTN_MAX_HEAD_SIZE + 1];
+    __shared__ float v_s[flash::kv_tile][FLASH_ATTN_MAX_HEAD_SIZE];
+
+    query += (size_t)row * seq_len * head_size;
+    key += (size_t)kv_row * kv_stride * head_size;
+    value += (size_t)kv_row * kv_stride * head_size;
+    output += (size_t)row * seq_len * head_size;
+
+    for (int idx = threadIdx.x; idx < flash::q_tile * head_size; idx += flash::threads) {
+        const int r = idx / head_size;
+        const int d = idx % head_size;
+        q_s[r][d] = (q_start + r < seq_len)
+                        ? conversion::to<float>(query[(size_t)(q_start + r) * head_size + d])
+                        : 0.f;
+    }
+
+    // Key range of the whole tile, the per row limits are applied on the scores.
+    const int last_query = min(q_start + flash::q_tile, seq_len) - 1 + q_offset;
+    const int kv_end = triangular ? min(soft_len, last_query + 1) : soft_len;
+    int kv_begin = 0;
+    if (local_attention && q_start + q_offset >= window_size)
+        kv_begin = ((q_start + q_offset - window_size + 1) / flash::kv_tile) * flash::kv_tile;
+
+    float max_val[flash::rows_per_warp];
+    float sum[flash::rows_per_warp];
+    float acc[flash::rows_per_warp][flash::max_lane_dims];
+#pragma unroll
+    for (int r = 0; r < flash::rows_per_warp; r++) {
+        max_val[r] = -INFINITY;
+        sum[r] = 0.f;
+#pragma unroll
+        for (int i = 0; i < flash::max_lane_dims; i++) acc[r][i] = 0.f;
+    }
+
+    for (int kv_start = kv_begin; kv_start < kv_end; kv_start += flash::kv_tile) {
+        tb.sync();
+        for (int idx = threadIdx.x; idx < flash::kv_tile * head_size; idx += flash::threads) {
+            const int j = idx / head_size;
+            const int d = idx % head_size;
+            const bool in_range = kv_start + j < soft_len;
+            const size_t offset = (size_t)(kv_start + j) * head_size + d;
+            k_s[j][d] = in_range ? conversion::to<float>(key[offset]) : 0.f;
+            v_s[j][d] = in_range ? conversion::to<float>(value[offset]) : 0.f;
+        }
+        tb.sync();
+
+        const int pos = kv_start + lane;
+#pragma unroll
+        for (int r = 0; r < flash::rows_per_warp; r++) {
+            const int q_row = warp_id * flash::rows_per_warp + r;
+            const int seq_id = q_start + q_row;
+            if (seq_id >= seq_len) continue;
+
+            const int real_seq_id = seq_id + q_offset;
+            const int window_stride =
+                (local_attention && real_seq_id >= window_size) ? real_seq_id - window_size : -1;
+            const bool valid = pos < soft_len && (!triangular || pos <= real_seq_id) &&
+                               pos > window_stride;
+
+            float score = -INFINITY;
+            if (valid) {
+                float dot = 0.f;
+                for (int d = 0; d < head_size; d++) dot += q_s[q_row][d] * k_s[lane][d];
+                score = dot * alpha * layer_scale;
+                if (alibi) score += conversion::to<float>(alibi[row * soft_len + pos]);
+                if (mask) {
+                    const int iter = row * seq_len + seq_id;
+                    const int mask_offset = batch * mask_stride + (iter % mask_stride);
+                    score += conversion::to<float>(mask[mask_offset * soft_len + pos]);
+                }
+            }
+
+            float tile_max = score;
+#pragma unroll
+            for (int j = WARP_SIZE / 2; j > 0; j >>= 1)
+                tile_max = fmaxf(tile_max, warp.shfl_xor(tile_max, j));
+            if (tile_max == -INFINITY) continue;
+
+            const float new_max = fmaxf(max_val[r], tile_max);
+            const float correction = __expf(max_val[r] - new_max);
+            const float p = valid ? __expf(score - new_max) : 0.f;
+            float p_sum = p;
+#pragma unroll
+            for (int j = WARP_SIZE / 2; j > 0; j >>= 1) p_sum += warp.shfl_xor(p_sum, j);
+            sum[r] = sum[r] * correction + p_sum;
+            max_val[r] = new_max;
+
+#pragma unroll
+            for (int i = 0; i < flash::max_lane_dims; i++) acc[r][i] *= correction;
+            for (int j = 0; j < flash::kv_tile; j++) {
+                const float p_j = warp.shfl(p, j);
+#pragma unroll
+                for (int i = 0; i < flash::max_lane_dims; i++) {
+                    const int d = lane + i * WARP_SIZE;
+                    if (d < head_size) acc[r][i] += p_j * v_s[j][d];
+                }
+            }
+        }
+    }
+
+#pragma unroll
+    for (int r = 0; r < flash::rows_per_warp; r++) {
+        const int seq_id = q_start + warp_id * flash::rows_per_warp + r;
+        if (seq_id >= seq_len) continue;
+        const float inv_sum = sum[r] > 0.f ? 1.f / sum[r] : 0.f;
+#pragma unroll
+        for (int i = 0; i < flash::max_lane_dims; i++) {
+            const int d = lane + i * WARP_SIZE;
+            if (d < head_size)
+                output[(size_t)seq_id * head_size + d] = conversion::to<T>(acc[r][i] * inv_sum);
+        }
+    }
+}
+
+template <typename T>
+void launch_flash_attention(T* output,
+                            const T* query,
+                            const T* key,
+                            const T* value,
+                            int kv_stride,
+                            const T* mask,
+                            int mask_stride,
+                            const T* alibi,
+                            float layer_scale,
+                            float alpha,
+                            bool triangular,
+                            bool local_attention,
+                            int window_size,
+                            int batch_size,
+                            int heads,
+                            int kv_heads,
+                            int seq_len,
+                            int soft_len,
+                            int head_size,
+                            cudaStream_t stream)
+{
+    assert(head_size <= FLASH_ATTN_MAX_HEAD_SIZE);
+    dim3 block_dim(flash::threads);
+    dim3 grid_dim((seq_len + flash::q_tile - 1) / flash::q_tile, heads, batch_size);
+    flash_attention<<<grid_dim, block_dim, 0, stream>>>(output,
+                                                        query,
+                                                        key,
+                                                        value,
+                                                        kv_stride,
+                                                        mask,
+                                                        mask_stride,
+                                                        alibi,
+                                                        layer_scale,
+                                                        alpha,
+                                                        triangular,
+                                                        local_attention,
+                                                        window_size,
+                                                        heads,
+                                                        kv_heads,
+                                                        seq_len,
+                                                        soft_len,
+                                                        head_size);
+}
+
+#define INSTANTIATE_FLASH_ATTENTION(T)                             \
+    template void launch_flash_attention<T>(T*,                    \
+                                            const T*,              \
+                                            const T*,              \
+                                            const T*,              \
+                                            int,                   \
+                                            const T*,              \
+                                            int,                   \
+                                            const T*,              \
+                                            float,                 \
+                                            float,                 \
+                                            bool,                  \
+                                            bool,                  \
+                                            int,                   \
+                                            int,                   \
+                                            int,                   \
+                                            int,                   \
+                                            int,                   \
+                                            int,                   \
+                                            int,                   \
+                                            cudaStream_t);
+
+INSTANTIATE_FLASH_ATTENTION(float)
+INSTANTIATE_FLASH_ATTENTION(__half)
@@ -0,0 +1,268 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "conversion_utils.h"
+#include "ds_kernel_utils.h"
+#include "inference_cuda_layers.h"
+#include "reduction_utils.h"
+
+#include <algorithm>
+
+#ifdef FP8_AVAILABLE
+
+namespace cg = cooperative_groups;
+using rop = reduce::ROpType;
+
+/*
+Producers of the fp8 activations of the fp8 GEMMs, with per tensor scaling: a value x is stored
+as fp8(x / scale), the GEMM multiplies the scale back in. scale is a device scalar, and each
+kernel folds the absolute max of what it converts into amax, so the scale can follow the
+activations without a host sync (see launch_fp8_update_scale).
+*/
+namespace fp8 {
+
+constexpr int threads = 256;
+
+DS_D_INLINE void update_amax(float* amax, float local_max)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+    reduce::block<rop::Max>(tb, warp, local_max);
+    // Non negative floats order as their bit patterns.
+    if (threadIdx.x == 0) atomicMax((int*)amax, __float_as_int(local_max));
+}
+
+DS_D_INLINE float gelu(const float x)
+{
+    const float sqrt_param = 0.79788456080286535587989211986876f;
+    const float mul_param = 0.044715;
+    return x * 0.5f * (1.0f + tanhf(sqrt_param * (x + mul_param * x * x * x)));
+}
+
+}  // namespace fp8
+
+template <typename T, typename FP8>
+__global__ void fp8_quantize(FP8* output,
+                             float* amax,
+                             const T* input,
+                             const float* scale,
+                             size_t count)
+{
+    const float inv_scale = 1.f / *scale;
+    float local_max = 0.f;
+    for (size_t idx = blockIdx.x * blockDim.x + threadIdx.x; idx < count;
+         idx += (size_t)gridDim.x * blockDim.x) {
+        const float val = conversion::to<float>(input[idx]);
+        local_max = fmaxf(local_max, fabsf(val));
+        output[idx] = conversion::to<FP8>(val * inv_scale);
+    }
+    fp8::update_amax(amax, local_max);
+}
+
+/*
+Layer norm of input (+ residual + bias when given), one block per row, written as fp8 and, when
+norm_output is set, also in T for the callers that keep the normalized input.
+*/
+template <typename T, typename FP8>
+__global__ void fused_ln_fp8(FP8* output,
+                             T* norm_output,
+                             float* amax,
+                             const T* input,
+                             const T* residual,
+                             const T* bias,
+                             const T* gamma,
+                             const T* beta,
+                             float epsilon,
+                             const float* scale,
+                             int elems_per_row)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+
+    const size_t row_offset = (size_t)blockIdx.x * elems_per_row;
+    auto load = [&](int i) {
+        float val = conversion::to<float>(input[row_offset + i]);
+        if (residual) val += conversion::to<float>(residual[row_offset + i]);
+        if (bias) val += conversion::to<float>(bias[i]);
+        return val;
+    };
+
+    float sum = 0.f;
+    for (int i = threadIdx.x; i < elems_per_row; i += blockDim.x) sum += load(i);
+    reduce::block<rop::Add>(tb, warp, sum);
+    const float mean = sum / elems_per_row;
+
+    float mean_diff = 0.f;
+    for (int i = threadIdx.x; i < elems_per_row; i += blockDim.x) {
+        const float diff = load(i) - mean;
+        mean_diff += diff * diff;
+    }
+    reduce::block<rop::Add>(tb, warp, mean_diff);
+    const float denom = __frsqrt_rn(mean_diff / elems_per_row + epsilon);
+
+    const float inv_scale = 1.f / *scale;
+    float local_max = 0.f;
+    for (int i = threadIdx.x; i < elems_per_row; i += blockDim.x) {
+        const float val = (load(i) - mean) * denom * conversion::to<float>(gamma[i]) +
+                          conversion::to<float>(beta[i]);
+        local_max = fmaxf(local_max, fabsf(val));
+        output[row_offset + i] = conversion::to<FP8>(val * inv_scale);
+        if (norm_output) norm_output[row_offset + i] = conversion::to<T>(val);
+    }
+    fp8::update_amax(amax, local_max);
+}
+
+// act(input + bias) as fp8, gelu or relu, for the second GEMM of the MLP.
+template <typename T, typename FP8>
+__global__ void bias_act_fp8(FP8* output,
+                             float* amax,
+                             const T* input,
+                             const T* bias,
+                             const float* scale,
+                             bool relu,
+                             int intermediate_size,
+                             size_t count)
+{
+    const float inv_scale = 1.f / *scale;
+    float local_max = 0.f;
+    for (size_t idx = blockIdx.x * blockDim.x + threadIdx.x; idx < count;
+         idx += (size_t)gridDim.x * blockDim.x) {
+        float val = conversion::to<float>(input[idx]) +
+                    conversion::to<float>(bias[idx % intermediate_size]);
+        val = relu ? fmaxf(val, 0.f) : fp8::gelu(val);
+        local_max = fmaxf(local_max, fabsf(val));
+        output[idx] = conversion::to<FP8>(val * inv_scale);
+    }
+    fp8::update_amax(amax, local_max);
+}
+
+__global__ void fp8_update_scale(float* scale, float* amax, float fp8_max)
+{
+    if (*amax > 0.f) *scale = *amax / fp8_max;
+    *amax = 0.f;
+}
+
+namespace fp8 {
+
+inline dim3 elementwise_grid(size_t count)
+{
+    const size_t blocks = (count + threads - 1) / threads;
+    // The kernels loop over the rest, so every block only adds one atomic.
+    return dim3((unsigned)std::min(blocks, (size_t)(SMs * 8)));
+}
+
+}  // namespace fp8
+
+template <typename T>
+void launch_fp8_quantize(void* output,
+                         float* amax,
+                         const T* input,
+                         const float* scale,
+                         size_t count,
+                         bool e5m2,
+                         cudaStream_t stream)
+{
+    dim3 grid_dim = fp8::elementwise_grid(count);
+    if (e5m2)
+        fp8_quantize<<<grid_dim, fp8::threads, 0, stream>>>(
+            (__nv_fp8_e5m2*)output, amax, input, scale, count);
+    else
+        fp8_quantize<<<grid_dim, fp8::threads, 0, stream>>>(
+            (__nv_fp8_e4m3*)output, amax, input, scale, count);
+}
+
+template <typename T>
+void launch_fused_ln_fp8(void* output,
+                         T* norm_output,
+                         float* amax,
+                         const T* input,
+                         const T* residual,
+                         const T* bias,
+                         const T* gamma,
+                         const T* beta,
+                         float epsilon,
+                         const float* scale,
+                         int rows,
+                         int elems_per_row,
+                         bool e5m2,
+                         cudaStream_t stream)
+{
+    if (e5m2)
+        fused_ln_fp8<<<rows, fp8::threads, 0, stream>>>((__nv_fp8_e5m2*)output,
+                                                        norm_output,
+                                                        amax,
+                                                        input,
+                                                        residual,
+                                                        bias,
+                                                        gamma,
+                                                        beta,
+                                                        epsilon,
+                                                        scale,
+                                                        elems_per_row);
+    else
+        fused_ln_fp8<<<rows, fp8::threads, 0, stream>>>((__nv_fp8_e4m3*)output,
+                                                        norm_output,
+                                                        amax,
+                                                        input,
+                                                        residual,
+                                                        bias,
+                                                        gamma,
+                                                        beta,
+                                                        epsilon,
+                                                        scale,
+                                                        elems_per_row);
+}
+
+template <typename T>
+void launch_bias_act_fp8(void* output,
+                         float* amax,
+                         const T* input,
+                         const T* bias,
+                         const float* scale,
+                         bool relu,
+                         int intermediate_size,
+                         int rows,
+                         bool e5m2,
+                         cudaStream_t stream)
+{
+    const size_t count = (size_t)rows * intermediate_size;
+    dim3 grid_dim = fp8::elementwise_grid(count);
+    if (e5m2)
+        bias_act_fp8<<<grid_dim, fp8::threads, 0, stream>>>(
+            (__nv_fp8_e5m2*)output, amax, input, bias, scale, relu, intermediate_size, count);
+    else
+        bias_act_fp8<<<grid_dim, fp8::threads, 0, stream>>>(
+            (__nv_fp8_e4m3*)output, amax, input, bias, scale, relu, intermediate_size, count);
+}
+
+void launch_fp8_update_scale(float* scale, float* amax, bool e5m2, cudaStream_t stream)
+{
+    fp8_update_scale<<<1, 1, 0, stream>>>(scale, amax, e5m2 ? FP8_E5M2_MAX : FP8_E4M3_MAX);
+}
+
+#define INSTANTIATE_FP8_PRODUCERS(T)                                                          \
+    template void launch_fp8_quantize<T>(                                                     \
+        void*, float*, const T*, const float*, size_t, bool, cudaStream_t);                   \
+    template void launch_fused_ln_fp8<T>(void*,                                               \
+                                         T*,                                                  \
+                                         float*,                                              \
+                                         const T*,                                            \
+                                         const T*,                                            \
+                                         const T*,                                            \
+                                         const T*,                                            \
+                                         const T*,                                            \
+                                         float,                                               \
+                                         const float*,                                        \
+                                         int,                                                 \
+                                         int,                                                 \
+                                         bool,                                                \
+                                         cudaStream_t);                                       \
+    template void launch_bias_act_fp8<T>(                                                     \
+        void*, float*, const T*, const T*, const float*, bool, int, int, bool, cudaStream_t);
+
+INSTANTIATE_FP8_PRODUCERS(float)
+INSTANTIATE_FP8_PRODUCERS(__half)
+
+#endif  // FP8_AVAILABLE
@@ -588,13 +588,20 @@ __device__ __forceinline__ float old_gelu(float val)
     return val * 0.5f * (1.0f + erff(val * rsqrt_2));
 }
 
+__device__ __forceinline__ float silu(float val) { return val / (1.0f + __expf(-val)); }
+
 namespace fused_geglu {
 constexpr int threads = 256;
 constexpr int steps = 2;
 constexpr int granularity = 16;
 }  // namespace fused_geglu
 
-template <typename T>
+/*
+Gated activation shared by GEGLU and SwiGLU: the second half of the channels of a row gates the
+first half, through a GeLU or a SiLU. When the bias is nullptr (the SwiGLU MLPs have none) the
+bias loads are skipped.
+*/
+template <typename T, bool siluGate>
 __global__ void fused_bias_geglu(T* output,
                                  const T* activation,
                                  const T* bias,
@@ -624,9 +631,10 @@ __global__ void fused_bias_geglu(T* output,
                                                               activation + seq_offset + channel_id);
             mem_access::load_global<fused_geglu::granularity>(
                 activation_buffer_2, activation + seq_offset + channel_id + base_channels);
-            mem_access::load_global<fused_geglu::granularity>(bias_buffer_1, bias + channel_id);
-            mem_access::load_global<fused_geglu::granularity>(bias_buffer_2,
-                                                              bias + channel_id + base_channels);
+            mem_access::load_global<fused_geglu::granularity>(
+                bias_buffer_1, bias + channel_id, bias != nullptr);
+            mem_access::load_global<fused_geglu::granularity>(
+                bias_buffer_2, bias + channel_id + base_channels, bias != nullptr);
 
             // Since the GeLU is going to happen at float, might as well
             // convert
@@ -634,7 +642,8 @@ __global__ void fused_bias_geglu(T* output,
             for (int v = 0; v < T_per_access; v++) {
                 T hidden_state = activation_buffer_1[v] + bias_buffer_1[v];
                 T pre_gate = activation_buffer_2[v] + bias_buffer_2[v];
-                float gate_f = old_gelu(conversion::to<float>(pre_gate));
+                float gate_f = siluGate ? silu(conversion::to<float>(pre_gate))
+                                        : old_gelu(conversion::to<float>(pre_gate));
                 T gate = conversion::to<T>(gate_f);
                 activation_buffer_1[v] = hidden_state * gate;
             }
@@ -645,6 +654,29 @@ __global__ void fused_bias_geglu(T* output,
     }
 }
 
+template <typename T, bool siluGate>
+void launch_fused_gated_activation(T* output,
+                                   const T* activation,
+                                   const T* bias,
+                                   int rows,
+                                   int elems_per_row,
+                                   cudaStream_t stream)
+{
+    // Re-derive the above figures
+    constexpr int T_per_access = fused_geglu::granularity / sizeof(T);
+    constexpr int T_per_step = T_per_access * fused_geglu::threads;
+    constexpr int T_per_block = T_per_step * fused_geglu::steps;
+
+    const int base_channels = elems_per_row / 2;
+    const int total_elems = base_channels * rows;
+
+    dim3 block(fused_geglu::threads);
+    dim3 grid((total_elems + T_per_block - 1) / T_per_block);
+
+    fused_bias_geglu<T, siluGate><<<grid, block, 0, stream>>>(
+        output, activation, bias, base_channels, total_elems);
+}
+
 template <typename T>
 void launch_fused_bias_geglu(T* output,
                              const T* activation,
@@ -659,20 +691,18 @@ void launch_fused_bias_geglu(T* output,
     where the second half of the channels act as GeLU gates for the first
     half.
     */
+    launch_fused_gated_activation<T, false>(output, activation, bias, rows, elems_per_row, stream);
+}
 
-    // Re-derive the above figures
-    constexpr int T_per_access = fused_geglu::granularity / sizeof(T);
-    constexpr int T_per_step = T_per_access * fused_geglu::threads;
-    constexpr int T_per_block = T_per_step * fused_geglu::steps;
-
-    const int base_channels = elems_per_row / 2;
-    const int total_elems = base_channels * rows;
-
-    dim3 block(fused_geglu::threads);
-    dim3 grid((total_elems + T_per_block - 1) / T_per_block);
-
-    fused_bias_geglu<<<grid, block, 0, stream>>>(
-        output, activation, bias, base_channels, total_elems);
+template <typename T>
+void launch_fused_bias_swiglu(T* output,
+                              const T* activation,
+                              const T* bias,
+                              int rows,
+                              int elems_per_row,
+                              cudaStream_t stream)
+{
+    launch_fused_gated_activation<T, true>(output, activation, bias, rows, elems_per_row, stream);
 }
 
 template void launch_fused_bias_geglu(__half*,
@@ -682,3 +712,10 @@ template void launch_fused_bias_geglu(__half*,
                                       int,
                                       cudaStream_t);
 template void launch_fused_bias_geglu(float*, const float*, const float*, int, int, cudaStream_t);
+template void launch_fused_bias_swiglu(__half*,
+                                       const __half*,
+                                       const __half*,
+                                       int,
+                                       int,
+                                       cudaStream_t);
+template void launch_fused_bias_swiglu(float*, const float*, const float*, int, int, cudaStream_t);
@@ -0,0 +1,242 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "conversion_utils.h"
+#include "inference_cuda_layers.h"
+#include "reduction_utils.h"
+
+#include <algorithm>
+
+namespace cg = cooperative_groups;
+using rop = reduce::ROpType;
+
+/*
+Layer norm as the prologue of a small batch GEMM: output = LN(input [+ residual + bias]) x W,
+for at most LN_GEMV_MAX_ROWS rows. Every block computes the row statistics itself, then normalizes
+the input chunk by chunk into shared memory while it streams its tile of weight columns, so the
+normalized input never goes through global memory (except for norm_output, written by block 0
+for the callers that keep it) and the layer norm needs no launch of its own.
+
+The weight is [in_features, out_features] row major, as cuBLAS sees it for CUBLAS_OP_N, or with
+transposed_weight [out_features, in_features]. A tile is 32 output columns, one per lane and split
+over the warps along k in the first case, 4 per warp, split over the lanes along k, in the second.
+*/
+namespace ln_gemv {
+
+constexpr int threads = 256;
+constexpr int warps = threads / hw_warp_size;
+constexpr int tile = 32;
+constexpr int outputs_per_warp = tile / warps;
+constexpr int chunk = threads;
+
+}  // namespace ln_gemv
+
+template <typename T, bool TransposedWeight>
+__global__ void fused_ln_gemv(T* output,
+                              T* norm_output,
+                              const T* input,
+                              const T* residual,
+                              const T* bias,
+                              const T* gamma,
+                              const T* beta,
+                              float epsilon,
+                              const T* weight,
+                              int rows,
+                              int in_features,
+                              int out_features)
+{
+    constexpr int accs = TransposedWeight ? ln_gemv::outputs_per_warp : 1;
+    __shared__ float x_chunk[LN_GEMV_MAX_ROWS][ln_gemv::chunk];
+    __shared__ float row_mean[LN_GEMV_MAX_ROWS];
+    __shared__ float row_rstd[LN_GEMV_MAX_ROWS];
+    __shared__ float partials[TransposedWeight ? 1 : ln_gemv::warps][LN_GEMV_MAX_ROWS]
+                             [ln_gemv::tile];
+
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+    const int warp_id = threadIdx.x / hw_warp_size;
+    const int lane = threadIdx.x % hw_warp_size;
+
+    auto load = [&](int r, int k) {
+        const size_t idx = (size_t)r * in_features + k;
+        float val = conversion::to<float>(input[idx]);
+        if (residual) val += conversion::to<float>(residual[idx]);
+        if (bias) val += conversion::to<float>(bias[k]);
+        return val;
+    };
+
+    for (int r = 0; r < rows; r++) {
+        float sum = 0.f;
+        for (int k = threadIdx.x; k < in_features; k += ln_gemv::threads) sum += load(r, k);
+        reduce::block<rop::Add>(tb, warp, sum);
+        const float mean = sum / in_features;
+
+        float mean_diff = 0.f;
+        for (int k = threadIdx.x; k < in_features; k += ln_gemv::threads) {
+            const float diff = load(r, k) - mean;
+            mean_diff += diff * diff;
+        }
+        reduce::block<rop::Add>(tb, warp, mean_diff);
+        if (threadIdx.x == 0) {
+            row_mean[r] = mean;
+            row_rstd[r] = __frsqrt_rn(mean_diff / in_features + epsilon);
+        }
+    }
+
+    for (int tile_idx = blockIdx.x; tile_idx * ln_gemv::tile < out_features;
+         tile_idx += gridDim.x) {
+        const int tile_base = tile_idx * ln_gemv::tile;
+        const bool store_norm = norm_output && tile_idx == blockIdx.x && blockIdx.x == 0;
+        float acc[LN_GEMV_MAX_ROWS][accs];
+#pragma unroll
+        for (int r = 0; r < LN_GEMV_MAX_ROWS; r++)
+#pragma unroll
+            for (int o = 0; o < accs; o++) acc[r][o] = 0.f;
+
+        for (int k_base = 0; k_base < in_features; k_base += ln_gemv::chunk) {
+            // The previous chunk (or the statistics) must be consumed before it is overwritten.
+            tb.sync();
+            const int k = k_base + threadIdx.x;
+            for (int r = 0; r < rows; r++) {
+                float val = 0.f;
+                if (k < in_features) {
+                    val = (load(r, k) - row_mean[r]) * row_rstd[r] *
+                              conversion::to<float>(gamma[k]) +
+                          conversion::to<float>(beta[k]);
+                    if (store_norm)
+                        norm_output[(size_t)r * in_features + k] = conversion::to<T>(val);
+                }
+                x_chunk[r][threadIdx.x] = val;
+            }
+            tb.sync();
+
+            const int chunk_size = min(ln_gemv::chunk, in_features - k_base);
+            if (TransposedWeight) {
+#pragma unroll
+                for (int o = 0; o < accs; o++) {
+                    const int n = tile_base + warp_id * accs + o;
+                    if (n >= out_features) break;
+                    const T* w_row = weight + (size_t)n * in_features + k_base;
+                    for (int kk = lane; kk < chunk_size; kk += hw_warp_size) {
+                        const float w = conversion::to<float>(w_row[kk]);
+#pragma unroll
+                        for (int r = 0; r < LN_GEMV_MAX_ROWS; r++)
+                            if (r < rows) acc[r][o] += w * x_chunk[r][kk];
+                    }
+                }
+            } else {
+                const int n = tile_base + lane;
+                if (n < out_features) {
+                    for (int kk = warp_id; kk < chunk_size; kk += ln_gemv::warps) {
+                        const float w =
+                            conversion::to<float>(weight[(size_t)(k_base + kk) * out_features + n]);
+#pragma unroll
+                        for (int r = 0; r < LN_GEMV_MAX_ROWS; r++)
+                            if (r < rows) acc[r][0] += w * x_chunk[r][kk];
+                    }
+                }
+            }
+        }
+
+        if (TransposedWeight) {
+#pragma unroll
+            for (int o = 0; o < accs; o++) {
+                const int n = tile_base + warp_id * accs + o;
+#pragma unroll
+                for (int r = 0; r < LN_GEMV_MAX_ROWS; r++) {
+                    if (r >= rows) break;
+                    float sum = acc[r][o];
+                    for (int offset = hw_warp_size / 2; offset > 0; offset /= 2)
+                        sum += warp.shfl_xor(sum, offset);
+                    if (lane == 0 && n < out_features)
+                        output[(size_t)r * out_features + n] = conversion::to<T>(sum);
+                }
+            }
+        } else {
+#pragma unroll
+            for (int r = 0; r < LN_GEMV_MAX_ROWS; r++) partials[warp_id][r][lane] = acc[r][0];
+            tb.sync();
+            // One thread per (row, column) of the tile sums the k slices of the warps.
+            const int r = threadIdx.x / ln_gemv::tile;
+            const int n = tile_base + threadIdx.x % ln_gemv::tile;
+            if (r < rows && n < out_features) {
+                float sum = 0.f;
+#pragma unroll
+                for (int w = 0; w < ln_gemv::warps; w++)
+                    sum += partials[w][r][threadIdx.x % ln_gemv::tile];
+                output[(size_t)r * out_features + n] = conversion::to<T>(sum);
+            }
+        }
+    }
+}
+
+template <typename T>
+void launch_fused_ln_gemv(T* output,
+                          T* norm_output,
+                          const T* input,
+                          const T* residual,
+                          const T* bias,
+                          const T* gamma,
+                          const T* beta,
+                          float epsilon,
+                          const T* weight,
+                          bool transposed_weight,
+                          int rows,
+                          int in_features,
+                          int out_features,
+                          cudaStream_t stream)
+{
+    assert(rows <= LN_GEMV_MAX_ROWS);
+    // Each block recomputes the row statistics, so keep enough tiles per block to amortize them.
+    const int tiles = (out_features + ln_gemv::tile - 1) / ln_gemv::tile;
+    dim3 grid_dim(std::min(tiles, SMs * 4));
+    dim3 block_dim(ln_gemv::threads);
+
+    if (transposed_weight)
+        fused_ln_gemv<T, true><<<grid_dim, block_dim, 0, stream>>>(output,
+                                                                   norm_output,
+                                                                   input,
+                                                                   residual,
+                                                                   bias,
+                                                                   gamma,
+                                                                   beta,
+                                                                   epsilon,
+                                                                   weight,
+                                                                   rows,
+                                                                   in_features,
+                                                                   out_features);
+    else
+        fused_ln_gemv<T, false><<<grid_dim, block_dim, 0, stream>>>(output,
+                                                                    norm_output,
+                                                                    input,
+                                                                    residual,
+                                                                    bias,
+                                                                    gamma,
+                                                                    beta,
+                                                                    epsilon,
+                                                                    weight,
+                                                                    rows,
+                                                                    in_features,
+                                                                    out_features);
+}
+
+#define INSTANTIATE_FUSED_LN_GEMV(T)                                     \
+    template void launch_fused_ln_gemv<T>(T*,                            \
+                                          T*,                            \
+                                          const T*,                      \
+                                          const T*,                      \
+                                          const T*,                      \
+                                          const T*,                      \
+                                          const T*,                      \
+                                          float,                         \
+                                          const T*,                      \
+                                          bool,                          \
+                                          int,                           \
+                                          int,                           \
+                                          int,                           \
+                                          cudaStream_t);
+
+INSTANTIATE_FUSED_LN_GEMV(float)
+INSTANTIATE_FUSED_LN_GEMV(__half)
@@ -0,0 +1,136 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "conversion_utils.h"
+#include "inference_cuda_layers.h"
+#include "reduction_utils.h"
+
+namespace cg = cooperative_groups;
+using rop = reduce::ROpType;
+
+/*
+Batched low-rank adapters on top of a base GEMM: output += scale * x . A[id] . B[id], with the
+adapter id read per token, so tokens of different adapters share one launch (BGMV). A is stored
+[adapters, rank, in_dim] and B [adapters, rank, out_dim], both rows of a rank contiguous.
+
+The shrink pass gives each (token, rank) pair a block that reduces x . A[id][r] into an fp32
+scratch of [tokens, rank], the expand pass gives each thread one output column of a token and
+accumulates the rank values of the scratch against B[id][:, n], coalesced over the columns.
+Tokens with a negative id (or one past the adapters) only keep the base GEMM.
+*/
+namespace lora {
+
+constexpr int shrink_threads = 256;
+constexpr int expand_threads = 256;
+
+DS_D_INLINE int adapter(const int* ids, int token, int tokens_per_id, int adapters)
+{
+    const int id = ids[token / tokens_per_id];
+    return id < adapters ? id : -1;
+}
+
+}  // namespace lora
+
+template <typename T>
+__global__ void lora_shrink(float* scratch,
+                            const T* input,
+                            const T* lora_a,
+                            const int* ids,
+                            int tokens_per_id,
+                            int adapters,
+                            int in_dim,
+                            int rank)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+
+    const int token = blockIdx.x;
+    const int r = blockIdx.y;
+    const int id = lora::adapter(ids, token, tokens_per_id, adapters);
+    if (id < 0) return;
+
+    const T* x = input + (size_t)token * in_dim;
+    const T* a = lora_a + ((size_t)id * rank + r) * in_dim;
+    float sum = 0.f;
+    for (int k = threadIdx.x; k < in_dim; k += lora::shrink_threads)
+        sum += conversion::to<float>(x[k]) * conversion::to<float>(a[k]);
+    reduce::block<rop::Add>(tb, warp, sum);
+    if (threadIdx.x == 0) scratch[(size_t)token * rank + r] = sum;
+}
+
+template <typename T>
+__global__ void lora_expand(T* output,
+                            const float* scratch,
+                            const T* lora_b,
+                            const int* ids,
+                            int tokens_per_id,
+                            int adapters,
+                            int rank,
+                            int out_dim,
+                            float scale)
+{
+    __shared__ float shrunk[LORA_MAX_RANK];
+
+    const int token = blockIdx.x;
+    const int id = lora::adapter(ids, token, tokens_per_id, adapters);
+    if (id < 0) return;
+
+    for (int r = threadIdx.x; r < rank; r += lora::expand_threads)
+        shrunk[r] = scratch[(size_t)token * rank + r];
+    __syncthreads();
+
+    const int n = blockIdx.y * lora::expand_threads + threadIdx.x;
+    if (n >= out_dim) return;
+    const T* b = lora_b + (size_t)id * rank * out_dim + n;
+    float sum = 0.f;
+    for (int r = 0; r < rank; r++) sum += shrunk[r] * conversion::to<float>(b[(size_t)r * out_dim]);
+
+    T* out = output + (size_t)token * out_dim + n;
+    *out = conversion::to<T>(conversion::to<float>(*out) + scale * sum);
+}
+
+template <typename T>
+void launch_lora_bgmv(T* output,
+                      float* scratch,
+                      const T* input,
+                      const T* lora_a,
+                      const T* lora_b,
+                      const int* ids,
+                      int tokens_per_id,
+                      float scale,
+                      int tokens,
+                      int adapters,
+                      int in_dim,
+                      int rank,
+                      int out_dim,
+                      cudaStream_t stream)
+{
+    dim3 shrink_grid(tokens, rank);
+    lora_shrink<<<shrink_grid, lora::shrink_threads, 0, stream>>>(
+        scratch, input, lora_a, ids, tokens_per_id, adapters, in_dim, rank);
+
+    dim3 expand_grid(tokens, (out_dim + lora::expand_threads - 1) / lora::expand_threads);
+    lora_expand<<<expand_grid, lora::expand_threads, 0, stream>>>(
+        output, scratch, lora_b, ids, tokens_per_id, adapters, rank, out_dim, scale);
+}
+
+#define INSTANTIATE_LORA_BGMV(T)                          \
+    template void launch_lora_bgmv<T>(T*,                 \
+                                      float*,             \
+                                      const T*,           \
+                                      const T*,           \
+                                      const T*,           \
+                                      const int*,         \
+                                      int,                \
+                                      float,              \
+                                      int,                \
+                                      int,                \
+                                      int,                \
+                                      int,                \
+                                      int,                \
+                                      cudaStream_t);
+
+INSTANTIATE_LORA_BGMV(float)
+INSTANTIATE_LORA_BGMV(__half)
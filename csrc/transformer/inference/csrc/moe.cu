@@ -0,0 +1,373 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "conversion_utils.h"
+#include "inference_cuda_layers.h"
+
+#include <cfloat>
+#include <climits>
+
+namespace cg = cooperative_groups;
+
+/*
+Expert FFNs of a MoE layer in a fixed number of launches, independent of the number of experts:
+gating (softmax + top-k) -> per expert offsets and the slot of every (token, k) assignment ->
+gather of the tokens in expert order -> grouped GEMM over all experts -> grouped GEMM -> weighted
+combine back into token order. Tokens are never dropped, each expert gets a ragged number of rows.
+*/
+namespace moe {
+
+constexpr int gating_threads = 256;
+constexpr int gating_warps = gating_threads / hw_warp_size;
+constexpr int expert_vals = MOE_MAX_EXPERTS / hw_warp_size;
+constexpr int permute_threads = 1024;
+constexpr int copy_threads = 256;
+
+constexpr int tile_m = 64;
+constexpr int tile_n = 64;
+constexpr int tile_k = 16;
+constexpr int gemm_threads = 256;
+constexpr int thread_dim = 4;
+
+DS_D_INLINE float gelu(const float x)
+{
+    const float sqrt_param = 0.79788456080286535587989211986876f;
+    const float mul_param = 0.044715;
+    return x * 0.5f * (1.0f + tanhf(sqrt_param * (x + mul_param * x * x * x)));
+}
+
+}  // namespace moe
+
+/*
+One warp per token. Each lane keeps the probabilities of experts lane, lane + 32, ... and top_k
+rounds of a warp argmax pick the experts, lowest expert first on ties as torch.argmax does. With
+top_k > 1 the gate weights are renormalized over the picked experts.
+*/
+__global__ void moe_gating(int* expert_ids,
+                           float* gate_weights,
+                           const float* logits,
+                           int tokens,
+                           int experts,
+                           int top_k)
+{
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+    const int token = blockIdx.x * moe::gating_warps + threadIdx.x / hw_warp_size;
+    const int lane = threadIdx.x % hw_warp_size;
+    if (token >= tokens) return;
+
+    const float* token_logits = logits + (size_t)token * experts;
+    float probs[moe::expert_vals];
+    float max_logit = -FLT_MAX;
+#pragma unroll
+    for (int i = 0; i < moe::expert_vals; i++) {
+        const int e = lane + i * hw_warp_size;
+        probs[i] = e < experts ? token_logits[e] : -FLT_MAX;
+        max_logit = fmaxf(max_logit, probs[i]);
+    }
+    for (int offset = hw_warp_size / 2; offset > 0; offset /= 2)
+        max_logit = fmaxf(max_logit, warp.shfl_xor(max_logit, offset));
+
+    float sum = 0.f;
+#pragma unroll
+    for (int i = 0; i < moe::expert_vals; i++) {
+        const int e = lane + i * hw_warp_size;
+        probs[i] = e < experts ? __expf(probs[i] - max_logit) : 0.f;
+        sum += probs[i];
+    }
+    for (int offset = hw_warp_size / 2; offset > 0; offset /= 2)
+        sum += warp.shfl_xor(sum, offset);
+    // Picked and padding experts are marked with -1 so they can never win again.
+#pragma unroll
+    for (int i = 0; i < moe::expert_vals; i++) {
+        const int e = lane + i * hw_warp_size;
+        probs[i] = e < experts ? probs[i] / sum : -1.f;
+    }
+
+    float weights[MOE_MAX_TOP_K];
+    int ids[MOE_MAX_TOP_K];
+    float picked_sum = 0.f;
+#pragma unroll
+    for (int s = 0; s < MOE_MAX_TOP_K; s++) {
+        if (s >= top_k) break;
+        float best = -1.f;
+        int best_expert = INT_MAX;
+#pragma unroll
+        for (int i = 0; i < moe::expert_vals; i++) {
+            if (probs[i] > best) {
+                best = probs[i];
+                best_expert = lane + i * hw_warp_size;
+            }
+        }
+        for (int offset = hw_warp_size / 2; offset > 0; offset /= 2) {
+            const float other = warp.shfl_xor(best, offset);
+            const int other_expert = warp.shfl_xor(best_expert, offset);
+            if (other > best || (other == best && other_expert < best_expert)) {
+                best = other;
+                best_expert = other_expert;
+            }
+        }
+#pragma unroll
+        for (int i = 0; i < moe::expert_vals; i++)
+            if (lane + i * hw_warp_size == best_expert) probs[i] = -1.f;
+        weights[s] = best;
+        ids[s] = best_expert;
+        picked_sum += best;
+    }
+
+    if (lane == 0) {
+        const float scale = top_k > 1 ? 1.f / fmaxf(picked_sum, FLT_EPSILON) : 1.f;
+#pragma unroll
+        for (int s = 0; s < MOE_MAX_TOP_K; s++) {
+            if (s >= top_k) break;
+            expert_ids[token * top_k + s] = ids[s];
+            gate_weights[token * top_k + s] = weights[s] * scale;
+        }
+    }
+}
+
+/*
+Single block: counts the assignments of every expert, scans them into expert_offsets[experts + 1]
+and hands out the rows of each expert. The order of the rows within an expert is not deterministic,
+which does not change any result since every row is computed on its own.
+*/
+__global__ void moe_scan_permute(int* expert_offsets,
+                                 int* positions,
+                                 const int* expert_ids,
+                                 int assignments,
+                                 int experts)
+{
+    __shared__ int counts[MOE_MAX_EXPERTS];
+    __shared__ int cursors[MOE_MAX_EXPERTS];
+
+    for (int e = threadIdx.x; e < experts; e += blockDim.x) counts[e] = 0;
+    __syncthreads();
+    for (int i = threadIdx.x; i < assignments; i += blockDim.x)
+        atomicAdd(&counts[expert_ids[i]], 1);
+    __syncthreads();
+    if (threadIdx.x == 0) {
+        int offset = 0;
+        for (int e = 0; e < experts; e++) {
+            cursors[e] = offset;
+            expert_offsets[e] = offset;
+            offset += counts[e];
+        }
+        expert_offsets[experts] = offset;
+    }
+    __syncthreads();
+    for (int i = threadIdx.x; i < assignments; i += blockDim.x)
+        positions[i] = atomicAdd(&cursors[expert_ids[i]], 1);
+}
+
+template <typename T>
+__global__ void moe_gather(T* permuted, const T* input, const int* positions, int top_k, int hidden)
+{
+    const int assignment = blockIdx.x;
+    const T* src = input + (size_t)(assignment / top_k) * hidden;
+    T* dst = permuted + (size_t)positions[assignment] * hidden;
+    for (int i = threadIdx.x; i < hidden; i += blockDim.x) dst[i] = src[i];
+}
+
+/*
+output[rows of e] = act(input[rows of e] x weights[e] + biases[e]) for all experts in one launch.
+Every weight is [in_features, out_features] row major. blockIdx.y enumerates the row tiles of all
+experts back to back, the grid is sized for the worst case and the blocks past the last tile exit.
+*/
+template <typename T>
+__global__ void moe_grouped_gemm(T* output,
+                                 const T* input,
+                                 const T* const* weights,
+                                 const T* const* biases,
+                                 const int* expert_offsets,
+                                 int experts,
+                                 int in_features,
+                                 int out_features,
+                                 bool gelu)
+{
+    __shared__ float a_tile[moe::tile_k][moe::tile_m + 1];
+    __shared__ float b_tile[moe::tile_k][moe::tile_n];
+
+    int tile = blockIdx.y;
+    int expert = -1;
+    int row_begin = 0, row_end = 0;
+    for (int e = 0; e < experts; e++) {
+        const int begin = expert_offsets[e];
+        const int end = expert_offsets[e + 1];
+        const int tiles = (end - begin + moe::tile_m - 1) / moe::tile_m;
+        if (tile < tiles) {
+            expert = e;
+            row_begin = begin + tile * moe::tile_m;
+            row_end = end;
+            break;
+        }
+        tile -= tiles;
+    }
+    if (expert < 0) return;
+
+    const T* weight = weights[expert];
+    const int col_begin = blockIdx.x * moe::tile_n;
+    const int ty = threadIdx.x / (moe::tile_n / moe::thread_dim);
+    const int tx = threadIdx.x % (moe::tile_n / moe::thread_dim);
+
+    float acc[moe::thread_dim][moe::thread_dim] = {};
+    for (int k_base = 0; k_base < in_features; k_base += moe::tile_k) {
+        for (int i = threadIdx.x; i < moe::tile_m * moe::tile_k; i += moe::gemm_threads) {
+            const int m = i / moe::tile_k, k = i % moe::tile_k;
+            const int row = row_begin + m, col = k_base + k;
+            a_tile[k][m] = (row < row_end && col < in_features)
+                               ? conversion::to<float>(input[(size_t)row * in_features + col])
+                               : 0.f;
+        }
+        for (int i = threadIdx.x; i < moe::tile_k * moe::tile_n; i += moe::gemm_threads) {
+            const int k = i / moe::tile_n, n = i % moe::tile_n;
+            const int row = k_base + k, col = col_begin + n;
+            b_tile[k][n] = (row < in_features && col < out_features)
+                               ? conversion::to<float>(weight[(size_t)row * out_features + col])
+                               : 0.f;
+        }
+        __syncthreads();
+#pragma unroll
+        for (int k = 0; k < moe::tile_k; k++) {
+            float a[moe::thread_dim], b[moe::thread_dim];
+#pragma unroll
+            for (int i = 0; i < moe::thread_dim; i++) {
+                a[i] = a_tile[k][ty * moe::thread_dim + i];
+                b[i] = b_tile[k][tx * moe::thread_dim + i];
+            }
+#pragma unroll
+            for (int i = 0; i < moe::thread_dim; i++)
+#pragma unroll
+                for (int j = 0; j < moe::thread_dim; j++) acc[i][j] += a[i] * b[j];
+        }
+        __syncthreads();
+    }
+
+    const T* bias = biases ? biases[expert] : nullptr;
+#pragma unroll
+    for (int i = 0; i < moe::thread_dim; i++) {
+        const int row = row_begin + ty * moe::thread_dim + i;
+        if (row >= row_end) break;
+#pragma unroll
+        for (int j = 0; j < moe::thread_dim; j++) {
+            const int col = col_begin + tx * moe::thread_dim + j;
+            if (col >= out_features) break;
+            float val = acc[i][j];
+            if (bias) val += conversion::to<float>(bias[col]);
+            if (gelu) val = moe::gelu(val);
+            output[(size_t)row * out_features + col] = conversion::to<T>(val);
+        }
+    }
+}
+
+template <typename T>
+__global__ void moe_combine(T* output,
+                            const T* expert_output,
+                            const int* positions,
+                            const float* gate_weights,
+                            int top_k,
+                            int hidden)
+{
+    const int token = blockIdx.x;
+    for (int i = threadIdx.x; i < hidden; i += blockDim.x) {
+        float val = 0.f;
+        for (int s = 0; s < top_k; s++) {
+            const int assignment = token * top_k + s;
+            val += gate_weights[assignment] *
+                   conversion::to<float>(
+                       expert_output[(size_t)positions[assignment] * hidden + i]);
+        }
+        output[(size_t)token * hidden + i] = conversion::to<T>(val);
+    }
+}
+
+void launch_moe_gating(int* expert_ids,
+                       float* gate_weights,
+                       int* expert_offsets,
+                       int* positions,
+                       const float* logits,
+                       int tokens,
+                       int experts,
+                       int top_k,
+                       cudaStream_t stream)
+{
+    dim3 grid_dim((tokens + moe::gating_warps - 1) / moe::gating_warps);
+    moe_gating<<<grid_dim, moe::gating_threads, 0, stream>>>(
+        expert_ids, gate_weights, logits, tokens, experts, top_k);
+    moe_scan_permute<<<1, moe::permute_threads, 0, stream>>>(
+        expert_offsets, positions, expert_ids, tokens * top_k, experts);
+}
+
+template <typename T>
+void launch_moe_gather(T* permuted,
+                       const T* input,
+                       const int* positions,
+                       int tokens,
+                       int top_k,
+                       int hidden,
+                       cudaStream_t stream)
+{
+    moe_gather<<<tokens * top_k, moe::copy_threads, 0, stream>>>(
+        permuted, input, positions, top_k, hidden);
+}
+
+template <typename T>
+void launch_moe_grouped_gemm(T* output,
+                             const T* input,
+                             const T* const* weights,
+                             const T* const* biases,
+                             const int* expert_offsets,
+                             int experts,
+                             int rows,
+                             int in_features,
+                             int out_features,
+                             bool gelu,
+                             cudaStream_t stream)
+{
+    // Every expert wastes at most one partial tile, so this covers any split of the rows.
+    dim3 grid_dim((out_features + moe::tile_n - 1) / moe::tile_n,
+                  (rows + moe::tile_m - 1) / moe::tile_m + experts);
+    moe_grouped_gemm<<<grid_dim, moe::gemm_threads, 0, stream>>>(output,
+                                                                 input,
+                                                                 weights,
+                                                                 biases,
+                                                                 expert_offsets,
+                                                                 experts,
+                                                                 in_features,
+                                                                 out_features,
+                                                                 gelu);
+}
+
+template <typename T>
+void launch_moe_combine(T* output,
+                        const T* expert_output,
+                        const int* positions,
+                        const float* gate_weights,
+                        int tokens,
+                        int top_k,
+                        int hidden,
+                        cudaStream_t stream)
+{
+    moe_combine<<<tokens, moe::copy_threads, 0, stream>>>(
+        output, expert_output, positions, gate_weights, top_k, hidden);
+}
+
+#define INSTANTIATE_MOE(T)                                                                        \
+    template void launch_moe_gather<T>(T*, const T*, const int*, int, int, int, cudaStream_t);    \
+    template void launch_moe_grouped_gemm<T>(T*,                                                  \
+                                             const T*,                                            \
+                                             const T* const*,                                     \
+                                             const T* const*,                                     \
+                                             const int*,                                          \
+                                             int,                                                 \
+                                             int,                                                 \
+                                             int,                                                 \
+                                             int,                                                 \
+                                             bool,                                                \
+                                             cudaStream_t);                                       \
+    template void launch_moe_combine<T>(                                                          \
+        T*, const T*, const int*, const float*, int, int, int, cudaStream_t);
+
+INSTANTIATE_MOE(float)
+INSTANTIATE_MOE(__half)
@@ -0,0 +1,221 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "conversion_utils.h"
+#include "inference_cuda_layers.h"
+#include "kv_cache_layout.h"
+
+/*
+Scatters the K and V of up to seq_len new tokens per sequence, laid out
+[bsz][heads][seq_len][head_size], into the pages of the block paged KV cache (see
+paged_kv_cache.h). Sequence b keeps new_tokens[b] tokens, written from position
+start_positions[b] on, the rest is padding. The attention over the pages is in decode_attention.cu.
+*/
+template <typename T>
+__global__ void paged_kv_append(T* pool,
+                                const int* block_table,
+                                int table_width,
+                                const int* start_positions,
+                                const int* new_tokens,
+                                const T* k_src,
+                                const T* v_src,
+                                int layer,
+                                int num_layers,
+                                int heads,
+                                int head_size,
+                                int block_tokens,
+                                int seq_len,
+                                int total_count)
+{
+    const int idx = blockIdx.x * blockDim.x + threadIdx.x;
+    if (idx >= total_count) return;
+
+    const int dim = idx % head_size;
+    int row = idx / head_size;
+    const int token = row % seq_len;
+    row /= seq_len;
+    const int head = row % heads;
+    const int seq = row / heads;
+    if (token >= new_tokens[seq]) return;
+
+    const kv_layout::Paged<T> cache{
+        pool, block_table, table_width, layer, num_layers, heads, head_size, block_tokens};
+    const int pos = start_positions[seq] + token;
+    cache.key(seq, head, pos)[dim] = k_src[idx];
+    cache.value(seq, head, pos)[dim] = v_src[idx];
+}
+
+namespace paged {
+
+constexpr int rows_per_block = 4;
+constexpr int max_lane_dims = DECODE_ATTN_MAX_HEAD_SIZE / WARP_SIZE;
+
+// Symmetric int8 quantization of one head_size row by a warp, lane 0 writes the scale.
+template <typename T>
+__device__ void quantize_row(int8_t* dst, float* scale, const T* src, int head_size, int lane)
+{
+    float vals[max_lane_dims];
+    float abs_max = 0.f;
+#pragma unroll
+    for (int i = 0; i < max_lane_dims; i++) {
+        const int dim = lane + i * WARP_SIZE;
+        vals[i] = dim < head_size ? conversion::to<float>(src[dim]) : 0.f;
+        abs_max = fmaxf(abs_max, fabsf(vals[i]));
+    }
+#pragma unroll
+    for (int j = WARP_SIZE / 2; j > 0; j >>= 1)
+        abs_max = fmaxf(abs_max, __shfl_xor_sync(0xffffffff, abs_max, j));
+
+    const float q_scale = abs_max > 0.f ? 127.f / abs_max : 0.f;
+#pragma unroll
+    for (int i = 0; i < max_lane_dims; i++) {
+        const int dim = lane + i * WARP_SIZE;
+        if (dim < head_size) dst[dim] = (int8_t)__float2int_rn(vals[i] * q_scale);
+    }
+    if (lane == 0) *scale = abs_max / 127.f;
+}
+
+}  // namespace paged
+
+/*
+paged_kv_append for the int8 cache: a warp takes one (sequence, head, token) row, quantizes its K
+and V with a scale each and stores the scales next to the blocks (see paged_kv_cache.h).
+*/
+template <typename T>
+__global__ void paged_kv_append_int8(int8_t* pool,
+                                     float* kv_scales,
+                                     const int* block_table,
+                                     int table_width,
+                                     const int* start_positions,
+                                     const int* new_tokens,
+                                     const T* k_src,
+                                     const T* v_src,
+                                     int layer,
+                                     int num_layers,
+                                     int heads,
+                                     int head_size,
+                                     int block_tokens,
+                                     int seq_len,
+                                     int total_rows)
+{
+    const int row = blockIdx.x * paged::rows_per_block + threadIdx.x / WARP_SIZE;
+    const int lane = threadIdx.x % WARP_SIZE;
+    if (row >= total_rows) return;
+
+    const int token = row % seq_len;
+    const int head = (row / seq_len) % heads;
+    const int seq = row / (seq_len * heads);
+    if (token >= new_tokens[seq]) return;
+
+    const kv_layout::QuantizedPaged<int8_t> cache{
+        {pool, block_table, table_width, layer, num_layers, heads, head_size, block_tokens},
+        kv_scales};
+    const int pos = start_positions[seq] + token;
+    const size_t scale_index = cache.scale_index(seq, head, pos);
+    const size_t src_offset = (size_t)row * head_size;
+    paged::quantize_row(cache.elements.key(seq, head, pos),
+                        kv_scales + scale_index,
+                        k_src + src_offset,
+                        head_size,
+                        lane);
+    paged::quantize_row(cache.elements.value(seq, head, pos),
+                        kv_scales + scale_index + heads * block_tokens,
+                        v_src + src_offset,
+                        head_size,
+                        lane);
+}
+
+template <typename T>
+void launch_paged_kv_append(void* pool,
+                            float* kv_scales,
+                            const int* block_table,
+                            int table_width,
+                            const int* start_positions,
+                            const int* new_tokens,
+                            const T* k_src,
+                            const T* v_src,
+                            int layer,
+                            int num_layers,
+                            int heads,
+                            int head_size,
+                            int block_tokens,
+                            int batch_size,
+                            int seq_len,
+                            cudaStream_t stream)
+{
+    if (kv_scales) {
+        assert(head_size <= DECODE_ATTN_MAX_HEAD_SIZE);
+        const int total_rows = batch_size * heads * seq_len;
+        dim3 block_dim(paged::rows_per_block * WARP_SIZE);
+        dim3 grid_dim((total_rows + paged::rows_per_block - 1) / paged::rows_per_block);
+        paged_kv_append_int8<<<grid_dim, block_dim, 0, stream>>>((int8_t*)pool,
+                                                                 kv_scales,
+                                                                 block_table,
+                                                                 table_width,
+                                                                 start_positions,
+                                                                 new_tokens,
+                                                                 k_src,
+                                                                 v_src,
+                                                                 layer,
+                                                                 num_layers,
+                                                                 heads,
+                                                                 head_size,
+                                                                 block_tokens,
+                                                                 seq_len,
+                                                                 total_rows);
+        return;
+    }
+    const int total_count = batch_size * heads * seq_len * head_size;
+    const int threads = 256;
+    dim3 block_dim(threads);
+    dim3 grid_dim((total_count + threads - 1) / threads);
+    paged_kv_append<<<grid_dim, block_dim, 0, stream>>>((T*)pool,
+                                                        block_table,
+                                                        table_width,
+                                                        start_positions,
+                                                        new_tokens,
+                                                        k_src,
+                                                        v_src,
+                                                        layer,
+                                                        num_layers,
+                                                        heads,
+                                                        head_size,
+                                                        block_tokens,
+                                                        seq_len,
+                                                        total_count);
+}
+
+template void launch_paged_kv_append<float>(void*,
+                                            float*,
+                                            const int*,
+                                            int,
+                                            const int*,
+                                            const int*,
+                                            const float*,
+                                            const float*,
+                                            int,
+                                            int,
+                                            int,
+                                            int,
+                                            int,
+                                            int,
+                                            int,
+                                            cudaStream_t);
+template void launch_paged_kv_append<__half>(void*,
+                                             float*,
+                                             const int*,
+                                             int,
+                                             const int*,
+                                             const int*,
+                                             const __half*,
+                                             const __half*,
+                                             int,
+                                             int,
+                                             int,
+                                             int,
+                                             int,
+                                             int,
+                                             int,
+                                             cudaStream_t);
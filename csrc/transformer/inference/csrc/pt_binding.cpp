@@ -7,6 +7,7 @@
 #include <torch/extension.h>
 #include <stdexcept>
 #include <vector>
+#include "ds_instrument.h"
 #include "inference_context.h"
 #include "inference_cublas_wrappers.h"
 #include "inference_cuda_layers.h"
@@ -111,7 +112,11 @@ void allocate_workspace(unsigned hidden_dim,
                         bool external_cache = false,
                         unsigned rank = 0,
                         unsigned max_out_tokens = 1024,
-                        unsigned min_out_tokens = 1)
+                        unsigned min_out_tokens = 1,
+                        unsigned kv_block_tokens = 0,
+                        size_t kv_blocks = 0,
+                        bool kv_int8 = false,
+                        unsigned num_kv_heads = 0)
 {
     InferenceContext::Instance().GenWorkSpace(num_layers,
                                               num_heads,
@@ -123,7 +128,11 @@ void allocate_workspace(unsigned hidden_dim,
                                               sizeof(T),
                                               rank,
                                               max_out_tokens,
-                                              min_out_tokens);
+                                              min_out_tokens,
+                                              kv_block_tokens,
+                                              kv_blocks,
+                                              kv_int8,
+                                              num_kv_heads);
 }
 
 template <typename T>
@@ -356,40 +365,46 @@ void attention_unfused(T* prev_key_cont,
                        unsigned& seq_len,
                        unsigned& soft_len,
                        int& heads,
+                       int kv_heads,
                        float& norm_factor,
                        bool triangular,
                        bool recompute,
                        bool local_attention,
                        int window_size,
                        at::Tensor& alibi,
-                       int layer_id)
+                       int layer_id,
+                       unsigned kv_stride)
 {
     float layer_scale = alibi.sizes().size() > 1 ? std::max(1, layer_id) : 1.0;
     float alpha = norm_factor * norm_factor / layer_scale;
     float gemm_beta = 0.0;
     T* workspace = (T*)InferenceContext::Instance().GetAttentionUnfusedWorkspace();
+    // With grouped KV heads the query heads of one K/V head are not a constant stride apart,
+    // each position within the groups is its own batched GEMM over the KV heads.
+    const int group = heads / kv_heads;
 
     cublasSetStream(InferenceContext::Instance().GetCublasHandle(),
                     InferenceContext::Instance().GetCurrentStream());
-    cublas_strided_batched_gemm(InferenceContext::Instance().GetCublasHandle(),
-                                soft_len,
-                                seq_len,
-                                k,
-                                &alpha,
-                                &gemm_beta,
-                                (T*)prev_key_cont,
-                                (T*)query_cont,
-                                workspace,
-                                CUBLAS_OP_T,
-                                CUBLAS_OP_N,
-                                InferenceContext::Instance().GetMaxTokenLenght() * k,
-                                seq_len * k,
-                                seq_len * soft_len,
-                                bsz * heads,
+    for (int g = 0; g < group; g++)
+        cublas_strided_batched_gemm(InferenceContext::Instance().GetCublasHandle(),
+                                    soft_len,
+                                    seq_len,
+                                    k,
+                                    &alpha,
+                                    &gemm_beta,
+                                    (T*)prev_key_cont,
+                                    (T*)query_cont + g * seq_len * k,
+                                    workspace + g * seq_len * soft_len,
+                                    CUBLAS_OP_T,
+                                    CUBLAS_OP_N,
+                                    kv_stride * k,
+                                    group * seq_len * k,
+                                    group * seq_len * soft_len,
+                                    bsz * kv_heads,
 #ifdef __HIP_PLATFORM_HCC__
-                                rocblas_gemm_algo_standard);
+                                    rocblas_gemm_algo_standard);
 #else
-                                CUBLAS_GEMM_DEFAULT_TENSOR_OP);
+                                    CUBLAS_GEMM_DEFAULT_TENSOR_OP);
 #endif
     ds_softmax_internal<T>(workspace,
                            attn_mask,
@@ -404,30 +419,437 @@ void attention_unfused(T* prev_key_cont,
                            soft_len,
                            heads);
     alpha = 1.0;
-    cublas_strided_batched_gemm(InferenceContext::Instance().GetCublasHandle(),
-                                k,
-                                seq_len,
-                                soft_len,
-                                &alpha,
-                                &gemm_beta,
-                                (T*)prev_value_cont,
-                                workspace,
-                                (T*)output,
-                                CUBLAS_OP_N,
-                                CUBLAS_OP_N,
-                                InferenceContext::Instance().GetMaxTokenLenght() * k,
-                                seq_len * soft_len,
-                                seq_len * k,
-                                bsz * heads,
+    for (int g = 0; g < group; g++)
+        cublas_strided_batched_gemm(InferenceContext::Instance().GetCublasHandle(),
+                                    k,
+                                    seq_len,
+                                    soft_len,
+                                    &alpha,
+                                    &gemm_beta,
+                                    (T*)prev_value_cont,
+                                    workspace + g * seq_len * soft_len,
+                                    (T*)output + g * seq_len * k,
+                                    CUBLAS_OP_N,
+                                    CUBLAS_OP_N,
+                                    kv_stride * k,
+                                    group * seq_len * soft_len,
+                                    group * seq_len * k,
+                                    bsz * kv_heads,
 #ifdef __HIP_PLATFORM_HCC__
-                                rocblas_gemm_algo_standard);
+                                    rocblas_gemm_algo_standard);
 #else
-                                CUBLAS_GEMM_DEFAULT_TENSOR_OP);
+                                    CUBLAS_GEMM_DEFAULT_TENSOR_OP);
 #endif
 }
 
+// Prompt attention, fused when the head fits the flash kernel so the scores stay on chip.
+template <typename T>
+void attention_prefill(T* prev_key_cont,
+                       T* query_cont,
+                       at::Tensor& attn_mask,
+                       T* prev_value_cont,
+                       T* output,
+                       unsigned& bsz,
+                       int& k,
+                       unsigned& seq_len,
+                       unsigned& soft_len,
+                       int& heads,
+                       int kv_heads,
+                       float& norm_factor,
+                       bool triangular,
+                       bool local_attention,
+                       int window_size,
+                       at::Tensor& alibi,
+                       int layer_id,
+                       unsigned kv_stride)
+{
+    if (!InferenceContext::Instance().flash_prefill()) {
+        attention_unfused<T>(prev_key_cont,
+                             query_cont,
+                             attn_mask,
+                             prev_value_cont,
+                             output,
+                             bsz,
+                             k,
+                             seq_len,
+                             soft_len,
+                             heads,
+                             kv_heads,
+                             norm_factor,
+                             triangular,
+                             true,
+                             local_attention,
+                             window_size,
+                             alibi,
+                             layer_id,
+                             kv_stride);
+        return;
+    }
+    float layer_scale = alibi.sizes().size() > 1 ? std::max(1, layer_id) : 1.0;
+    launch_flash_attention<T>(output,
+                              query_cont,
+                              prev_key_cont,
+                              prev_value_cont,
+                              kv_stride,
+                              (attn_mask.sizes().size() > 1 ? (T*)attn_mask.data_ptr() : nullptr),
+                              get_attn_mask_stride(attn_mask),
+                              (alibi.sizes().size() > 1 ? (T*)alibi.data_ptr() : nullptr),
+                              layer_scale,
+                              norm_factor * norm_factor / layer_scale,
+                              triangular,
+                              local_attention,
+                              window_size,
+                              bsz,
+                              heads,
+                              kv_heads,
+                              seq_len,
+                              soft_len,
+                              k,
+                              InferenceContext::Instance().GetCurrentStream());
+}
+
+// Attention of one new token per sequence over the contiguous cache, split over the cached
+// positions so a small batch still fills the GPU. Heads too large for the kernel go through the
+// unfused path.
+template <typename T>
+void attention_decode(T* prev_key_cont,
+                      T* query_cont,
+                      at::Tensor& attn_mask,
+                      T* prev_value_cont,
+                      T* output,
+                      unsigned& bsz,
+                      int& k,
+                      unsigned& seq_len,
+                      unsigned& soft_len,
+                      int& heads,
+                      int kv_heads,
+                      float& norm_factor,
+                      bool local_attention,
+                      int window_size,
+                      at::Tensor& alibi,
+                      int layer_id,
+                      unsigned kv_stride,
+                      const int* positions)
+{
+    if (k > DECODE_ATTN_MAX_HEAD_SIZE) {
+        TORCH_CHECK(!positions,
+                    "Device positions need a head size of at most ",
+                    DECODE_ATTN_MAX_HEAD_SIZE);
+        attention_unfused<T>(prev_key_cont,
+                             query_cont,
+                             attn_mask,
+                             prev_value_cont,
+                             output,
+                             bsz,
+                             k,
+                             seq_len,
+                             soft_len,
+                             heads,
+                             kv_heads,
+                             norm_factor,
+                             false,
+                             false,
+                             local_attention,
+                             window_size,
+                             alibi,
+                             layer_id,
+                             kv_stride);
+        return;
+    }
+    float layer_scale = alibi.sizes().size() > 1 ? std::max(1, layer_id) : 1.0;
+    // With device positions soft_len only bounds them and the mask and alibi rows are as wide as
+    // the buffers the graph was captured with.
+    int score_stride = soft_len;
+    if (positions && attn_mask.sizes().size() > 1)
+        score_stride = attn_mask.size(-1);
+    else if (positions && alibi.sizes().size() > 1)
+        score_stride = alibi.size(-1);
+    launch_decode_attention<T>(output,
+                               query_cont,
+                               prev_key_cont,
+                               prev_value_cont,
+                               kv_stride,
+                               (attn_mask.sizes().size() > 1 ? (T*)attn_mask.data_ptr() : nullptr),
+                               get_attn_mask_stride(attn_mask),
+                               (alibi.sizes().size() > 1 ? (T*)alibi.data_ptr() : nullptr),
+                               score_stride,
+                               layer_scale,
+                               norm_factor * norm_factor / layer_scale,
+                               local_attention,
+                               window_size,
+                               bsz,
+                               heads,
+                               kv_heads,
+                               positions,
+                               soft_len,
+                               k,
+                               InferenceContext::Instance().GetDecodeAttentionWorkspace(),
+                               InferenceContext::Instance().GetCurrentStream());
+}
+
 void reset_cache() { InferenceContext::Instance().reset_tokens(); }
 
+/*
+Rotary angles of the current context for the QKV transform. Shapes the transform cannot rotate
+itself are rotated by launch_apply_rotary_pos_emb, which only knows the default base.
+*/
+template <typename T>
+RotaryTable transform_rotary_table(int rotary_dim, bool rotate_half, bool rotate_every_two)
+{
+    InferenceContext& context = InferenceContext::Instance();
+    RotaryTable rope;
+    rope.theta = context.rope_theta();
+    rope.scale = context.rope_scale();
+    if (rotary_dim <= 0 || !(rotate_half || rotate_every_two)) return rope;
+    TORCH_CHECK(transform_fuses_rotary<T>(rotary_dim, rotate_half) ||
+                    (rope.theta == 10000.f && rope.scale == 1.f),
+                "A rotary base or scaling needs the rotary dims to split into halves of ",
+                2 * 16 / sizeof(T),
+                " values, got ",
+                rotary_dim);
+    rope.cos_sin = context.GetRotaryTable(rotary_dim);
+    rope.positions = context.rotary_table_positions();
+    return rope;
+}
+
+/*
+Attention over the block paged KV cache. The K/V of the new tokens are produced into a one layer
+scratch at the start of the cache part of the workspace, then scattered into the pages of their
+sequences. A uniform prompt attends over the scratch, everything else reads the pages directly.
+
+Without a ragged batch description the batch slot is the sequence id: a prompt frees and
+reserves the pages of its slots, a decode step grows them by one token. With one (see
+InferenceContext::SetRaggedBatch) every slot has its own sequence, start position and number of
+new tokens, the causal masking follows from the positions and attn_mask is not used.
+*/
+template <typename T>
+std::vector<at::Tensor> ds_softmax_context_paged(at::Tensor& query_key_value,
+                                                 at::Tensor& attn_mask,
+                                                 int rotary_dim,
+                                                 bool rotate_half,
+                                                 bool rotate_every_two,
+                                                 int heads,
+                                                 int num_kv_heads,
+                                                 float norm_factor,
+                                                 bool triangular,
+                                                 bool local_attention,
+                                                 int window_size,
+                                                 unsigned layer_id,
+                                                 unsigned num_layers,
+                                                 at::Tensor& alibi)
+{
+    unsigned bsz = query_key_value.size(0);
+    unsigned seq_len = query_key_value.size(1);
+    int k = query_key_value.size(2) / (heads + 2 * num_kv_heads);
+    unsigned hidden_dim = heads * k;
+    unsigned kv_dim = num_kv_heads * k;
+
+    TORCH_CHECK(k <= DECODE_ATTN_MAX_HEAD_SIZE,
+                "Paged KV cache supports head sizes up to ",
+                DECODE_ATTN_MAX_HEAD_SIZE,
+                ", got ",
+                k);
+    auto options = at::TensorOptions()
+                       .dtype(query_key_value.options().dtype())
+                       .layout(at::kStrided)
+                       .device(at::kCUDA)
+                       .requires_grad(false);
+
+    InferenceContext& context = InferenceContext::Instance();
+    PagedKVCache& kv_cache = context.GetPagedKVCache();
+    cudaStream_t stream = context.GetCurrentStream();
+
+    const bool ragged = context.ragged_batch();
+    const bool append = context.append_tokens();
+    bool is_prompt = (seq_len > 1) && !append;
+    std::vector<int> seqs(bsz);
+    std::vector<int> new_tokens(bsz, seq_len);
+    if (ragged) {
+        seqs = context.batch_sequences();
+        new_tokens = context.batch_new_tokens();
+        TORCH_CHECK(seqs.size() == bsz,
+                    "Ragged batch describes ",
+                    seqs.size(),
+                    " sequences, the input has ",
+                    bsz);
+        for (unsigned b = 0; b < bsz; b++)
+            TORCH_CHECK(new_tokens[b] >= 0 && new_tokens[b] <= (int)seq_len,
+                        "Sequence ",
+                        seqs[b],
+                        " brings ",
+                        new_tokens[b],
+                        " tokens, the input is ",
+                        seq_len,
+                        " long");
+    } else {
+        if (is_prompt) context.reset_tokens(seq_len);
+        for (unsigned b = 0; b < bsz; b++) seqs[b] = b;
+    }
+
+    unsigned soft_len = 0;
+    if (layer_id == 0) {
+        for (unsigned b = 0; b < bsz; b++) {
+            if (!ragged && is_prompt) kv_cache.Free(b);
+            kv_cache.CopyOnWrite(seqs[b], stream);
+            kv_cache.Reserve(seqs[b], kv_cache.length(seqs[b]) + new_tokens[b]);
+        }
+        kv_cache.UploadBatch(seqs, new_tokens, stream);
+    }
+    for (unsigned b = 0; b < bsz; b++)
+        soft_len = std::max(soft_len, (unsigned)(kv_cache.length(seqs[b]) + new_tokens[b]));
+    // Uniform batches keep the original token counting, the positions are the same for all.
+    unsigned start_pos = is_prompt ? 0 : soft_len - seq_len;
+
+    void* pool = kv_cache.pool();
+    // Set for the int8 cache, the kernels quantize on append and dequantize on read.
+    float* kv_scales = kv_cache.scales();
+    const int* block_table = kv_cache.device_block_tables();
+    const int* start_positions = kv_cache.device_start_positions();
+    const int* new_token_counts = kv_cache.device_new_tokens();
+    int table_width = kv_cache.table_width();
+    int block_tokens = kv_cache.block_tokens();
+
+    T* workspace = (T*)context.GetWorkSpace();
+    size_t buf_size = bsz * seq_len * hidden_dim;
+    auto output = torch::from_blob(workspace + 3 * buf_size, {bsz, seq_len, hidden_dim}, options);
+
+    auto query_cont = workspace + 4 * buf_size;
+    T* key_scratch = workspace + 10 * (hidden_dim * bsz * context.GetMaxTokenLenght());
+    T* value_scratch = key_scratch + bsz * seq_len * kv_dim;
+
+    T* temp_buf = (T*)output.data_ptr() + at::numel(output);
+    RotaryTable rope = transform_rotary_table<T>(rotary_dim, rotate_half, rotate_every_two);
+    launch_bias_add_transform_0213<T>((T*)query_cont,
+                                      key_scratch,
+                                      value_scratch,
+                                      (T*)query_key_value.data_ptr(),
+                                      nullptr,
+                                      bsz,
+                                      seq_len,
+                                      start_pos,
+                                      soft_len,
+                                      hidden_dim,
+                                      heads,
+                                      rotary_dim,
+                                      rotate_half,
+                                      rotate_every_two,
+                                      stream,
+                                      3,
+                                      seq_len,
+                                      (ragged ? start_positions : nullptr),
+                                      num_kv_heads,
+                                      nullptr,
+                                      rope);
+    if (rotary_dim > 0 && !transform_fuses_rotary<T>(rotary_dim, rotate_half))
+        launch_apply_rotary_pos_emb(query_cont,
+                                    key_scratch,
+                                    k,
+                                    seq_len,
+                                    rotary_dim,
+                                    start_pos,
+                                    heads,
+                                    bsz,
+                                    rotate_half,
+                                    rotate_every_two,
+                                    stream,
+                                    seq_len,
+                                    (ragged ? start_positions : nullptr),
+                                    num_kv_heads);
+    launch_paged_kv_append<T>(pool,
+                              kv_scales,
+                              block_table,
+                              table_width,
+                              start_positions,
+                              new_token_counts,
+                              key_scratch,
+                              value_scratch,
+                              layer_id,
+                              num_layers,
+                              num_kv_heads,
+                              k,
+                              block_tokens,
+                              bsz,
+                              seq_len,
+                              stream);
+
+    if (!ragged && is_prompt) {
+        attention_prefill<T>(key_scratch,
+                             (T*)query_cont,
+                             attn_mask,
+                             value_scratch,
+                             temp_buf,
+                             bsz,
+                             k,
+                             seq_len,
+                             soft_len,
+                             heads,
+                             num_kv_heads,
+                             norm_factor,
+                             triangular,
+                             local_attention,
+                             window_size,
+                             alibi,
+                             layer_id,
+                             seq_len);
+    } else {
+        const bool has_alibi = alibi.sizes().size() > 1;
+        const bool has_mask = !ragged && attn_mask.sizes().size() > 1;
+        float layer_scale = has_alibi ? std::max(1, (int)layer_id) : 1.0;
+        launch_paged_attention<T>(temp_buf,
+                                  (T*)query_cont,
+                                  pool,
+                                  kv_scales,
+                                  block_table,
+                                  table_width,
+                                  start_positions,
+                                  new_token_counts,
+                                  (has_mask ? (T*)attn_mask.data_ptr() : nullptr),
+                                  (has_mask ? get_attn_mask_stride(attn_mask) : 1),
+                                  (has_alibi ? (T*)alibi.data_ptr() : nullptr),
+                                  (ragged && has_alibi ? alibi.size(-1) : soft_len),
+                                  layer_scale,
+                                  norm_factor * norm_factor / layer_scale,
+                                  local_attention,
+                                  window_size,
+                                  layer_id,
+                                  num_layers,
+                                  heads,
+                                  num_kv_heads,
+                                  k,
+                                  block_tokens,
+                                  bsz,
+                                  seq_len,
+                                  soft_len,
+                                  context.GetDecodeAttentionWorkspace(),
+                                  stream);
+    }
+    launch_transform4d_0213<T>((T*)output.data_ptr(),
+                               temp_buf,
+                               bsz,
+                               heads,
+                               seq_len,
+                               output.size(2),
+                               context.GetCurrentStream(false),
+                               1);
+
+    if (layer_id == num_layers - 1) {
+        for (unsigned b = 0; b < bsz; b++) kv_cache.Advance(seqs[b], new_tokens[b]);
+        if (ragged)
+            context.ClearRaggedBatch();
+        else
+            context.advance_tokens(is_prompt ? 1 : seq_len);
+        context.ClearAppendTokens();
+    }
+
+    // The cache is not contiguous per sequence, the returned presents only carry its shape.
+    auto prev_key =
+        torch::from_blob(key_scratch, {bsz, num_kv_heads, soft_len, k}, {0, 0, 0, 0}, options);
+    auto prev_value =
+        torch::from_blob(value_scratch, {bsz, num_kv_heads, soft_len, k}, {0, 0, 0, 0}, options);
+
+    return {output, prev_key, prev_value};
+}
+
 template <typename T>
 std::vector<at::Tensor> ds_softmax_context(at::Tensor& query_key_value,
                                            at::Tensor& attn_mask,
@@ -435,6 +857,7 @@ std::vector<at::Tensor> ds_softmax_context(at::Tensor& query_key_value,
                                            bool rotate_half,
                                            bool rotate_every_two,
                                            int heads,
+                                           int num_kv_heads,
                                            float norm_factor,
                                            bool triangular,
                                            bool local_attention,
@@ -444,16 +867,49 @@ std::vector<at::Tensor> ds_softmax_context(at::Tensor& query_key_value,
                                            unsigned num_layers,
                                            at::Tensor& alibi)
 {
+    TORCH_CHECK(num_kv_heads > 0 && heads % num_kv_heads == 0,
+                "Query heads (",
+                heads,
+                ") must be a multiple of the KV heads (",
+                num_kv_heads,
+                ")");
+    if (InferenceContext::Instance().paged_kv())
+        return ds_softmax_context_paged<T>(query_key_value,
+                                           attn_mask,
+                                           rotary_dim,
+                                           rotate_half,
+                                           rotate_every_two,
+                                           heads,
+                                           num_kv_heads,
+                                           norm_factor,
+                                           triangular,
+                                           local_attention,
+                                           window_size,
+                                           layer_id,
+                                           num_layers,
+                                           alibi);
+
     unsigned bsz = query_key_value.size(0);
     unsigned seq_len = query_key_value.size(1);
-    unsigned hidden_dim = query_key_value.size(2) / 3;
+    // Q of all heads, then K and V of the num_kv_heads heads.
+    int k = query_key_value.size(2) / (heads + 2 * num_kv_heads);
+    unsigned hidden_dim = heads * k;
+    unsigned kv_dim = num_kv_heads * k;
 
-    bool is_prompt = (seq_len > 1);
+    // Without a prompt the seq_len new tokens follow the cached ones, one for a decode step and
+    // more to verify draft tokens (see InferenceContext::SetAppendTokens).
+    const bool append = InferenceContext::Instance().append_tokens();
+    bool is_prompt = (seq_len > 1) && !append;
 
     if (is_prompt) InferenceContext::Instance().reset_tokens(seq_len);
-    unsigned soft_len = InferenceContext::Instance().current_tokens();
+    unsigned soft_len =
+        InferenceContext::Instance().current_tokens() + (is_prompt ? 0 : seq_len - 1);
+    unsigned start_pos = is_prompt ? 0 : soft_len - seq_len;
+    // A decode step with device positions places and masks its token by them, nothing of the
+    // step depends on soft_len (see InferenceContext::SetDevicePositions).
+    int* positions = InferenceContext::Instance().GetDevicePositions();
+    const bool device_positions = InferenceContext::Instance().device_positions() && seq_len == 1;
 
-    int k = hidden_dim / heads;
     auto options = at::TensorOptions()
                        .dtype(query_key_value.options().dtype())
                        .layout(at::kStrided)
@@ -467,12 +923,19 @@ std::vector<at::Tensor> ds_softmax_context(at::Tensor& query_key_value,
     auto query_cont = workspace + 4 * buf_size;
     size_t offset =
         10 * (hidden_dim * bsz * InferenceContext::Instance().GetMaxTokenLenght()) +
-        layer_id * 2 * bsz * InferenceContext::Instance().GetMaxTokenLenght() * hidden_dim;
+        layer_id * 2 * bsz * InferenceContext::Instance().GetMaxTokenLenght() * kv_dim;
     unsigned all_tokens = soft_len;
-    auto kv_cache = workspace + offset + (hidden_dim / heads) * (is_prompt ? 0 : soft_len - 1);
-    size_t value_offset = bsz * InferenceContext::Instance().GetMaxTokenLenght() * hidden_dim;
+    TORCH_CHECK(soft_len <= InferenceContext::Instance().GetMaxTokenLenght(),
+                "KV cache holds at most ",
+                InferenceContext::Instance().GetMaxTokenLenght(),
+                " tokens, ",
+                soft_len,
+                " requested");
+    auto kv_cache = workspace + offset + k * (device_positions ? 0 : start_pos);
+    size_t value_offset = bsz * InferenceContext::Instance().GetMaxTokenLenght() * kv_dim;
 
     T* temp_buf = (T*)output.data_ptr() + at::numel(output);
+    RotaryTable rope = transform_rotary_table<T>(rotary_dim, rotate_half, rotate_every_two);
     launch_bias_add_transform_0213<T>((T*)query_cont,
                                       kv_cache,
                                       kv_cache + value_offset,
@@ -480,7 +943,7 @@ std::vector<at::Tensor> ds_softmax_context(at::Tensor& query_key_value,
                                       nullptr,
                                       bsz,
                                       seq_len,
-                                      (is_prompt ? 0 : soft_len - 1),
+                                      start_pos,
                                       soft_len,
                                       hidden_dim,
                                       heads,
@@ -489,38 +952,69 @@ std::vector<at::Tensor> ds_softmax_context(at::Tensor& query_key_value,
                                       rotate_every_two,
                                       InferenceContext::Instance().GetCurrentStream(),
                                       3,
-                                      InferenceContext::Instance().GetMaxTokenLenght());
-    if (rotary_dim > 0 && rotate_half)
+                                      InferenceContext::Instance().GetMaxTokenLenght(),
+                                      (device_positions ? positions : nullptr),
+                                      num_kv_heads,
+                                      (device_positions ? positions : nullptr),
+                                      rope);
+    if (rotary_dim > 0 && !transform_fuses_rotary<T>(rotary_dim, rotate_half))
         launch_apply_rotary_pos_emb(query_cont,
                                     kv_cache,
                                     k,
                                     seq_len,
                                     rotary_dim,
-                                    (is_prompt ? 0 : soft_len - 1),
+                                    start_pos,
                                     heads,
                                     bsz,
                                     rotate_half,
                                     rotate_every_two,
                                     InferenceContext::Instance().GetCurrentStream(),
-                                    InferenceContext::Instance().GetMaxTokenLenght());
-
-    attention_unfused<T>(workspace + offset,
-                         (T*)query_cont,
-                         attn_mask,
-                         workspace + offset + value_offset,
-                         temp_buf,
-                         bsz,
-                         k,
-                         seq_len,
-                         all_tokens,
-                         heads,
-                         norm_factor,
-                         (triangular && is_prompt),
-                         is_prompt,
-                         local_attention,
-                         window_size,
-                         alibi,
-                         layer_id);
+                                    InferenceContext::Instance().GetMaxTokenLenght(),
+                                    (device_positions ? positions : nullptr),
+                                    num_kv_heads,
+                                    (device_positions ? positions : nullptr));
+
+    if (seq_len > 1) {
+        attention_prefill<T>(workspace + offset,
+                             (T*)query_cont,
+                             attn_mask,
+                             workspace + offset + value_offset,
+                             temp_buf,
+                             bsz,
+                             k,
+                             seq_len,
+                             all_tokens,
+                             heads,
+                             num_kv_heads,
+                             norm_factor,
+                             triangular,
+                             local_attention,
+                             window_size,
+                             alibi,
+                             layer_id,
+                             InferenceContext::Instance().GetMaxTokenLenght());
+    } else {
+        unsigned visible_tokens =
+            device_positions ? InferenceContext::Instance().GetMaxTokenLenght() : all_tokens;
+        attention_decode<T>(workspace + offset,
+                            (T*)query_cont,
+                            attn_mask,
+                            workspace + offset + value_offset,
+                            temp_buf,
+                            bsz,
+                            k,
+                            seq_len,
+                            visible_tokens,
+                            heads,
+                            num_kv_heads,
+                            norm_factor,
+                            local_attention,
+                            window_size,
+                            alibi,
+                            layer_id,
+                            InferenceContext::Instance().GetMaxTokenLenght(),
+                            (device_positions ? positions : nullptr));
+    }
     launch_transform4d_0213<T>((T*)output.data_ptr(),
                                temp_buf,
                                bsz,
@@ -530,10 +1024,20 @@ std::vector<at::Tensor> ds_softmax_context(at::Tensor& query_key_value,
                                InferenceContext::Instance().GetCurrentStream(false),
                                1);
 
-    if (layer_id == num_layers - 1) InferenceContext::Instance().advance_tokens();
+    if (layer_id == num_layers - 1) {
+        InferenceContext::Instance().advance_tokens(is_prompt ? 1 : seq_len);
+        InferenceContext::Instance().ClearAppendTokens();
+        // A prompt sets the positions to its length, everything else moves them on.
+        if (InferenceContext::Instance().device_positions())
+            launch_update_positions(positions,
+                                    seq_len,
+                                    !is_prompt,
+                                    bsz,
+                                    InferenceContext::Instance().GetCurrentStream());
+    }
     auto prev_key = torch::from_blob(workspace + offset,
-                                     {bsz, heads, all_tokens, k},
-                                     {hidden_dim * InferenceContext::Instance().GetMaxTokenLenght(),
+                                     {bsz, num_kv_heads, all_tokens, k},
+                                     {kv_dim * InferenceContext::Instance().GetMaxTokenLenght(),
                                       k * InferenceContext::Instance().GetMaxTokenLenght(),
                                       k,
                                       1},
@@ -541,8 +1045,8 @@ std::vector<at::Tensor> ds_softmax_context(at::Tensor& query_key_value,
 
     auto prev_value =
         torch::from_blob(workspace + offset + value_offset,
-                         {bsz, heads, all_tokens, k},
-                         {hidden_dim * InferenceContext::Instance().GetMaxTokenLenght(),
+                         {bsz, num_kv_heads, all_tokens, k},
+                         {kv_dim * InferenceContext::Instance().GetMaxTokenLenght(),
                           k * InferenceContext::Instance().GetMaxTokenLenght(),
                           k,
                           1},
@@ -602,6 +1106,42 @@ at::Tensor ds_bias_geglu(at::Tensor& activation, at::Tensor& bias)
     return output;
 }
 
+at::Tensor ds_bias_swiglu(at::Tensor& activation, at::Tensor& bias)
+{
+    /*
+    SwiGLU of the fused gate/up projection of LLaMA style MLPs, the second half of the channels
+    is the gate. An empty bias means there is none.
+    */
+
+    const int batch_size = activation.size(0);
+    const int seq_len = activation.size(1);
+    const int channels = activation.size(2);
+
+    const int rows = batch_size * seq_len;
+    const int out_channels = channels / 2;
+
+    auto output = at::empty({batch_size, seq_len, out_channels}, activation.options());
+    const bool has_bias = bias.numel() > 0;
+
+    if (activation.options().dtype() == torch::kFloat32) {
+        launch_fused_bias_swiglu((float*)output.data_ptr(),
+                                 (const float*)activation.data_ptr(),
+                                 has_bias ? (const float*)bias.data_ptr() : nullptr,
+                                 rows,
+                                 channels,
+                                 InferenceContext::Instance().GetCurrentStream());
+    } else {
+        launch_fused_bias_swiglu((__half*)output.data_ptr(),
+                                 (const __half*)activation.data_ptr(),
+                                 has_bias ? (const __half*)bias.data_ptr() : nullptr,
+                                 rows,
+                                 channels,
+                                 InferenceContext::Instance().GetCurrentStream());
+    }
+
+    return output;
+}
+
 template <typename T>
 at::Tensor ds_bias_relu(at::Tensor& input, at::Tensor& bias)
 {
@@ -779,6 +1319,68 @@ std::vector<at::Tensor> ds_layer_norm_residual_store_pre_ln_res(at::Tensor& inpu
     return {norm_output, res_output};
 }
 
+at::Tensor ds_rms_norm(at::Tensor& input, at::Tensor& gamma, float epsilon)
+{
+    const int rows = input.size(0) * input.size(1);
+    const int elems_per_row = input.size(2);
+    auto output = at::empty_like(input);
+
+    if (input.options().dtype() == torch::kFloat16) {
+        launch_rms_norm((__half*)output.data_ptr(),
+                        (const __half*)input.data_ptr(),
+                        (const __half*)gamma.data_ptr(),
+                        epsilon,
+                        rows,
+                        elems_per_row,
+                        InferenceContext::Instance().GetCurrentStream());
+    } else {
+        launch_rms_norm((float*)output.data_ptr(),
+                        (const float*)input.data_ptr(),
+                        (const float*)gamma.data_ptr(),
+                        epsilon,
+                        rows,
+                        elems_per_row,
+                        InferenceContext::Instance().GetCurrentStream());
+    }
+
+    return output;
+}
+
+std::vector<at::Tensor> ds_pre_rms_norm(at::Tensor& input,
+                                        at::Tensor& residual,
+                                        at::Tensor& gamma,
+                                        float epsilon)
+{
+    const int rows = input.size(0) * input.size(1);
+    const int elems_per_row = input.size(2);
+    auto norm_output = at::empty_like(input);
+    auto res_output = at::empty_like(input);
+
+    if (input.options().dtype() == torch::kFloat16) {
+        launch_pre_rms_norm((__half*)norm_output.data_ptr(),
+                            (__half*)res_output.data_ptr(),
+                            (const __half*)input.data_ptr(),
+                            (const __half*)residual.data_ptr(),
+                            (const __half*)gamma.data_ptr(),
+                            epsilon,
+                            rows,
+                            elems_per_row,
+                            InferenceContext::Instance().GetCurrentStream());
+    } else {
+        launch_pre_rms_norm((float*)norm_output.data_ptr(),
+                            (float*)res_output.data_ptr(),
+                            (const float*)input.data_ptr(),
+                            (const float*)residual.data_ptr(),
+                            (const float*)gamma.data_ptr(),
+                            epsilon,
+                            rows,
+                            elems_per_row,
+                            InferenceContext::Instance().GetCurrentStream());
+    }
+
+    return {norm_output, res_output};
+}
+
 template <typename T>
 void quantized_gemm(void* output,
                     T* input,
@@ -788,6 +1390,24 @@ void quantized_gemm(void* output,
                     int bsz,
                     int hidden_size)
 {
+    // Decode sized inputs read the int8 weight once instead of dequantizing all of it first,
+    // every weight.size(0) / groups output channels share a scale.
+    if (bsz <= WEIGHT_ONLY_GEMV_MAX_ROWS && weight.size(0) % groups == 0 &&
+        weight.size(1) % 8 == 0) {
+        launch_weight_only_gemm((T*)output,
+                                (const T*)input,
+                                (const uint8_t*)weight.data_ptr(),
+                                (const float*)qscale.data_ptr(),
+                                nullptr,
+                                bsz,
+                                weight.size(0),
+                                weight.size(1),
+                                8,
+                                weight.size(1),
+                                weight.size(0) / groups,
+                                InferenceContext::Instance().GetCurrentStream());
+        return;
+    }
     // T* weight16 = (T*)InferenceContext::Instance().GetWorkSpace() + 12 * hidden_size * bsz;
 
     auto options = at::TensorOptions()
@@ -841,12 +1461,29 @@ at::Tensor qkv_unfused_cublas(at::Tensor& output,
     int bsz = input.size(0) * input.size(1);
     T* workspace = (T*)InferenceContext::Instance().GetWorkSpace();
     workspace += (3 * bsz * input.size(2));
-    ds_layer_norm_internal<T>(workspace, input, gamma, beta, epsilon);
 
-    if (q_int8) {
+    // Small batches normalize inside the GEMM, which still writes inp_norm for the caller.
+    if (!q_int8 && bsz <= LN_GEMV_MAX_ROWS) {
+        launch_fused_ln_gemv((T*)output.data_ptr(),
+                             workspace,
+                             (const T*)input.data_ptr(),
+                             (const T*)nullptr,
+                             (const T*)nullptr,
+                             (const T*)gamma.data_ptr(),
+                             (const T*)beta.data_ptr(),
+                             epsilon,
+                             (const T*)weight.data_ptr(),
+                             transposed_mode,
+                             bsz,
+                             input.size(2),
+                             weight.size(transposed_mode ? 0 : 1),
+                             InferenceContext::Instance().GetCurrentStream());
+    } else if (q_int8) {
+        ds_layer_norm_internal<T>(workspace, input, gamma, beta, epsilon);
         quantized_gemm<T>(
             output.data_ptr(), workspace, weight, q_scale, q_scale.size(0), bsz, input.size(2));
     } else {
+        ds_layer_norm_internal<T>(workspace, input, gamma, beta, epsilon);
         float alpha = (T)1.0;
         float gemm_beta = (T)0.0;
 
@@ -1233,6 +1870,66 @@ at::Tensor ds_linear_layer_int8(at::Tensor& input,
     return output;
 }
 
+/*
+Linear layer over a weight only quantized weight [out_features, in_features * bits / 8], int8 or
+two int4 per byte, with fp32 scales, and optionally zero points, per group_size input features of
+every output channel (see weight_only_gemm.cu). zeros has a single element when not used.
+*/
+template <typename T>
+at::Tensor ds_weight_only_linear(at::Tensor& input,
+                                 at::Tensor& weight,
+                                 at::Tensor& scales,
+                                 at::Tensor& zeros,
+                                 at::Tensor& bias,
+                                 bool add_bias,
+                                 int bits,
+                                 int group_size)
+{
+    auto input_cont = input.contiguous();
+    const int in_features = input_cont.size(-1);
+    const int out_features = weight.size(0);
+    TORCH_CHECK(bits == 4 || bits == 8, "Weight only GEMM supports 4 and 8 bits, got ", bits);
+    TORCH_CHECK(weight.size(1) * 8 / bits == in_features,
+                "Quantized weight holds ",
+                weight.size(1) * 8 / bits,
+                " input features, the input has ",
+                in_features);
+    TORCH_CHECK(in_features % 8 == 0 && group_size % 8 == 0 && in_features % group_size == 0,
+                "Weight only GEMM needs groups of a multiple of 8 input features");
+    TORCH_CHECK(scales.numel() == (int64_t)out_features * (in_features / group_size),
+                "Weight only GEMM expects one scale per group and output channel");
+    auto options = at::TensorOptions()
+                       .dtype(input_cont.options().dtype())
+                       .layout(at::kStrided)
+                       .device(at::kCUDA)
+                       .requires_grad(false);
+    int bsz = input_cont.numel() / in_features;
+
+    auto output_sizes = input_cont.sizes().vec();
+    output_sizes.back() = out_features;
+    auto output = at::empty(output_sizes, options);
+
+    launch_weight_only_gemm((T*)output.data_ptr(),
+                            (const T*)input_cont.data_ptr(),
+                            (const uint8_t*)weight.data_ptr(),
+                            (const float*)scales.data_ptr(),
+                            (zeros.numel() > 1 ? (const float*)zeros.data_ptr() : nullptr),
+                            bsz,
+                            out_features,
+                            in_features,
+                            bits,
+                            group_size,
+                            1,
+                            InferenceContext::Instance().GetCurrentStream());
+    if (add_bias)
+        launch_bias_add((T*)output.data_ptr(),
+                        (T*)bias.data_ptr(),
+                        out_features,
+                        bsz,
+                        InferenceContext::Instance().GetCurrentStream());
+    return output;
+}
+
 template <typename T>
 at::Tensor ds_vector_matmul(at::Tensor& input,
                             at::Tensor& weight,
@@ -1284,6 +1981,64 @@ at::Tensor ds_vector_matmul(at::Tensor& input,
     return output;
 }
 
+/*
+ds_vector_matmul restricted to the rows [row_begin, row_end) of the flattened input, written in
+place of the same rows of the full output in the workspace. Running the GEMM chunk by chunk lets
+the tensor parallel all-reduce of a finished chunk overlap the GEMM of the next one; every call
+returns the full output, which is complete once the last chunk is done.
+*/
+template <typename T>
+at::Tensor ds_vector_matmul_rows(at::Tensor& input,
+                                 at::Tensor& weight,
+                                 int row_begin,
+                                 int row_end,
+                                 at::Tensor& q_scale,
+                                 bool q_int8,
+                                 bool transposed_mode)
+{
+    auto options = at::TensorOptions()
+                       .dtype(input.options().dtype())
+                       .layout(at::kStrided)
+                       .device(at::kCUDA)
+                       .requires_grad(false);
+    int out_size = q_int8 ? weight.size(0) : weight.size(1);
+    int in_size = input.size(2);
+    int rows = row_end - row_begin;
+    TORCH_CHECK(row_begin >= 0 && rows > 0 && row_end <= input.size(0) * input.size(1),
+                "vector_matmul_rows: invalid row range");
+
+    T* workspace = (T*)InferenceContext::Instance().GetWorkSpace();
+    auto output = at::from_blob(workspace, {input.size(0), input.size(1), out_size}, options);
+    T* chunk_input = (T*)input.data_ptr() + (size_t)row_begin * in_size;
+    T* chunk_output = workspace + (size_t)row_begin * out_size;
+    if (q_int8) {
+        quantized_gemm<T>(
+            chunk_output, chunk_input, weight, q_scale, q_scale.size(0), rows, in_size);
+    } else {
+        float alpha = (T)1.0;
+        float gemm_beta = (T)0.0;
+        cublasSetStream(InferenceContext::Instance().GetCublasHandle(),
+                        InferenceContext::Instance().GetCurrentStream());
+        cublas_gemm_ex(InferenceContext::Instance().GetCublasHandle(),
+                       (transposed_mode ? CUBLAS_OP_T : CUBLAS_OP_N),
+                       CUBLAS_OP_N,
+                       weight.size(transposed_mode ? 0 : 1),
+                       rows,
+                       in_size,
+                       &alpha,
+                       &gemm_beta,
+                       (T*)weight.data_ptr(),
+                       chunk_input,
+                       chunk_output,
+#ifdef __HIP_PLATFORM_HCC__
+                       rocblas_gemm_algo_standard);
+#else
+                       CUBLAS_GEMM_DEFAULT_TENSOR_OP);
+#endif
+    }
+    return output;
+}
+
 template <typename T>
 at::Tensor ds_vector_matmul_int8(at::Tensor& input,
                                  at::Tensor& weight,
@@ -1328,7 +2083,23 @@ at::Tensor mlp_unfused_cublas(at::Tensor& output,
                   torch::numel(output);
     T* intermediate = inp_norm + torch::numel(input);
 
-    if (mlp_after_attn) {
+    const bool fused_ln = !q_int8 && bsz <= LN_GEMV_MAX_ROWS;
+    if (fused_ln) {
+        launch_fused_ln_gemv(intermediate,
+                             inp_norm,
+                             (const T*)input.data_ptr(),
+                             (mlp_after_attn ? (const T*)residual.data_ptr() : nullptr),
+                             (mlp_after_attn ? (const T*)input_bias.data_ptr() : nullptr),
+                             (const T*)gamma.data_ptr(),
+                             (const T*)beta.data_ptr(),
+                             epsilon,
+                             (const T*)weight.data_ptr(),
+                             transposed_mode,
+                             bsz,
+                             input.size(2),
+                             weight.size(transposed_mode ? 0 : 1),
+                             InferenceContext::Instance().GetCurrentStream());
+    } else if (mlp_after_attn) {
         launch_fused_residual_ln((T*)inp_norm,
                                  (const T*)input.data_ptr(),
                                  (const T*)residual.data_ptr(),
@@ -1345,7 +2116,7 @@ at::Tensor mlp_unfused_cublas(at::Tensor& output,
     if (q_int8) {
         quantized_gemm<T>(
             intermediate, inp_norm, weight, q_scale, q_scale.size(0), bsz, input.size(2));
-    } else {
+    } else if (!fused_ln) {
         float alpha = (T)1.0;
         float gemm_beta = (T)0.0;
         cublasSetStream(InferenceContext::Instance().GetCublasHandle(),
@@ -1504,6 +2275,279 @@ std::vector<at::Tensor> ds_mlp_gemm_int8(at::Tensor& input,
     return {output, residual_add};
 }
 
+#ifdef FP8_AVAILABLE
+/*
+fp8 GEMMs, with weights [out_features, in_features] in e4m3 (see fp8_quantize) and activations in
+e4m3 or, with e5m2 set, e5m2, each with a per tensor fp32 scale. Activations use delayed scaling:
+act_scale quantizes this call, the amax seen on the way is kept in act_amax and becomes the scale of
+the next call, all on the device.
+*/
+constexpr size_t fp8_gemm_workspace_size = 4 * MEGABYTE;
+
+template <typename T>
+void fp8_gemm(at::Tensor& output,
+              const void* input,
+              int bsz,
+              at::Tensor& weight,
+              at::Tensor& weight_scale,
+              const float* act_scale,
+              bool e5m2,
+              const T* bias)
+{
+    const int out_features = weight.size(0);
+    const int in_features = weight.size(1);
+    TORCH_CHECK(out_features % 16 == 0 && in_features % 16 == 0,
+                "fp8 GEMM needs in and out features that are multiples of 16");
+    auto gemm_workspace = at::empty({(int64_t)fp8_gemm_workspace_size},
+                                    weight.options().dtype(at::kByte));
+    int status = cublas_lt_fp8_gemm(InferenceContext::Instance().GetCublasLtHandle(),
+                                    out_features,
+                                    bsz,
+                                    in_features,
+                                    weight.data_ptr(),
+                                    CUDA_R_8F_E4M3,
+                                    input,
+                                    (e5m2 ? CUDA_R_8F_E5M2 : CUDA_R_8F_E4M3),
+                                    (__half*)output.data_ptr(),
+                                    (const float*)weight_scale.data_ptr(),
+                                    act_scale,
+                                    (const __half*)bias,
+                                    gemm_workspace.data_ptr(),
+                                    fp8_gemm_workspace_size,
+                                    InferenceContext::Instance().GetCurrentStream());
+    TORCH_CHECK(status == 0, "fp8 GEMM failed, it needs sm_89 or newer");
+}
+
+inline at::Tensor fp8_empty(const at::Tensor& like, int64_t elems)
+{
+    return at::empty({elems}, like.options().dtype(at::kByte));
+}
+
+inline at::Tensor gemm_output(const at::Tensor& input, int out_features)
+{
+    auto output_sizes = input.sizes().vec();
+    output_sizes.back() = out_features;
+    return at::empty(output_sizes, input.options());
+}
+
+template <typename T>
+at::Tensor ds_fp8_quantize(at::Tensor& input, at::Tensor& scale, at::Tensor& amax, bool e5m2)
+{
+    auto input_cont = input.contiguous();
+    auto output = at::empty(input_cont.sizes(), input_cont.options().dtype(at::kByte));
+    launch_fp8_quantize(output.data_ptr(),
+                        (float*)amax.data_ptr(),
+                        (const T*)input_cont.data_ptr(),
+                        (const float*)scale.data_ptr(),
+                        input_cont.numel(),
+                        e5m2,
+                        InferenceContext::Instance().GetCurrentStream());
+    return output;
+}
+
+template <typename T>
+at::Tensor linear_fp8(at::Tensor& input,
+                      at::Tensor& weight,
+                      at::Tensor& weight_scale,
+                      const T* bias,
+                      at::Tensor& act_scale,
+                      at::Tensor& act_amax,
+                      bool e5m2)
+{
+    auto input_cont = input.contiguous();
+    const int bsz = input_cont.numel() / input_cont.size(-1);
+    auto stream = InferenceContext::Instance().GetCurrentStream();
+
+    auto input_fp8 = fp8_empty(input_cont, input_cont.numel());
+    launch_fp8_quantize(input_fp8.data_ptr(),
+                        (float*)act_amax.data_ptr(),
+                        (const T*)input_cont.data_ptr(),
+                        (const float*)act_scale.data_ptr(),
+                        input_cont.numel(),
+                        e5m2,
+                        stream);
+    auto output = gemm_output(input_cont, weight.size(0));
+    fp8_gemm<T>(output,
+                input_fp8.data_ptr(),
+                bsz,
+                weight,
+                weight_scale,
+                (const float*)act_scale.data_ptr(),
+                e5m2,
+                bias);
+    launch_fp8_update_scale(
+        (float*)act_scale.data_ptr(), (float*)act_amax.data_ptr(), e5m2, stream);
+    return output;
+}
+
+template <typename T>
+at::Tensor ds_linear_layer_fp8(at::Tensor& input,
+                               at::Tensor& weight,
+                               at::Tensor& weight_scale,
+                               at::Tensor& bias,
+                               bool add_bias,
+                               at::Tensor& act_scale,
+                               at::Tensor& act_amax,
+                               bool e5m2)
+{
+    return linear_fp8<T>(input,
+                         weight,
+                         weight_scale,
+                         (add_bias ? (const T*)bias.data_ptr() : nullptr),
+                         act_scale,
+                         act_amax,
+                         e5m2);
+}
+
+template <typename T>
+at::Tensor ds_vector_matmul_fp8(at::Tensor& input,
+                                at::Tensor& weight,
+                                at::Tensor& weight_scale,
+                                at::Tensor& act_scale,
+                                at::Tensor& act_amax,
+                                bool e5m2)
+{
+    return linear_fp8<T>(input, weight, weight_scale, nullptr, act_scale, act_amax, e5m2);
+}
+
+// Layer norm straight into the fp8 input of the GEMM, inp_norm is returned as ds_qkv_gemm does.
+template <typename T>
+std::vector<at::Tensor> ds_qkv_gemm_fp8(at::Tensor& input,
+                                        at::Tensor& weight,
+                                        at::Tensor& weight_scale,
+                                        at::Tensor& bias,
+                                        at::Tensor& gamma,
+                                        at::Tensor& beta,
+                                        const float epsilon,
+                                        bool add_bias,
+                                        at::Tensor& act_scale,
+                                        at::Tensor& act_amax,
+                                        bool e5m2)
+{
+    auto input_cont = input.contiguous();
+    const int hidden = input_cont.size(-1);
+    const int bsz = input_cont.numel() / hidden;
+    auto stream = InferenceContext::Instance().GetCurrentStream();
+
+    auto inp_norm = at::empty_like(input_cont);
+    auto inp_norm_fp8 = fp8_empty(input_cont, input_cont.numel());
+    launch_fused_ln_fp8(inp_norm_fp8.data_ptr(),
+                        (T*)inp_norm.data_ptr(),
+                        (float*)act_amax.data_ptr(),
+                        (const T*)input_cont.data_ptr(),
+                        (const T*)nullptr,
+                        (const T*)nullptr,
+                        (const T*)gamma.data_ptr(),
+                        (const T*)beta.data_ptr(),
+                        epsilon,
+                        (const float*)act_scale.data_ptr(),
+                        bsz,
+                        hidden,
+                        e5m2,
+                        stream);
+    auto output = gemm_output(input_cont, weight.size(0));
+    fp8_gemm<T>(output,
+                inp_norm_fp8.data_ptr(),
+                bsz,
+                weight,
+                weight_scale,
+                (const float*)act_scale.data_ptr(),
+                e5m2,
+                (add_bias ? (const T*)bias.data_ptr() : nullptr));
+    launch_fp8_update_scale(
+        (float*)act_scale.data_ptr(), (float*)act_amax.data_ptr(), e5m2, stream);
+    return {output, inp_norm};
+}
+
+/*
+The MLP of ds_mlp_gemm in fp8: (residual) layer norm -> fp8 -> GEMM -> bias + activation -> fp8 ->
+GEMM. act_scale and act_amax hold two scalars, for the inputs of the first and second GEMM.
+*/
+template <typename T>
+std::vector<at::Tensor> ds_mlp_gemm_fp8(at::Tensor& input,
+                                        at::Tensor& residual,
+                                        at::Tensor& input_bias,
+                                        at::Tensor& weight_interm,
+                                        at::Tensor& weight_interm_scale,
+                                        at::Tensor& weight_out,
+                                        at::Tensor& weight_out_scale,
+                                        at::Tensor& bias,
+                                        at::Tensor& gamma,
+                                        at::Tensor& beta,
+                                        const float epsilon,
+                                        bool mlp_after_attn,
+                                        at::Tensor& act_scale,
+                                        at::Tensor& act_amax,
+                                        int activation_type,
+                                        bool e5m2)
+{
+    auto act_func_type = static_cast<ActivationFuncType>(activation_type);
+    TORCH_CHECK(act_func_type == ActivationFuncType::GELU ||
+                    act_func_type == ActivationFuncType::ReLU,
+                "fp8 MLP supports GELU and ReLU");
+    TORCH_CHECK(act_scale.numel() == 2 && act_amax.numel() == 2,
+                "fp8 MLP needs a scale and amax per GEMM input");
+    auto input_cont = input.contiguous();
+    const int hidden = input_cont.size(-1);
+    const int bsz = input_cont.numel() / hidden;
+    const int intermediate_size = weight_interm.size(0);
+    float* scales = (float*)act_scale.data_ptr();
+    float* amax = (float*)act_amax.data_ptr();
+    auto stream = InferenceContext::Instance().GetCurrentStream();
+
+    auto inp_norm = at::empty_like(input_cont);
+    auto inp_norm_fp8 = fp8_empty(input_cont, input_cont.numel());
+    launch_fused_ln_fp8(inp_norm_fp8.data_ptr(),
+                        (T*)inp_norm.data_ptr(),
+                        amax,
+                        (const T*)input_cont.data_ptr(),
+                        (mlp_after_attn ? (const T*)residual.data_ptr() : nullptr),
+                        (mlp_after_attn ? (const T*)input_bias.data_ptr() : nullptr),
+                        (const T*)gamma.data_ptr(),
+                        (const T*)beta.data_ptr(),
+                        epsilon,
+                        scales,
+                        bsz,
+                        hidden,
+                        e5m2,
+                        stream);
+    auto intermediate = gemm_output(input_cont, intermediate_size);
+    fp8_gemm<T>(intermediate,
+                inp_norm_fp8.data_ptr(),
+                bsz,
+                weight_interm,
+                weight_interm_scale,
+                scales,
+                e5m2,
+                (const T*)nullptr);
+
+    auto intermediate_fp8 = fp8_empty(input_cont, (int64_t)bsz * intermediate_size);
+    launch_bias_act_fp8(intermediate_fp8.data_ptr(),
+                        amax + 1,
+                        (const T*)intermediate.data_ptr(),
+                        (const T*)bias.data_ptr(),
+                        scales + 1,
+                        act_func_type == ActivationFuncType::ReLU,
+                        intermediate_size,
+                        bsz,
+                        e5m2,
+                        stream);
+    auto output = gemm_output(input_cont, weight_out.size(0));
+    fp8_gemm<T>(output,
+                intermediate_fp8.data_ptr(),
+                bsz,
+                weight_out,
+                weight_out_scale,
+                scales + 1,
+                e5m2,
+                (const T*)nullptr);
+
+    launch_fp8_update_scale(scales, amax, e5m2, stream);
+    launch_fp8_update_scale(scales + 1, amax + 1, e5m2, stream);
+    return {output, inp_norm};
+}
+#endif
+
 template <typename T>
 at::Tensor fused_gemm_gelu(at::Tensor& input,
                            at::Tensor& weight,
@@ -1738,89 +2782,547 @@ at::Tensor moe_res_matmul(at::Tensor& moe_res, at::Tensor& coef, at::Tensor& out
     return output;
 }
 
+/*
+All local experts of a MoE layer, gelu(x W1 + b1) W2 + b2 per expert, weighted by the gate and
+summed over the top_k experts of every token, without dropping tokens. gate_logits are the fp32
+[tokens, experts] logits of the gate. inter_w, inter_b, output_w and output_b are int64 device
+tensors with the address of every expert's parameter, so the expert weights stay where they are;
+the weights are [hidden, intermediate_size] and [intermediate_size, hidden] row major.
+*/
+template <typename T>
+at::Tensor ds_moe_ffn(at::Tensor& input,
+                      at::Tensor& gate_logits,
+                      at::Tensor& inter_w,
+                      at::Tensor& inter_b,
+                      at::Tensor& output_w,
+                      at::Tensor& output_b,
+                      int intermediate_size,
+                      int top_k)
+{
+    auto input_cont = input.contiguous();
+    auto logits = gate_logits.contiguous();
+    const int hidden = input_cont.size(-1);
+    const int tokens = input_cont.numel() / hidden;
+    const int experts = logits.size(-1);
+    const int assignments = tokens * top_k;
+    TORCH_CHECK(logits.scalar_type() == at::kFloat, "MoE gate logits must be fp32");
+    TORCH_CHECK(logits.numel() == (int64_t)tokens * experts, "One row of gate logits per token");
+    TORCH_CHECK(
+        experts <= MOE_MAX_EXPERTS, "Fused MoE supports up to ", MOE_MAX_EXPERTS, " experts");
+    TORCH_CHECK(top_k >= 1 && top_k <= MOE_MAX_TOP_K && top_k <= experts,
+                "Fused MoE supports top_k from 1 to min(experts, ",
+                MOE_MAX_TOP_K,
+                "), got ",
+                top_k);
+    TORCH_CHECK(inter_w.numel() == experts && inter_b.numel() == experts &&
+                    output_w.numel() == experts && output_b.numel() == experts,
+                "Fused MoE expects the parameters of ",
+                experts,
+                " experts");
+    auto stream = InferenceContext::Instance().GetCurrentStream();
+
+    auto int_options = input_cont.options().dtype(at::kInt);
+    auto expert_ids = at::empty({assignments}, int_options);
+    auto positions = at::empty({assignments}, int_options);
+    auto expert_offsets = at::empty({experts + 1}, int_options);
+    auto gate_weights = at::empty({assignments}, input_cont.options().dtype(at::kFloat));
+    launch_moe_gating((int*)expert_ids.data_ptr(),
+                      (float*)gate_weights.data_ptr(),
+                      (int*)expert_offsets.data_ptr(),
+                      (int*)positions.data_ptr(),
+                      (const float*)logits.data_ptr(),
+                      tokens,
+                      experts,
+                      top_k,
+                      stream);
+
+    auto permuted = at::empty({assignments, hidden}, input_cont.options());
+    launch_moe_gather((T*)permuted.data_ptr(),
+                      (const T*)input_cont.data_ptr(),
+                      (const int*)positions.data_ptr(),
+                      tokens,
+                      top_k,
+                      hidden,
+                      stream);
+
+    auto intermediate = at::empty({assignments, intermediate_size}, input_cont.options());
+    launch_moe_grouped_gemm((T*)intermediate.data_ptr(),
+                            (const T*)permuted.data_ptr(),
+                            (const T* const*)inter_w.data_ptr(),
+                            (const T* const*)inter_b.data_ptr(),
+                            (const int*)expert_offsets.data_ptr(),
+                            experts,
+                            assignments,
+                            hidden,
+                            intermediate_size,
+                            true,
+                            stream);
+    // The gathered input is not needed anymore, the second GEMM writes over it.
+    launch_moe_grouped_gemm((T*)permuted.data_ptr(),
+                            (const T*)intermediate.data_ptr(),
+                            (const T* const*)output_w.data_ptr(),
+                            (const T* const*)output_b.data_ptr(),
+                            (const int*)expert_offsets.data_ptr(),
+                            experts,
+                            assignments,
+                            intermediate_size,
+                            hidden,
+                            false,
+                            stream);
+
+    auto output = at::empty_like(input_cont);
+    launch_moe_combine((T*)output.data_ptr(),
+                       (const T*)permuted.data_ptr(),
+                       (const int*)positions.data_ptr(),
+                       (const float*)gate_weights.data_ptr(),
+                       tokens,
+                       top_k,
+                       hidden,
+                       stream);
+    return output;
+}
+
+/*
+Samples the next token of every row of logits ([rows, vocab], or [batch, seq, vocab] of which the
+last position is sampled). history holds, per row, the tokens the repetition penalty applies to,
+negative entries are padding; it can be empty when repetition_penalty is 1. top_k <= 0 and
+top_p >= 1 disable the respective cut, temperature <= 0 is greedy. seed and offset select the
+Philox stream of the draw. Returns the int64 tokens, one per row.
+*/
+template <typename T>
+at::Tensor ds_sample_tokens(at::Tensor& logits,
+                            at::Tensor& history,
+                            float temperature,
+                            float repetition_penalty,
+                            int top_k,
+                            float top_p,
+                            int64_t seed,
+                            int64_t offset)
+{
+    auto last_logits = logits.dim() == 3 ? logits.select(1, logits.size(1) - 1) : logits;
+    auto logits_cont = last_logits.contiguous();
+    const int vocab = logits_cont.size(-1);
+    const int rows = logits_cont.numel() / vocab;
+    auto history_cont = history.to(at::kLong).contiguous();
+    const int history_len = history_cont.numel() > 0 ? history_cont.size(-1) : 0;
+    TORCH_CHECK(history_len == 0 || history_cont.numel() == (int64_t)rows * history_len,
+                "sample_tokens: one row of history per row of logits");
+
+    auto tokens = at::empty({rows}, logits_cont.options().dtype(at::kLong));
+    auto scores = at::empty({rows, vocab}, logits_cont.options().dtype(at::kFloat));
+    launch_sample_tokens((int64_t*)tokens.data_ptr(),
+                         (float*)scores.data_ptr(),
+                         (const T*)logits_cont.data_ptr(),
+                         (const int64_t*)history_cont.data_ptr(),
+                         history_len,
+                         temperature,
+                         history_len > 0 ? repetition_penalty : 1.f,
+                         top_k,
+                         top_p,
+                         (uint64_t)seed,
+                         (uint64_t)offset,
+                         rows,
+                         vocab,
+                         InferenceContext::Instance().GetCurrentStream());
+    return tokens;
+}
+
+/*
+Adds the low-rank adapters of the context's current adapter ids (set_lora_adapters) to the
+output of a base GEMM in place: output += scale * input . lora_a[id] . lora_b[id], lora_a being
+[adapters, rank, in_features] and lora_b [adapters, rank, out_features].
+*/
+template <typename T>
+at::Tensor ds_lora_bgmv(at::Tensor& output,
+                        at::Tensor& input,
+                        at::Tensor& lora_a,
+                        at::Tensor& lora_b,
+                        float scale)
+{
+    const at::Tensor& ids = InferenceContext::Instance().lora_adapters();
+    if (!ids.defined()) return output;
+
+    auto input_cont = input.contiguous();
+    const int in_dim = input_cont.size(-1);
+    const int tokens = input_cont.numel() / in_dim;
+    const int adapters = lora_a.size(0);
+    const int rank = lora_a.size(1);
+    const int out_dim = lora_b.size(2);
+    TORCH_CHECK(lora_a.dim() == 3 && lora_a.size(2) == in_dim,
+                "lora_a must be [adapters, rank, ",
+                in_dim,
+                "]");
+    TORCH_CHECK(lora_b.dim() == 3 && lora_b.size(0) == adapters && lora_b.size(1) == rank,
+                "lora_b must be [",
+                adapters,
+                ", ",
+                rank,
+                ", out_features]");
+    TORCH_CHECK(rank <= LORA_MAX_RANK, "LoRA ranks up to ", LORA_MAX_RANK, " are supported");
+    TORCH_CHECK(output.is_contiguous() && output.numel() == (int64_t)tokens * out_dim,
+                "LoRA output must be a contiguous [tokens, ",
+                out_dim,
+                "] tensor");
+    TORCH_CHECK(tokens % ids.numel() == 0,
+                "One LoRA adapter id per sequence or per token, got ",
+                ids.numel(),
+                " for ",
+                tokens,
+                " tokens");
+
+    auto scratch = at::empty({tokens, rank}, input_cont.options().dtype(at::kFloat));
+    auto a_cont = lora_a.contiguous();
+    auto b_cont = lora_b.contiguous();
+    launch_lora_bgmv((T*)output.data_ptr(),
+                     (float*)scratch.data_ptr(),
+                     (const T*)input_cont.data_ptr(),
+                     (const T*)a_cont.data_ptr(),
+                     (const T*)b_cont.data_ptr(),
+                     (const int*)ids.data_ptr(),
+                     tokens / ids.numel(),
+                     scale,
+                     tokens,
+                     adapters,
+                     in_dim,
+                     rank,
+                     out_dim,
+                     InferenceContext::Instance().GetCurrentStream());
+    return output;
+}
+
+void ds_set_lora_adapters(at::Tensor& ids) { InferenceContext::Instance().SetLoraAdapters(ids); }
+
 void ds_release_workspace() { InferenceContext::Instance().release_workspace(); }
 
 bool ds_retake_workspace() { return InferenceContext::Instance().retake_workspace(); }
 
+void ds_free_paged_kv() { InferenceContext::Instance().GetPagedKVCache().FreeAll(); }
+
+size_t ds_paged_kv_free_blocks()
+{
+    return InferenceContext::Instance().GetPagedKVCache().free_blocks();
+}
+
+void ds_set_ragged_batch(const std::vector<int>& seqs, const std::vector<int>& new_tokens)
+{
+    InferenceContext::Instance().SetRaggedBatch(seqs, new_tokens);
+}
+
+void ds_release_sequence(int seq) { InferenceContext::Instance().GetPagedKVCache().Free(seq); }
+
+size_t ds_sequence_length(int seq)
+{
+    return InferenceContext::Instance().GetPagedKVCache().length(seq);
+}
+
+void ds_set_device_positions(bool enabled)
+{
+    InferenceContext::Instance().SetDevicePositions(enabled);
+}
+
+size_t ds_match_prefix(int seq, const std::vector<int>& tokens)
+{
+    return InferenceContext::Instance().GetPagedKVCache().MatchPrefix(seq, tokens);
+}
+
+size_t ds_register_prefix(int seq, const std::vector<int>& tokens)
+{
+    return InferenceContext::Instance().GetPagedKVCache().RegisterPrefix(seq, tokens);
+}
+
+void ds_clear_prefixes() { InferenceContext::Instance().GetPagedKVCache().ClearPrefixes(); }
+
+int ds_create_context() { return InferenceContext::Create(); }
+
+void ds_select_context(int id) { InferenceContext::Select(id); }
+
+void ds_destroy_context(int id) { InferenceContext::Destroy(id); }
+
+int ds_current_context() { return InferenceContext::CurrentId(); }
+
+// Address and allocated bytes of the workspace of the selected context.
+uintptr_t ds_workspace_ptr()
+{
+    return reinterpret_cast<uintptr_t>(InferenceContext::Instance().GetWorkSpace());
+}
+
+size_t ds_workspace_capacity() { return InferenceContext::Instance().get_workspace_capacity(); }
+
+// Process wide: the GEMMs of every context pick their algorithm from the on-disk cache, timing
+// the shapes it does not have yet (see tuned_gemm_algo).
+void ds_set_gemm_autotune(bool enable) { GemmAlgoCache::Instance().SetTuning(enable); }
+
+// Per context, the base and scaling of the rotary embedding of its model.
+void ds_set_rotary_base(float theta, float scale)
+{
+    TORCH_CHECK(theta > 0.f && scale > 0.f, "Rotary base and scaling must be positive");
+    InferenceContext::Instance().SetRotaryBase(theta, scale);
+}
+
+void ds_append_next_forward() { InferenceContext::Instance().SetAppendTokens(); }
+
+// Rolls the KV cache back to its first tokens tokens: of sequence seq of the paged cache, or of
+// the whole uniform batch when seq is negative.
+void ds_truncate_kv_cache(unsigned tokens, int seq)
+{
+    InferenceContext& context = InferenceContext::Instance();
+    PagedKVCache& kv_cache = context.GetPagedKVCache();
+    if (seq >= 0) {
+        TORCH_CHECK(context.paged_kv(), "Truncating a single sequence needs the paged KV cache");
+        kv_cache.Truncate(seq, tokens);
+        return;
+    }
+    context.TruncateTokens(tokens);
+    if (context.paged_kv())
+        for (unsigned b = 0; b < context.max_batch_size(); b++)
+            if (kv_cache.length(b) > tokens) kv_cache.Truncate(b, tokens);
+    if (context.device_positions())
+        launch_update_positions(context.GetDevicePositions(),
+                                tokens,
+                                false,
+                                context.max_batch_size(),
+                                context.GetCurrentStream());
+}
+
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
-    m.def("softmax_fp32", &ds_softmax<float>, "DeepSpeed SoftMax with fp32 (CUDA)");
-    m.def("softmax_fp16", &ds_softmax<__half>, "DeepSpeed SoftMax with fp16 (CUDA)");
-    m.def(
-        "softmax_context_fp32", &ds_softmax_context<float>, "DeepSpeed attention with fp32 (CUDA)");
-    m.def("softmax_context_fp16",
-          &ds_softmax_context<__half>,
-          "DeepSpeed attention with fp16 (CUDA)");
-    m.def("softmax_context_int8",
-          &ds_softmax_context1<__half>,
-          "DeepSpeed attention with int8 (CUDA)");
-    m.def("bias_gelu_fp32", &ds_bias_gelu<float>, "DeepSpeed Gelu with fp32 (CUDA)");
-    m.def("bias_gelu_fp16", &ds_bias_gelu<__half>, "DeepSpeed Gelu with fp16 (CUDA)");
-    m.def("bias_geglu", &ds_bias_geglu, "DeepSpeed Bias GEGLU (CUDA)");
-    m.def("bias_add_fp32", &ds_bias_add<float>, "DeepSpeed Bias Add with fp32 (CUDA)");
-    m.def("bias_add_fp16", &ds_bias_add<__half>, "DeepSpeed Gelu with fp16 (CUDA)");
-    m.def("bias_relu_fp32", &ds_bias_relu<float>, "DeepSpeed ReLU with fp32 (CUDA)");
-    m.def("bias_relu_fp16", &ds_bias_relu<__half>, "DeepSpeed ReLU with fp16 (CUDA)");
-    m.def("bias_residual_fp32",
-          &ds_bias_residual<float>,
-          "DeepSpeed residual-bias add with fp32 (CUDA)");
-    m.def("bias_residual_fp16",
-          &ds_bias_residual<__half>,
-          "DeepSpeed residual-bias add with fp16 (CUDA)");
-    m.def("layer_norm", &ds_layer_norm, "DeepSpeed layer norm (CUDA)");
-    m.def(
-        "_layer_norm_residual", &ds_layer_norm_residual, "DeepSpeed layer norm + residual (CUDA)");
-    m.def("layer_norm_residual_store_pre_ln_res",
-          &ds_layer_norm_residual_store_pre_ln_res,
-          "DeepSpeed layer norm + store pre Layernorm residual (CUDA)");
-    m.def("qkv_gemm_fp32", &ds_qkv_gemm<float>, "DeepSpeed qkv gemm with fp32 (CUDA)");
-    m.def("qkv_gemm_fp16", &ds_qkv_gemm<__half>, "DeepSpeed qkv gemm with fp16 (CUDA)");
-    m.def("qkv_gemm_int8", &ds_qkv_gemm_int8<__half>, "DeepSpeed qkv gemm with int8 (CUDA)");
-    m.def("mlp_gemm_fp32", &ds_mlp_gemm<float>, "DeepSpeed mlp with fp32 (CUDA)");
-    m.def("mlp_gemm_fp16", &ds_mlp_gemm<__half>, "DeepSpeed mlp with fp16 (CUDA)");
-    m.def("mlp_gemm_int8", &ds_mlp_gemm_int8<__half>, "DeepSpeed mlp with int8 (CUDA)");
-    m.def("vector_matmul_fp32", &ds_vector_matmul<float>, "DeepSpeed vector-MM with fp32 (CUDA)");
-    m.def("vector_matmul_fp16", &ds_vector_matmul<__half>, "DeepSpeed vector-MM with fp16 (CUDA)");
-    m.def("vector_matmul_int8",
-          &ds_vector_matmul_int8<__half>,
-          "DeepSpeed vector-MM with int8 (CUDA)");
-    m.def("linear_layer_fp32", &ds_linear_layer<float>, "DeepSpeed linear_layer with fp32 (CUDA)");
-    m.def("linear_layer_fp16", &ds_linear_layer<__half>, "DeepSpeed linear_layer with fp16 (CUDA)");
-    m.def("linear_layer_int8",
-          &ds_linear_layer_int8<__half>,
-          "DeepSpeed linear_layer with int8 (CUDA)");
-    m.def("fused_gemm_gelu_fp32", &fused_gemm_gelu<float>, "DeepSpeed mlp with fp32 (CUDA)");
-    m.def("fused_gemm_gelu_fp16", &fused_gemm_gelu<__half>, "DeepSpeed mlp with fp16 (CUDA)");
-    m.def("residual_add_bias_fp32",
-          &residual_add_bias<float>,
-          "DeepSpeed residual add with fp32 (CUDA)");
-    m.def("residual_add_bias_fp16",
-          &residual_add_bias<__half>,
-          "DeepSpeed residual add with fp16 (CUDA)");
-    m.def("apply_rotary_pos_emb", &apply_rotary_pos_emb, "DeepSpeed mlp with fp16 (CUDA)");
-    m.def("einsum_sec_sm_ecm_fp32",
-          &einsum_sec_sm_ecm<float>,
-          "DeepSpeed vector-MM with fp32 (CUDA)");
-
-    m.def("einsum_sec_sm_ecm_fp16",
-          &einsum_sec_sm_ecm<__half>,
-          "DeepSpeed vector-MM with fp16 (CUDA)");
-    m.def("moe_res_matmul", &moe_res_matmul, "DeepSpeed moe residual matmul (CUDA)");
-    m.def("add_padding_fp32", &add_padding<float>, "DeepSpeed residual add with fp32 (CUDA)");
-    m.def("add_padding_fp16", &add_padding<__half>, "DeepSpeed residual add with fp16 (CUDA)");
-    m.def("pad_transform_fp32",
-          &padd_add_transform<float>,
-          "DeepSpeed residual add with fp32 (CUDA)");
-    m.def("pad_transform_fp16",
-          &padd_add_transform<__half>,
-          "DeepSpeed residual add with fp16 (CUDA)");
-    m.def("allocate_workspace_fp32",
-          &allocate_workspace<float>,
-          "DeepSpeed memory allocation for GPT inference with fp32 (CUDA)");
-    m.def("allocate_workspace_fp16",
-          &allocate_workspace<__half>,
-          "DeepSpeed memory allocation for GPT inference with fp16 (CUDA)");
-    m.def("reset_cache", &reset_cache, "Reset Cache for generation tasks");
-    m.def("release_workspace", &ds_release_workspace, "DeepSpeed Release Workspace");
-    m.def("retake_workspace", &ds_retake_workspace, "DeepSpeed Retake Workspace");
+    ds_instrument::def(m, "softmax_fp32", &ds_softmax<float>, "DeepSpeed SoftMax with fp32 (CUDA)");
+    ds_instrument::def(
+        m, "softmax_fp16", &ds_softmax<__half>, "DeepSpeed SoftMax with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "softmax_context_fp32",
+                       &ds_softmax_context<float>,
+                       "DeepSpeed attention with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "softmax_context_fp16",
+                       &ds_softmax_context<__half>,
+                       "DeepSpeed attention with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "softmax_context_int8",
+                       &ds_softmax_context1<__half>,
+                       "DeepSpeed attention with int8 (CUDA)");
+    ds_instrument::def(
+        m, "bias_gelu_fp32", &ds_bias_gelu<float>, "DeepSpeed Gelu with fp32 (CUDA)");
+    ds_instrument::def(
+        m, "bias_gelu_fp16", &ds_bias_gelu<__half>, "DeepSpeed Gelu with fp16 (CUDA)");
+    ds_instrument::def(m, "bias_geglu", &ds_bias_geglu, "DeepSpeed Bias GEGLU (CUDA)");
+    ds_instrument::def(m, "bias_swiglu", &ds_bias_swiglu, "DeepSpeed Bias SwiGLU (CUDA)");
+    ds_instrument::def(
+        m, "bias_add_fp32", &ds_bias_add<float>, "DeepSpeed Bias Add with fp32 (CUDA)");
+    ds_instrument::def(m, "bias_add_fp16", &ds_bias_add<__half>, "DeepSpeed Gelu with fp16 (CUDA)");
+    ds_instrument::def(
+        m, "bias_relu_fp32", &ds_bias_relu<float>, "DeepSpeed ReLU with fp32 (CUDA)");
+    ds_instrument::def(
+        m, "bias_relu_fp16", &ds_bias_relu<__half>, "DeepSpeed ReLU with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "bias_residual_fp32",
+                       &ds_bias_residual<float>,
+                       "DeepSpeed residual-bias add with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "bias_residual_fp16",
+                       &ds_bias_residual<__half>,
+                       "DeepSpeed residual-bias add with fp16 (CUDA)");
+    ds_instrument::def(m, "layer_norm", &ds_layer_norm, "DeepSpeed layer norm (CUDA)");
+    ds_instrument::def(m,
+                       "_layer_norm_residual",
+                       &ds_layer_norm_residual,
+                       "DeepSpeed layer norm + residual (CUDA)");
+    ds_instrument::def(m,
+                       "layer_norm_residual_store_pre_ln_res",
+                       &ds_layer_norm_residual_store_pre_ln_res,
+                       "DeepSpeed layer norm + store pre Layernorm residual (CUDA)");
+    ds_instrument::def(m, "rms_norm", &ds_rms_norm, "DeepSpeed rms norm (CUDA)");
+    ds_instrument::def(
+        m, "pre_rms_norm", &ds_pre_rms_norm, "DeepSpeed rms norm + store pre norm residual (CUDA)");
+    ds_instrument::def(
+        m, "qkv_gemm_fp32", &ds_qkv_gemm<float>, "DeepSpeed qkv gemm with fp32 (CUDA)");
+    ds_instrument::def(
+        m, "qkv_gemm_fp16", &ds_qkv_gemm<__half>, "DeepSpeed qkv gemm with fp16 (CUDA)");
+    ds_instrument::def(
+        m, "qkv_gemm_int8", &ds_qkv_gemm_int8<__half>, "DeepSpeed qkv gemm with int8 (CUDA)");
+    ds_instrument::def(m, "mlp_gemm_fp32", &ds_mlp_gemm<float>, "DeepSpeed mlp with fp32 (CUDA)");
+    ds_instrument::def(m, "mlp_gemm_fp16", &ds_mlp_gemm<__half>, "DeepSpeed mlp with fp16 (CUDA)");
+    ds_instrument::def(
+        m, "mlp_gemm_int8", &ds_mlp_gemm_int8<__half>, "DeepSpeed mlp with int8 (CUDA)");
+    ds_instrument::def(
+        m, "vector_matmul_fp32", &ds_vector_matmul<float>, "DeepSpeed vector-MM with fp32 (CUDA)");
+    ds_instrument::def(
+        m, "vector_matmul_fp16", &ds_vector_matmul<__half>, "DeepSpeed vector-MM with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "vector_matmul_rows_fp32",
+                       &ds_vector_matmul_rows<float>,
+                       "DeepSpeed vector-MM over a range of rows with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "vector_matmul_rows_fp16",
+                       &ds_vector_matmul_rows<__half>,
+                       "DeepSpeed vector-MM over a range of rows with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "vector_matmul_int8",
+                       &ds_vector_matmul_int8<__half>,
+                       "DeepSpeed vector-MM with int8 (CUDA)");
+    ds_instrument::def(
+        m, "linear_layer_fp32", &ds_linear_layer<float>, "DeepSpeed linear_layer with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "linear_layer_fp16",
+                       &ds_linear_layer<__half>,
+                       "DeepSpeed linear_layer with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "weight_only_linear_fp16",
+                       &ds_weight_only_linear<__half>,
+                       "DeepSpeed linear layer over int4/int8 weights with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "weight_only_linear_fp32",
+                       &ds_weight_only_linear<float>,
+                       "DeepSpeed linear layer over int4/int8 weights with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "linear_layer_int8",
+                       &ds_linear_layer_int8<__half>,
+                       "DeepSpeed linear_layer with int8 (CUDA)");
+    ds_instrument::def(
+        m, "fused_gemm_gelu_fp32", &fused_gemm_gelu<float>, "DeepSpeed mlp with fp32 (CUDA)");
+    ds_instrument::def(
+        m, "fused_gemm_gelu_fp16", &fused_gemm_gelu<__half>, "DeepSpeed mlp with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "residual_add_bias_fp32",
+                       &residual_add_bias<float>,
+                       "DeepSpeed residual add with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "residual_add_bias_fp16",
+                       &residual_add_bias<__half>,
+                       "DeepSpeed residual add with fp16 (CUDA)");
+    ds_instrument::def(
+        m, "apply_rotary_pos_emb", &apply_rotary_pos_emb, "DeepSpeed mlp with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "einsum_sec_sm_ecm_fp32",
+                       &einsum_sec_sm_ecm<float>,
+                       "DeepSpeed vector-MM with fp32 (CUDA)");
+
+    ds_instrument::def(m,
+                       "einsum_sec_sm_ecm_fp16",
+                       &einsum_sec_sm_ecm<__half>,
+                       "DeepSpeed vector-MM with fp16 (CUDA)");
+    ds_instrument::def(
+        m, "moe_res_matmul", &moe_res_matmul, "DeepSpeed moe residual matmul (CUDA)");
+    ds_instrument::def(
+        m, "moe_ffn_fp32", &ds_moe_ffn<float>, "DeepSpeed fused MoE experts with fp32 (CUDA)");
+    ds_instrument::def(
+        m, "moe_ffn_fp16", &ds_moe_ffn<__half>, "DeepSpeed fused MoE experts with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "sample_tokens_fp32",
+                       &ds_sample_tokens<float>,
+                       "DeepSpeed next token sampling with fp32 logits (CUDA)");
+    ds_instrument::def(m,
+                       "sample_tokens_fp16",
+                       &ds_sample_tokens<__half>,
+                       "DeepSpeed next token sampling with fp16 logits (CUDA)");
+    ds_instrument::def(m,
+                       "lora_bgmv_fp32",
+                       &ds_lora_bgmv<float>,
+                       "DeepSpeed batched LoRA adapters with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "lora_bgmv_fp16",
+                       &ds_lora_bgmv<__half>,
+                       "DeepSpeed batched LoRA adapters with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "set_lora_adapters",
+                       &ds_set_lora_adapters,
+                       "Select the LoRA adapter of each sequence or token of the next forwards");
+    ds_instrument::def(
+        m, "add_padding_fp32", &add_padding<float>, "DeepSpeed residual add with fp32 (CUDA)");
+    ds_instrument::def(
+        m, "add_padding_fp16", &add_padding<__half>, "DeepSpeed residual add with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "pad_transform_fp32",
+                       &padd_add_transform<float>,
+                       "DeepSpeed residual add with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "pad_transform_fp16",
+                       &padd_add_transform<__half>,
+                       "DeepSpeed residual add with fp16 (CUDA)");
+    ds_instrument::def(m,
+                       "allocate_workspace_fp32",
+                       &allocate_workspace<float>,
+                       "DeepSpeed memory allocation for GPT inference with fp32 (CUDA)");
+    ds_instrument::def(m,
+                       "allocate_workspace_fp16",
+                       &allocate_workspace<__half>,
+                       "DeepSpeed memory allocation for GPT inference with fp16 (CUDA)");
+    ds_instrument::def(m, "reset_cache", &reset_cache, "Reset Cache for generation tasks");
+    ds_instrument::def(
+        m, "release_workspace", &ds_release_workspace, "DeepSpeed Release Workspace");
+    ds_instrument::def(m, "retake_workspace", &ds_retake_workspace, "DeepSpeed Retake Workspace");
+    ds_instrument::def(
+        m, "free_paged_kv", &ds_free_paged_kv, "Return all paged KV cache blocks to the pool");
+    ds_instrument::def(
+        m, "paged_kv_free_blocks", &ds_paged_kv_free_blocks, "Free paged KV cache blocks");
+    ds_instrument::def(m,
+                       "set_ragged_batch",
+                       &ds_set_ragged_batch,
+                       "Sequences and new token counts of the batch slots of the next forward");
+    ds_instrument::def(
+        m, "release_sequence", &ds_release_sequence, "Free the paged KV cache of a sequence");
+    ds_instrument::def(m, "sequence_length", &ds_sequence_length, "Tokens cached for a sequence");
+    ds_instrument::def(
+        m,
+        "match_prefix",
+        &ds_match_prefix,
+        "Share the cached blocks of the longest registered prefix with a new sequence");
+    ds_instrument::def(
+        m,
+        "register_prefix",
+        &ds_register_prefix,
+        "Make the full blocks of a sequence available to sequences with the same prefix");
+    ds_instrument::def(m, "clear_prefixes", &ds_clear_prefixes, "Drop all registered prefixes");
+    ds_instrument::def(
+        m, "create_context", &ds_create_context, "Create an inference context, returns its id");
+    ds_instrument::def(m,
+                       "select_context",
+                       &ds_select_context,
+                       "Run the following ops of this thread in an inference context");
+    ds_instrument::def(m, "destroy_context", &ds_destroy_context, "Free an inference context");
+    ds_instrument::def(
+        m, "current_context", &ds_current_context, "Id of the selected inference context");
+    ds_instrument::def(
+        m, "workspace_ptr", &ds_workspace_ptr, "Address of the workspace of the selected context");
+    ds_instrument::def(m,
+                       "workspace_capacity",
+                       &ds_workspace_capacity,
+                       "Bytes allocated for the workspace of the selected context");
+    ds_instrument::def(m,
+                       "set_gemm_autotune",
+                       &ds_set_gemm_autotune,
+                       "Autotune the cuBLAS algorithm of the inference GEMMs, cached on disk");
+    ds_instrument::def(
+        m,
+        "set_rotary_base",
+        &ds_set_rotary_base,
+        "Set the base and linear scaling of the rotary embedding of the current context");
+    ds_instrument::def(m,
+                       "set_device_positions",
+                       &ds_set_device_positions,
+                       "Read the decode positions from device memory, for CUDA graph capture");
+    ds_instrument::def(
+        m,
+        "append_next_forward",
+        &ds_append_next_forward,
+        "Append the tokens of the next forward to the KV cache instead of starting a prompt");
+    ds_instrument::def(
+        m, "truncate_kv_cache", &ds_truncate_kv_cache, "Drop the cached tokens past a length");
+#ifdef FP8_AVAILABLE
+    ds_instrument::def(
+        m, "fp8_quantize", &ds_fp8_quantize<__half>, "DeepSpeed fp8 quantize (CUDA)");
+    ds_instrument::def(m,
+                       "linear_layer_fp8",
+                       &ds_linear_layer_fp8<__half>,
+                       "DeepSpeed linear_layer with fp8 (CUDA)");
+    ds_instrument::def(m,
+                       "vector_matmul_fp8",
+                       &ds_vector_matmul_fp8<__half>,
+                       "DeepSpeed vector-MM with fp8 (CUDA)");
+    ds_instrument::def(
+        m, "qkv_gemm_fp8", &ds_qkv_gemm_fp8<__half>, "DeepSpeed qkv gemm with fp8 (CUDA)");
+    ds_instrument::def(
+        m, "mlp_gemm_fp8", &ds_mlp_gemm_fp8<__half>, "DeepSpeed mlp with fp8 (CUDA)");
+#endif
+    ds_instrument::def_queries(m);
 }
@@ -0,0 +1,222 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "conversion_utils.h"
+#include "ds_kernel_utils.h"
+#include "inference_cuda_layers.h"
+#include "memory_access_utils.h"
+#include "reduction_utils.h"
+
+namespace cg = cooperative_groups;
+using rop = reduce::ROpType;
+
+namespace rms {
+constexpr int granularity = 16;
+}  // namespace rms
+
+/*
+RMS norm, optionally fused with the residual add of a pre-norm block. Follows the schedule of the
+layer norm in layer_norm.cu but has a single reduction (the sum of squares) and no beta, so the
+row is read once and the statistics are accumulated in fp32. Assumes elems_per_row % 8 == 0.
+
+Args:
+    output: buffer for output data
+    res_output: vals + residual, the input of the next residual add (preLnResidual only)
+    vals: buffer for input data
+    residual: residual data (preLnResidual only)
+    gamma: gain for normalization
+    epsilon: numeric stability
+    rows: number of rows to normalize
+    elems_per_row: number of elements each group will normalize
+*/
+template <typename T, int unRoll, int threadsPerGroup, int maxThreads, bool preLnResidual>
+__global__ void fused_rms_norm(T* output,
+                               T* res_output,
+                               const T* vals,
+                               const T* residual,
+                               const T* gamma,
+                               float epsilon,
+                               int rows,
+                               int elems_per_row)
+{
+    constexpr int T_per_load = rms::granularity / sizeof(T);
+
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+
+    const int row = tb.group_index().x * (maxThreads / threadsPerGroup) + tb.thread_index().y;
+    const bool row_valid = row < rows;
+
+    const int block_offset = row * elems_per_row;
+    const int thread_offset = tb.thread_index().x * T_per_load;
+    const int base_offset = block_offset + thread_offset;
+    const int stride = tb.size() * T_per_load;
+
+    float sum_sq = reduce::init<rop::Add, float>();
+
+    T local_buffer[unRoll * T_per_load];
+
+#pragma unRoll
+    for (int i = 0; i < unRoll; i++) {
+        T* iteration_buffer = local_buffer + i * T_per_load;
+        const bool do_loads = row_valid && (thread_offset + i * stride < elems_per_row);
+
+        mem_access::load_global<rms::granularity>(
+            iteration_buffer, vals + base_offset + i * stride, do_loads);
+
+        if (preLnResidual) {
+            T residual_buffer[T_per_load];
+            mem_access::load_global<rms::granularity>(
+                residual_buffer, residual + base_offset + i * stride, do_loads);
+#pragma unRoll
+            for (int j = 0; j < T_per_load; j++) {
+                float val = conversion::to<float>(iteration_buffer[j]) +
+                            conversion::to<float>(residual_buffer[j]);
+                iteration_buffer[j] = conversion::to<T>(val);
+            }
+            if (do_loads) {
+                mem_access::store_global<rms::granularity>(res_output + base_offset + i * stride,
+                                                           iteration_buffer);
+            }
+        }
+
+        // Out of bounds loads are zero-filled, so they don't skew the sum of squares
+#pragma unRoll
+        for (int j = 0; j < T_per_load; j++) {
+            float val = conversion::to<float>(iteration_buffer[j]);
+            sum_sq = reduce::element<rop::Add>(sum_sq, val * val);
+        }
+    }
+
+    reduce::partitioned_block<rop::Add, threadsPerGroup>(tb, warp, sum_sq);
+    const float denom = __frsqrt_rn(sum_sq / elems_per_row + epsilon);
+
+    T* block_output = output + block_offset;
+
+#pragma unRoll
+    for (int i = 0; i < unRoll; i++) {
+        T* iteration_buffer = local_buffer + i * T_per_load;
+        const int iter_idx = i * stride + thread_offset;
+        const bool do_loads = row_valid && iter_idx < elems_per_row;
+
+        T gamma_local[T_per_load];
+        mem_access::load_global<rms::granularity>(gamma_local, gamma + iter_idx, do_loads);
+
+#pragma unRoll
+        for (int j = 0; j < T_per_load; j++) {
+            float val = conversion::to<float>(iteration_buffer[j]) * denom;
+            iteration_buffer[j] = conversion::to<T>(val * conversion::to<float>(gamma_local[j]));
+        }
+
+        if (do_loads) {
+            mem_access::store_global<rms::granularity>(block_output + iter_idx, iteration_buffer);
+        }
+    }
+}
+
+#define LAUNCH_FUSED_RMS_NORM(unRollFactor, threadsPerGroup, maxThreads)        \
+    fused_rms_norm<T, unRollFactor, threadsPerGroup, maxThreads, preLnResidual> \
+        <<<grid, block, 0, stream>>>(                                           \
+            output, res_output, vals, residual, gamma, epsilon, rows, elems_per_row);
+
+template <typename T, bool preLnResidual>
+void launch_fused_rms_norm_impl(T* output,
+                                T* res_output,
+                                const T* vals,
+                                const T* residual,
+                                const T* gamma,
+                                float epsilon,
+                                int rows,
+                                int elems_per_row,
+                                cudaStream_t stream)
+{
+    // 8 for __half, 4 for float
+    constexpr int T_per_load = rms::granularity / sizeof(T);
+
+    constexpr int maxThreads = 256;
+
+    // For Float, unRoll 4, for __half, unRoll 2
+    constexpr int internal_unRoll = sizeof(T) == 4 ? 4 : 2;
+
+    const bool is_subblock_schedule = (elems_per_row <= 128) ? true : false;
+    const int h_per_step = is_subblock_schedule ? T_per_load : T_per_load * internal_unRoll;
+
+    const int one_step_threads = next_pow2((elems_per_row + h_per_step - 1) / h_per_step);
+    const int threadsPerGroup = (one_step_threads < maxThreads) ? one_step_threads : maxThreads;
+
+    const int groups_per_block_max =
+        is_subblock_schedule ? (maxThreads + threadsPerGroup - 1) / threadsPerGroup : 1;
+    const int groups_per_block = (rows < groups_per_block_max) ? rows : groups_per_block_max;
+    const int groups_launch = (groups_per_block + rows - 1) / groups_per_block;
+
+    dim3 block(threadsPerGroup, groups_per_block);
+    dim3 grid(groups_launch);
+
+    const int elems_per_step = threadsPerGroup * h_per_step;
+    const int external_unRoll = (elems_per_row + elems_per_step - 1) / elems_per_step;
+
+    if (is_subblock_schedule) {
+        // <=128
+        if (threadsPerGroup == 1) {
+            LAUNCH_FUSED_RMS_NORM(1, 1, maxThreads);
+        } else if (threadsPerGroup == 2) {
+            LAUNCH_FUSED_RMS_NORM(1, 2, maxThreads);
+        } else if (threadsPerGroup == 4) {
+            LAUNCH_FUSED_RMS_NORM(1, 4, maxThreads);
+        } else if (threadsPerGroup == 8) {
+            LAUNCH_FUSED_RMS_NORM(1, 8, maxThreads);
+        } else if (threadsPerGroup == 16) {
+            LAUNCH_FUSED_RMS_NORM(1, 16, maxThreads);
+        }
+    } else if (external_unRoll == 1) {
+        // 129 - 4096 elems
+        LAUNCH_FUSED_RMS_NORM(1 * internal_unRoll, maxThreads, maxThreads);
+    } else if (external_unRoll == 2) {
+        // 4097 - 8192 elems
+        LAUNCH_FUSED_RMS_NORM(2 * internal_unRoll, maxThreads, maxThreads);
+    } else if (external_unRoll == 3) {
+        // 8193 - 12288 elems
+        LAUNCH_FUSED_RMS_NORM(3 * internal_unRoll, maxThreads, maxThreads);
+    } else if (external_unRoll == 4) {
+        // 12289 - 16384 elems
+        LAUNCH_FUSED_RMS_NORM(4 * internal_unRoll, maxThreads, maxThreads);
+    }
+}
+
+template <typename T>
+void launch_rms_norm(T* output,
+                     const T* vals,
+                     const T* gamma,
+                     float epsilon,
+                     int rows,
+                     int elems_per_row,
+                     cudaStream_t stream)
+{
+    launch_fused_rms_norm_impl<T, false>(
+        output, nullptr, vals, nullptr, gamma, epsilon, rows, elems_per_row, stream);
+}
+
+template <typename T>
+void launch_pre_rms_norm(T* norm_output,
+                         T* res_output,
+                         const T* vals,
+                         const T* residual,
+                         const T* gamma,
+                         float epsilon,
+                         int rows,
+                         int elems_per_row,
+                         cudaStream_t stream)
+{
+    launch_fused_rms_norm_impl<T, true>(
+        norm_output, res_output, vals, residual, gamma, epsilon, rows, elems_per_row, stream);
+}
+
+#define INSTANTIATE_RMS_NORM(T)                                                           \
+    template void launch_rms_norm(T*, const T*, const T*, float, int, int, cudaStream_t); \
+    template void launch_pre_rms_norm(                                                    \
+        T*, T*, const T*, const T*, const T*, float, int, int, cudaStream_t);
+
+INSTANTIATE_RMS_NORM(float)
+INSTANTIATE_RMS_NORM(__half)
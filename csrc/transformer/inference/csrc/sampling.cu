@@ -0,0 +1,280 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include <curand_kernel.h>
+#include <limits>
+#include "conversion_utils.h"
+#include "inference_cuda_layers.h"
+#include "reduction_utils.h"
+
+namespace cg = cooperative_groups;
+using rop = reduce::ROpType;
+
+/*
+Next token sampling, one block per row of logits: repetition penalty and temperature, top-k and
+top-p, then a multinomial draw among what is left, with no sort of the vocabulary.
+
+Both cuts are radix selects over the order preserving integer keys of the scaled logits, 8 bits
+per pass: top-k finds the key of the k-th largest logit by counting, top-p the key at which the
+probability mass of the larger candidates reaches top_p by summing the mass per digit instead.
+Candidates are the logits with a key at or above the final threshold, so ties at the threshold
+are all kept. The draw scans the candidate probabilities in vocabulary order, with each thread
+owning a contiguous slice of it.
+*/
+namespace sampling {
+
+constexpr int threads = 1024;
+constexpr int warps = threads / hw_warp_size;
+constexpr int radix_bits = 8;
+constexpr int bins = 1 << radix_bits;
+constexpr int passes = 32 / radix_bits;
+
+// Keys compare as the floats they come from.
+DS_D_INLINE uint32_t key(float val)
+{
+    const uint32_t bits = __float_as_uint(val);
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+}  // namespace sampling
+
+template <typename T>
+__global__ void sample_tokens(int64_t* tokens,
+                              float* scores,
+                              const T* logits,
+                              const int64_t* history,
+                              int history_len,
+                              float inv_temperature,
+                              float repetition_penalty,
+                              int top_k,
+                              float top_p,
+                              uint64_t seed,
+                              uint64_t offset,
+                              int vocab)
+{
+    __shared__ int count_hist[sampling::bins];
+    __shared__ float mass_hist[sampling::bins];
+    __shared__ uint32_t threshold;
+    __shared__ uint32_t p_prefix;
+    __shared__ float draw;
+    __shared__ float warp_sums[sampling::warps];
+    __shared__ int64_t token;
+
+    cg::thread_block tb = cg::this_thread_block();
+    cg::thread_block_tile<hw_warp_size> warp = cg::tiled_partition<hw_warp_size>(tb);
+    const int warp_id = threadIdx.x / hw_warp_size;
+    const int lane = threadIdx.x % hw_warp_size;
+
+    const size_t row_offset = (size_t)blockIdx.x * vocab;
+    const T* row_logits = logits + row_offset;
+    float* row_scores = scores + row_offset;
+
+    for (int v = threadIdx.x; v < vocab; v += sampling::threads)
+        row_scores[v] = conversion::to<float>(row_logits[v]) * inv_temperature;
+    tb.sync();
+    // Penalized from the logit itself, so a token seen several times is only penalized once.
+    if (repetition_penalty != 1.f) {
+        const int64_t* row_history = history + (size_t)blockIdx.x * history_len;
+        for (int h = threadIdx.x; h < history_len; h += sampling::threads) {
+            const int64_t tok = row_history[h];
+            if (tok < 0 || tok >= vocab) continue;
+            const float logit = conversion::to<float>(row_logits[tok]);
+            row_scores[tok] = (logit > 0.f ? logit / repetition_penalty
+                                           : logit * repetition_penalty) *
+                              inv_temperature;
+        }
+    }
+    if (threadIdx.x == 0) {
+        threshold = 0;
+        token = -1;
+    }
+    tb.sync();
+
+    float max_score = -std::numeric_limits<float>::infinity();
+    for (int v = threadIdx.x; v < vocab; v += sampling::threads)
+        max_score = fmaxf(max_score, row_scores[v]);
+    reduce::block<rop::Max>(tb, warp, max_score);
+
+    // Top-k: the digits of the k-th largest key, most significant first.
+    if (top_k > 0 && top_k < vocab) {
+        uint32_t prefix = 0, mask = 0;
+        int remaining = top_k;
+        for (int pass = 0; pass < sampling::passes; pass++) {
+            const int shift = 32 - (pass + 1) * sampling::radix_bits;
+            for (int b = threadIdx.x; b < sampling::bins; b += sampling::threads)
+                count_hist[b] = 0;
+            tb.sync();
+            for (int v = threadIdx.x; v < vocab; v += sampling::threads) {
+                const uint32_t k = sampling::key(row_scores[v]);
+                if ((k & mask) == prefix)
+                    atomicAdd(&count_hist[(k >> shift) & (sampling::bins - 1)], 1);
+            }
+            tb.sync();
+            if (threadIdx.x == 0) {
+                int b = sampling::bins - 1;
+                while (b > 0 && count_hist[b] < remaining) remaining -= count_hist[b--];
+                threshold = prefix | ((uint32_t)b << shift);
+            }
+            tb.sync();
+            // remaining is only kept up to date by thread 0, the one that reads it.
+            prefix = threshold;
+            mask |= (uint32_t)(sampling::bins - 1) << shift;
+        }
+    }
+
+    // Top-p: the digits of the key at which the mass of the larger candidates reaches top_p.
+    if (top_p < 1.f) {
+        const uint32_t k_threshold = threshold;
+        float total = 0.f;
+        for (int v = threadIdx.x; v < vocab; v += sampling::threads) {
+            const float score = row_scores[v];
+            if (sampling::key(score) >= k_threshold) total += __expf(score - max_score);
+        }
+        reduce::block<rop::Add>(tb, warp, total);
+
+        uint32_t prefix = 0, mask = 0;
+        float remaining = top_p * total;
+        for (int pass = 0; pass < sampling::passes; pass++) {
+            const int shift = 32 - (pass + 1) * sampling::radix_bits;
+            for (int b = threadIdx.x; b < sampling::bins; b += sampling::threads)
+                mass_hist[b] = 0.f;
+            tb.sync();
+            for (int v = threadIdx.x; v < vocab; v += sampling::threads) {
+                const float score = row_scores[v];
+                const uint32_t k = sampling::key(score);
+                if (k >= k_threshold && (k & mask) == prefix)
+                    atomicAdd(&mass_hist[(k >> shift) & (sampling::bins - 1)],
+                              __expf(score - max_score));
+            }
+            tb.sync();
+            if (threadIdx.x == 0) {
+                int b = sampling::bins - 1;
+                while (b > 0 && mass_hist[b] < remaining) remaining -= mass_hist[b--];
+                // Rounding can leave the last bins short of the target, keep the lowest one used.
+                if (mass_hist[b] == 0.f)
+                    while (b < sampling::bins - 1 && mass_hist[b] == 0.f) b++;
+                p_prefix = prefix | ((uint32_t)b << shift);
+            }
+            tb.sync();
+            prefix = p_prefix;
+            mask |= (uint32_t)(sampling::bins - 1) << shift;
+        }
+        if (threadIdx.x == 0) threshold = max(k_threshold, prefix);
+        tb.sync();
+    }
+
+    const uint32_t final_threshold = threshold;
+    const int slice = (vocab + sampling::threads - 1) / sampling::threads;
+    const int slice_begin = min(threadIdx.x * slice, vocab);
+    const int slice_end = min(slice_begin + slice, vocab);
+    float local = 0.f;
+    for (int v = slice_begin; v < slice_end; v++) {
+        const float score = row_scores[v];
+        if (sampling::key(score) >= final_threshold) local += __expf(score - max_score);
+    }
+
+    // Exclusive scan of the slice masses over the block.
+    float inclusive = local;
+#pragma unroll
+    for (int i = 1; i < hw_warp_size; i *= 2) {
+        const float other = warp.shfl_up(inclusive, i);
+        if (lane >= i) inclusive += other;
+    }
+    if (lane == hw_warp_size - 1) warp_sums[warp_id] = inclusive;
+    tb.sync();
+    if (warp_id == 0) {
+        float warp_total = lane < sampling::warps ? warp_sums[lane] : 0.f;
+#pragma unroll
+        for (int i = 1; i < hw_warp_size; i *= 2) {
+            const float other = warp.shfl_up(warp_total, i);
+            if (lane >= i) warp_total += other;
+        }
+        if (lane < sampling::warps) warp_sums[lane] = warp_total;
+        if (lane == sampling::warps - 1) {
+            curandStatePhilox4_32_10_t state;
+            curand_init(seed, blockIdx.x, offset, &state);
+            // curand_uniform is in (0, 1], keep the draw strictly below the total mass.
+            draw = (1.f - curand_uniform(&state)) * warp_total;
+        }
+    }
+    tb.sync();
+    const float exclusive = inclusive - local + (warp_id > 0 ? warp_sums[warp_id - 1] : 0.f);
+
+    if (local > 0.f && draw >= exclusive && draw < exclusive + local) {
+        float acc = exclusive;
+        int64_t picked = -1;
+        for (int v = slice_begin; v < slice_end; v++) {
+            const float score = row_scores[v];
+            if (sampling::key(score) < final_threshold) continue;
+            picked = v;
+            acc += __expf(score - max_score);
+            if (draw < acc) break;
+        }
+        token = picked;
+    }
+    tb.sync();
+
+    // Rounding can put the draw past every slice, fall back to the largest logit.
+    if (token < 0) {
+        for (int v = threadIdx.x; v < vocab; v += sampling::threads)
+            if (row_scores[v] == max_score) token = v;
+        tb.sync();
+    }
+    if (threadIdx.x == 0) tokens[blockIdx.x] = token;
+}
+
+template <typename T>
+void launch_sample_tokens(int64_t* tokens,
+                          float* scores,
+                          const T* logits,
+                          const int64_t* history,
+                          int history_len,
+                          float temperature,
+                          float repetition_penalty,
+                          int top_k,
+                          float top_p,
+                          uint64_t seed,
+                          uint64_t offset,
+                          int rows,
+                          int vocab,
+                          cudaStream_t stream)
+{
+    // No temperature is greedy decoding.
+    if (temperature <= 0.f) {
+        temperature = 1.f;
+        top_k = 1;
+    }
+    sample_tokens<<<rows, sampling::threads, 0, stream>>>(tokens,
+                                                          scores,
+                                                          logits,
+                                                          history,
+                                                          history_len,
+                                                          1.f / temperature,
+                                                          repetition_penalty,
+                                                          top_k,
+                                                          top_p,
+                                                          seed,
+                                                          offset,
+                                                          vocab);
+}
+
+#define INSTANTIATE_SAMPLE_TOKENS(T)                                     \
+    template void launch_sample_tokens<T>(int64_t*,                      \
+                                          float*,                        \
+                                          const T*,                      \
+                                          const int64_t*,                \
+                                          int,                           \
+                                          float,                         \
+                                          float,                         \
+                                          int,                           \
+                                          float,                         \
+                                          uint64_t,                      \
+                                          uint64_t,                      \
+                                          int,                           \
+                                          int,                           \
+                                          cudaStream_t);
+
+INSTANTIATE_SAMPLE_TOKENS(float)
+INSTANTIATE_SAMPLE_TOKENS(__half)
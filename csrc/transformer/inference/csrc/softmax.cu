@@ -76,7 +76,8 @@ __global__ void attn_softmax_v2(__half* vals,
         mask_offset = mask_offset * sequence_length;
         int seq_id = iter_offset % num_seq;
 
-        int real_seq_id = seq_id + (num_seq == sequence_length ? 0 : sequence_length);
+        // Position of the query among the keys, the last num_seq of them are the new tokens.
+        int real_seq_id = seq_id + (sequence_length - num_seq);
         int window_stride4 = (local_attention && (real_seq_id >> 2) > (window_size >> 2))
                                  ? (real_seq_id >> 2) - (window_size >> 2)
                                  : 0;
@@ -89,15 +90,16 @@ __global__ void attn_softmax_v2(__half* vals,
             int data_id = i * (reduceWidth << 2) + (seq_lane);
             bool check = (data_id >> 2) >= window_stride4;
             bool low_x_check = check && (data_id < sequence_length) &&
-                               (!triangular || (data_id <= seq_id)) && (data_id > window_stride);
+                               (!triangular || (data_id <= real_seq_id)) &&
+                               (data_id > window_stride);
             bool low_y_check = check && ((data_id + reduceWidth) < sequence_length) &&
-                               (!triangular || ((data_id + reduceWidth) <= seq_id)) &&
+                               (!triangular || ((data_id + reduceWidth) <= real_seq_id)) &&
                                ((data_id + reduceWidth) > window_stride);
             bool high_x_check = check && ((data_id + reduceWidth * 2) < sequence_length) &&
-                                (!triangular || ((data_id + reduceWidth * 2) <= seq_id)) &&
+                                (!triangular || ((data_id + reduceWidth * 2) <= real_seq_id)) &&
                                 ((data_id + reduceWidth * 2) > window_stride);
             bool high_y_check = check && ((data_id + reduceWidth * 3) < sequence_length) &&
-                                (!triangular || ((data_id + reduceWidth * 3) <= seq_id)) &&
+                                (!triangular || ((data_id + reduceWidth * 3) <= real_seq_id)) &&
                                 ((data_id + reduceWidth * 3) > window_stride);
 
             if (mask && alibi) {
@@ -278,7 +280,8 @@ __global__ void attn_softmax_v2(float* vals,
         mask_offset = mask_offset * sequence_length;
         int seq_id = iter_offset % num_seq;
 
-        int real_seq_id = seq_id + (num_seq == sequence_length ? 0 : sequence_length);
+        // Position of the query among the keys, the last num_seq of them are the new tokens.
+        int real_seq_id = seq_id + (sequence_length - num_seq);
         int window_stride4 = (local_attention && (real_seq_id >> 2) > (window_size >> 2))
                                  ? (real_seq_id >> 2) - (window_size >> 2)
                                  : 0;
@@ -291,15 +294,15 @@ __global__ void attn_softmax_v2(float* vals,
             int data_id = i * (reduceWidth << 2) + (seq_lane);
             bool check = (data_id >> 2) >= window_stride4;
             bool x_check = check && (data_id < sequence_length) &&
-                           (!triangular || (data_id <= seq_id)) && (data_id > window_stride);
+                           (!triangular || (data_id <= real_seq_id)) && (data_id > window_stride);
             bool y_check = check && ((data_id + reduceWidth) < sequence_length) &&
-                           (!triangular || ((data_id + reduceWidth) <= seq_id)) &&
+                           (!triangular || ((data_id + reduceWidth) <= real_seq_id)) &&
                            ((data_id + reduceWidth) > window_stride);
             bool z_check = check && ((data_id + reduceWidth * 2) < sequence_length) &&
-                           (!triangular || ((data_id + reduceWidth * 2) <= seq_id)) &&
+                           (!triangular || ((data_id + reduceWidth * 2) <= real_seq_id)) &&
                            ((data_id + reduceWidth * 2) > window_stride);
             bool w_check = check && ((data_id + reduceWidth * 3) < sequence_length) &&
-                           (!triangular || ((data_id + reduceWidth * 3) <= seq_id)) &&
+                           (!triangular || ((data_id + reduceWidth * 3) <= real_seq_id)) &&
                            ((data_id + reduceWidth * 3) > window_stride);
 
             if (attn_mask) {
@@ -9,6 +9,60 @@
 #include "inference_cuda_layers.h"
 namespace cg = cooperative_groups;
 
+namespace rotary {
+
+// Cos and sin of the angle of rotary pair `pair` at position `pos`.
+DS_D_INLINE float2 cos_sin(const RotaryTable& rope, unsigned pos, int pair, int rotary_dim)
+{
+    if (pos < (unsigned)rope.positions) return rope.cos_sin[pos * (rotary_dim >> 1) + pair];
+    const float inv_freq = powf(rope.theta, -(float)(pair << 1) / (float)rotary_dim);
+    float sin_val, cos_val;
+    sincosf((float)pos / rope.scale * inv_freq, &sin_val, &cos_val);
+    return make_float2(cos_val, sin_val);
+}
+
+// Vector of the other half of the rotary dims that rotate half pairs vector `vec` with.
+DS_D_INLINE int partner(int vec, int half_vecs)
+{
+    return vec < half_vecs ? vec + half_vecs : vec - half_vecs;
+}
+
+/*
+Rotates the N values x of a head starting at element first, all of them below rotary_dim. Rotate
+every two rotates the neighbours (2i, 2i + 1) by the angle of pair i, rotate half the elements i
+and i + rotary_dim / 2 by the angle of pair i, the other element of each pair is in partner.
+*/
+template <int N>
+DS_D_INLINE void apply(float* x,
+                       const float* partner,
+                       int first,
+                       int rotary_dim,
+                       bool rotate_half,
+                       unsigned pos,
+                       const RotaryTable& rope)
+{
+    if (rotate_half) {
+        const int half = rotary_dim >> 1;
+        const bool upper = first >= half;
+#pragma unroll
+        for (int i = 0; i < N; i++) {
+            const float2 cs = cos_sin(rope, pos, first + i - (upper ? half : 0), rotary_dim);
+            x[i] = upper ? x[i] * cs.x + partner[i] * cs.y : x[i] * cs.x - partner[i] * cs.y;
+        }
+    } else {
+#pragma unroll
+        for (int i = 0; i < N; i += 2) {
+            const float2 cs = cos_sin(rope, pos, (first + i) >> 1, rotary_dim);
+            const float even = x[i];
+            const float odd = x[i + 1];
+            x[i] = even * cs.x - odd * cs.y;
+            x[i + 1] = odd * cs.x + even * cs.y;
+        }
+    }
+}
+
+}  // namespace rotary
+
 // Bias add
 
 __global__ void bias_add_transform_0213(float* output,
@@ -24,11 +78,17 @@ __global__ void bias_add_transform_0213(float* output,
                                         bool rotate_half,
                                         bool rotate_every_two,
                                         int head_ext,
-                                        int max_out_tokens)
+                                        int max_out_tokens,
+                                        const int* seq_offsets,
+                                        int kv_heads,
+                                        const int* cache_offsets,
+                                        RotaryTable rope)
 {
-    int d0_stride = hidden_dim * seq_length;
-    int d1_stride = hidden_dim;
     int d2_stride = hidden_dim / heads;
+    // A token holds the Q of all heads followed by the K and V of the kv_heads KV heads.
+    int kv_dim = kv_heads * d2_stride;
+    int d1_stride = hidden_dim + (gridDim.z / head_ext - 1) * kv_dim;
+    int d0_stride = d1_stride * seq_length;
 
     int d0 = blockIdx.x;                                                  // Batch
     int d1 = blockIdx.y;                                                  // Sequence ID (0-127)
@@ -36,40 +96,41 @@ __global__ void bias_add_transform_0213(float* output,
     int d2 = threadIdx.y + (blockIdx.z % head_ext) * (heads / head_ext);  // Head (0-11)
     int d3 = threadIdx.x;                                                 // Values (groups of 4)
 
+    if (cnt > 0 && d2 >= kv_heads) return;
+
     int d2_out_stride = d2_stride * (cnt == 0 ? seq_length : max_out_tokens);
-    int d0_out_stride = hidden_dim * (cnt == 0 ? seq_length : max_out_tokens);
+    int d0_out_stride = (cnt == 0 ? hidden_dim * seq_length : kv_dim * max_out_tokens);
 
     const float4* vals_vec = reinterpret_cast<const float4*>(vals);
     float4* output_vec =
         reinterpret_cast<float4*>(cnt == 0 ? output : (cnt == 1 ? k_cache : v_cache));
 
-    vals_vec += (d0 * d0_stride * (gridDim.z / head_ext));
-    vals_vec += (d1 * d1_stride * (gridDim.z / head_ext));
-    vals_vec += (cnt * d1_stride);
+    vals_vec += (d0 * d0_stride);
+    vals_vec += (d1 * d1_stride);
+    vals_vec += (cnt == 0 ? 0 : hidden_dim + (cnt - 1) * kv_dim);
     vals_vec += (d2 * d2_stride);
 
     output_vec += (d1 * d2_stride);
     output_vec += (d0 * d0_out_stride);
     output_vec += (d2 * d2_out_stride);
+    // K/V written at a position read from device memory, see InferenceContext::SetDevicePositions.
+    if (cnt > 0 && cache_offsets) output_vec += cache_offsets[d0] * d2_stride;
 
-    unsigned seq_id = d1 + seq_offset;
-    float4 inputs = vals_vec[d3];
-    int lane = d3 & 0x1f;
-    if (cnt < 2 && rotary_dim > 0 && d3 < rotary_dim) {
+    // A ragged batch gives every sequence its own start position.
+    unsigned seq_id = d1 + (seq_offsets ? seq_offsets[d0] : seq_offset);
+    if (cnt < 2 && (rotate_half || rotate_every_two) && (d3 << 2) + 4 <= rotary_dim) {
         float4 q = vals_vec[d3];
-        float2* q_f = reinterpret_cast<float2*>(&q);
-        if (rotate_every_two) {
-#pragma unroll
-            for (int o = 0; o < 2; o++) {
-                float inv_freq = (float)(((d3 << 1) + o) * 2) / (float)(rotary_dim << 2);
-                inv_freq = 1.0 / powf(10000.0, inv_freq) * (float)seq_id;
-                q_f[o].x = (-1.0 * q_f[o].y * sinf(inv_freq) + q_f[o].x * cosf(inv_freq));
-                q_f[o].y = (q_f[o].x * sinf(inv_freq) + q_f[o].y * cosf(inv_freq));
-            }
-        }
+        float4 other = rotate_half ? vals_vec[rotary::partner(d3, rotary_dim >> 3)] : q;
+        rotary::apply<4>(reinterpret_cast<float*>(&q),
+                         reinterpret_cast<const float*>(&other),
+                         d3 << 2,
+                         rotary_dim,
+                         rotate_half,
+                         seq_id,
+                         rope);
         output_vec[d3] = q;
     } else
-        output_vec[d3] = inputs;
+        output_vec[d3] = vals_vec[d3];
 }
 
 #define ATTN_H 3
@@ -89,12 +150,17 @@ __global__ void bias_add_transform_0213(__half* output,  // q
                                         bool rotate_half,
                                         bool rotate_every_two,
                                         int head_ext,
-                                        int max_out_tokens)
+                                        int max_out_tokens,
+                                        const int* seq_offsets,
+                                        int kv_heads,
+                                        const int* cache_offsets,
+                                        RotaryTable rope)
 {
-    unsigned half_dim = (rotary_dim << 3) >> 1;
-    int d0_stride = hidden_dim * seq_length;
-    int d1_stride = hidden_dim;
     int d2_stride = hidden_dim / heads;
+    // A token holds the Q of all heads followed by the K and V of the kv_heads KV heads.
+    int kv_dim = kv_heads * d2_stride;
+    int d1_stride = hidden_dim + (gridDim.z / head_ext - 1) * kv_dim;
+    int d0_stride = d1_stride * seq_length;
 
     int d0 = blockIdx.x;                                                  // Batch
     int d1 = blockIdx.y;                                                  // Sequence ID (0-127)
@@ -102,8 +168,10 @@ __global__ void bias_add_transform_0213(__half* output,  // q
     int d2 = threadIdx.y + (blockIdx.z % head_ext) * (heads / head_ext);  // Head (0-11)
     int d3 = threadIdx.x;                                                 // Values (groups of 4)
 
+    if (cnt > 0 && d2 >= kv_heads) return;
+
     int d2_out_stride = d2_stride * (cnt == 0 ? seq_length : max_out_tokens);
-    int d0_out_stride = hidden_dim * (cnt == 0 ? seq_length : max_out_tokens);
+    int d0_out_stride = (cnt == 0 ? hidden_dim * seq_length : kv_dim * max_out_tokens);
 
     float4 vals_arr;
     float4 output_arr;
@@ -115,33 +183,38 @@ __global__ void bias_add_transform_0213(__half* output,  // q
     float4* output_vec =
         reinterpret_cast<float4*>(cnt == 0 ? output : (cnt == 1 ? k_cache : v_cache));
 
-    vals_vec += (d0 * d0_stride * (gridDim.z / head_ext));
-    vals_vec += (d1 * d1_stride * (gridDim.z / head_ext));
-    vals_vec += (cnt * d1_stride);
+    vals_vec += (d0 * d0_stride);
+    vals_vec += (d1 * d1_stride);
+    vals_vec += (cnt == 0 ? 0 : hidden_dim + (cnt - 1) * kv_dim);
     vals_vec += (d2 * d2_stride);
 
     output_vec += (d1 * d2_stride);
     output_vec += (d0 * d0_out_stride);
     output_vec += (d2 * d2_out_stride);
+    // K/V written at a position read from device memory, see InferenceContext::SetDevicePositions.
+    if (cnt > 0 && cache_offsets) output_vec += cache_offsets[d0] * d2_stride;
 
-    unsigned seq_id = d1 + seq_offset;
+    // A ragged batch gives every sequence its own start position.
+    unsigned seq_id = d1 + (seq_offsets ? seq_offsets[d0] : seq_offset);
 
-    int lane = d3 & 0x1f;
-    if (cnt < 2 && rotary_dim > 0 && d3 < rotary_dim) {
+    if (cnt < 2 && (rotate_half || rotate_every_two) && (d3 << 3) + 8 <= rotary_dim) {
         float4 q = vals_vec[d3];
+        float4 other = rotate_half ? vals_vec[rotary::partner(d3, rotary_dim >> 4)] : q;
         __half2* q_h = reinterpret_cast<__half2*>(&q);
-        if (rotate_every_two) {
+        const __half2* other_h = reinterpret_cast<const __half2*>(&other);
+        float q_f[8], other_f[8];
 #pragma unroll
-            for (int o = 0; o < 4; o++) {
-                float inv_freq = (float)(((d3 << 2) + o) * 2) / (float)(rotary_dim << 3);
-                inv_freq = 1.0 / powf(10000.0, inv_freq) * (float)seq_id;
-                float q_data[2];
-                q_data[0] = (float)q_h[o].x;
-                q_data[1] = (float)q_h[o].y;
-                q_h[o].x = (__half)(-1.0 * q_data[1] * sinf(inv_freq) + q_data[0] * cosf(inv_freq));
-                q_h[o].y = (__half)(q_data[0] * sinf(inv_freq) + q_data[1] * cosf(inv_freq));
-            }
+        for (int o = 0; o < 4; o++) {
+            const float2 q_pair = __half22float2(q_h[o]);
+            const float2 other_pair = __half22float2(other_h[o]);
+            q_f[2 * o] = q_pair.x;
+            q_f[2 * o + 1] = q_pair.y;
+            other_f[2 * o] = other_pair.x;
+            other_f[2 * o + 1] = other_pair.y;
         }
+        rotary::apply<8>(q_f, other_f, d3 << 3, rotary_dim, rotate_half, seq_id, rope);
+#pragma unroll
+        for (int o = 0; o < 4; o++) q_h[o] = __floats2half2_rn(q_f[2 * o], q_f[2 * o + 1]);
         output_vec[d3] = q;
     } else
         output_vec[d3] = vals_vec[d3];
@@ -165,10 +238,16 @@ void launch_bias_add_transform_0213<float>(float* output,
                                            bool rotate_every_two,
                                            cudaStream_t stream,
                                            int trans_count,
-                                           int max_out_tokens)
+                                           int max_out_tokens,
+                                           const int* seq_offsets,
+                                           int kv_heads,
+                                           const int* cache_offsets,
+                                           RotaryTable rope)
 {
     hidden_dim >>= 2;
     int head_ext = (hidden_dim - 1) / MAX_THREADS + 1;
+    // Otherwise the caller rotates with launch_apply_rotary_pos_emb.
+    const bool fuse_half = transform_fuses_rotary<float>(rotary_dim, rotate_half);
 
     dim3 block_dim(hidden_dim / heads, (heads / head_ext));
     dim3 grid_dim(batch_size, seq_length, (trans_count * head_ext));
@@ -182,11 +261,15 @@ void launch_bias_add_transform_0213<float>(float* output,
                                                                 seq_length,
                                                                 seq_offset,
                                                                 heads,
-                                                                rotary_dim >> 2,
-                                                                rotate_half,
+                                                                rotary_dim,
+                                                                rotate_half && fuse_half,
                                                                 rotate_every_two,
                                                                 head_ext,
-                                                                max_out_tokens);
+                                                                max_out_tokens,
+                                                                seq_offsets,
+                                                                (kv_heads ? kv_heads : heads),
+                                                                cache_offsets,
+                                                                rope);
 }
 template <typename T>
 void launch_bias_add_transform_0213(T* outputs,
@@ -205,7 +288,11 @@ void launch_bias_add_transform_0213(T* outputs,
                                     bool rotate_every_two,
                                     cudaStream_t stream,
                                     int trans_count,
-                                    int max_out_tokens);
+                                    int max_out_tokens,
+                                    const int* seq_offsets,
+                                    int kv_heads,
+                                    const int* cache_offsets,
+                                    RotaryTable rope);
 template <>
 void launch_bias_add_transform_0213<__half>(__half* output,
                                             __half* k_cache,
@@ -223,10 +310,15 @@ void launch_bias_add_transform_0213<__half>(__half* output,
                                             bool rotate_every_two,
                                             cudaStream_t stream,
                                             int trans_count,
-                                            int max_out_tokens)
+                                            int max_out_tokens,
+                                            const int* seq_offsets,
+                                            int kv_heads,
+                                            const int* cache_offsets,
+                                            RotaryTable rope)
 {
     hidden_dim >>= 3;
     int head_ext = 1;  // (hidden_dim - 1) / MAX_THREADS + 1;
+    const bool fuse_half = transform_fuses_rotary<__half>(rotary_dim, rotate_half);
     dim3 block_dim(hidden_dim / heads, (heads / head_ext));
     dim3 grid_dim(batch_size, seq_length, (trans_count * head_ext));
     bias_add_transform_0213<<<grid_dim, block_dim, 0, stream>>>(output,
@@ -239,11 +331,15 @@ void launch_bias_add_transform_0213<__half>(__half* output,
                                                                 seq_offset,
                                                                 all_tokens,
                                                                 heads,
-                                                                rotary_dim >> 3,
-                                                                rotate_half,
+                                                                rotary_dim,
+                                                                rotate_half && fuse_half,
                                                                 rotate_every_two,
                                                                 head_ext,
-                                                                max_out_tokens);
+                                                                max_out_tokens,
+                                                                seq_offsets,
+                                                                (kv_heads ? kv_heads : heads),
+                                                                cache_offsets,
+                                                                rope);
 }
 
 // Bias add
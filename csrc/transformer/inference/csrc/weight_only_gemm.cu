@@ -0,0 +1,356 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#include "conversion_utils.h"
+#include "inference_cuda_layers.h"
+
+namespace wo_gemm {
+
+// Weights dequantized per load, they always share one scale.
+constexpr int chunk = 8;
+
+constexpr int gemv_warps = 8;
+constexpr int gemv_threads = gemv_warps * WARP_SIZE;
+
+constexpr int tile_m = 64;
+constexpr int tile_n = 64;
+constexpr int tile_k = 32;
+constexpr int tile_threads = 256;
+// Every thread computes a 4x4 block of the output tile.
+constexpr int thread_dim = 16;
+constexpr int thread_tile = tile_m / thread_dim;
+
+DS_D_INLINE void load_chunk(float (&dst)[chunk], const float* src)
+{
+    const float4* src_vec = reinterpret_cast<const float4*>(src);
+    const float4 low = src_vec[0];
+    const float4 high = src_vec[1];
+    dst[0] = low.x;
+    dst[1] = low.y;
+    dst[2] = low.z;
+    dst[3] = low.w;
+    dst[4] = high.x;
+    dst[5] = high.y;
+    dst[6] = high.z;
+    dst[7] = high.w;
+}
+
+DS_D_INLINE void load_chunk(float (&dst)[chunk], const __half* src)
+{
+    const float4 raw = *reinterpret_cast<const float4*>(src);
+    const __half2* halves = reinterpret_cast<const __half2*>(&raw);
+#pragma unroll
+    for (int i = 0; i < chunk / 2; i++) {
+        const float2 vals = __half22float2(halves[i]);
+        dst[2 * i] = vals.x;
+        dst[2 * i + 1] = vals.y;
+    }
+}
+
+// Weights chunk .. chunk + 7 of a row, int8 as signed bytes, int4 as unsigned nibbles with the
+// even weight in the low nibble.
+template <int Bits>
+DS_D_INLINE void dequantize_chunk(float (&dst)[chunk],
+                                  const uint8_t* row,
+                                  int k,
+                                  float scale,
+                                  float zero)
+{
+    if (Bits == 8) {
+        const uint2 raw = *reinterpret_cast<const uint2*>(row + k);
+        const int8_t* q = reinterpret_cast<const int8_t*>(&raw);
+#pragma unroll
+        for (int i = 0; i < chunk; i++) dst[i] = ((float)q[i] - zero) * scale;
+    } else {
+        const uint32_t raw = *reinterpret_cast<const uint32_t*>(row + k / 2);
+#pragma unroll
+        for (int i = 0; i < chunk; i++) dst[i] = ((float)((raw >> (4 * i)) & 0xf) - zero) * scale;
+    }
+}
+
+// Zero point of the weights without explicit zeros: symmetric int8, int4 centered on 8.
+template <int Bits>
+DS_D_INLINE float default_zero()
+{
+    return Bits == 8 ? 0.f : 8.f;
+}
+
+}  // namespace wo_gemm
+
+/*
+Weight only quantized GEMM, output[rows, out_features] = input[rows, in_features] times the
+transpose of the weight [out_features, in_features], dequantized on the fly so it is read once, in
+its quantized size. Every in_features / group_size weights of an output channel share a fp32
+scale, and a zero point when zeros is given, at
+    (n / scale_rows) * (in_features / group_size) + k / group_size
+scale_rows is 1 for per channel groups (GPTQ/AWQ style), larger when channels share their scales.
+
+For decode sized inputs each warp streams one weight row and keeps the dot products with all input
+rows, the GEMM is bound by reading the weight.
+*/
+template <typename T, int Bits>
+__global__ void weight_only_gemv(T* output,
+                                 const T* input,
+                                 const uint8_t* weight,
+                                 const float* scales,
+                                 const float* zeros,
+                                 int rows,
+                                 int out_features,
+                                 int in_features,
+                                 int group_size,
+                                 int scale_rows)
+{
+    const int warp_id = threadIdx.x / WARP_SIZE;
+    const int lane = threadIdx.x % WARP_SIZE;
+    const int n = blockIdx.x * wo_gemm::gemv_warps + warp_id;
+    if (n >= out_features) return;
+
+    const int k_groups = in_features / group_size;
+    const size_t scale_offset = (size_t)(n / scale_rows) * k_groups;
+    const uint8_t* row = weight + (size_t)n * in_features * Bits / 8;
+
+    float acc[WEIGHT_ONLY_GEMV_MAX_ROWS];
+#pragma unroll
+    for (int r = 0; r < WEIGHT_ONLY_GEMV_MAX_ROWS; r++) acc[r] = 0.f;
+
+    for (int k = lane * wo_gemm::chunk; k < in_features; k += WARP_SIZE * wo_gemm::chunk) {
+        const int group = k / group_size;
+        float w[wo_gemm::chunk];
+        wo_gemm::dequantize_chunk<Bits>(
+            w,
+            row,
+            k,
+            scales[scale_offset + group],
+            zeros ? zeros[scale_offset + group] : wo_gemm::default_zero<Bits>());
+#pragma unroll
+        for (int r = 0; r < WEIGHT_ONLY_GEMV_MAX_ROWS; r++) {
+            if (r < rows) {
+                float x[wo_gemm::chunk];
+                wo_gemm::load_chunk(x, input + (size_t)r * in_features + k);
+#pragma unroll
+                for (int i = 0; i < wo_gemm::chunk; i++) acc[r] += w[i] * x[i];
+            }
+        }
+    }
+
+#pragma unroll
+    for (int r = 0; r < WEIGHT_ONLY_GEMV_MAX_ROWS; r++) {
+        if (r < rows) {
+            float sum = acc[r];
+#pragma unroll
+            for (int j = WARP_SIZE / 2; j > 0; j >>= 1) sum += __shfl_xor_sync(0xffffffff, sum, j);
+            if (lane == 0) output[(size_t)r * out_features + n] = conversion::to<T>(sum);
+        }
+    }
+}
+
+/*
+weight_only_gemv for larger inputs: a block computes a tile_m x tile_n tile of the output,
+staging tile_k deep slices of the input and of the weight, dequantized while they are written,
+in shared memory.
+*/
+template <typename T, int Bits>
+__global__ void weight_only_gemm_tiled(T* output,
+                                       const T* input,
+                                       const uint8_t* weight,
+                                       const float* scales,
+                                       const float* zeros,
+                                       int rows,
+                                       int out_features,
+                                       int in_features,
+                                       int group_size,
+                                       int scale_rows)
+{
+    // Padded so the transposing stores don't conflict.
+    __shared__ float input_tile[wo_gemm::tile_k][wo_gemm::tile_m + 1];
+    __shared__ float weight_tile[wo_gemm::tile_k][wo_gemm::tile_n + 1];
+
+    const int m_start = blockIdx.y * wo_gemm::tile_m;
+    const int n_start = blockIdx.x * wo_gemm::tile_n;
+    const int tx = threadIdx.x % wo_gemm::thread_dim;
+    const int ty = threadIdx.x / wo_gemm::thread_dim;
+
+    // Each thread loads one chunk of an input row and of a weight row per slice.
+    const int load_row = threadIdx.x / (wo_gemm::tile_k / wo_gemm::chunk);
+    const int load_k = (threadIdx.x % (wo_gemm::tile_k / wo_gemm::chunk)) * wo_gemm::chunk;
+    const int m = m_start + load_row;
+    const int n = n_start + load_row;
+    const int k_groups = in_features / group_size;
+    const size_t scale_offset = (size_t)(n / scale_rows) * k_groups;
+    const uint8_t* weight_row = weight + (size_t)n * in_features * Bits / 8;
+
+    float acc[wo_gemm::thread_tile][wo_gemm::thread_tile];
+#pragma unroll
+    for (int i = 0; i < wo_gemm::thread_tile; i++)
+#pragma unroll
+        for (int j = 0; j < wo_gemm::thread_tile; j++) acc[i][j] = 0.f;
+
+    for (int k_start = 0; k_start < in_features; k_start += wo_gemm::tile_k) {
+        const int k = k_start + load_k;
+        float x[wo_gemm::chunk];
+        float w[wo_gemm::chunk];
+        if (m < rows && k < in_features) {
+            wo_gemm::load_chunk(x, input + (size_t)m * in_features + k);
+        } else {
+#pragma unroll
+            for (int i = 0; i < wo_gemm::chunk; i++) x[i] = 0.f;
+        }
+        if (n < out_features && k < in_features) {
+            const int group = k / group_size;
+            wo_gemm::dequantize_chunk<Bits>(
+                w,
+                weight_row,
+                k,
+                scales[scale_offset + group],
+                zeros ? zeros[scale_offset + group] : wo_gemm::default_zero<Bits>());
+        } else {
+#pragma unroll
+            for (int i = 0; i < wo_gemm::chunk; i++) w[i] = 0.f;
+        }
+#pragma unroll
+        for (int i = 0; i < wo_gemm::chunk; i++) {
+            input_tile[load_k + i][load_row] = x[i];
+            weight_tile[load_k + i][load_row] = w[i];
+        }
+        __syncthreads();
+
+#pragma unroll
+        for (int kk = 0; kk < wo_gemm::tile_k; kk++) {
+            float a[wo_gemm::thread_tile];
+            float b[wo_gemm::thread_tile];
+#pragma unroll
+            for (int i = 0; i < wo_gemm::thread_tile; i++) {
+                a[i] = input_tile[kk][ty + i * wo_gemm::thread_dim];
+                b[i] = weight_tile[kk][tx + i * wo_gemm::thread_dim];
+            }
+#pragma unroll
+            for (int i = 0; i < wo_gemm::thread_tile; i++)
+#pragma unroll
+                for (int j = 0; j < wo_gemm::thread_tile; j++) acc[i][j] += a[i] * b[j];
+        }
+        __syncthreads();
+    }
+
+#pragma unroll
+    for (int i = 0; i < wo_gemm::thread_tile; i++) {
+        const int out_m = m_start + ty + i * wo_gemm::thread_dim;
+        if (out_m >= rows) continue;
+#pragma unroll
+        for (int j = 0; j < wo_gemm::thread_tile; j++) {
+            const int out_n = n_start + tx + j * wo_gemm::thread_dim;
+            if (out_n < out_features)
+                output[(size_t)out_m * out_features + out_n] = conversion::to<T>(acc[i][j]);
+        }
+    }
+}
+
+template <typename T, int Bits>
+void launch_weight_only_gemm_bits(T* output,
+                                  const T* input,
+                                  const uint8_t* weight,
+                                  const float* scales,
+                                  const float* zeros,
+                                  int rows,
+                                  int out_features,
+                                  int in_features,
+                                  int group_size,
+                                  int scale_rows,
+                                  cudaStream_t stream)
+{
+    if (rows <= WEIGHT_ONLY_GEMV_MAX_ROWS) {
+        dim3 block_dim(wo_gemm::gemv_threads);
+        dim3 grid_dim((out_features + wo_gemm::gemv_warps - 1) / wo_gemm::gemv_warps);
+        weight_only_gemv<T, Bits><<<grid_dim, block_dim, 0, stream>>>(output,
+                                                                      input,
+                                                                      weight,
+                                                                      scales,
+                                                                      zeros,
+                                                                      rows,
+                                                                      out_features,
+                                                                      in_features,
+                                                                      group_size,
+                                                                      scale_rows);
+    } else {
+        dim3 block_dim(wo_gemm::tile_threads);
+        dim3 grid_dim((out_features + wo_gemm::tile_n - 1) / wo_gemm::tile_n,
+                      (rows + wo_gemm::tile_m - 1) / wo_gemm::tile_m);
+        weight_only_gemm_tiled<T, Bits><<<grid_dim, block_dim, 0, stream>>>(output,
+                                                                            input,
+                                                                            weight,
+                                                                            scales,
+                                                                            zeros,
+                                                                            rows,
+                                                                            out_features,
+                                                                            in_features,
+                                                                            group_size,
+                                                                            scale_rows);
+    }
+}
+
+template <typename T>
+void launch_weight_only_gemm(T* output,
+                             const T* input,
+                             const uint8_t* weight,
+                             const float* scales,
+                             const float* zeros,
+                             int rows,
+                             int out_features,
+                             int in_features,
+                             int bits,
+                             int group_size,
+                             int scale_rows,
+                             cudaStream_t stream)
+{
+    assert(in_features % wo_gemm::chunk == 0 && group_size % wo_gemm::chunk == 0);
+    if (bits == 4)
+        launch_weight_only_gemm_bits<T, 4>(output,
+                                           input,
+                                           weight,
+                                           scales,
+                                           zeros,
+                                           rows,
+                                           out_features,
+                                           in_features,
+                                           group_size,
+                                           scale_rows,
+                                           stream);
+    else
+        launch_weight_only_gemm_bits<T, 8>(output,
+                                           input,
+                                           weight,
+                                           scales,
+                                           zeros,
+                                           rows,
+                                           out_features,
+                                           in_features,
+                                           group_size,
+                                           scale_rows,
+                                           stream);
+}
+
+template void launch_weight_only_gemm<float>(float*,
+                                             const float*,
+                                             const uint8_t*,
+                                             const float*,
+                                             const float*,
+                                             int,
+                                             int,
+                                             int,
+                                             int,
+                                             int,
+                                             int,
+                                             cudaStream_t);
+template void launch_weight_only_gemm<__half>(__half*,
+                                              const __half*,
+                                              const uint8_t*,
+                                              const float*,
+                                              const float*,
+                                              int,
+                                              int,
+                                              int,
+                                              int,
+                                              int,
+                                              int,
+                                              cudaStream_t);
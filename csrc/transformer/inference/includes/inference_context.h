@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <ATen/ATen.h>
+#include <c10/cuda/CUDACachingAllocator.h>
 #include <c10/cuda/CUDAStream.h>
 #include <cuda_runtime_api.h>
 #include <cassert>
@@ -12,12 +14,19 @@
 #include <vector>
 #include "cublas_v2.h"
 #include "cuda.h"
+#include "ds_kernel_utils.h"
+#include "paged_kv_cache.h"
+#ifdef FP8_AVAILABLE
+#include <cublasLt.h>
+#endif
 
 #define MEGABYTE (1024 * 1024)
 #define GIGABYTE (1024 * 1024 * 1024)
 
 // TODO: refactor out
 #define WARP_SIZE 32
+#define FLASH_ATTN_MAX_HEAD_SIZE 128
+#define DECODE_ATTN_MAX_SPLITS 32
 
 #define CUDA_CHECK(callstr)                                                                    \
     {                                                                                          \
@@ -56,7 +65,16 @@ public:
           _free_memory_size(0),
           _num_tokens(1),
           _attention_unfused_workspace_offset(0),
-          _workSpaceSize(0)
+          _decode_partials_offset(0),
+          _device_positions_offset(0),
+          _device_positions(false),
+          _max_batch_size(0),
+          _append_tokens(false),
+          _flash_prefill(false),
+          _rope_theta(10000.f),
+          _rope_scale(1.f),
+          _workSpaceSize(0),
+          _workspace_capacity(0)
     {
         _workSpaceSize = 0;
         _workspace = 0;
@@ -77,17 +95,49 @@ public:
     virtual ~InferenceContext()
     {
         cublasDestroy(_cublasHandle);
-        cudaFree(_workspace);
+#ifdef FP8_AVAILABLE
+        if (_cublasLtHandle) cublasLtDestroy(_cublasLtHandle);
+#endif
+        release_workspace();
         cudaEventDestroy(_comp1_event);
         cudaEventDestroy(_comp2_event);
         cudaEventDestroy(_comp_event);
         cudaEventDestroy(_comm_event);
     }
 
-    static InferenceContext& Instance()
+    /*
+    Contexts are numbered, 0 is the one every model starts with. Instance() is the context
+    selected on the calling thread, so models that each select their own context before running
+    get their own workspace, KV cache and token count. The contexts are never destroyed at exit,
+    their workspace comes from the PyTorch caching allocator, which may already be gone by then.
+    */
+    static InferenceContext& Instance() { return *Current(); }
+
+    static int Create()
+    {
+        auto& contexts = Contexts();
+        contexts.push_back(new InferenceContext());
+        return contexts.size() - 1;
+    }
+
+    static void Select(int id) { Current() = Get(id); }
+
+    // The context must not be selected on another thread.
+    static void Destroy(int id)
     {
-        static InferenceContext _ctx;
-        return _ctx;
+        if (id == 0) throw std::runtime_error("The default inference context can't be destroyed.");
+        InferenceContext* context = Get(id);
+        if (Current() == context) Current() = Contexts()[0];
+        Contexts()[id] = nullptr;
+        delete context;
+    }
+
+    static int CurrentId()
+    {
+        auto& contexts = Contexts();
+        for (size_t id = 0; id < contexts.size(); id++)
+            if (contexts[id] == Current()) return id;
+        return -1;
     }
 
     void GenWorkSpace(const unsigned& num_layers,
@@ -100,8 +150,14 @@ public:
                       const size_t& elem_size,
                       const unsigned& rank,
                       unsigned max_out_tokens,
-                      unsigned min_out_tokens)
+                      unsigned min_out_tokens,
+                      unsigned kv_block_tokens = 0,
+                      size_t kv_blocks = 0,
+                      bool kv_int8 = false,
+                      unsigned num_kv_heads = 0)
     {
+        // 0 means one KV head per query head, fewer than num_heads groups the query heads.
+        if (!num_kv_heads) num_kv_heads = num_heads;
         size_t total_size;
         if (!_free_memory_size) { cudaMemGetInfo(&_free_memory_size, &total_size); }
 
@@ -112,12 +168,23 @@ public:
         const int effective_head_size = (head_size > 128) ? head_size : padded_head_size;
 
         size_t activation_size = 10 * (num_heads * effective_head_size) * batch_size;
+        // The prompt scores only go through the workspace without the fused prefill attention,
+        // otherwise a single row of scores per head is left for the decode steps.
+        _flash_prefill = head_size <= FLASH_ATTN_MAX_HEAD_SIZE;
         // Other sequence length dimension is added when the final workSpaceSize is calculated
         size_t temp_size = batch_size * (num_heads / mp_size) * max_out_tokens;
-        size_t cache_size =
-            num_layers * batch_size * ((num_heads * effective_head_size) / mp_size) * 2;
-        size_t minimal_requirements =
-            temp_size + (_free_memory_size > GIGABYTE ? 500 : 100) * MEGABYTE;
+        const size_t temp_rows = _flash_prefill ? 0 : temp_size;
+        // With a paged KV cache the workspace only keeps the K/V of the tokens of the current
+        // layer, as scratch for the prompt attention, the cache itself lives in the block pool.
+        const bool paged = kv_block_tokens > 0;
+        size_t cache_size = (paged ? 1 : num_layers) * batch_size *
+                            ((num_kv_heads * effective_head_size) / mp_size) * 2;
+        // fp32 partial outputs and (max, sum) pairs of the split decode attention.
+        const size_t decode_partials_size = batch_size * (num_heads / mp_size) *
+                                            DECODE_ATTN_MAX_SPLITS * (head_size + 2) *
+                                            sizeof(float);
+        size_t minimal_requirements = temp_size + decode_partials_size +
+                                      (_free_memory_size > GIGABYTE ? 500 : 100) * MEGABYTE;
         if (_free_memory_size < minimal_requirements) {
             printf("Requested:\t%lu\nFree:\t%lu\nTotal:\t%lu\n",
                    minimal_requirements,
@@ -127,12 +194,18 @@ public:
         }
 
         _max_seq_len = ((_free_memory_size - minimal_requirements) / elem_size) /
-                       (activation_size + temp_size + cache_size);
+                       (activation_size + temp_rows + cache_size);
         _max_seq_len = std::min((size_t)max_out_tokens, _max_seq_len);
-        size_t workSpaceSize = ((external_cache ? (activation_size + temp_size)
-                                                : (activation_size + temp_size + cache_size))) *
-                               _max_seq_len * elem_size;
-        temp_size *= _max_seq_len * elem_size;
+        temp_size *= (_flash_prefill ? 1 : _max_seq_len) * elem_size;
+        size_t workSpaceSize = ((external_cache && !paged ? (activation_size + temp_rows)
+                                                : (activation_size + temp_rows + cache_size))) *
+                                   _max_seq_len * elem_size +
+                               (_flash_prefill ? temp_size : 0);
+        const size_t decode_partials_offset = (workSpaceSize + 15) & ~(size_t)15;
+        // The decode position of each sequence when it is read from device memory.
+        const size_t device_positions_offset =
+            (decode_partials_offset + decode_partials_size + 15) & ~(size_t)15;
+        workSpaceSize = device_positions_offset + batch_size * sizeof(int);
 
         if (_max_seq_len < min_out_tokens) {
             printf(
@@ -143,14 +216,14 @@ public:
             throw std::runtime_error("Workspace can't be allocated, not enough memory");
         }
 
-        if (!_workspace) {
-            assert(_workspace == nullptr);
-            cudaMalloc(&_workspace, workSpaceSize);
-        } else if (_workSpaceSize < workSpaceSize) {
-            cudaFree(_workspace);
-            cudaMalloc(&_workspace, workSpaceSize);
+        // A smaller shape keeps the buffer, a larger one swaps it through the caching allocator,
+        // which reuses a cached block when it has one instead of going to cudaMalloc/cudaFree.
+        const bool grow = !_workspace || _workspace_capacity < workSpaceSize;
+        if (grow) {
+            release_workspace();
+            AllocateWorkspace(workSpaceSize);
         }
-        if (rank == 0 && (!_workspace || _workSpaceSize < workSpaceSize))
+        if (rank == 0 && grow)
             printf(
                 "------------------------------------------------------\n"
                 "Free memory : %f (GigaBytes)  \n"
@@ -173,18 +246,91 @@ public:
             throw std::runtime_error("Workspace is null.");
         }
         _workSpaceSize = workSpaceSize;
-        _attention_unfused_workspace_offset = workSpaceSize - temp_size;
+        _max_batch_size = batch_size;
+        _attention_unfused_workspace_offset = decode_partials_offset - temp_size;
+        _decode_partials_offset = decode_partials_offset;
+        _device_positions_offset = device_positions_offset;
+
+        if (paged) {
+            const unsigned kv_heads = num_kv_heads / mp_size;
+            // An int8 block has one fp32 scale per token and head next to its elements.
+            const size_t token_bytes =
+                kv_int8 ? head_size * sizeof(int8_t) + sizeof(float) : head_size * elem_size;
+            const size_t block_bytes =
+                (size_t)num_layers * 2 * kv_heads * kv_block_tokens * token_bytes;
+            if (kv_blocks == 0) {
+                // Fill most of the memory left next to the workspace.
+                const size_t reserved = minimal_requirements + workSpaceSize;
+                const size_t left = _free_memory_size > reserved ? _free_memory_size - reserved : 0;
+                kv_blocks = (size_t)(0.9 * left) / block_bytes;
+            }
+            _paged_kv.Configure(
+                num_layers, kv_heads, head_size, kv_block_tokens, elem_size, kv_blocks, kv_int8);
+            if (rank == 0)
+                printf("Paged KV cache: %lu %sblocks of %u tokens (%f GigaBytes)\n",
+                       kv_blocks,
+                       (kv_int8 ? "int8 " : ""),
+                       kv_block_tokens,
+                       (float)(kv_blocks * block_bytes) / GIGABYTE);
+        } else {
+            _paged_kv.Release();
+        }
     }
     inline size_t GetMaxTokenLenght() const { return _max_seq_len; }
 
+    // Base of the rotary frequencies and the factor the positions are divided by (linear scaling).
+    void SetRotaryBase(float theta, float scale)
+    {
+        if (theta == _rope_theta && scale == _rope_scale) return;
+        _rope_theta = theta;
+        _rope_scale = scale;
+        _rotary_table = at::Tensor();
+    }
+    inline float rope_theta() const { return _rope_theta; }
+    inline float rope_scale() const { return _rope_scale; }
+
+    /*
+    Cos and sin of the rotary angles of every position the KV cache can hold, [positions,
+    rotary_dim / 2] (cos, sin) pairs, built on first use and kept while the shape and the base do
+    not change. The kernels compute the angles of later positions themselves.
+    */
+    const float2* GetRotaryTable(int rotary_dim)
+    {
+        if (rotary_dim <= 0) return nullptr;
+        const int64_t positions = std::max(_max_seq_len, (size_t)1);
+        if (!_rotary_table.defined() || _rotary_table.size(0) != positions ||
+            _rotary_table.size(1) != rotary_dim / 2) {
+            // In double, the angles of the long positions lose too much in float.
+            auto options = at::TensorOptions().dtype(at::kDouble).device(at::kCUDA);
+            auto exponents = at::arange(0, rotary_dim / 2 * 2, 2, options) / -rotary_dim;
+            auto inv_freq = at::pow((double)_rope_theta, exponents);
+            auto angles = at::outer(at::arange(positions, options) / (double)_rope_scale, inv_freq);
+            _rotary_table = at::stack({angles.cos(), angles.sin()}, -1).to(at::kFloat).contiguous();
+        }
+        return reinterpret_cast<const float2*>(_rotary_table.data_ptr<float>());
+    }
+    inline int rotary_table_positions() const
+    {
+        return _rotary_table.defined() ? (int)_rotary_table.size(0) : 0;
+    }
+
     cudaEvent_t GetCompEvent(int id) { return id == 1 ? _comp1_event : _comp2_event; }
 
     size_t get_workspace_size() const { return _workSpaceSize; }
+    size_t get_workspace_capacity() const { return _workspace_capacity; }
     void* GetWorkSpace() { return _workspace; }
+    PagedKVCache& GetPagedKVCache() { return _paged_kv; }
+    inline bool paged_kv() const { return _paged_kv.enabled(); }
+    inline bool flash_prefill() const { return _flash_prefill; }
     void* GetAttentionUnfusedWorkspace()
     {
         return (char*)_workspace + _attention_unfused_workspace_offset;
     }
+    float* GetDecodeAttentionWorkspace()
+    {
+        return (float*)((char*)_workspace + _decode_partials_offset);
+    }
+    int* GetDevicePositions() { return (int*)((char*)_workspace + _device_positions_offset); }
 
     inline unsigned new_token(unsigned layer_id)
     {
@@ -199,7 +345,69 @@ public:
 
     inline unsigned current_tokens() const { return _num_tokens; }
 
-    inline void advance_tokens() { _num_tokens++; }
+    inline void advance_tokens(unsigned tokens = 1) { _num_tokens += tokens; }
+
+    // Speculative decoding: the next forward appends its tokens, e.g. the draft tokens to verify,
+    // after the ones cached instead of starting a new prompt, each attending to the cache and to
+    // the new tokens before it. The flag holds for one forward, it is dropped after the last
+    // layer.
+    inline void SetAppendTokens() { _append_tokens = true; }
+    inline void ClearAppendTokens() { _append_tokens = false; }
+    inline bool append_tokens() const { return _append_tokens; }
+
+    // Drops the cached tokens after the first tokens ones of a uniform batch, e.g. the rejected
+    // draft tokens of a verify forward. Ragged batches truncate per sequence in the paged cache.
+    void TruncateTokens(unsigned tokens)
+    {
+        if (tokens + 1 > _num_tokens)
+            throw std::runtime_error("KV cache holds " + std::to_string(_num_tokens - 1) +
+                                     " tokens, can't truncate it to " + std::to_string(tokens));
+        _num_tokens = tokens + 1;
+    }
+
+    // Continuous batching over the paged KV cache: the next forward runs batch slot i as
+    // sequence seqs[i], bringing new_tokens[i] tokens after the ones it has cached (right padded
+    // to the longest). Prompts and decode steps of different sequences can share the batch. The
+    // description holds for one forward, it is dropped after the last layer.
+    void SetRaggedBatch(const std::vector<int>& seqs, const std::vector<int>& new_tokens)
+    {
+        if (!paged_kv())
+            throw std::runtime_error("Ragged batches need the paged KV cache.");
+        if (seqs.size() != new_tokens.size())
+            throw std::runtime_error("Ragged batch needs one token count per sequence.");
+        _batch_seqs = seqs;
+        _batch_new_tokens = new_tokens;
+    }
+    inline void ClearRaggedBatch()
+    {
+        _batch_seqs.clear();
+        _batch_new_tokens.clear();
+    }
+    inline bool ragged_batch() const { return !_batch_seqs.empty(); }
+
+    // Adapter of each sequence ([batch]) or token ([batch * tokens]) of the next forwards for the
+    // batched LoRA GEMMs, negative for the base model. An empty tensor disables the adapters.
+    void SetLoraAdapters(const at::Tensor& ids)
+    {
+        _lora_ids = ids.numel() > 0 ? ids.to(at::kCUDA, at::kInt).contiguous() : at::Tensor();
+    }
+    inline const at::Tensor& lora_adapters() const { return _lora_ids; }
+
+    // Decode steps of the dense KV cache take the position of each sequence from
+    // GetDevicePositions() instead of current_tokens(), and move it on themselves, so the launches
+    // of a step don't change from one token to the next and can be captured in a CUDA graph once
+    // and replayed. The prompt sets the positions to its length.
+    void SetDevicePositions(bool enabled)
+    {
+        if (enabled && paged_kv())
+            throw std::runtime_error("Device positions need the dense KV cache.");
+        _device_positions = enabled;
+    }
+    inline bool device_positions() const { return _device_positions; }
+    // Sequences GetDevicePositions() has room for.
+    inline unsigned max_batch_size() const { return _max_batch_size; }
+    inline const std::vector<int>& batch_sequences() const { return _batch_seqs; }
+    inline const std::vector<int>& batch_new_tokens() const { return _batch_new_tokens; }
 
     cudaStream_t GetCommStream(bool async_op = false)
     {
@@ -219,19 +427,40 @@ public:
         return stream;
     }
 
+    // The workspace goes back to the caching allocator, where PyTorch tensors and the other
+    // contexts can use it until it is retaken.
     void release_workspace()
     {
-        cudaFree(_workspace);
+        if (_workspace) {
+            // The kernels may still run on the comm stream, cudaFree used to wait for them too.
+            cudaDeviceSynchronize();
+            c10::cuda::CUDACachingAllocator::raw_delete(_workspace);
+        }
         _workspace = nullptr;
+        _workspace_capacity = 0;
     }
     bool retake_workspace()
     {
         if (_workspace != nullptr || _workSpaceSize == 0) return true;
-        cudaMalloc(&_workspace, _workSpaceSize);
+        AllocateWorkspace(_workSpaceSize);
         return _workspace != nullptr;
     }
+    size_t get_workspace_capacity() const { return _workspace_capacity; }
     cublasHandle_t GetCublasHandle() { return _cublasHandle; }
 
+#ifdef FP8_AVAILABLE
+    // Only the fp8 GEMMs go through cublasLt, so its handle is created on first use.
+    cublasLtHandle_t GetCublasLtHandle()
+    {
+        if (!_cublasLtHandle && cublasLtCreate(&_cublasLtHandle) != CUBLAS_STATUS_SUCCESS) {
+            auto message = std::string("Fail to create cublasLt handle.");
+            std::cerr << message << std::endl;
+            throw std::runtime_error(message);
+        }
+        return _cublasLtHandle;
+    }
+#endif
+
     std::pair<uint64_t, uint64_t> IncrementOffset(uint64_t offset_inc)
     {
         uint64_t offset = _curr_offset;
@@ -255,7 +484,42 @@ public:
     }
 
 private:
+    static std::vector<InferenceContext*>& Contexts()
+    {
+        static std::vector<InferenceContext*>* contexts =
+            new std::vector<InferenceContext*>{new InferenceContext()};
+        return *contexts;
+    }
+
+    static InferenceContext*& Current()
+    {
+        thread_local InferenceContext* current = Contexts()[0];
+        return current;
+    }
+
+    static InferenceContext* Get(int id)
+    {
+        auto& contexts = Contexts();
+        if (id < 0 || id >= (int)contexts.size() || !contexts[id])
+            throw std::runtime_error("No inference context " + std::to_string(id) + ".");
+        return contexts[id];
+    }
+
+    void AllocateWorkspace(size_t size)
+    {
+        try {
+            _workspace = c10::cuda::CUDACachingAllocator::raw_alloc(size);
+        } catch (const c10::Error&) {
+            // Out of memory, reported as a null workspace like a failed cudaMalloc.
+            _workspace = nullptr;
+        }
+        _workspace_capacity = _workspace ? size : 0;
+    }
+
     cublasHandle_t _cublasHandle;
+#ifdef FP8_AVAILABLE
+    cublasLtHandle_t _cublasLtHandle = nullptr;
+#endif
 
     cudaEvent_t _comp_event;
     cudaEvent_t _comm_event;
@@ -263,10 +527,23 @@ private:
     void* _workspace;
     // offset from _workspace for attention unfused memory
     size_t _attention_unfused_workspace_offset;
+    // offset from _workspace for the partial results of the split decode attention
+    size_t _decode_partials_offset;
+    // offset from _workspace for the per sequence positions of SetDevicePositions
+    size_t _device_positions_offset;
+    bool _device_positions;
+    unsigned _max_batch_size;
+    bool _append_tokens;
+    bool _flash_prefill;
+    float _rope_theta;
+    float _rope_scale;
+    at::Tensor _rotary_table;
     uint64_t _seed;
     uint64_t _curr_offset;
 
     size_t _workSpaceSize;
+    // Bytes actually allocated, at least _workSpaceSize once a larger shape was configured.
+    size_t _workspace_capacity;
     size_t _free_memory_size;
 
     size_t _max_seq_len;
@@ -284,4 +561,9 @@ private:
     cudaStream_t _comm_stream;
 
     std::unordered_map<int, int> _world_sizes;
+
+    PagedKVCache _paged_kv;
+    std::vector<int> _batch_seqs;
+    std::vector<int> _batch_new_tokens;
+    at::Tensor _lora_ids;
 };
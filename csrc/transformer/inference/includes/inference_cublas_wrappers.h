@@ -14,6 +14,51 @@
 #include <mma.h>
 #endif
 #include <stdio.h>
+#include "ds_kernel_utils.h"
+#include "gemm_algo_cache.h"
+#ifdef FP8_AVAILABLE
+#include <cublasLt.h>
+#endif
+
+#ifndef __HIP_PLATFORM_HCC__
+/*
+Algorithm for a GEMM asked to run with CUBLAS_GEMM_DEFAULT_TENSOR_OP, once autotuning is enabled
+(set_gemm_autotune): the fastest tensor op algorithm, from GemmAlgoCache or timed in place on the
+first call for the shape. n is the token count at the call sites, it is rounded up to a power of
+two so prompts of every length do not each start a search. Only GEMMs that overwrite C (beta == 0)
+can be timed in place.
+*/
+template <typename Func>
+cublasGemmAlgo_t tuned_gemm_algo(cublasHandle_t handle,
+                                 cublasOperation_t transa,
+                                 cublasOperation_t transb,
+                                 int m,
+                                 int n,
+                                 int k,
+                                 int elem_size,
+                                 const float* beta,
+                                 cublasGemmAlgo_t algo,
+                                 Func gemm)
+{
+    GemmAlgoCache& cache = GemmAlgoCache::Instance();
+    if (!cache.Tuning() || algo != CUBLAS_GEMM_DEFAULT_TENSOR_OP || *beta != 0.f) return algo;
+    int n_bucket = 1;
+    while (n_bucket < n) n_bucket *= 2;
+    cudaStream_t stream;
+    cublasGetStream(handle, &stream);
+    auto key = GemmAlgoCache::Key("inference_gemm", 1, m, n_bucket, k, transa, transb, elem_size);
+    return static_cast<cublasGemmAlgo_t>(
+        cache.Select(key,
+                     algo,
+                     CUBLAS_GEMM_DEFAULT_TENSOR_OP,
+                     CUBLAS_GEMM_ALGO15_TENSOR_OP,
+                     stream,
+                     [&](int candidate) {
+                         return gemm(static_cast<cublasGemmAlgo_t>(candidate)) ==
+                                CUBLAS_STATUS_SUCCESS;
+                     }));
+}
+#endif
 
 #ifdef __HIP_PLATFORM_HCC__
 int cublas_gemm_ex(rocblas_handle handle,
@@ -69,25 +114,29 @@ int cublas_gemm_ex(cublasHandle_t handle,
                                             0,
                                             0);
 #else
-    cublasStatus_t status = cublasGemmEx(handle,
-                                         transa,
-                                         transb,
-                                         m,
-                                         n,
-                                         k,
-                                         (const void*)alpha,
-                                         (const void*)A,
-                                         CUDA_R_32F,
-                                         (transa == CUBLAS_OP_N) ? m : k,
-                                         (const void*)B,
-                                         CUDA_R_32F,
-                                         (transb == CUBLAS_OP_N) ? k : n,
-                                         (const void*)beta,
-                                         C,
-                                         CUDA_R_32F,
-                                         m,
-                                         CUDA_R_32F,
-                                         algo);
+    auto gemm = [&](cublasGemmAlgo_t gemm_algo) {
+        return cublasGemmEx(handle,
+                            transa,
+                            transb,
+                            m,
+                            n,
+                            k,
+                            (const void*)alpha,
+                            (const void*)A,
+                            CUDA_R_32F,
+                            (transa == CUBLAS_OP_N) ? m : k,
+                            (const void*)B,
+                            CUDA_R_32F,
+                            (transb == CUBLAS_OP_N) ? k : n,
+                            (const void*)beta,
+                            C,
+                            CUDA_R_32F,
+                            m,
+                            CUDA_R_32F,
+                            gemm_algo);
+    };
+    cublasStatus_t status =
+        gemm(tuned_gemm_algo(handle, transa, transb, m, n, k, sizeof(float), beta, algo, gemm));
 #endif
 
 #ifdef __HIP_PLATFORM_HCC__
@@ -160,25 +209,29 @@ int cublas_gemm_ex(cublasHandle_t handle,
                                             0,
                                             0);
 #else
-    cublasStatus_t status = cublasGemmEx(handle,
-                                         transa,
-                                         transb,
-                                         m,
-                                         n,
-                                         k,
-                                         (const void*)alpha,
-                                         (const void*)A,
-                                         CUDA_R_16F,
-                                         (transa == CUBLAS_OP_N) ? m : k,
-                                         (const void*)B,
-                                         CUDA_R_16F,
-                                         (transb == CUBLAS_OP_N) ? k : n,
-                                         (const void*)beta,
-                                         (void*)C,
-                                         CUDA_R_16F,
-                                         m,
-                                         CUDA_R_32F,
-                                         algo);
+    auto gemm = [&](cublasGemmAlgo_t gemm_algo) {
+        return cublasGemmEx(handle,
+                            transa,
+                            transb,
+                            m,
+                            n,
+                            k,
+                            (const void*)alpha,
+                            (const void*)A,
+                            CUDA_R_16F,
+                            (transa == CUBLAS_OP_N) ? m : k,
+                            (const void*)B,
+                            CUDA_R_16F,
+                            (transb == CUBLAS_OP_N) ? k : n,
+                            (const void*)beta,
+                            (void*)C,
+                            CUDA_R_16F,
+                            m,
+                            CUDA_R_32F,
+                            gemm_algo);
+    };
+    cublasStatus_t status =
+        gemm(tuned_gemm_algo(handle, transa, transb, m, n, k, sizeof(__half), beta, algo, gemm));
 #endif
 
 #ifdef __HIP_PLATFORM_HCC__
@@ -416,3 +469,101 @@ int cublas_strided_batched_gemm(cublasHandle_t handle,
 
     return 0;
 }
+
+#ifdef FP8_AVAILABLE
+/*
+D[n, m] = (a_scale * A[m, k]) x (b_scale * B[n, k])^T + bias, with A and B stored row major in fp8
+(a_type and b_type are CUDA_R_8F_E4M3 or CUDA_R_8F_E5M2, not both e5m2) and D in fp16. The scales
+are device scalars, so delayed scaling never syncs with the host. cublasLt only runs fp8 on sm_89
+and newer and wants m, n and k multiples of 16.
+*/
+int cublas_lt_fp8_gemm(cublasLtHandle_t handle,
+                       int m,
+                       int n,
+                       int k,
+                       const void* A,
+                       cudaDataType_t a_type,
+                       const void* B,
+                       cudaDataType_t b_type,
+                       __half* D,
+                       const float* a_scale,
+                       const float* b_scale,
+                       const __half* bias,
+                       void* workspace,
+                       size_t workspace_size,
+                       cudaStream_t stream)
+{
+    cublasLtMatmulDesc_t op_desc = nullptr;
+    cublasLtMatrixLayout_t a_desc = nullptr, b_desc = nullptr, d_desc = nullptr;
+    const cublasOperation_t op_t = CUBLAS_OP_T;
+    const cublasOperation_t op_n = CUBLAS_OP_N;
+    const int8_t fast_accum = 1;
+    const float alpha = 1.f, beta = 0.f;
+
+    // Column major view: D^T[m, n] = op(A^T)[m, k] x B^T[k, n], fp8 needs the TN layout.
+    cublasStatus_t status = cublasLtMatmulDescCreate(&op_desc, CUBLAS_COMPUTE_32F, CUDA_R_32F);
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatmulDescSetAttribute(
+            op_desc, CUBLASLT_MATMUL_DESC_TRANSA, &op_t, sizeof(op_t));
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatmulDescSetAttribute(
+            op_desc, CUBLASLT_MATMUL_DESC_TRANSB, &op_n, sizeof(op_n));
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatmulDescSetAttribute(
+            op_desc, CUBLASLT_MATMUL_DESC_A_SCALE_POINTER, &a_scale, sizeof(a_scale));
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatmulDescSetAttribute(
+            op_desc, CUBLASLT_MATMUL_DESC_B_SCALE_POINTER, &b_scale, sizeof(b_scale));
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatmulDescSetAttribute(
+            op_desc, CUBLASLT_MATMUL_DESC_FAST_ACCUM, &fast_accum, sizeof(fast_accum));
+    if (status == CUBLAS_STATUS_SUCCESS && bias) {
+        const cublasLtEpilogue_t epilogue = CUBLASLT_EPILOGUE_BIAS;
+        status = cublasLtMatmulDescSetAttribute(
+            op_desc, CUBLASLT_MATMUL_DESC_EPILOGUE, &epilogue, sizeof(epilogue));
+        if (status == CUBLAS_STATUS_SUCCESS)
+            status = cublasLtMatmulDescSetAttribute(
+                op_desc, CUBLASLT_MATMUL_DESC_BIAS_POINTER, &bias, sizeof(bias));
+    }
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatrixLayoutCreate(&a_desc, a_type, k, m, k);
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatrixLayoutCreate(&b_desc, b_type, k, n, k);
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatrixLayoutCreate(&d_desc, CUDA_R_16F, m, n, m);
+    if (status == CUBLAS_STATUS_SUCCESS)
+        status = cublasLtMatmul(handle,
+                                op_desc,
+                                &alpha,
+                                A,
+                                a_desc,
+                                B,
+                                b_desc,
+                                &beta,
+                                D,
+                                d_desc,
+                                D,
+                                d_desc,
+                                nullptr,
+                                workspace,
+                                workspace_size,
+                                stream);
+
+    if (d_desc) cublasLtMatrixLayoutDestroy(d_desc);
+    if (b_desc) cublasLtMatrixLayoutDestroy(b_desc);
+    if (a_desc) cublasLtMatrixLayoutDestroy(a_desc);
+    if (op_desc) cublasLtMatmulDescDestroy(op_desc);
+
+    if (status != CUBLAS_STATUS_SUCCESS) {
+        fprintf(stderr,
+                "!!!! kernel execution error. (m: %d, n: %d, k: %d, error: %d) \n",
+                m,
+                n,
+                k,
+                (int)status);
+        return EXIT_FAILURE;
+    }
+
+    return 0;
+}
+#endif
@@ -22,6 +22,24 @@
 
 #define MAX_REGISTERS 256
 
+// Largest head the fused prefill attention (flash_attention.cu) keeps in shared memory.
+#define FLASH_ATTN_MAX_HEAD_SIZE 128
+#define DECODE_ATTN_MAX_HEAD_SIZE 256
+// Most (token, split) pairs per (batch, head) of the split decode attention.
+#define DECODE_ATTN_MAX_SPLITS 32
+// Largest input the weight only GEMM runs as a GEMV, one warp per output channel.
+#define WEIGHT_ONLY_GEMV_MAX_ROWS 8
+// Largest input the layer norm fused into the following GEMM (ln_gemv.cu) runs for.
+#define LN_GEMV_MAX_ROWS 8
+// Limits of the fused MoE gating (moe.cu): experts per layer and experts per token.
+#define MOE_MAX_EXPERTS 256
+#define MOE_MAX_TOP_K 8
+// Largest rank of the batched LoRA adapters (lora.cu), kept in shared memory per token.
+#define LORA_MAX_RANK 256
+// Largest finite values of the two fp8 formats, the range the per tensor scales map amax onto.
+#define FP8_E4M3_MAX 448.f
+#define FP8_E5M2_MAX 57344.f
+
 template <typename T>
 void launch_attn_softmax_v2(T* vals,
                             T* mask,
@@ -56,6 +74,15 @@ void launch_fused_bias_geglu(T* output,
                              int elems_per_row,
                              cudaStream_t stream);
 
+// Same layout as the GEGLU above with a SiLU gate (SwiGLU), bias may be nullptr.
+template <typename T>
+void launch_fused_bias_swiglu(T* output,
+                              const T* activation,
+                              const T* bias,
+                              int rows,
+                              int elems_per_row,
+                              cudaStream_t stream);
+
 // Fused bias add with relu activation
 template <typename T>
 void launch_bias_relu(T* input,
@@ -114,6 +141,27 @@ void launch_fused_residual_ln_store_pre_ln_res(T* norm_output,
                                                int elems_per_row,
                                                cudaStream_t stream);
 
+template <typename T>
+void launch_rms_norm(T* output,
+                     const T* vals,
+                     const T* gamma,
+                     float epsilon,
+                     int rows,
+                     int elems_per_row,
+                     cudaStream_t stream);
+
+// RMS norm of vals + residual, also storing the sum in res_output (see rms_norm.cu).
+template <typename T>
+void launch_pre_rms_norm(T* norm_output,
+                         T* res_output,
+                         const T* vals,
+                         const T* residual,
+                         const T* gamma,
+                         float epsilon,
+                         int rows,
+                         int elems_per_row,
+                         cudaStream_t stream);
+
 template <typename T>
 void launch_dequantize(T* output,
                        const int8_t* input,
@@ -155,7 +203,10 @@ void launch_apply_rotary_pos_emb(T* mixed_query,
                                  bool rotate_half,
                                  bool rotate_every_two,
                                  cudaStream_t stream,
-                                 int max_out_tokens);
+                                 int max_out_tokens,
+                                 const int* seq_offsets = nullptr,
+                                 int num_kv_heads = 0,
+                                 const int* cache_offsets = nullptr);
 
 template <typename T>
 void launch_moe_res_matmul(T* residual,
@@ -175,6 +226,26 @@ void launch_transform4d_0213(T* out,
                              int hidden_dim,
                              cudaStream_t stream,
                              int trans_count);
+/*
+Rotary angles for the transform, see InferenceContext::GetRotaryTable. Positions past the table
+(or all of them without one) get their angles computed from theta and scale.
+*/
+struct RotaryTable {
+    const float2* cos_sin = nullptr;
+    int positions = 0;
+    float theta = 10000.f;
+    float scale = 1.f;
+};
+
+// Whether launch_bias_add_transform_0213 applies the rotary embedding of this shape itself:
+// rotate half needs both halves of the rotary dims to be whole vectors of the kernel.
+template <typename T>
+inline bool transform_fuses_rotary(int rotary_dim, bool rotate_half)
+{
+    constexpr int vec = 16 / sizeof(T);
+    return !rotate_half || (rotary_dim > 0 && rotary_dim % (2 * vec) == 0);
+}
+
 template <typename T>
 void launch_bias_add_transform_0213(T* outputs,
                                     T* vals,
@@ -192,7 +263,11 @@ void launch_bias_add_transform_0213(T* outputs,
                                     bool rotate_every_two,
                                     cudaStream_t stream,
                                     int trans_count,
-                                    int max_out_tokens);
+                                    int max_out_tokens,
+                                    const int* seq_offsets = nullptr,
+                                    int kv_heads = 0,
+                                    const int* cache_offsets = nullptr,
+                                    RotaryTable rope = RotaryTable());
 template <typename T>
 void pad_data(T* padded_output,
               T* output,
@@ -221,3 +296,253 @@ void launch_pad_add_transform_0213(T* output,
                                    int heads,
                                    int padded_head_size,
                                    cudaStream_t stream);
+
+template <typename T>
+void launch_paged_kv_append(void* pool,
+                            float* kv_scales,
+                            const int* block_table,
+                            int table_width,
+                            const int* start_positions,
+                            const int* new_tokens,
+                            const T* k_src,
+                            const T* v_src,
+                            int layer,
+                            int num_layers,
+                            int heads,
+                            int head_size,
+                            int block_tokens,
+                            int batch_size,
+                            int seq_len,
+                            cudaStream_t stream);
+
+template <typename T>
+void launch_paged_attention(T* output,
+                            const T* query,
+                            const void* pool,
+                            const float* kv_scales,
+                            const int* block_table,
+                            int table_width,
+                            const int* start_positions,
+                            const int* new_tokens,
+                            const T* mask,
+                            int mask_stride,
+                            const T* alibi,
+                            int score_stride,
+                            float layer_scale,
+                            float alpha,
+                            bool local_attention,
+                            int window_size,
+                            int layer,
+                            int num_layers,
+                            int heads,
+                            int kv_heads,
+                            int head_size,
+                            int block_tokens,
+                            int batch_size,
+                            int seq_len,
+                            int max_visible,
+                            float* partials,
+                            cudaStream_t stream);
+
+template <typename T>
+void launch_decode_attention(T* output,
+                             const T* query,
+                             const T* key,
+                             const T* value,
+                             int kv_stride,
+                             const T* mask,
+                             int mask_stride,
+                             const T* alibi,
+                             int score_stride,
+                             float layer_scale,
+                             float alpha,
+                             bool local_attention,
+                             int window_size,
+                             int batch_size,
+                             int heads,
+                             int kv_heads,
+                             const int* positions,
+                             int soft_len,
+                             int head_size,
+                             float* partials,
+                             cudaStream_t stream);
+
+void launch_update_positions(int* positions,
+                             int value,
+                             bool relative,
+                             int batch_size,
+                             cudaStream_t stream);
+
+template <typename T>
+void launch_flash_attention(T* output,
+                            const T* query,
+                            const T* key,
+                            const T* value,
+                            int kv_stride,
+                            const T* mask,
+                            int mask_stride,
+                            const T* alibi,
+                            float layer_scale,
+                            float alpha,
+                            bool triangular,
+                            bool local_attention,
+                            int window_size,
+                            int batch_size,
+                            int heads,
+                            int kv_heads,
+                            int seq_len,
+                            int soft_len,
+                            int head_size,
+                            cudaStream_t stream);
+
+// bits is 4 or 8, in_features and group_size multiples of 8 (see weight_only_gemm.cu).
+template <typename T>
+void launch_weight_only_gemm(T* output,
+                             const T* input,
+                             const uint8_t* weight,
+                             const float* scales,
+                             const float* zeros,
+                             int rows,
+                             int out_features,
+                             int in_features,
+                             int bits,
+                             int group_size,
+                             int scale_rows,
+                             cudaStream_t stream);
+
+template <typename T>
+void launch_fused_ln_gemv(T* output,
+                          T* norm_output,
+                          const T* input,
+                          const T* residual,
+                          const T* bias,
+                          const T* gamma,
+                          const T* beta,
+                          float epsilon,
+                          const T* weight,
+                          bool transposed_weight,
+                          int rows,
+                          int in_features,
+                          int out_features,
+                          cudaStream_t stream);
+
+void launch_moe_gating(int* expert_ids,
+                       float* gate_weights,
+                       int* expert_offsets,
+                       int* positions,
+                       const float* logits,
+                       int tokens,
+                       int experts,
+                       int top_k,
+                       cudaStream_t stream);
+
+template <typename T>
+void launch_moe_gather(T* permuted,
+                       const T* input,
+                       const int* positions,
+                       int tokens,
+                       int top_k,
+                       int hidden,
+                       cudaStream_t stream);
+
+template <typename T>
+void launch_moe_grouped_gemm(T* output,
+                             const T* input,
+                             const T* const* weights,
+                             const T* const* biases,
+                             const int* expert_offsets,
+                             int experts,
+                             int rows,
+                             int in_features,
+                             int out_features,
+                             bool gelu,
+                             cudaStream_t stream);
+
+template <typename T>
+void launch_moe_combine(T* output,
+                        const T* expert_output,
+                        const int* positions,
+                        const float* gate_weights,
+                        int tokens,
+                        int top_k,
+                        int hidden,
+                        cudaStream_t stream);
+
+// scores is [rows, vocab] fp32 scratch, history [rows, history_len] tokens of the repetition
+// penalty, negative ones ignored. temperature <= 0 is greedy (see sampling.cu).
+template <typename T>
+void launch_sample_tokens(int64_t* tokens,
+                          float* scores,
+                          const T* logits,
+                          const int64_t* history,
+                          int history_len,
+                          float temperature,
+                          float repetition_penalty,
+                          int top_k,
+                          float top_p,
+                          uint64_t seed,
+                          uint64_t offset,
+                          int rows,
+                          int vocab,
+                          cudaStream_t stream);
+
+// output [tokens, out_dim] += scale * input . lora_a[id] . lora_b[id], with lora_a [adapters,
+// rank, in_dim], lora_b [adapters, rank, out_dim] and the id of token t at ids[t / tokens_per_id].
+// scratch is [tokens, rank] fp32 (see lora.cu).
+template <typename T>
+void launch_lora_bgmv(T* output,
+                      float* scratch,
+                      const T* input,
+                      const T* lora_a,
+                      const T* lora_b,
+                      const int* ids,
+                      int tokens_per_id,
+                      float scale,
+                      int tokens,
+                      int adapters,
+                      int in_dim,
+                      int rank,
+                      int out_dim,
+                      cudaStream_t stream);
+
+#ifdef FP8_AVAILABLE
+// Producers of the fp8 GEMM inputs, output is e4m3 or, with e5m2 set, e5m2 (see fp8.cu).
+template <typename T>
+void launch_fp8_quantize(void* output,
+                         float* amax,
+                         const T* input,
+                         const float* scale,
+                         size_t count,
+                         bool e5m2,
+                         cudaStream_t stream);
+
+template <typename T>
+void launch_fused_ln_fp8(void* output,
+                         T* norm_output,
+                         float* amax,
+                         const T* input,
+                         const T* residual,
+                         const T* bias,
+                         const T* gamma,
+                         const T* beta,
+                         float epsilon,
+                         const float* scale,
+                         int rows,
+                         int elems_per_row,
+                         bool e5m2,
+                         cudaStream_t stream);
+
+template <typename T>
+void launch_bias_act_fp8(void* output,
+                         float* amax,
+                         const T* input,
+                         const T* bias,
+                         const float* scale,
+                         bool relu,
+                         int intermediate_size,
+                         int rows,
+                         bool e5m2,
+                         cudaStream_t stream);
+
+void launch_fp8_update_scale(float* scale, float* amax, bool e5m2, cudaStream_t stream);
+#endif
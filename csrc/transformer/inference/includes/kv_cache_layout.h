@@ -0,0 +1,110 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#pragma once
+
+#include "ds_kernel_utils.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Device side views of the KV cache layouts, so the attention kernels can be written once for all of
+them. key(seq, head, pos) gives the head_size elements of one cached token, indexable by dim,
+value() the matching V elements.
+*/
+namespace kv_layout {
+
+// The workspace cache: [bsz][heads][stride][head_size], K and V in separate buffers.
+template <typename T>
+struct Contiguous {
+    T* key_base;
+    T* value_base;
+    int stride;
+    int heads;
+    int head_size;
+
+    DS_D_INLINE T* key(int seq, int head, int pos) const
+    {
+        return key_base + (((size_t)seq * heads + head) * stride + pos) * head_size;
+    }
+    DS_D_INLINE T* value(int seq, int head, int pos) const
+    {
+        return value_base + (((size_t)seq * heads + head) * stride + pos) * head_size;
+    }
+};
+
+// The block paged cache (see paged_kv_cache.h): token pos of sequence seq lives in block
+// block_table[seq * table_width + pos / block_tokens], at slot pos % block_tokens.
+template <typename T>
+struct Paged {
+    T* pool;
+    const int* block_table;
+    int table_width;
+    int layer;
+    int num_layers;
+    int heads;
+    int head_size;
+    int block_tokens;
+
+    DS_D_INLINE T* key(int seq, int head, int pos) const
+    {
+        const int block = block_table[seq * table_width + pos / block_tokens];
+        const size_t layer_span = (size_t)2 * heads * block_tokens * head_size;
+        return pool + ((size_t)block * num_layers + layer) * layer_span +
+               ((size_t)head * block_tokens + pos % block_tokens) * head_size;
+    }
+    DS_D_INLINE T* value(int seq, int head, int pos) const
+    {
+        return key(seq, head, pos) + (size_t)heads * block_tokens * head_size;
+    }
+};
+
+// One cached token of the int8 cache, reads return the dequantized element.
+struct ScaledRow {
+    const int8_t* data;
+    float scale;
+
+    DS_D_INLINE float operator[](int dim) const { return data[dim] * scale; }
+};
+
+// The int8 block paged cache, elements as in Paged plus one scale per (token, head), see
+// paged_kv_cache.h. T is int8_t or const int8_t.
+template <typename T>
+struct QuantizedPaged {
+    Paged<T> elements;
+    const float* scales;
+
+    DS_D_INLINE size_t scale_index(int seq, int head, int pos) const
+    {
+        const Paged<T>& e = elements;
+        const int block = e.block_table[seq * e.table_width + pos / e.block_tokens];
+        return (((size_t)block * e.num_layers + e.layer) * 2 * e.heads + head) * e.block_tokens +
+               pos % e.block_tokens;
+    }
+    DS_D_INLINE ScaledRow key(int seq, int head, int pos) const
+    {
+        return {elements.key(seq, head, pos), scales[scale_index(seq, head, pos)]};
+    }
+    DS_D_INLINE ScaledRow value(int seq, int head, int pos) const
+    {
+        return {elements.value(seq, head, pos),
+                scales[scale_index(seq, head, pos) + elements.heads * elements.block_tokens]};
+    }
+};
+
+// Where the query tokens of every sequence start and how many of them are real, either the
+// same for the whole batch or read per sequence from device memory.
+struct Positions {
+    const int* starts;
+    const int* counts;
+    int start;
+    int count;
+
+    DS_D_INLINE int start_of(int seq) const { return starts ? starts[seq] : start; }
+    DS_D_INLINE int count_of(int seq) const { return counts ? counts[seq] : count; }
+};
+
+}  // namespace kv_layout
@@ -0,0 +1,436 @@
+// Copyright (c) Microsoft Corporation.
+// SPDX-License-Identifier: Apache-2.0
+
+// DeepSpeed Team
+
+#pragma once
+
+#include <cuda_runtime_api.h>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+Block paged KV cache. The cache is a pool of fixed size token blocks, every sequence owns the
+blocks listed in its block table, so a sequence only holds memory for the tokens it has rather than
+for max_out_tokens.
+
+A block covers block_tokens positions of all layers, one block id serves every layer of a
+sequence. Within the pool the elements are laid out as
+    [block][layer][K, V][kv_head][block_tokens][head_size]
+so a (block, layer) pair is one contiguous span of K followed by one of V.
+
+A quantized cache stores the elements as int8 with one fp32 scale per (token, kv_head) of K and
+of V, the scales follow all the blocks in the same allocation as
+    [block][layer][K, V][kv_head][block_tokens]
+
+Sequences are identified by a non negative id, the cache also tracks how many tokens of each one
+are stored so that the sequences of a batch can be at different positions.
+
+Full blocks can be shared between sequences with the same token prefix. RegisterPrefix indexes the
+blocks of a sequence by a hash of the tokens up to their end, MatchPrefix hands them to a new
+sequence, which then only computes the tokens after them. Blocks are reference counted, the index
+holds one reference too so a registered prefix outlives its sequences until the pool runs out of
+free blocks; a shared block is copied before a sequence writes into it.
+*/
+class PagedKVCache {
+public:
+    PagedKVCache()
+        : _pool(nullptr),
+          _num_blocks(0),
+          _block_tokens(0),
+          _num_layers(0),
+          _kv_heads(0),
+          _head_size(0),
+          _elem_size(0),
+          _quantized(false),
+          _prefix_hits(0),
+          _d_block_table(nullptr),
+          _d_block_table_size(0),
+          _table_width(0),
+          _batch_size(0)
+    {
+    }
+
+    ~PagedKVCache() { Release(); }
+
+    PagedKVCache(const PagedKVCache&) = delete;
+    PagedKVCache& operator=(const PagedKVCache&) = delete;
+
+    // (Re)allocates the pool, all sequences are dropped. elem_size is ignored when quantized.
+    void Configure(unsigned num_layers,
+                   unsigned kv_heads,
+                   unsigned head_size,
+                   unsigned block_tokens,
+                   size_t elem_size,
+                   size_t num_blocks,
+                   bool quantized = false)
+    {
+        if (quantized) elem_size = sizeof(int8_t);
+        if (block_tokens == 0 || num_blocks == 0)
+            throw std::runtime_error("Paged KV cache needs at least one block of one token.");
+        const bool same_pool = _pool && _num_blocks == num_blocks &&
+                               _block_tokens == block_tokens && _num_layers == num_layers &&
+                               _kv_heads == kv_heads && _head_size == head_size &&
+                               _elem_size == elem_size && _quantized == quantized;
+        if (!same_pool) {
+            Release();
+            _num_layers = num_layers;
+            _kv_heads = kv_heads;
+            _head_size = head_size;
+            _block_tokens = block_tokens;
+            _elem_size = elem_size;
+            _quantized = quantized;
+            _num_blocks = num_blocks;
+            if (cudaMalloc(&_pool, num_blocks * block_bytes()) != cudaSuccess) {
+                _pool = nullptr;
+                throw std::runtime_error("Paged KV cache pool can't be allocated, " +
+                                         std::to_string(num_blocks) + " blocks requested.");
+            }
+        }
+        _tables.clear();
+        _lengths.clear();
+        _prefixes.clear();
+        _prefix_hits = 0;
+        _ref_counts.assign(_num_blocks, 0);
+        _free_blocks.resize(_num_blocks);
+        // Hand out low block ids first.
+        for (size_t i = 0; i < _num_blocks; i++) _free_blocks[i] = _num_blocks - 1 - i;
+    }
+
+    void Release()
+    {
+        if (_pool) cudaFree(_pool);
+        if (_d_block_table) cudaFree(_d_block_table);
+        _pool = nullptr;
+        _d_block_table = nullptr;
+        _d_block_table_size = 0;
+        _num_blocks = 0;
+        _tables.clear();
+        _lengths.clear();
+        _prefixes.clear();
+        _ref_counts.clear();
+        _free_blocks.clear();
+    }
+
+    inline bool enabled() const { return _pool != nullptr; }
+
+    // Bytes of one block, all layers, K and V, scales included.
+    inline size_t block_bytes() const { return block_data_bytes() + block_scale_bytes(); }
+
+    // Blocks needed to hold tokens positions.
+    inline size_t blocks_for(size_t tokens) const
+    {
+        return (tokens + _block_tokens - 1) / _block_tokens;
+    }
+
+    // Grows the block table of seq so it holds at least tokens positions.
+    void Reserve(int seq, size_t tokens)
+    {
+        Track(seq);
+        auto& table = _tables[seq];
+        const size_t needed = blocks_for(tokens);
+        if (needed > table.size() + _free_blocks.size())
+            EvictPrefixes(needed - table.size() - _free_blocks.size());
+        if (needed > table.size() + _free_blocks.size())
+            throw std::runtime_error("Paged KV cache is out of blocks: " +
+                                     std::to_string(needed - table.size()) + " more needed, " +
+                                     std::to_string(_free_blocks.size()) + " free.");
+        while (table.size() < needed) table.push_back(Allocate());
+    }
+
+    // Gives seq, which must not hold any token yet, the registered blocks of the longest prefix of
+    // tokens, leaving at least the last token to compute. Returns the number of tokens matched,
+    // the sequence continues from there.
+    size_t MatchPrefix(int seq, const std::vector<int>& tokens)
+    {
+        Track(seq);
+        if (_lengths[seq] > 0 || !_tables[seq].empty())
+            throw std::runtime_error("Paged KV cache sequence " + std::to_string(seq) +
+                                     " already holds tokens, free it before matching a prefix.");
+        uint64_t hash = prefix_seed;
+        const size_t full_blocks = tokens.empty() ? 0 : (tokens.size() - 1) / _block_tokens;
+        for (size_t i = 0; i < full_blocks; i++) {
+            const auto first = tokens.begin() + i * _block_tokens;
+            const uint64_t parent = hash;
+            hash = HashBlock(parent, &*first);
+            const auto it = _prefixes.find(hash);
+            if (it == _prefixes.end() || it->second.parent != parent ||
+                !std::equal(first, first + _block_tokens, it->second.tokens.begin()))
+                break;
+            _ref_counts[it->second.block]++;
+            _tables[seq].push_back(it->second.block);
+        }
+        _lengths[seq] = _tables[seq].size() * _block_tokens;
+        _prefix_hits += _tables[seq].size();
+        return _lengths[seq];
+    }
+
+    // Indexes the full blocks of seq holding the first of tokens, its token ids, so that later
+    // sequences can match them. Returns the number of blocks newly registered.
+    size_t RegisterPrefix(int seq, const std::vector<int>& tokens)
+    {
+        const size_t full_blocks = std::min(tokens.size(), length(seq)) / _block_tokens;
+        size_t registered = 0;
+        uint64_t hash = prefix_seed;
+        for (size_t i = 0; i < full_blocks; i++) {
+            const auto first = tokens.begin() + i * _block_tokens;
+            const uint64_t parent = hash;
+            hash = HashBlock(parent, &*first);
+            if (_prefixes.count(hash)) continue;
+            const int block = _tables[seq][i];
+            _ref_counts[block]++;
+            _prefixes[hash] = {block, parent, std::vector<int>(first, first + _block_tokens)};
+            registered++;
+        }
+        return registered;
+    }
+
+    // Drops the index of registered prefixes, their blocks go back to the pool once no sequence
+    // uses them.
+    void ClearPrefixes()
+    {
+        for (const auto& entry : _prefixes) Unref(entry.second.block);
+        _prefixes.clear();
+    }
+
+    // Copy on write: gives seq a private copy of the block its next token goes to if that block
+    // is shared, as after truncating into a matched prefix. Ordered on stream before the appends.
+    void CopyOnWrite(int seq, cudaStream_t stream)
+    {
+        if (seq >= (int)_tables.size()) return;
+        auto& table = _tables[seq];
+        const size_t index = _lengths[seq] / _block_tokens;
+        if (index >= table.size() || _ref_counts[table[index]] == 1) return;
+        if (_free_blocks.empty()) EvictPrefixes(1);
+        if (_free_blocks.empty())
+            throw std::runtime_error("Paged KV cache is out of blocks to copy a shared one.");
+        const int shared = table[index];
+        const int copy = Allocate();
+        char* base = (char*)_pool;
+        cudaMemcpyAsync(base + copy * block_data_bytes(),
+                        base + shared * block_data_bytes(),
+                        block_data_bytes(),
+                        cudaMemcpyDeviceToDevice,
+                        stream);
+        if (_quantized) {
+            char* scales_base = base + _num_blocks * block_data_bytes();
+            cudaMemcpyAsync(scales_base + copy * block_scale_bytes(),
+                            scales_base + shared * block_scale_bytes(),
+                            block_scale_bytes(),
+                            cudaMemcpyDeviceToDevice,
+                            stream);
+        }
+        Unref(shared);
+        table[index] = copy;
+    }
+
+    // Records that tokens more positions of seq hold their K/V.
+    void Advance(int seq, size_t tokens)
+    {
+        Track(seq);
+        _lengths[seq] += tokens;
+    }
+
+    // Returns all blocks of seq to the free list, the sequence starts over from position 0.
+    void Free(int seq)
+    {
+        if (seq >= (int)_tables.size()) return;
+        auto& table = _tables[seq];
+        for (auto it = table.rbegin(); it != table.rend(); it++) Unref(*it);
+        table.clear();
+        _lengths[seq] = 0;
+    }
+
+    // Frees all sequences and registered prefixes.
+    void FreeAll()
+    {
+        for (size_t seq = 0; seq < _tables.size(); seq++) Free(seq);
+        ClearPrefixes();
+    }
+
+    // Keeps the first tokens positions of seq and frees the blocks past them, e.g. to drop the
+    // rejected draft tokens of speculative decoding.
+    void Truncate(int seq, size_t tokens)
+    {
+        if (tokens > length(seq))
+            throw std::runtime_error("Paged KV cache sequence " + std::to_string(seq) + " holds " +
+                                     std::to_string(length(seq)) +
+                                     " tokens, can't truncate it to " + std::to_string(tokens));
+        if (seq >= (int)_tables.size()) return;
+        auto& table = _tables[seq];
+        const size_t kept = blocks_for(tokens);
+        for (auto it = table.rbegin(); it != table.rend() - kept; it++) Unref(*it);
+        table.resize(kept);
+        _lengths[seq] = tokens;
+    }
+
+    // Uploads the description of a batch whose slot i holds sequence seqs[i] with new_tokens[i]
+    // tokens after the ones already cached, as one int array of
+    //     [batch, table_width()] block tables, unused entries -1
+    //     [batch] start positions
+    //     [batch] new tokens
+    // The copy is ordered on stream before the kernels using it.
+    void UploadBatch(const std::vector<int>& seqs,
+                     const std::vector<int>& new_tokens,
+                     cudaStream_t stream)
+    {
+        const size_t batch = seqs.size();
+        size_t width = 1;
+        for (int seq : seqs) width = std::max(width, sequence_blocks(seq));
+        _table_width = width;
+        _batch_size = batch;
+
+        _h_block_table.assign(batch * (width + 2), -1);
+        for (size_t i = 0; i < batch; i++) {
+            if (seqs[i] < (int)_tables.size())
+                std::copy(_tables[seqs[i]].begin(),
+                          _tables[seqs[i]].end(),
+                          &_h_block_table[i * width]);
+            _h_block_table[batch * width + i] = (int)length(seqs[i]);
+            _h_block_table[batch * (width + 1) + i] = new_tokens[i];
+        }
+
+        const size_t bytes = _h_block_table.size() * sizeof(int);
+        if (bytes > _d_block_table_size) {
+            if (_d_block_table) cudaFree(_d_block_table);
+            // Grow geometrically so decode steps rarely reallocate.
+            _d_block_table_size = std::max(bytes, 2 * _d_block_table_size);
+            if (cudaMalloc(&_d_block_table, _d_block_table_size) != cudaSuccess) {
+                _d_block_table = nullptr;
+                _d_block_table_size = 0;
+                throw std::runtime_error("Paged KV cache block table can't be allocated.");
+            }
+        }
+        // The source is pageable, so the copy is staged before this returns.
+        cudaMemcpyAsync(
+            _d_block_table, _h_block_table.data(), bytes, cudaMemcpyHostToDevice, stream);
+    }
+
+    inline void* pool() const { return _pool; }
+    inline bool quantized() const { return _quantized; }
+    // Scales of the quantized cache, nullptr otherwise.
+    inline float* scales() const
+    {
+        return _quantized ? (float*)((char*)_pool + _num_blocks * block_data_bytes()) : nullptr;
+    }
+    inline const int* device_block_tables() const { return _d_block_table; }
+    inline const int* device_start_positions() const
+    {
+        return _d_block_table + _batch_size * _table_width;
+    }
+    inline const int* device_new_tokens() const
+    {
+        return _d_block_table + _batch_size * (_table_width + 1);
+    }
+    inline int table_width() const { return (int)_table_width; }
+    inline unsigned block_tokens() const { return _block_tokens; }
+    inline unsigned num_layers() const { return _num_layers; }
+    inline size_t num_blocks() const { return _num_blocks; }
+    inline size_t free_blocks() const { return _free_blocks.size(); }
+    inline size_t prefix_blocks() const { return _prefixes.size(); }
+    // Blocks handed out by MatchPrefix since the pool was configured.
+    inline size_t prefix_hits() const { return _prefix_hits; }
+    inline size_t sequence_blocks(int seq) const
+    {
+        return seq < (int)_tables.size() ? _tables[seq].size() : 0;
+    }
+    // Tokens of seq stored in the cache.
+    inline size_t length(int seq) const
+    {
+        return seq < (int)_lengths.size() ? _lengths[seq] : 0;
+    }
+
+private:
+    inline size_t block_data_bytes() const
+    {
+        return (size_t)_num_layers * 2 * _kv_heads * _block_tokens * _head_size * _elem_size;
+    }
+    inline size_t block_scale_bytes() const
+    {
+        return _quantized ? (size_t)_num_layers * 2 * _kv_heads * _block_tokens * sizeof(float)
+                          : 0;
+    }
+
+    static constexpr uint64_t prefix_seed = 14695981039346656037ull;
+
+    // FNV-1a over the token ids of a block, chained through the hash of the blocks before it.
+    uint64_t HashBlock(uint64_t parent, const int* tokens) const
+    {
+        uint64_t hash = parent;
+        for (unsigned i = 0; i < _block_tokens; i++) {
+            hash ^= (uint32_t)tokens[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    int Allocate()
+    {
+        const int block = _free_blocks.back();
+        _free_blocks.pop_back();
+        _ref_counts[block] = 1;
+        return block;
+    }
+
+    void Unref(int block)
+    {
+        if (--_ref_counts[block] == 0) _free_blocks.push_back(block);
+    }
+
+    // Returns up to blocks registered prefix blocks no sequence uses to the free list.
+    void EvictPrefixes(size_t blocks)
+    {
+        for (auto it = _prefixes.begin(); it != _prefixes.end() && blocks > 0;) {
+            if (_ref_counts[it->second.block] == 1) {
+                Unref(it->second.block);
+                it = _prefixes.erase(it);
+                blocks--;
+            } else {
+                it++;
+            }
+        }
+    }
+
+    void Track(int seq)
+    {
+        if (seq < 0) throw std::runtime_error("Paged KV cache sequence ids can't be negative.");
+        if (seq >= (int)_tables.size()) {
+            _tables.resize(seq + 1);
+            _lengths.resize(seq + 1, 0);
+        }
+    }
+
+    void* _pool;
+    size_t _num_blocks;
+    unsigned _block_tokens;
+    unsigned _num_layers;
+    unsigned _kv_heads;
+    unsigned _head_size;
+    size_t _elem_size;
+    bool _quantized;
+
+    // Used as a stack, the most recently freed block is reused first.
+    std::vector<int> _free_blocks;
+    std::vector<std::vector<int>> _tables;
+    std::vector<size_t> _lengths;
+    std::vector<int> _ref_counts;
+
+    // A registered block, the hash of the blocks before it and its tokens tell collisions apart.
+    struct PrefixBlock {
+        int block;
+        uint64_t parent;
+        std::vector<int> tokens;
+    };
+    std::unordered_map<uint64_t, PrefixBlock> _prefixes;
+    size_t _prefix_hits;
+
+    std::vector<int> _h_block_table;
+    int* _d_block_table;
+    size_t _d_block_table_size;
+    size_t _table_width;
+    size_t _batch_size;
+};
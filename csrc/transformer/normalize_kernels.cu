@@ -2132,3 +2132,315 @@ void launch_layerNorm_backward_fused_add<__half>(const __half* out_grad1,
     LayerNormBackward2_fused_add<<<grid_dim2, block_dim2, 0, stream[1]>>>(
         out_grad1, out_grad2, X_data, gamma, vars, means, inp_grad, hidden_dim / 2);
 }
+
+/*
+Single-pass normalization backward.
+
+Each block walks rows_per_block consecutive rows with every thread owning the same COLS columns
+of all of them, so the input gradient of a row and the gamma/betta contributions of the block
+come out of one read of out_grad and vals. The contributions stay in registers until the block
+writes them as a [blocks, width] fp32 partial, and a second kernel sums those few rows per
+column. With the same column ownership, RMSNorm only drops the mean terms.
+*/
+namespace norm_fused {
+
+constexpr int max_cols = 16;
+constexpr int min_rows_per_block = 8;
+constexpr int reduce_threads = 256;
+
+// The fewest columns per thread that keep the blocks at 256 threads, up to max_cols.
+inline int cols_per_thread(int width)
+{
+    int cols = 1;
+    while (cols < max_cols && width > THREADS * cols) cols <<= 1;
+    return cols;
+}
+
+inline int threads(int width, int cols)
+{
+    return ((width + cols - 1) / cols + WARP_SIZE - 1) / WARP_SIZE * WARP_SIZE;
+}
+
+__device__ __forceinline__ float2 block_sum(cg::thread_block& b,
+                                            cg::thread_block_tile<WARP_SIZE>& g,
+                                            float2 val,
+                                            float2* shr)
+{
+    for (int i = 1; i < WARP_SIZE; i *= 2) {
+        val.x += g.shfl_xor(val.x, i);
+        val.y += g.shfl_xor(val.y, i);
+    }
+    if (g.thread_rank() == 0) shr[threadIdx.x / WARP_SIZE] = val;
+    b.sync();
+
+    val = (g.thread_rank() < (blockDim.x >> WARP_SIZE_BITS)) ? shr[g.thread_rank()]
+                                                            : make_float2(0.f, 0.f);
+    for (int i = 1; i < WARP_SIZE; i *= 2) {
+        val.x += g.shfl_xor(val.x, i);
+        val.y += g.shfl_xor(val.y, i);
+    }
+    // shr is reused by the next row.
+    b.sync();
+    return val;
+}
+
+}  // namespace norm_fused
+
+template <typename T, int COLS>
+__global__ void rms_norm_fused(T* vals,
+                               const T* residual,
+                               const T* gamma,
+                               float epsilon,
+                               bool training,
+                               T* vars,
+                               int width)
+{
+    __shared__ float2 shr[MAX_WARP_NUM];
+
+    cg::thread_block b = cg::this_thread_block();
+    cg::thread_block_tile<WARP_SIZE> g = cg::tiled_partition<WARP_SIZE>(b);
+
+    const size_t offset = (size_t)blockIdx.x * width;
+
+    float vals_arr[COLS];
+    float2 sum = make_float2(0.f, 0.f);
+#pragma unroll
+    for (int i = 0; i < COLS; i++) {
+        const int col = threadIdx.x + i * blockDim.x;
+        vals_arr[i] = (col < width) ? (float)residual[offset + col] : 0.f;
+        sum.x += vals_arr[i] * vals_arr[i];
+    }
+
+    sum = norm_fused::block_sum(b, g, sum, shr);
+    const float variance = sum.x / width + epsilon;
+    if (training && threadIdx.x == 0) vars[blockIdx.x] = variance;
+
+    const float rstd = rsqrtf(variance);
+#pragma unroll
+    for (int i = 0; i < COLS; i++) {
+        const int col = threadIdx.x + i * blockDim.x;
+        if (col < width) vals[offset + col] = (T)(vals_arr[i] * rstd * (float)gamma[col]);
+    }
+}
+
+template <typename T, int COLS>
+__global__ void norm_backward_fused(const T* out_grad,
+                                    const T* residual_grad,
+                                    const T* vals,
+                                    const T* vars,
+                                    const T* means,
+                                    const T* gamma,
+                                    const T* betta,
+                                    T* inp_grad,
+                                    float* partial_gamma,
+                                    float* partial_betta,
+                                    int rows,
+                                    int width,
+                                    int rows_per_block,
+                                    bool invertible,
+                                    bool rms)
+{
+    __shared__ float2 shr[MAX_WARP_NUM];
+
+    cg::thread_block b = cg::this_thread_block();
+    cg::thread_block_tile<WARP_SIZE> g = cg::tiled_partition<WARP_SIZE>(b);
+
+    float gamma_reg[COLS], betta_reg[COLS], gamma_acc[COLS], betta_acc[COLS];
+#pragma unroll
+    for (int i = 0; i < COLS; i++) {
+        const int col = threadIdx.x + i * blockDim.x;
+        gamma_reg[i] = (col < width) ? (float)gamma[col] : 1.f;
+        betta_reg[i] = (col < width && invertible && !rms) ? (float)betta[col] : 0.f;
+        gamma_acc[i] = 0.f;
+        betta_acc[i] = 0.f;
+    }
+
+    const int row_end = min(rows, (int)(blockIdx.x + 1) * rows_per_block);
+    for (int row = blockIdx.x * rows_per_block; row < row_end; row++) {
+        const size_t offset = (size_t)row * width;
+        const float rstd = rsqrtf((float)vars[row]);
+        const float mean = (invertible || rms) ? 0.f : (float)means[row];
+
+        float dy_gamma[COLS], vals_hat[COLS];
+        float2 sum = make_float2(0.f, 0.f);
+#pragma unroll
+        for (int i = 0; i < COLS; i++) {
+            const int col = threadIdx.x + i * blockDim.x;
+            dy_gamma[i] = 0.f;
+            vals_hat[i] = 0.f;
+            if (col < width) {
+                const float dy = (float)out_grad[offset + col];
+                const float val = (float)vals[offset + col];
+                vals_hat[i] =
+                    invertible ? (val - betta_reg[i]) / gamma_reg[i] : (val - mean) * rstd;
+                gamma_acc[i] += dy * vals_hat[i];
+                betta_acc[i] += dy;
+                dy_gamma[i] = dy * gamma_reg[i];
+                sum.x += dy_gamma[i];
+                sum.y += dy_gamma[i] * vals_hat[i];
+            }
+        }
+
+        sum = norm_fused::block_sum(b, g, sum, shr);
+        const float mean_dy = rms ? 0.f : sum.x / width;
+        const float mean_dy_hat = sum.y / width;
+
+#pragma unroll
+        for (int i = 0; i < COLS; i++) {
+            const int col = threadIdx.x + i * blockDim.x;
+            if (col < width) {
+                float grad = rstd * (dy_gamma[i] - mean_dy - vals_hat[i] * mean_dy_hat);
+                if (residual_grad) grad += (float)residual_grad[offset + col];
+                inp_grad[offset + col] = (T)grad;
+            }
+        }
+    }
+
+#pragma unroll
+    for (int i = 0; i < COLS; i++) {
+        const int col = threadIdx.x + i * blockDim.x;
+        if (col < width) {
+            partial_gamma[(size_t)blockIdx.x * width + col] = gamma_acc[i];
+            if (partial_betta) partial_betta[(size_t)blockIdx.x * width + col] = betta_acc[i];
+        }
+    }
+}
+
+template <typename T>
+__global__ void norm_backward_reduce(const float* partial_gamma,
+                                     const float* partial_betta,
+                                     T* gamma_grad,
+                                     T* betta_grad,
+                                     int blocks,
+                                     int width)
+{
+    const int col = blockIdx.x * blockDim.x + threadIdx.x;
+    if (col >= width) return;
+
+    float gamma_sum = 0.f, betta_sum = 0.f;
+    for (int r = 0; r < blocks; r++) {
+        gamma_sum += partial_gamma[(size_t)r * width + col];
+        if (partial_betta) betta_sum += partial_betta[(size_t)r * width + col];
+    }
+    gamma_grad[col] = (T)gamma_sum;
+    if (betta_grad) betta_grad[col] = (T)betta_sum;
+}
+
+#define LAUNCH_NORM_FUSED_COLS(kernel, cols, grid, block, stream, ...)          \
+    switch (cols) {                                                             \
+        case 1: kernel<T, 1><<<grid, block, 0, stream>>>(__VA_ARGS__); break;   \
+        case 2: kernel<T, 2><<<grid, block, 0, stream>>>(__VA_ARGS__); break;   \
+        case 4: kernel<T, 4><<<grid, block, 0, stream>>>(__VA_ARGS__); break;   \
+        case 8: kernel<T, 8><<<grid, block, 0, stream>>>(__VA_ARGS__); break;   \
+        default: kernel<T, 16><<<grid, block, 0, stream>>>(__VA_ARGS__); break; \
+    }
+
+template <typename T>
+void launch_rms_norm(T* vals,
+                     const T* residual,
+                     const T* gamma,
+                     float epsilon,
+                     int batch_size,
+                     int hidden_dim,
+                     cudaStream_t stream,
+                     bool training,
+                     T* vars)
+{
+    if (hidden_dim > NORM_FUSED_MAX_WIDTH) throw std::runtime_error("Unsupport hidden_dim.");
+
+    const int cols = norm_fused::cols_per_thread(hidden_dim);
+    LAUNCH_NORM_FUSED_COLS(rms_norm_fused,
+                           cols,
+                           batch_size,
+                           norm_fused::threads(hidden_dim, cols),
+                           stream,
+                           vals,
+                           residual,
+                           gamma,
+                           epsilon,
+                           training,
+                           vars,
+                           hidden_dim);
+}
+
+template <typename T>
+void launch_norm_backward_fused(const T* out_grad,
+                                const T* residual_grad,
+                                const T* vals,
+                                const T* vars,
+                                const T* means,
+                                const T* gamma,
+                                const T* betta,
+                                T* gamma_grad,
+                                T* betta_grad,
+                                T* inp_grad,
+                                int batch_size,
+                                int hidden_dim,
+                                bool invertible,
+                                bool rms,
+                                cudaStream_t stream)
+{
+    if (hidden_dim > NORM_FUSED_MAX_WIDTH) throw std::runtime_error("Unsupport hidden_dim.");
+
+    // A couple of blocks per SM, each with at least a few rows to amortize its partial.
+    TrainingContext& context = TrainingContext::Instance();
+    int blocks = (std::min)(2 * context.GetMultiProcessorCount(),
+                            (batch_size + norm_fused::min_rows_per_block - 1) /
+                                norm_fused::min_rows_per_block);
+    blocks = (std::max)(blocks, 1);
+    const int rows_per_block = (batch_size + blocks - 1) / blocks;
+    blocks = (batch_size + rows_per_block - 1) / rows_per_block;
+
+    float* partial_gamma = static_cast<float*>(
+        context.GetReduceWorkSpace(2 * size_t(blocks) * hidden_dim * sizeof(float)));
+    float* partial_betta = rms ? nullptr : partial_gamma + size_t(blocks) * hidden_dim;
+
+    const int cols = norm_fused::cols_per_thread(hidden_dim);
+    LAUNCH_NORM_FUSED_COLS(norm_backward_fused,
+                           cols,
+                           blocks,
+                           norm_fused::threads(hidden_dim, cols),
+                           stream,
+                           out_grad,
+                           residual_grad,
+                           vals,
+                           vars,
+                           means,
+                           gamma,
+                           betta,
+                           inp_grad,
+                           partial_gamma,
+                           partial_betta,
+                           batch_size,
+                           hidden_dim,
+                           rows_per_block,
+                           invertible,
+                           rms);
+
+    const int reduce_blocks =
+        (hidden_dim + norm_fused::reduce_threads - 1) / norm_fused::reduce_threads;
+    norm_backward_reduce<T><<<reduce_blocks, norm_fused::reduce_threads, 0, stream>>>(
+        partial_gamma, partial_betta, gamma_grad, betta_grad, blocks, hidden_dim);
+}
+
+#define INSTANTIATE_NORM_FUSED(T)                                         \
+    template void launch_rms_norm<T>(                                     \
+        T*, const T*, const T*, float, int, int, cudaStream_t, bool, T*); \
+    template void launch_norm_backward_fused<T>(const T*,                 \
+                                                const T*,                 \
+                                                const T*,                 \
+                                                const T*,                 \
+                                                const T*,                 \
+                                                const T*,                 \
+                                                const T*,                 \
+                                                T*,                       \
+                                                T*,                       \
+                                                T*,                       \
+                                                int,                      \
+                                                int,                      \
+                                                bool,                     \
+                                                bool,                     \
+                                                cudaStream_t);
+
+INSTANTIATE_NORM_FUSED(float)
+INSTANTIATE_NORM_FUSED(__half)
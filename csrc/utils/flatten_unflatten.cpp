@@ -22,8 +22,40 @@ std::vector<at::Tensor> unflatten(at::Tensor flat, std::vector<at::Tensor> tenso
     return torch::utils::unflatten_dense_tensors(flat, tensors);
 }
 
+// Copies tensors back to back into the front of a preallocated 1-D buffer, without allocating.
+// cat batches all inputs of a call into one copy kernel on the device.
+void flatten_into(at::Tensor flat, std::vector<at::Tensor> tensors)
+{
+    TORCH_CHECK(flat.dim() == 1 && flat.is_contiguous(), "flat must be a contiguous 1-D tensor");
+    std::vector<at::Tensor> views;
+    views.reserve(tensors.size());
+    int64_t numel = 0;
+    for (const auto& t : tensors) {
+        TORCH_CHECK(t.scalar_type() == flat.scalar_type(), "dtype mismatch with the flat buffer");
+        views.push_back(t.reshape({-1}));
+        numel += t.numel();
+    }
+    TORCH_CHECK(numel <= flat.numel(), "flat buffer is smaller than the tensors");
+    if (views.empty()) return;
+    auto out = flat.narrow(0, 0, numel);
+    at::cat_out(out, views, 0);
+}
+
+// Copies consecutive slices of flat back into tensors, the inverse of flatten_into.
+void unflatten_into(at::Tensor flat, std::vector<at::Tensor> tensors)
+{
+    int64_t offset = 0;
+    for (auto& t : tensors) {
+        TORCH_CHECK(offset + t.numel() <= flat.numel(), "flat buffer is smaller than the tensors");
+        t.copy_(flat.narrow(0, offset, t.numel()).view(t.sizes()));
+        offset += t.numel();
+    }
+}
+
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m)
 {
     m.def("flatten", &flatten, "Flatten dense tensors");
     m.def("unflatten", &unflatten, "Unflatten dense tensors");
+    m.def("flatten_into", &flatten_into, "Flatten dense tensors into a preallocated buffer");
+    m.def("unflatten_into", &unflatten_into, "Copy a flat buffer back into dense tensors");
 }
@@ -210,6 +210,15 @@ class DeepSpeedInferenceConfig(DeepSpeedConfigModel):
     passed.
     """
 
+    save_kernel_checkpoint: bool = False
+    """
+    With ``save_mp_checkpoint_path``, save each rank's shard in the layout of the inference kernels
+    (already transposed and quantized, scales included) as one raw file, instead of torch
+    checkpoints. Passing the ``ds_inference_config.json`` written next to it as ``checkpoint``
+    maps the files and streams them to the GPU with no deserialization, resharding or conversion.
+    It loads on as many ranks as it was saved from.
+    """
+
     checkpoint_config: InferenceCheckpointConfig = Field({}, alias="ckpt_config")
     """
     TODO: Add docs. Expects a dictionary containing values for
@@ -260,6 +269,54 @@ class DeepSpeedInferenceConfig(DeepSpeedConfigModel):
     rather than seg-faulting or providing corrupted output.
     """
 
+    kv_cache_block_size: int = 0
+    """
+    Number of tokens per block of a paged KV cache. When set, the cache is a pool of blocks handed
+    out to the sequences as they grow instead of a max_out_tokens buffer per batch slot and layer,
+    so the memory held follows the tokens actually generated. 0 keeps the contiguous cache.
+    """
+
+    kv_cache_blocks: int = 0
+    """
+    Number of blocks of the paged KV cache, 0 sizes the pool from the memory left after the
+    workspace is allocated. Only used when ``kv_cache_block_size`` is set.
+    """
+
+    kv_cache_int8: bool = False
+    """
+    Store the paged KV cache as int8 with a scale per token and head, about half the memory of a
+    fp16 cache so the same pool holds twice the tokens. Only used when ``kv_cache_block_size`` is
+    set.
+    """
+
+    mp_overlap_chunks: int = 1
+    """
+    Number of row chunks the attention output GEMM is split in with tensor parallelism. The
+    all-reduce of each chunk is started as soon as its GEMM is done, so it runs while the next chunk
+    is computed instead of after the whole GEMM. 1 keeps a single GEMM and all-reduce.
+    """
+
+    gemm_autotune: bool = False
+    """
+    Time the cuBLAS algorithms of every GEMM shape the kernels run on its first use and keep the
+    fastest. The winners are stored in an on-disk cache per GPU model, in
+    ``$DS_GEMM_ALGO_CACHE_DIR`` or else ``~/.cache/deepspeed/gemm_algos``, so later runs start
+    without the search. Token counts are rounded up to a power of two, so the search runs once per
+    bucket of prompt lengths.
+    """
+
+    rope_theta: float = 10000.0
+    """
+    Base of the rotary embedding frequencies, larger for models trained with an NTK scaled base.
+    Only used by models with rotary embeddings.
+    """
+
+    rope_scaling: float = 1.0
+    """
+    Linear scaling of the rotary embedding: positions are divided by this factor before their
+    angles are taken, to run past the context length the model was trained with.
+    """
+
     transposed_mode: bool = Field(False, alias="transposed_mode")
 
     mp_size: int = Field(1, deprecated=True, new_param="tensor_parallel.tp_size")
@@ -33,6 +33,8 @@ class DeepSpeedTransformerInference(nn.Module):
                 for specific downstream tasks.
     """
     layer_id = 0
+    # Layers built in each inference context, see new_inference_context.
+    context_layers = {}
 
     def __init__(self,
                  config,
@@ -52,6 +54,12 @@ class DeepSpeedTransformerInference(nn.Module):
         if inference_cuda_module is None:
             builder = InferenceBuilder()
             inference_cuda_module = builder.load()
+        if self.config.gemm_autotune:
+            inference_cuda_module.set_gemm_autotune(True)
+        if self.config.rotary_dim > 0:
+            inference_cuda_module.set_rotary_base(self.config.rope_theta, self.config.rope_scaling)
+        self.context_id = inference_cuda_module.current_context()
+        DeepSpeedTransformerInference.context_layers[self.context_id] = DeepSpeedTransformerInference.layer_id
 
         if DeepSpeedTransformerInference.layer_id == 1:
             log_dist(f"DeepSpeed-Inference config: {self.config.__dict__}", [0])
@@ -78,11 +86,85 @@ class DeepSpeedTransformerInference(nn.Module):
                                 inference_cuda_module.allocate_workspace_fp16
         self._alloc_workspace = True
 
+    @classmethod
+    def new_inference_context(cls):
+        """Host another model on the same GPU: the layers built after this call belong to a new
+        inference context, with its own workspace, KV cache and token count, and are numbered from
+        0 again. Every model selects its context when its first layer runs. Returns the context id."""
+        global inference_cuda_module
+        if inference_cuda_module is None:
+            inference_cuda_module = InferenceBuilder().load()
+        context_id = inference_cuda_module.create_context()
+        inference_cuda_module.select_context(context_id)
+        cls.layer_id = 0
+        return context_id
+
+    @classmethod
+    def destroy_inference_context(cls, context_id):
+        """Free the workspace and KV cache of a model built after ``new_inference_context``."""
+        inference_cuda_module.destroy_context(context_id)
+        cls.context_layers.pop(context_id, None)
+
     @classmethod
     def reset_cache(cls):
         if inference_cuda_module is not None:
             inference_cuda_module.reset_cache()
 
+    @classmethod
+    def set_ragged_batch(cls, seq_ids, new_tokens):
+        """Describe the batch of the next forward for continuous batching over the paged KV cache:
+        slot ``i`` continues sequence ``seq_ids[i]`` with ``new_tokens[i]`` tokens, the input being
+        right padded to the longest slot. Needs ``kv_cache_block_size`` to be set."""
+        inference_cuda_module.set_ragged_batch(list(seq_ids), list(new_tokens))
+
+    @classmethod
+    def release_sequence(cls, seq_id):
+        """Return the paged KV cache blocks of a finished sequence, its id can then be reused."""
+        inference_cuda_module.release_sequence(seq_id)
+
+    @classmethod
+    def match_prefix(cls, seq_id, token_ids):
+        """Prefix sharing over the paged KV cache: give the new sequence ``seq_id`` the cached
+        blocks of the longest registered prefix of ``token_ids`` and return how many tokens they
+        hold. The prompt then only runs the tokens after them, as a ragged batch slot bringing
+        ``len(token_ids) - matched`` tokens. At least the last token is always left to compute."""
+        return inference_cuda_module.match_prefix(seq_id, list(token_ids))
+
+    @classmethod
+    def register_prefix(cls, seq_id, token_ids):
+        """Make the full blocks of the cached ``token_ids`` of ``seq_id`` available to
+        ``match_prefix``, e.g. after the prompt of a shared system prompt has run. Registered
+        blocks stay cached after the sequence is released, until the pool needs them."""
+        return inference_cuda_module.register_prefix(seq_id, list(token_ids))
+
+    @classmethod
+    def clear_prefixes(cls):
+        """Drop all registered prefixes, their blocks are freed once no sequence uses them."""
+        inference_cuda_module.clear_prefixes()
+
+    @classmethod
+    def set_device_positions(cls, enabled=True):
+        """Take the decode position of every sequence from device memory instead of the host side
+        token count, so that one decode step can be captured in a CUDA graph and replayed for all
+        the following tokens. Capture a graph per batch size after the prompt has run, with the
+        attention mask (or alibi) in a static buffer as wide as ``max_out_tokens``; the returned
+        presents keep the length of the capture. Only for the dense KV cache."""
+        inference_cuda_module.set_device_positions(enabled)
+
+    @classmethod
+    def append_next_forward(cls):
+        """Speculative decoding: the tokens of the next forward, e.g. the draft tokens to verify,
+        follow the cached ones instead of starting a new prompt. Each of them attends causally to
+        the cache and to the new tokens before it, and all of them are cached."""
+        inference_cuda_module.append_next_forward()
+
+    @classmethod
+    def truncate_kv_cache(cls, tokens, seq_id=-1):
+        """Keep the first ``tokens`` cached tokens and drop the rest, e.g. the draft tokens rejected
+        after a verify forward. ``seq_id`` picks one sequence of the paged KV cache, by default the
+        whole batch is rolled back."""
+        inference_cuda_module.truncate_kv_cache(tokens, seq_id)
+
     def forward(
             self,
             input=None,
@@ -114,14 +196,19 @@ class DeepSpeedTransformerInference(nn.Module):
 
         input_mask = (input_mask if attn_mask is None else attn_mask) if attention_mask is None else attention_mask
 
+        if self.config.layer_id == 0:
+            inference_cuda_module.select_context(self.context_id)
         # Allocate memory only on first layer forward
         if self.config.layer_id == 0 and self._alloc_workspace:
             self.allocate_workspace(self.config.hidden_size, self.config.heads,
                                     input.size()[1],
-                                    input.size()[0], DeepSpeedTransformerInference.layer_id, self.config.mp_size,
+                                    input.size()[0], DeepSpeedTransformerInference.context_layers[self.context_id],
+                                    self.config.mp_size,
                                     self.config.bigscience_bloom,
                                     dist.get_rank() if dist.is_initialized() else 0, self.config.max_out_tokens,
-                                    self.config.min_out_tokens)
+                                    self.config.min_out_tokens, self.config.kv_cache_block_size,
+                                    self.config.kv_cache_blocks, self.config.kv_cache_int8,
+                                    self.config.num_kv_heads)
             self._alloc_workspace = False
 
         get_present = (get_present or get_key_value or use_cache)
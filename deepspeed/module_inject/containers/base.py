@@ -33,6 +33,8 @@ class BaseTransformerContainer(ABC):
         # configuration for models. todo: can this be moved to a pydantic model config?
         self.hidden_size = None
         self.num_attention_heads = None
+        # Grouped-query attention models keep fewer key/value heads than attention heads.
+        self.num_kv_heads = getattr(self.model_config, 'num_key_value_heads', None)
         self.mp_size = self.config.tensor_parallel.tp_size
         self.pre_layer_norm = self.model_config.do_layer_norm_before if \
             hasattr(self.model_config, 'do_layer_norm_before') else self.policy.pre_attn_norm
@@ -80,6 +82,10 @@ class BaseTransformerContainer(ABC):
         assert self.num_attention_heads % self.mp_size == 0,\
                 "To run the model parallel across the GPUs, the attention_heads require to be divisible by the world_size!" +\
                 "This is because the attention computation is partitioned evenly among the parallel GPUs."
+        if self.num_kv_heads is None:
+            self.num_kv_heads = self.num_attention_heads
+        assert self.num_kv_heads % self.mp_size == 0 and self.num_attention_heads % self.num_kv_heads == 0, \
+            "The key/value heads need to divide the attention heads and be divisible by the world_size!"
 
         self.ds_model_config = DeepSpeedInferenceConfig(
             hidden_size=self.hidden_size,
@@ -104,7 +110,15 @@ class BaseTransformerContainer(ABC):
             use_mup=self.use_mup,
             return_single_tuple=self.return_single_tuple,
             set_empty_params=self.config.set_empty_params,
-            transposed_mode=self.config.transposed_mode)
+            transposed_mode=self.config.transposed_mode,
+            kv_cache_block_size=self.config.kv_cache_block_size,
+            kv_cache_blocks=self.config.kv_cache_blocks,
+            kv_cache_int8=self.config.kv_cache_int8,
+            num_kv_heads=self.num_kv_heads,
+            mp_overlap_chunks=self.config.mp_overlap_chunks,
+            gemm_autotune=self.config.gemm_autotune,
+            rope_theta=self.config.rope_theta,
+            rope_scaling=self.config.rope_scaling)
 
         return self.ds_model_config
 
@@ -0,0 +1,192 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+"""
+Checkpoint of an injected model in the layout of the inference kernels, one file per tensor parallel rank.
+
+The file of a rank holds the raw bytes of every tensor of the replaced module state dict, already sharded,
+transposed and (with int8) quantized as the kernels use them, with the quantization scales next to their
+weights. Loading it is then only a copy: the file is read in large chunks into pinned buffers, through the aio
+engine when it is available or else a memory map, and each chunk is copied to the GPU tensors it overlaps
+while the next chunk is read.
+
+Layout of ``kernel_<rank>.bin``: the tensors one after the other, each starting at a multiple of ``ALIGNMENT``
+bytes, the file padded to a multiple of it as well so every read can use O_DIRECT. ``kernel_<rank>.json`` maps
+the state dict names to their dtype, shape and byte offset.
+"""
+
+import json
+import os
+
+import numpy as np
+import torch
+
+import deepspeed
+from deepspeed import comm as dist
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import AsyncIOBuilder
+
+ALIGNMENT = 4096
+CHUNK_BYTES = 64 * 1024 * 1024
+
+
+def kernel_checkpoint_names(rank):
+    return f'kernel_{rank:0>2d}.bin', f'kernel_{rank:0>2d}.json'
+
+
+def _dtype_name(dtype):
+    return str(dtype).split('.')[-1]
+
+
+def _tensor_bytes(tensor):
+    return tensor.detach().contiguous().reshape(-1).view(torch.uint8).cpu().numpy()
+
+
+def save_kernel_checkpoint(module, save_dir, rank):
+    """Write the state dict of the injected ``module`` to the kernel layout files of ``rank`` in ``save_dir``."""
+    bin_name, index_name = kernel_checkpoint_names(rank)
+    index = {}
+    offset = 0
+
+    def write(f, tensor):
+        nonlocal offset
+        entry = {'dtype': _dtype_name(tensor.dtype), 'shape': list(tensor.shape), 'offset': offset}
+        data = _tensor_bytes(tensor)
+        f.write(data)
+        pad = -len(data) % ALIGNMENT
+        f.write(b'\0' * pad)
+        offset += len(data) + pad
+        return entry
+
+    with open(os.path.join(save_dir, bin_name), 'wb') as f:
+        for name, tensor in module.state_dict(keep_vars=True).items():
+            index[name] = write(f, tensor)
+            if hasattr(tensor, 'scale'):
+                index[name]['scale'] = write(f, tensor.scale)
+    with open(os.path.join(save_dir, index_name), 'w') as f:
+        json.dump({'file_size': offset, 'tensors': index}, f)
+
+
+def _materialize(module, name, entry, device):
+    """The tensor ``name`` of ``module`` to load ``entry`` into, allocated on ``device`` if it is a meta tensor."""
+    module_name, _, attr = name.rpartition('.')
+    owner = module.get_submodule(module_name) if module_name else module
+    tensor = getattr(owner, attr)
+    dtype = getattr(torch, entry['dtype'])
+    if tensor.is_meta or tensor.dtype != dtype or list(tensor.shape) != entry['shape']:
+        data = torch.empty(entry['shape'], dtype=dtype, device=device if tensor.is_meta else tensor.device)
+        if isinstance(tensor, torch.nn.Parameter):
+            tensor.data = data
+        else:
+            setattr(owner, attr, data)
+            tensor = data
+    return tensor
+
+
+class _ChunkReader:
+    """Reads consecutive chunks of a file into two pinned buffers, the next chunk in flight while one is used."""
+
+    def __init__(self, path, file_size, chunk_bytes, use_aio):
+        self.path = path
+        self.file_size = file_size
+        self.chunk_bytes = chunk_bytes
+        self.aio_handle = None
+        if use_aio:
+            aio_op = AsyncIOBuilder().load(verbose=False)
+            self.aio_handle = aio_op.aio_handle(1024 * 1024, 32, False, True, 1)
+            example = torch.empty(0, dtype=torch.uint8)
+            self.buffers = [self.aio_handle.new_cpu_locked_tensor(chunk_bytes, example) for _ in range(2)]
+        else:
+            self.mmap = np.memmap(path, dtype=np.uint8, mode='r', shape=(file_size, ))
+            self.buffers = [
+                get_accelerator().pin_memory(torch.empty(chunk_bytes, dtype=torch.uint8)) for _ in range(2)
+            ]
+        self.copied = [None, None]
+
+    def _read(self, index, start):
+        size = min(self.chunk_bytes, self.file_size - start)
+        buffer = self.buffers[index % 2][:size]
+        # The copies out of this buffer must be done before it is refilled.
+        if self.copied[index % 2] is not None:
+            self.copied[index % 2].synchronize()
+        if self.aio_handle is not None:
+            self.aio_handle.async_pread_batch([buffer], [self.path], [start])
+        else:
+            buffer.numpy()[:] = self.mmap[start:start + size]
+        return buffer
+
+    def chunks(self):
+        """Yields (file offset, pinned chunk). The caller queues its copies out of a chunk before asking for the
+        next one: the aio read of the next chunk runs while they are queued, the memory map copy after."""
+        starts = list(range(0, self.file_size, self.chunk_bytes))
+        pending = self._read(0, 0) if starts else None
+        for i, start in enumerate(starts):
+            chunk = pending
+            has_next = i + 1 < len(starts)
+            if self.aio_handle is not None:
+                self.aio_handle.wait()
+                if has_next:
+                    pending = self._read(i + 1, starts[i + 1])
+            yield start, chunk
+            self.copied[i % 2] = get_accelerator().Event()
+            self.copied[i % 2].record()
+            if self.aio_handle is None and has_next:
+                pending = self._read(i + 1, starts[i + 1])
+
+    def close(self):
+        for event in self.copied:
+            if event is not None:
+                event.synchronize()
+        if self.aio_handle is not None:
+            for buffer in self.buffers:
+                self.aio_handle.free_cpu_locked_tensor(buffer)
+        self.buffers = None
+
+
+def load_kernel_checkpoint(module, checkpoint_dict, rank, chunk_bytes=CHUNK_BYTES, use_aio=None):
+    """Load the kernel layout checkpoint of ``rank`` into the injected ``module``.
+
+    ``checkpoint_dict`` is the ``ds_inference_config.json`` written next to the files. ``use_aio`` defaults to
+    using the aio engine when it is compatible with the system.
+    """
+    base_dir = checkpoint_dict.get('base_dir', '')
+    files = checkpoint_dict['checkpoints']['kernel']
+    world_size = dist.get_world_size() if dist.is_initialized() else 1
+    assert len(files) == world_size, \
+        f"The kernel layout checkpoint is sharded for {len(files)} ranks, it can only be loaded on as many ranks"
+    bin_name = files[rank]
+    index_name = os.path.splitext(bin_name)[0] + '.json'
+    with open(os.path.join(base_dir, index_name)) as f:
+        index = json.load(f)
+    if use_aio is None:
+        use_aio = deepspeed.ops.__compatible_ops__.get(AsyncIOBuilder.NAME, False)
+    device = get_accelerator().current_device_name()
+
+    # (offset, bytes, destination) of every tensor, in file order.
+    targets = []
+    for name, entry in index['tensors'].items():
+        tensor = _materialize(module, name, entry, device)
+        targets.append((entry['offset'], tensor.numel() * tensor.element_size(), tensor))
+        if 'scale' in entry:
+            scale = entry['scale']
+            tensor.scale = torch.empty(scale['shape'], dtype=getattr(torch, scale['dtype']), device=tensor.device)
+            targets.append((scale['offset'], tensor.scale.numel() * tensor.scale.element_size(), tensor.scale))
+    targets.sort(key=lambda target: target[0])
+
+    chunk_bytes -= chunk_bytes % ALIGNMENT
+    reader = _ChunkReader(os.path.join(base_dir, bin_name), index['file_size'], chunk_bytes, use_aio)
+    first = 0
+    for start, chunk in reader.chunks():
+        end = start + chunk.numel()
+        while first < len(targets) and targets[first][0] + targets[first][1] <= start:
+            first += 1
+        for offset, nbytes, tensor in targets[first:]:
+            if offset >= end:
+                break
+            begin, stop = max(offset, start), min(offset + nbytes, end)
+            if begin >= stop:
+                continue
+            dst = tensor.data.reshape(-1).view(torch.uint8)[begin - offset:stop - offset]
+            dst.copy_(chunk[begin - start:stop - start], non_blocking=True)
+    reader.close()
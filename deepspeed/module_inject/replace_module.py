@@ -11,6 +11,7 @@ import deepspeed.ops.transformer as transformer_inference
 from deepspeed.ops.transformer.inference.diffusers_attention import DeepSpeedDiffusersAttention
 from deepspeed.ops.transformer.inference.diffusers_transformer_block import DeepSpeedDiffusersTransformerBlock
 from deepspeed.ops.transformer.inference.diffusers_2d_transformer import Diffusers2DTransformerConfig
+from deepspeed.ops.transformer.inference.diffusers_resnet_block import DeepSpeedDiffusersResnetBlock
 from deepspeed.accelerator import get_accelerator
 from .replace_policy import HFGPT2LayerPolicy
 from .replace_policy import replace_policies, generic_policies
@@ -20,6 +21,7 @@ from torch import nn
 
 from .layers import LinearAllreduce, LinearLayer
 from .load_checkpoint import load_model_with_checkpoint
+from .kernel_checkpoint import kernel_checkpoint_names, load_kernel_checkpoint, save_kernel_checkpoint
 import time
 
 from .utils import policy_to_ds_container
@@ -225,6 +227,9 @@ def generic_injection(module, fp16=False, enable_cuda_graph=True):
         config = Diffusers2DTransformerConfig()
         return DeepSpeedDiffusersTransformerBlock(child, config)
 
+    def replace_resnet_block(child, policy):
+        return DeepSpeedDiffusersResnetBlock(child)
+
     if isinstance(module, torch.nn.Module):
         pass
     else:
@@ -235,9 +240,11 @@ def generic_injection(module, fp16=False, enable_cuda_graph=True):
             import diffusers
             cross_attention = diffusers.models.attention.CrossAttention
             attention_block = diffusers.models.attention.BasicTransformerBlock
+            resnet_block = diffusers.models.resnet.ResnetBlock2D
             new_policies = {
                 cross_attention: replace_attn,
                 attention_block: replace_attn_block,
+                resnet_block: replace_resnet_block,
             }
         except ImportError:
             new_policies = {}
@@ -511,7 +518,9 @@ def replace_transformer_layer(orig_layer_impl, model, checkpoint_dict, config, m
         ckpt_mp_size = checkpoint_dict.get('mp_size', ckpt_mp_size)
         base_dir1 = checkpoint_dict.get('base_dir', config.base_dir)
 
-        if ckpt_type == 'pp' and type(checkpoint) is list:
+        if checkpoint_dict['type'] == 'ds_kernel':
+            load_kernel_checkpoint(replaced_module, checkpoint_dict, rank)
+        elif ckpt_type == 'pp' and type(checkpoint) is list:
             pbar = tqdm.tqdm(total=len(checkpoint), desc=f"Loading {len(checkpoint)} checkpoint shards")
 
             for i in range(len(checkpoint)):
@@ -571,7 +580,26 @@ def replace_transformer_layer(orig_layer_impl, model, checkpoint_dict, config, m
                     gc.collect()
         print(f"checkpoint loading time at rank {rank}: {time.time()-start_time} sec")
 
-    if config.save_mp_checkpoint_path is not None:
+    if config.save_mp_checkpoint_path is not None and config.save_kernel_checkpoint:
+        import json
+        os.makedirs(config.save_mp_checkpoint_path, exist_ok=True)
+        if not dist.is_initialized() or dist.get_rank() == 0:
+            print("Saving tp-sharded checkpoints in the kernel layout")
+            with open(f"{config.save_mp_checkpoint_path}/ds_inference_config.json", "w") as cfg:
+                json.dump(
+                    {
+                        'type': 'ds_kernel',
+                        'base_dir': f'{config.save_mp_checkpoint_path}',
+                        'checkpoints': {
+                            "kernel": [kernel_checkpoint_names(r)[0] for r in range(world_size)]
+                        },
+                        'version': 1.0,
+                        'parallelization': 'tp',
+                        'tp_size': world_size,
+                        'dtype': 'int8' if quantize else ('float16' if fp16 else 'float32')
+                    }, cfg)
+        save_kernel_checkpoint(replaced_module, config.save_mp_checkpoint_path, rank)
+    elif config.save_mp_checkpoint_path is not None:
         from collections import OrderedDict
         import json
         num_partitions = 8
@@ -5,13 +5,38 @@
 
 import torch
 from deepspeed.ops.op_builder import CPUAdagradBuilder
+from deepspeed.utils import logger
 from deepspeed.utils.logging import should_log_le
 
 
 class DeepSpeedCPUAdagrad(torch.optim.Optimizer):
     optimizer_id = 0
 
-    def __init__(self, model_params, lr=1e-2, eps=1e-10, weight_decay=0, amsgrad=False, fp32_optimizer_states=True):
+    def __init__(self,
+                 model_params,
+                 lr=1e-2,
+                 eps=1e-10,
+                 weight_decay=0,
+                 amsgrad=False,
+                 fp32_optimizer_states=True,
+                 numa_aware=False):
+        """Vectorized implementation of Adagrad on CPU, for ZeRO-Offload.
+
+        Arguments:
+            model_params (iterable): iterable of parameters to optimize or dicts defining
+                parameter groups.
+            lr (float, optional): learning rate. (default: 1e-2)
+            eps (float, optional): term added to the denominator to improve
+                numerical stability. (default: 1e-10)
+            weight_decay (float, optional): weight decay (L2 penalty) (default: 0)
+            amsgrad (boolean, optional): unused, Adagrad has no AMSGrad variant. (default: False)
+            fp32_optimizer_states: creates the variance in full precision regardless of the precision
+                        of the parameters (default: True)
+            numa_aware: pin the optimizer threads node by node and allocate the variance on the node
+                        whose threads update it, so multi-socket hosts do not stream state across sockets.
+                        The calling thread is only moved to its node while a step runs and keeps its own
+                        affinity otherwise. (default: False)
+        """
 
         default_args = dict(lr=lr, eps=eps, weight_decay=weight_decay, amsgrad=amsgrad)
         super(DeepSpeedCPUAdagrad, self).__init__(model_params, default_args)
@@ -23,6 +48,12 @@ class DeepSpeedCPUAdagrad(torch.optim.Optimizer):
 
         self.ds_opt_adagrad.create_adagrad(self.opt_id, lr, eps, weight_decay, should_log_le("info"))
 
+        # See DeepSpeedCPUAdam, the variance is placed on the node whose threads update it.
+        self.numa_aware = numa_aware
+        if self.numa_aware:
+            num_nodes = self.ds_opt_adagrad.numa_init()
+            logger.info(f"CPUAdagrad pinned its threads to {num_nodes} NUMA node(s)")
+
     def __del__(self):
         # need to destroy the C++ object explicitly to avoid a memory leak when deepspeed.initialize
         # is used multiple times in the same process (notebook or pytest worker)
@@ -81,7 +112,14 @@ class DeepSpeedCPUAdagrad(torch.optim.Optimizer):
 
                     #memory_format=torch.preserve_format)
                     # gradient variances
-                    state['exp_avg_sq'] = torch.zeros_like(p.data, dtype=state_dtype, device='cpu')
+                    if self.numa_aware:
+                        state['exp_avg_sq'] = torch.empty_like(p.data,
+                                                               dtype=state_dtype,
+                                                               device='cpu',
+                                                               memory_format=torch.contiguous_format)
+                        self.ds_opt_adagrad.numa_zero(state['exp_avg_sq'])
+                    else:
+                        state['exp_avg_sq'] = torch.zeros_like(p.data, dtype=state_dtype, device='cpu')
                     #memory_format=torch.preserve_format)
 
                 state['step'] += 1
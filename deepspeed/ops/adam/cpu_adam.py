@@ -8,6 +8,7 @@ from cpuinfo import get_cpu_info
 from deepspeed.utils import logger
 from deepspeed.utils.logging import should_log_le
 from deepspeed.ops.op_builder import CPUAdamBuilder
+from .fused_adam import QUANTIZED_STATE_BLOCK, QUANTIZED_STATE_MIN_NUMEL
 
 
 class DeepSpeedCPUAdam(torch.optim.Optimizer):
@@ -22,7 +23,11 @@ class DeepSpeedCPUAdam(torch.optim.Optimizer):
                  weight_decay=0,
                  amsgrad=False,
                  adamw_mode=True,
-                 fp32_optimizer_states=True):
+                 fp32_optimizer_states=True,
+                 numa_aware=False,
+                 copy_pipeline_depth=2,
+                 copy_tile_numel=128 * 1024 * 1024,
+                 quantized_state=False):
         """Fast vectorized implementation of two variations of Adam optimizer on CPU:
 
         * Adam: A Method for Stochastic Optimization: (https://arxiv.org/abs/1412.6980);
@@ -65,6 +70,17 @@ class DeepSpeedCPUAdam(torch.optim.Optimizer):
             adamw_mode: select between Adam and AdamW implementations (default: AdamW)
             full_precision_optimizer_states: creates momementum and variance in full precision regardless of
                         the precision of the parameters (default: True)
+            numa_aware: pin the optimizer threads node by node and allocate momentum and variance on the
+                        node whose threads update them, so multi-socket hosts do not stream state across
+                        sockets. The calling thread is only moved to its node while a step runs and keeps
+                        its own affinity otherwise. (default: False)
+            copy_pipeline_depth: number of pinned tiles staging the updated params on their way to the device
+                        copy in ``fp16_param_groups``. The optimizer only waits for a copy once all tiles are in
+                        flight. The tiles are shared by all CPUAdam instances. (default: 2)
+            copy_tile_numel: elements per staging tile of the device copy. (default: 128M)
+            quantized_state: keep momentum and variance of params with at least ``QUANTIZED_STATE_MIN_NUMEL``
+                        elements as blockwise 8-bit codes, in the same layout as ``FusedAdam``. This cuts the
+                        host memory of the state 4x, smaller params keep fp32 state. (default: False)
         """
 
         default_args = dict(lr=lr,
@@ -91,10 +107,18 @@ class DeepSpeedCPUAdam(torch.optim.Optimizer):
         DeepSpeedCPUAdam.optimizer_id = DeepSpeedCPUAdam.optimizer_id + 1
         self.adam_w_mode = adamw_mode
         self.fp32_optimizer_states = fp32_optimizer_states
+        self.quantized_state = quantized_state
+        # Base seed of the stochastic rounding of the 8-bit moments, mixed with the step in the kernel.
+        self.state_seed = int(torch.randint(0, 2**31 - 1, (1, )).item())
         self.ds_opt_adam = CPUAdamBuilder().load()
 
         self.ds_opt_adam.create_adam(self.opt_id, lr, betas[0], betas[1], eps, weight_decay, adamw_mode,
-                                     should_log_le("info"))
+                                     should_log_le("info"), copy_pipeline_depth, copy_tile_numel)
+
+        self.numa_aware = numa_aware
+        if self.numa_aware:
+            num_nodes = self.ds_opt_adam.numa_init()
+            logger.info(f"CPUAdam pinned its threads to {num_nodes} NUMA node(s)")
 
     def __del__(self):
         # need to destroy the C++ object explicitly to avoid a memory leak when deepspeed.initialize
@@ -106,6 +130,15 @@ class DeepSpeedCPUAdam(torch.optim.Optimizer):
         for group in self.param_groups:
             group.setdefault('amsgrad', False)
 
+    def _zeros_like(self, data, dtype, device, copy):
+        if not self.numa_aware:
+            return torch.zeros_like(data, dtype=dtype, device=device)
+        # Leave the pages untouched so the first write, done by the owning threads, places them. A step that
+        # copies the params to the device splits the state by its copy tile, so the zeroing needs to know.
+        state = torch.empty_like(data, dtype=dtype, device=device, memory_format=torch.contiguous_format)
+        self.ds_opt_adam.numa_zero(self.opt_id, state, copy)
+        return state
+
     @torch.no_grad()
     def step(self, closure=None, fp16_param_groups=None):
         """Update the model parameters.
@@ -119,7 +152,7 @@ class DeepSpeedCPUAdam(torch.optim.Optimizer):
         Args:
             closure (callable, optional): closure to compute the loss.
                 Defaults to ``None``.
-            fp16_param_groups: FP16 GPU parameters to update. Performing the
+            fp16_param_groups: FP16 or BF16 GPU parameters to update. Performing the
                 copy here reduces communication time. Defaults to ``None``.
 
         Returns:
@@ -142,6 +175,8 @@ class DeepSpeedCPUAdam(torch.optim.Optimizer):
             fp16_param_groups = [[fp16_param_groups]]
 
         for group_id, group in enumerate(self.param_groups):
+            # Params without a device copy are updated by one multi tensor call per step count.
+            multi_tensor_lists = {}
             for param_id, p in enumerate(group['params']):
 
                 if p.grad is None:
@@ -158,24 +193,47 @@ class DeepSpeedCPUAdam(torch.optim.Optimizer):
 
                     #use full precision by default unless self.fp32_optimizer_states is off
                     state_dtype = torch.float if self.fp32_optimizer_states else p.dtype
+                    if self.quantized_state and p.numel() >= QUANTIZED_STATE_MIN_NUMEL:
+                        state_dtype = torch.uint8
+                        blocks = (p.numel() + QUANTIZED_STATE_BLOCK - 1) // QUANTIZED_STATE_BLOCK
+                        state['state_absmax'] = torch.zeros(2 * blocks, dtype=torch.float, device=device)
 
                     # gradient momentums
-                    state['exp_avg'] = torch.zeros_like(p.data, dtype=state_dtype, device=device)
+                    state['exp_avg'] = self._zeros_like(p.data, state_dtype, device, fp16_param_groups is not None)
                     #memory_format=torch.preserve_format)
                     # gradient variances
-                    state['exp_avg_sq'] = torch.zeros_like(p.data, dtype=state_dtype, device=device)
+                    state['exp_avg_sq'] = self._zeros_like(p.data, state_dtype, device, fp16_param_groups is not None)
                     #memory_format=torch.preserve_format)
 
                 state['step'] += 1
                 beta1, beta2 = group['betas']
 
-                if fp16_param_groups is not None:
+                if 'state_absmax' in state:
+                    self.ds_opt_adam.adam_update_quantized(self.opt_id, state['step'], group['lr'], beta1, beta2,
+                                                           group['eps'], group['weight_decay'],
+                                                           group['bias_correction'], p.data, p.grad.data,
+                                                           state['exp_avg'], state['exp_avg_sq'],
+                                                           state['state_absmax'], self.state_seed)
+                    if fp16_param_groups is not None:
+                        fp16_param_groups[group_id][param_id].data.copy_(p.data)
+                elif fp16_param_groups is not None:
                     self.ds_opt_adam.adam_update_copy(self.opt_id, state['step'], group['lr'], beta1, beta2,
                                                       group['eps'], group['weight_decay'], group['bias_correction'],
                                                       p.data, p.grad.data, state['exp_avg'], state['exp_avg_sq'],
                                                       fp16_param_groups[group_id][param_id].data)
-                else:
+                elif self.numa_aware:
+                    # The per tensor split is the one numa_zero placed the moments with.
                     self.ds_opt_adam.adam_update(self.opt_id, state['step'], group['lr'], beta1, beta2, group['eps'],
                                                  group['weight_decay'], group['bias_correction'], p.data, p.grad.data,
                                                  state['exp_avg'], state['exp_avg_sq'])
+                else:
+                    tensor_lists = multi_tensor_lists.setdefault(state['step'], ([], [], [], []))
+                    for tensor_list, tensor in zip(tensor_lists,
+                                                   [p.data, p.grad.data, state['exp_avg'], state['exp_avg_sq']]):
+                        tensor_list.append(tensor)
+
+            for step, tensor_lists in multi_tensor_lists.items():
+                beta1, beta2 = group['betas']
+                self.ds_opt_adam.adam_update_multi(self.opt_id, step, group['lr'], beta1, beta2, group['eps'],
+                                                   group['weight_decay'], group['bias_correction'], *tensor_lists)
         return loss
@@ -15,6 +15,10 @@ from deepspeed.accelerator import get_accelerator
 from deepspeed.ops.op_builder import FusedAdamBuilder
 
 
+QUANTIZED_STATE_MIN_NUMEL = 4096
+QUANTIZED_STATE_BLOCK = 2048
+
+
 class FusedAdam(torch.optim.Optimizer):
     """Implements Adam algorithm.
 
@@ -43,6 +47,9 @@ class FusedAdam(torch.optim.Optimizer):
             True for decoupled weight decay(also known as AdamW) (default: True)
         set_grad_none (bool, optional): whether set grad to None when zero_grad()
             method is called. (default: True)
+        quantized_state (bool, optional): keep exp_avg and exp_avg_sq of params with at least
+            ``QUANTIZED_STATE_MIN_NUMEL`` elements as blockwise 8-bit codes, one byte per element plus
+            two fp32 scales per block of 2048. Smaller params keep fp32 moments. (default: False)
 
     .. _Adam - A Method for Stochastic Optimization:
         https://arxiv.org/abs/1412.6980
@@ -59,7 +66,8 @@ class FusedAdam(torch.optim.Optimizer):
                  adam_w_mode=True,
                  weight_decay=0.,
                  amsgrad=False,
-                 set_grad_none=True):
+                 set_grad_none=True,
+                 quantized_state=False):
 
         if amsgrad:
             raise RuntimeError('FusedAdam does not support the AMSGrad variant.')
@@ -67,11 +75,15 @@ class FusedAdam(torch.optim.Optimizer):
         super(FusedAdam, self).__init__(params, defaults)
         self.adam_w_mode = 1 if adam_w_mode else 0
         self.set_grad_none = set_grad_none
+        self.quantized_state = quantized_state
+        # Base seed of the stochastic rounding of the 8-bit moments, mixed with the step on the device.
+        self.state_seed = int(torch.randint(0, 2**31 - 1, (1, )).item())
 
         fused_adam_cuda = FusedAdamBuilder().load()
         # Skip buffer
         self._dummy_overflow_buf = get_accelerator().IntTensor([0])
         self.multi_tensor_adam = fused_adam_cuda.multi_tensor_adam
+        self.multi_tensor_adam_8bit = fused_adam_cuda.multi_tensor_adam_8bit
 
     def zero_grad(self):
         if self.set_grad_none:
@@ -81,12 +93,41 @@ class FusedAdam(torch.optim.Optimizer):
         else:
             super(FusedAdam, self).zero_grad()
 
-    def step(self, closure=None, grads=None, output_params=None, scale=None, grad_norms=None):
+    @staticmethod
+    def epilogue_scalars(scaled_grad_norm, loss_scale=1., max_grad_norm=0.):
+        """Device side ``found_inf`` and ``clip_coef`` for :meth:`step`, computed from the global norm of the
+        still scaled gradients without a sync on the host. Clipping follows ``FP16_Optimizer``.
+        """
+        found_inf = (~torch.isfinite(scaled_grad_norm)).float().view(1)
+        clip_coef = None
+        if max_grad_norm > 0:
+            clip = ((scaled_grad_norm.float() / loss_scale) + 1e-6) / max_grad_norm
+            clip_coef = (1. / clip.clamp(min=1.)).view(1)
+        return found_inf, clip_coef
+
+    def step(self,
+             closure=None,
+             grads=None,
+             output_params=None,
+             scale=None,
+             grad_norms=None,
+             inv_scale=1.,
+             found_inf=None,
+             clip_coef=None):
         """Performs a single optimization step.
 
         Arguments:
             closure (callable, optional): A closure that reevaluates the model
                 and returns the loss.
+            inv_scale (float, optional): inverse loss scale the gradients are multiplied with as they
+                are read. (default: 1)
+            found_inf (Tensor, optional): one element float tensor on the device of the params. The
+                step is skipped on the device when it is non zero. The step counts then move to one
+                element float tensors on the device, advanced by ``1 - found_inf`` and read by the
+                bias correction in the kernel, so a skipped step is not counted and step() never waits
+                on the device.
+            clip_coef (Tensor, optional): one element float tensor on the device of the params, the
+                gradients are multiplied with it as they are read.
 
         The remaining arguments are deprecated, and are only retained (for the moment) for error-checking purposes.
         """
@@ -98,6 +139,15 @@ class FusedAdam(torch.optim.Optimizer):
         if closure is not None:
             loss = closure()
 
+        # Step count advance of the states whose count lives on the device, 0 for a skipped step
+        advance = None if found_inf is None else 1. - found_inf
+
+        epilogue = dict(inv_scale=inv_scale)
+        if found_inf is not None:
+            epilogue['found_inf'] = found_inf
+        if clip_coef is not None:
+            epilogue['clip_coef'] = clip_coef
+
         for group in self.param_groups:
             bias_correction = 1 if group['bias_correction'] else 0
             beta1, beta2 = group['betas']
@@ -108,6 +158,12 @@ class FusedAdam(torch.optim.Optimizer):
             # create lists for multi-tensor apply
             g_16, p_16, m_16, v_16 = [], [], [], []
             g_32, p_32, m_32, v_32 = [], [], [], []
+            # g, p, exp_avg, exp_avg_sq and absmax lists of the quantized state, per param dtype
+            quantized_lists = {}
+            # One step for every launch of the group, whatever the mix of dtypes and state formats
+            step = 0
+            step_tensor = None
+            device_steps = []
 
             for p in group['params']:
                 if p.grad is None:
@@ -123,12 +179,34 @@ class FusedAdam(torch.optim.Optimizer):
                     # While this is not an issue for ZeRO 1 & 2, since they apply a single optimizatin step to the whole param group at the same time.
                     # In order to keep backward compatibility for the existing checkpoints, we use group['state'] to initialize state['step'] if it exists.
                     state['step'] = group.get('step', 0)
-                    # Exponential moving average of gradient values
-                    state['exp_avg'] = torch.zeros_like(p.data)
-                    # Exponential moving average of squared gradient values
-                    state['exp_avg_sq'] = torch.zeros_like(p.data)
-
-                if p.dtype == torch.float16:
+                    if self.quantized_state and p.numel() >= QUANTIZED_STATE_MIN_NUMEL:
+                        # Zero codes decode to zero moments whatever the absmax.
+                        blocks = (p.numel() + QUANTIZED_STATE_BLOCK - 1) // QUANTIZED_STATE_BLOCK
+                        state['exp_avg'] = torch.zeros_like(p.data, dtype=torch.uint8)
+                        state['exp_avg_sq'] = torch.zeros_like(p.data, dtype=torch.uint8)
+                        state['state_absmax'] = torch.zeros(2 * blocks, dtype=torch.float32, device=p.device)
+                    else:
+                        # Exponential moving average of gradient values
+                        state['exp_avg'] = torch.zeros_like(p.data)
+                        # Exponential moving average of squared gradient values
+                        state['exp_avg_sq'] = torch.zeros_like(p.data)
+
+                if found_inf is not None or torch.is_tensor(state['step']):
+                    if not torch.is_tensor(state['step']):
+                        state['step'] = torch.tensor([float(state['step'])], dtype=torch.float32, device=p.device)
+                    device_steps.append(state['step'])
+                    step_tensor = state['step']
+                else:
+                    state['step'] += 1
+                    step = state['step']
+
+                if 'state_absmax' in state and p.dtype in (torch.float16, torch.float32):
+                    tensor_lists = quantized_lists.setdefault(p.dtype, [[], [], [], [], []])
+                    for tensors, t in zip(tensor_lists, [
+                            p.grad.data, p.data, state['exp_avg'], state['exp_avg_sq'], state['state_absmax']
+                    ]):
+                        tensors.append(t)
+                elif p.dtype == torch.float16:
                     g_16.append(p.grad.data)
                     p_16.append(p.data)
                     m_16.append(state['exp_avg'])
@@ -141,15 +219,35 @@ class FusedAdam(torch.optim.Optimizer):
                 else:
                     raise RuntimeError('FusedAdam only support fp16 and fp32.')
 
+            group_epilogue = epilogue
+            if step_tensor is not None:
+                if advance is None:
+                    torch._foreach_add_(device_steps, 1)
+                else:
+                    torch._foreach_add_(device_steps, [advance] * len(device_steps))
+                group_epilogue = dict(epilogue, step_tensor=step_tensor)
+
             if (len(g_16) > 0):
-                state['step'] += 1
                 multi_tensor_applier(self.multi_tensor_adam, self._dummy_overflow_buf, [g_16, p_16, m_16, v_16],
-                                     group['lr'], beta1, beta2, group['eps'], state['step'], self.adam_w_mode,
-                                     bias_correction, group['weight_decay'])
+                                     group['lr'], beta1, beta2, group['eps'], step, self.adam_w_mode,
+                                     bias_correction, group['weight_decay'], **group_epilogue)
             if (len(g_32) > 0):
-                state['step'] += 1
                 multi_tensor_applier(self.multi_tensor_adam, self._dummy_overflow_buf, [g_32, p_32, m_32, v_32],
-                                     group['lr'], beta1, beta2, group['eps'], state['step'], self.adam_w_mode,
-                                     bias_correction, group['weight_decay'])
+                                     group['lr'], beta1, beta2, group['eps'], step, self.adam_w_mode,
+                                     bias_correction, group['weight_decay'], **group_epilogue)
+            for tensor_lists in quantized_lists.values():
+                multi_tensor_applier(self.multi_tensor_adam_8bit,
+                                     self._dummy_overflow_buf,
+                                     tensor_lists,
+                                     group['lr'],
+                                     beta1,
+                                     beta2,
+                                     group['eps'],
+                                     step,
+                                     self.adam_w_mode,
+                                     bias_correction,
+                                     group['weight_decay'],
+                                     seed=self.state_seed,
+                                     **group_epilogue)
 
         return loss
@@ -13,5 +13,5 @@ class MultiTensorApply(object):
     def __init__(self, chunk_size):
         self.chunk_size = chunk_size
 
-    def __call__(self, op, noop_flag_buffer, tensor_lists, *args):
-        return op(self.chunk_size, noop_flag_buffer, tensor_lists, *args)
+    def __call__(self, op, noop_flag_buffer, tensor_lists, *args, **kwargs):
+        return op(self.chunk_size, noop_flag_buffer, tensor_lists, *args, **kwargs)
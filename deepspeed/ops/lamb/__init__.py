@@ -3,4 +3,5 @@
 
 # DeepSpeed Team
 
+from .cpu_lamb import DeepSpeedCPULamb
 from .fused_lamb import FusedLamb
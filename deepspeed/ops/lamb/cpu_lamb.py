@@ -0,0 +1,169 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import torch
+from deepspeed.utils.logging import should_log_le
+from deepspeed.ops.op_builder import CPULambBuilder
+
+
+class DeepSpeedCPULamb(torch.optim.Optimizer):
+    optimizer_id = 0
+
+    def __init__(self,
+                 model_params,
+                 lr=1e-3,
+                 bias_correction=True,
+                 betas=(0.9, 0.999),
+                 eps=1e-8,
+                 eps_inside_sqrt=False,
+                 weight_decay=0.,
+                 max_grad_norm=0.,
+                 max_coeff=10.0,
+                 min_coeff=0.01,
+                 amsgrad=False,
+                 copy_pipeline_depth=2,
+                 copy_tile_numel=128 * 1024 * 1024):
+        """Vectorized implementation of the LAMB optimizer on CPU, for large batches:
+
+        * Large Batch Optimization for Deep Learning: Training BERT in 76 minutes (https://arxiv.org/abs/1904.00962)
+
+        The update matches FusedLamb. Each parameter tensor is updated in two passes, the first refreshes the
+        moments and reduces the parameter and update norms for the lamb coefficient, the second applies the
+        scaled update and, like CPUAdam, can copy the parameters back to the GPU on the fly.
+
+        The trust ratio is computed per parameter tensor, so it cannot be used with ZeRO, which hands the
+        optimizer one flat partition per rank.
+
+        Arguments:
+            model_params (iterable): iterable of parameters to optimize or dicts defining
+                parameter groups.
+            lr (float, optional): learning rate. (default: 1e-3)
+            bias_correction (bool, optional): bias correction (default: True)
+            betas (Tuple[float, float], optional): coefficients used for computing
+                running averages of gradient and its square. (default: (0.9, 0.999))
+            eps (float, optional): term added to the denominator to improve
+                numerical stability. (default: 1e-8)
+            eps_inside_sqrt (boolean, optional): adds eps to the second moment estimate before
+                evaluating square root instead of adding it to the square root. (default: False)
+            weight_decay (float, optional): weight decay (L2 penalty) (default: 0)
+            max_grad_norm (float, optional): value used to clip global grad norm, applied when
+                ``grad_norms`` are passed to :meth:`step` (default: 0.0)
+            max_coeff(float, optional): maximum value of the lamb coefficient (default: 10.0)
+            min_coeff(float, optional): minimum value of the lamb coefficient (default: 0.01)
+            amsgrad (boolean, optional): NOT SUPPORTED in DeepSpeed CPULamb!
+            copy_pipeline_depth: number of pinned tiles staging the updated params on their way to the device
+                        copy in ``fp16_param_groups``. The tiles are shared by all CPU optimizers. (default: 2)
+            copy_tile_numel: elements per staging tile of the device copy. (default: 128M)
+        """
+
+        if amsgrad:
+            raise RuntimeError('DeepSpeedCPULamb does not support the AMSGrad variant.')
+        default_args = dict(lr=lr,
+                            bias_correction=bias_correction,
+                            betas=betas,
+                            eps=eps,
+                            weight_decay=weight_decay,
+                            max_grad_norm=max_grad_norm,
+                            max_coeff=max_coeff,
+                            min_coeff=min_coeff)
+        super(DeepSpeedCPULamb, self).__init__(model_params, default_args)
+
+        self.opt_id = DeepSpeedCPULamb.optimizer_id
+        DeepSpeedCPULamb.optimizer_id = DeepSpeedCPULamb.optimizer_id + 1
+        self.ds_opt_lamb = CPULambBuilder().load()
+
+        self.ds_opt_lamb.create_lamb(self.opt_id, lr, betas[0], betas[1], eps, weight_decay, max_coeff, min_coeff,
+                                     eps_inside_sqrt, should_log_le("info"), copy_pipeline_depth, copy_tile_numel)
+        self.lamb_coeffs = []
+
+    def __del__(self):
+        # need to destroy the C++ object explicitly to avoid a memory leak when deepspeed.initialize
+        # is used multiple times in the same process (notebook or pytest worker)
+        self.ds_opt_lamb.destroy_lamb(self.opt_id)
+
+    @torch.no_grad()
+    def step(self, closure=None, fp16_param_groups=None, scale=1., grad_norms=None):
+        """Update the model parameters.
+
+        Args:
+            closure (callable, optional): closure to compute the loss.
+                Defaults to ``None``.
+            fp16_param_groups: FP16 or BF16 GPU parameters to update. Performing the
+                copy here reduces communication time. Defaults to ``None``.
+            scale (float, optional): factor to divide gradient tensor values
+                by before applying to weights. (default: 1)
+            grad_norms (list, optional): gradient norms, times ``scale``, of each param group,
+                used for ``max_grad_norm`` clipping. Defaults to ``None``.
+
+        Returns:
+            loss: if ``closure`` is provided. Otherwise ``None``.
+        """
+
+        loss = None
+        if closure is not None:
+            with torch.enable_grad():
+                loss = closure()
+
+        # intended device for step
+        device = torch.device('cpu')
+
+        # converting the fp16 params to a group of parameter
+        if type(fp16_param_groups) is list:
+            if type(fp16_param_groups[0]) is not list:
+                fp16_param_groups = [fp16_param_groups]
+        elif fp16_param_groups is not None:
+            fp16_param_groups = [[fp16_param_groups]]
+
+        if grad_norms is None:
+            grad_norms = [None] * len(self.param_groups)
+
+        #remove the previous coeffs
+        del self.lamb_coeffs[:]
+
+        for group_id, (group, grad_norm) in enumerate(zip(self.param_groups, grad_norms)):
+            # compute combined scale factor for this group
+            combined_scale = scale
+            if group['max_grad_norm'] > 0 and grad_norm is not None:
+                # norm is in fact norm*scale
+                clip = ((grad_norm / scale) + 1e-6) / group['max_grad_norm']
+                if clip > 1:
+                    combined_scale = clip * scale
+
+            for param_id, p in enumerate(group['params']):
+
+                if p.grad is None:
+                    continue
+
+                assert p.device == device, f"CPULamb param is on {p.device} and must be 'cpu', make " \
+                        "sure you enabled 'offload_optimizer': 'cpu' in your ZeRO config."
+
+                state = self.state[p]
+                # State initialization
+                if len(state) == 0:
+                    state['step'] = 0
+                    # gradient momentums
+                    state['exp_avg'] = torch.zeros_like(p.data, dtype=torch.float, device=device)
+                    # gradient variances
+                    state['exp_avg_sq'] = torch.zeros_like(p.data, dtype=torch.float, device=device)
+
+                state['step'] += 1
+                beta1, beta2 = group['betas']
+
+                if fp16_param_groups is not None:
+                    lamb_coeff = self.ds_opt_lamb.lamb_update_copy(
+                        self.opt_id, state['step'], group['lr'], beta1, beta2, group['eps'], group['weight_decay'],
+                        group['bias_correction'], group['max_coeff'], group['min_coeff'], combined_scale, p.data,
+                        p.grad.data, state['exp_avg'], state['exp_avg_sq'], fp16_param_groups[group_id][param_id].data)
+                else:
+                    lamb_coeff = self.ds_opt_lamb.lamb_update(self.opt_id, state['step'], group['lr'], beta1, beta2,
+                                                              group['eps'], group['weight_decay'],
+                                                              group['bias_correction'], group['max_coeff'],
+                                                              group['min_coeff'], combined_scale, p.data, p.grad.data,
+                                                              state['exp_avg'], state['exp_avg_sq'])
+                self.lamb_coeffs.append(lamb_coeff)
+        return loss
+
+    def get_lamb_coeffs(self):
+        return list(self.lamb_coeffs)
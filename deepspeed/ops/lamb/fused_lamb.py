@@ -8,8 +8,12 @@ This file is adapted from NVIDIA/apex/optimizer/fused_adam and implements the LA
 """
 import types
 import torch
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.adam.multi_tensor_apply import MultiTensorApply
 from deepspeed.ops.op_builder import FusedLambBuilder
 
+multi_tensor_applier = MultiTensorApply(2048 * 32)
+
 
 class FusedLamb(torch.optim.Optimizer):
     """Implements the LAMB algorithm. Currently GPU-only.
@@ -36,6 +40,9 @@ class FusedLamb(torch.optim.Optimizer):
         max_coeff(float, optional): maximum value of the lamb coefficient (default: 10.0)
         min_coeff(float, optional): minimum value of the lamb coefficient (default: 0.01)
         amsgrad (boolean, optional): NOT SUPPORTED in FusedLamb!
+        multi_tensor (boolean, optional): update all tensors sharing a step count, grad scale and
+            dtypes with two chunked launches instead of three kernels per tensor. fp32 gradients
+            hold the raw update afterwards. (default: False)
     """
 
     def __init__(self,
@@ -49,7 +56,8 @@ class FusedLamb(torch.optim.Optimizer):
                  max_grad_norm=0.,
                  max_coeff=10.0,
                  min_coeff=0.01,
-                 amsgrad=False):
+                 amsgrad=False,
+                 multi_tensor=False):
         self.fused_lamb_cuda = FusedLambBuilder().load()
 
         if amsgrad:
@@ -66,6 +74,10 @@ class FusedLamb(torch.optim.Optimizer):
         self.eps_mode = 0 if eps_inside_sqrt else 1
         self.lamb_coeffs = []
 
+        self.multi_tensor = multi_tensor
+        # Skip buffer
+        self._dummy_overflow_buf = get_accelerator().IntTensor([0])
+
     def step(self, closure=None, grads=None, output_params=None, scale=1., grad_norms=None):
         """Performs a single optimization step.
 
@@ -124,6 +136,8 @@ class FusedLamb(torch.optim.Optimizer):
                 grad_norm_group = [grad_norm_group]
 
             bias_correction = 1 if group['bias_correction'] else 0
+            # Lists for multi tensor apply, keyed by what a launch shares.
+            multi_tensor_buckets = {}
 
             for p, grad, output_param, grad_norm in zip(group['params'], grads_this_group, output_params_this_group,
                                                         grad_norm_group):
@@ -161,12 +175,39 @@ class FusedLamb(torch.optim.Optimizer):
 
                 state['step'] += 1
 
+                if self.multi_tensor:
+                    key = (state['step'], combined_scale, grad.dtype, p.dtype, output_param is not None)
+                    g_list, p_list, m_list, v_list, out_list, positions = multi_tensor_buckets.setdefault(
+                        key, ([], [], [], [], [], []))
+                    g_list.append(grad)
+                    p_list.append(p.data)
+                    m_list.append(exp_avg)
+                    v_list.append(exp_avg_sq)
+                    if output_param is not None:
+                        out_list.append(output_param)
+                    # Filled in once the launch is issued, so the coeffs keep the param order.
+                    positions.append(len(self.lamb_coeffs))
+                    self.lamb_coeffs.append(None)
+                    continue
+
                 out_p = torch.tensor([], dtype=torch.float) if output_param is None else output_param
                 lamb_coeff = self.fused_lamb_cuda.lamb(p.data, out_p, exp_avg, exp_avg_sq, grad, group['lr'], beta1,
                                                        beta2, max_coeff, min_coeff, group['eps'], combined_scale,
                                                        state['step'], self.eps_mode, bias_correction,
                                                        group['weight_decay'])
                 self.lamb_coeffs.append(lamb_coeff)
+
+            for (step, combined_scale, _, _, has_output), tensor_lists in multi_tensor_buckets.items():
+                beta1, beta2 = group['betas']
+                positions = tensor_lists[-1]
+                tensor_lists = list(tensor_lists[:5] if has_output else tensor_lists[:4])
+                lamb_coeffs = torch.empty(len(positions), dtype=torch.float, device=tensor_lists[1][0].device)
+                multi_tensor_applier(self.fused_lamb_cuda.multi_tensor_lamb, self._dummy_overflow_buf, tensor_lists,
+                                     group['lr'], beta1, beta2, group['eps'], step, self.eps_mode, bias_correction,
+                                     group['weight_decay'], group['max_coeff'], group['min_coeff'], combined_scale,
+                                     lamb_coeffs)
+                for i, position in enumerate(positions):
+                    self.lamb_coeffs[position] = lamb_coeffs[i]
         return loss
 
     def get_lamb_coeffs(self):
@@ -45,7 +45,8 @@ def gpt_sample_tokens(reserved_length: int,
 """
 Returns:
     sampled_indices: [layers, batch_size, reserved_length]
-    new_mask: [layers, batch_size, 1, reserved_length, reserved_length]
+    new_mask: [layers, batch_size, 1, reserved_length, reserved_length], a list of the per layer
+        masks for masks the mask_gather_bert kernel does not handle
 """
 
 
@@ -65,8 +66,14 @@ def bert_sample_tokens(reserved_length: int,
         random_ltd_module = RandomLTDBuilder().load()
 
     sampled_indices = random_ltd_module.token_sort_(sampled_indices, seq_length)
-    dtype = sampled_indices.dtype
 
+    # The kernel gathers the rows and columns of every layer's mask in one launch
+    if attn_mask.dtype in (torch.float, torch.half) and attn_mask.dim() == 4 and attn_mask.size(1) == 1 \
+            and attn_mask.size(2) == seq_length and attn_mask.size(3) == seq_length:
+        new_mask = random_ltd_module.mask_gather_bert(attn_mask.contiguous(), sampled_indices)
+        return sampled_indices, new_mask
+
+    dtype = sampled_indices.dtype
     sampled_indices = sampled_indices.to(torch.long)
     new_mask = []
     for l in range(layers):
@@ -0,0 +1,289 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+# Block-sparse matmul and softmax on precompiled CUDA kernels. The classes mirror the Triton
+# backed ones in matmul.py and softmax.py but never import Triton, so there is no JIT compile
+# on new shapes.
+
+import torch
+
+from deepspeed.accelerator import get_accelerator
+from deepspeed.git_version_info import compatible_ops
+from deepspeed.ops.op_builder import BlockSparseAttnBuilder, SparseAttnBuilder
+
+block_sparse_module = None
+sparse_attn_utils = None
+
+supported_blocks = (16, 32, 64, 128)
+
+
+def _module():
+    global block_sparse_module
+    if block_sparse_module is None:
+        block_sparse_module = BlockSparseAttnBuilder().load()
+    return block_sparse_module
+
+
+def make_sdd_lut(layout, block, device):
+    """(head, block row, block column, block index) for every non-zero block, grouped into
+    super-blocks by `sdd_segment` when the sparse_attn utils op is available.
+    """
+    global sparse_attn_utils
+    if sparse_attn_utils is None and compatible_ops[SparseAttnBuilder.NAME]:
+        sparse_attn_utils = SparseAttnBuilder().load()
+    if sparse_attn_utils is not None:
+        # sdd_segment clears the blocks it consumes
+        start_width = (128 if block > 16 else 32) // block
+        segmented = sparse_attn_utils.sdd_segment(layout.type(torch.int32).clone(), start_width)
+        lut = torch.cat([entries for _, entries in segmented]) if segmented else torch.empty((0, 4))
+    else:
+        nnz = layout.nonzero()
+        lut = torch.cat((nnz, torch.arange(nnz.size(0)).unsqueeze(1)), dim=1)
+    return lut.view(-1).type(torch.int32).to(device)
+
+
+def make_csr_lut(layout, transpose, device):
+    """(size, offset) for each (head, row) of `layout`, or of its transpose, followed by the
+    (column, block index) of the non-zero blocks of each row. Block indices always refer to the
+    untransposed layout.
+    """
+    idx = torch.zeros_like(layout)
+    idx[layout != 0] = torch.arange(int(layout.sum()))
+    if transpose:
+        layout, idx = layout.transpose(1, 2), idx.transpose(1, 2)
+    sizes = layout.sum(-1).view(-1)
+    offsets = torch.zeros_like(sizes)
+    offsets[1:] = torch.cumsum(sizes[:-1], dim=0)
+    offsets = offsets * 2 + 2 * sizes.numel()
+    header = torch.stack((sizes, offsets), dim=1).view(-1)
+    nnz = layout.nonzero()
+    core = torch.stack((nnz[:, 2], idx[nnz[:, 0], nnz[:, 1], nnz[:, 2]]), dim=1).view(-1)
+    return torch.cat((header, core)).type(torch.int32).to(device)
+
+
+def make_softmax_lut(layout, device):
+    """Same look-up table as the Triton `Softmax`: a (size, offset) header per (head, block row)
+    and (block index, column, row, head) for every non-zero block.
+    """
+    sizes = layout.sum(-1).view(-1)
+    offsets = torch.zeros_like(sizes)
+    offsets[1:] = torch.cumsum(sizes[:-1], dim=0)
+    offsets = offsets * 4 + 2 * sizes.numel()
+    header = torch.stack((sizes, offsets), dim=1).view(-1)
+    nnz = layout.nonzero()
+    idx = torch.arange(nnz.size(0))
+    core = torch.stack((idx, nnz[:, 2], nnz[:, 1], nnz[:, 0]), dim=1).view(-1)
+    return torch.cat((header, core)).type(torch.int32).to(device)
+
+
+def _sdd(a, b, trans_a, trans_b, luts, spdims, block):
+    return _module().sdd_matmul(a, b, luts['sdd'], trans_a, trans_b, block, luts['nnz'])
+
+
+def _dsd(a, b, trans_a, trans_b, luts, spdims, block):
+    heads, rows, cols = spdims
+    lut, block_rows = (luts['cols'], cols) if trans_a else (luts['rows'], rows)
+    return _module().dsd_matmul(a.contiguous(), b, lut, trans_a, trans_b, block, heads, block_rows)
+
+
+def _dds(a, b, trans_a, trans_b, luts, spdims, block):
+    heads, rows, cols = spdims
+    # Columns of op(b) are the rows of the layout when b is transposed
+    lut, block_cols = (luts['rows'], rows) if trans_b else (luts['cols'], cols)
+    return _module().dds_matmul(a, b.contiguous(), lut, trans_a, trans_b, block, heads, block_cols)
+
+
+class _block_sparse_matmul(torch.autograd.Function):
+
+    fn = {'sdd': _sdd, 'dsd': _dsd, 'dds': _dds}
+
+    @staticmethod
+    def forward(ctx, a, b, mode, trans_a, trans_b, luts, spdims, block):
+        ctx.save_for_backward(a, b)
+        ctx.mode = mode
+        ctx.trans_a = trans_a
+        ctx.trans_b = trans_b
+        ctx.luts = luts
+        ctx.spdims = spdims
+        ctx.block = block
+        return _block_sparse_matmul.fn[mode](a, b, trans_a, trans_b, luts, spdims, block)
+
+    @staticmethod
+    def backward(ctx, dc):
+        a, b = ctx.saved_tensors
+        mode, trans_a, trans_b = ctx.mode, ctx.trans_a, ctx.trans_b
+        args = (ctx.luts, ctx.spdims, ctx.block)
+        if mode == 'sdd':
+            dc = dc.contiguous()
+        da, db = None, None
+        # For c = op(a) @ op(b): d op(a) = dc @ op(b)^T and d op(b) = op(a)^T @ dc, transposed
+        # back for a transposed input. The sparse operand keeps the layout of c.
+        if ctx.needs_input_grad[0]:
+            if mode == 'sdd':
+                da = _dds(b, dc, trans_b, True, *args) if trans_a else _dsd(dc, b, False, not trans_b, *args)
+            elif mode == 'dsd':
+                da = _sdd(b, dc, trans_b, True, *args) if trans_a else _sdd(dc, b, False, not trans_b, *args)
+            else:
+                da = _dsd(b, dc, trans_b, True, *args) if trans_a else _dds(dc, b, False, not trans_b, *args)
+        if ctx.needs_input_grad[1]:
+            if mode == 'sdd':
+                db = _dsd(dc, a, True, trans_a, *args) if trans_b else _dds(a, dc, not trans_a, False, *args)
+            elif mode == 'dsd':
+                db = _dds(dc, a, True, trans_a, *args) if trans_b else _dsd(a, dc, not trans_a, False, *args)
+            else:
+                db = _sdd(dc, a, True, trans_a, *args) if trans_b else _sdd(a, dc, not trans_a, False, *args)
+        return da, db, None, None, None, None, None, None
+
+
+class MatMul:
+    """Block-Sparse MatMul on precompiled CUDA kernels, a drop-in replacement for
+    `deepspeed.ops.sparse_attention.matmul.MatMul` that does not depend on Triton.
+    Supports fp32, fp16 and bf16 inputs and block sizes of 16, 32, 64 and 128.
+    """
+
+    def __init__(self, layout, block, mode, trans_a=False, trans_b=False, bench=False):
+        """Initialize the Block-Sparse MatMul class.
+
+        Arguments:
+             layout: required: sparsity layout tensor
+             block: required: an integer determining the block size.
+             mode: required: a string determining type of matmul; ('sdd') sparse = dense X dense, ('dsd') dense = sparse X dense, ('dds') dense = dense X sparse
+             trans_a: optional: a boolean determining if multiplication needs to be applied on transpose of input a; default is false
+             trans_b: optional: a boolean determining if multiplication needs to be applied on transpose of input b; default is false
+             bench: optional: unused, kept for interface compatibility
+        """
+        if mode not in ['sdd', 'dsd', 'dds']:
+            raise NotImplementedError('Supported modes are: sdd, dsd, dds')
+        if block not in supported_blocks:
+            raise NotImplementedError(f'Supported block sizes are: {supported_blocks}')
+        assert layout.ndim in (2, 3), "Layout should be a 2 or 3 dimensional tensor of 0s and 1s"
+        if layout.ndim == 2:
+            layout = layout.unsqueeze(0)
+        self.layout = layout.long().cpu()
+        self.block = block
+        self.mode = mode
+        self.trans_a = trans_a
+        self.trans_b = trans_b
+        self.spdims = tuple(self.layout.shape)
+        self.lut_cache = dict()
+
+    def make_lut(self, device):
+        """Generates the look-up tables of the forward and backward kernels
+        """
+        key = (device, )
+        if key not in self.lut_cache:
+            self.lut_cache[key] = {
+                'nnz': int(self.layout.sum()),
+                'sdd': make_sdd_lut(self.layout, self.block, device),
+                'rows': make_csr_lut(self.layout, False, device),
+                'cols': make_csr_lut(self.layout, True, device),
+            }
+        return self.lut_cache[key]
+
+    def __call__(self, a, b):
+        """Applies Block-Sparse MatMul.
+
+        Arguments:
+             a: required: a dense/block-sparse tensor; first input of mat-mul
+             b: required: a dense/block-sparse tensor; second input of mat-mul
+
+        Return:
+             c: a dense/block-sparse tensor result of a X b
+        """
+        if a.device != b.device:
+            raise ValueError(f"Inputs must be on the same device; got {a.device} for tensor A "
+                             f"and {b.device} for tensor B")
+        if not get_accelerator().on_accelerator(a):
+            raise ValueError("Only GPU devices are supported for now")
+        if torch.is_autocast_enabled():
+            a, b = a.half(), b.half()
+        elif a.dtype != b.dtype:
+            raise ValueError(f"Inputs must be the same dtype; got {a.dtype} for A and {b.dtype} for B")
+
+        original_dims = max(a.ndim, b.ndim)
+        while a.ndim < 4:
+            a = a.unsqueeze(0)
+        while b.ndim < 4:
+            b = b.unsqueeze(0)
+
+        luts = self.make_lut(a.device)
+        c = _block_sparse_matmul.apply(a, b, self.mode, self.trans_a, self.trans_b, luts, self.spdims, self.block)
+
+        # Remove the leading singleton dimensions added above
+        for _ in range(c.ndim - original_dims):
+            c = c.squeeze(0)
+        return c
+
+
+class _block_sparse_softmax(torch.autograd.Function):
+
+    @staticmethod
+    def forward(ctx, x, scale, rpe, key_padding_mask, attn_mask, kp_mask_mode, attn_mask_mode, spdims, block, lut):
+        empty = torch.empty(0, dtype=x.dtype, device=x.device)
+        rpe = empty if rpe is None else rpe
+        key_padding_mask = empty if key_padding_mask is None else key_padding_mask
+        attn_mask = empty if attn_mask is None else attn_mask
+        _module().softmax_fwd(x, lut, rpe, key_padding_mask, attn_mask, scale, kp_mask_mode == 'mul',
+                              attn_mask_mode == 'mul', block, spdims[0] * spdims[1])
+
+        ctx.mark_dirty(x)
+        ctx.save_for_backward(x, lut)
+        ctx.spdims = spdims
+        ctx.block = block
+        ctx.scale = scale
+        return x
+
+    @staticmethod
+    def backward(ctx, dx):
+        y, lut = ctx.saved_tensors
+        dx = _module().softmax_bwd(dx.contiguous(), y, lut, ctx.scale, ctx.block, ctx.spdims[0] * ctx.spdims[1])
+        return dx, None, None, None, None, None, None, None, None, None
+
+
+class Softmax:
+    """Block-Sparse Softmax on precompiled CUDA kernels, a drop-in replacement for
+    `deepspeed.ops.sparse_attention.softmax.Softmax` that does not depend on Triton.
+    """
+
+    def __init__(self, layout, block, bench=False):
+        """Initialize the Block-Sparse Softmax class.
+
+        Arguments:
+             layout: required: sparsity layout tensor
+             block: required: an integer determining the block size.
+             bench: optional: unused, kept for interface compatibility
+        """
+        if block not in supported_blocks:
+            raise NotImplementedError(f'Supported block sizes are: {supported_blocks}')
+        self.layout = layout.long().cpu()
+        self.spdims = tuple(self.layout.shape)
+        self.block = block
+        self.lut_cache = dict()
+
+    def make_lut(self, device):
+        key = (device, )
+        if key not in self.lut_cache:
+            self.lut_cache[key] = make_softmax_lut(self.layout, device)
+        return self.lut_cache[key]
+
+    def __call__(self,
+                 x,
+                 scale=1.,
+                 rpe=None,
+                 key_padding_mask=None,
+                 attn_mask=None,
+                 key_padding_mask_mode='add',
+                 attn_mask_mode='add'):
+        """Applies softmax on a Block-Sparse input tensor, in place; see `softmax.Softmax`.
+        """
+        if rpe is not None and rpe.dtype != x.dtype:
+            raise ValueError('relative position embedding must be %s' % x.dtype)
+        if attn_mask is not None and attn_mask.dtype != x.dtype:
+            raise ValueError('Attention mask must be %s' % x.dtype)
+        if key_padding_mask is not None and key_padding_mask.dtype != x.dtype:
+            raise ValueError('Key padding mask must be %s' % x.dtype)
+        lut = self.make_lut(x.device)
+        return _block_sparse_softmax.apply(x, scale, rpe, key_padding_mask, attn_mask, key_padding_mask_mode,
+                                           attn_mask_mode, self.spdims, self.block, lut)
@@ -5,7 +5,9 @@
 
 # DeepSpeed note, code taken & adapted from commit 9aa94789f13ada713af36cfd8cca2fc9a7f6b79a
 # https://github.com/ptillet/torch-blocksparse/blob/master/torch_blocksparse/matmul.py
+import hashlib
 import importlib
+from collections import OrderedDict
 import torch
 
 import triton
@@ -200,6 +202,16 @@ class _sparse_matmul(torch.autograd.Function):
     dds_cache = dict()
     locks = dict()
 
+    # Look-up tables shared by all MatMul instances, keyed by the layout contents, so layouts
+    # that recur (rebuilt modules, dynamic or per-batch patterns) skip the segmentation.
+    lut_cache = OrderedDict()
+    lut_cache_size = 64
+
+    @staticmethod
+    def layout_key(layout):
+        layout = layout.to(device='cpu', dtype=torch.int32).contiguous()
+        return tuple(layout.shape), hashlib.sha1(layout.numpy().tobytes()).hexdigest()
+
     # Given an array sizes representing reduction size for each
     # column of a block-mode matrix multiplication,
     # performs load-balancing to achieve more smaller reductions
@@ -640,6 +652,11 @@ class MatMul:
         key = (dtype, device)
         if key in self.lut_cache:
             return self.lut_cache[key]
+        shared_key = (self.layout_key, self.block, self.mode, self.trans_a, self.trans_b, dtype, device)
+        if shared_key in _sparse_matmul.lut_cache:
+            _sparse_matmul.lut_cache.move_to_end(shared_key)
+            self.lut_cache[key] = _sparse_matmul.lut_cache[shared_key]
+            return self.lut_cache[key]
         # C look-up table
         layout, block = self.layout, self.block
         step = 16
@@ -670,6 +687,9 @@ class MatMul:
         self.lut_cache[key] = (c_lut, c_num_locks, c_width, c_packs,\
                                da_lut, da_num_locks, da_width, da_packs,\
                                db_lut, db_num_locks, db_width, db_packs)
+        _sparse_matmul.lut_cache[shared_key] = self.lut_cache[key]
+        if len(_sparse_matmul.lut_cache) > _sparse_matmul.lut_cache_size:
+            _sparse_matmul.lut_cache.popitem(last=False)
         return self.lut_cache[key]
 
     def __init__(self, layout, block, mode, trans_a=False, trans_b=False, bench=False):
@@ -688,6 +708,7 @@ class MatMul:
             raise NotImplementedError('Supported modes are: sdd, dsd, dds')
         # look-up table cache
         self.lut_cache = dict()
+        self.layout_key = _sparse_matmul.layout_key(layout)
         # attributes
         self.trans_a = trans_a
         self.trans_b = trans_b
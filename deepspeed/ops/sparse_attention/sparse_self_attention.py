@@ -23,13 +23,15 @@ class SparseSelfAttention(nn.Module):
             sparsity_config=SparsityConfig(num_heads=4),
             key_padding_mask_mode='add',
             attn_mask_mode='mul',
-            max_seq_length=2048):
+            max_seq_length=2048,
+            use_cuda_kernels=False):
         """Initialize the sparse self attention layer.
         Arguments:
             sparsity_config: optional: this parameter determines sparsity pattern configuration; it is based on SparsityConfig class.
             key_padding_mask_mode: optional: a string determining if key padding mask needs to be added, `add`, or be multiplied, `mul`.
             attn_mask_mode: optional: a string determining if attention mask needs to be added, `add`, or be multiplied, `mul`.
             max_seq_length: optional: the maximum sequence length this sparse attention module will be applied to; it controls the size of the master_layout.
+            use_cuda_kernels: optional: run on the precompiled CUDA block-sparse kernels instead of Triton; these also support bf16.
         """
         super().__init__()
 
@@ -44,6 +46,7 @@ class SparseSelfAttention(nn.Module):
         # mask modes
         self.key_padding_mask_mode = key_padding_mask_mode
         self.attn_mask_mode = attn_mask_mode
+        self.use_cuda_kernels = use_cuda_kernels
 
     ops = dict()
 
@@ -62,9 +65,13 @@ class SparseSelfAttention(nn.Module):
 
     # add to cache
     def get_ops(self, H, L):
-        from deepspeed.ops.sparse_attention.matmul import MatMul
-        from deepspeed.ops.sparse_attention.softmax import Softmax
-        if L not in SparseSelfAttention.ops:
+        if self.use_cuda_kernels:
+            from deepspeed.ops.sparse_attention.block_sparse_cuda import MatMul, Softmax
+        else:
+            from deepspeed.ops.sparse_attention.matmul import MatMul
+            from deepspeed.ops.sparse_attention.softmax import Softmax
+        key = (L, self.use_cuda_kernels)
+        if key not in SparseSelfAttention.ops:
             sparsity_layout = self.get_layout(L)
             sparse_dot_sdd_nt = MatMul(sparsity_layout, self.sparsity_config.block, 'sdd', trans_a=False, trans_b=True)
 
@@ -76,8 +83,8 @@ class SparseSelfAttention(nn.Module):
 
             sparse_softmax = Softmax(sparsity_layout, self.sparsity_config.block)
 
-            SparseSelfAttention.ops[L] = (sparse_dot_sdd_nt, sparse_dot_dsd_nn, sparse_softmax)
-        return SparseSelfAttention.ops[L]
+            SparseSelfAttention.ops[key] = (sparse_dot_sdd_nt, sparse_dot_dsd_nn, sparse_softmax)
+        return SparseSelfAttention.ops[key]
 
     def transpose_key_for_scores(self, x, L):
         bsz, num_heads, seq_len, head_dim = x.size()
@@ -111,7 +118,10 @@ class SparseSelfAttention(nn.Module):
         Return:
              attn_output: a dense tensor containing attention context
         """
-        assert query.dtype == torch.half, "sparse attention only supports training in fp16 currently, please file a github issue if you need fp32 support"
+        if self.use_cuda_kernels:
+            assert query.dtype in (torch.half, torch.bfloat16), "CUDA sparse attention supports fp16 and bf16"
+        else:
+            assert query.dtype == torch.half, "sparse attention only supports training in fp16 currently, please file a github issue if you need fp32 support"
         bsz, num_heads, tgt_len, head_dim = query.size()
 
         # transpose back key if it is already transposed
@@ -4,6 +4,7 @@
 # DeepSpeed Team
 
 from .transformer import DeepSpeedTransformerLayer, DeepSpeedTransformerConfig
+from .transformer import TransformerRecomputePolicy, transformer_activation_bytes, select_recompute_policy
 from .inference.config import DeepSpeedInferenceConfig
 from ...model_implementations.transformers.ds_transformer import DeepSpeedTransformerInference
 from .inference.moe_inference import DeepSpeedMoEInferenceConfig, DeepSpeedMoEInference
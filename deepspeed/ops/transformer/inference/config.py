@@ -42,6 +42,17 @@ class DeepSpeedInferenceConfig(TransformerConfig):
             scale_attention: If true, both q and k are scaled by 1/sqrt(attention_heads) before attention computation.
             return_tuple: if True, returns the transformer output as a tuple, otherwise returns as a tensor
             bigscience_bloom: This flag is added temporarily for supporting the BLOOM-176B model architecture.
+            kv_cache_block_size: tokens per block of the paged KV cache, 0 keeps the contiguous cache.
+            kv_cache_blocks: number of blocks of the paged KV cache, 0 sizes it from the free memory.
+            kv_cache_int8: store the paged KV cache as int8 with a scale per token and head.
+            num_kv_heads: number of key/value heads for grouped-query attention, -1 means one per
+                attention head.
+            mp_overlap_chunks: number of row chunks the attention output GEMM is split in for mp_size > 1,
+                the all-reduce of a chunk overlaps the GEMM of the next one. 1 reduces the whole output.
+            gemm_autotune: time the cuBLAS algorithms of each GEMM shape on first use and keep the fastest
+                in an on-disk cache shared by later runs on the same GPU model.
+            rope_theta: base of the rotary embedding frequencies.
+            rope_scaling: linear scaling of the rotary positions, they are divided by this factor.
     """
 
     def __init__(self,
@@ -75,7 +86,15 @@ class DeepSpeedInferenceConfig(TransformerConfig):
                  scale_attn_by_inverse_layer_idx=False,
                  return_single_tuple=False,
                  set_empty_params=False,
-                 transposed_mode=False):
+                 transposed_mode=False,
+                 kv_cache_block_size=0,
+                 kv_cache_blocks=0,
+                 kv_cache_int8=False,
+                 num_kv_heads=-1,
+                 mp_overlap_chunks=1,
+                 gemm_autotune=False,
+                 rope_theta=10000.0,
+                 rope_scaling=1.0):
         super(DeepSpeedInferenceConfig,
               self).__init__(hidden_size, (intermediate_size if intermediate_size > 0 else 4 * hidden_size), heads,
                              num_hidden_layers)
@@ -107,6 +126,14 @@ class DeepSpeedInferenceConfig(TransformerConfig):
         self.return_single_tuple = return_single_tuple
         self.set_empty_params = set_empty_params
         self.transposed_mode = transposed_mode
+        self.kv_cache_block_size = kv_cache_block_size
+        self.kv_cache_blocks = kv_cache_blocks
+        self.kv_cache_int8 = kv_cache_int8
+        self.num_kv_heads = num_kv_heads if num_kv_heads > 0 else heads
+        self.mp_overlap_chunks = mp_overlap_chunks
+        self.gemm_autotune = gemm_autotune
+        self.rope_theta = rope_theta
+        self.rope_scaling = rope_scaling
 
     @classmethod
     def from_dict(cls, json_object):
@@ -10,10 +10,11 @@ import torch.nn as nn
 from packaging import version as pkg_version
 from deepspeed.utils.logging import log_dist
 from deepspeed.accelerator import get_accelerator
-from deepspeed.ops.op_builder import InferenceBuilder
+from deepspeed.ops.op_builder import InferenceBuilder, SpatialInferenceBuilder
 
 # Cuda modules will be imported if needed
 inference_cuda_module = None
+spatial_cuda_module = None
 minus_inf = -10000.0
 triton_flash_attn = None
 
@@ -65,6 +66,14 @@ class DeepSpeedDiffusersAttentionFunction(Function):
                                                          input.shape[-2] % 128 == 0)
                 context_layer = _transpose_for_context(context_layer[:, :, :, :head_size])
 
+            elif context is not None and input.dtype == torch.half and head_size <= 256:
+                # Cross-attention with a short text context: the fused spatial kernel consumes
+                # the token-major projections directly and skips the score buffer and transposes.
+                query = torch.matmul(input, attn_qw)
+                key = torch.matmul(context, attn_kw)
+                value = torch.matmul(context, attn_vw)
+                context_layer = spatial_cuda_module.cross_attention(query, key, value, config.heads, scale)
+
             else:
                 do_flash_attn = False
                 if context is not None:
@@ -122,6 +131,9 @@ class DeepSpeedDiffusersAttention(nn.Module):
         if inference_cuda_module is None:
             builder = InferenceBuilder()
             inference_cuda_module = builder.load()
+        global spatial_cuda_module
+        if spatial_cuda_module is None:
+            spatial_cuda_module = SpatialInferenceBuilder().load()
 
         if DeepSpeedDiffusersAttention.layer_id == 1:
             log_dist(f"DeepSpeed-Attention config: {self.config.__dict__}", [0])
@@ -184,7 +196,8 @@ class DeepSpeedDiffusersAttention(nn.Module):
             self.allocate_workspace(self.config.hidden_size, self.config.heads,
                                     input.size()[1],
                                     input.size()[0], DeepSpeedDiffusersAttention.layer_id, self.config.mp_size, False,
-                                    0, self.config.max_out_tokens, self.config.min_out_tokens)
+                                    0, self.config.max_out_tokens, self.config.min_out_tokens, 0, 0,
+                                    False, 0)
         output = DeepSpeedDiffusersAttentionFunction.apply(input, context, input_mask, self.config, self.attn_qkvw,
                                                            self.attn_qw, self.attn_kw, self.attn_vw, self.attn_qkvb,
                                                            self.num_attention_heads_per_partition, self.norm_factor,
@@ -0,0 +1,74 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import torch
+import torch.nn as nn
+
+from .group_norm import nhwc_group_norm
+
+
+class DeepSpeedDiffusersResnetBlock(nn.Module):
+    """Runs a diffusers ``ResnetBlock2D`` with the fused channels-last GroupNorm kernels.
+
+    ``norm1 + SiLU`` and ``time embedding add + norm2 + SiLU`` each become a single kernel; the
+    convolutions are reused from the original module. Configurations the kernels do not cover
+    (up/down sampling, scale-shift time embeddings, non-SiLU activations, or inputs that are not
+    fp16 channels-last) fall back to the original module.
+    """
+
+    def __init__(self, equivalent_module: nn.Module):
+        super(DeepSpeedDiffusersResnetBlock, self).__init__()
+        self.module = equivalent_module
+
+        self.norm1_groups = equivalent_module.norm1.num_groups
+        self.norm1_eps = equivalent_module.norm1.eps
+        self.norm2_groups = equivalent_module.norm2.num_groups
+        self.norm2_eps = equivalent_module.norm2.eps
+
+        self.fused = (isinstance(equivalent_module.nonlinearity, nn.SiLU)
+                      and getattr(equivalent_module, "time_embedding_norm", "default") == "default"
+                      and getattr(equivalent_module, "upsample", None) is None
+                      and getattr(equivalent_module, "downsample", None) is None
+                      and equivalent_module.norm1.affine and equivalent_module.norm2.affine)
+
+    def forward(self, input_tensor, temb, **kwargs):
+        if not self.fused or input_tensor.dtype != torch.half or \
+                not input_tensor.is_contiguous(memory_format=torch.channels_last):
+            return self.module(input_tensor, temb, **kwargs)
+
+        module = self.module
+        hidden_states = nhwc_group_norm(input_tensor,
+                                        module.norm1.weight,
+                                        module.norm1.bias,
+                                        self.norm1_groups,
+                                        eps=self.norm1_eps,
+                                        silu=True)
+        hidden_states = module.conv1(hidden_states)
+
+        # The projected time embedding is a per-image channel bias, folded into norm2
+        if temb is not None and module.time_emb_proj is not None:
+            if not getattr(module, "skip_time_act", False):
+                temb = module.nonlinearity(temb)
+            temb = module.time_emb_proj(temb).contiguous()
+        else:
+            temb = None
+
+        hidden_states = nhwc_group_norm(hidden_states,
+                                        module.norm2.weight,
+                                        module.norm2.bias,
+                                        self.norm2_groups,
+                                        eps=self.norm2_eps,
+                                        silu=True,
+                                        bias=temb)
+        hidden_states = module.dropout(hidden_states)
+        hidden_states = module.conv2(hidden_states)
+
+        if module.conv_shortcut is not None:
+            input_tensor = module.conv_shortcut(input_tensor)
+
+        output_tensor = input_tensor + hidden_states
+        if module.output_scale_factor != 1.0:
+            output_tensor = output_tensor / module.output_scale_factor
+        return output_tensor
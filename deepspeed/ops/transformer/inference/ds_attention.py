@@ -8,7 +8,7 @@ import torch
 import torch.nn as nn
 from deepspeed import comm as dist
 from deepspeed.accelerator import get_accelerator
-from .op_binding import LinearOp, VectorMatMulOp, SoftmaxContextOp, QKVGemmOp, SoftmaxOp
+from .op_binding import LinearOp, VectorMatMulOp, SoftmaxContextOp, QKVGemmOp, SoftmaxOp, LoRAOp
 
 minus_inf = -10000.0
 
@@ -25,6 +25,9 @@ class DeepSpeedSelfAttention(nn.Module):
         self.config.layer_id = DeepSpeedSelfAttention.num_layers
         DeepSpeedSelfAttention.num_layers = DeepSpeedSelfAttention.num_layers + 1
         device = get_accelerator().current_device_name()  #if config.bigscience_bloom else 'cpu'
+        # Grouped-query attention: K and V only have num_kv_heads heads, shared by groups of query heads.
+        self.num_kv_heads_per_partition = self.config.num_kv_heads // self.config.mp_size
+        self.kv_size_per_partition = (self.config.hidden_size // self.config.heads) * self.num_kv_heads_per_partition
         if self.config.set_empty_params:
             self.attn_qw = None
             self.attn_qb = None
@@ -37,7 +40,7 @@ class DeepSpeedSelfAttention(nn.Module):
             self.attn_ow = None
             self.attn_ob = None
         else:
-            qkv_size_per_partition = (self.config.hidden_size // self.config.mp_size) * 3
+            qkv_size_per_partition = (self.config.hidden_size // self.config.mp_size) + 2 * self.kv_size_per_partition
             self.attn_qkvw = nn.Parameter(torch.empty(self.config.hidden_size,
                                                       qkv_size_per_partition,
                                                       dtype=data_type,
@@ -78,15 +81,32 @@ class DeepSpeedSelfAttention(nn.Module):
         self.score_context_func = SoftmaxContextOp(config)
         self.linear_func = LinearOp(config)
         self.vector_matmul_func = VectorMatMulOp(config)
+        self.lora_func = LoRAOp(config)
+        self.lora_qkv = None
+        self.lora_out = None
+        self.lora_scale = 1.0
         if len(DeepSpeedSelfAttention._qkv_buffers) == 0:
             DeepSpeedSelfAttention._qkv_buffers = [
-                torch.empty(self.hidden_size_per_partition * 3,
+                torch.empty(self.hidden_size_per_partition + 2 * self.kv_size_per_partition,
                             self.config.hidden_size,
                             dtype=data_type_fp,
                             device=device),
-                torch.empty(self.hidden_size_per_partition * 3, dtype=data_type_fp, device=device)
+                torch.empty(self.hidden_size_per_partition + 2 * self.kv_size_per_partition,
+                            dtype=data_type_fp,
+                            device=device)
             ]
 
+    def set_lora(self, qkv=None, out=None, scale=1.0):
+        """Low-rank adapters of the QKV and output projections, each a ``(lora_a, lora_b)`` pair of the adapters
+        stacked: ``[adapters, rank, in_features]`` and ``[adapters, rank, out_features]``, sharded like the
+        projections (columns of the QKV output, rows of the output projection input). Per adapter ``alpha / rank``
+        factors are folded into ``lora_b``, ``scale`` applies to all. The adapter of each sequence is selected
+        with ``set_lora_adapters`` of the inference module, ``None`` removes the adapters of a projection.
+        """
+        self.lora_qkv = qkv
+        self.lora_out = out
+        self.lora_scale = scale
+
     def compute_attention(self, qkv_out, input_mask, layer_past, alibi):
         if isinstance(qkv_out, list):
             qkv_out = qkv_out[0]
@@ -105,21 +125,24 @@ class DeepSpeedSelfAttention(nn.Module):
             no_masking=no_masking,
             layer_id=self.config.layer_id,
             num_layers=DeepSpeedSelfAttention.num_layers,
-            alibi=alibi)
+            alibi=alibi,
+            num_kv_heads=self.num_kv_heads_per_partition)
 
         context_layer, key_layer, value_layer = attn_key_value
         return context_layer, key_layer, value_layer
 
     def _merge_qkv(self):
+        q_size = self.hidden_size_per_partition
+        kv_end = q_size + self.kv_size_per_partition
         qvkw = DeepSpeedSelfAttention._qkv_buffers[0]
-        qvkw[:self.hidden_size_per_partition, :] = self.attn_qw
-        qvkw[self.hidden_size_per_partition:2 * self.hidden_size_per_partition, :] = self.attn_kw
-        qvkw[2 * self.hidden_size_per_partition:, :] = self.attn_vw
+        qvkw[:q_size, :] = self.attn_qw
+        qvkw[q_size:kv_end, :] = self.attn_kw
+        qvkw[kv_end:, :] = self.attn_vw
         if self.attn_qb is not None:
             qvkb = DeepSpeedSelfAttention._qkv_buffers[1]
-            qvkb[:self.hidden_size_per_partition] = self.attn_qb
-            qvkb[self.hidden_size_per_partition:2 * self.hidden_size_per_partition] = self.attn_kb
-            qvkb[2 * self.hidden_size_per_partition:] = self.attn_vb
+            qvkb[:q_size] = self.attn_qb
+            qvkb[q_size:kv_end] = self.attn_kb
+            qvkb[kv_end:] = self.attn_vb
         return DeepSpeedSelfAttention._qkv_buffers
 
     def forward(self,
@@ -157,17 +180,31 @@ class DeepSpeedSelfAttention(nn.Module):
                                     add_bias=(self.attn_qkvb is not None),
                                     num_layers=DeepSpeedSelfAttention.num_layers,
                                     num_heads=self.num_attention_heads_per_partition)
+        if self.lora_qkv is not None:
+            # The fused QKV GEMM returns the normalized input it multiplied next to its output.
+            lora_input = qkv_out[-1] if self.config.pre_layer_norm else input
+            self.lora_func(qkv_out[0] if isinstance(qkv_out, list) else qkv_out, lora_input, *self.lora_qkv,
+                           self.lora_scale)
         context_layer, key_layer, value_layer = self.compute_attention(qkv_out=qkv_out,
                                                                        input_mask=input_mask,
                                                                        layer_past=layer_past,
                                                                        alibi=alibi)
-        output = self.vector_matmul_func(input=context_layer, weight=self.attn_ow)
+        # With a parallel MLP (not mlp_after_attn) the MLP reduces the sum of both branches instead.
+        reduce_output = (self.config.mlp_after_attn and self.mp_group is not None
+                         and dist.get_world_size(group=self.mp_group) > 1)
+        if self.lora_out is None:
+            output = self.vector_matmul_func(input=context_layer,
+                                             weight=self.attn_ow,
+                                             mp_group=self.mp_group if reduce_output else None)
+        else:
+            # Each rank adds the adapter of its input rows, the all-reduce sums them like the base GEMM.
+            output = self.vector_matmul_func(input=context_layer, weight=self.attn_ow)
+            self.lora_func(output, context_layer, *self.lora_out, self.lora_scale)
+            if reduce_output:
+                dist.all_reduce(output, group=self.mp_group)
 
         inp_norm = qkv_out[-1]
 
-        if self.config.mlp_after_attn and self.mp_group is not None and dist.get_world_size(group=self.mp_group) > 1:
-            dist.all_reduce(output, group=self.mp_group)
-
         return (output, key_layer, value_layer, context_layer, inp_norm)
 
 
@@ -0,0 +1,40 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+from typing import Optional
+import torch
+from deepspeed.ops.op_builder import SpatialInferenceBuilder
+
+spatial_cuda_module = None
+
+
+def nhwc_group_norm(activation: torch.Tensor,
+                    gamma: torch.Tensor,
+                    beta: torch.Tensor,
+                    num_groups: int,
+                    eps: float = 1e-5,
+                    silu: bool = False,
+                    bias: Optional[torch.Tensor] = None,
+                    residual: Optional[torch.Tensor] = None) -> torch.Tensor:
+    """GroupNorm over a channels-last activation, optionally followed by SiLU.
+
+    The normalized input is ``activation + bias + residual``, where ``bias`` is broadcast over
+    the spatial dimensions and may be ``[C]`` or ``[B, C]`` (e.g. a projected time embedding),
+    and ``residual`` has the same shape and memory format as ``activation``.
+    """
+    global spatial_cuda_module
+    if spatial_cuda_module is None:
+        spatial_cuda_module = SpatialInferenceBuilder().load()
+
+    if bias is None and residual is None:
+        return spatial_cuda_module.nhwc_group_norm(activation, gamma, beta, num_groups, eps, silu)
+    elif residual is None:
+        return spatial_cuda_module.nhwc_bias_group_norm(activation, bias, gamma, beta, num_groups, eps, silu)
+    elif bias is None:
+        return spatial_cuda_module.nhwc_add_group_norm(activation, residual, gamma, beta, num_groups, eps, silu)
+    else:
+        return spatial_cuda_module.nhwc_bias_add_group_norm(activation, bias, residual, gamma, beta, num_groups, eps,
+                                                            silu)
+
@@ -240,6 +240,9 @@ class DeepSpeedMoEInference(nn.Module):
                                         inference_cuda_module.layer_norm_fp32
         self.einsum_sec_sm_ecm = inference_cuda_module.einsum_sec_sm_ecm_fp16 if self.config.fp16 or self.config.q_int8 else \
                                         inference_cuda_module.einsum_sec_sm_ecm_fp32
+        self.moe_ffn_func = inference_cuda_module.moe_ffn_fp16 if self.config.fp16 else \
+                                        inference_cuda_module.moe_ffn_fp32
+        self.expert_params = None
 
     def res_coef_func(self, inp, async_op):
         inp = self.vector_matmul_func(inp, self.res_coef, async_op)
@@ -270,6 +273,31 @@ class DeepSpeedMoEInference(nn.Module):
                                                                  dispatched_input.shape[-1]))
         return expert_outputs
 
+    def use_fused_experts(self):
+        """Whether the experts run as one fused gating + grouped GEMM pass (see ``moe_ffn``).
+
+        The fused pass never drops tokens and picks each token's top-k experts without noise, so it
+        is only used with ``drop_tokens=False``, no noisy gate policy and all experts on this rank.
+        For k > 1 this is deterministic top-k routing, unlike the Gumbel sampled second expert and
+        the capacity limit of the top-2 gate.
+        """
+        return (not self.config.drop_tokens and self.config.noisy_gate_policy is None and not self.config.q_int8
+                and self.expert_mp_group is None and dist.get_world_size(group=self.ep_group) == 1)
+
+    def fused_expert_exec(self, attention_output):
+        # The kernels read the parameters of every expert through their addresses, taken on the first
+        # call once the weights are in place.
+        if self.expert_params is None:
+            self.expert_params = [
+                torch.tensor([getattr(mlp, name).data_ptr() for mlp in self.mlp],
+                             dtype=torch.int64,
+                             device=attention_output.device) for name in ('inter_w', 'inter_b', 'output_w', 'output_b')
+            ]
+        wg = self.moe_gate.wg.float()
+        logits = wg(attention_output.view(-1, self.config.hidden_size).float())
+        return self.moe_ffn_func(attention_output, logits, *self.expert_params, self.mlp[0].inter_w.shape[1],
+                                 self.config.k)
+
     def _alltoall(self, dispatched_attention):
         if dist.get_world_size(group=self.ep_group) > 1:
             dispatched_input = torch.empty_like(dispatched_attention)
@@ -335,11 +363,14 @@ class DeepSpeedMoEInference(nn.Module):
                 attention_output = torch.cat(tensor_list).contiguous()
 
             ############## MoE Gating + Experts ###############
-            dispatched_attention, combined_weights = self.moe_gate_einsum(attention_output)
-            dispatched_input = self._alltoall(dispatched_attention)
-            expert_outputs = self.expert_exec(dispatched_input)
-            expert_output = self._alltoall(expert_outputs)
-            output = self.scale_expert_output(attention_output, expert_output, combined_weights)
+            if self.use_fused_experts():
+                output = self.fused_expert_exec(attention_output)
+            else:
+                dispatched_attention, combined_weights = self.moe_gate_einsum(attention_output)
+                dispatched_input = self._alltoall(dispatched_attention)
+                expert_outputs = self.expert_exec(dispatched_input)
+                expert_output = self._alltoall(expert_outputs)
+                output = self.scale_expert_output(attention_output, expert_output, combined_weights)
             ################################################
 
             if self.expert_mp_group is not None:
@@ -4,6 +4,8 @@
 # DeepSpeed Team
 
 from .linear import LinearOp
+from .weight_only_linear import WeightOnlyLinearOp
+from .fp8_linear import Fp8LinearOp
 from .vector_matmul import VectorMatMulOp
 from .softmax_context import SoftmaxContextOp
 from .qkv_gemm import QKVGemmOp
@@ -11,3 +13,5 @@ from .softmax import SoftmaxOp
 from .mlp_gemm import MLPGemmOp
 from .gelu_gemm import GELUGemmOp
 from .residual_add import ResidualAddOp
+from .sampling import SamplingOp
+from .lora import LoRAOp
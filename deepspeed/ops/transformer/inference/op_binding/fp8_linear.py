@@ -0,0 +1,44 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import torch
+from ..config import DeepSpeedInferenceConfig
+from .base import BaseOp
+
+FP8_E4M3_MAX = 448.0
+
+
+class Fp8LinearOp(BaseOp):
+    """fp16 linear layer that runs its GEMM in fp8 (sm_89 and newer).
+
+    The weight is a uint8 ``[out_features, in_features]`` tensor of e4m3 values made by
+    ``quantize_weight``, which also attaches its fp32 per tensor ``scale``. The input is cast to
+    fp8 with delayed scaling: the op keeps a device side scale and amax, the amax of one call sets
+    the scale of the next, so the first call runs with a scale of one.
+    """
+
+    def __init__(self, config: DeepSpeedInferenceConfig, e5m2: bool = False):
+        super(Fp8LinearOp, self).__init__(config)
+        assert self.config.fp16, "fp8 GEMMs produce fp16 outputs"
+        self.linear_func = self.inference_cuda_module.linear_layer_fp8
+        self.e5m2 = e5m2
+        self.act_scale = None
+        self.act_amax = None
+
+    def quantize_weight(self, weight: torch.Tensor):
+        scale = (weight.abs().max().float() / FP8_E4M3_MAX).clamp(min=1e-12).reshape(1)
+        amax = torch.zeros(1, dtype=torch.float32, device=weight.device)
+        weight_fp8 = self.inference_cuda_module.fp8_quantize(weight.contiguous(), scale, amax, False)
+        weight_fp8.scale = scale
+        return weight_fp8
+
+    def forward(self, input: torch.Tensor, weight: torch.Tensor, bias: torch.Tensor = None):
+        if self.act_scale is None:
+            self.act_scale = torch.ones(1, dtype=torch.float32, device=input.device)
+            self.act_amax = torch.zeros(1, dtype=torch.float32, device=input.device)
+        add_bias = bias is not None
+        return self.linear_func(input, weight, weight.scale,
+                                bias if add_bias else torch.empty(1), add_bias, self.act_scale, self.act_amax,
+                                self.e5m2)
@@ -0,0 +1,29 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import torch
+from ..config import DeepSpeedInferenceConfig
+from .base import BaseOp
+
+
+class LoRAOp(BaseOp):
+    """Batched low-rank adapters added in place to the output of a base GEMM:
+    ``output += scale * input @ lora_a[id].T @ lora_b[id]`` with the adapter ``id`` of each token.
+
+    ``lora_a`` is ``[adapters, rank, in_features]`` and ``lora_b`` ``[adapters, rank, out_features]``, the
+    adapters of all the fine-tunes stacked. The ids come from ``set_lora_adapters`` of the inference module,
+    one per sequence or per token, negative for the base model. Without ids the output is left as it is.
+    """
+
+    def __init__(self, config: DeepSpeedInferenceConfig):
+        super(LoRAOp, self).__init__(config)
+        if self.config.fp16:
+            self.lora_func = self.inference_cuda_module.lora_bgmv_fp16
+        else:
+            self.lora_func = self.inference_cuda_module.lora_bgmv_fp32
+
+    def forward(self, output: torch.Tensor, input: torch.Tensor, lora_a: torch.Tensor, lora_b: torch.Tensor,
+                scale: float):
+        return self.lora_func(output, input, lora_a, lora_b, scale)
@@ -0,0 +1,38 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import torch
+from ..config import DeepSpeedInferenceConfig
+from .base import BaseOp
+
+
+class SamplingOp(BaseOp):
+    """Next token sampling in one kernel per row: repetition penalty, temperature, top-k, top-p and the
+    multinomial draw, for logits of ``[batch, vocab]`` or ``[batch, seq, vocab]`` (last position).
+
+    ``history`` is a ``[batch, n]`` tensor of the tokens the repetition penalty applies to, negative entries
+    are ignored. ``top_k <= 0`` and ``top_p >= 1`` disable the cuts, ``temperature <= 0`` is greedy. The draws
+    follow the torch default generator, so ``torch.manual_seed`` makes them reproducible.
+    """
+
+    def __init__(self, config: DeepSpeedInferenceConfig = None):
+        super(SamplingOp, self).__init__(config)
+        self.sample_fp16 = self.inference_cuda_module.sample_tokens_fp16
+        self.sample_fp32 = self.inference_cuda_module.sample_tokens_fp32
+
+    def forward(self,
+                logits: torch.Tensor,
+                history: torch.Tensor = None,
+                temperature: float = 1.0,
+                top_k: int = 0,
+                top_p: float = 1.0,
+                repetition_penalty: float = 1.0):
+        if history is None:
+            history = torch.empty(0, dtype=torch.long, device=logits.device)
+        seed = int(torch.randint(0, 2**62, (1, )).item())
+        if logits.dtype not in (torch.half, torch.float):
+            logits = logits.float()
+        sample_func = self.sample_fp16 if logits.dtype == torch.half else self.sample_fp32
+        return sample_func(logits, history, temperature, repetition_penalty, top_k, top_p, seed, 0)
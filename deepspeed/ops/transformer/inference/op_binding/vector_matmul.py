@@ -4,6 +4,7 @@
 # DeepSpeed Team
 
 import torch
+from deepspeed import comm as dist
 from ..config import DeepSpeedInferenceConfig
 from .base import BaseOp
 
@@ -14,11 +15,34 @@ class VectorMatMulOp(BaseOp):
         super(VectorMatMulOp, self).__init__(config)
         if self.config.fp16:
             self.vector_matmul_func = self.inference_cuda_module.vector_matmul_fp16
+            self.vector_matmul_rows_func = self.inference_cuda_module.vector_matmul_rows_fp16
         else:
             self.vector_matmul_func = self.inference_cuda_module.vector_matmul_fp32
+            self.vector_matmul_rows_func = self.inference_cuda_module.vector_matmul_rows_fp32
 
-    def forward(self, input: torch.Tensor, weight: torch.Tensor, async_op: bool = False):
+    def forward(self, input: torch.Tensor, weight: torch.Tensor, async_op: bool = False, mp_group=None):
+        """
+        With mp_group set, the output is also all-reduced over it: in mp_overlap_chunks row chunks
+        when there are enough rows, each reduced while the GEMM of the next one runs.
+        """
         q_scale = weight.scale if hasattr(weight, 'scale') else torch.empty(1)
         q_int8 = self.config.q_int8
-        output = self.vector_matmul_func(input, weight, async_op, q_scale, q_int8, self.config.transposed_mode)
+        rows = input.size(0) * input.size(1)
+        chunks = min(self.config.mp_overlap_chunks, rows)
+        if mp_group is None or chunks <= 1:
+            output = self.vector_matmul_func(input, weight, async_op, q_scale, q_int8, self.config.transposed_mode)
+            if mp_group is not None:
+                dist.all_reduce(output, group=mp_group)
+            return output
+
+        chunk_rows = (rows + chunks - 1) // chunks
+        works = []
+        for row_begin in range(0, rows, chunk_rows):
+            row_end = min(row_begin + chunk_rows, rows)
+            output = self.vector_matmul_rows_func(input, weight, row_begin, row_end, q_scale, q_int8,
+                                                  self.config.transposed_mode)
+            chunk = output.view(rows, -1)[row_begin:row_end]
+            works.append(dist.all_reduce(chunk, group=mp_group, async_op=True))
+        for work in works:
+            work.wait()
         return output
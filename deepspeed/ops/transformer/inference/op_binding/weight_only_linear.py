@@ -0,0 +1,32 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import torch
+from ..config import DeepSpeedInferenceConfig
+from .base import BaseOp
+
+
+class WeightOnlyLinearOp(BaseOp):
+    """Linear layer over a weight only quantized weight, dequantized inside the GEMM.
+
+    The weight is a uint8 tensor of ``[out_features, in_features * num_bits // 8]``, int8 values or
+    two int4 values per byte with the even input feature in the low nibble. Like the int8 path it
+    carries its quantization parameters as attributes: ``scale``, fp32 ``[out_features,
+    in_features // group_size]``, ``num_bits`` (4 or 8), ``group_size`` and optionally ``zeros``
+    shaped like ``scale``. Without zeros int8 is symmetric and int4 is centered on 8.
+    """
+
+    def __init__(self, config: DeepSpeedInferenceConfig):
+        super(WeightOnlyLinearOp, self).__init__(config)
+        if self.config.fp16:
+            self.linear_func = self.inference_cuda_module.weight_only_linear_fp16
+        else:
+            self.linear_func = self.inference_cuda_module.weight_only_linear_fp32
+
+    def forward(self, input: torch.Tensor, weight: torch.Tensor, bias: torch.Tensor = None):
+        zeros = weight.zeros if getattr(weight, 'zeros', None) is not None else torch.empty(1)
+        add_bias = bias is not None
+        return self.linear_func(input, weight, weight.scale, zeros, bias if add_bias else torch.empty(1), add_bias,
+                                weight.num_bits, weight.group_size)
@@ -81,6 +81,35 @@ class DeepSpeedTransformerConfig(TransformerConfig):
                 a high accuracy level. On the other hand, for the downstream tasks, such as fine-tuning, we recommend
                 to turn it off in order to be able to reproduce the same result through the regular kernel execution.
 
+            flash_attention: Optional: Compute the attention scores, softmax, dropout and context in fused
+                kernels that never write the [batch, heads, seq, seq] scores or dropout mask to memory, and
+                recompute them in the backward. Requires heads of at most 128 elements, default is False
+
+            stateless_dropout: Optional: Keep only the seed and offset of each dropout instead of its one byte
+                per element mask, and regenerate the mask in the backward from a counter based RNG. The
+                masks then no longer depend on the kernel launch shapes, default is False
+
+            gemm_epilogues: Optional: Add the intermediate bias and GELU in the epilogue of the intermediate
+                GEMM and reduce the bias gradients and apply the GELU derivative in the epilogues of the
+                output GEMMs, through cublasLt. Requires CUDA 11.4 and an intermediate size multiple of 8,
+                default is False
+
+            recompute_qkv: Optional: Recompute Q, K and V with the QKV GEMM in the backward instead of keeping
+                them, default is False
+
+            recompute_softmax: Optional: Recompute the attention probabilities from Q.K^T in the backward
+                instead of keeping them. Not supported with flash_attention, default is False
+
+            recompute_ff1: Optional: Recompute the intermediate GEMM output (the GELU input) in the backward
+                instead of keeping it, default is False
+
+            rms_norm: Optional: Use RMSNorm (no mean, no bias) instead of LayerNorm for both normalizations, the
+                norm_b and attn_nb biases are then unused and get zero gradients, default is False
+
+            swiglu: Optional: Use a SwiGLU gated feed-forward instead of the GELU one, inter_w and inter_b are
+                then 2 * intermediate_size wide, their second half being the gate. Not supported with
+                gelu_checkpoint or gemm_epilogues, default is False
+
             return_tuple: Enable if using the return_tuple interface style for sending out the forward results.
 
             training: Enable for training rather than inference.
@@ -105,6 +134,14 @@ class DeepSpeedTransformerConfig(TransformerConfig):
                  adjust_init_range=True,
                  attn_dropout_checkpoint=False,
                  stochastic_mode=False,
+                 flash_attention=False,
+                 stateless_dropout=False,
+                 gemm_epilogues=False,
+                 recompute_qkv=False,
+                 recompute_softmax=False,
+                 recompute_ff1=False,
+                 rms_norm=False,
+                 swiglu=False,
                  return_tuple=False,
                  training=True):
         super(DeepSpeedTransformerConfig,
@@ -124,6 +161,14 @@ class DeepSpeedTransformerConfig(TransformerConfig):
         self.is_grad_enabled = True
         self.attn_dropout_checkpoint = attn_dropout_checkpoint
         self.stochastic_mode = stochastic_mode
+        self.flash_attention = flash_attention
+        self.stateless_dropout = stateless_dropout
+        self.gemm_epilogues = gemm_epilogues
+        self.recompute_qkv = recompute_qkv
+        self.recompute_softmax = recompute_softmax
+        self.recompute_ff1 = recompute_ff1
+        self.rms_norm = rms_norm
+        self.swiglu = swiglu
         self.return_tuple = return_tuple
 
     @classmethod
@@ -140,17 +185,197 @@ class DeepSpeedTransformerConfig(TransformerConfig):
         return cls.from_dict(json.loads(text))
 
 
+def packed_sequence_layout(cu_seqlens, total_tokens, max_seqlen=None, dtype=torch.half):
+    """Index maps and attention mask of sequences packed one after the other without padding.
+
+    Args:
+        cu_seqlens: int tensor of the batch size + 1 cumulative sequence lengths, starting at 0
+        total_tokens: number of packed tokens, cu_seqlens[-1]
+        max_seqlen: Optional: longest sequence, read from cu_seqlens (a device sync) if not given
+        dtype: type of the attention mask
+
+    Returns:
+        token_index: [total_tokens] position of every packed token in the padded [batch, seq] batch
+        padded_index: [batch * seq] packed token of every padded position, -1 for the padding
+        input_mask: [batch, 1, 1, seq] additive mask of the padding
+        with seq the longest sequence rounded up to a multiple of 16, as for padded batches.
+    """
+    lens = cu_seqlens[1:] - cu_seqlens[:-1]
+    if max_seqlen is None:
+        max_seqlen = int(lens.max())
+    seq = (max_seqlen + 15) // 16 * 16
+    starts = cu_seqlens[:-1].long()
+
+    positions = torch.arange(seq, device=cu_seqlens.device)
+    valid = positions.unsqueeze(0) < lens.unsqueeze(1)
+    padded_index = torch.where(valid, starts.unsqueeze(1) + positions, -1).int().view(-1)
+
+    tokens = torch.arange(total_tokens, device=cu_seqlens.device)
+    batch = torch.searchsorted(cu_seqlens[1:].long(), tokens, right=True)
+    token_index = (batch * seq + tokens - starts[batch]).int()
+
+    input_mask = torch.zeros(valid.shape, dtype=dtype, device=cu_seqlens.device).masked_fill_(~valid, -10000)
+    return token_index, padded_index, input_mask.view(-1, 1, 1, seq)
+
+
+class TransformerRecomputePolicy():
+    """Which activations of a DeepSpeedTransformerLayer are kept for the backward or recomputed.
+
+        Arguments:
+            qkv: Recompute Q, K and V with the QKV GEMM (recompute_qkv)
+
+            softmax: Recompute the attention probabilities from Q.K^T (recompute_softmax)
+
+            ctx: Recompute the attention probabilities after dropout from their mask
+                (attn_dropout_checkpoint)
+
+            ff1_output: Recompute the intermediate GEMM output, the GELU input (recompute_ff1)
+
+            gelu_output: Recompute the GELU output from its input (gelu_checkpoint)
+    """
+    FIELDS = ('qkv', 'softmax', 'ctx', 'ff1_output', 'gelu_output')
+
+    def __init__(self, qkv=False, softmax=False, ctx=False, ff1_output=False, gelu_output=False):
+        self.qkv = qkv
+        self.softmax = softmax
+        self.ctx = ctx
+        self.ff1_output = ff1_output
+        self.gelu_output = gelu_output
+
+    @classmethod
+    def from_config(cls, config):
+        return cls(qkv=config.recompute_qkv,
+                   softmax=config.recompute_softmax,
+                   ctx=config.attn_dropout_checkpoint,
+                   ff1_output=config.recompute_ff1,
+                   gelu_output=config.gelu_checkpoint)
+
+    def apply(self, config):
+        """Set the recomputation flags of config, before its layer is created."""
+        config.recompute_qkv = self.qkv
+        config.recompute_softmax = self.softmax
+        config.attn_dropout_checkpoint = self.ctx
+        config.recompute_ff1 = self.ff1_output
+        config.gelu_checkpoint = self.gelu_output
+        return config
+
+    def recompute_flops(self, config, batch_size, seq_length):
+        """Rough cost of the recomputation in the backward, in floating point operations."""
+        tokens = batch_size * seq_length
+        hidden, inter = config.hidden_size, config.intermediate_size
+        ff1 = inter * (2 if config.swiglu else 1)
+        scores = batch_size * config.heads * seq_length * seq_length
+        flops = 0
+        if self.qkv:
+            flops += 2 * tokens * hidden * 3 * hidden
+        if self.softmax:
+            flops += 2 * scores * (hidden // config.heads) + 5 * scores
+        if self.ctx:
+            flops += scores
+        if self.ff1_output:
+            flops += 2 * tokens * hidden * ff1
+        if self.gelu_output:
+            flops += 8 * tokens * inter
+        return flops
+
+    def __eq__(self, other):
+        return isinstance(other, TransformerRecomputePolicy) and all(
+            getattr(self, f) == getattr(other, f) for f in self.FIELDS)
+
+    def __repr__(self):
+        return 'TransformerRecomputePolicy({})'.format(', '.join('{}={}'.format(f, getattr(self, f))
+                                                                 for f in self.FIELDS))
+
+
+def transformer_activation_bytes(config, batch_size, seq_length, policy=None):
+    """Bytes of the activations one DeepSpeedTransformerLayer keeps between its forward and backward.
+
+    The layer input and output are not counted, they are the activations of the neighbouring layers.
+
+    Args:
+        config: DeepSpeedTransformerConfig of the layer
+        batch_size: micro-batch size
+        seq_length: sequence length, rounded up to a multiple of 16 as the forward does
+        policy: Optional: TransformerRecomputePolicy to account for instead of the one of config
+
+    Returns:
+        dict of the bytes kept per activation
+    """
+    if policy is None:
+        policy = TransformerRecomputePolicy.from_config(config)
+    seq = (seq_length + 15) // 16 * 16
+    elem = 2 if config.fp16 else 4
+    tokens = batch_size * seq
+    hidden, inter = config.hidden_size, config.intermediate_size
+    ff1 = inter * (2 if config.swiglu else 1)
+    scores = batch_size * config.heads * seq * seq
+    pre, invertible = config.pre_layer_norm, config.normalize_invertible
+
+    saved = {
+        'inp_norm': tokens * hidden * elem if pre or not invertible else 0,
+        'qkv_tf': 0 if policy.qkv else 3 * tokens * hidden * elem,
+        'attn_o_inp': tokens * hidden * elem,
+        'add_res': 0 if invertible else tokens * hidden * elem,
+        'ff1_inp': tokens * hidden * elem,
+        'layer_norm_stats': 4 * tokens * elem,
+    }
+    if config.flash_attention:
+        # The log-sum-exp of the score rows, and host seeds for the dropout.
+        saved['soft_inp'] = batch_size * config.heads * seq * 4
+        saved['ctx_bufB'] = 0
+    else:
+        saved['soft_inp'] = 0 if policy.softmax else scores * elem
+        saved['ctx_bufB'] = 0 if policy.ctx else scores * elem
+    # gelu_checkpoint keeps the GELU input in ff2_inp instead of its output.
+    saved['gelu_inp'] = 0 if policy.gelu_output or policy.ff1_output else tokens * ff1 * elem
+    saved['ff2_inp'] = 0 if policy.gelu_output and policy.ff1_output else tokens * inter * elem
+    if config.stateless_dropout:
+        saved['dropout_masks'] = 0
+    else:
+        saved['dropout_masks'] = 2 * tokens * hidden + (0 if config.flash_attention else scores)
+    return saved
+
+
+def select_recompute_policy(config, batch_size, seq_length, budget_bytes, num_layers=1):
+    """Cheapest TransformerRecomputePolicy whose kept activations fit budget_bytes.
+
+    Args:
+        config: DeepSpeedTransformerConfig of the layers
+        batch_size: micro-batch size
+        seq_length: sequence length
+        budget_bytes: bytes available to the activations kept by num_layers layers
+        num_layers: number of layers sharing the budget
+
+    Returns:
+        the policy with the least recomputation that fits, None if none does
+    """
+    candidates = []
+    for mask in range(1 << len(TransformerRecomputePolicy.FIELDS)):
+        flags = {f: bool(mask >> i & 1) for i, f in enumerate(TransformerRecomputePolicy.FIELDS)}
+        if config.flash_attention and flags['softmax']:
+            continue
+        if config.swiglu and flags['gelu_output']:
+            continue
+        policy = TransformerRecomputePolicy(**flags)
+        total = num_layers * sum(transformer_activation_bytes(config, batch_size, seq_length, policy).values())
+        if total <= budget_bytes:
+            candidates.append((policy.recompute_flops(config, batch_size, seq_length), total, mask, policy))
+    return min(candidates, key=lambda c: c[:3])[3] if candidates else None
+
+
 class DeepSpeedTransformerFunction(Function):
 
     @staticmethod
     def forward(ctx, input, input_mask, self, grads, layer_id, attn_qkvw, attn_qkvb, attn_ow, attn_ob, attn_nw,
-                attn_nb, inter_w, inter_b, output_w, output_b, norm_w, norm_b, config):
+                attn_nb, inter_w, inter_b, output_w, output_b, norm_w, norm_b, config, token_index, padded_index):
 
         cuda_module = stochastic_transformer_cuda_module if config.stochastic_mode else transformer_cuda_module
         forward_func = cuda_module.forward_fp16 if config.fp16 else cuda_module.forward_fp32
 
+        # Packed [tokens, hidden] inputs are already laid out by packed_sequence_layout.
+        packed = token_index.numel() > 0
         inp_size = input.size()
-        if inp_size[1] % 16 != 0:
+        if not packed and inp_size[1] % 16 != 0:
             input = torch.cat(
                 (input,
                  torch.randn(
@@ -165,7 +390,7 @@ class DeepSpeedTransformerFunction(Function):
              config.layer_id, input, input_mask, attn_qkvw, attn_qkvb, attn_ow, attn_ob, attn_nw, attn_nb, inter_w,
              inter_b, output_w, output_b, norm_w, norm_b, config.training and config.is_grad_enabled,
              config.pre_layer_norm, config.attn_dropout_checkpoint, config.normalize_invertible,
-             config.gelu_checkpoint)
+             config.gelu_checkpoint, token_index, padded_index)
 
         # For testing only.
         if grads is not None:
@@ -198,12 +423,17 @@ class DeepSpeedTransformerFunction(Function):
                                       attn_nb, inter_w, inter_b, output_w, output_b, norm_w, norm_b)
 
             ctx.config = config
+            ctx.token_index = token_index
+            ctx.padded_index = padded_index
             if (config.pre_layer_norm or not config.normalize_invertible):
                 ctx.inp_norm = inp_norm
 
-            ctx.qkv_tf = qkv_tf
-            ctx.soft_inp = soft_inp
-            if not config.attn_dropout_checkpoint:
+            if not config.recompute_qkv:
+                ctx.qkv_tf = qkv_tf
+            if not config.recompute_softmax:
+                ctx.soft_inp = soft_inp
+            # With flash_attention, ctx_bufB is the seed of the attention dropout.
+            if not config.attn_dropout_checkpoint or config.flash_attention:
                 ctx.ctx_bufB = ctx_bufB
 
             ctx.attn_o_inp = attn_o_inp
@@ -214,17 +444,19 @@ class DeepSpeedTransformerFunction(Function):
             ctx.layer_norm_mean = layer_norm_mean
 
             ctx.ff1_inp = ff1_inp
-            if not config.gelu_checkpoint:
+            if not config.gelu_checkpoint and not config.recompute_ff1:
                 ctx.gelu_inp = gelu_inp
 
-            ctx.ff2_inp = ff2_inp
+            # Under gelu_checkpoint ff2_inp is the intermediate GEMM output.
+            if not config.gelu_checkpoint or not config.recompute_ff1:
+                ctx.ff2_inp = ff2_inp
             ctx.attn_prob_dropout_mask = attn_prob_dropout_mask
             ctx.attn_output_dropout_mask = attn_output_dropout_mask
             ctx.layer_output_dropout_mask = layer_output_dropout_mask
             ctx.attn_layer_norm_var = attn_layer_norm_var
             ctx.layer_norm_var = layer_norm_var
 
-        if inp_size[1] % 16 != 0:
+        if not packed and inp_size[1] % 16 != 0:
             output = torch.narrow(output, 1, 0, inp_size[1])
 
         if config.return_tuple:
@@ -236,7 +468,8 @@ class DeepSpeedTransformerFunction(Function):
     def backward(ctx, grad_output):
         bsz = grad_output.shape[0]
         grad_output_shape = grad_output.size()
-        if grad_output_shape[1] % 16 != 0:
+        packed = ctx.token_index.numel() > 0
+        if not packed and grad_output_shape[1] % 16 != 0:
             grad_output = torch.cat((grad_output, torch.zeros((bsz, (16 - (grad_output_shape[1] % 16)), \
                                         grad_output_shape[2]), device=grad_output.device, dtype=grad_output.dtype)), 1)
 
@@ -252,19 +485,28 @@ class DeepSpeedTransformerFunction(Function):
         cuda_module = stochastic_transformer_cuda_module if ctx.config.stochastic_mode else transformer_cuda_module
         backward_func = cuda_module.backward_fp16 if ctx.config.fp16 else cuda_module.backward_fp32
 
+        # The recomputed activations are rebuilt by the backward, an empty tensor stands for them.
+        placeholder = grad_output.new_empty(0)
+        qkv_tf = ctx.qkv_tf if not ctx.config.recompute_qkv else placeholder
+        soft_inp = ctx.soft_inp if not ctx.config.recompute_softmax else placeholder
+        gelu_inp = ctx.gelu_inp if not (ctx.config.gelu_checkpoint or ctx.config.recompute_ff1) else placeholder
+        ff2_inp = ctx.ff2_inp if not (ctx.config.gelu_checkpoint and ctx.config.recompute_ff1) else placeholder
+
         (grad_input, grad_attn_qkvw, grad_attn_qkvb, grad_attn_ow, grad_attn_ob, grad_attn_nw, grad_attn_nb,
          grad_inter_w, grad_inter_b, grad_output_w, grad_output_b, grad_norm_w, grad_norm_b) = backward_func(
              ctx.config.layer_id, grad_output,
              (ctx.inp_norm if (ctx.config.pre_layer_norm and ctx.config.normalize_invertible) else output),
              (ctx.inp_norm if (ctx.config.pre_layer_norm or not ctx.config.normalize_invertible) else input),
-             ctx.qkv_tf, ctx.soft_inp, (ctx.soft_inp if ctx.config.attn_dropout_checkpoint else ctx.ctx_bufB),
+             qkv_tf, soft_inp,
+             (soft_inp if ctx.config.attn_dropout_checkpoint and not ctx.config.flash_attention else ctx.ctx_bufB),
              ctx.attn_o_inp, (ctx.ff1_inp if ctx.config.normalize_invertible else ctx.add_res), ctx.ff1_inp,
-             (ctx.ff2_inp if ctx.config.gelu_checkpoint else ctx.gelu_inp), ctx.ff2_inp, ctx.attn_prob_dropout_mask,
+             (ff2_inp if ctx.config.gelu_checkpoint else gelu_inp), ff2_inp, ctx.attn_prob_dropout_mask,
              ctx.attn_output_dropout_mask, ctx.layer_output_dropout_mask, ctx.attn_layer_norm_var,
              ctx.attn_layer_norm_mean, ctx.layer_norm_var, ctx.layer_norm_mean,
              (ctx.inp_norm if
               (ctx.config.pre_layer_norm and ctx.config.normalize_invertible) else input), input_mask, attn_qkvw,
-             attn_qkvb, attn_ow, attn_ob, attn_nw, attn_nb, inter_w, inter_b, output_w, output_b, norm_w, norm_b)
+             attn_qkvb, attn_ow, attn_ob, attn_nw, attn_nb, inter_w, inter_b, output_w, output_b, norm_w, norm_b,
+             ctx.token_index, ctx.padded_index)
 
         # This appears to be an effective way to release context memory
         ctx.qkv_tf = None
@@ -284,13 +526,15 @@ class DeepSpeedTransformerFunction(Function):
         ctx.layer_output_dropout_mask = None
         ctx.attn_layer_norm_var = None
         ctx.layer_norm_var = None
+        ctx.token_index = None
+        ctx.padded_index = None
 
-        if grad_output_shape[1] % 16 != 0:
+        if not packed and grad_output_shape[1] % 16 != 0:
             grad_input = torch.narrow(grad_input, 1, 0, grad_output_shape[1])
 
         return (grad_input, None, None, None, None, grad_attn_qkvw, grad_attn_qkvb, grad_attn_ow, grad_attn_ob,
                 grad_attn_nw, grad_attn_nb, grad_inter_w, grad_inter_b, grad_output_w, grad_output_b, grad_norm_w,
-                grad_norm_b, None)
+                grad_norm_b, None, None, None)
 
 
 class DeepSpeedTransformerLayer(nn.Module):
@@ -327,8 +571,9 @@ class DeepSpeedTransformerLayer(nn.Module):
             self.attn_ob = nn.Parameter(torch.Tensor(self.config.hidden_size))
             self.attn_nw = nn.Parameter(torch.Tensor(self.config.hidden_size))
             self.attn_nb = nn.Parameter(torch.Tensor(self.config.hidden_size))
-            self.inter_w = nn.Parameter(torch.Tensor(self.config.intermediate_size, self.config.hidden_size))
-            self.inter_b = nn.Parameter(torch.Tensor(self.config.intermediate_size))
+            ff1_size = self.config.intermediate_size * (2 if self.config.swiglu else 1)
+            self.inter_w = nn.Parameter(torch.Tensor(ff1_size, self.config.hidden_size))
+            self.inter_b = nn.Parameter(torch.Tensor(ff1_size))
             self.output_w = nn.Parameter(torch.Tensor(self.config.hidden_size, self.config.intermediate_size))
             self.output_b = nn.Parameter(torch.Tensor(self.config.hidden_size))
             self.norm_w = nn.Parameter(torch.Tensor(self.config.hidden_size))
@@ -372,7 +617,10 @@ class DeepSpeedTransformerLayer(nn.Module):
                           self.config.intermediate_size, self.config.attn_dropout_ratio,
                           self.config.hidden_dropout_ratio, self.config.layer_norm_eps, self.config.seed,
                           self.config.pre_layer_norm, self.config.test_gemm, self.config.attn_dropout_checkpoint,
-                          self.config.normalize_invertible, self.config.gelu_checkpoint, self.config.stochastic_mode)
+                          self.config.normalize_invertible, self.config.gelu_checkpoint, self.config.stochastic_mode,
+                          self.config.flash_attention, self.config.stateless_dropout,
+                          self.config.gemm_epilogues, self.config.recompute_qkv, self.config.recompute_softmax,
+                          self.config.recompute_ff1, self.config.rms_norm, self.config.swiglu)
 
     def init_transformer_weights(self, adjust_init_range=False):
         num_layers = self.config.num_hidden_layers
@@ -403,10 +651,20 @@ class DeepSpeedTransformerLayer(nn.Module):
                 encoder_attention_mask=None,
                 past_key_value=None,
                 output_attentions=False,
-                grads=None):
+                grads=None,
+                cu_seqlens=None,
+                max_seqlen=None):
+        """With ``cu_seqlens``, ``hidden_states`` are the [tokens, hidden] sequences packed without padding and
+        ``attention_mask`` is ignored: the token-wise layers only run on the real tokens."""
         self.config.is_grad_enabled = torch.is_grad_enabled()
         self.config.training = self.training
+        if cu_seqlens is not None:
+            token_index, padded_index, attention_mask = packed_sequence_layout(cu_seqlens, hidden_states.size(0),
+                                                                               max_seqlen, hidden_states.dtype)
+        else:
+            token_index = padded_index = torch.empty(0, dtype=torch.int32, device=hidden_states.device)
         return DeepSpeedTransformerFunction.apply(hidden_states, attention_mask, self, grads, self.config.layer_id,
                                                   self.attn_qkvw, self.attn_qkvb, self.attn_ow, self.attn_ob,
                                                   self.attn_nw, self.attn_nb, self.inter_w, self.inter_b,
-                                                  self.output_w, self.output_b, self.norm_w, self.norm_b, self.config)
+                                                  self.output_w, self.output_b, self.norm_w, self.norm_b, self.config,
+                                                  token_index, padded_index)
@@ -18,6 +18,9 @@ from torch.distributed import ProcessGroup
 import torch.nn.functional
 
 from deepspeed.utils import instrument_w_nvtx
+from deepspeed.ops.op_builder import QuantizerBuilder
+
+quantizer_module = None
 
 
 def _torch_reduce_scatter_fn(input_tensor: Tensor, output_tensor: Tensor, group=None, async_op=False, prof=False):
@@ -89,3 +92,105 @@ def reduce_scatter_coalesced(
         offset += padded_partition_sz_for_each_tensor[tensor_idx]
 
     return output_lst
+
+
+@instrument_w_nvtx
+@torch.no_grad()
+def all_to_all_quant_reduce(tensors: List[Tensor],
+                            intra_node_group: ProcessGroup,
+                            inter_node_group: ProcessGroup,
+                            group: ProcessGroup = None,
+                            num_bits: int = 8,
+                            group_size: int = 2048) -> List[Tensor]:
+    """quantized, hierarchical replacement for reduce_scatter_coalesced
+
+    Each tensor is quantized once and laid out per destination rank, exchanged within the node,
+    reduced and requantized, then exchanged between nodes and reduced again, so both hops move
+    num_bits data instead of fp16. Assumes rank = node * devices_per_node + local_rank, with
+    intra_node_group holding the ranks of this node and inter_node_group the ranks sharing this
+    local_rank. Tensors that are not fp16 or not a multiple of world_size * group_size fall back
+    to reduce_scatter_coalesced over group.
+    """
+    global quantizer_module
+    if quantizer_module is None:
+        quantizer_module = QuantizerBuilder().load()
+
+    local_world_size = dist.get_world_size(intra_node_group)
+    num_nodes = dist.get_world_size(inter_node_group)
+    world_sz = local_world_size * num_nodes
+    q_type = quantizer_module.Symmetric
+
+    output_lst: List[Tensor] = [None] * len(tensors)
+    for tensor_idx, tensor in enumerate(tensors):
+        if tensor.dtype != torch.half or tensor.numel() % (world_sz * group_size) != 0:
+            output_lst[tensor_idx] = reduce_scatter_coalesced([tensor], group=group)[0]
+            continue
+
+        groups = tensor.numel() // group_size
+        intra_quant_groups = groups // local_world_size
+        inter_quant_groups = groups // world_sz
+
+        # pre-divide, as reduce_scatter_coalesced does
+        scaled_tensor = tensor.view(-1) / world_sz
+        q_tensor, q_scales = quantizer_module.swizzle_quant(scaled_tensor, groups, num_bits, q_type, 1, num_nodes,
+                                                            local_world_size)
+
+        local_output = torch.empty_like(q_tensor)
+        local_scales = torch.empty_like(q_scales)
+        dist.all_to_all_single(local_output, q_tensor, group=intra_node_group)
+        dist.all_to_all_single(local_scales, q_scales, group=intra_node_group)
+        q_tensor, q_scales = quantizer_module.quantized_reduction(local_output, local_scales, intra_quant_groups,
+                                                                  num_bits, q_type, local_world_size)
+
+        global_output = torch.empty_like(q_tensor)
+        global_scales = torch.empty_like(q_scales)
+        dist.all_to_all_single(global_output, q_tensor, group=inter_node_group)
+        dist.all_to_all_single(global_scales, q_scales, group=inter_node_group)
+        q_tensor, q_scales = quantizer_module.quantized_reduction(global_output, global_scales, inter_quant_groups,
+                                                                  num_bits, q_type, num_nodes)
+
+        output_lst[tensor_idx] = quantizer_module.dequantize(q_tensor, q_scales, inter_quant_groups, num_bits,
+                                                             q_type)
+
+    return output_lst
+
+
+@instrument_w_nvtx
+@torch.no_grad()
+def all_gather_quant(tensor: Tensor,
+                     intra_node_group: ProcessGroup,
+                     inter_node_group: ProcessGroup,
+                     num_bits: int = 8,
+                     group_size: int = 2048) -> Tensor:
+    """quantized, hierarchical all-gather of the fp16 shard held by each rank
+
+    The shard is quantized once and gathered between nodes first, so each shard crosses the
+    inter-node links only once, then within the node. The received groups are in
+    [local_rank, node] order; the swizzled dequantize writes them back in rank order in the
+    same pass. Uses the rank layout of all_to_all_quant_reduce and needs
+    tensor.numel() % group_size == 0.
+    """
+    global quantizer_module
+    if quantizer_module is None:
+        quantizer_module = QuantizerBuilder().load()
+
+    local_world_size = dist.get_world_size(intra_node_group)
+    num_nodes = dist.get_world_size(inter_node_group)
+    world_sz = local_world_size * num_nodes
+    q_type = quantizer_module.Symmetric
+
+    groups = tensor.numel() // group_size
+    q_tensor, q_scales = quantizer_module.quantize(tensor.view(-1), groups, num_bits, q_type)
+
+    node_output = q_tensor.new_empty(num_nodes * q_tensor.numel())
+    node_scales = q_scales.new_empty((num_nodes * groups, q_scales.size(1)))
+    dist.allgather_fn(node_output, q_tensor, group=inter_node_group)
+    dist.allgather_fn(node_scales, q_scales, group=inter_node_group)
+
+    global_output = node_output.new_empty(local_world_size * node_output.numel())
+    global_scales = node_scales.new_empty((world_sz * groups, q_scales.size(1)))
+    dist.allgather_fn(global_output, node_output, group=intra_node_group)
+    dist.allgather_fn(global_scales, node_scales, group=intra_node_group)
+
+    return quantizer_module.swizzled_dequantize(global_output, global_scales, world_sz * groups, num_bits, q_type, 1,
+                                                num_nodes, local_world_size)
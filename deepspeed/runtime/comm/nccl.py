@@ -10,6 +10,8 @@ import numpy as np
 
 from deepspeed.runtime.compression.cupy import CupyBackend
 from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import FusedAdamBuilder
+from deepspeed.utils import logger
 
 
 class NcclBackend(object):
@@ -28,6 +30,31 @@ class NcclBackend(object):
         TORCH_MINOR = int(torch.__version__.split('.')[1])
         if (TORCH_MAJOR == 1 and TORCH_MINOR >= 10) or TORCH_MAJOR == 2:
             self.bool_not_supported = True
+        # Fused sign-pack and error-feedback kernels of fp32 buffers, the cupy path is the fallback.
+        # Loaded on the first fp32 allreduce, so installs without prebuilt ops only JIT build them
+        # when they are used.
+        self.fused_compression = None
+        self.fused_compression_loaded = False
+
+    def load_fused_compression(self, device):
+        """Loads the fused compression kernels on first use, None if they are unavailable on any rank.
+        The ranks agree on the outcome, the fused and the cupy paths do not exchange the same messages.
+        """
+        if self.fused_compression_loaded:
+            return self.fused_compression
+        self.fused_compression_loaded = True
+
+        fused_compression = None
+        if FusedAdamBuilder().is_compatible(verbose=False):
+            try:
+                fused_compression = FusedAdamBuilder().load()
+            except Exception as e:
+                logger.warning(f"1-bit compression falls back to cupy, loading fused_adam failed: {e}")
+        available = torch.tensor([1 if fused_compression is not None else 0], dtype=torch.int32, device=device)
+        dist.all_reduce(available, op=dist.ReduceOp.MIN, group=self.world_group)
+        if available.item() == 1:
+            self.fused_compression = fused_compression
+        return self.fused_compression
 
     def my_igather(self, rank, size, group, sendbuf, recvbuf, root):
         req = []
@@ -65,6 +92,14 @@ class NcclBackend(object):
             empty_tensor = torch.zeros(worker_error_size - original_size, device=buffer_m.device)
             buffer_m = torch.cat([buffer_m, empty_tensor])
 
+        if buffer_m.dtype == torch.float32 and self.load_fused_compression(buffer_m.device) is not None:
+            self.fused_compressed_allreduce(buffer_m, worker_error, server_error)
+            if original_size != worker_error_size:
+                buffer_m = buffer_m[0:original_size]
+            if len(original_shape) > 1:
+                buffer_m = buffer_m.reshape(original_shape)
+            return buffer_m
+
         buffer_m.add_(worker_error)
         worker_scale = torch.norm(buffer_m) / np.sqrt(buffer_m.numel())
         worker_error.set_(buffer_m - worker_scale * buffer_m.sign().add_(1).bool().float().add_(-0.5).mul_(2.0))
@@ -167,3 +202,29 @@ class NcclBackend(object):
             buffer_m = buffer_m.reshape(original_shape)
 
         return buffer_m
+
+    def fused_compressed_allreduce(self, buffer_m, worker_error, server_error):
+        """Same exchange as compressed_allreduce, the signs packed in int32 words by the fused
+        kernels which also update worker_error and server_error. buffer_m is overwritten with the
+        result."""
+        # Communication phase 1: chunk r of the signs of every worker goes to server r
+        sign_list_packed, worker_scale = self.fused_compression.onebit_worker_compress(
+            buffer_m, worker_error, self.size)
+        recvbuf_sign = torch.empty_like(sign_list_packed)
+        recvbuf_scale = [torch.empty_like(worker_scale) for _ in range(self.size)]
+        dist.all_to_all_single(recvbuf_sign, sign_list_packed, group=self.world_group)
+        dist.all_gather(recvbuf_scale, worker_scale, group=self.world_group)
+        sign_list_packed = None
+
+        server_sign_packed, server_scale = self.fused_compression.onebit_server_compress(
+            recvbuf_sign, torch.cat(recvbuf_scale), server_error)
+        recvbuf_sign = None
+
+        # Communication phase 2: every server sends its compressed chunk to all workers
+        recvbuf_sign_server = [torch.empty_like(server_sign_packed[0]) for _ in range(self.size)]
+        recvbuf_scale_server = [torch.empty_like(server_scale) for _ in range(self.size)]
+        dist.all_gather(recvbuf_sign_server, server_sign_packed[0], group=self.world_group)
+        dist.all_gather(recvbuf_scale_server, server_scale, group=self.world_group)
+
+        self.fused_compression.onebit_decompress(buffer_m, torch.stack(recvbuf_sign_server),
+                                                 torch.cat(recvbuf_scale_server))
@@ -84,6 +84,9 @@ TORCH_ADAM_PARAM = "torch_adam"
 ADAM_W_MODE = "adam_w_mode"
 ADAM_W_MODE_DEFAULT = True
 
+# extra optimizer parameter for lamb, only understood by FusedLamb
+LAMB_MULTI_TENSOR = "multi_tensor"
+
 
 class DeepSpeedConfigError(Exception):
     pass
@@ -35,7 +35,7 @@ from deepspeed.runtime.bf16_optimizer import BF16_Optimizer
 
 from deepspeed.runtime.config import DEEPSPEED_OPTIMIZERS, \
     ADAGRAD_OPTIMIZER, ADAM_OPTIMIZER, ADAMW_OPTIMIZER, LAMB_OPTIMIZER, ONEBIT_ADAM_OPTIMIZER, ONEBIT_LAMB_OPTIMIZER, \
-    TORCH_ADAM_PARAM, ADAM_W_MODE, ADAM_W_MODE_DEFAULT, ZERO_ONE_ADAM_OPTIMIZER
+    TORCH_ADAM_PARAM, ADAM_W_MODE, ADAM_W_MODE_DEFAULT, ZERO_ONE_ADAM_OPTIMIZER, LAMB_MULTI_TENSOR
 
 from deepspeed.runtime.dataloader import DeepSpeedDataLoader
 from deepspeed.runtime.constants import \
@@ -101,6 +101,9 @@ dist = None
 
 MEMORY_OPT_ALLREDUCE_SIZE = 500000000
 
+CPU_LAMB_ZERO_ERROR = "DeepSpeedCPULamb is not supported with ZeRO, its trust ratio would be computed over the " \
+    "flat ZeRO partition of each rank instead of per parameter. Use Lamb without ZeRO-Offload (FusedLamb) instead."
+
 DeepSpeedOptimizerCallable = \
     Callable[[Union[Iterable[Parameter], Dict[str, Iterable]]], Optimizer]
 DeepSpeedSchedulerCallable = Callable[[Optimizer], _LRScheduler]
@@ -1168,7 +1171,11 @@ class DeepSpeedEngine(Module):
                 basic_optimizer = client_optimizer(model_parameters)
                 log_dist('Using client callable to create basic optimizer', ranks=[0])
 
-            if self.zero_use_cpu_optimizer() and not isinstance(basic_optimizer, deepspeed.ops.adam.DeepSpeedCPUAdam):
+            if self.zero_optimization() and isinstance(basic_optimizer, deepspeed.ops.lamb.DeepSpeedCPULamb):
+                raise ZeRORuntimeException(CPU_LAMB_ZERO_ERROR)
+            cpu_optimizers = (deepspeed.ops.adam.DeepSpeedCPUAdam, deepspeed.ops.adagrad.DeepSpeedCPUAdagrad,
+                              deepspeed.ops.lion.DeepSpeedCPULion)
+            if self.zero_use_cpu_optimizer() and not isinstance(basic_optimizer, cpu_optimizers):
                 if self.zero_force_ds_cpu_optimizer():
                     msg = f'You are using ZeRO-Offload with a client provided optimizer ({type(basic_optimizer)}) which in most cases will yield poor performance. Please either use deepspeed.ops.adam.DeepSpeedCPUAdam or set an optimizer in your ds-config (https://www.deepspeed.ai/docs/config-json/#optimizer-parameters). If you really want to use a custom optimizer w. ZeRO-Offload and understand the performance impacts you can also set <"zero_force_ds_cpu_optimizer": false> in your configuration file.'
                     raise ZeRORuntimeException(msg)
@@ -1246,9 +1253,12 @@ class DeepSpeedEngine(Module):
                     )
 
         elif self.optimizer_name() == LAMB_OPTIMIZER:
+            multi_tensor = optimizer_parameters.pop(LAMB_MULTI_TENSOR, False)
+            if self.zero_use_cpu_optimizer():
+                raise ZeRORuntimeException(CPU_LAMB_ZERO_ERROR)
             from deepspeed.ops.lamb import FusedLamb
 
-            optimizer = FusedLamb(model_parameters, **optimizer_parameters)
+            optimizer = FusedLamb(model_parameters, **optimizer_parameters, multi_tensor=multi_tensor)
         elif self.optimizer_name() == ONEBIT_ADAM_OPTIMIZER:
             assert not self.zero_optimization(), "1bit-Adam is not compatible with ZeRO"
             from deepspeed.runtime.fp16.onebit.adam import OnebitAdam
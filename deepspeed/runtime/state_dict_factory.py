@@ -33,7 +33,7 @@ class SDLoaderFactory:
         version = data['version']
         ckpt_type = data.get('parallelization', 'pp')
         mp_size = data.get('mp_size', 0)
-        if sd_type.lower() in ['bloom', 'ds_model']:
+        if sd_type.lower() in ['bloom', 'ds_model', 'ds_kernel']:
             return data
         return SDLoaderFactory.get_sd_loader(ckpt_list, checkpoint_engine, sd_type, version)
 
@@ -11,7 +11,9 @@ AIO_DEFAULT_DICT = {
     AIO_QUEUE_DEPTH: AIO_QUEUE_DEPTH_DEFAULT,
     AIO_THREAD_COUNT: AIO_THREAD_COUNT_DEFAULT,
     AIO_SINGLE_SUBMIT: AIO_SINGLE_SUBMIT_DEFAULT,
-    AIO_OVERLAP_EVENTS: AIO_OVERLAP_EVENTS_DEFAULT
+    AIO_OVERLAP_EVENTS: AIO_OVERLAP_EVENTS_DEFAULT,
+    AIO_USE_IO_URING: AIO_USE_IO_URING_DEFAULT,
+    AIO_SQ_POLL: AIO_SQ_POLL_DEFAULT
 }
 
 
@@ -23,7 +25,9 @@ def get_aio_config(param_dict):
             AIO_QUEUE_DEPTH: get_scalar_param(aio_dict, AIO_QUEUE_DEPTH, AIO_QUEUE_DEPTH_DEFAULT),
             AIO_THREAD_COUNT: get_scalar_param(aio_dict, AIO_THREAD_COUNT, AIO_THREAD_COUNT_DEFAULT),
             AIO_SINGLE_SUBMIT: get_scalar_param(aio_dict, AIO_SINGLE_SUBMIT, AIO_SINGLE_SUBMIT_DEFAULT),
-            AIO_OVERLAP_EVENTS: get_scalar_param(aio_dict, AIO_OVERLAP_EVENTS, AIO_OVERLAP_EVENTS_DEFAULT)
+            AIO_OVERLAP_EVENTS: get_scalar_param(aio_dict, AIO_OVERLAP_EVENTS, AIO_OVERLAP_EVENTS_DEFAULT),
+            AIO_USE_IO_URING: get_scalar_param(aio_dict, AIO_USE_IO_URING, AIO_USE_IO_URING_DEFAULT),
+            AIO_SQ_POLL: get_scalar_param(aio_dict, AIO_SQ_POLL, AIO_SQ_POLL_DEFAULT)
         }
 
     return AIO_DEFAULT_DICT
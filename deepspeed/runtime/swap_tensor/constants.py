@@ -11,7 +11,9 @@ AIO_FORMAT = '''
   "queue_depth": 8,
   "thread_count": 1,
   "single_submit": false,
-  "overlap_events": true
+  "overlap_events": true,
+  "use_io_uring": false,
+  "sq_poll": false
 }
 '''
 AIO = "aio"
@@ -25,3 +27,7 @@ AIO_SINGLE_SUBMIT = "single_submit"
 AIO_SINGLE_SUBMIT_DEFAULT = False
 AIO_OVERLAP_EVENTS = "overlap_events"
 AIO_OVERLAP_EVENTS_DEFAULT = True
+AIO_USE_IO_URING = "use_io_uring"
+AIO_USE_IO_URING_DEFAULT = False
+AIO_SQ_POLL = "sq_poll"
+AIO_SQ_POLL_DEFAULT = False
@@ -0,0 +1,121 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+"""
+Functionality of running a CPU Adam step directly over optimizer state swapped to (NVMe) storage devices.
+"""
+
+import torch
+
+from deepspeed.runtime.swap_tensor.utils import AIO_ALIGNED_BYTES
+
+# Chunks in flight: one being read, one being updated, one being written back.
+STREAMING_PIPELINE_DEPTH = 3
+
+STREAMING_STATE_KEYS = ['param', 'exp_avg', 'exp_avg_sq']
+
+
+class StreamingCPUAdam(object):
+    """Runs DeepSpeedCPUAdam over fp32 params and moments that live in swap files.
+
+    The state is walked in chunks of ``chunk_numel`` elements. While chunk i is updated, chunk i+1 is
+    read and chunk i-1 is written back, so pinned memory is bounded by a few chunks per state tensor
+    instead of whole partitions, and the NVMe traffic hides behind the Adam compute.
+
+    Every read and write covers a multiple of ``numel_alignment`` elements, split evenly in aligned slices
+    across the aio threads as the other swappers do. The swap files of a param of n elements must therefore
+    hold ``aligned_numel(n)`` elements, the padding being read and written back unchanged.
+
+    Arguments:
+        optimizer (DeepSpeedCPUAdam): optimizer providing the step kernel and hyperparameters.
+        aio_handle: aio handle used for the swaps, it must not have other requests in flight.
+        chunk_numel (int): elements per chunk, a multiple of ``numel_alignment``.
+    """
+
+    def __init__(self, optimizer, aio_handle, chunk_numel):
+        self.optimizer = optimizer
+        self.aio_handle = aio_handle
+        example = torch.empty(0, dtype=torch.float32)
+        self.numel_alignment = AIO_ALIGNED_BYTES * aio_handle.get_thread_count() // example.element_size()
+        assert chunk_numel > 0 and chunk_numel % self.numel_alignment == 0, \
+            f'chunk_numel {chunk_numel} must be a multiple of {self.numel_alignment} for aligned I/O'
+        self.chunk_numel = chunk_numel
+
+        self.buffers = [{
+            key: aio_handle.new_cpu_locked_tensor(chunk_numel, example)
+            for key in STREAMING_STATE_KEYS
+        } for _ in range(STREAMING_PIPELINE_DEPTH)]
+
+    def release(self):
+        for slot in self.buffers:
+            for buffer in slot.values():
+                self.aio_handle.free_cpu_locked_tensor(buffer)
+        self.buffers = []
+
+    def aligned_numel(self, numel):
+        remainder = numel % self.numel_alignment
+        return numel if remainder == 0 else (numel + self.numel_alignment - remainder)
+
+    def _chunk_range(self, index, numel):
+        start = index * self.chunk_numel
+        return start, min(self.chunk_numel, numel - start)
+
+    def _chunk_io(self, read, slot, paths, start, numel):
+        # The tail chunk is padded, chunk_numel is already aligned
+        io_numel = self.aligned_numel(numel)
+        buffers = [self.buffers[slot][key].narrow(0, 0, io_numel) for key in STREAMING_STATE_KEYS]
+        files = [paths[key] for key in STREAMING_STATE_KEYS]
+        offsets = [start * buffers[0].element_size()] * len(buffers)
+        io_batch = self.aio_handle.async_pread_batch if read else self.aio_handle.async_pwrite_batch
+        assert io_batch(buffers, files, offsets) == 0
+        return self.aio_handle.get_last_request()
+
+    @torch.no_grad()
+    def step(self, group, step, grad, paths, param_out=None):
+        """Update one swapped parameter in place on storage.
+
+        Arguments:
+            group (dict): param group supplying lr, betas, eps, weight_decay and bias_correction.
+            step (int): optimizer step count for this parameter.
+            grad (Tensor): flat host gradient covering the whole parameter. bf16 gradients are read as is
+                by the kernel, fp16 ones are upcast to fp32 chunk by chunk.
+            paths (dict): swap file paths for 'param', 'exp_avg' and 'exp_avg_sq', each holding
+                ``aligned_numel(grad.numel())`` elements.
+            param_out (Tensor, optional): flat tensor, on any device, that receives the updated param.
+        """
+        numel = grad.numel()
+        num_chunks = (numel + self.chunk_numel - 1) // self.chunk_numel
+        if num_chunks == 0:
+            return
+
+        beta1, beta2 = group['betas']
+        read_requests = {0: self._chunk_io(True, 0, paths, *self._chunk_range(0, numel))}
+        write_requests = {}
+        for i in range(num_chunks):
+            slot = i % STREAMING_PIPELINE_DEPTH
+            if i + 1 < num_chunks:
+                # The next slot was last used by chunk i-2, its write back must land before we overwrite it.
+                if i - 2 in write_requests:
+                    self.aio_handle.wait_request(write_requests.pop(i - 2))
+                read_requests[i + 1] = self._chunk_io(True, (i + 1) % STREAMING_PIPELINE_DEPTH, paths,
+                                                      *self._chunk_range(i + 1, numel))
+
+            self.aio_handle.wait_request(read_requests.pop(i))
+            start, chunk_numel = self._chunk_range(i, numel)
+            param, exp_avg, exp_avg_sq = [
+                self.buffers[slot][key].narrow(0, 0, chunk_numel) for key in STREAMING_STATE_KEYS
+            ]
+            grad_chunk = grad.narrow(0, start, chunk_numel)
+            if grad_chunk.dtype != torch.bfloat16:
+                grad_chunk = grad_chunk.float()
+            self.optimizer.ds_opt_adam.adam_update(self.optimizer.opt_id, step, group['lr'], beta1, beta2,
+                                                   group['eps'], group['weight_decay'], group['bias_correction'],
+                                                   param, grad_chunk, exp_avg, exp_avg_sq)
+            if param_out is not None:
+                param_out.narrow(0, start, chunk_numel).copy_(param)
+
+            write_requests[i] = self._chunk_io(False, slot, paths, start, chunk_numel)
+
+        for request in write_requests.values():
+            self.aio_handle.wait_request(request)
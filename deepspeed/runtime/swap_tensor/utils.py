@@ -17,13 +17,13 @@ AIO_ALIGNED_BYTES = 1024
 
 
 def swap_in_tensors(swap_handle, tensor_buffers, swap_paths):
-    for buffer, path in zip(tensor_buffers, swap_paths):
-        assert (swap_handle.async_pread(buffer, path) == 0)
+    tensor_buffers, swap_paths = list(tensor_buffers), list(swap_paths)
+    assert (swap_handle.async_pread_batch(tensor_buffers, swap_paths, [0] * len(tensor_buffers)) == 0)
 
 
 def swap_out_tensors(swap_handle, tensor_buffers, swap_paths):
-    for buffer, path in zip(tensor_buffers, swap_paths):
-        assert (swap_handle.async_pwrite(buffer, path) == 0)
+    tensor_buffers, swap_paths = list(tensor_buffers), list(swap_paths)
+    assert (swap_handle.async_pwrite_batch(tensor_buffers, swap_paths, [0] * len(tensor_buffers)) == 0)
 
 
 def print_object(obj, name, exclude_list=[]):
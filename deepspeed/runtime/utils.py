@@ -920,6 +920,51 @@ def align_dense_tensors(tensor_list, alignment):
     return padded_tensor_list
 
 
+class PersistentFlatBuffers:
+    """Flat buffers reused by every flatten of a bucket instead of one allocation and copy per call.
+
+    There is one buffer per dtype and device, grown to the largest bucket seen, so repeated
+    reductions of the same buckets do not churn the allocator. Tensors handed to :meth:`flatten`
+    are copied in with a single batched copy, :meth:`unflatten_into` copies the result back.
+    :meth:`bind` instead moves tensors into a buffer of their own for good, rebinding their
+    ``.data`` as views so later flattens need no copy at all.
+
+    A buffer is only valid until the next :meth:`flatten` of the same dtype and device, and must
+    be used on the stream that flattened it.
+    """
+
+    def __init__(self, util_ops):
+        self.util_ops = util_ops
+        self._buffers = {}
+
+    def flatten(self, tensors):
+        numel = sum(t.numel() for t in tensors)
+        key = (tensors[0].dtype, tensors[0].device)
+        buffer = self._buffers.get(key)
+        if buffer is None or buffer.numel() < numel:
+            buffer = torch.empty(numel, dtype=tensors[0].dtype, device=tensors[0].device)
+            self._buffers[key] = buffer
+        flat = buffer.narrow(0, 0, numel)
+        self.util_ops.flatten_into(flat, tensors)
+        return flat
+
+    def unflatten_into(self, flat, tensors):
+        self.util_ops.unflatten_into(flat, tensors)
+
+    def bind(self, tensors):
+        """Returns a new flat buffer holding ``tensors``, which become views into it."""
+        flat = torch.empty(sum(t.numel() for t in tensors), dtype=tensors[0].dtype, device=tensors[0].device)
+        self.util_ops.flatten_into(flat, tensors)
+        offset = 0
+        for t in tensors:
+            t.data = flat.narrow(0, offset, t.numel()).view_as(t)
+            offset += t.numel()
+        return flat
+
+    def release(self):
+        self._buffers.clear()
+
+
 def all_gather_dp_groups(partitioned_param_groups, dp_process_group, start_alignment_factor, allgather_bucket_size):
     for group_id, partitioned_params in enumerate(partitioned_param_groups):
         # Sequential AllGather Best of both worlds
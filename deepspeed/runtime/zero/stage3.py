@@ -12,7 +12,7 @@ from deepspeed.runtime import ZeROOptimizer
 from deepspeed.utils import logger
 from deepspeed.runtime.fp16.loss_scaler import CreateLossScaler
 from deepspeed.runtime.comm.coalesced_collectives import reduce_scatter_coalesced
-from deepspeed.runtime.utils import inf, get_global_norm, is_model_parallel_parameter
+from deepspeed.runtime.utils import inf, get_global_norm, is_model_parallel_parameter, PersistentFlatBuffers
 from deepspeed.runtime.zero.partition_parameters import *
 from deepspeed.runtime.zero.config import ZeroStageEnum
 from deepspeed.runtime.zero.offload_config import OffloadDeviceEnum
@@ -130,6 +130,8 @@ class DeepSpeedZeroOptimizer_Stage3(ZeROOptimizer):
         util_ops = UtilsBuilder().load()
         self.flatten = util_ops.flatten
         self.unflatten = util_ops.unflatten
+        # Reused by the gradient bucket reductions, which flatten buckets of the same size every step
+        self.flat_buffers = PersistentFlatBuffers(util_ops)
         self.dtype = self.optimizer.param_groups[0]['params'][0].dtype
         self._global_grad_norm = 0.
 
@@ -1291,7 +1293,7 @@ class DeepSpeedZeroOptimizer_Stage3(ZeROOptimizer):
 
     def allreduce_bucket(self, bucket, rank=None, log=None):
         rank = None
-        tensor = self.flatten(bucket)
+        tensor = self.flat_buffers.flatten(bucket)
 
         tensor_to_allreduce = tensor
 
@@ -1323,8 +1325,7 @@ class DeepSpeedZeroOptimizer_Stage3(ZeROOptimizer):
         with get_accelerator().stream(self.reduction_stream):
             allreduced = self.allreduce_bucket(small_bucket, rank=rank, log=log)
             if rank is None or rank == dist.get_rank(group=self.dp_process_group):
-                for buf, synced in zip(small_bucket, self.unflatten(allreduced, small_bucket)):
-                    buf.copy_(synced)
+                self.flat_buffers.unflatten_into(allreduced, small_bucket)
 
     def allreduce_no_retain(self, bucket, numel_per_bucket=500000000, rank=None, log=None):
         small_bucket = []
@@ -12,7 +12,8 @@ from collections import OrderedDict
 from deepspeed.runtime import ZeROOptimizer
 from deepspeed.runtime.fp16.loss_scaler import CreateLossScaler
 from deepspeed.runtime.utils import (bwc_tensor_model_parallel_rank, get_global_norm, empty_cache, see_memory_usage,
-                                     inf, is_model_parallel_parameter, align_dense_tensors, all_gather_dp_groups)
+                                     inf, is_model_parallel_parameter, align_dense_tensors, all_gather_dp_groups,
+                                     PersistentFlatBuffers)
 
 from deepspeed.runtime.zero.config import ZeroStageEnum
 from deepspeed.runtime.zero.offload_config import OffloadDeviceEnum
@@ -154,6 +155,8 @@ class DeepSpeedZeroOptimizer(ZeROOptimizer):
         util_ops = UtilsBuilder().load()
         self.flatten = util_ops.flatten
         self.unflatten = util_ops.unflatten
+        # Reused by the gradient bucket reductions, which flatten buckets of the same size every step
+        self.flat_buffers = PersistentFlatBuffers(util_ops)
 
         # ZeRO stage 1 (False) or 2 (True)
         self.partition_gradients = partition_grads
@@ -1315,7 +1318,7 @@ class DeepSpeedZeroOptimizer(ZeROOptimizer):
     ######################Reduction Related Methods##############################
     def allreduce_bucket(self, bucket, rank=None, log=None):
         rank = None
-        tensor = self.flatten(bucket)
+        tensor = self.flat_buffers.flatten(bucket)
 
         tensor_to_allreduce = tensor
 
@@ -1361,8 +1364,7 @@ class DeepSpeedZeroOptimizer(ZeROOptimizer):
         with get_accelerator().stream(stream):
             allreduced = self.allreduce_bucket(small_bucket, rank=rank, log=log)
             if rank is None or rank == dist.get_rank(group=self.dp_process_group):
-                for buf, synced in zip(small_bucket, self.unflatten(allreduced, small_bucket)):
-                    buf.copy_(synced)
+                self.flat_buffers.unflatten_into(allreduced, small_bucket)
 
     def allreduce_no_retain(self, bucket, numel_per_bucket=500000000, rank=None, log=None):
         small_bucket = []
@@ -4,6 +4,7 @@
 # DeepSpeed Team
 
 import distutils.spawn
+import os
 import subprocess
 
 from .builder import OpBuilder
@@ -25,17 +26,22 @@ class AsyncIOBuilder(OpBuilder):
             'csrc/aio/py_lib/deepspeed_py_aio.cpp', 'csrc/aio/py_lib/deepspeed_py_aio_handle.cpp',
             'csrc/aio/py_lib/deepspeed_aio_thread.cpp', 'csrc/aio/common/deepspeed_aio_utils.cpp',
             'csrc/aio/common/deepspeed_aio_common.cpp', 'csrc/aio/common/deepspeed_aio_types.cpp',
-            'csrc/aio/py_lib/deepspeed_pin_tensor.cpp'
+            'csrc/aio/py_lib/deepspeed_pin_tensor.cpp', 'csrc/aio/common/deepspeed_aio_uring.cpp',
+            'csrc/aio/py_lib/deepspeed_swap_arena.cpp', 'csrc/aio/common/deepspeed_aio_gds.cpp',
+            'csrc/aio/py_lib/deepspeed_aio_codec.cpp'
         ]
 
     def include_paths(self):
-        return ['csrc/aio/py_lib', 'csrc/aio/common']
+        paths = ['csrc/aio/py_lib', 'csrc/aio/common', 'csrc/includes']
+        if self.has_cudart():
+            paths.append(os.path.join(self._gds_cuda_home(), 'include'))
+        return paths
 
     def cxx_args(self):
         # -O0 for improved debugging, since performance is bound by I/O
         CPU_ARCH = self.cpu_arch()
         SIMD_WIDTH = self.simd_width()
-        return [
+        args = [
             '-g',
             '-Wall',
             '-O0',
@@ -48,9 +54,56 @@ class AsyncIOBuilder(OpBuilder):
             SIMD_WIDTH,
             '-laio',
         ]
+        if self.has_io_uring():
+            args.append('-DDS_AIO_IO_URING')
+        if self.has_gds():
+            args.append('-DDS_AIO_GDS')
+        if self.has_cudart():
+            args.append('-DDS_AIO_CUDART')
+        return args
 
     def extra_ldflags(self):
-        return ['-laio']
+        flags = ['-laio']
+        if self.has_io_uring():
+            flags.append('-luring')
+        if self.has_cudart():
+            flags += [f"-L{os.path.join(self._gds_cuda_home(), 'lib64')}", '-lcudart']
+        if self.has_gds():
+            flags.append('-lcufile')
+        return flags
+
+    def has_io_uring(self):
+        # liburing is optional, handles fall back to libaio when it is missing.
+        if not hasattr(self, '_has_io_uring'):
+            self._has_io_uring = self.has_function('io_uring_queue_init', ('uring', ))
+        return self._has_io_uring
+
+    def _gds_cuda_home(self):
+        try:
+            from torch.utils.cpp_extension import CUDA_HOME
+        except ImportError:
+            return None
+        return CUDA_HOME
+
+    def has_gds(self):
+        # GPUDirect Storage ships libcufile with the CUDA toolkit, handles fall back to staging
+        # device tensors through host memory when it is missing.
+        if not hasattr(self, '_has_gds'):
+            cuda_home = self._gds_cuda_home()
+            self._has_gds = self.has_cudart() and \
+                os.path.isfile(os.path.join(cuda_home, 'include', 'cufile.h')) and \
+                os.path.isfile(os.path.join(cuda_home, 'lib64', 'libcufile.so'))
+        return self._has_gds
+
+    def has_cudart(self):
+        # The CUDA runtime lets the pinned tensor pool cudaHostRegister its blocks, and is
+        # required by GPUDirect Storage.
+        if not hasattr(self, '_has_cudart'):
+            cuda_home = self._gds_cuda_home()
+            self._has_cudart = cuda_home is not None and \
+                os.path.isfile(os.path.join(cuda_home, 'include', 'cuda_runtime.h')) and \
+                os.path.isfile(os.path.join(cuda_home, 'lib64', 'libcudart.so'))
+        return self._has_cudart
 
     def check_for_libaio_pkg(self):
         libs = dict(
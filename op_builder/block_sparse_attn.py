@@ -0,0 +1,45 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+from .builder import CUDAOpBuilder
+
+
+class BlockSparseAttnBuilder(CUDAOpBuilder):
+    BUILD_VAR = "DS_BUILD_BLOCK_SPARSE_ATTN"
+    NAME = "block_sparse_attn"
+
+    def __init__(self, name=None):
+        name = self.NAME if name is None else name
+        super().__init__(name=name)
+
+    def absolute_name(self):
+        return f'deepspeed.ops.sparse_attention.{self.NAME}_op'
+
+    def is_compatible(self, verbose=True):
+        if self.is_rocm_pytorch():
+            self.warning(f'{self.NAME} is not compatible with ROCM')
+            return False
+
+        try:
+            import torch
+        except ImportError:
+            self.warning(f"unable to import torch, please install it first")
+            return False
+
+        # bf16 support comes from cuda_bf16.h, available from CUDA 11
+        cuda_okay = True
+        if torch.version.cuda is None:
+            cuda_okay = False
+            self.warning(f"{self.NAME} cuda is not available from torch")
+        elif int(torch.version.cuda.split('.')[0]) < 11:
+            cuda_okay = False
+            self.warning(f"{self.NAME} requires CUDA version 11+")
+        return super().is_compatible(verbose) and cuda_okay
+
+    def sources(self):
+        return ['csrc/sparse_attention/pt_binding.cpp', 'csrc/sparse_attention/block_sparse_kernels.cu']
+
+    def include_paths(self):
+        return ['csrc/includes']
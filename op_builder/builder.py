@@ -5,6 +5,7 @@
 
 import os
 import sys
+import platform
 import time
 import importlib
 from pathlib import Path
@@ -690,9 +691,14 @@ class TorchCPUOpBuilder(CUDAOpBuilder):
                 '-g',
             ]
 
+        CUDA_ENABLE = self.is_cuda_enable()
+        if self.simd_dispatch():
+            # Baseline ISA for everything but the per-ISA kernel sources, see simd.h.
+            args += ['-fopenmp', '-D__DS_SIMD_DISPATCH__', CUDA_ENABLE]
+            return args
+
         CPU_ARCH = self.cpu_arch()
         SIMD_WIDTH = self.simd_width()
-        CUDA_ENABLE = self.is_cuda_enable()
         args += [
             CPU_ARCH,
             '-fopenmp',
@@ -701,3 +707,12 @@ class TorchCPUOpBuilder(CUDAOpBuilder):
         ]
 
         return args
+
+    def simd_dispatch(self):
+        """Compile the SIMD kernels for every x86 ISA and select one at runtime instead of building for the
+        host CPU. On by default for prebuilt ops, which may be loaded on other CPUs than the build machine,
+        and controlled by DS_BUILD_SIMD_DISPATCH=0/1."""
+        if platform.machine() not in ('x86_64', 'AMD64') or sys.platform == "win32":
+            return False
+        default = '0' if self.jit_mode else '1'
+        return os.environ.get('DS_BUILD_SIMD_DISPATCH', default) == '1'
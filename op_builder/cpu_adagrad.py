@@ -18,10 +18,14 @@ class CPUAdagradBuilder(TorchCPUOpBuilder):
         return f'deepspeed.ops.adagrad.{self.NAME}_op'
 
     def sources(self):
+        # The per-ISA kernel sources are empty unless the op is built with SIMD dispatch.
+        sources = [
+            'csrc/adagrad/cpu_adagrad.cpp', 'csrc/adagrad/cpu_adagrad_avx512.cpp', 'csrc/adagrad/cpu_adagrad_avx2.cpp'
+        ]
         if self.build_for_cpu:
-            return ['csrc/adagrad/cpu_adagrad.cpp']
+            return sources
 
-        return ['csrc/adagrad/cpu_adagrad.cpp', 'csrc/common/custom_cuda_kernel.cu']
+        return sources + ['csrc/common/custom_cuda_kernel.cu']
 
     def libraries_args(self):
         args = super().libraries_args()
@@ -18,10 +18,12 @@ class CPUAdamBuilder(TorchCPUOpBuilder):
         return f'deepspeed.ops.adam.{self.NAME}_op'
 
     def sources(self):
+        # The per-ISA kernel sources are empty unless the op is built with SIMD dispatch.
+        sources = ['csrc/adam/cpu_adam.cpp', 'csrc/adam/cpu_adam_avx512.cpp', 'csrc/adam/cpu_adam_avx2.cpp']
         if self.build_for_cpu:
-            return ['csrc/adam/cpu_adam.cpp']
+            return sources
 
-        return ['csrc/adam/cpu_adam.cpp', 'csrc/common/custom_cuda_kernel.cu']
+        return sources + ['csrc/common/custom_cuda_kernel.cu', 'csrc/common/cpu_staging_ring.cpp']
 
     def libraries_args(self):
         args = super().libraries_args()
@@ -0,0 +1,49 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import os
+from .builder import TorchCPUOpBuilder
+
+
+class CPULambBuilder(TorchCPUOpBuilder):
+    BUILD_VAR = "DS_BUILD_CPU_LAMB"
+    NAME = "cpu_lamb"
+
+    def __init__(self):
+        super().__init__(name=self.NAME)
+
+    def absolute_name(self):
+        return f'deepspeed.ops.lamb.{self.NAME}_op'
+
+    def sources(self):
+        # The per-ISA kernel sources are empty unless the op is built with SIMD dispatch.
+        sources = ['csrc/lamb/cpu_lamb.cpp', 'csrc/lamb/cpu_lamb_avx512.cpp', 'csrc/lamb/cpu_lamb_avx2.cpp']
+        if self.build_for_cpu:
+            return sources
+
+        return sources + ['csrc/common/custom_cuda_kernel.cu', 'csrc/common/cpu_staging_ring.cpp']
+
+    def libraries_args(self):
+        args = super().libraries_args()
+        if self.build_for_cpu:
+            return args
+
+        if not self.is_rocm_pytorch():
+            args += ['curand']
+        return args
+
+    def include_paths(self):
+        import torch
+        if self.build_for_cpu:
+            CUDA_INCLUDE = []
+        elif not self.is_rocm_pytorch():
+            CUDA_INCLUDE = [os.path.join(torch.utils.cpp_extension.CUDA_HOME, "include")]
+        else:
+            CUDA_INCLUDE = [
+                os.path.join(torch.utils.cpp_extension.ROCM_HOME, "include"),
+                os.path.join(torch.utils.cpp_extension.ROCM_HOME, "include", "rocrand"),
+                os.path.join(torch.utils.cpp_extension.ROCM_HOME, "include", "hiprand"),
+            ]
+        return ['csrc/includes'] + CUDA_INCLUDE
@@ -19,7 +19,9 @@ class FusedAdamBuilder(CUDAOpBuilder):
         return f'deepspeed.ops.adam.{self.NAME}_op'
 
     def sources(self):
-        return ['csrc/adam/fused_adam_frontend.cpp', 'csrc/adam/multi_tensor_adam.cu']
+        return [
+            'csrc/adam/fused_adam_frontend.cpp', 'csrc/adam/multi_tensor_adam.cu', 'csrc/adam/onebit_compression.cu'
+        ]
 
     def include_paths(self):
         return ['csrc/includes', 'csrc/adam']
@@ -19,10 +19,10 @@ class FusedLambBuilder(CUDAOpBuilder):
         return f'deepspeed.ops.lamb.{self.NAME}_op'
 
     def sources(self):
-        return ['csrc/lamb/fused_lamb_cuda.cpp', 'csrc/lamb/fused_lamb_cuda_kernel.cu']
+        return ['csrc/lamb/fused_lamb_cuda.cpp', 'csrc/lamb/fused_lamb_cuda_kernel.cu', 'csrc/lamb/multi_tensor_lamb.cu']
 
     def include_paths(self):
-        return ['csrc/includes']
+        return ['csrc/includes', 'csrc/adam']
 
     def cxx_args(self):
         args = super().cxx_args()
@@ -0,0 +1,51 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+from .builder import CUDAOpBuilder
+
+
+class KernelBenchBuilder(CUDAOpBuilder):
+    """Microbenchmarks of the csrc kernels, see csrc/benchmarks/run_kernel_bench.py."""
+    BUILD_VAR = "DS_BUILD_KERNEL_BENCH"
+    NAME = "kernel_bench"
+
+    def __init__(self, name=None):
+        name = self.NAME if name is None else name
+        super().__init__(name=name)
+
+    def absolute_name(self):
+        return f'deepspeed.ops.{self.NAME}_op'
+
+    def is_compatible(self, verbose=True):
+        # Limited by the inference kernels it links
+        from .transformer_inference import InferenceBuilder
+        return InferenceBuilder().is_compatible(verbose) and super().is_compatible(verbose)
+
+    def sources(self):
+        return [
+            'csrc/benchmarks/kernel_bench.cpp',
+            'csrc/benchmarks/inference_bench.cpp',
+            'csrc/benchmarks/quantization_bench.cpp',
+            'csrc/benchmarks/adam_bench.cpp',
+            'csrc/transformer/inference/csrc/softmax.cu',
+            'csrc/transformer/inference/csrc/layer_norm.cu',
+            'csrc/transformer/inference/csrc/transform.cu',
+            'csrc/quantization/quantize.cu',
+            'csrc/adam/multi_tensor_adam.cu',
+        ]
+
+    def include_paths(self):
+        return ['csrc/benchmarks', 'csrc/transformer/inference/includes', 'csrc/includes', 'csrc/adam']
+
+    def cxx_args(self):
+        # The CPU Adam kernels are benchmarked for the ISA of the host
+        args = super().cxx_args() + self.version_dependent_macros()
+        return args + [self.cpu_arch(), self.simd_width(), '-fopenmp']
+
+    def nvcc_args(self):
+        return super().nvcc_args() + self.version_dependent_macros() + ['-lineinfo']
+
+    def extra_ldflags(self):
+        return ['-fopenmp']
@@ -38,6 +38,8 @@ class SpatialInferenceBuilder(CUDAOpBuilder):
     def sources(self):
         return [
             'csrc/spatial/csrc/opt_bias_add.cu',
+            'csrc/spatial/csrc/opt_group_norm.cu',
+            'csrc/spatial/csrc/opt_cross_attention.cu',
             'csrc/spatial/csrc/pt_binding.cpp',
         ]
 
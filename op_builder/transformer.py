@@ -19,7 +19,7 @@ class TransformerBuilder(CUDAOpBuilder):
 
     def extra_ldflags(self):
         if not self.is_rocm_pytorch():
-            return ['-lcurand']
+            return ['-lcurand', '-lcublasLt']
         else:
             return []
 
@@ -28,7 +28,8 @@ class TransformerBuilder(CUDAOpBuilder):
             'csrc/transformer/ds_transformer_cuda.cpp', 'csrc/transformer/cublas_wrappers.cu',
             'csrc/transformer/transform_kernels.cu', 'csrc/transformer/gelu_kernels.cu',
             'csrc/transformer/dropout_kernels.cu', 'csrc/transformer/normalize_kernels.cu',
-            'csrc/transformer/softmax_kernels.cu', 'csrc/transformer/general_kernels.cu'
+            'csrc/transformer/softmax_kernels.cu', 'csrc/transformer/general_kernels.cu',
+            'csrc/transformer/flash_attention_kernels.cu'
         ]
 
     def include_paths(self):
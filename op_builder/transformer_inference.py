@@ -56,15 +56,25 @@ class InferenceBuilder(CUDAOpBuilder):
             'csrc/transformer/inference/csrc/gelu.cu',
             'csrc/transformer/inference/csrc/relu.cu',
             'csrc/transformer/inference/csrc/layer_norm.cu',
+            'csrc/transformer/inference/csrc/rms_norm.cu',
             'csrc/transformer/inference/csrc/softmax.cu',
             'csrc/transformer/inference/csrc/dequantize.cu',
             'csrc/transformer/inference/csrc/apply_rotary_pos_emb.cu',
             'csrc/transformer/inference/csrc/transform.cu',
+            'csrc/transformer/inference/csrc/paged_attention.cu',
+            'csrc/transformer/inference/csrc/flash_attention.cu',
+            'csrc/transformer/inference/csrc/decode_attention.cu',
+            'csrc/transformer/inference/csrc/weight_only_gemm.cu',
+            'csrc/transformer/inference/csrc/ln_gemv.cu',
+            'csrc/transformer/inference/csrc/moe.cu',
+            'csrc/transformer/inference/csrc/fp8.cu',
+            'csrc/transformer/inference/csrc/sampling.cu',
+            'csrc/transformer/inference/csrc/lora.cu',
         ]
 
     def extra_ldflags(self):
         if not self.is_rocm_pytorch():
-            return ['-lcurand']
+            return ['-lcurand', '-lcublasLt']
         else:
             return []
 
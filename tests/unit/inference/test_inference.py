@@ -355,6 +355,47 @@ class TestMPSize(DistributedTest):
         assert assert_fn(bs_output, ds_output)
 
 
+@pytest.mark.inference
+@pytest.mark.parametrize("model_w_task", [("gpt2", "text-generation"), ("EleutherAI/gpt-neo-125M", "text-generation")],
+                         ids=["gpt2", "gpt-neo"])
+@pytest.mark.parametrize("kv_cache_block_size", [1, 16])
+@pytest.mark.parametrize("kv_cache_int8", [False, True], ids=["fp16_kv", "int8_kv"])
+class TestPagedKVCache(DistributedTest):
+    world_size = 1
+
+    def test(
+        self,
+        model_w_task,
+        kv_cache_block_size,
+        kv_cache_int8,
+        query,
+        inf_kwargs,
+        assert_fn,
+    ):
+        model, task = model_w_task
+        local_rank = int(os.getenv("LOCAL_RANK", "0"))
+        dtype = torch.half
+
+        pipe = pipeline(task, model=model, device=torch.device("cpu"), framework="pt")
+        pipe.model.half()
+        pipe.device = torch.device(get_accelerator().device_name(local_rank))
+        pipe.model.to(pipe.device)
+        bs_output = pipe(query, **inf_kwargs)
+
+        pipe.model = deepspeed.init_inference(pipe.model,
+                                              dtype=dtype,
+                                              replace_with_kernel_inject=True,
+                                              kv_cache_block_size=kv_cache_block_size,
+                                              kv_cache_blocks=256,
+                                              kv_cache_int8=kv_cache_int8)
+        check_injection(pipe.model)
+        ds_output = pipe(query, **inf_kwargs)
+
+        print(local_rank, "baseline", bs_output)
+        print(local_rank, "deepspeed", ds_output)
+        assert assert_fn(bs_output, ds_output)
+
+
 @pytest.mark.seq_inference
 @pytest.mark.parametrize(
     "model_w_task, injection_policy",
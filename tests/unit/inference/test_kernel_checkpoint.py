@@ -0,0 +1,46 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+from deepspeed.accelerator import get_accelerator
+from deepspeed.module_inject.kernel_checkpoint import (kernel_checkpoint_names, load_kernel_checkpoint,
+                                                        save_kernel_checkpoint)
+
+
+def make_module(device):
+    module = torch.nn.Sequential(torch.nn.Linear(300, 1000), torch.nn.LayerNorm(1000), torch.nn.Linear(1000, 7))
+    module.register_buffer("positions", torch.arange(12, dtype=torch.int32))
+    return module.half().to(device)
+
+
+@pytest.mark.inference
+@pytest.mark.parametrize("use_aio", [False, True], ids=["mmap", "aio"])
+@pytest.mark.parametrize("chunk_bytes", [4096, 64 * 1024 * 1024])
+def test_kernel_checkpoint_roundtrip(use_aio, chunk_bytes, tmpdir):
+    if use_aio:
+        import deepspeed
+        from deepspeed.ops.op_builder import AsyncIOBuilder
+        if not deepspeed.ops.__compatible_ops__[AsyncIOBuilder.NAME]:
+            pytest.skip("async_io is not compatible with this system")
+    device = get_accelerator().device_name()
+    saved = make_module(device)
+    saved[0].weight.scale = torch.rand(16, device=device)
+    save_kernel_checkpoint(saved, str(tmpdir), 0)
+
+    loaded = make_module("meta")
+    checkpoint_dict = {
+        "type": "ds_kernel",
+        "base_dir": str(tmpdir),
+        "checkpoints": {
+            "kernel": [kernel_checkpoint_names(0)[0]]
+        }
+    }
+    load_kernel_checkpoint(loaded, checkpoint_dict, 0, chunk_bytes=chunk_bytes, use_aio=use_aio)
+
+    for (name, expected), (_, actual) in zip(saved.state_dict().items(), loaded.state_dict().items()):
+        assert actual.device.type == expected.device.type, name
+        assert torch.equal(actual, expected), name
+    assert torch.equal(loaded[0].weight.scale, saved[0].weight.scale)
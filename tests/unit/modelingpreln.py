@@ -178,7 +178,13 @@ def swish(x):
     return x * torch.sigmoid(x)
 
 
-ACT2FN = {"gelu": gelu, "relu": torch.nn.functional.relu, "swish": swish}
+def swiglu(x):
+    # The second half of the channels gates the first one.
+    hidden, gate = x.chunk(2, dim=-1)
+    return hidden * swish(gate)
+
+
+ACT2FN = {"gelu": gelu, "relu": torch.nn.functional.relu, "swish": swish, "swiglu": swiglu}
 
 
 class GPUTimer:
@@ -11,6 +11,7 @@ import copy
 from torch import nn
 from deepspeed import DeepSpeedTransformerLayer, DeepSpeedTransformerConfig
 from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.transformer import TransformerRecomputePolicy, select_recompute_policy
 from unit.modeling import BertConfig, BertLayerNorm, BertEncoder as BertEncoderPostln
 from unit.modelingpreln import BertEncoder as BertEncoderPreln
 from unit.common import DistributedTest
@@ -155,7 +156,7 @@ def create_models(ds_config):
                              num_hidden_layers=ds_config.num_hidden_layers,
                              num_attention_heads=ds_config.heads,
                              intermediate_size=ds_config.intermediate_size,
-                             hidden_act="gelu",
+                             hidden_act="swiglu" if ds_config.swiglu else "gelu",
                              hidden_dropout_prob=ds_config.hidden_dropout_ratio,
                              attention_probs_dropout_prob=ds_config.attn_dropout_ratio,
                              max_position_embeddings=512,
@@ -171,7 +172,8 @@ def create_models(ds_config):
 
     weights.append(nn.Parameter(torch.Tensor(ds_config.hidden_size)))
     weights[4].data.fill_(1.0)
-    weights.append(nn.Parameter(torch.Tensor(ds_config.intermediate_size, ds_config.hidden_size)))
+    ff1_size = ds_config.intermediate_size * (2 if ds_config.swiglu else 1)
+    weights.append(nn.Parameter(torch.Tensor(ff1_size, ds_config.hidden_size)))
     weights[5].data.normal_(mean=0.0, std=ds_config.initializer_range)
     weights.append(nn.Parameter(torch.Tensor(ds_config.hidden_size, ds_config.intermediate_size)))
     weights[6].data.normal_(mean=0.0, std=ds_config.initializer_range)
@@ -183,7 +185,7 @@ def create_models(ds_config):
     for i in range(4):
         biases.append(nn.Parameter(torch.Tensor(ds_config.hidden_size)))
         biases[i + 1].data.zero_()
-    biases.append(nn.Parameter(torch.Tensor(ds_config.intermediate_size)))
+    biases.append(nn.Parameter(torch.Tensor(ff1_size)))
     biases[5].data.zero_()
     biases.append(nn.Parameter(torch.Tensor(ds_config.hidden_size)))
     biases[6].data.zero_()
@@ -317,3 +319,175 @@ class TestCUDABackward(DistributedTest):
     #    ds_config.stochastic_mode = True
     #
     #    run_backward(ds_config, atol=atol)
+
+
+@pytest.mark.parametrize('batch_size, hidden_size, seq_len, heads, num_layers, is_preln, use_fp16, atol',
+                         [
+                             (8,160,128,2,3,True,True, 0.1),
+                             (8,1024,128,16,3,True,True, 0.05),
+                             (8,160,120,2,3,False,True, 0.2),
+                             (8,160,128,2,3,True,False, 0.05),
+                         ]) # yapf: disable
+class TestCUDABackwardFlash(DistributedTest):
+    world_size = 1
+
+    def test_backward_flash(self, batch_size, hidden_size, seq_len, heads, num_layers, is_preln, use_fp16, atol):
+        if not get_accelerator().is_fp16_supported() and (use_fp16 is True or is_preln is False):
+            return
+
+        ds_config = DeepSpeedTransformerConfig()
+        ds_config.layer_id = None
+        ds_config.batch_size = batch_size
+        ds_config.hidden_size = hidden_size
+        ds_config.intermediate_size = hidden_size
+        ds_config.heads = heads
+        ds_config.attn_dropout_ratio = 0.0
+        ds_config.hidden_dropout_ratio = 0.0
+        ds_config.num_hidden_layers = num_layers
+        ds_config.pre_layer_norm = is_preln
+        ds_config.initializer_range = 0.02
+        ds_config.fp16 = use_fp16
+        ds_config.flash_attention = True
+
+        run_backward(ds_config, seq_len, atol=atol, verbose=True)
+
+
+@pytest.mark.parametrize('batch_size, hidden_size, seq_len, heads, num_layers, is_preln, use_fp16, atol',
+                         [
+                             (8,160,128,2,3,True,True, 0.1),
+                             (8,160,128,2,3,False,True, 0.2),
+                             (8,160,128,2,3,True,False, 0.05),
+                         ]) # yapf: disable
+class TestCUDABackwardStatelessDropout(DistributedTest):
+    world_size = 1
+
+    def test_backward_stateless_dropout(self, batch_size, hidden_size, seq_len, heads, num_layers, is_preln, use_fp16,
+                                        atol):
+        if not get_accelerator().is_fp16_supported() and (use_fp16 is True or is_preln is False):
+            return
+
+        ds_config = DeepSpeedTransformerConfig()
+        ds_config.layer_id = None
+        ds_config.batch_size = batch_size
+        ds_config.hidden_size = hidden_size
+        ds_config.intermediate_size = hidden_size
+        ds_config.heads = heads
+        ds_config.attn_dropout_ratio = 0.0
+        ds_config.hidden_dropout_ratio = 0.0
+        ds_config.num_hidden_layers = num_layers
+        ds_config.pre_layer_norm = is_preln
+        ds_config.initializer_range = 0.02
+        ds_config.fp16 = use_fp16
+        ds_config.stateless_dropout = True
+
+        run_backward(ds_config, seq_len, atol=atol, verbose=True)
+
+
+@pytest.mark.parametrize('batch_size, hidden_size, seq_len, heads, num_layers, is_preln, use_fp16, atol',
+                         [
+                             (8,160,128,2,3,True,True, 0.1),
+                             (8,160,128,2,3,False,True, 0.2),
+                             (8,160,128,2,3,True,False, 0.05),
+                         ]) # yapf: disable
+class TestCUDABackwardGemmEpilogues(DistributedTest):
+    world_size = 1
+
+    def test_backward_gemm_epilogues(self, batch_size, hidden_size, seq_len, heads, num_layers, is_preln, use_fp16,
+                                     atol):
+        if not get_accelerator().is_fp16_supported() and (use_fp16 is True or is_preln is False):
+            return
+
+        ds_config = DeepSpeedTransformerConfig()
+        ds_config.layer_id = None
+        ds_config.batch_size = batch_size
+        ds_config.hidden_size = hidden_size
+        ds_config.intermediate_size = 4 * hidden_size
+        ds_config.heads = heads
+        ds_config.attn_dropout_ratio = 0.0
+        ds_config.hidden_dropout_ratio = 0.0
+        ds_config.num_hidden_layers = num_layers
+        ds_config.pre_layer_norm = is_preln
+        ds_config.initializer_range = 0.02
+        ds_config.fp16 = use_fp16
+        ds_config.gemm_epilogues = True
+
+        run_backward(ds_config, seq_len, atol=atol, verbose=True)
+
+
+@pytest.mark.parametrize('batch_size, hidden_size, seq_len, heads, num_layers, is_preln, use_fp16, atol',
+                         [
+                             (8,160,128,2,3,True,True, 0.1),
+                             (8,160,128,2,3,False,True, 0.2),
+                             (8,160,128,2,3,True,False, 0.05),
+                         ]) # yapf: disable
+class TestCUDABackwardSwiglu(DistributedTest):
+    world_size = 1
+
+    def test_backward_swiglu(self, batch_size, hidden_size, seq_len, heads, num_layers, is_preln, use_fp16, atol):
+        if not get_accelerator().is_fp16_supported() and (use_fp16 is True or is_preln is False):
+            return
+
+        ds_config = DeepSpeedTransformerConfig()
+        ds_config.layer_id = None
+        ds_config.batch_size = batch_size
+        ds_config.hidden_size = hidden_size
+        ds_config.intermediate_size = 4 * hidden_size
+        ds_config.heads = heads
+        ds_config.attn_dropout_ratio = 0.0
+        ds_config.hidden_dropout_ratio = 0.0
+        ds_config.num_hidden_layers = num_layers
+        ds_config.pre_layer_norm = is_preln
+        ds_config.initializer_range = 0.02
+        ds_config.fp16 = use_fp16
+        ds_config.swiglu = True
+
+        run_backward(ds_config, seq_len, atol=atol, verbose=True)
+
+
+@pytest.mark.parametrize('batch_size, hidden_size, seq_len, heads, num_layers, is_preln, use_fp16, atol',
+                         [
+                             (8,160,128,2,3,True,True, 0.1),
+                             (8,160,128,2,3,False,True, 0.2),
+                             (8,160,128,2,3,True,False, 0.05),
+                         ]) # yapf: disable
+@pytest.mark.parametrize('policy', [
+    TransformerRecomputePolicy(qkv=True),
+    TransformerRecomputePolicy(softmax=True, ctx=True),
+    TransformerRecomputePolicy(ff1_output=True),
+    TransformerRecomputePolicy(ff1_output=True, gelu_output=True),
+])
+class TestCUDABackwardRecompute(DistributedTest):
+    world_size = 1
+
+    def test_backward_recompute(self, batch_size, hidden_size, seq_len, heads, num_layers, is_preln, use_fp16, atol,
+                                policy):
+        if not get_accelerator().is_fp16_supported() and (use_fp16 is True or is_preln is False):
+            return
+
+        ds_config = DeepSpeedTransformerConfig()
+        ds_config.layer_id = None
+        ds_config.batch_size = batch_size
+        ds_config.hidden_size = hidden_size
+        ds_config.intermediate_size = hidden_size
+        ds_config.heads = heads
+        ds_config.attn_dropout_ratio = 0.0
+        ds_config.hidden_dropout_ratio = 0.0
+        ds_config.num_hidden_layers = num_layers
+        ds_config.pre_layer_norm = is_preln
+        ds_config.initializer_range = 0.02
+        ds_config.fp16 = use_fp16
+        policy.apply(ds_config)
+
+        run_backward(ds_config, seq_len, atol=atol, verbose=True)
+
+
+def test_select_recompute_policy():
+    config = DeepSpeedTransformerConfig(hidden_size=1024, heads=16, fp16=True)
+    keep_all = TransformerRecomputePolicy()
+    full = select_recompute_policy(config, 8, 512, 1 << 40)
+    assert full == keep_all
+
+    # A budget between the two extremes recomputes something, but not everything.
+    tight = select_recompute_policy(config, 8, 512, 150 << 20)
+    assert tight is not None and tight != keep_all and not tight.qkv
+    assert select_recompute_policy(config, 8, 512, 1 << 20) is None
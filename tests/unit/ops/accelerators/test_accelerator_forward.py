@@ -307,3 +307,53 @@ class TestCUDAForwardStochastic(DistributedTest):
         ds_config.stochastic_mode = True
 
         run_forward(ds_config, seq_len, atol=7e-2)
+
+
+def run_forward_packed(ds_config, seq_lens, atol=1e-2):
+    set_seed(123)
+    _, ds_encoder = create_models(ds_config)
+    layer = ds_encoder.layer[0]
+
+    kwargs = kwargs_fp16 if ds_config.fp16 else kwargs_fp32
+    seq_len = (max(seq_lens) + 15) // 16 * 16
+    hidden_states = torch.randn(len(seq_lens), seq_len, ds_config.hidden_size, **kwargs)
+    input_mask = torch.zeros(len(seq_lens), 1, 1, seq_len, dtype=kwargs['dtype'], device=device)
+    for b, length in enumerate(seq_lens):
+        input_mask[b, ..., length:] = -10000
+
+    padded = layer(hidden_states, input_mask)
+
+    packed_states = torch.cat([hidden_states[b, :length] for b, length in enumerate(seq_lens)])
+    cu_seqlens = torch.tensor([0] + list(np.cumsum(seq_lens)), dtype=torch.int32, device=device)
+    packed = layer(packed_states, cu_seqlens=cu_seqlens, max_seqlen=max(seq_lens))
+
+    expected = torch.cat([padded[b, :length] for b, length in enumerate(seq_lens)])
+    check_equal([[expected]], [[packed]], atol=atol)
+
+
+@pytest.mark.parametrize('seq_lens, is_preln, use_fp16', [
+    ([128, 77, 5, 100], True, True),
+    ([64, 31, 64, 1], False, True),
+    ([50, 128, 9, 33], True, False),
+])
+class TestCUDAForwardPacked(DistributedTest):
+    world_size = 1
+
+    def test_forward_packed(self, seq_lens, is_preln, use_fp16):
+        if not get_accelerator().is_fp16_supported() and use_fp16 is True:
+            return
+
+        ds_config = DeepSpeedTransformerConfig()
+        ds_config.layer_id = None
+        ds_config.batch_size = len(seq_lens)
+        ds_config.hidden_size = 1024
+        ds_config.intermediate_size = 4 * 1024
+        ds_config.heads = 16
+        ds_config.attn_dropout_ratio = 0.0
+        ds_config.hidden_dropout_ratio = 0.0
+        ds_config.num_hidden_layers = 1
+        ds_config.pre_layer_norm = is_preln
+        ds_config.initializer_range = 0.02
+        ds_config.fp16 = use_fp16
+
+        run_forward_packed(ds_config, seq_lens, atol=3e-2)
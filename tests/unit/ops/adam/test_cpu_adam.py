@@ -3,6 +3,7 @@
 
 # DeepSpeed Team
 
+import os
 import torch
 import numpy as np
 import pytest
@@ -112,6 +113,199 @@ class TestCPUAdam(DistributedTest):
                                 optimizer2=ref_optimizer)
 
 
+class TestCPUAdamMultiTensor(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    @pytest.mark.parametrize('dtype', [torch.bfloat16, torch.float], ids=["bf16", "fp32"])
+    def test_multi_tensor_equal(self, dtype):
+        from deepspeed.ops.adam import DeepSpeedCPUAdam
+
+        model_sizes = [22, 64 * 1024, 64 * 1024 + 129, 3, 1048576 + 7]
+        cpu_params = [torch.nn.Parameter(torch.randn(size).to(dtype)) for size in model_sizes]
+        ref_params = [torch.nn.Parameter(p.data.clone()) for p in cpu_params]
+        cpu_optimizer = DeepSpeedCPUAdam(cpu_params)
+        ref_optimizer = DeepSpeedCPUAdam(ref_params)
+
+        for _ in range(3):
+            for cpu_param, ref_param in zip(cpu_params, ref_params):
+                cpu_param.grad = torch.randn(cpu_param.numel()).to(dtype)
+                ref_param.grad = cpu_param.grad.clone()
+            cpu_optimizer.step()
+            for ref_param in ref_params:
+                state = ref_optimizer.state[ref_param]
+                if len(state) == 0:
+                    state['step'] = 0
+                    state['exp_avg'] = torch.zeros_like(ref_param.data, dtype=torch.float)
+                    state['exp_avg_sq'] = torch.zeros_like(ref_param.data, dtype=torch.float)
+                state['step'] += 1
+                group = ref_optimizer.param_groups[0]
+                ref_optimizer.ds_opt_adam.adam_update(ref_optimizer.opt_id, state['step'], group['lr'],
+                                                      group['betas'][0], group['betas'][1], group['eps'],
+                                                      group['weight_decay'], group['bias_correction'], ref_param.data,
+                                                      ref_param.grad.data, state['exp_avg'], state['exp_avg_sq'])
+
+        for cpu_param, ref_param in zip(cpu_params, ref_params):
+            check_equal(cpu_param.data.float(), ref_param.data.float(), atol=1e-6)
+
+
+class TestCPUAdamBF16(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    @pytest.mark.parametrize('model_size', [22, 128, 1048576 + 3])
+    def test_bf16_grads_equal(self, model_size):
+        from deepspeed.ops.adam import DeepSpeedCPUAdam
+
+        cpu_data = torch.randn(model_size)
+        bf16_param = torch.nn.Parameter(cpu_data.clone())
+        ref_param = torch.nn.Parameter(cpu_data.clone())
+        bf16_optimizer = DeepSpeedCPUAdam([bf16_param])
+        ref_optimizer = DeepSpeedCPUAdam([ref_param])
+
+        for _ in range(10):
+            bf16_param.grad = torch.randn(model_size, dtype=torch.bfloat16)
+            ref_param.grad = bf16_param.grad.float()
+            bf16_optimizer.step()
+            ref_optimizer.step()
+
+        check_equal(bf16_param.data, ref_param.data, atol=1e-6)
+
+    @pytest.mark.parametrize('model_size', [22, 128, 1048576 + 3])
+    def test_bf16_params_equal(self, model_size):
+        from deepspeed.ops.adam import DeepSpeedCPUAdam
+
+        cpu_data = torch.randn(model_size).bfloat16()
+        cpu_param = torch.nn.Parameter(cpu_data)
+        ref_param = torch.nn.Parameter(cpu_data.float())
+        cpu_optimizer = DeepSpeedCPUAdam([cpu_param])
+        ref_optimizer = torch.optim.AdamW([ref_param])
+
+        _compare_optimizers(model_size=model_size,
+                            param1=cpu_param,
+                            optimizer1=cpu_optimizer,
+                            param2=ref_param,
+                            optimizer2=ref_optimizer)
+
+
+class TestCPUAdamNUMA(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    def test_numa_aware_equal(self):
+        from deepspeed.ops.adam import DeepSpeedCPUAdam
+
+        model_size = 1048576 + 3
+        cpu_data = torch.randn(model_size)
+        numa_param = torch.nn.Parameter(cpu_data.clone())
+        ref_param = torch.nn.Parameter(cpu_data.clone())
+        numa_optimizer = DeepSpeedCPUAdam([numa_param], numa_aware=True)
+        ref_optimizer = DeepSpeedCPUAdam([ref_param])
+
+        for _ in range(3):
+            numa_param.grad = torch.randn(model_size)
+            ref_param.grad = numa_param.grad.clone()
+            numa_optimizer.step()
+            ref_optimizer.step()
+
+        check_equal(numa_param.data, ref_param.data, atol=1e-6)
+
+    @pytest.mark.parametrize('copy', [False, True])
+    def test_numa_zero_copy_tile(self, copy):
+        from deepspeed.ops.adam import DeepSpeedCPUAdam
+
+        # A copy tile that is not a whole number of vectors, with a partial last tile and a scalar tail.
+        optimizer = DeepSpeedCPUAdam([torch.nn.Parameter(torch.randn(8))], numa_aware=True, copy_tile_numel=1000)
+        state = torch.full((10000 + 3, ), float('nan'))
+        optimizer.ds_opt_adam.numa_zero(optimizer.opt_id, state, copy)
+        assert torch.count_nonzero(state).item() == 0
+
+    @pytest.mark.skipif(not hasattr(os, 'sched_getaffinity'), reason="needs sched_getaffinity")
+    def test_numa_aware_keeps_caller_affinity(self):
+        from deepspeed.ops.adam import DeepSpeedCPUAdam
+
+        affinity = os.sched_getaffinity(0)
+        param = torch.nn.Parameter(torch.randn(1024))
+        optimizer = DeepSpeedCPUAdam([param], numa_aware=True)
+        param.grad = torch.randn(1024)
+        optimizer.step()
+        assert os.sched_getaffinity(0) == affinity
+
+
+class TestCPUAdamCopyPipeline(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    @pytest.mark.skipif(not get_accelerator().is_available(), reason="only supported in CUDA environments.")
+    @pytest.mark.parametrize('copy_pipeline_depth', [1, 2, 4])
+    def test_param_copy_equal(self, copy_pipeline_depth):
+        from deepspeed.ops.adam import DeepSpeedCPUAdam
+
+        model_size = 1048576 + 3
+        cpu_param = torch.nn.Parameter(torch.randn(model_size))
+        device_param = cpu_param.data.half().to(get_accelerator().device_name())
+        optimizer = DeepSpeedCPUAdam([cpu_param],
+                                     copy_pipeline_depth=copy_pipeline_depth,
+                                     copy_tile_numel=64 * 1024)
+
+        for _ in range(3):
+            cpu_param.grad = torch.randn(model_size)
+            optimizer.step(fp16_param_groups=[device_param])
+
+        check_equal(device_param.float().cpu(), cpu_param.data.half().float(), atol=1e-3)
+
+
+class TestCPUAdamQuantizedState(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    @pytest.mark.parametrize('model_size', [4096, 65536 + 5])
+    def test_torch_adamw_close(self, model_size):
+        from deepspeed.ops.adam import DeepSpeedCPUAdam
+
+        cpu_data = torch.randn(model_size)
+        quantized_param = torch.nn.Parameter(cpu_data.clone())
+        ref_param = torch.nn.Parameter(cpu_data.clone())
+        optimizer = DeepSpeedCPUAdam([quantized_param], weight_decay=0.01, quantized_state=True)
+        ref_optimizer = torch.optim.AdamW([ref_param], weight_decay=0.01)
+
+        for _ in range(10):
+            quantized_param.grad = torch.randn(model_size)
+            ref_param.grad = quantized_param.grad.clone()
+            optimizer.step()
+            ref_optimizer.step()
+
+        state = optimizer.state[quantized_param]
+        assert state['exp_avg'].dtype == torch.uint8 and state['exp_avg_sq'].dtype == torch.uint8
+        check_equal(quantized_param.data, ref_param.data, atol=1e-2)
+
+    def test_small_params_stay_fp32(self):
+        from deepspeed.ops.adam import DeepSpeedCPUAdam
+
+        param = torch.nn.Parameter(torch.randn(1024))
+        optimizer = DeepSpeedCPUAdam([param], quantized_state=True)
+        param.grad = torch.randn(1024)
+        optimizer.step()
+
+        assert optimizer.state[param]['exp_avg'].dtype == torch.float
+        assert 'state_absmax' not in optimizer.state[param]
+
+
 class TestCPUAdamGPUError(DistributedTest):
 
     def test_cpu_adam_gpu_error(self):
@@ -124,3 +318,50 @@ class TestCPUAdamGPUError(DistributedTest):
         param.grad = torch.randn(model_size, device=device)
         with pytest.raises(AssertionError):
             optimizer.step()
+
+
+class TestStreamingCPUAdam(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    # A tail of 37 elements pads the last read and write to the aio alignment
+    @pytest.mark.parametrize('tail', [0, 37])
+    @pytest.mark.parametrize('num_chunks', [1, 2, 5])
+    def test_swapped_equal(self, tmpdir, num_chunks, tail):
+        from deepspeed.ops.op_builder import AsyncIOBuilder
+        if not deepspeed.ops.__compatible_ops__[AsyncIOBuilder.NAME]:
+            pytest.skip("async-io is not compatible")
+
+        from deepspeed.ops.adam import DeepSpeedCPUAdam
+        from deepspeed.runtime.swap_tensor.streaming_adam import StreamingCPUAdam, STREAMING_STATE_KEYS
+
+        chunk_numel = 1024
+        model_size = chunk_numel * (num_chunks - 1) + (tail or chunk_numel)
+        ref_param = torch.nn.Parameter(torch.randn(model_size))
+        ref_optimizer = DeepSpeedCPUAdam([ref_param])
+
+        swap_optimizer = DeepSpeedCPUAdam([torch.nn.Parameter(torch.zeros(1))])
+        aio_handle = AsyncIOBuilder().load().aio_handle(1024**2, 8, False, True, 2)
+        streaming_adam = StreamingCPUAdam(swap_optimizer, aio_handle, chunk_numel)
+
+        # Swap files padded to the aio alignment, as the swappers write them
+        padding = torch.full((streaming_adam.aligned_numel(model_size) - model_size, ), 7.)
+        paths = {key: os.path.join(tmpdir, f'{key}.swp') for key in STREAMING_STATE_KEYS}
+        torch.cat([ref_param.data, padding]).numpy().tofile(paths['param'])
+        for key in ['exp_avg', 'exp_avg_sq']:
+            torch.cat([torch.zeros(model_size), padding]).numpy().tofile(paths[key])
+
+        param_out = torch.empty(model_size)
+        for step in range(1, 4):
+            ref_param.grad = torch.randn(model_size)
+            ref_optimizer.step()
+            streaming_adam.step(swap_optimizer.param_groups[0], step, ref_param.grad, paths, param_out)
+
+        streaming_adam.release()
+        check_equal(param_out, ref_param.data, atol=1e-6)
+        swapped_param = torch.from_numpy(np.fromfile(paths['param'], dtype=np.float32))
+        check_equal(swapped_param[:model_size], ref_param.data, atol=1e-6)
+        check_equal(swapped_param[model_size:], padding, atol=0)
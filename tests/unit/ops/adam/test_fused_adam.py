@@ -0,0 +1,141 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import torch
+import pytest
+
+import deepspeed
+from deepspeed.ops.adam import FusedAdam
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import FusedAdamBuilder
+from unit.common import DistributedTest
+
+if not deepspeed.ops.__compatible_ops__[FusedAdamBuilder.NAME]:
+    pytest.skip("fused-adam is not compatible", allow_module_level=True)
+
+
+class TestFusedAdamEpilogue(DistributedTest):
+    world_size = 1
+
+    @pytest.mark.parametrize('max_grad_norm', [0., 1.])
+    def test_unscale_and_clip(self, max_grad_norm):
+        device = get_accelerator().device_name()
+        loss_scale = 1024.
+        params = [torch.nn.Parameter(torch.randn(size, device=device)) for size in [127, 65536 + 7]]
+        params1 = [torch.nn.Parameter(p.detach().clone()) for p in params]
+        optimizer = FusedAdam(params)
+        optimizer1 = FusedAdam(params1)
+
+        for _ in range(3):
+            for p, p1 in zip(params, params1):
+                p.grad = torch.randn_like(p) * loss_scale
+                p1.grad = p.grad.clone()
+
+            scaled_norm = torch.norm(torch.stack([torch.norm(p.grad) for p in params]))
+            found_inf, clip_coef = FusedAdam.epilogue_scalars(scaled_norm, loss_scale, max_grad_norm)
+            optimizer.step(inv_scale=1. / loss_scale, found_inf=found_inf, clip_coef=clip_coef)
+
+            # Reference: separate unscale and clip passes.
+            for p1 in params1:
+                p1.grad.div_(loss_scale)
+            if max_grad_norm > 0:
+                torch.nn.utils.clip_grad_norm_(params1, max_grad_norm)
+            optimizer1.step()
+
+        for p, p1 in zip(params, params1):
+            assert torch.allclose(p, p1, atol=1e-5), "param-update mismatch!"
+
+    def test_found_inf_skips_step(self):
+        device = get_accelerator().device_name()
+        param = torch.nn.Parameter(torch.randn(1024, device=device))
+        initial = param.detach().clone()
+        optimizer = FusedAdam([param])
+
+        param.grad = torch.randn_like(param)
+        param.grad[3] = float('inf')
+        found_inf, _ = FusedAdam.epilogue_scalars(torch.norm(param.grad))
+        optimizer.step(found_inf=found_inf)
+
+        assert found_inf.item() == 1.
+        assert torch.equal(param.detach(), initial)
+        assert torch.count_nonzero(optimizer.state[param]['exp_avg']) == 0
+        # The skipped step does not count towards the bias correction
+        step = optimizer.state_dict()['state'][0]['step']
+        assert torch.is_tensor(step) and step.device == param.device
+        assert step.item() == 0
+
+    def test_step_after_skipped_step(self):
+        device = get_accelerator().device_name()
+        param = torch.nn.Parameter(torch.randn(1024, device=device))
+        param1 = torch.nn.Parameter(param.detach().clone())
+        optimizer = FusedAdam([param])
+        optimizer1 = FusedAdam([param1])
+
+        param.grad = torch.full_like(param, float('inf'))
+        found_inf, _ = FusedAdam.epilogue_scalars(torch.norm(param.grad))
+        optimizer.step(found_inf=found_inf)
+
+        for _ in range(3):
+            param1.grad = torch.randn_like(param1)
+            param.grad = param1.grad.clone()
+            found_inf, _ = FusedAdam.epilogue_scalars(torch.norm(param.grad))
+            optimizer.step(found_inf=found_inf)
+            optimizer1.step()
+
+        assert optimizer.state_dict()['state'][0]['step'].item() == 3
+        assert torch.allclose(param, param1), "param-update mismatch!"
+
+
+class TestFusedAdamQuantizedState(DistributedTest):
+    world_size = 1
+
+    @pytest.mark.parametrize('dtype', [torch.float, torch.half], ids=["fp32", "fp16"])
+    def test_close_to_fp32_state(self, dtype):
+        device = get_accelerator().device_name()
+        sizes = [1024, 4096, 65536 + 7]
+        params = [torch.nn.Parameter(torch.randn(size, device=device).to(dtype)) for size in sizes]
+        params1 = [torch.nn.Parameter(p.detach().clone()) for p in params]
+        optimizer = FusedAdam(params, weight_decay=0.01, quantized_state=True)
+        optimizer1 = FusedAdam(params1, weight_decay=0.01)
+
+        for _ in range(10):
+            for p, p1 in zip(params, params1):
+                p.grad = torch.randn_like(p)
+                p1.grad = p.grad.clone()
+            optimizer.step()
+            optimizer1.step()
+
+        assert optimizer.state[params[0]]['exp_avg'].dtype == dtype
+        for p in params[1:]:
+            state = optimizer.state[p]
+            assert state['exp_avg'].dtype == torch.uint8 and state['exp_avg_sq'].dtype == torch.uint8
+            assert state['state_absmax'].numel() == 2 * ((p.numel() + 2047) // 2048)
+        for p, p1 in zip(params, params1):
+            assert torch.allclose(p.float(), p1.float(), atol=1e-2), "param-update mismatch!"
+
+    def test_mixed_group_matches_torch_adam(self):
+        device = get_accelerator().device_name()
+        # Dense fp32, 8-bit fp32 and 8-bit fp16 state in the same group
+        params = [
+            torch.nn.Parameter(torch.randn(1024, device=device)),
+            torch.nn.Parameter(torch.randn(65536 + 7, device=device)),
+            torch.nn.Parameter((torch.randn(8192, device=device) * 0.1).half()),
+        ]
+        params1 = [torch.nn.Parameter(p.detach().float().clone()) for p in params]
+        optimizer = FusedAdam(params, quantized_state=True)
+        optimizer1 = torch.optim.Adam(params1)
+
+        steps = 10
+        for _ in range(steps):
+            for p, p1 in zip(params, params1):
+                p1.grad = torch.randn_like(p1)
+                p.grad = p1.grad.to(p.dtype)
+            optimizer.step()
+            optimizer1.step()
+
+        assert all(optimizer.state[p]['step'] == steps for p in params)
+        assert torch.allclose(params[0], params1[0], atol=1e-5), "dense param-update mismatch!"
+        for p, p1 in zip(params[1:], params1[1:]):
+            assert torch.allclose(p.float(), p1, atol=1e-2), "param-update mismatch!"
@@ -0,0 +1,78 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import torch
+import pytest
+
+import deepspeed
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import FusedAdamBuilder
+
+if not deepspeed.ops.__compatible_ops__[FusedAdamBuilder.NAME]:
+    pytest.skip("fused-adam is not compatible", allow_module_level=True)
+
+fused_adam_cuda = FusedAdamBuilder().load()
+
+
+def unpack_signs(packed, chunk_elems):
+    # Bit j of word w is element 32 * w + j of the chunk
+    shifts = torch.arange(32, dtype=torch.int32, device=packed.device)
+    bits = (packed.unsqueeze(-1) >> shifts) & 1
+    return bits.reshape(packed.size(0), -1)[:, :chunk_elems].bool()
+
+
+def reference_compress(x):
+    scale = torch.norm(x) / (x.numel()**0.5)
+    return x >= 0, scale, x - scale * ((x >= 0).float() * 2 - 1)
+
+
+# Chunks of 1-bit Adam are padded to a multiple of 8 elements, not of the 32 bits of a word
+@pytest.mark.parametrize('num_chunks', [1, 4])
+@pytest.mark.parametrize('chunk_elems', [8, 296, 65536 + 8])
+def test_worker_compress(num_chunks, chunk_elems):
+    device = get_accelerator().device_name()
+    buffer = torch.randn(num_chunks * chunk_elems, device=device)
+    worker_error = torch.randn_like(buffer) * 0.1
+
+    sign, scale, error = reference_compress(buffer + worker_error)
+    packed, fused_scale = fused_adam_cuda.onebit_worker_compress(buffer, worker_error, num_chunks)
+
+    assert packed.shape == (num_chunks, (chunk_elems + 31) // 32)
+    assert torch.equal(unpack_signs(packed, chunk_elems), sign.reshape(num_chunks, -1))
+    assert torch.allclose(fused_scale, scale.reshape(1), rtol=1e-5)
+    assert torch.allclose(worker_error, error, atol=1e-5)
+
+
+@pytest.mark.parametrize('ranks', [1, 3, 8])
+@pytest.mark.parametrize('chunk_elems', [296, 65536 + 8])
+def test_server_compress(ranks, chunk_elems):
+    device = get_accelerator().device_name()
+    words = (chunk_elems + 31) // 32
+    signs = torch.randint(-2**31, 2**31 - 1, (ranks, words), dtype=torch.int32, device=device)
+    scales = torch.rand(ranks, device=device)
+    server_error = torch.randn(chunk_elems, device=device) * 0.1
+
+    average = ((unpack_signs(signs, chunk_elems).float() * 2 - 1) * scales.unsqueeze(1)).mean(0)
+    sign, scale, error = reference_compress(average + server_error)
+    packed, fused_scale = fused_adam_cuda.onebit_server_compress(signs, scales, server_error)
+
+    assert torch.equal(unpack_signs(packed, chunk_elems)[0], sign)
+    assert torch.allclose(fused_scale, scale.reshape(1), rtol=1e-5)
+    assert torch.allclose(server_error, error, atol=1e-5)
+
+
+@pytest.mark.parametrize('ranks', [1, 4])
+@pytest.mark.parametrize('chunk_elems', [296, 65536 + 8])
+def test_decompress(ranks, chunk_elems):
+    device = get_accelerator().device_name()
+    words = (chunk_elems + 31) // 32
+    signs = torch.randint(-2**31, 2**31 - 1, (ranks, words), dtype=torch.int32, device=device)
+    scales = torch.rand(ranks, device=device)
+    output = torch.empty(ranks * chunk_elems, device=device)
+
+    fused_adam_cuda.onebit_decompress(output, signs, scales)
+
+    expected = (unpack_signs(signs, chunk_elems).float() * 2 - 1) * scales.unsqueeze(1)
+    assert torch.equal(output, expected.flatten())
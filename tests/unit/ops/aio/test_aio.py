@@ -314,3 +314,440 @@ class TestAsyncQueue(DistributedTest):
 
             filecmp.clear_cache()
             assert filecmp.cmp(ref_files[i], aio_files[i], shallow=False)
+
+
+@pytest.mark.parametrize("sq_poll", [True, False])
+class TestIoUring(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    def _get_handle(self, sq_poll):
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE,
+                                               QUEUE_DEPTH,
+                                               False,
+                                               True,
+                                               IO_PARALLEL,
+                                               use_io_uring=True,
+                                               sq_poll=sq_poll)
+        if not h.get_use_io_uring():
+            pytest.skip('async_io was built without io_uring support')
+        return h
+
+    def test_read(self, tmpdir, sq_poll):
+        h = self._get_handle(sq_poll)
+        aio_buffer = h.new_cpu_locked_tensor(IO_SIZE, torch.empty(0, dtype=torch.uint8))
+
+        ref_file, _ = _do_ref_write(tmpdir)
+        assert h.async_pread(aio_buffer, ref_file) == 0
+        assert h.wait() == 1
+
+        with open(ref_file, 'rb') as f:
+            ref_buffer = list(f.read())
+        assert ref_buffer == aio_buffer.tolist()
+
+        h.free_cpu_locked_tensor(aio_buffer)
+
+    def test_write(self, tmpdir, sq_poll):
+        ref_file, ref_buffer = _do_ref_write(tmpdir)
+        h = self._get_handle(sq_poll)
+        aio_file, aio_buffer = _get_test_write_file_and_cpu_buffer(tmpdir, ref_buffer, h)
+
+        assert h.async_pwrite(aio_buffer, aio_file) == 0
+        assert h.wait() == 1
+
+        h.free_cpu_locked_tensor(aio_buffer)
+
+        filecmp.clear_cache()
+        assert filecmp.cmp(ref_file, aio_file, shallow=False)
+
+
+@pytest.mark.parametrize("overlap_events", [True, False])
+class TestBatch(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    @pytest.mark.parametrize("batch_size", [1, 3])
+    def test_read(self, tmpdir, overlap_events, batch_size):
+        ref_files = [_do_ref_write(tmpdir, i)[0] for i in range(batch_size)]
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, overlap_events, IO_PARALLEL)
+
+        tmp_tensor = torch.empty(0, dtype=torch.uint8)
+        aio_buffers = [h.new_cpu_locked_tensor(IO_SIZE, tmp_tensor) for _ in range(batch_size)]
+
+        assert h.async_pread_batch(aio_buffers, ref_files, [0] * batch_size) == 0
+        assert h.wait() == batch_size
+
+        for ref_file, aio_buffer in zip(ref_files, aio_buffers):
+            with open(ref_file, 'rb') as f:
+                assert list(f.read()) == aio_buffer.tolist()
+            h.free_cpu_locked_tensor(aio_buffer)
+
+    @pytest.mark.parametrize("batch_size", [1, 3])
+    def test_write_single_file(self, tmpdir, overlap_events, batch_size):
+        ref_buffers = [os.urandom(IO_SIZE) for _ in range(batch_size)]
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, overlap_events, IO_PARALLEL)
+
+        aio_file = _get_test_write_file(tmpdir, 0)
+        aio_buffers = [_get_test_write_file_and_cpu_buffer(tmpdir, buf, h)[1] for buf in ref_buffers]
+        offsets = [i * IO_SIZE for i in range(batch_size)]
+
+        assert h.async_pwrite_batch(aio_buffers, [aio_file] * batch_size, offsets) == 0
+        assert h.wait() == batch_size
+
+        for t in aio_buffers:
+            h.free_cpu_locked_tensor(t)
+
+        with open(aio_file, 'rb') as f:
+            assert f.read() == b''.join(ref_buffers)
+
+
+@pytest.mark.parametrize("overlap_events", [True, False])
+class TestStriped(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    @pytest.mark.parametrize("num_files", [1, 2, 3])
+    def test_write_read(self, tmpdir, overlap_events, num_files):
+        num_stripes = 5
+        ref_buffer = os.urandom(num_stripes * IO_SIZE)
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, overlap_events, IO_PARALLEL)
+
+        aio_files = [_get_test_write_file(tmpdir, i) for i in range(num_files)]
+        _, aio_buffer = _get_test_write_file_and_cpu_buffer(tmpdir, ref_buffer, h)
+        assert h.async_pwrite_striped(aio_buffer, aio_files, IO_SIZE) == 0
+        assert h.wait() == num_stripes
+
+        for i, aio_file in enumerate(aio_files):
+            expected = b''.join(ref_buffer[k * IO_SIZE:(k + 1) * IO_SIZE] for k in range(i, num_stripes, num_files))
+            with open(aio_file, 'rb') as f:
+                assert f.read() == expected
+
+        aio_buffer.zero_()
+        assert h.async_pread_striped(aio_buffer, aio_files, IO_SIZE) == 0
+        assert h.wait() == num_stripes
+        assert bytes(aio_buffer.tolist()) == ref_buffer
+
+        h.free_cpu_locked_tensor(aio_buffer)
+
+    @pytest.mark.parametrize("stripe_size, buffer_size", [(IO_SIZE + 512, 2 * IO_SIZE),
+                                                          (IO_SIZE, 2 * IO_SIZE + 512)])
+    def test_unaligned(self, tmpdir, overlap_events, stripe_size, buffer_size):
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, overlap_events, IO_PARALLEL)
+
+        aio_files = [_get_test_write_file(tmpdir, i) for i in range(2)]
+        _, aio_buffer = _get_test_write_file_and_cpu_buffer(tmpdir, os.urandom(buffer_size), h)
+        assert h.async_pwrite_striped(aio_buffer, aio_files, stripe_size) == -1
+        assert h.async_pread_striped(aio_buffer, aio_files, stripe_size) == -1
+
+        h.free_cpu_locked_tensor(aio_buffer)
+
+
+@pytest.mark.parametrize("overlap_events", [True, False])
+class TestRequest(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    def test_wait_out_of_order(self, tmpdir, overlap_events):
+        ref_files = [_do_ref_write(tmpdir, i)[0] for i in range(3)]
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, overlap_events, IO_PARALLEL)
+
+        tmp_tensor = torch.empty(0, dtype=torch.uint8)
+        aio_buffers = [h.new_cpu_locked_tensor(IO_SIZE, tmp_tensor) for _ in ref_files]
+
+        assert h.async_pread(aio_buffers[0], ref_files[0]) == 0
+        single_request = h.get_last_request()
+        assert h.async_pread_batch(aio_buffers[1:], ref_files[1:], [0, 0]) == 0
+        batch_request = h.get_last_request()
+        assert single_request != batch_request
+
+        assert h.wait_request(batch_request) == 2
+        assert h.test_request(batch_request)
+        # The single read may have been retired while waiting for the batch.
+        assert h.wait_request(single_request) in (0, 1)
+        assert h.test_request(single_request)
+        assert h.wait_request(single_request) == 0
+
+        for ref_file, aio_buffer in zip(ref_files, aio_buffers):
+            with open(ref_file, 'rb') as f:
+                assert list(f.read()) == aio_buffer.tolist()
+            h.free_cpu_locked_tensor(aio_buffer)
+
+
+@pytest.mark.parametrize("overlap_events", [True, False])
+class TestCompressed(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    @pytest.mark.parametrize("codec", ["bf16", "fp16"])
+    def test_write_read(self, tmpdir, overlap_events, codec):
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, overlap_events, IO_PARALLEL)
+
+        # Small integers are exact in both encodings.
+        ref_tensor = torch.randint(-128, 128, (IO_SIZE, ), dtype=torch.float32)
+        aio_file = _get_test_write_file(tmpdir, 0)
+        assert h.async_pwrite_compressed(ref_tensor, aio_file, codec) == 0
+        assert h.wait() == 1
+        assert os.path.getsize(aio_file) == IO_SIZE * 2
+
+        aio_tensor = torch.zeros_like(ref_tensor)
+        assert h.async_pread_compressed(aio_tensor, aio_file, codec) == 0
+        assert h.wait() == 1
+        assert torch.equal(aio_tensor, ref_tensor)
+
+    def test_invalid(self, tmpdir, overlap_events):
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, overlap_events, IO_PARALLEL)
+        aio_file = _get_test_write_file(tmpdir, 0)
+        assert h.async_pwrite_compressed(torch.zeros(IO_SIZE), aio_file, "int4") == -1
+        assert h.async_pwrite_compressed(torch.zeros(IO_SIZE, dtype=torch.half), aio_file, "bf16") == -1
+
+
+# Arena extents are page aligned per aio thread.
+ARENA_EXTENT_SIZE = max(IO_SIZE, os.sysconf('SC_PAGE_SIZE') * IO_PARALLEL)
+
+
+class TestSwapArena(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    def test_alloc_free(self, tmpdir):
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, True, IO_PARALLEL)
+        arena_bytes = 4 * ARENA_EXTENT_SIZE
+        arena_id = h.new_swap_arena(os.path.join(tmpdir, '_aio_arena.swp'), arena_bytes)
+        assert arena_id >= 0
+
+        offsets = [h.swap_arena_alloc(arena_id, ARENA_EXTENT_SIZE) for _ in range(4)]
+        assert offsets == [i * ARENA_EXTENT_SIZE for i in range(4)]
+        assert h.swap_arena_alloc(arena_id, ARENA_EXTENT_SIZE) == -1
+        assert h.get_swap_arena_free_bytes(arena_id) == 0
+
+        # Freed neighbours coalesce into one extent.
+        assert h.swap_arena_free(arena_id, offsets[1])
+        assert h.swap_arena_free(arena_id, offsets[2])
+        assert not h.swap_arena_free(arena_id, offsets[2])
+        assert h.swap_arena_alloc(arena_id, 2 * ARENA_EXTENT_SIZE) == offsets[1]
+
+    def test_write_read(self, tmpdir):
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, True, IO_PARALLEL)
+        num_tensors = 3
+        arena_id = h.new_swap_arena(os.path.join(tmpdir, '_aio_arena.swp'), num_tensors * ARENA_EXTENT_SIZE)
+        offsets = [h.swap_arena_alloc(arena_id, ARENA_EXTENT_SIZE) for _ in range(num_tensors)]
+
+        ref_buffers = [os.urandom(ARENA_EXTENT_SIZE) for _ in range(num_tensors)]
+        write_buffers = [_get_test_write_file_and_cpu_buffer(tmpdir, buf, h)[1] for buf in ref_buffers]
+        assert h.async_pwrite_arena(write_buffers, arena_id, offsets) == 0
+        assert h.wait() == num_tensors
+
+        tmp_tensor = torch.empty(0, dtype=torch.uint8)
+        read_buffers = [h.new_cpu_locked_tensor(ARENA_EXTENT_SIZE, tmp_tensor) for _ in range(num_tensors)]
+        assert h.async_pread_arena(read_buffers, arena_id, offsets) == 0
+        assert h.wait() == num_tensors
+
+        for ref_buffer, read_buffer in zip(ref_buffers, read_buffers):
+            assert list(ref_buffer) == read_buffer.tolist()
+
+        for t in write_buffers + read_buffers:
+            h.free_cpu_locked_tensor(t)
+
+
+class TestGDS(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    def _get_handle(self):
+        _skip_for_invalid_environment(use_cuda_device=True, use_cuda_pinned_tensor=False)
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, True, IO_PARALLEL, use_gds=True)
+        if not h.get_use_gds():
+            pytest.skip('GPUDirect Storage is not available')
+        return h
+
+    def test_read(self, tmpdir):
+        h = self._get_handle()
+        aio_buffer = torch.empty(IO_SIZE, dtype=torch.uint8, device=get_accelerator().device_name())
+
+        ref_file, _ = _do_ref_write(tmpdir)
+        assert h.async_pread(aio_buffer, ref_file) == 0
+        assert h.wait() == 1
+
+        with open(ref_file, 'rb') as f:
+            ref_buffer = list(f.read())
+        assert ref_buffer == aio_buffer.tolist()
+
+    def test_write(self, tmpdir):
+        h = self._get_handle()
+        ref_file, ref_buffer = _do_ref_write(tmpdir)
+        aio_file, aio_buffer = _get_test_write_file_and_cuda_buffer(tmpdir, ref_buffer)
+
+        assert h.async_pwrite(aio_buffer, aio_file) == 0
+        assert h.wait() == 1
+
+        filecmp.clear_cache()
+        assert filecmp.cmp(ref_file, aio_file, shallow=False)
+
+    def test_registered_file_reuse(self, tmpdir):
+        h = self._get_handle()
+        aio_buffer = torch.empty(IO_SIZE, dtype=torch.uint8, device=get_accelerator().device_name())
+
+        # Rewritten in place, then replaced by another file under the same path
+        ref_file, _ = _do_ref_write(tmpdir)
+        for replace in [False, False, True]:
+            if replace:
+                other_file, _ = _do_ref_write(tmpdir, index=1)
+                os.replace(other_file, ref_file)
+            else:
+                _do_ref_write(tmpdir)
+            assert h.async_pread(aio_buffer, ref_file) == 0
+            assert h.wait() == 1
+
+            with open(ref_file, 'rb') as f:
+                ref_buffer = list(f.read())
+            assert ref_buffer == aio_buffer.tolist()
+
+
+@pytest.mark.parametrize("overlap_events", [True, False])
+class TestStats(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    def test_read(self, tmpdir, overlap_events):
+        ref_file, _ = _do_ref_write(tmpdir)
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, overlap_events, IO_PARALLEL)
+
+        aio_buffer = h.new_cpu_locked_tensor(IO_SIZE, torch.empty(0, dtype=torch.uint8))
+        assert h.async_pread(aio_buffer, ref_file) == 0
+        assert h.wait() == 1
+
+        stats = h.get_stats()
+        assert stats['wait_calls'] == 1
+        assert len(stats['threads']) == IO_PARALLEL
+        assert sum(t['read_bytes'] for t in stats['threads']) == IO_SIZE
+        # Chunks may be stolen across threads, but the op is retired exactly once.
+        assert sum(t['read_ops'] for t in stats['threads']) == 1
+        assert sum(t['write_bytes'] for t in stats['threads']) == 0
+        for t in stats['threads']:
+            assert t['complete']['count'] == sum(t['complete']['buckets'])
+            assert t['queue_depth_max'] <= QUEUE_DEPTH
+
+        h.reset_stats()
+        stats = h.get_stats()
+        assert stats['wait_calls'] == 0
+        assert all(t['read_bytes'] == 0 and t['complete']['count'] == 0 for t in stats['threads'])
+
+        h.free_cpu_locked_tensor(aio_buffer)
+
+
+class TestPinnedPool(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    @pytest.mark.parametrize("exact_size_classes", [False, True])
+    def test_reuse(self, exact_size_classes):
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, True, IO_PARALLEL)
+        h.configure_pinned_pool(exact_size_classes=exact_size_classes, use_hugepages=False)
+        example = torch.empty(0, dtype=torch.float16)
+
+        t = h.new_cpu_locked_tensor(IO_SIZE, example)
+        assert t.numel() == IO_SIZE and t.dtype == torch.float16
+        address = t.data_ptr()
+        assert h.free_cpu_locked_tensor(t)
+        assert not h.free_cpu_locked_tensor(t)
+
+        # Same size class is served from the cache without locking new memory.
+        t = h.new_cpu_locked_tensor(IO_SIZE, example)
+        assert t.data_ptr() == address
+        stats = h.get_pinned_pool_stats()
+        assert stats['allocs'] == 2 and stats['frees'] == 1
+        assert stats['cache_hits'] == 1 and stats['cache_misses'] == 1
+        assert stats['in_use_bytes'] >= IO_SIZE * example.element_size()
+        assert stats['cached_bytes'] == 0
+
+        h.free_cpu_locked_tensor(t)
+        released = h.release_cached_cpu_locked_tensors()
+        assert released == stats['in_use_bytes']
+        assert h.get_pinned_pool_stats()['locked_bytes'] == 0
+
+    def test_max_cached_bytes(self):
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, True, IO_PARALLEL)
+        page_size = os.sysconf('SC_PAGE_SIZE')
+        h.configure_pinned_pool(exact_size_classes=True, use_hugepages=False, max_cached_bytes=page_size)
+        example = torch.empty(0, dtype=torch.uint8)
+
+        tensors = [h.new_cpu_locked_tensor(page_size, example) for _ in range(3)]
+        for t in tensors:
+            h.free_cpu_locked_tensor(t)
+
+        stats = h.get_pinned_pool_stats()
+        assert stats['cached_bytes'] == page_size
+        assert stats['locked_bytes'] == page_size
+
+    @pytest.mark.parametrize("geometric_max_bytes", [0, 1024 * 1024])
+    def test_large_size_classes(self, geometric_max_bytes):
+        h = AsyncIOBuilder().load().aio_handle(BLOCK_SIZE, QUEUE_DEPTH, False, True, IO_PARALLEL)
+        page_size = os.sysconf('SC_PAGE_SIZE')
+        h.configure_pinned_pool(use_hugepages=False, geometric_max_bytes=geometric_max_bytes)
+        example = torch.empty(0, dtype=torch.uint8)
+
+        # Just above a power of two, the worst case of geometric classes
+        num_bytes = 2 * 1024 * 1024 + 1
+        t = h.new_cpu_locked_tensor(num_bytes, example)
+        exact_bytes = ((num_bytes + page_size - 1) // page_size) * page_size
+        expected = 4 * 1024 * 1024 if geometric_max_bytes == 0 else exact_bytes
+        assert h.get_pinned_pool_stats()['in_use_bytes'] == expected
+        h.free_cpu_locked_tensor(t)
+
+
+class TestMemcpy(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    # Large enough to be split into several chunks and to take the streaming path
+    @pytest.mark.parametrize("numel", [1, 4099, 48 * 1024 * 1024 + 7])
+    @pytest.mark.parametrize("dest_dtype, src_dtype",
+                             [(torch.float32, torch.float32), (torch.uint8, torch.uint8),
+                              (torch.float16, torch.float32), (torch.bfloat16, torch.float32),
+                              (torch.float32, torch.float16), (torch.float32, torch.bfloat16)])
+    @pytest.mark.parametrize("offset", [0, 1])
+    def test_copy(self, numel, dest_dtype, src_dtype, offset):
+        aio_op = AsyncIOBuilder().load()
+        src = torch.randn(numel + offset).to(src_dtype) if src_dtype.is_floating_point else \
+            torch.randint(0, 255, (numel + offset, ), dtype=src_dtype)
+        # A non-zero storage offset exercises the unaligned head of the SIMD loops
+        src = src[offset:]
+        dest = torch.empty(numel + offset, dtype=dest_dtype)[offset:]
+
+        assert aio_op.deepspeed_memcpy(dest, src) == 0
+        assert torch.equal(dest, src.to(dest_dtype))
+
+    def test_mismatch(self):
+        aio_op = AsyncIOBuilder().load()
+        assert aio_op.deepspeed_memcpy(torch.empty(8), torch.empty(4)) == -1
+        assert aio_op.deepspeed_memcpy(torch.empty(8, dtype=torch.int32), torch.empty(8)) == -1
@@ -0,0 +1,151 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import math
+import torch
+import numpy as np
+import pytest
+
+import deepspeed
+from deepspeed.ops.lamb import DeepSpeedCPULamb
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import CPULambBuilder
+from unit.common import DistributedTest
+
+if not deepspeed.ops.__compatible_ops__[CPULambBuilder.NAME]:
+    pytest.skip("cpu-lamb is not compatible", allow_module_level=True)
+
+
+def check_equal(first, second, atol=1e-2, verbose=False):
+    x = first.detach().numpy()
+    y = second.detach().numpy()
+    if verbose:
+        print("x = {}".format(x.flatten()))
+        print("y = {}".format(y.flatten()))
+        print('-' * 80)
+    np.testing.assert_allclose(x, y, err_msg="param-update mismatch!", atol=atol)
+
+
+def lamb_reference_step(param, state, step, lr, betas, eps, weight_decay, max_coeff=10.0, min_coeff=0.01):
+    """The FusedLamb update, in fp64."""
+    beta1, beta2 = betas
+    grad = param.grad.double()
+    exp_avg = state['exp_avg']
+    exp_avg_sq = state['exp_avg_sq']
+    exp_avg.mul_(beta1).add_(grad, alpha=1 - beta1)
+    exp_avg_sq.mul_(beta2).addcmul_(grad, grad, value=1 - beta2)
+    update = exp_avg / (exp_avg_sq.sqrt() + eps) + weight_decay * param.data.double()
+
+    w_norm = param.data.double().norm()
+    u_norm = update.norm()
+    lamb_coeff = 1.0
+    if w_norm != 0 and u_norm != 0:
+        lamb_coeff = min(max((w_norm / u_norm).item(), min_coeff), max_coeff)
+
+    step_size = lr * math.sqrt(1 - beta2**step) / (1 - beta1**step)
+    param.data.sub_((step_size * lamb_coeff * update).float())
+    return lamb_coeff
+
+
+class TestCPULamb(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    @pytest.mark.parametrize('weight_decay', [0, 0.01])
+    @pytest.mark.parametrize('model_size',
+                            [
+                                (64),
+                                (22),
+                                (55),
+                                (127),
+                                (1024),
+                                (1048576),
+                            ]) # yapf: disable
+    def test_cpu_lamb_opt(self, model_size, weight_decay):
+        device = 'cpu'
+        lr, betas, eps = 1e-2, (0.9, 0.999), 1e-6
+        rng_state = torch.get_rng_state()
+        param = torch.nn.Parameter(torch.randn(model_size, device=device))
+        torch.set_rng_state(rng_state)
+        param1 = torch.nn.Parameter(torch.randn(model_size, device=device))
+        state1 = {
+            'exp_avg': torch.zeros(model_size, dtype=torch.double),
+            'exp_avg_sq': torch.zeros(model_size, dtype=torch.double)
+        }
+
+        optimizer = DeepSpeedCPULamb([param], lr=lr, betas=betas, eps=eps, weight_decay=weight_decay)
+
+        for step in range(1, 11):
+            rng_state = torch.get_rng_state()
+            param.grad = torch.randn(model_size, device=device)
+            torch.set_rng_state(rng_state)
+            param1.grad = torch.randn(model_size, device=device)
+            optimizer.step()
+            with torch.no_grad():
+                lamb_coeff1 = lamb_reference_step(param1, state1, step, lr, betas, eps, weight_decay)
+            assert math.isclose(optimizer.get_lamb_coeffs()[0], lamb_coeff1, rel_tol=1e-3)
+
+        check_equal(param, param1, atol=1e-4, verbose=True)
+
+    def test_cpu_lamb_coeff_clamp(self):
+        model_size = 1024
+        param = torch.nn.Parameter(torch.full((model_size, ), 1000.0))
+        optimizer = DeepSpeedCPULamb([param], max_coeff=5.0)
+        param.grad = torch.randn(model_size)
+        optimizer.step()
+        assert optimizer.get_lamb_coeffs() == [5.0]
+
+        zero_param = torch.nn.Parameter(torch.zeros(model_size))
+        optimizer = DeepSpeedCPULamb([zero_param])
+        zero_param.grad = torch.randn(model_size)
+        optimizer.step()
+        assert optimizer.get_lamb_coeffs() == [1.0]
+
+
+class TestCPULambGPUError(DistributedTest):
+
+    def test_cpu_lamb_gpu_error(self):
+        model_size = 64
+        device = get_accelerator().device_name(0)  # 'cuda:0' or 'xpu:0'
+        param = torch.nn.Parameter(torch.randn(model_size, device=device))
+        optimizer = DeepSpeedCPULamb([param])
+
+        param.grad = torch.randn(model_size, device=device)
+        with pytest.raises(AssertionError):
+            optimizer.step()
+
+
+@pytest.mark.parametrize('client_optimizer', [True, False])
+class TestCPULambZeroOffload(DistributedTest):
+    world_size = 1
+
+    def test_rejected(self, client_optimizer):
+        from unit.simple_model import SimpleModel
+        from deepspeed.runtime.zero.utils import ZeRORuntimeException
+
+        config_dict = {
+            "train_batch_size": 2,
+            "fp16": {
+                "enabled": True
+            },
+            "zero_optimization": {
+                "stage": 2,
+                "offload_optimizer": {
+                    "device": "cpu"
+                }
+            },
+        }
+        model = SimpleModel(10)
+        optimizer = None
+        if client_optimizer:
+            optimizer = DeepSpeedCPULamb(model.parameters())
+        else:
+            config_dict["optimizer"] = {"type": "Lamb", "params": {"lr": 1e-3}}
+
+        with pytest.raises(ZeRORuntimeException):
+            deepspeed.initialize(model=model, optimizer=optimizer, config=config_dict)
@@ -0,0 +1,71 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import torch
+import pytest
+
+import deepspeed
+from deepspeed.ops.lamb import FusedLamb
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import FusedLambBuilder
+from unit.common import DistributedTest
+
+if not deepspeed.ops.__compatible_ops__[FusedLambBuilder.NAME]:
+    pytest.skip("fused-lamb is not compatible", allow_module_level=True)
+
+
+class TestFusedLambMultiTensor(DistributedTest):
+    world_size = 1
+
+    @pytest.mark.parametrize('weight_decay', [0, 0.01])
+    @pytest.mark.parametrize('eps_inside_sqrt', [False, True])
+    def test_multi_tensor_matches_per_tensor(self, weight_decay, eps_inside_sqrt):
+        device = get_accelerator().device_name()
+        # Mixes tensors smaller than a block with ones split across chunks and launches.
+        sizes = [1, 127, 1024, 65536 + 33, 3 * 65536, 500011]
+        params = [torch.nn.Parameter(torch.randn(size, device=device)) for size in sizes]
+        params1 = [torch.nn.Parameter(p.detach().clone()) for p in params]
+
+        kwargs = dict(lr=1e-2, weight_decay=weight_decay, eps_inside_sqrt=eps_inside_sqrt)
+        optimizer = FusedLamb(params, multi_tensor=True, **kwargs)
+        optimizer1 = FusedLamb(params1, **kwargs)
+
+        for _ in range(5):
+            for p, p1 in zip(params, params1):
+                p.grad = torch.randn_like(p)
+                p1.grad = p.grad.clone()
+            optimizer.step(scale=2.)
+            optimizer1.step(scale=2.)
+
+            coeffs = optimizer.get_lamb_coeffs()
+            coeffs1 = optimizer1.get_lamb_coeffs()
+            assert len(coeffs) == len(sizes)
+            assert coeffs == pytest.approx(coeffs1, rel=1e-4)
+
+        for p, p1 in zip(params, params1):
+            assert torch.allclose(p, p1, atol=1e-5), "param-update mismatch!"
+
+    def test_half_grads_keep_fp32_update(self):
+        device = get_accelerator().device_name()
+        sizes = [127, 65536 + 33, 500011]
+        params = [torch.nn.Parameter(torch.randn(size, device=device)) for size in sizes]
+        params1 = [torch.nn.Parameter(p.detach().clone()) for p in params]
+        optimizer = FusedLamb(params, lr=1e-2, multi_tensor=True)
+        optimizer1 = FusedLamb(params1, lr=1e-2, multi_tensor=True)
+
+        for _ in range(5):
+            grads = [torch.randn_like(p).half() for p in params]
+            grads1 = [g.float() for g in grads]
+            originals = [g.clone() for g in grads]
+            optimizer.step(grads=grads)
+            optimizer1.step(grads=grads1)
+
+            # The update goes to a scratch copy and is not rounded to half
+            for g, original in zip(grads, originals):
+                assert torch.equal(g, original)
+            assert optimizer.get_lamb_coeffs() == pytest.approx(optimizer1.get_lamb_coeffs(), rel=1e-5)
+
+        for p, p1 in zip(params, params1):
+            assert torch.allclose(p, p1, atol=1e-6), "param-update mismatch!"
@@ -0,0 +1,78 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import torch
+import pytest
+
+import deepspeed
+from deepspeed.ops.lion import DeepSpeedCPULion
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import CPULionBuilder
+from unit.common import DistributedTest
+
+if not deepspeed.ops.__compatible_ops__[CPULionBuilder.NAME]:
+    pytest.skip("cpu-lion is not compatible", allow_module_level=True)
+
+
+def lion_reference_step(param, exp_avg, lr, betas, weight_decay):
+    beta1, beta2 = betas
+    update = (exp_avg * beta1 + param.grad * (1 - beta1)).sign()
+    param.data.mul_(1 - lr * weight_decay).add_(update, alpha=-lr)
+    exp_avg.mul_(beta2).add_(param.grad, alpha=1 - beta2)
+
+
+class TestCPULion(DistributedTest):
+    world_size = 1
+    requires_cuda_env = False
+    if not get_accelerator().is_available():
+        init_distributed = False
+        set_dist_env = False
+
+    @pytest.mark.parametrize('weight_decay', [0, 0.1])
+    @pytest.mark.parametrize('model_size',
+                            [
+                                (64),
+                                (22),
+                                (55),
+                                (127),
+                                (1024),
+                                (1048576),
+                            ]) # yapf: disable
+    def test_cpu_lion_opt(self, model_size, weight_decay):
+        device = 'cpu'
+        lr, betas = 1e-3, (0.9, 0.99)
+        rng_state = torch.get_rng_state()
+        param = torch.nn.Parameter(torch.randn(model_size, device=device))
+        torch.set_rng_state(rng_state)
+        param1 = torch.nn.Parameter(torch.randn(model_size, device=device))
+        exp_avg1 = torch.zeros_like(param1)
+
+        optimizer = DeepSpeedCPULion([param], lr=lr, betas=betas, weight_decay=weight_decay)
+
+        for i in range(10):
+            rng_state = torch.get_rng_state()
+            param.grad = torch.randn(model_size, device=device)
+            torch.set_rng_state(rng_state)
+            param1.grad = torch.randn(model_size, device=device)
+            optimizer.step()
+            with torch.no_grad():
+                lion_reference_step(param1, exp_avg1, lr, betas, weight_decay)
+
+        # An update that rounds to +-0 differently in the vector kernel flips its sign, allow a handful.
+        mismatch = (param.detach() - param1.detach()).abs() > 1e-5
+        assert mismatch.float().mean().item() < 1e-4
+
+
+class TestCPULionGPUError(DistributedTest):
+
+    def test_cpu_lion_gpu_error(self):
+        model_size = 64
+        device = get_accelerator().device_name(0)  # 'cuda:0' or 'xpu:0'
+        param = torch.nn.Parameter(torch.randn(model_size, device=device))
+        optimizer = DeepSpeedCPULion([param])
+
+        param.grad = torch.randn(model_size, device=device)
+        with pytest.raises(AssertionError):
+            optimizer.step()
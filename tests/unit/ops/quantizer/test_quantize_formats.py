@@ -0,0 +1,106 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+from deepspeed.ops import op_builder
+from deepspeed.accelerator import get_accelerator
+
+quantize_module = None
+
+NF4_CODE = [
+    -1.0, -0.6961928009986877, -0.5250730514526367, -0.39491748809814453, -0.28444138169288635,
+    -0.18477343022823334, -0.09105003625154495, 0.0, 0.07958029955625534, 0.16093020141124725, 0.24611230194568634,
+    0.33791524171829224, 0.44070982933044434, 0.5626170039176941, 0.7229568362236023, 1.0
+]
+
+
+def get_quantize_module():
+    global quantize_module
+    if quantize_module is None:
+        quantize_module = op_builder.QuantizerBuilder().load()
+    return quantize_module
+
+
+def run_ref_fp8(activations, num_groups, fp8_dtype):
+    activations = activations.reshape(num_groups, -1).to(torch.float32)
+    absmax = activations.abs().amax(dim=-1, keepdim=True)
+    scale = torch.where(absmax == 0, torch.ones_like(absmax), torch.finfo(fp8_dtype).max / absmax)
+    return ((activations * scale).to(fp8_dtype).to(torch.float32) / scale).to(torch.float16)
+
+
+def run_ref_nf4(activations, num_groups):
+    activations = activations.reshape(num_groups, -1).to(torch.float32)
+    absmax = activations.abs().amax(dim=-1, keepdim=True)
+    absmax = torch.where(absmax == 0, torch.ones_like(absmax), absmax)
+    code = torch.tensor(NF4_CODE, device=activations.device)
+    index = torch.argmin(torch.abs((activations / absmax).unsqueeze(-1) - code), dim=-1)
+    return (code[index] * absmax).to(torch.float16)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("num_groups", [1, 13, 512])
+@pytest.mark.parametrize("num_elems", [8, 64, 256, 4096, 16384])
+@pytest.mark.parametrize("fp8_format", ["FP8_E4M3", "FP8_E5M2"])
+def test_fp8_quantize(num_elems, num_groups, fp8_format):
+    module = get_quantize_module()
+    if not hasattr(module, fp8_format):
+        pytest.skip("fp8 quantization requires CUDA 11.8 or newer")
+    fp8_dtype = getattr(torch, "float8_e4m3fn" if fp8_format == "FP8_E4M3" else "float8_e5m2", None)
+    if fp8_dtype is None:
+        pytest.skip("fp8 reference requires torch float8 types")
+    q_type = getattr(module, fp8_format)
+
+    activations = torch.randn((num_groups, num_elems), dtype=torch.float16, device=get_accelerator().device_name())
+
+    q_data, q_params = module.quantize(activations, num_groups, 8, q_type)
+    ds_out = module.dequantize(q_data, q_params, num_groups, 8, q_type)
+    ref_out = run_ref_fp8(activations, num_groups, fp8_dtype)
+
+    assert torch.allclose(ds_out.reshape(num_groups, -1).float(), ref_out.float(), rtol=1e-2, atol=1e-3)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("num_groups", [1, 13, 512])
+@pytest.mark.parametrize("num_elems", [8, 64, 256, 4096, 16384])
+def test_nf4_quantize(num_elems, num_groups):
+    module = get_quantize_module()
+
+    activations = torch.randn((num_groups, num_elems), dtype=torch.float16, device=get_accelerator().device_name())
+
+    # num_bits is implied by the format
+    q_data, q_params = module.quantize(activations, num_groups, 8, module.NF4)
+    assert q_data.numel() == activations.numel() // 2
+
+    ds_out = module.dequantize(q_data, q_params, num_groups, 8, module.NF4).reshape(num_groups, -1)
+    ref_out = run_ref_nf4(activations, num_groups)
+
+    # Elements right at the midpoint of two codes may round either way
+    mismatches = ~torch.isclose(ds_out.float(), ref_out.float(), rtol=1e-3, atol=1e-3)
+    assert mismatches.float().mean() < 1e-3
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("num_groups", [256, 1024])
+@pytest.mark.parametrize("num_elems", [64, 256])
+def test_nf4_double_quantize(num_elems, num_groups):
+    module = get_quantize_module()
+    scale_block_size = 256
+
+    activations = torch.randn((num_groups, num_elems), dtype=torch.float16, device=get_accelerator().device_name())
+
+    q_data, q_scales, scale_params = module.quantize_nf4(activations, num_groups, scale_block_size)
+    assert q_scales.dtype == torch.int8
+    assert scale_params.numel() == num_groups // scale_block_size
+
+    ds_out = module.dequantize_nf4(q_data, q_scales, scale_params, num_groups).reshape(num_groups, -1)
+
+    q_data_ref, q_params_ref = module.quantize(activations, num_groups, 4, module.NF4)
+    ref_out = module.dequantize(q_data_ref, q_params_ref, num_groups, 4, module.NF4).reshape(num_groups, -1)
+
+    # Only the scales differ, each by at most half a step of the 8 bit symmetric scale quantization
+    max_scale = q_params_ref.reshape(-1, scale_block_size).amax(dim=-1, keepdim=True)
+    tolerance = (max_scale / 127).repeat_interleave(scale_block_size, dim=0) + 1e-3
+    assert torch.all(torch.abs(ds_out.float() - ref_out.float()) <= tolerance)
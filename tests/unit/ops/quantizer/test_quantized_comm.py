@@ -0,0 +1,104 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+from deepspeed.ops import op_builder
+from deepspeed.accelerator import get_accelerator
+
+quantize_module = None
+
+
+def get_quantize_module():
+    global quantize_module
+    if quantize_module is None:
+        quantize_module = op_builder.QuantizerBuilder().load()
+    return quantize_module
+
+
+def get_q_type(is_symmetric_quant):
+    module = get_quantize_module()
+    return module.Symmetric if is_symmetric_quant else module.Asymmetric
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("pipeline_size", [1, 2])
+@pytest.mark.parametrize("nodes", [1, 2])
+@pytest.mark.parametrize("devices_per_node", [1, 4, 8])
+@pytest.mark.parametrize("elems_per_group", [256, 2048, 8192])
+@pytest.mark.parametrize("is_symmetric_quant", [True, False])
+@pytest.mark.parametrize("q_bits", [4, 8])
+def test_swizzle_quant(pipeline_size, nodes, devices_per_node, elems_per_group, is_symmetric_quant, q_bits):
+    module = get_quantize_module()
+    q_type = get_q_type(is_symmetric_quant)
+
+    groups_per_partition = 2
+    groups = pipeline_size * nodes * devices_per_node * groups_per_partition
+    activations = torch.randn((groups, elems_per_group), dtype=torch.float16, device=get_accelerator().device_name())
+
+    ds_out, ds_params = module.swizzle_quant(activations.flatten(), groups, q_bits, q_type, pipeline_size, nodes,
+                                             devices_per_node)
+    ref_out, ref_params = module.quantize(activations, groups, q_bits, q_type)
+
+    # Partition (node, device) of every pipeline stage moves to slot (device, node)
+    ref_out = ref_out.reshape(pipeline_size, nodes, devices_per_node, -1).transpose(1, 2).flatten()
+    ref_params = ref_params.reshape(pipeline_size, nodes, devices_per_node, groups_per_partition, -1).transpose(1, 2)
+
+    assert torch.equal(ds_out, ref_out)
+    assert torch.allclose(ds_params.flatten(), ref_params.flatten())
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("pipeline_size", [1, 2])
+@pytest.mark.parametrize("nodes", [1, 2])
+@pytest.mark.parametrize("devices_per_node", [1, 4, 8])
+@pytest.mark.parametrize("elems_per_group", [256, 2048, 8192])
+@pytest.mark.parametrize("is_symmetric_quant", [True, False])
+@pytest.mark.parametrize("q_bits", [4, 8])
+def test_swizzled_dequantize(pipeline_size, nodes, devices_per_node, elems_per_group, is_symmetric_quant, q_bits):
+    module = get_quantize_module()
+    q_type = get_q_type(is_symmetric_quant)
+
+    groups_per_partition = 2
+    groups = pipeline_size * nodes * devices_per_node * groups_per_partition
+    activations = torch.randn((groups, elems_per_group), dtype=torch.float16, device=get_accelerator().device_name())
+
+    # The swizzled layout is what a [node]- then [device]-level all-gather of the partitions produces
+    q_data, q_params = module.swizzle_quant(activations.flatten(), groups, q_bits, q_type, pipeline_size, nodes,
+                                            devices_per_node)
+    ds_out = module.swizzled_dequantize(q_data, q_params, groups, q_bits, q_type, pipeline_size, nodes,
+                                        devices_per_node)
+
+    ref_data, ref_params = module.quantize(activations, groups, q_bits, q_type)
+    ref_out = module.dequantize(ref_data, ref_params, groups, q_bits, q_type)
+
+    assert torch.equal(ds_out, ref_out.flatten())
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("num_tensors", [2, 4, 8])
+@pytest.mark.parametrize("out_groups", [1, 16])
+@pytest.mark.parametrize("elems_per_group", [256, 2048, 8192])
+@pytest.mark.parametrize("is_symmetric_quant", [True, False])
+@pytest.mark.parametrize("q_bits", [4, 8])
+def test_quantized_reduction(num_tensors, out_groups, elems_per_group, is_symmetric_quant, q_bits):
+    module = get_quantize_module()
+    q_type = get_q_type(is_symmetric_quant)
+
+    in_groups = num_tensors * out_groups
+    activations = torch.randn((in_groups, elems_per_group),
+                              dtype=torch.float16,
+                              device=get_accelerator().device_name())
+    q_data, q_params = module.quantize(activations, in_groups, q_bits, q_type)
+
+    ds_out, ds_params = module.quantized_reduction(q_data.flatten(), q_params, out_groups, q_bits, q_type, num_tensors)
+    ds_result = module.dequantize(ds_out, ds_params, out_groups, q_bits, q_type).reshape(out_groups, -1)
+
+    dequantized = module.dequantize(q_data, q_params, in_groups, q_bits, q_type)
+    ref_result = dequantized.reshape(num_tensors, -1).float().sum(dim=0).half().reshape(out_groups, -1)
+
+    # The sum is requantized once, so each element can be off by about one quantization step
+    step = ds_params[:, :1].to(torch.float16)
+    assert torch.all(torch.abs(ds_result - ref_result) <= step + 1e-2)
@@ -0,0 +1,131 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+import deepspeed
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import BlockSparseAttnBuilder
+
+if not deepspeed.ops.__compatible_ops__[BlockSparseAttnBuilder.NAME]:
+    pytest.skip("block sparse attention op is not compatible on this system", allow_module_level=True)
+
+
+def block_mask(layout, block):
+    return layout.repeat_interleave(block, dim=1).repeat_interleave(block, dim=2).bool()
+
+
+def dense_to_sparse(w, layout, block):
+    nnz = layout.nonzero()
+    blocks = w.unfold(2, block, block).unfold(3, block, block)
+    return blocks[:, nnz[:, 0], nnz[:, 1], nnz[:, 2]].contiguous()
+
+
+def sparse_to_dense(w, layout, block, fill=0.):
+    Z, (H, M, N) = w.size(0), layout.shape
+    dense = torch.full((Z, H, M, N, block, block), fill, dtype=w.dtype, device=w.device)
+    nnz = layout.nonzero()
+    dense[:, nnz[:, 0], nnz[:, 1], nnz[:, 2]] = w
+    return dense.permute(0, 1, 2, 4, 3, 5).reshape(Z, H, M * block, N * block)
+
+
+def allclose(x, y):
+    rtol, atol = {torch.float32: (5e-4, 5e-5), torch.float16: (3e-2, 2e-3), torch.bfloat16: (5e-2, 1e-2)}[x.dtype]
+    return torch.allclose(x.float(), y.float(), rtol=rtol, atol=atol * max(1., y.abs().max().item()))
+
+
+def make_layout(H, M, N):
+    layout = torch.randint(0, 2, (H, M, N))
+    # Keep every block row non-empty so softmax rows are well defined
+    layout[:, torch.arange(M), torch.arange(M) % N] = 1
+    return layout
+
+
+testdata = [(block, dtype, mode, trans_a, trans_b)\
+                for block in [16, 32, 64, 128]\
+                for dtype in [torch.float16, torch.bfloat16]\
+                for mode in ['sdd', 'dsd', 'dds']\
+                for trans_a in [False, True]\
+                for trans_b in [False, True]]
+
+
+@pytest.mark.parametrize("block, dtype, mode, trans_a, trans_b", testdata)
+def test_matmul(block, dtype, mode, trans_a, trans_b):
+    from deepspeed.ops.sparse_attention.block_sparse_cuda import MatMul
+    torch.manual_seed(0)
+    device = get_accelerator().device_name()
+    Z, H, M, N, K = 2, 2, 256, 256, 128
+    shape = {'sdd': (M, N), 'dsd': (K, M) if trans_a else (M, K), 'dds': (N, K) if trans_b else (K, N)}[mode]
+    layout = make_layout(H, shape[0] // block, shape[1] // block)
+    x = torch.randn((Z, H, K, M) if trans_a else (Z, H, M, K), dtype=dtype, device=device)
+    w = torch.randn((Z, H, N, K) if trans_b else (Z, H, K, N), dtype=dtype, device=device)
+    dy = torch.randn((Z, H, M, N), dtype=dtype, device=device)
+
+    # Dense reference in fp32, with the sparse operand zeroed outside the layout
+    mask = block_mask(layout, block).to(device)
+    ref_x = x.float().masked_fill(~mask, 0) if mode == 'dsd' else x.float()
+    ref_w = w.float().masked_fill(~mask, 0) if mode == 'dds' else w.float()
+    ref_x.requires_grad_()
+    ref_w.requires_grad_()
+    ref_y = torch.matmul(ref_x.transpose(2, 3) if trans_a else ref_x, ref_w.transpose(2, 3) if trans_b else ref_w)
+    ref_y = ref_y.masked_fill(~mask, 0) if mode == 'sdd' else ref_y
+    ref_y.backward(dy.float())
+
+    st_x = dense_to_sparse(x, layout, block) if mode == 'dsd' else x.clone()
+    st_w = dense_to_sparse(w, layout, block) if mode == 'dds' else w.clone()
+    st_dy = dense_to_sparse(dy, layout, block) if mode == 'sdd' else dy
+    st_x.requires_grad_()
+    st_w.requires_grad_()
+    st_y = MatMul(layout, block, mode, trans_a=trans_a, trans_b=trans_b)(st_x, st_w)
+    st_y.backward(st_dy)
+
+    to_ref = lambda t, sparse: sparse_to_dense(t, layout, block) if sparse else t
+    # Gradients of the sparse operand are only defined on the layout
+    ref_dx = ref_x.grad.masked_fill(~mask, 0) if mode == 'dsd' else ref_x.grad
+    ref_dw = ref_w.grad.masked_fill(~mask, 0) if mode == 'dds' else ref_w.grad
+    assert allclose(to_ref(st_y, mode == 'sdd'), ref_y.detach())
+    assert allclose(to_ref(st_x.grad, mode == 'dsd'), ref_dx)
+    assert allclose(to_ref(st_w.grad, mode == 'dds'), ref_dw)
+
+
+@pytest.mark.parametrize("block", [16, 32, 64, 128])
+@pytest.mark.parametrize("dtype", [torch.float16, torch.bfloat16])
+def test_softmax(block, dtype):
+    from deepspeed.ops.sparse_attention.block_sparse_cuda import Softmax
+    torch.manual_seed(0)
+    device = get_accelerator().device_name()
+    Z, H, S = 2, 2, 512
+    scale = 0.4
+    layout = make_layout(H, S // block, S // block)
+
+    x = torch.randn((Z, H, S, S), dtype=dtype, device=device)
+    dy = torch.randn_like(x)
+    kp_mask = torch.zeros((Z, S), dtype=dtype, device=device)
+    kp_mask[:, S // 2:] = float('-inf')
+    attn_mask = torch.randint(0, 2, (S, S), dtype=dtype, device=device)
+    # One key that always survives both masks keeps every row defined
+    kp_mask[:, 0] = 0
+    attn_mask[:, 0] = 1
+    layout[:, :, 0] = 1
+    mask = block_mask(layout, block).to(device)
+
+    ref_x = x.float().requires_grad_()
+    logits = ref_x * scale + kp_mask.float()[:, None, None, :]
+    logits = logits.masked_fill((attn_mask == 0)[None, None] | ~mask, float('-inf'))
+    ref_y = torch.softmax(logits, -1)
+    ref_y.backward(dy.float())
+
+    st_x = dense_to_sparse(x, layout, block).requires_grad_()
+    st_in = st_x.clone()
+    st_y = Softmax(layout, block)(st_in,
+                                  scale=scale,
+                                  key_padding_mask=kp_mask,
+                                  key_padding_mask_mode='add',
+                                  attn_mask=attn_mask,
+                                  attn_mask_mode='mul')
+    st_y.backward(dense_to_sparse(dy, layout, block))
+
+    assert allclose(st_y, dense_to_sparse(ref_y.detach().to(dtype), layout, block))
+    assert allclose(st_x.grad, dense_to_sparse(ref_x.grad.to(dtype), layout, block))
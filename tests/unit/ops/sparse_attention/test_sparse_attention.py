@@ -249,3 +249,22 @@ def test_matmul(block, dtype, mode, trans_a, trans_b):
     assert allclose(ref_y, st_y)
     assert allclose(ref_dx, st_dx)
     assert allclose(ref_dw, st_dw)
+
+
+def test_matmul_lut_cache():
+    valid_cuda_versions = [101, 102, 110, 111]
+    skip_on_arch(min_arch=7)
+    skip_on_cuda(valid_cuda=valid_cuda_versions)
+    from deepspeed.ops.sparse_attention.matmul import MatMul
+
+    block = 16
+    device = get_accelerator().device_name()
+    layout = make_layout(0.5, (2, 8, 8))
+
+    first = MatMul(layout, block, 'sdd', trans_a=False, trans_b=True)
+    second = MatMul(layout.clone(), block, 'sdd', trans_a=False, trans_b=True)
+    other = MatMul(1 - layout, block, 'sdd', trans_a=False, trans_b=True)
+
+    # Instances with equal layouts share the look-up tables, different layouts don't
+    assert first.make_lut(torch.float16, device) is second.make_lut(torch.float16, device)
+    assert first.make_lut(torch.float16, device) is not other.make_lut(torch.float16, device)
@@ -0,0 +1,45 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import math
+import pytest
+import torch
+from deepspeed.ops.op_builder import SpatialInferenceBuilder
+from deepspeed.accelerator import get_accelerator
+
+
+def allclose(x, y):
+    assert x.dtype == y.dtype
+    rtol, atol = {torch.float32: (5e-3, 5e-4), torch.float16: (3e-2, 2e-3)}[x.dtype]
+    return torch.allclose(x, y, rtol=rtol, atol=atol)
+
+
+def ref_cross_attention(query, key, value, heads, scale):
+
+    def split_heads(x):
+        return x.float().reshape(x.shape[0], x.shape[1], heads, -1).permute(0, 2, 1, 3)
+
+    scores = torch.matmul(split_heads(query), split_heads(key).transpose(-1, -2)) * scale
+    context = torch.matmul(scores.softmax(dim=-1), split_heads(value))
+    return context.permute(0, 2, 1, 3).reshape(query.shape).half()
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("batch", [1, 2])
+@pytest.mark.parametrize("q_len", [64, 1024, 4096])
+@pytest.mark.parametrize("kv_len", [1, 77, 128])
+@pytest.mark.parametrize("heads, head_size", [(8, 40), (8, 80), (8, 160), (5, 64), (10, 64)])
+def test_cross_attention(batch, q_len, kv_len, heads, head_size):
+    device = get_accelerator().device_name()
+    hidden = heads * head_size
+    query = torch.randn((batch, q_len, hidden), dtype=torch.float16, device=device)
+    key = torch.randn((batch, kv_len, hidden), dtype=torch.float16, device=device)
+    value = torch.randn((batch, kv_len, hidden), dtype=torch.float16, device=device)
+    scale = 1 / math.sqrt(head_size)
+
+    ref_vals = ref_cross_attention(query, key, value, heads, scale)
+    ds_vals = SpatialInferenceBuilder().load().cross_attention(query, key, value, heads, scale)
+
+    assert allclose(ds_vals, ref_vals)
@@ -0,0 +1,71 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+from deepspeed.ops.transformer.inference.group_norm import nhwc_group_norm
+from deepspeed.accelerator import get_accelerator
+
+
+def allclose(x, y):
+    assert x.dtype == y.dtype
+    rtol, atol = {torch.float32: (5e-3, 5e-4), torch.float16: (3e-2, 2e-2)}[x.dtype]
+    return torch.allclose(x, y, rtol=rtol, atol=atol)
+
+
+def ref_group_norm(activations, gamma, beta, num_groups, eps, silu, bias=None, residual=None):
+    x = activations.float()
+    if bias is not None:
+        x = x + bias.float().reshape(bias.shape[0] if bias.dim() == 2 else 1, -1, 1, 1)
+    if residual is not None:
+        x = x + residual.float()
+    out = torch.nn.functional.group_norm(x, num_groups, gamma.float(), beta.float(), eps)
+    if silu:
+        out = torch.nn.functional.silu(out)
+    return out.half()
+
+
+def make_inputs(batch, image_size, channels):
+    device = get_accelerator().device_name()
+    activations = torch.randn((batch, channels, image_size, image_size), dtype=torch.float16,
+                              device=device).to(memory_format=torch.channels_last)
+    gamma = torch.randn((channels), dtype=torch.float16, device=device)
+    beta = torch.randn((channels), dtype=torch.float16, device=device)
+    return activations, gamma, beta
+
+
+channels_list = [320, 640, 960, 1280, 1920, 2560]
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("batch", [1, 2])
+@pytest.mark.parametrize("image_size", [8, 32, 64])
+@pytest.mark.parametrize("channels", channels_list)
+@pytest.mark.parametrize("silu", [False, True])
+def test_group_norm(batch, image_size, channels, silu):
+    activations, gamma, beta = make_inputs(batch, image_size, channels)
+
+    ref_vals = ref_group_norm(activations, gamma, beta, 32, 1e-5, silu)
+    ds_vals = nhwc_group_norm(activations, gamma, beta, 32, eps=1e-5, silu=silu)
+
+    assert allclose(ds_vals, ref_vals)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("batch", [1, 2])
+@pytest.mark.parametrize("image_size", [8, 32])
+@pytest.mark.parametrize("channels", channels_list)
+@pytest.mark.parametrize("per_image_bias", [False, True])
+@pytest.mark.parametrize("use_residual", [False, True])
+def test_bias_add_group_norm(batch, image_size, channels, per_image_bias, use_residual):
+    activations, gamma, beta = make_inputs(batch, image_size, channels)
+    device = get_accelerator().device_name()
+    bias = torch.randn((batch, channels) if per_image_bias else (channels), dtype=torch.float16, device=device)
+    residual = torch.randn_like(activations) if use_residual else None
+
+    ref_vals = ref_group_norm(activations, gamma, beta, 32, 1e-6, True, bias=bias, residual=residual)
+    ds_vals = nhwc_group_norm(activations, gamma, beta, 32, eps=1e-6, silu=True, bias=bias, residual=residual)
+
+    assert allclose(ds_vals, ref_vals)
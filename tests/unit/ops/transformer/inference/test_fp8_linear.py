@@ -0,0 +1,95 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+import deepspeed
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import InferenceBuilder
+
+if not deepspeed.ops.__compatible_ops__[InferenceBuilder.NAME]:
+    pytest.skip("Inference ops are not available on this system", allow_module_level=True)
+
+inference_module = None
+
+
+def get_inference_module():
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    if not hasattr(inference_module, 'linear_layer_fp8'):
+        pytest.skip("The inference ops were built without fp8 support")
+    if torch.cuda.get_device_capability() < (8, 9):
+        pytest.skip("fp8 GEMMs need sm_89 or newer")
+    return inference_module
+
+
+def fp8_scales(device, count=1):
+    return torch.ones(count, device=device), torch.zeros(count, device=device)
+
+
+def quantize_weight(module, weight):
+    scale = (weight.abs().max().float() / 448.).reshape(1)
+    amax = torch.zeros(1, device=weight.device)
+    return module.fp8_quantize(weight, scale, amax, False), scale
+
+
+def allclose(x, y):
+    # e4m3 keeps 3 mantissa bits, compare relative to the output range.
+    return (x.float() - y.float()).abs().max() <= 0.1 * y.float().abs().max()
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("tokens", [1, 33])
+@pytest.mark.parametrize("in_features, out_features", [(512, 1536), (1024, 1024)])
+@pytest.mark.parametrize("e5m2", [False, True])
+def test_linear_layer_fp8(tokens, in_features, out_features, e5m2):
+    module = get_inference_module()
+    device = get_accelerator().device_name()
+    input = torch.randn((1, tokens, in_features), dtype=torch.float16, device=device)
+    weight = torch.randn((out_features, in_features), dtype=torch.float16, device=device) * 0.05
+    bias = torch.randn((out_features), dtype=torch.float16, device=device)
+    weight_fp8, weight_scale = quantize_weight(module, weight)
+    act_scale, act_amax = fp8_scales(device)
+
+    ref_out = torch.matmul(input.float(), weight.float().t()) + bias.float()
+    # The first call only measures the input, the second one runs with its scale.
+    for _ in range(2):
+        ds_out = module.linear_layer_fp8(input, weight_fp8, weight_scale, bias, True, act_scale, act_amax, e5m2)
+    assert allclose(ds_out, ref_out)
+    max_fp8 = 57344. if e5m2 else 448.
+    assert torch.allclose(act_scale, input.float().abs().max() / max_fp8)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("tokens", [1, 33])
+@pytest.mark.parametrize("hidden, intermediate", [(512, 2048)])
+@pytest.mark.parametrize("mlp_after_attn", [False, True])
+def test_mlp_gemm_fp8(tokens, hidden, intermediate, mlp_after_attn):
+    module = get_inference_module()
+    device = get_accelerator().device_name()
+    input = torch.randn((1, tokens, hidden), dtype=torch.float16, device=device)
+    residual = torch.randn((1, tokens, hidden), dtype=torch.float16, device=device)
+    input_bias = torch.randn((hidden), dtype=torch.float16, device=device)
+    gamma = torch.randn((hidden), dtype=torch.float16, device=device)
+    beta = torch.randn((hidden), dtype=torch.float16, device=device)
+    weight_interm = torch.randn((intermediate, hidden), dtype=torch.float16, device=device) * 0.05
+    weight_out = torch.randn((hidden, intermediate), dtype=torch.float16, device=device) * 0.05
+    bias = torch.randn((intermediate), dtype=torch.float16, device=device)
+    interm_fp8, interm_scale = quantize_weight(module, weight_interm)
+    out_fp8, out_scale = quantize_weight(module, weight_out)
+    act_scale, act_amax = fp8_scales(device, 2)
+
+    ln_input = input.float() + residual.float() + input_bias.float() if mlp_after_attn else input.float()
+    inp_norm = torch.nn.functional.layer_norm(ln_input, (hidden, ), gamma.float(), beta.float(), 1e-5)
+    act = torch.nn.functional.gelu(torch.matmul(inp_norm, weight_interm.float().t()) + bias.float(),
+                                   approximate='tanh')
+    ref_out = torch.matmul(act, weight_out.float().t())
+    for _ in range(2):
+        ds_out, ds_norm = module.mlp_gemm_fp8(input, residual, input_bias, interm_fp8, interm_scale, out_fp8,
+                                              out_scale, bias, gamma, beta, 1e-5, mlp_after_attn, act_scale,
+                                              act_amax, 1, False)
+    assert allclose(ds_norm, inp_norm)
+    assert allclose(ds_out, ref_out)
@@ -0,0 +1,44 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import deepspeed
+from deepspeed.ops.op_builder import InferenceBuilder
+
+if not deepspeed.ops.__compatible_ops__[InferenceBuilder.NAME]:
+    pytest.skip("Inference ops are not available on this system", allow_module_level=True)
+
+
+@pytest.mark.inference_ops
+def test_inference_contexts():
+    inference_module = InferenceBuilder().load()
+    heads, head_size = 4, 64
+    hidden = heads * head_size
+    assert inference_module.current_context() == 0
+
+    other = inference_module.create_context()
+    inference_module.select_context(other)
+    assert inference_module.current_context() == other
+    inference_module.allocate_workspace_fp16(hidden, heads, 8, 1, 1, 1, False, 0, 64, 1, 0, 0, False, 0)
+    inference_module.reset_cache()
+
+    capacity = inference_module.workspace_capacity()
+    assert inference_module.workspace_ptr() != 0 and capacity > 0
+
+    # A larger shape never shrinks the workspace, a smaller one then reuses it in place.
+    inference_module.allocate_workspace_fp16(hidden, heads, 8, 4, 1, 1, False, 0, 64, 1, 0, 0, False, 0)
+    workspace = inference_module.workspace_ptr()
+    assert inference_module.workspace_capacity() >= capacity
+    capacity = inference_module.workspace_capacity()
+    inference_module.allocate_workspace_fp16(hidden, heads, 8, 1, 1, 1, False, 0, 64, 1, 0, 0, False, 0)
+    assert inference_module.workspace_ptr() == workspace
+    assert inference_module.workspace_capacity() == capacity
+
+    inference_module.destroy_context(other)
+    assert inference_module.current_context() == 0
+    with pytest.raises(RuntimeError):
+        inference_module.select_context(other)
+    with pytest.raises(RuntimeError):
+        inference_module.destroy_context(0)
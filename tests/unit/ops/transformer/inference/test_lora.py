@@ -0,0 +1,62 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+import deepspeed
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import InferenceBuilder
+
+if not deepspeed.ops.__compatible_ops__[InferenceBuilder.NAME]:
+    pytest.skip("Inference ops are not available on this system", allow_module_level=True)
+
+inference_module = None
+
+
+def allclose(x, y):
+    assert x.dtype == y.dtype
+    rtol, atol = {torch.float32: (5e-4, 5e-5), torch.float16: (3e-2, 2e-2)}[x.dtype]
+    return torch.allclose(x, y, rtol=rtol, atol=atol)
+
+
+def run_lora_reference(output, input, lora_a, lora_b, token_ids, scale):
+    # output [tokens, out], input [tokens, in], token_ids [tokens]
+    out = output.float().clone()
+    for t, adapter in enumerate(token_ids.tolist()):
+        if adapter < 0:
+            continue
+        out[t] += scale * (input[t].float() @ lora_a[adapter].float().t() @ lora_b[adapter].float())
+    return out.to(output.dtype)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("dtype", [torch.float16, torch.float32])
+@pytest.mark.parametrize("per_token", [False, True])
+@pytest.mark.parametrize("rank", [8, 64])
+@pytest.mark.parametrize("in_features, out_features", [(1024, 3072), (768, 500)])
+def test_lora_bgmv(dtype, per_token, rank, in_features, out_features):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    device = get_accelerator().device_name()
+    batch, seq, adapters, scale = 4, 3, 3, 0.5
+    input = torch.randn((batch, seq, in_features), dtype=dtype, device=device)
+    output = torch.randn((batch, seq, out_features), dtype=dtype, device=device)
+    lora_a = torch.randn((adapters, rank, in_features), dtype=dtype, device=device) / in_features**0.5
+    lora_b = torch.randn((adapters, rank, out_features), dtype=dtype, device=device) / rank**0.5
+
+    # Sequences of every adapter and one of the base model in the same batch.
+    ids = torch.tensor([2, -1, 0, 1], dtype=torch.int32, device=device)
+    if per_token:
+        ids = torch.randint(-1, adapters, (batch * seq, ), dtype=torch.int32, device=device)
+    token_ids = ids if per_token else ids.repeat_interleave(seq)
+    ref_out = run_lora_reference(output.view(-1, out_features), input.view(-1, in_features), lora_a, lora_b,
+                                 token_ids, scale)
+
+    inference_module.set_lora_adapters(ids)
+    lora_func = inference_module.lora_bgmv_fp16 if dtype == torch.float16 else inference_module.lora_bgmv_fp32
+    ds_out = lora_func(output, input, lora_a, lora_b, scale)
+    inference_module.set_lora_adapters(torch.empty(0, dtype=torch.int32))
+    assert allclose(ds_out.view(-1, out_features), ref_out)
@@ -0,0 +1,65 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+import deepspeed
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import InferenceBuilder
+
+if not deepspeed.ops.__compatible_ops__[InferenceBuilder.NAME]:
+    pytest.skip("Inference ops are not available on this system", allow_module_level=True)
+
+inference_module = None
+
+
+def allclose(x, y):
+    assert x.dtype == y.dtype
+    rtol, atol = {torch.float32: (5e-4, 5e-4), torch.float16: (3e-2, 2e-2)}[x.dtype]
+    return torch.allclose(x, y, rtol=rtol, atol=atol)
+
+
+def run_moe_ffn_reference(input, logits, inter_w, inter_b, output_w, output_b, top_k):
+    gates = torch.softmax(logits, dim=-1)
+    weights, experts = torch.topk(gates, top_k, dim=-1)
+    if top_k > 1:
+        weights = weights / weights.sum(dim=-1, keepdim=True)
+    output = torch.zeros_like(input, dtype=torch.float32)
+    for e in range(len(inter_w)):
+        tokens, slots = torch.nonzero(experts == e, as_tuple=True)
+        if tokens.numel() == 0:
+            continue
+        x = input[tokens].float()
+        inter = torch.nn.functional.gelu(x @ inter_w[e].float() + inter_b[e].float(), approximate='tanh')
+        out = inter @ output_w[e].float() + output_b[e].float()
+        output.index_add_(0, tokens, out * weights[tokens, slots].unsqueeze(-1))
+    return output.to(input.dtype)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("tokens", [1, 7, 130])
+@pytest.mark.parametrize("experts, top_k", [(4, 1), (8, 2), (64, 2)])
+@pytest.mark.parametrize("dtype", [torch.float16, torch.float32], ids=["fp16", "fp32"])
+def test_moe_ffn(tokens, experts, top_k, dtype):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    device = get_accelerator().device_name()
+    hidden, intermediate = 256, 512
+    input = torch.randn((tokens, hidden), dtype=dtype, device=device)
+    logits = torch.randn((tokens, experts), dtype=torch.float32, device=device)
+    inter_w = [torch.randn((hidden, intermediate), dtype=dtype, device=device) * 0.05 for _ in range(experts)]
+    inter_b = [torch.randn((intermediate), dtype=dtype, device=device) for _ in range(experts)]
+    output_w = [torch.randn((intermediate, hidden), dtype=dtype, device=device) * 0.05 for _ in range(experts)]
+    output_b = [torch.randn((hidden), dtype=dtype, device=device) for _ in range(experts)]
+
+    def addresses(params):
+        return torch.tensor([p.data_ptr() for p in params], dtype=torch.int64, device=device)
+
+    moe_ffn = inference_module.moe_ffn_fp16 if dtype == torch.float16 else inference_module.moe_ffn_fp32
+    ds_out = moe_ffn(input, logits, addresses(inter_w), addresses(inter_b), addresses(output_w), addresses(output_b),
+                     intermediate, top_k)
+    ref_out = run_moe_ffn_reference(input, logits, inter_w, inter_b, output_w, output_b, top_k)
+    assert allclose(ds_out, ref_out)
@@ -0,0 +1,63 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import deepspeed
+import torch
+import pytest
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import InferenceBuilder
+
+if not deepspeed.ops.__compatible_ops__[InferenceBuilder.NAME]:
+    pytest.skip("Inference ops are not available on this system", allow_module_level=True)
+
+inference_module = None
+
+
+def get_inference_module():
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    return inference_module
+
+
+def run_rms_norm(batch, seq_len, channels):
+    vals = torch.randn((batch, seq_len, channels), dtype=torch.float16, device=get_accelerator().current_device_name())
+    gamma = torch.randn((channels), dtype=torch.float16, device=get_accelerator().current_device_name())
+    return get_inference_module().rms_norm(vals, gamma, 1e-5)
+
+
+@pytest.mark.inference_ops
+def test_timing_disabled():
+    module = get_inference_module()
+    module.set_instrumentation(nvtx=False, timing=False)
+    module.reset_op_timings()
+
+    run_rms_norm(1, 8, 1024)
+
+    assert module.get_op_timings() == []
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("nvtx", [False, True])
+def test_timing_per_shape(nvtx):
+    module = get_inference_module()
+    module.reset_op_timings()
+    module.set_instrumentation(nvtx=nvtx, timing=True)
+
+    for _ in range(3):
+        run_rms_norm(1, 8, 1024)
+    run_rms_norm(2, 16, 1024)
+    module.set_instrumentation()
+
+    timings = {(op["name"], tuple(op["shape"])): op for op in module.get_op_timings()}
+    assert set(timings.keys()) == {("rms_norm", (1, 8, 1024)), ("rms_norm", (2, 16, 1024))}
+
+    op = timings[("rms_norm", (1, 8, 1024))]
+    assert op["count"] == 3
+    assert 0 <= op["min_ms"] <= op["max_ms"] <= op["total_ms"]
+    assert timings[("rms_norm", (2, 16, 1024))]["count"] == 1
+
+    module.reset_op_timings()
+    assert module.get_op_timings() == []
@@ -0,0 +1,55 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+import deepspeed
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import InferenceBuilder
+
+if not deepspeed.ops.__compatible_ops__[InferenceBuilder.NAME]:
+    pytest.skip("Inference ops are not available on this system", allow_module_level=True)
+
+inference_module = None
+
+
+def allclose(x, y):
+    assert x.dtype == y.dtype
+    rtol, atol = {torch.float32: (5e-4, 5e-3), torch.float16: (3e-2, 5e-2)}[x.dtype]
+    return torch.allclose(x, y, rtol=rtol, atol=atol)
+
+
+# Up to 8 tokens the layer norm runs fused into the GEMM, past that it runs on its own.
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("tokens", [1, 5, 8, 9, 64])
+@pytest.mark.parametrize("hidden", [768, 1000])
+@pytest.mark.parametrize("transposed_mode", [False, True])
+@pytest.mark.parametrize("dtype", [torch.float16, torch.float32], ids=["fp16", "fp32"])
+def test_qkv_gemm(tokens, hidden, transposed_mode, dtype):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    device = get_accelerator().device_name()
+    heads = 8
+    if dtype == torch.float16:
+        inference_module.allocate_workspace_fp16(hidden, heads, tokens, 1, 1, 1, False, 0, 256, 1, 0, 0, False, 0)
+        qkv_gemm = inference_module.qkv_gemm_fp16
+    else:
+        inference_module.allocate_workspace_fp32(hidden, heads, tokens, 1, 1, 1, False, 0, 256, 1, 0, 0, False, 0)
+        qkv_gemm = inference_module.qkv_gemm_fp32
+
+    input = torch.randn((1, tokens, hidden), dtype=dtype, device=device)
+    weight = torch.randn((hidden, 3 * hidden), dtype=dtype, device=device) * 0.05
+    bias = torch.randn((3 * hidden), dtype=dtype, device=device)
+    gamma = torch.randn((hidden), dtype=dtype, device=device)
+    beta = torch.randn((hidden), dtype=dtype, device=device)
+
+    ref_norm = torch.nn.functional.layer_norm(input.float(), (hidden, ), gamma.float(), beta.float(), 1e-5)
+    ref_out = (torch.matmul(ref_norm, weight.float()) + bias.float()).to(dtype)
+    ds_weight = weight.t().contiguous() if transposed_mode else weight
+    ds_out, ds_norm = qkv_gemm(input, ds_weight, torch.empty(1), bias, gamma, beta, 1e-5, True, 1, False, 1, 0, False,
+                               transposed_mode)
+    assert allclose(ds_norm, ref_norm.to(dtype))
+    assert allclose(ds_out, ref_out)
@@ -0,0 +1,77 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import deepspeed
+import torch
+import pytest
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import InferenceBuilder
+
+if not deepspeed.ops.__compatible_ops__[InferenceBuilder.NAME]:
+    pytest.skip("Inference ops are not available on this system", allow_module_level=True)
+
+inference_module = None
+
+
+def allclose(x, y):
+    assert x.dtype == y.dtype
+    rtol, atol = {torch.float32: (5e-4, 5e-5), torch.float16: (3e-2, 2e-3)}[x.dtype]
+    return torch.allclose(x, y, rtol=rtol, atol=atol)
+
+
+def ref_implementation(vals, gamma, epsilon):
+    vals_f = vals.to(torch.float32)
+    variance = vals_f.pow(2).mean(-1, keepdim=True)
+    return (vals_f * torch.rsqrt(variance + epsilon) * gamma.to(torch.float32)).to(vals.dtype)
+
+
+def ds_implementation(vals, gamma, epsilon):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    return inference_module.rms_norm(vals, gamma, epsilon)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("batch", [1, 32])
+@pytest.mark.parametrize("seq_len", [1, 128])
+@pytest.mark.parametrize("channels", [64, 384, 512, 768, 1024, 2048, 8192, 14432])
+@pytest.mark.parametrize("dtype", [torch.float16, torch.float32])
+def test_rms_norm(batch, seq_len, channels, dtype):
+    vals = torch.randn((batch, seq_len, channels), dtype=dtype, device=get_accelerator().current_device_name())
+    gamma = torch.randn((channels), dtype=dtype, device=get_accelerator().current_device_name())
+    epsilon = 1e-5
+
+    ref_output = ref_implementation(vals, gamma, epsilon)
+    new_output = ds_implementation(vals, gamma, epsilon)
+
+    assert allclose(new_output, ref_output)
+
+
+def pre_rms_norm_ds_implementation(vals, res, gamma, epsilon):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    return inference_module.pre_rms_norm(vals, res, gamma, epsilon)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("batch", [1, 32])
+@pytest.mark.parametrize("seq_len", [1, 128])
+@pytest.mark.parametrize("channels", [64, 384, 512, 768, 1024, 2048, 8192, 14432])
+@pytest.mark.parametrize("dtype", [torch.float16, torch.float32])
+def test_pre_rms_norm(batch, seq_len, channels, dtype):
+    vals = torch.randn((batch, seq_len, channels), dtype=dtype, device=get_accelerator().current_device_name())
+    residual = torch.randn((batch, seq_len, channels), dtype=dtype, device=get_accelerator().current_device_name())
+    gamma = torch.randn((channels), dtype=dtype, device=get_accelerator().current_device_name())
+    epsilon = 1e-5
+
+    ref_res_output = vals + residual
+    ref_norm_output = ref_implementation(ref_res_output, gamma, epsilon)
+
+    ds_norm_output, ds_res_output = pre_rms_norm_ds_implementation(vals, residual, gamma, epsilon)
+
+    assert allclose(ds_res_output, ref_res_output)
+    assert allclose(ds_norm_output, ref_norm_output)
@@ -0,0 +1,86 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+import deepspeed
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import InferenceBuilder
+
+if not deepspeed.ops.__compatible_ops__[InferenceBuilder.NAME]:
+    pytest.skip("Inference ops are not available on this system", allow_module_level=True)
+
+inference_module = None
+
+
+def sample(logits, history=None, temperature=1.0, top_k=0, top_p=1.0, repetition_penalty=1.0, seed=0):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    if history is None:
+        history = torch.empty(0, dtype=torch.long, device=logits.device)
+    sample_func = inference_module.sample_tokens_fp16 if logits.dtype == torch.half else \
+        inference_module.sample_tokens_fp32
+    return sample_func(logits, history, temperature, repetition_penalty, top_k, top_p, seed, 0)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("vocab", [1000, 50257, 128256])
+@pytest.mark.parametrize("dtype", [torch.float16, torch.float32], ids=["fp16", "fp32"])
+def test_greedy(vocab, dtype):
+    logits = torch.randn((4, vocab), dtype=dtype, device=get_accelerator().device_name())
+    expected = logits.float().argmax(dim=-1)
+    assert torch.equal(sample(logits, temperature=0.0), expected)
+    assert torch.equal(sample(logits, top_k=1), expected)
+    # The top logit alone already holds more than a tiny top_p.
+    assert torch.equal(sample(logits, top_p=1e-6), expected)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("top_k", [5, 64])
+@pytest.mark.parametrize("dtype", [torch.float16, torch.float32], ids=["fp16", "fp32"])
+def test_top_k(top_k, dtype):
+    vocab = 32000
+    logits = torch.randn((8, vocab), dtype=dtype, device=get_accelerator().device_name())
+    allowed = logits.float().topk(top_k, dim=-1).indices
+    for seed in range(16):
+        tokens = sample(logits, top_k=top_k, temperature=2.0, seed=seed)
+        assert (allowed == tokens.unsqueeze(-1)).any(dim=-1).all()
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("top_p", [0.5, 0.9])
+def test_top_p(top_p):
+    vocab = 32000
+    logits = torch.randn((8, vocab), dtype=torch.float32, device=get_accelerator().device_name()) * 4
+    probs, order = logits.softmax(dim=-1).sort(dim=-1, descending=True)
+    # The smallest prefix of the sorted probabilities reaching top_p.
+    keep = (probs.cumsum(dim=-1) - probs) < top_p
+    for seed in range(16):
+        tokens = sample(logits, top_p=top_p, seed=seed)
+        position = (order == tokens.unsqueeze(-1)).int().argmax(dim=-1)
+        assert keep.gather(-1, position.unsqueeze(-1)).all()
+
+
+@pytest.mark.inference_ops
+def test_repetition_penalty():
+    device = get_accelerator().device_name()
+    logits = torch.randn((2, 1000), dtype=torch.float32, device=device)
+    top2 = logits.topk(2, dim=-1).indices
+    # A strong penalty on the best token makes the greedy choice the second best.
+    history = torch.stack([top2[:, 0], torch.full_like(top2[:, 0], -1)], dim=-1)
+    tokens = sample(logits, history=history, temperature=0.0, repetition_penalty=1e4)
+    assert torch.equal(tokens, top2[:, 1])
+
+
+@pytest.mark.inference_ops
+def test_distribution():
+    device = get_accelerator().device_name()
+    logits = torch.tensor([[0.0, 1.0, 2.0, -1.0]], device=device).repeat(4096, 1)
+    counts = torch.zeros(4, device=device)
+    for seed in range(8):
+        counts += torch.bincount(sample(logits, seed=seed), minlength=4)
+    expected = logits[0].softmax(dim=-1)
+    assert torch.allclose(counts / counts.sum(), expected, atol=0.02)
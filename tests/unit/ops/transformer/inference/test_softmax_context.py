@@ -0,0 +1,268 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import math
+import pytest
+import torch
+import deepspeed
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import InferenceBuilder
+
+if not deepspeed.ops.__compatible_ops__[InferenceBuilder.NAME]:
+    pytest.skip("Inference ops are not available on this system", allow_module_level=True)
+
+inference_module = None
+
+
+def allclose(x, y):
+    assert x.dtype == y.dtype
+    rtol, atol = {torch.float32: (5e-4, 5e-5), torch.float16: (3e-2, 2e-3)}[x.dtype]
+    return torch.allclose(x, y, rtol=rtol, atol=atol)
+
+
+def apply_rotary_reference(x, rotary_dim, rotate_half, theta, scale):
+    # x is [batch, heads, tokens, head_size], the first rotary_dim values of each head are rotated.
+    tokens = x.shape[2]
+    inv_freq = theta**(-torch.arange(0, rotary_dim, 2, dtype=torch.float64, device=x.device) / rotary_dim)
+    angles = torch.outer(torch.arange(tokens, dtype=torch.float64, device=x.device) / scale, inv_freq).float()
+    cos, sin = angles.cos(), angles.sin()
+    rot, rest = x[..., :rotary_dim], x[..., rotary_dim:]
+    if rotate_half:
+        lower, upper = rot.chunk(2, dim=-1)
+        rot = torch.cat([lower * cos - upper * sin, upper * cos + lower * sin], dim=-1)
+    else:
+        even, odd = rot[..., 0::2], rot[..., 1::2]
+        rot = torch.stack([even * cos - odd * sin, odd * cos + even * sin], dim=-1).flatten(-2)
+    return torch.cat([rot, rest], dim=-1)
+
+
+def run_attention_reference(qkv, heads, kv_heads, rotary=None):
+    batch, tokens, _ = qkv.shape
+    head_size = qkv.shape[-1] // (heads + 2 * kv_heads)
+    q, k, v = qkv.float().split([heads * head_size, kv_heads * head_size, kv_heads * head_size], dim=-1)
+    q = q.view(batch, tokens, heads, head_size).transpose(1, 2)
+    k = k.view(batch, tokens, kv_heads, head_size).transpose(1, 2)
+    if rotary is not None:
+        q = apply_rotary_reference(q, *rotary)
+        k = apply_rotary_reference(k, *rotary)
+    k = k.repeat_interleave(heads // kv_heads, dim=1)
+    v = v.view(batch, tokens, kv_heads, head_size).transpose(1, 2).repeat_interleave(heads // kv_heads, dim=1)
+    scores = torch.matmul(q, k.transpose(-1, -2)) / math.sqrt(head_size)
+    causal = torch.ones(tokens, tokens, dtype=torch.bool, device=qkv.device).tril()
+    scores = scores.masked_fill(~causal, float("-inf"))
+    out = torch.matmul(scores.softmax(dim=-1), v)
+    return out.transpose(1, 2).reshape(batch, tokens, heads * head_size).to(qkv.dtype)
+
+
+def run_attention_ds(qkv, heads, kv_heads, rotary_dim=-1, rotate_half=False, rotate_every_two=False):
+    head_size = qkv.shape[-1] // (heads + 2 * kv_heads)
+    norm_factor = 1 / math.sqrt(math.sqrt(head_size))
+    empty = torch.empty(1)
+    return inference_module.softmax_context_fp16(qkv, empty, rotary_dim, rotate_half, rotate_every_two, heads,
+                                                 kv_heads, norm_factor, True, False, 1, True, 0, 1, empty)[0]
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("batch", [1, 2])
+@pytest.mark.parametrize("prompt", [5, 17, 128])
+@pytest.mark.parametrize("heads, kv_heads", [(8, 8), (8, 2), (8, 1)], ids=["mha", "gqa", "mqa"])
+@pytest.mark.parametrize("head_size", [64, 128])
+def test_softmax_context(batch, prompt, heads, kv_heads, head_size):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    dtype = torch.float16
+    inference_module.allocate_workspace_fp16(heads * head_size, heads, prompt, batch, 1, 1, False, 0, 256, 1, 0, 0,
+                                             False, kv_heads)
+
+    # The prompt, then one decode step over the cached K/V of the prompt.
+    tokens = prompt + 1
+    qkv = torch.randn((batch, tokens, (heads + 2 * kv_heads) * head_size),
+                      dtype=dtype,
+                      device=get_accelerator().device_name())
+    ref_out = run_attention_reference(qkv, heads, kv_heads)
+
+    ds_prompt = run_attention_ds(qkv[:, :prompt].contiguous(), heads, kv_heads)
+    ds_decode = run_attention_ds(qkv[:, prompt:].contiguous(), heads, kv_heads)
+    assert allclose(ds_prompt, ref_out[:, :prompt])
+    assert allclose(ds_decode, ref_out[:, prompt:])
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("batch", [1, 2])
+@pytest.mark.parametrize("draft", [2, 4])
+@pytest.mark.parametrize("heads, kv_heads", [(8, 8), (8, 2)], ids=["mha", "gqa"])
+def test_softmax_context_verify(batch, draft, heads, kv_heads):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    dtype = torch.float16
+    head_size = 64
+    prompt = 17
+    inference_module.allocate_workspace_fp16(heads * head_size, heads, prompt, batch, 1, 1, False, 0, 256, 1, 0, 0,
+                                             False, kv_heads)
+
+    # The prompt, the draft tokens verified in one forward, then a decode step after rolling the cache
+    # back to the first accepted draft token.
+    accepted = prompt + 1
+    qkv = torch.randn((batch, prompt + draft + 1, (heads + 2 * kv_heads) * head_size),
+                      dtype=dtype,
+                      device=get_accelerator().device_name())
+    ref_verify = run_attention_reference(qkv[:, :prompt + draft], heads, kv_heads)
+    ref_decode = run_attention_reference(torch.cat([qkv[:, :accepted], qkv[:, -1:]], dim=1), heads, kv_heads)
+
+    run_attention_ds(qkv[:, :prompt].contiguous(), heads, kv_heads)
+    inference_module.append_next_forward()
+    ds_verify = run_attention_ds(qkv[:, prompt:prompt + draft].contiguous(), heads, kv_heads)
+    inference_module.truncate_kv_cache(accepted, -1)
+    ds_decode = run_attention_ds(qkv[:, -1:].contiguous(), heads, kv_heads)
+    assert allclose(ds_verify, ref_verify[:, prompt:])
+    assert allclose(ds_decode, ref_decode[:, -1:])
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("heads, kv_heads", [(8, 8), (8, 2)], ids=["mha", "gqa"])
+def test_softmax_context_ragged(heads, kv_heads):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    dtype = torch.float16
+    head_size, block_size = 64, 16
+    prompts = [21, 37]
+    inference_module.allocate_workspace_fp16(heads * head_size, heads, max(prompts), 2, 1, 1, False, 0, 256, 1,
+                                             block_size, 64, False, kv_heads)
+    inference_module.free_paged_kv()
+
+    width = (heads + 2 * kv_heads) * head_size
+    device = get_accelerator().device_name()
+    qkv0 = torch.randn((1, prompts[0] + 1, width), dtype=dtype, device=device)
+    qkv1 = torch.randn((1, prompts[1], width), dtype=dtype, device=device)
+    ref_out0 = run_attention_reference(qkv0, heads, kv_heads)
+    ref_out1 = run_attention_reference(qkv1, heads, kv_heads)
+
+    # Sequence 0 caches its prompt, then decodes its next token in the same launch as the prompt of
+    # sequence 1, the decode slot right padded to the prompt.
+    inference_module.set_ragged_batch([0], [prompts[0]])
+    run_attention_ds(qkv0[:, :prompts[0]].contiguous(), heads, kv_heads)
+
+    batch_qkv = torch.zeros((2, prompts[1], width), dtype=dtype, device=device)
+    batch_qkv[0, :1] = qkv0[0, prompts[0]:]
+    batch_qkv[1] = qkv1[0]
+    inference_module.set_ragged_batch([0, 1], [1, prompts[1]])
+    ds_out = run_attention_ds(batch_qkv, heads, kv_heads)
+
+    assert inference_module.sequence_length(0) == prompts[0] + 1
+    assert inference_module.sequence_length(1) == prompts[1]
+    assert allclose(ds_out[:1, :1], ref_out0[:, prompts[0]:])
+    assert allclose(ds_out[1:], ref_out1)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("kv_cache_int8", [False, True])
+def test_softmax_context_shared_prefix(kv_cache_int8):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    dtype = torch.float16
+    heads, kv_heads, head_size = 8, 2, 64
+    block_size, shared, prompt = 16, 37, 45
+    inference_module.allocate_workspace_fp16(heads * head_size, heads, prompt, 1, 1, 1, False, 0, 256, 1, block_size,
+                                             64, kv_cache_int8, kv_heads)
+    inference_module.free_paged_kv()
+
+    # Two prompts with the same first tokens, the second one reuses the full blocks of the first.
+    width = (heads + 2 * kv_heads) * head_size
+    qkv = torch.randn((2, prompt, width), dtype=dtype, device=get_accelerator().device_name())
+    qkv[1, :shared] = qkv[0, :shared]
+    tokens = [list(range(prompt)), list(range(shared)) + list(range(1000, 1000 + prompt - shared))]
+    ref_out = run_attention_reference(qkv[1:], heads, kv_heads)
+
+    inference_module.set_ragged_batch([0], [prompt])
+    run_attention_ds(qkv[:1].contiguous(), heads, kv_heads)
+    assert inference_module.register_prefix(0, tokens[0]) == prompt // block_size
+
+    matched = inference_module.match_prefix(1, tokens[1])
+    assert matched == shared // block_size * block_size
+    inference_module.set_ragged_batch([1], [prompt - matched])
+    ds_out = run_attention_ds(qkv[1:, matched:].contiguous(), heads, kv_heads)
+    assert inference_module.sequence_length(1) == prompt
+    if kv_cache_int8:
+        assert torch.allclose(ds_out, ref_out[:, matched:], rtol=5e-2, atol=2e-2)
+    else:
+        assert allclose(ds_out, ref_out[:, matched:])
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("rotate_half", [False, True], ids=["every_two", "half"])
+@pytest.mark.parametrize("rotary_dim", [16, 64])
+@pytest.mark.parametrize("theta, scale", [(10000.0, 1.0), (500000.0, 1.0), (10000.0, 4.0)],
+                         ids=["default", "ntk", "linear"])
+def test_softmax_context_rotary(rotate_half, rotary_dim, theta, scale):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    dtype = torch.float16
+    batch, heads, kv_heads, head_size, prompt = 2, 8, 2, 64, 17
+    inference_module.allocate_workspace_fp16(heads * head_size, heads, prompt, batch, 1, 1, False, 0, 256, 1, 0, 0,
+                                             False, kv_heads)
+    inference_module.set_rotary_base(theta, scale)
+
+    tokens = prompt + 1
+    qkv = torch.randn((batch, tokens, (heads + 2 * kv_heads) * head_size),
+                      dtype=dtype,
+                      device=get_accelerator().device_name())
+    ref_out = run_attention_reference(qkv, heads, kv_heads, (rotary_dim, rotate_half, theta, scale))
+
+    ds_prompt = run_attention_ds(qkv[:, :prompt].contiguous(), heads, kv_heads, rotary_dim, rotate_half,
+                                 not rotate_half)
+    ds_decode = run_attention_ds(qkv[:, prompt:].contiguous(), heads, kv_heads, rotary_dim, rotate_half,
+                                 not rotate_half)
+    inference_module.set_rotary_base(10000.0, 1.0)
+    assert allclose(ds_prompt, ref_out[:, :prompt])
+    assert allclose(ds_decode, ref_out[:, prompt:])
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("heads, kv_heads", [(8, 8), (8, 2)], ids=["mha", "gqa"])
+def test_softmax_context_graph_replay(heads, kv_heads):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    dtype = torch.float16
+    batch, head_size, prompt, steps = 2, 64, 17, 8
+    inference_module.allocate_workspace_fp16(heads * head_size, heads, prompt, batch, 1, 1, False, 0, 256, 1, 0, 0,
+                                             False, kv_heads)
+
+    qkv = torch.randn((batch, prompt + steps, (heads + 2 * kv_heads) * head_size),
+                      dtype=dtype,
+                      device=get_accelerator().device_name())
+    ref_out = run_attention_reference(qkv, heads, kv_heads)
+
+    # Eager decoding from the host side token count
+    run_attention_ds(qkv[:, :prompt].contiguous(), heads, kv_heads)
+    eager_out = [
+        run_attention_ds(qkv[:, prompt + i:prompt + i + 1].contiguous(), heads, kv_heads) for i in range(steps)
+    ]
+
+    inference_module.set_device_positions(True)
+    try:
+        # One eager step before the capture, the prompt then sets the positions back to its length.
+        static_qkv = qkv[:, prompt:prompt + 1].clone()
+        run_attention_ds(qkv[:, :prompt].contiguous(), heads, kv_heads)
+        run_attention_ds(static_qkv, heads, kv_heads)
+        run_attention_ds(qkv[:, :prompt].contiguous(), heads, kv_heads)
+        torch.cuda.synchronize()
+
+        graph = torch.cuda.CUDAGraph()
+        with torch.cuda.graph(graph):
+            static_out = run_attention_ds(static_qkv, heads, kv_heads)
+
+        for i in range(steps):
+            static_qkv.copy_(qkv[:, prompt + i:prompt + i + 1])
+            graph.replay()
+            assert allclose(static_out, eager_out[i])
+            assert allclose(static_out, ref_out[:, prompt + i:prompt + i + 1])
+    finally:
+        inference_module.set_device_positions(False)
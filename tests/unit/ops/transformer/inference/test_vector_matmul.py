@@ -0,0 +1,83 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+import deepspeed
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import InferenceBuilder
+
+if not deepspeed.ops.__compatible_ops__[InferenceBuilder.NAME]:
+    pytest.skip("Inference ops are not available on this system", allow_module_level=True)
+
+inference_module = None
+
+
+def allclose(x, y):
+    assert x.dtype == y.dtype
+    rtol, atol = {torch.float32: (5e-4, 5e-3), torch.float16: (3e-2, 5e-2)}[x.dtype]
+    return torch.allclose(x, y, rtol=rtol, atol=atol)
+
+
+# The chunks of rows, as the tensor parallel all-reduce pipeline runs them, add up to the full GEMM.
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("tokens", [1, 7, 64])
+@pytest.mark.parametrize("chunks", [1, 2, 4])
+@pytest.mark.parametrize("transposed_mode", [False, True])
+@pytest.mark.parametrize("dtype", [torch.float16, torch.float32], ids=["fp16", "fp32"])
+def test_vector_matmul_rows(tokens, chunks, transposed_mode, dtype):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    device = get_accelerator().device_name()
+    hidden = 1024
+    if dtype == torch.float16:
+        inference_module.allocate_workspace_fp16(hidden, 8, tokens, 2, 1, 1, False, 0, 256, 1, 0, 0, False, 0)
+        vector_matmul_rows = inference_module.vector_matmul_rows_fp16
+    else:
+        inference_module.allocate_workspace_fp32(hidden, 8, tokens, 2, 1, 1, False, 0, 256, 1, 0, 0, False, 0)
+        vector_matmul_rows = inference_module.vector_matmul_rows_fp32
+
+    input = torch.randn((2, tokens, hidden), dtype=dtype, device=device)
+    weight = torch.randn((hidden, hidden), dtype=dtype, device=device) * 0.05
+    ref_out = torch.matmul(input.float(), (weight.t() if transposed_mode else weight).float()).to(dtype)
+
+    rows = 2 * tokens
+    chunk_rows = (rows + chunks - 1) // chunks
+    for row_begin in range(0, rows, chunk_rows):
+        output = vector_matmul_rows(input, weight, row_begin, min(row_begin + chunk_rows, rows), torch.empty(1),
+                                    False, transposed_mode)
+    assert allclose(output, ref_out)
+
+
+# The first call for a shape times the cuBLAS algorithms, the next one runs the cached winner.
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("tokens", [1, 37])
+@pytest.mark.parametrize("dtype", [torch.float16, torch.float32], ids=["fp16", "fp32"])
+def test_vector_matmul_autotune(tokens, dtype, tmp_path, monkeypatch):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    monkeypatch.setenv("DS_GEMM_ALGO_CACHE_DIR", str(tmp_path))
+    device = get_accelerator().device_name()
+    hidden = 1024
+    if dtype == torch.float16:
+        inference_module.allocate_workspace_fp16(hidden, 8, tokens, 1, 1, 1, False, 0, 256, 1, 0, 0, False, 0)
+        vector_matmul = inference_module.vector_matmul_fp16
+    else:
+        inference_module.allocate_workspace_fp32(hidden, 8, tokens, 1, 1, 1, False, 0, 256, 1, 0, 0, False, 0)
+        vector_matmul = inference_module.vector_matmul_fp32
+
+    input = torch.randn((1, tokens, hidden), dtype=dtype, device=device)
+    weight = torch.randn((hidden, hidden), dtype=dtype, device=device) * 0.05
+    ref_out = torch.matmul(input.float(), weight.float()).to(dtype)
+
+    inference_module.set_gemm_autotune(True)
+    try:
+        for _ in range(2):
+            output = vector_matmul(input, weight, False, torch.empty(1), False, False)
+            assert allclose(output, ref_out)
+    finally:
+        inference_module.set_gemm_autotune(False)
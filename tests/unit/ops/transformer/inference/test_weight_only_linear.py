@@ -0,0 +1,69 @@
+# Copyright (c) Microsoft Corporation.
+# SPDX-License-Identifier: Apache-2.0
+
+# DeepSpeed Team
+
+import pytest
+import torch
+import deepspeed
+from deepspeed.accelerator import get_accelerator
+from deepspeed.ops.op_builder import InferenceBuilder
+
+if not deepspeed.ops.__compatible_ops__[InferenceBuilder.NAME]:
+    pytest.skip("Inference ops are not available on this system", allow_module_level=True)
+
+inference_module = None
+
+
+def allclose(x, y):
+    assert x.dtype == y.dtype
+    rtol, atol = {torch.float32: (5e-4, 5e-4), torch.float16: (3e-2, 2e-2)}[x.dtype]
+    return torch.allclose(x, y, rtol=rtol, atol=atol)
+
+
+def quantize_weight(out_features, in_features, bits, group_size, use_zeros):
+    device = get_accelerator().device_name()
+    groups = in_features // group_size
+    scales = torch.rand((out_features, groups), device=device) * 0.02 + 0.001
+    if bits == 8:
+        q = torch.randint(-128, 128, (out_features, in_features), dtype=torch.int32, device=device)
+    else:
+        q = torch.randint(0, 16, (out_features, in_features), dtype=torch.int32, device=device)
+    if use_zeros:
+        zeros = torch.randint(0, 2**(bits - 1), (out_features, groups), device=device).float()
+    else:
+        zeros = torch.full((out_features, groups), 0. if bits == 8 else 8., device=device)
+    dequantized = (q.float() - zeros.repeat_interleave(group_size, dim=1)) * scales.repeat_interleave(group_size, 1)
+    if bits == 8:
+        packed = q.to(torch.int8).view(torch.uint8)
+    else:
+        packed = (q[:, 0::2] | (q[:, 1::2] << 4)).to(torch.uint8)
+    return packed, scales, (zeros if use_zeros else None), dequantized
+
+
+def run_weight_only_linear_ds(input, weight, scales, zeros, bias, bits, group_size):
+    global inference_module
+    if inference_module is None:
+        inference_module = InferenceBuilder().load()
+    zeros = zeros if zeros is not None else torch.empty(1)
+    if input.dtype == torch.float16:
+        return inference_module.weight_only_linear_fp16(input, weight, scales, zeros, bias, True, bits, group_size)
+    else:
+        return inference_module.weight_only_linear_fp32(input, weight, scales, zeros, bias, True, bits, group_size)
+
+
+@pytest.mark.inference_ops
+@pytest.mark.parametrize("tokens", [1, 3, 8, 9, 200])
+@pytest.mark.parametrize("in_features, out_features", [(512, 1536), (4096, 1000)])
+@pytest.mark.parametrize("bits", [4, 8])
+@pytest.mark.parametrize("group_size, use_zeros", [(64, True), (128, False)])
+@pytest.mark.parametrize("dtype", [torch.float16, torch.float32], ids=["fp16", "fp32"])
+def test_weight_only_linear(tokens, in_features, out_features, bits, group_size, use_zeros, dtype):
+    device = get_accelerator().device_name()
+    weight, scales, zeros, dequantized = quantize_weight(out_features, in_features, bits, group_size, use_zeros)
+    input = torch.randn((1, tokens, in_features), dtype=dtype, device=device)
+    bias = torch.randn((out_features), dtype=dtype, device=device)
+
+    ref_out = (torch.matmul(input.float(), dequantized.t()) + bias.float()).to(dtype)
+    ds_out = run_weight_only_linear_ds(input, weight, scales, zeros, bias, bits, group_size)
+    assert allclose(ds_out, ref_out)
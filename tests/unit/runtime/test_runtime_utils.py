@@ -77,3 +77,27 @@ class TestCheckOverflow(DistributedTest):
             overflow_checker = ds_utils.CheckOverflow([parameters])
             overflow = overflow_checker.check()
         assert overflow
+
+
+def test_persistent_flat_buffers():
+    from deepspeed.ops.op_builder import UtilsBuilder
+
+    flat_buffers = ds_utils.PersistentFlatBuffers(UtilsBuilder().load())
+    tensors = [torch.randn(3, 5), torch.randn(7), torch.randn(2, 2, 2)]
+
+    flat = flat_buffers.flatten(tensors)
+    assert torch.equal(flat, _flatten_dense_tensors(tensors))
+    # The same buffer is handed out again, also for smaller buckets.
+    assert flat_buffers.flatten(tensors).data_ptr() == flat.data_ptr()
+    assert flat_buffers.flatten(tensors[1:]).data_ptr() == flat.data_ptr()
+
+    flat = flat_buffers.flatten(tensors)
+    flat.mul_(2)
+    expected = [t * 2 for t in tensors]
+    flat_buffers.unflatten_into(flat, tensors)
+    for t, e in zip(tensors, expected):
+        assert torch.equal(t, e)
+
+    bound = flat_buffers.bind(tensors)
+    bound.zero_()
+    assert all(torch.count_nonzero(t) == 0 for t in tensors)